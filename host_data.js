@@ -6,12 +6,22 @@ const socketIo = require('socket.io');
 const fs = require('fs');
 const path = require('path');
 const WebSocket = require('ws');
+const EventEmitter = require('events');
+const { STATE_NAMES, leaderOf, parseStatusLine } = require('./lib/telemetry');
+const { LogStore } = require('./lib/log_store');
+const { ActivityAnalytics } = require('./lib/analytics');
+const { ALL, HORIZONS, Leaderboard, parseWeights } = require('./lib/leaderboard');
+const { epochUs, timesyncReply } = require('./lib/timesync');
+const { FirmwareStore, runRollout } = require('./lib/ota_rollout');
+const { Tracer, parseTrace } = require('./lib/trace');
+const { Checkpoint, Watermarks } = require('./lib/checkpoint');
 const app = express();
 const server = http.createServer(app);
 const io = socketIo(server);
 
 // Serve static files from the current directory
 app.use(express.static(__dirname));
+app.use(express.json());
 
 // Route for video page
 app.get('/video', (req, res) => {
@@ -23,100 +33,154 @@ app.get('/chart', (req, res) => {
     res.sendFile(path.join(__dirname, 'public', 'chart.html'));
 });
 
-// Function to parse duration string into seconds
-function parseDuration(durationStr) {
-    const parts = durationStr.split(':').map(Number);
-    let seconds = 0;
-    if (parts.length === 3) {
-        // HH:MM:SS
-        seconds = parts[0] * 3600 + parts[1] * 60 + parts[2];
-    } else if (parts.length === 2) {
-        // MM:SS
-        seconds = parts[0] * 60 + parts[1];
-    } else if (parts.length === 1) {
-        // SS
-        seconds = parts[0];
-    }
-    return seconds;
-}
+// cat_status_log.txt is compacted into logs/cat_status_log/ as it grows; totals come
+// from the day rollups plus whatever is still in the live file. STATUS_LOG puts it (and
+// its logs/ directory) elsewhere, as tools/replay.js does for a scratch server.
+const statusLog = new LogStore(process.env.STATUS_LOG || path.join(__dirname, 'cat_status_log.txt'), 'status');
 
-// Function to compute the leader ID based on "Wander Time" and "Moonwalk Time"
+// Per-state weights for the leader and leaderboards, e.g. LEADERBOARD_WEIGHTS=wander=1,moonwalk=2
+const weights = parseWeights(process.env.LEADERBOARD_WEIGHTS || '');
+
+// Function to compute the leader ID based on weighted "Wander Time" and "Moonwalk Time"
 function computeLeaderId(callback) {
-    fs.readFile(path.join(__dirname, 'cat_status_log.txt'), 'utf8', (err, data) => {
+    statusLog.totals((err, totals) => {
         if (err) {
             console.error('Error reading cat_status_log.txt:', err);
             callback(null);
             return;
         }
 
-        const lines = data.trim().split('\n');
-
-        // Initialize data structure
-        const catDurations = {
-            '1': 0, // For cat on port 3333
-            '2': 0, // For cat on port 3334
-            '3': 0  // For cat on port 3335
-        };
+        callback(leaderOf(totals.cats, weights));
+    });
+}
 
-        // Process each line
-        lines.forEach(line => {
-            if (line.trim() === '') return;
+// Sessions, daily and hourly summaries, session-length histograms and streaks over the
+// status log history, scanned in parallel and cached (see lib/analytics.js)
+// GET /analytics?from=2024-10-01&to=2024-10-30&cats=1,2&goal=30 (default: the last 7 days)
+const analytics = new ActivityAnalytics(statusLog);
+
+app.get('/analytics', (req, res) => {
+    analytics.query({
+        from: req.query.from,
+        to: req.query.to,
+        cats: req.query.cats ? String(req.query.cats).split(',') : null,
+        goalMinutes: req.query.goal
+    }).then(
+        result => res.json(result),
+        (err) => {
+            if (!err.status) {
+                console.error('Analytics query failed:', err);
+            }
+            res.status(err.status || 500).json({ error: err.message });
+        }
+    );
+});
 
-            // Parse line
-            const parts = line.split(' | ');
-            let port = null;
-            let content = null;
+app.get('/analytics/stats', (req, res) => {
+    res.json(analytics.stats());
+});
 
-            parts.forEach(part => {
-                if (part.startsWith('Port ')) {
-                    port = part.substring('Port '.length).trim();
-                } else if (part.startsWith('Message: ')) {
-                    content = part.substring('Message: '.length).trim();
-                }
-            });
+// Top-K leaderboards over the last minute, 10 minutes, hour and day, for every cat and for
+// each group in collar_groups.json, updated record by record (see lib/leaderboard.js)
+function loadGroups() {
+    try {
+        return JSON.parse(fs.readFileSync(path.join(__dirname, 'collar_groups.json'), 'utf8'));
+    } catch (err) {
+        if (err.code !== 'ENOENT') {
+            console.error('Error reading collar_groups.json:', err);
+        }
+        return {};
+    }
+}
 
-            if (port && content) {
-                // Determine cat ID based on port
-                let catId = null;
-                if (port === '3333') {
-                    catId = '1';
-                } else if (port === '3334') {
-                    catId = '2';
-                } else if (port === '3335') {
-                    catId = '3';
-                } else {
-                    console.error('Unknown port:', port);
-                    return;
-                }
+const leaderboard = new Leaderboard({ weights, groups: loadGroups() });
 
-                // Parse content to get duration and state
-                let [durationStr, stateStr] = content.split(', Cat state:');
-                const durationInSeconds = parseDuration(durationStr.trim());
-                const state = stateStr ? stateStr.trim() : '';
+// Latency of each status record from the collar's sampling window to the leader on /buzz,
+// by stage (see lib/trace.js); GET /metrics
+const tracer = new Tracer(['window', 'send', 'network', 'store', 'leader', 'buzz', 'total']);
 
-                // Accumulate if state is "Wander Time" or "Moonwalk Time"
-                if (state === 'Wander Time' || state === 'Moonwalk Time') {
-                    catDurations[catId] += durationInSeconds;
-                }
-            } else {
-                console.error('Invalid line format:', line);
-            }
-        });
+// The leaderboards are checkpointed into logs/cat_status_log/checkpoint.bin every minute
+// and on shutdown, with each collar's last record applied; a restart restores them and
+// replays only the lines logged since (see lib/checkpoint.js)
+const checkpoint = new Checkpoint(path.join(statusLog.dir, 'checkpoint.bin'));
+const watermarks = new Watermarks();
 
-        // Find the cat with the maximum duration
-        let leaderId = null;
-        let maxDuration = -1;
-        for (let catId in catDurations) {
-            if (catDurations[catId] > maxDuration) {
-                maxDuration = catDurations[catId];
-                leaderId = catId;
+// readUs: when a followed batch was read, to trace its records; undefined for replays,
+// which skip the records the checkpoint already holds
+function feedLeaderboard(lines, readUs) {
+    lines.toString('utf8').split('\n').forEach((line) => {
+        const record = line.trim() === '' ? null : parseStatusLine(line);
+        if (!record || record.id === null) {
+            return;
+        }
+        const ms = Number(record.id);
+        if (readUs === undefined) {
+            if (!watermarks.replayed(record.port, ms)) {
+                return;
             }
+        } else {
+            watermarks.note(record.port, ms);
+        }
+        const state = STATE_NAMES.indexOf(record.state);
+        if (state >= 0) {
+            leaderboard.update(record.catId || record.port, ms, state, record.duration);
+        }
+        const trace = readUs !== undefined ? parseTrace(line) : null;
+        if (trace && tracer.live(ms)) {
+            const originUs = tracer.arrive(trace, record.sourceTimeUs, ms * 1000, readUs);
+            tracer.hold(`${record.port}/${trace.id}`, { originUs, readUs });
         }
-
-        callback(leaderId);
     });
 }
 
+// Restore the last checkpoint and replay what was logged since, or without one the last
+// day; then follow the live file and start checkpointing
+const startedMs = Date.now();
+const saved = checkpoint.load();
+if (saved) {
+    leaderboard.restore(saved.state.leaderboard);
+    watermarks.restore(saved.state.watermarks);
+}
+const longestMs = HORIZONS[HORIZONS.length - 1].ms;
+const replayFromMs = Math.max(saved ? saved.savedMs : 0, startedMs - longestMs);
+statusLog.replaySince(replayFromMs, lines => feedLeaderboard(lines)).then((offset) => {
+    statusLog.follow(lines => feedLeaderboard(lines, Number(epochUs())), offset);
+    checkpoint.start(() => ({ leaderboard: leaderboard.snapshot(), watermarks: watermarks.snapshot() }));
+    console.log(`Leaderboards ready in ${Date.now() - startedMs} ms (` +
+        (saved ? `checkpoint from ${new Date(saved.savedMs).toISOString()}` : 'no checkpoint') +
+        `, replayed from ${new Date(replayFromMs).toISOString()})`);
+}).catch((err) => {
+    console.error('Error loading the leaderboards:', err);
+});
+
+// GET /leaderboard?horizon=1h&group=living_room&k=5 (default: every horizon, all cats, top 10)
+app.get('/leaderboard', (req, res) => {
+    const group = req.query.group ? String(req.query.group) : ALL;
+    const k = req.query.k ? parseInt(req.query.k, 10) : undefined;
+    if (k !== undefined && !(k > 0)) {
+        res.status(400).json({ error: 'k must be a positive number' });
+        return;
+    }
+    const horizons = req.query.horizon ? [String(req.query.horizon)] : HORIZONS.map(horizon => horizon.name);
+    const boards = {};
+    for (const horizon of horizons) {
+        boards[horizon] = leaderboard.top(horizon, group, k);
+        if (!boards[horizon]) {
+            res.status(400).json({ error: `Unknown horizon ${horizon} or group ${group}` });
+            return;
+        }
+    }
+    res.json({ group, weights, asOf: new Date().toISOString(), boards });
+});
+
+app.get('/leaderboard/stats', (req, res) => {
+    res.json({ ...leaderboard.stats(), checkpoint: checkpoint.stats() });
+});
+
+app.get('/metrics', (req, res) => {
+    res.json(tracer.metrics());
+});
+
 // Set up the WebSocket server on the same HTTP server, listening on '/buzz'
 const wss = new WebSocket.Server({
     server,
@@ -124,35 +188,239 @@ const wss = new WebSocket.Server({
     perMessageDeflate: false // Disable permessage-deflate compression
 });
 
-wss.on('connection', (ws) => {
+// Collars announce themselves with "HELLO <catId> rev=<n> fw=<version> boot_sample=<ms>
+// boot_uplink=<ms> leader=seq" so config and firmware can be pushed by cat ID. The boot fields
+// are how long the collar took from power-up to its first sample and to first reaching us;
+// leader=seq asks for numbered leader pushes, which it handles once whichever path brings them.
+const collars = new Map(); // catId -> { ws, revision, fw, boot }
+const CONFIG_ACK_TIMEOUT_MS = 5000;
+
+// Every message from an identified collar, for the OTA rollout to wait on
+const collarMessages = new EventEmitter();
+collarMessages.setMaxListeners(0);
+
+wss.on('connection', (ws, req) => {
     console.log('A new client connected to /buzz!');
+    ws.pendingConfig = null;
+    // The address the collar reached us on is one it can download firmware from
+    ws.localAddress = req.socket.localAddress.replace(/^::ffff:/, '');
 
     // Handle messages received from the ESP32 client
     ws.on('message', (message) => {
-        console.log('Received from ESP32:', message);
+        // Stamp before anything else so time sync sees only network delay
+        const receivedUs = epochUs();
+        const text = message.toString();
+
+        const reply = timesyncReply(text, receivedUs);
+        if (reply) {
+            ws.send(reply);
+            return;
+        }
+        console.log('Received from ESP32:', text);
+
+        if (text.startsWith('HELLO ')) {
+            const [, catId, ...fields] = text.split(' ');
+            const info = Object.fromEntries(fields.map(field => field.split('=')));
+            ws.catId = catId;
+            ws.leaderSeq = info.leader === 'seq';
+            const boot = 'boot_sample' in info
+                ? { sampleMs: Number(info.boot_sample), uplinkMs: Number(info.boot_uplink) }
+                : null;
+            collars.set(catId, { ws, revision: Number(info.rev || 0), fw: info.fw || null, boot });
+        } else if (text.startsWith('CFG ') && ws.pendingConfig) {
+            // Replies are "CFG ACK rev=<n> [reboot]", "CFG NAK rev=<n> <reason>" or "CFG VAL ..."
+            const pending = ws.pendingConfig;
+            ws.pendingConfig = null;
+            clearTimeout(pending.timer);
+            pending.resolve(text);
+        }
+        if (ws.catId) {
+            collarMessages.emit('message', ws.catId, text);
+        }
+    });
 
-        // Process the message as needed
-        // For example, you can save it to a file or broadcast to other clients
+    ws.on('close', () => {
+        if (ws.catId && collars.get(ws.catId)?.ws === ws) {
+            collars.delete(ws.catId);
+        }
+        if (ws.pendingConfig) {
+            const pending = ws.pendingConfig;
+            ws.pendingConfig = null;
+            clearTimeout(pending.timer);
+            pending.resolve('CFG NAK rev=0 disconnected');
+        }
     });
 
     // Optionally send a welcome message to the client
     ws.send('Welcome to the /buzz WebSocket server!');
 });
 
+// Send one CFG command to a collar and wait for its reply
+function sendConfigCommand(catId, command) {
+    return new Promise((resolve) => {
+        const collar = collars.get(catId);
+        if (!collar || collar.ws.readyState !== WebSocket.OPEN) {
+            resolve({ catId, ok: false, reply: 'not connected' });
+            return;
+        }
+        if (collar.ws.pendingConfig) {
+            resolve({ catId, ok: false, reply: 'busy' });
+            return;
+        }
+
+        const finish = (reply) => {
+            const ok = reply.startsWith('CFG ACK') || reply.startsWith('CFG VAL');
+            const rev = /rev=(\d+)/.exec(reply);
+            if (ok && rev) {
+                collar.revision = Number(rev[1]);
+            }
+            resolve({ catId, ok, reply });
+        };
+        collar.ws.pendingConfig = {
+            resolve: finish,
+            timer: setTimeout(() => {
+                collar.ws.pendingConfig = null;
+                finish('CFG NAK rev=0 timeout');
+            }, CONFIG_ACK_TIMEOUT_MS)
+        };
+        collar.ws.send(command);
+    });
+}
+
+// Push config to a group of collars in parallel
+// Body: { "cats": ["1", "2"] | "all", "set": { "sample_period_ms": 250 } | "rollback": true | "get": true }
+app.post('/config', (req, res) => {
+    const { cats, set, rollback, get } = req.body || {};
+    const targets = cats === 'all' || !cats ? [...collars.keys()] : cats.map(String);
+
+    let command;
+    if (rollback) {
+        command = 'CFG ROLLBACK';
+    } else if (get) {
+        command = 'CFG GET';
+    } else if (set && Object.keys(set).length > 0) {
+        const pairs = Object.entries(set).map(([key, value]) => `${key}=${value}`);
+        if (pairs.some(pair => /\s/.test(pair))) {
+            res.status(400).json({ error: 'Config values may not contain whitespace' });
+            return;
+        }
+        command = `CFG SET ${pairs.join(' ')}`;
+    } else {
+        res.status(400).json({ error: 'Expected one of set, rollback or get' });
+        return;
+    }
+
+    Promise.all(targets.map(catId => sendConfigCommand(catId, command))).then(results => {
+        res.json({ command, results });
+    });
+});
+
+app.get('/config', (req, res) => {
+    const connected = [...collars.entries()].map(([catId, c]) => ({
+        catId, revision: c.revision, fw: c.fw, boot: c.boot
+    }));
+    res.json({ collars: connected });
+});
+
+// Firmware rollout: images in firmware/<version>.bin, patches served from firmware/patches
+const firmware = new FirmwareStore(path.join(__dirname, 'firmware'));
+app.use('/ota/patches', express.static(firmware.patchDir));
+let rollout = null;
+
+// Resolve with the first message from catId that matches, or null after timeoutMs
+function waitForCollar(catId, predicate, timeoutMs) {
+    return new Promise((resolve) => {
+        const onMessage = (from, text) => {
+            if (from === catId && predicate(text)) {
+                finish(text);
+            }
+        };
+        const finish = (text) => {
+            clearTimeout(timer);
+            collarMessages.off('message', onMessage);
+            resolve(text);
+        };
+        const timer = setTimeout(() => finish(null), timeoutMs);
+        collarMessages.on('message', onMessage);
+    });
+}
+
+const rolloutHooks = {
+    collarVersion: (catId) => {
+        const collar = collars.get(catId);
+        return collar && collar.ws.readyState === WebSocket.OPEN ? (collar.fw || '') : null;
+    },
+    send: (catId, text) => {
+        const collar = collars.get(catId);
+        if (!collar || collar.ws.readyState !== WebSocket.OPEN) {
+            return false;
+        }
+        collar.ws.send(text);
+        return true;
+    },
+    waitFor: waitForCollar,
+    patchUrl: (catId, file) => `http://${collars.get(catId).ws.localAddress}:${PORT}/ota/patches/${file}`
+};
+
+// Start a staged rollout; progress is polled with GET /ota
+// Body: { "version": "1.1.0", "cats": ["1", "2"] | "all", "waves": [1, 4, 16], "parallel": 4, "maxFailures": 0 }
+app.post('/ota', (req, res) => {
+    const { version, cats, waves, parallel, maxFailures } = req.body || {};
+    if (rollout && !rollout.finished) {
+        res.status(409).json({ error: `Rollout of ${rollout.version} still running` });
+        return;
+    }
+    if (typeof version !== 'string' || !firmware.has(version)) {
+        res.status(400).json({ error: `No image firmware/${version}.bin` });
+        return;
+    }
+    const targets = cats === 'all' || !cats ? [...collars.keys()] : cats.map(String);
+    const options = { version, cats: targets, waves, parallel, maxFailures };
+
+    rollout = { version, finished: false, results: [] };
+    runRollout(options, firmware, rolloutHooks, (state) => {
+        rollout = state;
+    }).catch((err) => {
+        console.error('Rollout failed:', err);
+        rollout = { version, finished: true, error: err.message, results: [] };
+    });
+    res.status(202).json({ version, targets });
+});
+
+app.get('/ota', (req, res) => {
+    res.json({ rollout });
+});
+
+// Leader pushes are numbered for collars that asked (see HELLO), from the clock so the
+// numbers keep growing across restarts of this server
+let leaderSeq = Math.floor(Date.now() / 1000);
+
 // Periodically compute and send the leader ID to connected clients
 setInterval(() => {
+    // Every line read so far is in the totals this computation reads
+    const traced = tracer.drain();
     computeLeaderId((leaderId) => {
+        const leaderUs = Number(epochUs());
         if (leaderId) {
             console.log('Current leader ID:', leaderId);
             // Send leader ID to all connected clients in '/buzz'
+            const numbered = `LEADER ${++leaderSeq} ${leaderId}`;
             wss.clients.forEach((client) => {
                 if (client.readyState === WebSocket.OPEN) {
-                    client.send(leaderId);
+                    client.send(client.leaderSeq ? numbered : leaderId);
                 }
             });
         } else {
             console.error('Failed to compute leader ID');
         }
+        const sentUs = Number(epochUs());
+        traced.forEach(({ originUs, readUs }) => {
+            tracer.record('leader', leaderUs - readUs);
+            if (leaderId) {
+                tracer.record('buzz', sentUs - leaderUs);
+                tracer.record('total', sentUs - originUs);
+            }
+        });
     });
 }, 5000); // Send every 5 seconds
 // Namespace for chart data
@@ -160,75 +428,15 @@ const chartNamespace = io.of('/chart');
 
 chartNamespace.on('connection', (socket) => {
     console.log('New client connected to chart namespace');
-    fs.readFile(path.join(__dirname, 'cat_status_log.txt'), 'utf8', (err, data) => {
+    statusLog.totals((err, totals) => {
         if (err) {
             console.error('Error reading cat_status_log.txt:', err);
             socket.emit('data', { error: 'Failed to load data.' });
             return;
         }
 
-        const lines = data.trim().split('\n');
-
-        // Initialize data structure
-        const catStates = {
-            '1': {}, // For cat on port 3333
-            '2': {}, // For cat on port 3334
-            '3': {}  // For cat on port 3335
-        };
-
-        // Process each line
-        lines.forEach(line => {
-            if (line.trim() === '') return;
-
-            // Parse line
-            // Expected format:
-            // Port 3334 | ID 1729875494654 | Message: 00:03:01, Cat state: Wander Time
-
-            const parts = line.split(' | ');
-            let port = null;
-            let id = null;
-            let content = null;
-
-            parts.forEach(part => {
-                if (part.startsWith('Port ')) {
-                    port = part.substring('Port '.length).trim();
-                } else if (part.startsWith('ID ')) {
-                    id = part.substring('ID '.length).trim();
-                } else if (part.startsWith('Message: ')) {
-                    content = part.substring('Message: '.length).trim();
-                }
-            });
-
-            if (port && content) {
-                // Determine cat ID based on port
-                let catId = null;
-                if (port === '3333') {
-                    catId = '1';
-                } else if (port === '3334') {
-                    catId = '2';
-                } else if (port === '3335') {
-                    catId = '3';
-                } else {
-                    console.error('Unknown port:', port);
-                    return;
-                }
-                // Parse content to get duration and state
-                let [durationStr, stateStr] = content.split(', Cat state: ');
-                const durationInSeconds = parseDuration(durationStr.trim());
-                const state = stateStr ? stateStr.trim() : '';
-
-                // Accumulate duration per state per cat
-                if (!catStates[catId][state]) {
-                    catStates[catId][state] = 0;
-                }
-                catStates[catId][state] += durationInSeconds;
-            } else {
-                console.error('Invalid line format:', line);
-            }
-        });
-
-        // Emit the data to the client
-        socket.emit('data', catStates);
+        // Emit seconds per state per cat
+        socket.emit('data', totals.cats);
     });
 
     socket.on('disconnect', () => {
@@ -253,3 +461,10 @@ server.listen(PORT, '0.0.0.0', () => {
     console.log(`Server running on port ${PORT}`);
 });
 
+// Checkpoint once more on the way out, so the next start has nothing to replay
+['SIGINT', 'SIGTERM'].forEach((signal) => {
+    process.on(signal, () => {
+        checkpoint.stop().finally(() => process.exit());
+    });
+});
+
@@ -0,0 +1,744 @@
+// analytics.js
+//
+// Activity queries over the status log history: cat_status_log.txt plus the days
+// LogStore has compacted into logs/cat_status_log/ (see lib/log_segments.js).
+//
+// Collars report on every state change (and on a capture press), so each record
+// holds the cat's state from its time until the next record of that cat. A session
+// is a run of records in the same state. It ends at the first record in another
+// state, or at its last record when the collar then goes silent for more than
+// MAX_GAP_MS (off or out of range). Seconds in a state are credited to the hours
+// they fall in, so a night's sleep is split across the hours and days it spans.
+//
+// Every sealed day, open part, rotated file and the live file is a partition. Sealed
+// days are scanned from their intervals (<day>.ivl, see public/interval_codec.js), which
+// hold the same runs the raw lines would give, without parsing or decompressing text.
+// Partitions are scanned in parallel on a pool of worker threads
+// (lib/analytics_worker.js). Each scan returns per (cat, day) cells for the time
+// and sessions that lie wholly inside the partition, plus each cat's sessions at
+// the partition's edges. query() joins those edges across partitions in time order.
+// Scans are cached by file size and mtime, so a query rereads only the live file
+// and new parts, and whole answers are cached per range until a partition changes.
+//
+// Raw lines are kept for LOG_RAW_DAYS but intervals are kept forever, so a query can
+// reach back to the first day sealed with them.
+
+const fs = require('fs');
+const os = require('os');
+const path = require('path');
+const { Worker } = require('worker_threads');
+const { PORT_TO_CAT, STATE_NAMES, parseStatusLog } = require('./telemetry');
+const { readFooter, readSegmentLines } = require('./log_segments');
+const { decodeSeries, readBlock } = require('../public/interval_codec');
+
+const DAY_MS = 86400000;
+const HOUR_MS = 3600000;
+const MAX_GAP_MS = Number(process.env.ANALYTICS_MAX_GAP_MS) || 12 * HOUR_MS;
+const LIVE_REFRESH_MS = 5000; // The live file is rescanned at most this often
+const MAX_CACHED_QUERIES = 64;
+const DEFAULT_GOAL_MINUTES = 30; // Active (Wander + Moonwalk) minutes a day that extend a streak
+
+// Session length histogram: bucket 0 is under 1 s, bucket b is [2^(b-1), 2^b) s, the last is open
+const HIST_BUCKETS = 18;
+const HIST_BOUNDS_S = Array.from({ length: HIST_BUCKETS }, (_, b) => (b === 0 ? 0 : 2 ** (b - 1)));
+
+// Cell layout of one (cat, day)
+const STATES = STATE_NAMES.length;
+const CELL_SECONDS = 0; // [hour * STATES + state]
+const CELL_SESSIONS = 24 * STATES; // [state], sessions that started this day
+const CELL_LONGEST = CELL_SESSIONS + STATES; // [state], seconds
+const CELL_HIST = CELL_LONGEST + STATES; // [state * HIST_BUCKETS + bucket]
+const CELLS = CELL_HIST + STATES * HIST_BUCKETS;
+
+const ROTATED_RE = /^rotated-(\d+)\.log$/;
+const PART_RE = /^(\d{4}-\d\d-\d\d)\.(\d+)\.part$/;
+const SEALED_RE = /^(\d{4}-\d\d-\d\d)\.seg$/;
+const INTERVALS_RE = /^(\d{4}-\d\d-\d\d)\.ivl$/;
+
+const dayNames = new Map();
+
+function dayName(day) {
+    let name = dayNames.get(day);
+    if (!name) {
+        name = new Date(day * DAY_MS).toISOString().slice(0, 10);
+        dayNames.set(day, name);
+    }
+    return name;
+}
+
+// Cat IDs and ports in numeric order
+function compareCats(a, b) {
+    return Number(a) - Number(b) || (a < b ? -1 : a > b ? 1 : 0);
+}
+
+// Collars the servers know by cat ID; any other port is its own cat
+function catOf(port) {
+    return PORT_TO_CAT[port] || String(port);
+}
+
+function histBucket(seconds) {
+    return seconds < 1 ? 0 : Math.min(HIST_BUCKETS - 1, Math.floor(Math.log2(seconds)) + 1);
+}
+
+// Per (cat, day) cells of one cat; cellOf returns null for days the caller is not collecting
+class CatDays {
+    constructor(fromDay = -Infinity, toDay = Infinity) {
+        this.days = new Map();
+        this.fromDay = fromDay;
+        this.toDay = toDay;
+    }
+
+    cellOf(day) {
+        if (day < this.fromDay || day > this.toDay) {
+            return null;
+        }
+        let cell = this.days.get(day);
+        if (!cell) {
+            cell = new Float64Array(CELLS);
+            this.days.set(day, cell);
+        }
+        return cell;
+    }
+
+    // Credit [t0, t1) in state to the hours it covers
+    credit(state, t0, t1) {
+        while (t0 < t1) {
+            const hourEnd = (Math.floor(t0 / HOUR_MS) + 1) * HOUR_MS;
+            const until = Math.min(t1, hourEnd);
+            const cell = this.cellOf(Math.floor(t0 / DAY_MS));
+            if (cell) {
+                cell[CELL_SECONDS + Math.floor((t0 % DAY_MS) / HOUR_MS) * STATES + state] += (until - t0) / 1000;
+            }
+            t0 = until;
+        }
+    }
+
+    session(state, start, end) {
+        const cell = this.cellOf(Math.floor(start / DAY_MS));
+        if (cell) {
+            const seconds = (end - start) / 1000;
+            cell[CELL_SESSIONS + state]++;
+            cell[CELL_LONGEST + state] = Math.max(cell[CELL_LONGEST + state], seconds);
+            cell[CELL_HIST + state * HIST_BUCKETS + histBucket(seconds)]++;
+        }
+    }
+
+    add(day, cells, offset) {
+        const cell = this.cellOf(day);
+        if (!cell) {
+            return;
+        }
+        for (let i = 0; i < CELL_LONGEST; i++) {
+            cell[i] += cells[offset + i];
+        }
+        for (let i = CELL_LONGEST; i < CELL_HIST; i++) {
+            cell[i] = Math.max(cell[i], cells[offset + i]);
+        }
+        for (let i = CELL_HIST; i < CELLS; i++) {
+            cell[i] += cells[offset + i];
+        }
+    }
+}
+
+// Partition scans //////////////////////////////////////////////////////////////
+
+// Scan raw status lines. Returns { cats, entries, cells, edges }: entries holds a
+// (cat index, day) pair per cell block in cells; edges[cat index] is
+// { first, last, head, tail, whole }, where first/last are that cat's first and last
+// records ({ t, state }), head is the session holding the first record (closed, with an
+// end, unless whole) and tail the one holding the last (still open).
+function scanLines(buf) {
+    const cols = parseStatusLog(buf);
+
+    // Bucket record indices by cat (counting sort), without an object per record
+    const time = new Float64Array(cols.count);
+    const catOfRecord = new Int32Array(cols.count);
+    const catByPort = new Map();
+    const cats = [];
+    const counts = [];
+    for (let i = 0; i < cols.count; i++) {
+        // The collar's stamp when it sent one, else the arrival time
+        time[i] = Number.isNaN(cols.sourceTime[i]) ? cols.id[i] : cols.sourceTime[i] / 1000;
+        if (cols.state[i] >= STATES || Number.isNaN(time[i])) {
+            catOfRecord[i] = -1;
+            continue;
+        }
+        let c = catByPort.get(cols.port[i]);
+        if (c === undefined) {
+            c = cats.length;
+            catByPort.set(cols.port[i], c);
+            cats.push(catOf(cols.port[i]));
+            counts.push(0);
+        }
+        catOfRecord[i] = c;
+        counts[c]++;
+    }
+    const starts = new Int32Array(cats.length + 1);
+    for (let c = 0; c < cats.length; c++) {
+        starts[c + 1] = starts[c] + counts[c];
+    }
+    const order = new Int32Array(starts[cats.length]);
+    const fill = starts.slice(0, cats.length);
+    for (let i = 0; i < cols.count; i++) {
+        if (catOfRecord[i] >= 0) {
+            order[fill[catOfRecord[i]]++] = i;
+        }
+    }
+
+    const state = cols.state;
+    const edges = [];
+    const blocks = [];
+    for (let c = 0; c < cats.length; c++) {
+        const records = order.subarray(starts[c], starts[c + 1]);
+        // Logged in arrival order; stamped records can be a little out of it
+        for (let k = 1; k < records.length; k++) {
+            if (time[records[k]] < time[records[k - 1]]) {
+                records.sort((x, y) => time[x] - time[y] || x - y);
+                break;
+            }
+        }
+
+        const days = new CatDays();
+        const first = records[0];
+        let head = null;
+        let run = { state: state[first], start: time[first], end: null };
+        for (let k = 1; k < records.length; k++) {
+            const prev = records[k - 1];
+            const r = records[k];
+            const gap = time[r] - time[prev];
+            if (gap <= MAX_GAP_MS) {
+                days.credit(state[prev], time[prev], time[r]);
+            }
+            if (gap > MAX_GAP_MS || state[r] !== state[prev]) {
+                run.end = gap <= MAX_GAP_MS ? time[r] : time[prev];
+                if (head === null) {
+                    head = run;
+                } else {
+                    days.session(run.state, run.start, run.end);
+                }
+                run = { state: state[r], start: time[r], end: null };
+            }
+        }
+
+        const last = records[records.length - 1];
+        edges.push({
+            first: { t: time[first], state: state[first] },
+            last: { t: time[last], state: state[last] },
+            head: head || run,
+            tail: run,
+            whole: head === null
+        });
+        for (const [day, cell] of days.days) {
+            blocks.push({ catIndex: c, day, cell });
+        }
+    }
+
+    return packScan(cats, blocks, edges);
+}
+
+// Scan an interval block: the same result as scanLines over the lines it was written from
+function scanIntervals(buf) {
+    const block = readBlock(buf);
+    const cats = [];
+    const edges = [];
+    const blocks = [];
+    for (const { key, offset } of block.series) {
+        const { runs } = decodeSeries(block.bytes, offset, { readings: false });
+        const n = runs.count;
+        if (n === 0) {
+            continue;
+        }
+        const c = cats.length;
+        cats.push(catOf(key));
+        const days = new CatDays();
+        const { start, end, state } = runs;
+        for (let i = 0; i < n; i++) {
+            days.credit(state[i], start[i], end[i]);
+            if (i > 0 && i < n - 1) {
+                days.session(state[i], start[i], end[i]);
+            }
+        }
+        const tail = { state: state[n - 1], start: start[n - 1], end: null };
+        edges.push({
+            first: { t: start[0], state: state[0] },
+            last: { t: end[n - 1], state: state[n - 1] },
+            head: n > 1 ? { state: state[0], start: start[0], end: end[0] } : tail,
+            tail,
+            whole: n === 1
+        });
+        for (const [day, cell] of days.days) {
+            blocks.push({ catIndex: c, day, cell });
+        }
+    }
+    return packScan(cats, blocks, edges);
+}
+
+function packScan(cats, blocks, edges) {
+    const entries = new Int32Array(blocks.length * 2);
+    const cells = new Float64Array(blocks.length * CELLS);
+    blocks.forEach((block, i) => {
+        entries[i * 2] = block.catIndex;
+        entries[i * 2 + 1] = block.day;
+        cells.set(block.cell, i * CELLS);
+    });
+    return { cats, entries, cells, edges };
+}
+
+// Scan one partition: [{ file, type: 'intervals' }], or [{ file, type: 'segment' | 'raw' }]
+// read in order as one run of lines
+function scanPartition(files) {
+    if (files[0].type === 'intervals') {
+        return scanIntervals(fs.readFileSync(files[0].file));
+    }
+    const bufs = files.map(({ file, type }) => (type === 'segment' ? readSegmentLines(file) : fs.readFileSync(file)));
+    return scanLines(bufs.length === 1 ? bufs[0] : Buffer.concat(bufs));
+}
+
+// Worker pool //////////////////////////////////////////////////////////////////
+
+class ScanPool {
+    constructor(size) {
+        this.size = size;
+        this.workers = [];
+        this.idle = [];
+        this.queue = [];
+        this.nextId = 0;
+        this.pending = new Map(); // id -> { files, resolve, reject, worker }
+    }
+
+    spawn() {
+        const worker = new Worker(path.join(__dirname, 'analytics_worker.js'));
+        worker.on('message', ({ id, result, error, code }) => {
+            const job = this.pending.get(id);
+            this.pending.delete(id);
+            if (error) {
+                job.reject(Object.assign(new Error(error), { code }));
+            } else {
+                job.resolve(result);
+            }
+            this.release(worker);
+        });
+        worker.on('error', (err) => {
+            // A dead worker fails its job and is replaced on demand
+            for (const [id, job] of this.pending) {
+                if (job.worker === worker) {
+                    this.pending.delete(id);
+                    job.reject(err);
+                }
+            }
+            this.workers = this.workers.filter(w => w !== worker);
+            this.idle = this.idle.filter(w => w !== worker);
+            this.dispatch();
+        });
+        this.workers.push(worker);
+        return worker;
+    }
+
+    run(files) {
+        return new Promise((resolve, reject) => {
+            this.queue.push({ files, resolve, reject });
+            this.dispatch();
+        });
+    }
+
+    dispatch() {
+        while (this.queue.length > 0) {
+            let worker = this.idle.pop();
+            if (!worker && this.workers.length < this.size) {
+                worker = this.spawn();
+            }
+            if (!worker) {
+                return;
+            }
+            const job = this.queue.shift();
+            const id = this.nextId++;
+            this.pending.set(id, { ...job, worker });
+            worker.ref();
+            worker.postMessage({ id, files: job.files });
+        }
+    }
+
+    release(worker) {
+        // Idle workers do not keep the process alive
+        worker.unref();
+        this.idle.push(worker);
+        this.dispatch();
+    }
+
+    close() {
+        this.workers.forEach(worker => worker.terminate());
+        this.workers = [];
+        this.idle = [];
+    }
+}
+
+// Query engine /////////////////////////////////////////////////////////////////
+
+class ActivityAnalytics {
+    // store: the status log's LogStore. options: { workers (default: cores - 1, 0 scans
+    // on this thread), liveRefreshMs, goalMinutes }
+    constructor(store, options = {}) {
+        this.store = store;
+        const workers = options.workers !== undefined ? options.workers : Math.min(8, Math.max(1, os.cpus().length - 1));
+        this.pool = workers > 0 ? new ScanPool(workers) : null;
+        this.liveRefreshMs = options.liveRefreshMs !== undefined ? options.liveRefreshMs : LIVE_REFRESH_MS;
+        this.goalMinutes = options.goalMinutes || DEFAULT_GOAL_MINUTES;
+
+        this.scans = new Map(); // file -> { key (path, size, mtime), at, scan: Promise }
+        this.footers = new Map(); // sealed segment key -> Set of its parts' rotation ms
+        this.queries = new Map(); // query key -> { fingerprint, expiresAt, result }
+        this.counters = { queries: 0, cachedQueries: 0, scans: 0, cachedScans: 0 };
+    }
+
+    close() {
+        if (this.pool) {
+            this.pool.close();
+        }
+    }
+
+    scan(files) {
+        this.counters.scans++;
+        return this.pool ? this.pool.run(files) : Promise.resolve().then(() => scanPartition(files));
+    }
+
+    statKey(file) {
+        const stats = fs.statSync(file);
+        return `${file}:${stats.size}:${stats.mtimeMs}`;
+    }
+
+    // Parts already merged into their day's segment (the window between sealing and unlinking)
+    sealedParts(file) {
+        const key = this.statKey(file);
+        let parts = this.footers.get(key);
+        if (!parts) {
+            parts = new Set(readFooter(file).parts.map(String));
+            this.footers.set(key, parts);
+        }
+        return parts;
+    }
+
+    // Partitions overlapping [fromDay, toDay] in time order: [{ key, day, files, live }]
+    listPartitions(fromDay, toDay) {
+        const dir = this.store.dir;
+        let names;
+        try {
+            names = fs.readdirSync(dir);
+        } catch (err) {
+            if (err.code !== 'ENOENT') {
+                throw err;
+            }
+            names = [];
+        }
+
+        const sealed = new Map();
+        const intervals = new Map();
+        const parts = [];
+        const rotated = [];
+        for (const name of names) {
+            let match;
+            if ((match = SEALED_RE.exec(name))) {
+                sealed.set(match[1], path.join(dir, name));
+            } else if ((match = INTERVALS_RE.exec(name))) {
+                intervals.set(match[1], path.join(dir, name));
+            } else if ((match = PART_RE.exec(name))) {
+                parts.push({ day: match[1], ms: match[2], file: path.join(dir, name) });
+            } else if ((match = ROTATED_RE.exec(name))) {
+                rotated.push({ ms: match[1], file: path.join(dir, name) });
+            }
+        }
+        // A rotated file is deleted right after it is split into parts
+        const split = new Set(parts.map(part => part.ms));
+
+        const inRange = day => day >= dayName(fromDay) && day <= dayName(toDay);
+        const dated = [];
+        // A sealed day's intervals, unless the day was sealed again since they were written
+        for (const day of new Set([...sealed.keys(), ...intervals.keys()])) {
+            if (!inRange(day)) {
+                continue;
+            }
+            const ivl = intervals.get(day);
+            const seg = sealed.get(day);
+            const files = ivl && (!seg || fs.statSync(ivl).mtimeMs >= fs.statSync(seg).mtimeMs)
+                ? [{ file: ivl, type: 'intervals' }]
+                : [{ file: seg, type: 'segment' }];
+            dated.push({ day, order: 0, files });
+        }
+        for (const part of parts) {
+            if (inRange(part.day) && !(sealed.has(part.day) && this.sealedParts(sealed.get(part.day)).has(part.ms))) {
+                dated.push({ day: part.day, order: Number(part.ms), files: [{ file: part.file, type: 'segment' }] });
+            }
+        }
+        dated.sort((a, b) => (a.day < b.day ? -1 : a.day > b.day ? 1 : a.order - b.order));
+
+        const partitions = dated.map(p => ({ key: this.statKey(p.files[0].file), day: p.day, files: p.files, live: false }));
+        rotated
+            .filter(r => !split.has(r.ms))
+            .sort((a, b) => Number(a.ms) - Number(b.ms))
+            .forEach((r) => {
+                partitions.push({ key: this.statKey(r.file), day: null, files: [{ file: r.file, type: 'raw' }], live: false });
+            });
+        if (fs.existsSync(this.store.livePath)) {
+            partitions.push({ key: this.statKey(this.store.livePath), day: null, files: [{ file: this.store.livePath, type: 'raw' }], live: true });
+        }
+        return partitions;
+    }
+
+    scanOf(partition) {
+        const file = partition.files[0].file;
+        const cached = this.scans.get(file);
+        if (cached && (cached.key === partition.key || (partition.live && Date.now() - cached.at < this.liveRefreshMs))) {
+            this.counters.cachedScans++;
+            return cached.scan;
+        }
+        const scan = this.scan(partition.files);
+        this.scans.set(file, { key: partition.key, at: Date.now(), scan });
+        scan.catch(() => this.scans.delete(file));
+        return scan;
+    }
+
+    // Forget scans of files compaction has merged or expired
+    prune() {
+        for (const file of this.scans.keys()) {
+            if (!fs.existsSync(file)) {
+                this.scans.delete(file);
+            }
+        }
+    }
+
+    // Resolve with activity per cat over whole UTC days. query: { from, to (Date, ms or
+    // ISO string; default the last 7 days), cats ([ids], default all), goalMinutes }
+    query(query = {}) {
+        return this.store.ready.then(() => this.run(query, 0));
+    }
+
+    run(query, attempt) {
+        const started = process.hrtime.bigint();
+        const now = Date.now();
+        const toDay = Math.floor(toMs(query.to, now) / DAY_MS);
+        const fromDay = Math.floor(toMs(query.from, (toDay - 6) * DAY_MS) / DAY_MS);
+        if (!(fromDay <= toDay) || toDay - fromDay > 3660) {
+            return Promise.reject(Object.assign(new Error('Bad range'), { status: 400 }));
+        }
+        const cats = query.cats && query.cats.length > 0 ? new Set(query.cats.map(String)) : null;
+        const goalMinutes = Number(query.goalMinutes) || this.goalMinutes;
+        const queryKey = `${fromDay}:${toDay}:${cats ? [...cats].sort().join(',') : '*'}:${goalMinutes}`;
+        this.counters.queries++;
+
+        // Plus the days around it, whose records bound the sessions at either end (gaps are at most MAX_GAP_MS)
+        const pad = Math.ceil(MAX_GAP_MS / DAY_MS);
+        const partitions = this.listPartitions(fromDay - pad, toDay + pad);
+        const fingerprint = partitions.map(p => p.key).join('|');
+        const cached = this.queries.get(queryKey);
+        if (cached && cached.fingerprint === fingerprint && now < cached.expiresAt) {
+            this.counters.cachedQueries++;
+            this.queries.delete(queryKey);
+            this.queries.set(queryKey, cached);
+            return Promise.resolve(cached.result);
+        }
+
+        this.prune();
+
+        return Promise.all(partitions.map(p => this.scanOf(p))).then(
+            (scans) => {
+                const result = this.merge(scans, { fromDay, toDay, cats, goalMinutes, now });
+                result.stats = {
+                    partitions: partitions.length,
+                    ms: Number(process.hrtime.bigint() - started) / 1e6
+                };
+                // Answers that include the ongoing session change with the clock
+                const live = partitions.some(p => p.live) && toDay >= Math.floor(now / DAY_MS);
+                this.queries.set(queryKey, { fingerprint, expiresAt: live ? now + this.liveRefreshMs : Infinity, result });
+                if (this.queries.size > MAX_CACHED_QUERIES) {
+                    this.queries.delete(this.queries.keys().next().value);
+                }
+                return result;
+            },
+            (err) => {
+                // Compaction moved a file between listing and reading; list again
+                if (err.code === 'ENOENT' && attempt < 3) {
+                    return this.run(query, attempt + 1);
+                }
+                throw err;
+            }
+        );
+    }
+
+    merge(scans, { fromDay, toDay, cats, goalMinutes, now }) {
+        const perCat = new Map(); // cat -> { days: CatDays, edges: [] }
+        const catState = (cat) => {
+            let entry = perCat.get(cat);
+            if (!entry) {
+                entry = { days: new CatDays(fromDay, toDay), edges: [] };
+                perCat.set(cat, entry);
+            }
+            return entry;
+        };
+
+        for (const scan of scans) {
+            const wanted = scan.cats.map(cat => (!cats || cats.has(cat) ? catState(cat) : null));
+            for (let i = 0; i < scan.entries.length / 2; i++) {
+                const entry = wanted[scan.entries[i * 2]];
+                if (entry) {
+                    entry.days.add(scan.entries[i * 2 + 1], scan.cells, i * CELLS);
+                }
+            }
+            scan.edges.forEach((edge, i) => {
+                if (wanted[i]) {
+                    wanted[i].edges.push(edge);
+                }
+            });
+        }
+
+        const result = {
+            from: dayName(fromDay),
+            to: dayName(toDay),
+            states: STATE_NAMES,
+            histogramBoundsS: HIST_BOUNDS_S,
+            goalMinutes,
+            cats: {}
+        };
+        for (const [cat, { days, edges }] of [...perCat].sort((a, b) => compareCats(a[0], b[0]))) {
+            const current = this.joinEdges(days, edges, now);
+            result.cats[cat] = summarise(days, fromDay, toDay, goalMinutes, now);
+            result.cats[cat].current = current;
+        }
+        return result;
+    }
+
+    // Join each cat's sessions across partition edges, crediting the time between
+    // partitions; returns the ongoing session, also credited up to now
+    joinEdges(days, edges, now) {
+        let open = null; // { state, start }
+        let last = null;
+        for (const edge of edges) {
+            const gapOk = last !== null && edge.first.t - last.t <= MAX_GAP_MS;
+            if (gapOk) {
+                days.credit(last.state, last.t, edge.first.t);
+            }
+            if (open && gapOk && edge.first.state === open.state) {
+                if (!edge.whole) {
+                    days.session(open.state, open.start, edge.head.end);
+                    open = { state: edge.tail.state, start: edge.tail.start };
+                }
+            } else {
+                if (open) {
+                    days.session(open.state, open.start, gapOk ? edge.first.t : last.t);
+                }
+                if (!edge.whole) {
+                    days.session(edge.head.state, edge.head.start, edge.head.end);
+                }
+                open = { state: edge.tail.state, start: edge.tail.start };
+            }
+            last = edge.last;
+        }
+        if (!open) {
+            return null;
+        }
+        const until = Math.min(now, last.t + MAX_GAP_MS);
+        days.credit(last.state, last.t, until);
+        return {
+            state: STATE_NAMES[open.state],
+            since: new Date(open.start).toISOString(),
+            seconds: Math.max(0, Math.round((until - open.start) / 1000)),
+            lastReport: new Date(last.t).toISOString()
+        };
+    }
+
+    stats() {
+        return { ...this.counters, cachedPartitions: this.scans.size, workers: this.pool ? this.pool.size : 0 };
+    }
+}
+
+function toMs(value, fallback) {
+    if (value === undefined || value === null || value === '') {
+        return fallback;
+    }
+    if (value instanceof Date) {
+        return value.getTime();
+    }
+    return /^\d+$/.test(String(value)) ? Number(value) : Date.parse(value);
+}
+
+function byState(values, map) {
+    const out = {};
+    for (let s = 0; s < STATES; s++) {
+        out[STATE_NAMES[s]] = map ? map(values[s]) : values[s];
+    }
+    return out;
+}
+
+function round(seconds) {
+    return Math.round(seconds * 10) / 10;
+}
+
+// One cat's answer from its day cells
+function summarise(catDays, fromDay, toDay, goalMinutes, now) {
+    const totals = new Float64Array(STATES);
+    const sessions = new Float64Array(STATES);
+    const longest = new Float64Array(STATES);
+    const hours = Array.from({ length: 24 }, () => new Float64Array(STATES));
+    const histogram = STATE_NAMES.map(() => new Array(HIST_BUCKETS).fill(0));
+    const days = {};
+    const activeDays = new Set();
+
+    for (const [day, cell] of [...catDays.days].sort((a, b) => a[0] - b[0])) {
+        const seconds = new Float64Array(STATES);
+        for (let h = 0; h < 24; h++) {
+            for (let s = 0; s < STATES; s++) {
+                const value = cell[CELL_SECONDS + h * STATES + s];
+                seconds[s] += value;
+                hours[h][s] += value;
+            }
+        }
+        for (let s = 0; s < STATES; s++) {
+            totals[s] += seconds[s];
+            sessions[s] += cell[CELL_SESSIONS + s];
+            longest[s] = Math.max(longest[s], cell[CELL_LONGEST + s]);
+            for (let b = 0; b < HIST_BUCKETS; b++) {
+                histogram[s][b] += cell[CELL_HIST + s * HIST_BUCKETS + b];
+            }
+        }
+        days[dayName(day)] = {
+            seconds: byState(seconds, round),
+            sessions: byState(cell.subarray(CELL_SESSIONS, CELL_SESSIONS + STATES)),
+            longest: byState(cell.subarray(CELL_LONGEST, CELL_LONGEST + STATES), round)
+        };
+        if (seconds[1] + seconds[2] >= goalMinutes * 60) {
+            activeDays.add(day);
+        }
+    }
+
+    // Today still counts toward the current streak until it ends
+    let longestStreak = 0;
+    let run = 0;
+    for (let day = fromDay; day <= toDay; day++) {
+        run = activeDays.has(day) ? run + 1 : 0;
+        longestStreak = Math.max(longestStreak, run);
+    }
+    let currentStreak = 0;
+    let day = toDay;
+    if (!activeDays.has(day) && day === Math.floor(now / DAY_MS)) {
+        day--;
+    }
+    for (; day >= fromDay && activeDays.has(day); day--) {
+        currentStreak++;
+    }
+
+    return {
+        seconds: byState(totals, round),
+        sessions: byState(sessions),
+        longest: byState(longest, round),
+        days,
+        hours: hours.map(h => byState(h, round)),
+        histogram: byState(histogram),
+        streaks: { current: currentStreak, longest: longestStreak }
+    };
+}
+
+module.exports = {
+    ActivityAnalytics,
+    scanPartition,
+    scanIntervals,
+    scanLines,
+    MAX_GAP_MS
+};
@@ -0,0 +1,17 @@
+// analytics_worker.js
+//
+// Worker thread that scans status log partitions for ActivityAnalytics (lib/analytics.js).
+
+const { parentPort } = require('worker_threads');
+const { scanPartition } = require('./analytics');
+
+parentPort.on('message', ({ id, files }) => {
+    let result;
+    try {
+        result = scanPartition(files);
+    } catch (err) {
+        parentPort.postMessage({ id, error: err.message, code: err.code });
+        return;
+    }
+    parentPort.postMessage({ id, result }, [result.entries.buffer, result.cells.buffer]);
+});
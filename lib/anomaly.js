@@ -0,0 +1,303 @@
+// anomaly.js
+//
+// Streaming anomaly detection on each cat's activity and collar temperature.
+// update() takes one status record at a time and keeps a fixed-size baseline per
+// cat, so the cost per record and the memory per cat stay the same however long
+// the server runs. Nothing ever re-reads history; baselines survive restarts through
+// the server's checkpoint (snapshot() and restore()).
+//
+// Activity: the cat's state holds from one record until the next. Its active
+// (Wander + Moonwalk) share of each BIN_MS bin is compared with an hour-of-day
+// profile, an EWMA of the share for each of the 24 hours. A one-sided CUSUM of the
+// shortfall, measured in the cat's own usual day of activity, raises "inactive"
+// once the cat has missed ACT_H of a day's worth beyond a slack of ACT_SLACK. Day
+// to day a cat's activity varies by about a third, so this takes a day or two;
+// anything quicker would flag every lazy afternoon. It clears when the CUSUM falls
+// back to zero.
+//
+// Temperature: each reading is compared with its own hour-of-day profile. A
+// two-sided CUSUM raises "temperature-high" or "temperature-low" on a sustained
+// drift, while single outliers are absorbed.
+//
+// Silence: collars report on state changes, so a quiet collar is usually a
+// sleeping cat, and tick() fills its bins with the last state. A collar that has
+// not reported for SILENCE_MS raises "silent" instead. Bins stop being filled then,
+// and a collar coming back starts a fresh bin.
+//
+// Baselines stop learning while their alert is raised, so an anomaly that lasts
+// does not become the new normal. Each hour slot needs a few days of samples
+// before it can alert. Alerts are emitted as 'alert' events: { source, catId,
+// type, raised, time, value, baseline, score }.
+
+const EventEmitter = require('events');
+const { PORT_TO_CAT, STATE_NAMES } = require('./telemetry');
+
+const HOUR_MS = 3600000;
+const DAY_MS = 86400000;
+const BIN_MS = 15 * 60000;
+const SILENCE_MS = Number(process.env.ANOMALY_SILENCE_MS) || 12 * HOUR_MS; // Longer than a cat sleeps
+const MAX_RECENT_ALERTS = 100;
+
+const ACT_ALPHA = 0.02; // About 50 samples, i.e. twelve days of one hour's four bins
+const ACT_MIN_SAMPLES = 16; // Four days
+const ACT_SLACK = 0.3; // Shortfalls within this fraction of the usual share are noise
+const ACT_H = 0.75; // Raise once this much of a usual day's activity is missing beyond the slack
+const ACT_MIN_DAY_BINS = 4; // Floor on a usual day's activity, for cats that barely move
+
+const TEMP_ALPHA = 0.02;
+const TEMP_MIN_SAMPLES = 12;
+const TEMP_MIN_SD = 0.25; // °F; the sensor's resolution and noise floor
+const TEMP_K = 0.5;
+const TEMP_H = 10;
+
+const ACTIVE = STATE_NAMES.map(name => name !== 'Sleepy Time');
+
+// Per-cat layout of the baseline array
+const ACT_SLOTS = 0; // 24 x (mean, variance, samples)
+const TEMP_SLOTS = 72; // 24 x (mean, variance, samples)
+const BIN_START = 144; // Start of the open activity bin
+const BIN_ACTIVE = 145; // Active ms in it so far
+const LAST_T = 146; // Activity is accounted up to here
+const LAST_STATE = 147;
+const LAST_SEEN = 148; // Latest record
+const ACT_CUSUM = 149;
+const TEMP_CUSUM_HI = 150;
+const TEMP_CUSUM_LO = 151;
+const RAISED = 152; // Bit per alert type
+const BASELINE_SIZE = 153;
+
+const ALERTS = ['inactive', 'temperature-high', 'temperature-low', 'silent'];
+const ALERT_BIT = Object.fromEntries(ALERTS.map((type, i) => [type, 1 << i]));
+
+function hourOf(t) {
+    return Math.floor((((t % DAY_MS) + DAY_MS) % DAY_MS) / HOUR_MS);
+}
+
+// EWMA mean and variance of one slot. Until it has 1/alpha samples the weight is
+// 1/n, a plain running mean, so early variances are not biased low.
+function learn(base, slot, x, alpha) {
+    const n = ++base[slot + 2];
+    const w = Math.max(alpha, 1 / n);
+    const d = x - base[slot];
+    base[slot] += w * d;
+    base[slot + 1] = (1 - w) * (base[slot + 1] + w * d * d);
+}
+
+class AnomalyDetector extends EventEmitter {
+    constructor() {
+        super();
+        this.cats = new Map(); // source -> { catId, base: Float64Array(BASELINE_SIZE) }
+        this.alerts = [];
+        this.counters = { records: 0, bins: 0, raised: 0, cleared: 0 };
+    }
+
+    catOf(source) {
+        let cat = this.cats.get(source);
+        if (!cat) {
+            const port = source.slice(source.lastIndexOf(':') + 1);
+            cat = { catId: PORT_TO_CAT[port] || null, base: new Float64Array(BASELINE_SIZE) };
+            cat.base[LAST_T] = NaN;
+            cat.base[LAST_SEEN] = NaN;
+            this.cats.set(source, cat);
+        }
+        return cat;
+    }
+
+    // One status record: source is "<host>:<port>", t its epoch ms, state an index into
+    // STATE_NAMES (or -1), temperature in °F (or null)
+    update(source, t, state, temperature) {
+        const cat = this.catOf(source);
+        const base = cat.base;
+        this.counters.records++;
+
+        if (!(t <= base[LAST_SEEN])) {
+            base[LAST_SEEN] = t;
+        }
+        if (state >= 0) {
+            this.advance(source, cat, t);
+            if (!(t < base[LAST_T])) {
+                base[LAST_T] = t;
+                base[LAST_STATE] = state;
+            }
+        }
+        if (temperature !== null && temperature !== undefined && !Number.isNaN(temperature)) {
+            this.temperature(source, cat, t, temperature);
+        }
+    }
+
+    // Close every bin before t, with the last state held up to it
+    advance(source, cat, t) {
+        const base = cat.base;
+        const lastT = base[LAST_T];
+        if (Number.isNaN(lastT) || base[RAISED] & ALERT_BIT.silent || t - lastT > SILENCE_MS) {
+            // First record, or back after an outage: start a fresh bin, keep the baselines
+            base[BIN_START] = Math.floor(t / BIN_MS) * BIN_MS;
+            base[BIN_ACTIVE] = 0;
+            base[ACT_CUSUM] = 0;
+            if (base[RAISED] & ALERT_BIT.silent) {
+                this.emitAlert(source, cat, 'silent', false, t, 0, 0, 0);
+            }
+            return;
+        }
+        if (t <= lastT) {
+            return; // Late record; its time is already accounted for
+        }
+        const active = ACTIVE[base[LAST_STATE]];
+        let from = lastT;
+        while (base[BIN_START] + BIN_MS <= t) {
+            const binEnd = base[BIN_START] + BIN_MS;
+            if (active) {
+                base[BIN_ACTIVE] += binEnd - Math.max(from, base[BIN_START]);
+            }
+            this.closeBin(source, cat);
+            from = binEnd;
+        }
+        if (active) {
+            base[BIN_ACTIVE] += t - Math.max(from, base[BIN_START]);
+        }
+    }
+
+    closeBin(source, cat) {
+        const base = cat.base;
+        const binStart = base[BIN_START];
+        const share = base[BIN_ACTIVE] / BIN_MS;
+        const slot = ACT_SLOTS + hourOf(binStart) * 3;
+        this.counters.bins++;
+        base[BIN_START] = binStart + BIN_MS;
+        base[BIN_ACTIVE] = 0;
+
+        // Shares are mostly 0 or 1 bin by bin, so the CUSUM runs on active time itself:
+        // it gains what the bin fell short of (1 - ACT_SLACK) of the usual share, as a
+        // fraction of the active time in a usual day
+        if (base[slot + 2] >= ACT_MIN_SAMPLES) {
+            let usual = 0;
+            for (let h = 0; h < 24; h++) {
+                usual += base[ACT_SLOTS + h * 3];
+            }
+            usual = Math.max(usual * HOUR_MS / BIN_MS, ACT_MIN_DAY_BINS);
+            base[ACT_CUSUM] = Math.max(0, base[ACT_CUSUM] + ((1 - ACT_SLACK) * base[slot] - share) / usual);
+            this.check(source, cat, 'inactive', base[ACT_CUSUM], ACT_H, binStart + BIN_MS, share, base[slot]);
+        }
+        if (!(base[RAISED] & ALERT_BIT.inactive) && base[ACT_CUSUM] < ACT_H / 2) {
+            learn(base, slot, share, ACT_ALPHA);
+        }
+    }
+
+    temperature(source, cat, t, x) {
+        const base = cat.base;
+        const slot = TEMP_SLOTS + hourOf(t) * 3;
+        const drifting = base[RAISED] & (ALERT_BIT['temperature-high'] | ALERT_BIT['temperature-low']);
+        if (base[slot + 2] >= TEMP_MIN_SAMPLES) {
+            const sd = Math.max(Math.sqrt(base[slot + 1]), TEMP_MIN_SD);
+            const z = (x - base[slot]) / sd;
+            base[TEMP_CUSUM_HI] = Math.max(0, base[TEMP_CUSUM_HI] + z - TEMP_K);
+            base[TEMP_CUSUM_LO] = Math.max(0, base[TEMP_CUSUM_LO] - z - TEMP_K);
+            this.check(source, cat, 'temperature-high', base[TEMP_CUSUM_HI], TEMP_H, t, x, base[slot]);
+            this.check(source, cat, 'temperature-low', base[TEMP_CUSUM_LO], TEMP_H, t, x, base[slot]);
+        }
+        if (!drifting) {
+            learn(base, slot, x, TEMP_ALPHA);
+        }
+    }
+
+    check(source, cat, type, score, threshold, t, value, baseline) {
+        const raised = cat.base[RAISED] & ALERT_BIT[type];
+        if (!raised && score > threshold) {
+            this.emitAlert(source, cat, type, true, t, value, baseline, score);
+        } else if (raised && score === 0) {
+            this.emitAlert(source, cat, type, false, t, value, baseline, 0);
+        }
+    }
+
+    // Close bins up to now for cats that have gone quiet, and raise "silent" for
+    // collars past SILENCE_MS; call periodically
+    tick(now) {
+        for (const [source, cat] of this.cats) {
+            const base = cat.base;
+            if (Number.isNaN(base[LAST_T])) {
+                continue;
+            }
+            if (now - base[LAST_SEEN] > SILENCE_MS) {
+                if (!(base[RAISED] & ALERT_BIT.silent)) {
+                    this.emitAlert(source, cat, 'silent', true, now, (now - base[LAST_SEEN]) / 1000, SILENCE_MS / 1000, 0);
+                }
+            } else if (now > base[LAST_T]) {
+                this.advance(source, cat, now);
+                base[LAST_T] = now;
+            }
+        }
+    }
+
+    emitAlert(source, cat, type, raised, t, value, baseline, score) {
+        if (raised) {
+            cat.base[RAISED] |= ALERT_BIT[type];
+            this.counters.raised++;
+        } else {
+            cat.base[RAISED] &= ~ALERT_BIT[type];
+            this.counters.cleared++;
+        }
+        const alert = {
+            source,
+            catId: cat.catId,
+            type,
+            raised,
+            time: new Date(t).toISOString(),
+            value: Math.round(value * 1000) / 1000,
+            baseline: Math.round(baseline * 1000) / 1000,
+            score: Math.round(score * 100) / 100
+        };
+        this.alerts.push(alert);
+        if (this.alerts.length > MAX_RECENT_ALERTS) {
+            this.alerts.shift();
+        }
+        this.emit('alert', alert);
+    }
+
+    // Alerts currently raised, by source
+    active() {
+        const active = {};
+        for (const [source, cat] of this.cats) {
+            const types = ALERTS.filter(type => cat.base[RAISED] & ALERT_BIT[type]);
+            if (types.length > 0) {
+                active[source] = types;
+            }
+        }
+        return active;
+    }
+
+    // State for a checkpoint (lib/checkpoint.js): every cat's baseline, end to end
+    snapshot() {
+        const sources = [...this.cats.keys()];
+        const bases = new Float64Array(sources.length * BASELINE_SIZE);
+        sources.forEach((source, i) => bases.set(this.cats.get(source).base, i * BASELINE_SIZE));
+        return { sources, baselineSize: BASELINE_SIZE, bases, alerts: this.alerts, counters: this.counters };
+    }
+
+    // Take over a snapshot's baselines and alerts; false if its layout is not this one's
+    restore(snapshot) {
+        if (snapshot.baselineSize !== BASELINE_SIZE) {
+            return false;
+        }
+        snapshot.sources.forEach((source, i) => {
+            this.catOf(source).base.set(snapshot.bases.subarray(i * BASELINE_SIZE, (i + 1) * BASELINE_SIZE));
+        });
+        this.alerts = snapshot.alerts;
+        Object.assign(this.counters, snapshot.counters);
+        return true;
+    }
+
+    stats() {
+        return {
+            ...this.counters,
+            cats: this.cats.size,
+            bytesPerCat: BASELINE_SIZE * Float64Array.BYTES_PER_ELEMENT
+        };
+    }
+}
+
+module.exports = {
+    AnomalyDetector,
+    ALERTS,
+    BIN_MS,
+    SILENCE_MS
+};
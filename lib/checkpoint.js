@@ -0,0 +1,223 @@
+// checkpoint.js
+//
+// Snapshots of a server's aggregation state, so a restart carries on from where it
+// stopped instead of rebuilding from the log history.
+//
+// The telemetry logs are the write-ahead log: every record is appended to the live
+// file before a server applies it, and LogStore keeps what rotates out. A Checkpoint
+// saves the server's state every CHECKPOINT_MS and on shutdown, together with
+// Watermarks: per collar, the arrival stamp of the last record applied. On start the
+// server restores the snapshot and replays only what was logged since it was saved
+// (LogStore.replaySince), skipping each collar's records up to its watermark. Start-up
+// then costs the snapshot's size plus the lines since, however long the history is.
+//
+// File format:
+//   ["CKPT"][u32 LE version][u32 LE header length][header JSON][pad to 8][arrays]
+// The header is { savedMs, state }, with every typed array in state replaced by
+// { $array: <type>, offset, length } into the arrays section, where each one starts
+// 8-byte aligned. Loading maps the arrays back in place without parsing them.
+// Files are written to a temporary name, synced and renamed, so a crash leaves the
+// previous snapshot.
+
+const fs = require('fs');
+
+const MAGIC = 'CKPT';
+const VERSION = 1;
+const PREAMBLE_LEN = 12;
+const CHECKPOINT_MS = Number(process.env.CHECKPOINT_INTERVAL_MS) || 60000;
+
+const ARRAY_TYPES = {
+    Float64Array, Float32Array, Int32Array, Uint32Array, Int16Array, Uint16Array, Int8Array, Uint8Array
+};
+
+function align8(n) {
+    return (n + 7) & ~7;
+}
+
+function encodeSnapshot(state, savedMs) {
+    const arrays = [];
+    let arrayBytes = 0;
+    const json = JSON.stringify({ savedMs, state }, (key, value) => {
+        if (!ArrayBuffer.isView(value)) {
+            return value;
+        }
+        const offset = align8(arrayBytes);
+        arrayBytes = offset + value.byteLength;
+        arrays.push({ value, offset });
+        return { $array: value.constructor.name, offset, length: value.length };
+    });
+    const header = Buffer.from(json, 'utf8');
+    const start = align8(PREAMBLE_LEN + header.length);
+    const buf = Buffer.alloc(start + arrayBytes);
+    buf.write(MAGIC, 0, 'latin1');
+    buf.writeUInt32LE(VERSION, 4);
+    buf.writeUInt32LE(header.length, 8);
+    header.copy(buf, PREAMBLE_LEN);
+    arrays.forEach(({ value, offset }) => {
+        buf.set(new Uint8Array(value.buffer, value.byteOffset, value.byteLength), start + offset);
+    });
+    return buf;
+}
+
+// { savedMs, state } from a snapshot file's bytes; throws if they are not one
+function decodeSnapshot(buf) {
+    if (buf.length < PREAMBLE_LEN || buf.toString('latin1', 0, 4) !== MAGIC) {
+        throw new Error('not a checkpoint');
+    }
+    if (buf.readUInt32LE(4) !== VERSION) {
+        throw new Error(`version ${buf.readUInt32LE(4)}, expected ${VERSION}`);
+    }
+    const headerLen = buf.readUInt32LE(8);
+    const start = align8(PREAMBLE_LEN + headerLen);
+    if (start > buf.length) {
+        throw new Error('truncated header');
+    }
+    return JSON.parse(buf.toString('utf8', PREAMBLE_LEN, PREAMBLE_LEN + headerLen), (key, value) => {
+        if (value === null || typeof value !== 'object' || typeof value.$array !== 'string') {
+            return value;
+        }
+        const Type = ARRAY_TYPES[value.$array];
+        const from = start + value.offset;
+        const bytes = value.length * (Type ? Type.BYTES_PER_ELEMENT : 0);
+        if (!Type || from + bytes > buf.length) {
+            throw new Error('truncated arrays');
+        }
+        const at = buf.byteOffset + from;
+        return at % Type.BYTES_PER_ELEMENT === 0
+            ? new Type(buf.buffer, at, value.length)
+            : new Type(buf.buffer.slice(at, at + bytes));
+    });
+}
+
+class Checkpoint {
+    // options: { intervalMs }
+    constructor(file, options = {}) {
+        this.file = file;
+        this.intervalMs = options.intervalMs || CHECKPOINT_MS;
+        this.collect = null;
+        this.timer = null;
+        this.saving = null;
+        this.counters = { saved: 0, failed: 0, bytes: 0, encodeMs: 0 };
+    }
+
+    // { savedMs, state } of the last snapshot, or null if there is none or it is unreadable
+    load() {
+        let buf;
+        try {
+            buf = fs.readFileSync(this.file);
+        } catch (err) {
+            if (err.code !== 'ENOENT') {
+                console.error(`Error reading ${this.file}:`, err);
+            }
+            return null;
+        }
+        try {
+            return decodeSnapshot(buf);
+        } catch (err) {
+            console.error(`Ignoring ${this.file}: ${err.message}`);
+            return null;
+        }
+    }
+
+    // Save collect()'s state now and every intervalMs from here on
+    start(collect) {
+        this.collect = collect;
+        this.timer = setInterval(() => this.save(), this.intervalMs);
+        this.timer.unref();
+    }
+
+    // Resolves once the state as of now is on disk (or the write failed)
+    save() {
+        if (!this.collect) {
+            return Promise.resolve();
+        }
+        if (this.saving) {
+            return this.saving;
+        }
+        const started = process.hrtime.bigint();
+        const buf = encodeSnapshot(this.collect(), Date.now());
+        this.counters.encodeMs = Number(process.hrtime.bigint() - started) / 1e6;
+        const tmp = `${this.file}.tmp`;
+        this.saving = fs.promises.open(tmp, 'w')
+            .then(handle => handle.writeFile(buf).then(() => handle.sync()).finally(() => handle.close()))
+            .then(() => fs.promises.rename(tmp, this.file))
+            .then(() => {
+                this.counters.saved++;
+                this.counters.bytes = buf.length;
+            })
+            .catch((err) => {
+                this.counters.failed++;
+                console.error(`Error saving ${this.file}:`, err);
+            })
+            .finally(() => {
+                this.saving = null;
+            });
+        return this.saving;
+    }
+
+    // Stop the timer and save a last time, so the next start has nothing to replay
+    stop() {
+        clearInterval(this.timer);
+        return this.saving ? this.saving.then(() => this.save()) : this.save();
+    }
+
+    stats() {
+        return { file: this.file, intervalMs: this.intervalMs, ...this.counters };
+    }
+}
+
+// Per collar, the latest arrival stamp (ms) applied and how many records carried it,
+// so a replay from before a checkpoint skips exactly the records applied before it.
+// A collar's records are logged in stamp order by the ingest that receives them.
+class Watermarks {
+    constructor() {
+        this.marks = new Map(); // key -> { ms, count, skip }
+    }
+
+    // A record was applied
+    note(key, ms) {
+        const mark = this.marks.get(key);
+        if (!mark || ms > mark.ms) {
+            this.marks.set(key, { ms, count: 1, skip: 0 });
+        } else if (ms === mark.ms) {
+            mark.count++;
+        }
+    }
+
+    // Whether a replayed record is new; notes it if so
+    replayed(key, ms) {
+        const mark = this.marks.get(key);
+        if (mark && (ms < mark.ms || (ms === mark.ms && mark.skip > 0))) {
+            if (ms === mark.ms) {
+                mark.skip--;
+            }
+            return false;
+        }
+        this.note(key, ms);
+        return true;
+    }
+
+    snapshot() {
+        const keys = [...this.marks.keys()];
+        const ms = new Float64Array(keys.length);
+        const counts = new Uint32Array(keys.length);
+        keys.forEach((key, i) => {
+            ms[i] = this.marks.get(key).ms;
+            counts[i] = this.marks.get(key).count;
+        });
+        return { keys, ms, counts };
+    }
+
+    restore(snapshot) {
+        snapshot.keys.forEach((key, i) => {
+            this.marks.set(key, { ms: snapshot.ms[i], count: snapshot.counts[i], skip: snapshot.counts[i] });
+        });
+    }
+}
+
+module.exports = {
+    Checkpoint,
+    Watermarks,
+    decodeSnapshot,
+    encodeSnapshot
+};
@@ -0,0 +1,329 @@
+// hls_relay.js
+//
+// Relay cache for the Raspberry Pi camera's HLS stream. Viewers load /hls/<path>
+// from the web server instead of the Pi. The relay fetches each playlist and
+// segment from the origin once and serves the copy to everyone. This keeps the
+// Pi's uplink and CPU flat however many viewers there are.
+//
+// - Playlists are refetched at most every half target duration. Requests in
+//   between get the cached copy, and concurrent misses share one origin fetch.
+// - Each playlist refresh prefetches the segments it lists, so the first viewer
+//   of a new segment does not wait on the Pi.
+// - Segments stay in memory while a playlist lists them, plus a grace period
+//   for viewers lagging behind, and never past maxBytes in total.
+// - Every response writes the one cached Buffer (or a view of it for Range
+//   requests), so serving N viewers never copies the segment in JS.
+//
+// Stats (origin fetches and bytes against client requests and bytes) come from stats().
+
+const http = require('http');
+const https = require('https');
+
+const DEFAULT_TARGET_S = 2;
+const EVICT_GRACE_TARGETS = 3; // Keep delisted segments this many target durations
+const FETCH_TIMEOUT_MS = 10000;
+
+const CONTENT_TYPES = {
+    '.m3u8': 'application/vnd.apple.mpegurl',
+    '.ts': 'video/mp2t',
+    '.m4s': 'video/iso.segment',
+    '.mp4': 'video/mp4',
+    '.aac': 'audio/aac',
+    '.vtt': 'text/vtt'
+};
+
+function extOf(key) {
+    const dot = key.lastIndexOf('.');
+    return dot < 0 ? '' : key.slice(dot).toLowerCase();
+}
+
+function isPlaylist(key) {
+    return extOf(key) === '.m3u8';
+}
+
+class HlsRelay {
+    // origin: base URL of the camera server, e.g. "http://192.168.1.103:8000/"
+    // options: { maxBytes (64 MiB) }
+    constructor(origin, options = {}) {
+        this.origin = new URL(origin.endsWith('/') ? origin : `${origin}/`);
+        this.client = this.origin.protocol === 'https:' ? https : http;
+        this.agent = new this.client.Agent({ keepAlive: true, maxSockets: 4 });
+        this.maxBytes = options.maxBytes || 64 * 1048576;
+
+        this.entries = new Map(); // key -> { body, type, etag, fetchedAt, expiresAt, listedAt }
+        this.inflight = new Map(); // key -> Promise<entry>
+        this.heldBytes = 0;
+        this.counters = {
+            clientRequests: 0,
+            clientBytes: 0,
+            hits: 0,
+            coalesced: 0,
+            notModified: 0,
+            originFetches: 0,
+            originBytes: 0,
+            originErrors: 0,
+            prefetches: 0,
+            evictions: 0
+        };
+    }
+
+    // Express/connect middleware; mount it at the relay's path (app.use('/hls', relay.middleware())).
+    // Also works as a plain http.createServer() handler, with the request path as the key.
+    middleware() {
+        return (req, res, next) => {
+            if (req.method !== 'GET' && req.method !== 'HEAD') {
+                if (next) {
+                    next();
+                } else {
+                    res.writeHead(405).end();
+                }
+                return;
+            }
+            let key;
+            try {
+                key = decodeURIComponent(new URL(req.url, 'http://relay').pathname.replace(/^\/+/, ''));
+            } catch (err) {
+                key = '';
+            }
+            if (this.resolve(key) === null) {
+                res.writeHead(400).end();
+                return;
+            }
+            this.counters.clientRequests++;
+            this.get(key).then(
+                entry => this.send(req, res, entry),
+                (err) => {
+                    res.writeHead(err.status || 502).end();
+                }
+            );
+        };
+    }
+
+    // The origin URL for key, or null if key would leave the origin's directory: a scheme
+    // ("http:..."), a protocol-relative host ("//host/..."), a ".." segment, or anything
+    // else that resolves to another host or outside the origin's path
+    resolve(key) {
+        if (typeof key !== 'string' || key === '' || key.startsWith('/') || key.startsWith('\\') ||
+            /^[a-z][a-z0-9+.-]*:/i.test(key) || key.split(/[/\\]/).includes('..')) {
+            return null;
+        }
+        let url;
+        try {
+            url = new URL(key, this.origin);
+        } catch (err) {
+            return null;
+        }
+        if (url.origin !== this.origin.origin || !url.pathname.startsWith(this.origin.pathname)) {
+            return null;
+        }
+        return url;
+    }
+
+    // Resolve with the cache entry for key, fetching it from the origin if it is missing or stale
+    get(key) {
+        if (this.resolve(key) === null) {
+            return Promise.reject(Object.assign(new Error(`Not under the origin: ${key}`), { status: 400 }));
+        }
+        const entry = this.entries.get(key);
+        if (entry && Date.now() < entry.expiresAt) {
+            this.counters.hits++;
+            return Promise.resolve(entry);
+        }
+        const pending = this.inflight.get(key);
+        if (pending) {
+            this.counters.coalesced++;
+            return pending;
+        }
+        const fetch = this.fetch(key).finally(() => this.inflight.delete(key));
+        this.inflight.set(key, fetch);
+        return fetch.catch((err) => {
+            // A stale playlist beats a black player while the Pi hiccups
+            if (entry && isPlaylist(key)) {
+                return entry;
+            }
+            throw err;
+        });
+    }
+
+    fetch(key) {
+        this.counters.originFetches++;
+        return new Promise((resolve, reject) => {
+            const url = this.resolve(key);
+            if (url === null) {
+                reject(Object.assign(new Error(`Not under the origin: ${key}`), { status: 400 }));
+                return;
+            }
+            const req = this.client.get(url, { agent: this.agent, timeout: FETCH_TIMEOUT_MS }, (res) => {
+                const chunks = [];
+                res.on('data', chunk => chunks.push(chunk));
+                res.on('end', () => {
+                    if (res.statusCode !== 200) {
+                        this.counters.originErrors++;
+                        reject(Object.assign(new Error(`Origin ${res.statusCode} for ${key}`), { status: res.statusCode === 404 ? 404 : 502 }));
+                        return;
+                    }
+                    const body = Buffer.concat(chunks);
+                    this.counters.originBytes += body.length;
+                    resolve(this.store(key, body, res.headers['content-type']));
+                });
+                res.on('error', reject);
+            });
+            req.on('timeout', () => req.destroy(new Error(`Origin timeout for ${key}`)));
+            req.on('error', (err) => {
+                this.counters.originErrors++;
+                reject(err);
+            });
+        });
+    }
+
+    store(key, body, contentType) {
+        const now = Date.now();
+        const old = this.entries.get(key);
+        if (old) {
+            this.heldBytes -= old.body.length;
+        }
+        const entry = {
+            body,
+            type: CONTENT_TYPES[extOf(key)] || contentType || 'application/octet-stream',
+            etag: `"${body.length.toString(36)}-${now.toString(36)}"`,
+            fetchedAt: now,
+            expiresAt: Infinity,
+            maxAge: 0,
+            listedAt: old ? old.listedAt : now
+        };
+        if (isPlaylist(key)) {
+            entry.body = this.rewritePlaylist(key, body);
+            // Unchanged playlists keep their ETag so viewers get 304s
+            if (old && old.body.equals(entry.body)) {
+                entry.etag = old.etag;
+            }
+            this.onPlaylist(key, entry);
+        }
+        this.entries.set(key, entry);
+        this.heldBytes += entry.body.length;
+        this.evict();
+        return entry;
+    }
+
+    // Make absolute URIs under the playlist's origin directory relative, so viewers come back through the relay
+    rewritePlaylist(key, body) {
+        const text = body.toString();
+        const base = new URL(key.slice(0, key.lastIndexOf('/') + 1), this.origin).href;
+        if (!text.includes(base)) {
+            return body;
+        }
+        return Buffer.from(text.split('\n').map(line => line.startsWith(base) ? line.slice(base.length) : line).join('\n'));
+    }
+
+    onPlaylist(key, entry) {
+        const text = entry.body.toString();
+        const target = /#EXT-X-TARGETDURATION:(\d+(?:\.\d+)?)/.exec(text);
+        const targetS = target ? Number(target[1]) : DEFAULT_TARGET_S;
+        const live = !text.includes('#EXT-X-ENDLIST');
+        entry.targetS = targetS;
+        entry.expiresAt = live ? entry.fetchedAt + targetS * 500 : Infinity;
+        entry.maxAge = live ? Math.max(1, Math.floor(targetS / 2)) : 3600;
+
+        // Relative to the playlist, like the player resolves them
+        const dir = key.includes('/') ? key.slice(0, key.lastIndexOf('/') + 1) : '';
+        const uris = text.split('\n').map(line => line.trim()).filter(line => line && !line.startsWith('#'));
+        const now = Date.now();
+        for (const uri of uris) {
+            if (/^[a-z]+:/i.test(uri)) {
+                continue; // Another host entirely; the player fetches it directly
+            }
+            const child = (dir + uri).split('?')[0];
+            const cached = this.entries.get(child);
+            if (cached) {
+                cached.listedAt = now;
+            } else if (!isPlaylist(child) && !this.inflight.has(child)) {
+                this.counters.prefetches++;
+                this.get(child).then((fetched) => {
+                    fetched.listedAt = Date.now();
+                }, () => {});
+            }
+        }
+        this.graceMs = targetS * 1000 * EVICT_GRACE_TARGETS;
+    }
+
+    evict() {
+        const now = Date.now();
+        const grace = this.graceMs || DEFAULT_TARGET_S * 1000 * EVICT_GRACE_TARGETS;
+        for (const [key, entry] of this.entries) {
+            if (!isPlaylist(key) && now - entry.listedAt > grace) {
+                this.drop(key, entry);
+            }
+        }
+        // Over budget: oldest segments first (Map order is insertion order)
+        for (const [key, entry] of this.entries) {
+            if (this.heldBytes <= this.maxBytes) {
+                break;
+            }
+            if (!isPlaylist(key)) {
+                this.drop(key, entry);
+            }
+        }
+    }
+
+    drop(key, entry) {
+        this.entries.delete(key);
+        this.heldBytes -= entry.body.length;
+        this.counters.evictions++;
+    }
+
+    send(req, res, entry) {
+        // Segments never change under a name while the playlist lists them; playlists turn over every half target
+        const maxAge = entry.maxAge || Math.ceil((this.graceMs || 0) / 1000) || 60;
+        const headers = {
+            'Content-Type': entry.type,
+            'Cache-Control': `public, max-age=${maxAge}`,
+            'ETag': entry.etag,
+            'Last-Modified': new Date(entry.fetchedAt).toUTCString(),
+            'Accept-Ranges': 'bytes',
+            'Access-Control-Allow-Origin': '*'
+        };
+        if (req.headers['if-none-match'] === entry.etag) {
+            this.counters.notModified++;
+            res.writeHead(304, headers);
+            res.end();
+            return;
+        }
+
+        let body = entry.body;
+        let status = 200;
+        const range = /^bytes=(\d*)-(\d*)$/.exec(req.headers.range || '');
+        if (range && (range[1] || range[2])) {
+            const size = body.length;
+            const start = range[1] ? Number(range[1]) : Math.max(0, size - Number(range[2]));
+            const end = range[1] && range[2] ? Math.min(Number(range[2]), size - 1) : size - 1;
+            if (start >= size || start > end) {
+                res.writeHead(416, { 'Content-Range': `bytes */${size}` });
+                res.end();
+                return;
+            }
+            body = body.subarray(start, end + 1);
+            status = 206;
+            headers['Content-Range'] = `bytes ${start}-${end}/${size}`;
+        }
+        headers['Content-Length'] = body.length;
+        res.writeHead(status, headers);
+        if (req.method === 'HEAD') {
+            res.end();
+            return;
+        }
+        this.counters.clientBytes += body.length;
+        res.end(body);
+    }
+
+    stats() {
+        let segments = 0;
+        for (const key of this.entries.keys()) {
+            segments += isPlaylist(key) ? 0 : 1;
+        }
+        return { origin: this.origin.href, ...this.counters, segments, heldBytes: this.heldBytes };
+    }
+}
+
+module.exports = {
+    HlsRelay
+};
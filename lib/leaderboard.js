@@ -0,0 +1,610 @@
+// leaderboard.js
+//
+// Top-K leaderboards of weighted activity over several sliding horizons at once
+// (by default the last minute, 10 minutes, hour and day), for every cat and for
+// each named group of cats, kept up to date one status record at a time.
+//
+// A record credits its duration to its state at the record's time, the same way
+// the all-time leader counts it (leaderOf in lib/telemetry.js). Its score is the
+// state's weight times that duration, capped at the horizon's length so one long
+// session cannot count for more than the whole window. Records live in one ring
+// buffer in time order, holding the longest horizon. Each horizon keeps a cursor
+// into it and takes a record back out once the record falls behind the window.
+//
+// Every (group, horizon) pair keeps its cats in two heaps: a min-heap of the K
+// best and a max-heap of the rest, with each cat's position indexed. A score
+// change moves one cat within its heap and swaps at most one cat across, so a
+// record costs O(log n) per horizon and group, and a query reads the K best
+// straight out of the first heap. Ties go to the cat seen first.
+//
+// Time only moves forward. A record stamped earlier than one already seen counts
+// from the later time, and one older than the longest horizon is dropped.
+
+const { LEADER_WEIGHTS, STATE_NAMES } = require('./telemetry');
+
+const HORIZONS = [
+    { name: '1m', ms: 60000 },
+    { name: '10m', ms: 600000 },
+    { name: '1h', ms: 3600000 },
+    { name: '24h', ms: 86400000 }
+];
+const DEFAULT_WEIGHTS = { 'Sleepy Time': 0, ...LEADER_WEIGHTS };
+const DEFAULT_K = 10;
+const ALL = 'all';
+const INITIAL_CAPACITY = 1024;
+
+// Weights from "wander=1,moonwalk=2" (first word of the state, any case) or full state names
+function parseWeights(text) {
+    const weights = { ...DEFAULT_WEIGHTS };
+    String(text).split(',').filter(Boolean).forEach((pair) => {
+        const [key, value] = pair.split('=').map(s => s.trim());
+        const name = STATE_NAMES.find(n => n === key || n.split(' ')[0].toLowerCase() === key.toLowerCase());
+        if (!name || !Number.isFinite(Number(value)) || Number(value) < 0) {
+            throw new Error(`Bad leaderboard weight "${pair}"`);
+        }
+        weights[name] = Number(value);
+    });
+    return weights;
+}
+
+// A typed array at least size long, twice as long as before if that is more
+function grow(array, size) {
+    const next = new array.constructor(Math.max(size, 2 * array.length));
+    next.set(array);
+    return next;
+}
+
+// Ranks two (score, slot) pairs
+function better(scoreA, slotA, scoreB, slotB) {
+    return scoreA > scoreB || (scoreA === scoreB && slotA < slotB);
+}
+
+// The K best slots of one (group, horizon) by score. Slots are the group's members
+// in the order they joined. Both heaps hold (score, slot) pairs side by side, so a
+// sift reads one place per level instead of chasing each slot's score. The rest is
+// 4-ary: half as deep, and a node's children are one 64-byte run.
+class TopK {
+    constructor(k) {
+        this.k = k;
+        this.pos = new Int32Array(INITIAL_CAPACITY); // >= 0: index in top, < 0: -1 - index in rest
+        this.top = new Float64Array(2 * k); // Min-heap: the weakest of the K first
+        this.topSize = 0;
+        this.rest = new Float64Array(2 * INITIAL_CAPACITY); // Max-heap: the best of the others first
+        this.restSize = 0;
+    }
+
+    // A new member, scoring 0
+    insert(slot) {
+        if (slot >= this.pos.length) {
+            this.pos = grow(this.pos, slot + 1);
+        }
+        if (this.topSize < this.k) {
+            this.top[2 * this.topSize] = 0;
+            this.top[2 * this.topSize + 1] = slot;
+            this.topUp(this.topSize++);
+            return;
+        }
+        if (2 * this.restSize >= this.rest.length) {
+            this.rest = grow(this.rest, 2 * this.restSize + 2);
+        }
+        this.rest[2 * this.restSize] = 0;
+        this.rest[2 * this.restSize + 1] = slot;
+        this.restUp(this.restSize++);
+        this.rebalance();
+    }
+
+    add(slot, delta) {
+        const p = this.pos[slot];
+        if (p >= 0) {
+            this.top[2 * p] += delta;
+            if (delta > 0) {
+                this.topDown(p);
+            } else {
+                this.topUp(p);
+            }
+        } else {
+            const i = -1 - p;
+            this.rest[2 * i] += delta;
+            if (delta > 0) {
+                this.restUp(i);
+            } else {
+                this.restDown(i);
+            }
+        }
+        this.rebalance();
+    }
+
+    // Set the scores of members 0..n-1 at once (scores[slot]), in O(n + K log n): every
+    // member goes into the rest, which is heapified bottom-up, and the K best move to the top
+    build(scores, n) {
+        if (2 * n > this.rest.length) {
+            this.rest = grow(this.rest, 2 * n);
+        }
+        for (let slot = 0; slot < n; slot++) {
+            this.rest[2 * slot] = scores[slot];
+            this.rest[2 * slot + 1] = slot;
+            this.pos[slot] = -1 - slot;
+        }
+        this.restSize = n;
+        this.topSize = 0;
+        for (let i = (n - 2) >> 2; i >= 0; i--) {
+            this.restDown(i);
+        }
+        while (this.topSize < this.k && this.restSize > 0) {
+            const score = this.rest[0];
+            const slot = this.rest[1];
+            this.restSize--;
+            if (this.restSize > 0) {
+                this.rest[0] = this.rest[2 * this.restSize];
+                this.rest[1] = this.rest[2 * this.restSize + 1];
+                this.restDown(0);
+            }
+            this.top[2 * this.topSize] = score;
+            this.top[2 * this.topSize + 1] = slot;
+            this.topUp(this.topSize++);
+        }
+    }
+
+    // Only one score changes at a time, so at most one cat has to cross
+    rebalance() {
+        const top = this.top;
+        const rest = this.rest;
+        if (this.restSize === 0 || !better(rest[0], rest[1], top[0], top[1])) {
+            return;
+        }
+        const score = top[0];
+        const slot = top[1];
+        top[0] = rest[0];
+        top[1] = rest[1];
+        rest[0] = score;
+        rest[1] = slot;
+        this.topDown(0);
+        this.restDown(0);
+    }
+
+    // [{ slot, score }] of the best n, best first
+    best(n) {
+        const entries = [];
+        for (let i = 0; i < this.topSize; i++) {
+            entries.push({ slot: this.top[2 * i + 1], score: this.top[2 * i] });
+        }
+        return entries
+            .sort((a, b) => (better(a.score, a.slot, b.score, b.slot) ? -1 : 1))
+            .slice(0, n);
+    }
+
+    topUp(i) {
+        const heap = this.top;
+        const score = heap[2 * i];
+        const slot = heap[2 * i + 1];
+        while (i > 0) {
+            const parent = (i - 1) >> 1;
+            if (!better(heap[2 * parent], heap[2 * parent + 1], score, slot)) {
+                break;
+            }
+            heap[2 * i] = heap[2 * parent];
+            heap[2 * i + 1] = heap[2 * parent + 1];
+            this.pos[heap[2 * i + 1]] = i;
+            i = parent;
+        }
+        heap[2 * i] = score;
+        heap[2 * i + 1] = slot;
+        this.pos[slot] = i;
+    }
+
+    topDown(i) {
+        const heap = this.top;
+        const size = this.topSize;
+        const score = heap[2 * i];
+        const slot = heap[2 * i + 1];
+        for (;;) {
+            let child = 2 * i + 1;
+            if (child >= size) {
+                break;
+            }
+            if (child + 1 < size && better(heap[2 * child], heap[2 * child + 1], heap[2 * child + 2], heap[2 * child + 3])) {
+                child++;
+            }
+            if (!better(score, slot, heap[2 * child], heap[2 * child + 1])) {
+                break;
+            }
+            heap[2 * i] = heap[2 * child];
+            heap[2 * i + 1] = heap[2 * child + 1];
+            this.pos[heap[2 * i + 1]] = i;
+            i = child;
+        }
+        heap[2 * i] = score;
+        heap[2 * i + 1] = slot;
+        this.pos[slot] = i;
+    }
+
+    restUp(i) {
+        const heap = this.rest;
+        const score = heap[2 * i];
+        const slot = heap[2 * i + 1];
+        while (i > 0) {
+            const parent = (i - 1) >> 2;
+            if (!better(score, slot, heap[2 * parent], heap[2 * parent + 1])) {
+                break;
+            }
+            heap[2 * i] = heap[2 * parent];
+            heap[2 * i + 1] = heap[2 * parent + 1];
+            this.pos[heap[2 * i + 1]] = -1 - i;
+            i = parent;
+        }
+        heap[2 * i] = score;
+        heap[2 * i + 1] = slot;
+        this.pos[slot] = -1 - i;
+    }
+
+    restDown(i) {
+        const heap = this.rest;
+        const size = this.restSize;
+        const score = heap[2 * i];
+        const slot = heap[2 * i + 1];
+        for (;;) {
+            const first = 4 * i + 1;
+            if (first >= size) {
+                break;
+            }
+            let child = first;
+            const last = Math.min(first + 4, size);
+            for (let c = first + 1; c < last; c++) {
+                if (better(heap[2 * c], heap[2 * c + 1], heap[2 * child], heap[2 * child + 1])) {
+                    child = c;
+                }
+            }
+            if (!better(heap[2 * child], heap[2 * child + 1], score, slot)) {
+                break;
+            }
+            heap[2 * i] = heap[2 * child];
+            heap[2 * i + 1] = heap[2 * child + 1];
+            this.pos[heap[2 * i + 1]] = -1 - i;
+            i = child;
+        }
+        heap[2 * i] = score;
+        heap[2 * i + 1] = slot;
+        this.pos[slot] = -1 - i;
+    }
+}
+
+class Leaderboard {
+    // options: { weights: { 'Wander Time': 1, ... }, groups: { name: ['1', '3'] }, k, horizons }
+    constructor(options = {}) {
+        this.weights = { ...DEFAULT_WEIGHTS, ...(options.weights || {}) };
+        this.weightOf = Float64Array.from(STATE_NAMES, name => this.weights[name] || 0);
+        this.k = options.k || DEFAULT_K;
+        this.horizons = (options.horizons || HORIZONS).slice().sort((a, b) => a.ms - b.ms);
+
+        this.catIds = []; // cat index -> cat ID
+        this.cats = new Map(); // cat ID -> cat index
+        // Every cat is in ALL under its own index; named groups are listed per cat as
+        // (group, slot) pairs in memberList, from memberStart[c] for memberCount[c] pairs
+        this.memberStart = new Int32Array(INITIAL_CAPACITY);
+        this.memberCount = new Uint8Array(INITIAL_CAPACITY);
+        this.memberList = new Int32Array(INITIAL_CAPACITY);
+        this.memberListSize = 0;
+        this.groups = [{ name: ALL, members: [], boards: this.horizons.map(() => new TopK(this.k)) }];
+        this.groupsOf = new Map(); // cat ID -> named group indexes, for cats not seen yet
+        Object.entries(options.groups || {}).forEach(([name, catIds]) => {
+            const g = this.groups.length;
+            this.groups.push({ name, members: [], boards: this.horizons.map(() => new TopK(this.k)) });
+            catIds.map(String).forEach((catId) => {
+                this.groupsOf.set(catId, (this.groupsOf.get(catId) || []).concat(g));
+            });
+        });
+        this.boards = this.groups.flatMap(group => group.boards); // [group * horizons + horizon]
+
+        // Ring of scored records, oldest at tail; sequence numbers index it modulo its capacity
+        this.ringT = new Float64Array(INITIAL_CAPACITY);
+        this.ringCat = new Int32Array(INITIAL_CAPACITY);
+        this.ringDuration = new Float32Array(INITIAL_CAPACITY);
+        this.ringState = new Uint8Array(INITIAL_CAPACITY);
+        this.head = 0; // Next sequence number
+        this.cursors = new Float64Array(this.horizons.length); // First record still inside each horizon
+        this.now = -Infinity;
+        this.counters = { records: 0, dropped: 0, expired: 0 };
+    }
+
+    catOf(catId) {
+        let c = this.cats.get(catId);
+        if (c === undefined) {
+            c = this.catIds.length;
+            this.catIds.push(catId);
+            this.cats.set(catId, c);
+            const named = this.groupsOf.get(catId) || [];
+            if (c >= this.memberStart.length) {
+                this.memberStart = grow(this.memberStart, c + 1);
+                this.memberCount = grow(this.memberCount, c + 1);
+            }
+            if (this.memberListSize + 2 * named.length > this.memberList.length) {
+                this.memberList = grow(this.memberList, this.memberListSize + 2 * named.length);
+            }
+            this.memberStart[c] = this.memberListSize;
+            this.memberCount[c] = named.length;
+            [0].concat(named).forEach((g) => {
+                const group = this.groups[g];
+                const slot = group.members.length;
+                group.members.push(c);
+                group.boards.forEach(board => board.insert(slot));
+                if (g > 0) {
+                    this.memberList[this.memberListSize++] = g;
+                    this.memberList[this.memberListSize++] = slot;
+                }
+            });
+        }
+        return c;
+    }
+
+    // One status record: t in epoch ms, state an index into STATE_NAMES, duration in seconds
+    update(catId, t, state, duration) {
+        const c = this.catOf(String(catId));
+        this.counters.records++;
+        this.advance(t);
+        if (t <= this.now - this.horizons[this.horizons.length - 1].ms) {
+            this.counters.dropped++;
+            return;
+        }
+        if (!(this.weightOf[state] > 0) || !(duration > 0)) {
+            return;
+        }
+
+        if (this.head - this.cursors[this.horizons.length - 1] >= this.ringT.length) {
+            this.growRing();
+        }
+        const i = this.head % this.ringT.length;
+        this.ringT[i] = this.now;
+        this.ringCat[i] = c;
+        this.ringDuration[i] = duration;
+        this.ringState[i] = state;
+        this.head++;
+        for (let h = 0; h < this.horizons.length; h++) {
+            this.credit(c, h, this.scoreOf(h, state, this.ringDuration[i]));
+        }
+    }
+
+    // Move the windows up to t, taking out the records that fall behind them
+    advance(t) {
+        if (!(t > this.now)) {
+            return;
+        }
+        this.now = t;
+        const size = this.ringT.length;
+        for (let h = 0; h < this.horizons.length; h++) {
+            const from = t - this.horizons[h].ms;
+            let seq = this.cursors[h];
+            while (seq < this.head && this.ringT[seq % size] <= from) {
+                const i = seq % size;
+                this.credit(this.ringCat[i], h, -this.scoreOf(h, this.ringState[i], this.ringDuration[i]));
+                this.counters.expired++;
+                seq++;
+            }
+            this.cursors[h] = seq;
+        }
+    }
+
+    scoreOf(h, state, duration) {
+        return this.weightOf[state] * Math.min(duration, this.horizons[h].ms / 1000);
+    }
+
+    credit(c, h, delta) {
+        this.boards[h].add(c, delta);
+        const horizons = this.horizons.length;
+        const end = this.memberStart[c] + 2 * this.memberCount[c];
+        for (let m = this.memberStart[c]; m < end; m += 2) {
+            this.boards[this.memberList[m] * horizons + h].add(this.memberList[m + 1], delta);
+        }
+    }
+
+    // Double the ring, keeping each record at its sequence number modulo the new size
+    growRing() {
+        const size = this.ringT.length;
+        const next = size * 2;
+        const tail = this.cursors[this.horizons.length - 1];
+        const move = (from) => {
+            const to = new from.constructor(next);
+            for (let seq = tail; seq < this.head;) {
+                const src = seq % size;
+                const dst = seq % next;
+                const n = Math.min(this.head - seq, size - src, next - dst);
+                to.set(from.subarray(src, src + n), dst);
+                seq += n;
+            }
+            return to;
+        };
+        this.ringT = move(this.ringT);
+        this.ringCat = move(this.ringCat);
+        this.ringDuration = move(this.ringDuration);
+        this.ringState = move(this.ringState);
+    }
+
+    // State for a checkpoint (lib/checkpoint.js): the cats, and the records still inside
+    // the longest horizon in time order
+    snapshot() {
+        const tail = this.cursors[this.horizons.length - 1];
+        const count = this.head - tail;
+        const size = this.ringT.length;
+        const ring = {
+            t: new Float64Array(count),
+            cat: new Int32Array(count),
+            duration: new Float32Array(count),
+            state: new Uint8Array(count)
+        };
+        for (let n = 0; n < count; n++) {
+            const i = (tail + n) % size;
+            ring.t[n] = this.ringT[i];
+            ring.cat[n] = this.ringCat[i];
+            ring.duration[n] = this.ringDuration[i];
+            ring.state[n] = this.ringState[i];
+        }
+        return { catIds: this.catIds, now: this.now, counters: this.counters, ...ring };
+    }
+
+    // Take over a snapshot's cats and records; call on a new Leaderboard. Scores are
+    // recomputed from the records, so the current weights, groups and horizons apply.
+    restore(snapshot) {
+        snapshot.catIds.forEach(catId => this.catOf(catId));
+        const count = snapshot.t.length;
+        let size = this.ringT.length;
+        while (size < count) {
+            size *= 2;
+        }
+        this.ringT = new Float64Array(size);
+        this.ringCat = new Int32Array(size);
+        this.ringDuration = new Float32Array(size);
+        this.ringState = new Uint8Array(size);
+        this.ringT.set(snapshot.t);
+        this.ringCat.set(snapshot.cat);
+        this.ringDuration.set(snapshot.duration);
+        this.ringState.set(snapshot.state);
+        this.head = count;
+        this.now = snapshot.now;
+        Object.assign(this.counters, snapshot.counters);
+
+        const horizons = this.horizons.length;
+        const cats = this.catIds.length;
+        const scores = new Float64Array(cats * horizons); // [cat * horizons + horizon]
+        for (let h = 0; h < horizons; h++) {
+            let seq = 0;
+            while (seq < count && this.ringT[seq] <= this.now - this.horizons[h].ms) {
+                seq++;
+            }
+            this.cursors[h] = seq;
+            for (; seq < count; seq++) {
+                scores[this.ringCat[seq] * horizons + h] += this.scoreOf(h, this.ringState[seq], this.ringDuration[seq]);
+            }
+        }
+        const slotScores = new Float64Array(cats);
+        this.groups.forEach((group) => {
+            group.boards.forEach((board, h) => {
+                group.members.forEach((c, slot) => {
+                    slotScores[slot] = scores[c * horizons + h];
+                });
+                board.build(slotScores, group.members.length);
+            });
+        });
+    }
+
+    // Hand some cats over to another board (lib/shard.js): a snapshot of just their
+    // records, for mergeSnapshots and restore. Here they then score nothing; their
+    // records stay in the ring with no duration, so expiring them takes nothing out.
+    extract(catIds) {
+        const wanted = new Map(); // cat index -> index in the snapshot's catIds
+        const ids = [];
+        catIds.forEach((catId) => {
+            const c = this.cats.get(String(catId));
+            if (c !== undefined && !wanted.has(c)) {
+                wanted.set(c, ids.length);
+                ids.push(this.catIds[c]);
+            }
+        });
+        const records = { t: [], cat: [], duration: [], state: [] };
+        const size = this.ringT.length;
+        for (let seq = this.cursors[this.horizons.length - 1]; seq < this.head; seq++) {
+            const i = seq % size;
+            const c = this.ringCat[i];
+            if (!wanted.has(c) || this.ringDuration[i] === 0) {
+                continue;
+            }
+            records.t.push(this.ringT[i]);
+            records.cat.push(wanted.get(c));
+            records.duration.push(this.ringDuration[i]);
+            records.state.push(this.ringState[i]);
+            for (let h = 0; h < this.horizons.length; h++) {
+                if (seq >= this.cursors[h]) {
+                    this.credit(c, h, -this.scoreOf(h, this.ringState[i], this.ringDuration[i]));
+                }
+            }
+            this.ringDuration[i] = 0;
+        }
+        return {
+            catIds: ids,
+            now: this.now,
+            counters: { records: 0, dropped: 0, expired: 0 },
+            t: Float64Array.from(records.t),
+            cat: Int32Array.from(records.cat),
+            duration: Float32Array.from(records.duration),
+            state: Uint8Array.from(records.state)
+        };
+    }
+
+    // [{ rank, catId, score }] of up to k cats with a score in horizon (a name from HORIZONS)
+    // for group (ALL or a configured name), as of now; null for an unknown horizon or group
+    top(horizon, group = ALL, k = this.k, now = Date.now()) {
+        const h = this.horizons.findIndex(entry => entry.name === horizon);
+        const g = this.groups.findIndex(entry => entry.name === group);
+        if (h < 0 || g < 0) {
+            return null;
+        }
+        this.advance(now);
+        const { members, boards } = this.groups[g];
+        return boards[h].best(Math.min(k, this.k))
+            .filter(entry => entry.score > 1e-6)
+            .map((entry, i) => ({ rank: i + 1, catId: this.catIds[members[entry.slot]], score: Math.round(entry.score * 100) / 100 }));
+    }
+
+    stats() {
+        return {
+            cats: this.catIds.length,
+            groups: this.groups.map(group => group.name),
+            horizons: this.horizons.map(entry => entry.name),
+            k: this.k,
+            weights: this.weights,
+            ringRecords: this.head - this.cursors[this.horizons.length - 1],
+            ...this.counters
+        };
+    }
+}
+
+// One snapshot from several (snapshot() or extract() of boards that held different
+// cats), with the records merged back into time order, for restore()
+function mergeSnapshots(snapshots) {
+    const catIds = [];
+    const index = new Map();
+    const remap = snapshots.map(snapshot => Int32Array.from(snapshot.catIds, (catId) => {
+        if (!index.has(catId)) {
+            index.set(catId, catIds.length);
+            catIds.push(catId);
+        }
+        return index.get(catId);
+    }));
+    const order = [];
+    snapshots.forEach((snapshot, s) => {
+        for (let n = 0; n < snapshot.t.length; n++) {
+            order.push({ t: snapshot.t[n], s, n });
+        }
+    });
+    order.sort((a, b) => a.t - b.t || a.s - b.s || a.n - b.n);
+    const merged = {
+        catIds,
+        now: Math.max(-Infinity, ...snapshots.map(snapshot => snapshot.now)),
+        counters: { records: 0, dropped: 0, expired: 0 },
+        t: new Float64Array(order.length),
+        cat: new Int32Array(order.length),
+        duration: new Float32Array(order.length),
+        state: new Uint8Array(order.length)
+    };
+    snapshots.forEach((snapshot) => {
+        Object.keys(merged.counters).forEach((key) => {
+            merged.counters[key] += snapshot.counters[key];
+        });
+    });
+    order.forEach(({ s, n }, i) => {
+        const snapshot = snapshots[s];
+        merged.t[i] = snapshot.t[n];
+        merged.cat[i] = remap[s][snapshot.cat[n]];
+        merged.duration[i] = snapshot.duration[n];
+        merged.state[i] = snapshot.state[n];
+    });
+    return merged;
+}
+
+module.exports = {
+    ALL,
+    DEFAULT_K,
+    DEFAULT_WEIGHTS,
+    HORIZONS,
+    Leaderboard,
+    mergeSnapshots,
+    parseWeights
+};
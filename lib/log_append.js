@@ -0,0 +1,53 @@
+// log_append.js
+//
+// Batched appends for the ingest paths that write the status and data logs
+// themselves (serial_ingest.js, relay_ingest.js): one write per file per FLUSH_MS,
+// shared by every ingest in the process. Call flushAll() before exiting.
+
+const fs = require('fs');
+
+const FLUSH_MS = 100;
+
+const appenders = new Map();
+
+function append(file, text) {
+    let appender = appenders.get(file);
+    if (!appender) {
+        appender = { chunks: [], timer: null };
+        appenders.set(file, appender);
+    }
+    appender.chunks.push(text);
+    if (!appender.timer) {
+        appender.timer = setTimeout(() => flushAppender(file, appender), FLUSH_MS);
+    }
+}
+
+function flushAppender(file, appender) {
+    appender.timer = null;
+    const text = appender.chunks.join('');
+    appender.chunks = [];
+    if (text.length > 0) {
+        fs.appendFile(file, text, (err) => {
+            if (err) {
+                console.error(`Error writing ${file}:`, err.message);
+            }
+        });
+    }
+}
+
+function flushAll() {
+    for (const [file, appender] of appenders) {
+        clearTimeout(appender.timer);
+        appender.timer = null;
+        const text = appender.chunks.join('');
+        appender.chunks = [];
+        if (text.length > 0) {
+            fs.appendFileSync(file, text);
+        }
+    }
+}
+
+module.exports = {
+    append,
+    flushAll
+};
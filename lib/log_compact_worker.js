@@ -0,0 +1,17 @@
+// log_compact_worker.js
+//
+// Worker thread that runs one compaction for LogStore (lib/log_store.js).
+
+const os = require('os');
+const { parentPort, workerData } = require('worker_threads');
+const { compactDir } = require('./log_segments');
+
+// Linux nice values are per thread, so this lowers the worker and not the server
+try {
+    os.setPriority(19);
+} catch (err) {
+    // Not permitted or not supported; compaction still runs, just at normal priority
+}
+
+const { dir, kind, options } = workerData;
+parentPort.postMessage(compactDir(dir, kind, options));
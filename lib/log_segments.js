@@ -0,0 +1,536 @@
+// log_segments.js
+//
+// On-disk layout and compaction for the telemetry logs; lib/log_store.js runs it on a
+// worker thread and tools/bench_logs.js runs it directly.
+//
+// logs/<name>/
+//   rotated-<ms>.log      raw lines taken out of the live log at <ms>, not yet compacted
+//   <day>.<ms>.part       lines of <day> (UTC, YYYY-MM-DD) that were in rotated-<ms>.log
+//   <day>.seg             sealed day: every part of a day that has ended, merged
+//   rollups.json          footer of every sealed day and their running total, kept forever
+//   <day>.ivl             the sealed day as intervals (public/interval_codec.js), a few bytes
+//                         a line; kept forever, like the rollups. lib/analytics.js scans these
+//
+// A part or segment is the gzip-compressed raw lines followed by a JSON footer:
+//   [gzip members][footer JSON][u32 LE footer length]["CSEG"]
+// The footer is { day, parts: [<ms>, ...], lines, bytes, summary }, where summary holds
+// the per-cat totals of the kind (below), so totals never need the body decompressed.
+// Sealing concatenates the parts' gzip members, which is still one valid gzip stream.
+//
+// Sealed segments older than the raw retention are deleted; their rollups and intervals stay.
+
+const fs = require('fs');
+const path = require('path');
+const zlib = require('zlib');
+const { STATE_NAMES, aggregateStatusLog, groupDataLog, parseStatusLog } = require('./telemetry');
+const { UNKNOWN_STATE, encodeBlock } = require('../public/interval_codec');
+
+const MAGIC = 'CSEG';
+const TRAILER_LEN = 8;
+const DAY_MS = 86400000;
+// Runs in interval blocks end at silences longer than this, as the analytics sessions do
+const INTERVAL_GAP_MS = Number(process.env.ANALYTICS_MAX_GAP_MS) || 12 * 3600000;
+
+const ROTATED_RE = /^rotated-(\d+)\.log$/;
+const PART_RE = /^(\d{4}-\d\d-\d\d)\.(\d+)\.part$/;
+const SEALED_RE = /^(\d{4}-\d\d-\d\d)\.seg$/;
+const INTERVALS_RE = /^(\d{4}-\d\d-\d\d)\.ivl$/;
+
+function dayName(dayNumber) {
+    return new Date(dayNumber * DAY_MS).toISOString().slice(0, 10);
+}
+
+// Parse `len` ASCII digits at buf[start], or -1
+function readDigits(buf, start, len) {
+    let value = 0;
+    for (let i = start; i < start + len; i++) {
+        const c = buf[i] - 48;
+        if (c < 0 || c > 9) {
+            return -1;
+        }
+        value = value * 10 + c;
+    }
+    return value;
+}
+
+const ID_FIELD = Buffer.from('| ID ');
+
+// Each kind knows which day a raw line belongs to, how to total a day's lines per cat and
+// how to write them as an interval block with a series per collar.
+// dayOf() returns the UTC day number of the line at buf[start..end), or -1 if it has none.
+const KINDS = {
+    // cat_status_log.txt: "Port 3334 | ID <arrival epoch ms> | Message: ..."
+    // summary: { cats: { '1': { 'Wander Time': <seconds>, ... }, ... } }
+    status: {
+        dayOf(buf, start, end) {
+            const field = buf.indexOf(ID_FIELD, start);
+            if (field < 0 || field >= end) {
+                return -1;
+            }
+            let ms = 0;
+            for (let i = field + ID_FIELD.length; i < end && buf[i] >= 48 && buf[i] <= 57; i++) {
+                ms = ms * 10 + (buf[i] - 48);
+            }
+            return ms > 0 ? Math.floor(ms / DAY_MS) : -1;
+        },
+        summarise(buf) {
+            return { cats: aggregateStatusLog(buf).catStates };
+        },
+        merge(a, b) {
+            const cats = {};
+            for (const summary of [a, b]) {
+                for (const [catId, states] of Object.entries(summary.cats)) {
+                    const total = cats[catId] = cats[catId] || {};
+                    for (const [state, seconds] of Object.entries(states)) {
+                        total[state] = (total[state] || 0) + seconds;
+                    }
+                }
+            }
+            return { cats };
+        },
+        empty() {
+            return { cats: {} };
+        },
+        // Series per port, timed as the analytics scans time records
+        intervals(buf) {
+            const cols = parseStatusLog(buf);
+            const byPort = new Map();
+            for (let i = 0; i < cols.count; i++) {
+                const time = Number.isNaN(cols.sourceTime[i]) ? cols.id[i] : cols.sourceTime[i] / 1000;
+                if (!Number.isNaN(time)) {
+                    (byPort.get(cols.port[i]) || byPort.set(cols.port[i], []).get(cols.port[i])).push(i);
+                }
+            }
+            const series = [...byPort].sort((a, b) => a[0] - b[0]).map(([port, rows]) => {
+                const records = {
+                    count: rows.length,
+                    time: new Float64Array(rows.length),
+                    state: new Uint8Array(rows.length),
+                    temperature: new Float64Array(rows.length)
+                };
+                rows.forEach((i, k) => {
+                    records.time[k] = Number.isNaN(cols.sourceTime[i]) ? cols.id[i] : cols.sourceTime[i] / 1000;
+                    records.state[k] = cols.state[i];
+                    // Logged to 2 decimals; the parsers may hand back a float32
+                    records.temperature[k] = Math.round(cols.temperature[i] * 100) / 100;
+                });
+                return { key: String(port), records };
+            });
+            return encodeBlock(series, INTERVAL_GAP_MS);
+        }
+    },
+
+    // cat_data.csv: "<ISO arrival time>, [<host>:<port>, ]<status message>"
+    // summary: { sources: { '<host>:<port>': { samples, states: { <state>: <samples> },
+    //                                          tempMin, tempMax, tempSum, tempCount, first, last } } }
+    data: {
+        dayOf(buf, start, end) {
+            if (end - start < 10 || buf[start + 4] !== 0x2D || buf[start + 7] !== 0x2D) {
+                return -1;
+            }
+            const year = readDigits(buf, start, 4);
+            const month = readDigits(buf, start + 5, 2);
+            const day = readDigits(buf, start + 8, 2);
+            if (year < 0 || month < 1 || day < 1) {
+                return -1;
+            }
+            return Date.UTC(year, month - 1, day) / DAY_MS;
+        },
+        summarise(buf) {
+            const sources = {};
+            for (const [source, records] of Object.entries(groupDataLog(buf))) {
+                const s = sources[source] = {
+                    samples: 0, states: {}, tempMin: null, tempMax: null, tempSum: 0, tempCount: 0, first: null, last: null
+                };
+                for (const record of records) {
+                    s.samples++;
+                    if (record.state) {
+                        s.states[record.state] = (s.states[record.state] || 0) + 1;
+                    }
+                    if (record.temperature !== null) {
+                        s.tempMin = s.tempMin === null ? record.temperature : Math.min(s.tempMin, record.temperature);
+                        s.tempMax = s.tempMax === null ? record.temperature : Math.max(s.tempMax, record.temperature);
+                        s.tempSum += record.temperature;
+                        s.tempCount++;
+                    }
+                    if (record.time) {
+                        s.first = s.first === null || record.time < s.first ? record.time : s.first;
+                        s.last = s.last === null || record.time > s.last ? record.time : s.last;
+                    }
+                }
+            }
+            return { sources };
+        },
+        merge(a, b) {
+            const sources = JSON.parse(JSON.stringify(a.sources));
+            for (const [source, s] of Object.entries(b.sources)) {
+                const t = sources[source];
+                if (!t) {
+                    sources[source] = JSON.parse(JSON.stringify(s));
+                    continue;
+                }
+                const pick = (x, y, fn) => (x === null ? y : (y === null ? x : fn(x, y)));
+                t.samples += s.samples;
+                for (const [state, count] of Object.entries(s.states)) {
+                    t.states[state] = (t.states[state] || 0) + count;
+                }
+                t.tempMin = pick(t.tempMin, s.tempMin, Math.min);
+                t.tempMax = pick(t.tempMax, s.tempMax, Math.max);
+                t.tempSum += s.tempSum;
+                t.tempCount += s.tempCount;
+                t.first = pick(t.first, s.first, (x, y) => (x < y ? x : y));
+                t.last = pick(t.last, s.last, (x, y) => (x > y ? x : y));
+            }
+            return { sources };
+        },
+        empty() {
+            return { sources: {} };
+        },
+        // Timed as the dashboard draws records: the collar's stamp, else the arrival time
+        intervals(buf) {
+            const grouped = groupDataLog(buf);
+            return encodeBlock(Object.keys(grouped).map((source) => {
+                const rows = grouped[source].filter(record => record.time);
+                const records = {
+                    count: rows.length,
+                    time: new Float64Array(rows.length),
+                    state: new Uint8Array(rows.length),
+                    temperature: new Float64Array(rows.length)
+                };
+                rows.forEach((record, i) => {
+                    const state = STATE_NAMES.indexOf(record.state);
+                    records.time[i] = Date.parse(record.time);
+                    records.state[i] = state < 0 ? UNKNOWN_STATE : state;
+                    records.temperature[i] = record.temperature === null ? NaN : record.temperature;
+                });
+                return { key: source, records };
+            }), INTERVAL_GAP_MS);
+        }
+    }
+};
+
+function mergeFooters(kind, a, b) {
+    return {
+        day: a.day || b.day,
+        parts: [...a.parts, ...b.parts].sort((x, y) => x - y),
+        lines: a.lines + b.lines,
+        bytes: a.bytes + b.bytes,
+        summary: kind.merge(a.summary, b.summary)
+    };
+}
+
+function emptyFooter(kind, day) {
+    return { day, parts: [], lines: 0, bytes: 0, summary: kind.empty() };
+}
+
+// Segment files ///////////////////////////////////////////////////////////////
+
+function encodeSegment(gzipBody, footer) {
+    const json = Buffer.from(JSON.stringify(footer), 'utf8');
+    const trailer = Buffer.alloc(TRAILER_LEN);
+    trailer.writeUInt32LE(json.length, 0);
+    trailer.write(MAGIC, 4, 'latin1');
+    return Buffer.concat([gzipBody, json, trailer]);
+}
+
+// Split a segment file into { body (gzip), footer }
+function decodeSegment(buf, name) {
+    if (buf.length < TRAILER_LEN || buf.toString('latin1', buf.length - 4) !== MAGIC) {
+        throw new Error(`${name}: not a log segment`);
+    }
+    const jsonLen = buf.readUInt32LE(buf.length - TRAILER_LEN);
+    const bodyEnd = buf.length - TRAILER_LEN - jsonLen;
+    if (bodyEnd < 0) {
+        throw new Error(`${name}: truncated footer`);
+    }
+    return {
+        body: buf.subarray(0, bodyEnd),
+        footer: JSON.parse(buf.toString('utf8', bodyEnd, buf.length - TRAILER_LEN))
+    };
+}
+
+// Footer only: reads the tail of the file instead of the whole segment
+function readFooter(file) {
+    const fd = fs.openSync(file, 'r');
+    try {
+        const size = fs.fstatSync(fd).size;
+        const trailer = Buffer.alloc(TRAILER_LEN);
+        fs.readSync(fd, trailer, 0, TRAILER_LEN, Math.max(0, size - TRAILER_LEN));
+        if (size < TRAILER_LEN || trailer.toString('latin1', 4) !== MAGIC) {
+            throw new Error(`${file}: not a log segment`);
+        }
+        const jsonLen = trailer.readUInt32LE(0);
+        const json = Buffer.alloc(jsonLen);
+        fs.readSync(fd, json, 0, jsonLen, size - TRAILER_LEN - jsonLen);
+        return JSON.parse(json.toString('utf8'));
+    } finally {
+        fs.closeSync(fd);
+    }
+}
+
+// Raw lines of a segment
+function readSegmentLines(file) {
+    const body = decodeSegment(fs.readFileSync(file), file).body;
+    return body.length > 0 ? zlib.gunzipSync(body) : Buffer.alloc(0);
+}
+
+// Write via a temporary file so a crash never leaves a half-written segment
+function writeAtomic(file, data) {
+    fs.writeFileSync(`${file}.tmp`, data);
+    fs.renameSync(`${file}.tmp`, file);
+}
+
+function countLines(buf) {
+    let lines = 0;
+    for (let i = buf.indexOf(10); i >= 0; i = buf.indexOf(10, i + 1)) {
+        lines++;
+    }
+    return lines;
+}
+
+// Compaction //////////////////////////////////////////////////////////////////
+
+// Split one rotated file into a part per day. Lines without a day of their own stay
+// with the line before them (or go to the rotation day if they come first).
+function splitRotated(dir, kind, file, rotatedMs) {
+    const buf = fs.readFileSync(path.join(dir, file));
+    const runs = new Map(); // day number -> [Buffer slices]
+    let runDay = Math.floor(rotatedMs / DAY_MS);
+    let runStart = 0;
+
+    for (let start = 0; start < buf.length;) {
+        let end = buf.indexOf(10, start);
+        end = end < 0 ? buf.length : end + 1;
+        const day = kind.dayOf(buf, start, end);
+        if (day >= 0 && day !== runDay) {
+            if (start > runStart) {
+                (runs.get(runDay) || runs.set(runDay, []).get(runDay)).push(buf.subarray(runStart, start));
+            }
+            runDay = day;
+            runStart = start;
+        }
+        start = end;
+    }
+    if (buf.length > runStart) {
+        (runs.get(runDay) || runs.set(runDay, []).get(runDay)).push(buf.subarray(runStart));
+    }
+
+    for (const [dayNumber, slices] of runs) {
+        const lines = slices.length === 1 ? slices[0] : Buffer.concat(slices);
+        const day = dayName(dayNumber);
+        const footer = {
+            day,
+            parts: [rotatedMs],
+            lines: countLines(lines),
+            bytes: lines.length,
+            summary: kind.summarise(lines)
+        };
+        // Named after the rotated file, so redoing this after a crash rewrites the same part
+        writeAtomic(path.join(dir, `${day}.${rotatedMs}.part`), encodeSegment(zlib.gzipSync(lines), footer));
+    }
+    fs.unlinkSync(path.join(dir, file));
+    return buf.length;
+}
+
+// <day>.ivl from <day>.seg
+function writeIntervals(dir, kind, day) {
+    const block = kind.intervals(readSegmentLines(path.join(dir, `${day}.seg`)));
+    writeAtomic(path.join(dir, `${day}.ivl`), block);
+}
+
+// Whether <day>.ivl needs writing from <day>.seg: it is missing (sealed before intervals
+// were kept), older than the segment (a crash between the two writes) or has another gap
+function intervalsStale(dir, day, exists) {
+    if (!exists) {
+        return true;
+    }
+    const file = path.join(dir, `${day}.ivl`);
+    return fs.statSync(file).mtimeMs < fs.statSync(path.join(dir, `${day}.seg`)).mtimeMs ||
+        intervalGapMs(file) !== INTERVAL_GAP_MS;
+}
+
+// The run gap an interval file was written with, or null if it is unreadable
+function intervalGapMs(file) {
+    const fd = fs.openSync(file, 'r');
+    try {
+        const head = Buffer.alloc(16);
+        const read = fs.readSync(fd, head, 0, head.length, 0);
+        if (read < 6 || head.toString('latin1', 0, 4) !== 'CIVL') {
+            return null;
+        }
+        let value = 0;
+        for (let i = 5, scale = 1; i < read; i++, scale *= 0x80) {
+            value += (head[i] & 0x7F) * scale;
+            if (!(head[i] & 0x80)) {
+                return value;
+            }
+        }
+        return null;
+    } finally {
+        fs.closeSync(fd);
+    }
+}
+
+// { total: footer over every sealed day, days: { <day>: footer } }
+function readRollups(dir, kind) {
+    try {
+        return JSON.parse(fs.readFileSync(path.join(dir, 'rollups.json'), 'utf8'));
+    } catch (err) {
+        if (err.code === 'ENOENT') {
+            return { total: emptyFooter(kind, null), days: {} };
+        }
+        throw err;
+    }
+}
+
+// Merge every part of an ended day into <day>.seg and add it to the rollups
+function sealDay(dir, kind, day, partFiles, rollups) {
+    const sealedPath = path.join(dir, `${day}.seg`);
+    const rollup = rollups.days[day] || emptyFooter(kind, day);
+    let footer = rollup; // Raw data already expired; late lines still add to the rollup
+    const bodies = [];
+    if (fs.existsSync(sealedPath)) {
+        const sealed = decodeSegment(fs.readFileSync(sealedPath), sealedPath);
+        footer = sealed.footer;
+        bodies.push(sealed.body);
+    }
+
+    // A crash between the writes below leaves parts that <day>.seg, or also the
+    // rollups, already hold; each is added only where it is missing
+    let added = emptyFooter(kind, day);
+    const holds = (f, part) => part.footer.parts.every(ms => f.parts.includes(ms));
+    for (const file of partFiles) {
+        const part = decodeSegment(fs.readFileSync(path.join(dir, file)), file);
+        if (!holds(footer, part)) {
+            footer = mergeFooters(kind, footer, part.footer);
+            bodies.push(part.body);
+        }
+        if (!holds(rollup, part)) {
+            added = mergeFooters(kind, added, part.footer);
+        }
+    }
+
+    writeAtomic(sealedPath, encodeSegment(Buffer.concat(bodies), footer));
+    writeIntervals(dir, kind, day);
+    rollups.days[day] = footer;
+    // Day and parts are not meaningful across days, and parts would grow without bound
+    rollups.total = { ...mergeFooters(kind, rollups.total, added), day: null, parts: [] };
+    writeAtomic(path.join(dir, 'rollups.json'), JSON.stringify(rollups));
+    for (const file of partFiles) {
+        fs.unlinkSync(path.join(dir, file));
+    }
+}
+
+// Compact every rotated file in dir, seal the days before now's day and delete raw
+// segments older than rawDays. Options: { now, rawDays, recent }
+// Returns { rotatedBytes, sealedDays, expiredDays, totals, recent }: totals is the
+// footer merged over every rollup and open part; recent is the raw lines of the open
+// parts when options.recent is set.
+function compactDir(dir, kindName, options = {}) {
+    const kind = KINDS[kindName];
+    const now = options.now || Date.now();
+    const rawDays = options.rawDays === undefined ? 30 : options.rawDays;
+    const today = dayName(Math.floor(now / DAY_MS));
+    const expiry = dayName(Math.floor(now / DAY_MS) - rawDays);
+    fs.mkdirSync(dir, { recursive: true });
+
+    // Oldest first, so parts and seals see lines in the order they were logged
+    let rotatedBytes = 0;
+    const rotated = fs.readdirSync(dir)
+        .map(file => ROTATED_RE.exec(file))
+        .filter(Boolean)
+        .sort((a, b) => Number(a[1]) - Number(b[1]));
+    for (const [file, ms] of rotated) {
+        rotatedBytes += splitRotated(dir, kind, file, Number(ms));
+    }
+
+    const partsByDay = new Map();
+    for (const file of fs.readdirSync(dir)) {
+        const match = PART_RE.exec(file);
+        if (match) {
+            (partsByDay.get(match[1]) || partsByDay.set(match[1], []).get(match[1])).push(file);
+        }
+    }
+
+    const rollups = readRollups(dir, kind);
+    const sealedDays = [];
+    for (const [day, files] of [...partsByDay].sort()) {
+        if (day < today) {
+            files.sort((a, b) => Number(PART_RE.exec(a)[2]) - Number(PART_RE.exec(b)[2]));
+            sealDay(dir, kind, day, files, rollups);
+            partsByDay.delete(day);
+            sealedDays.push(day);
+        }
+    }
+
+    const expiredDays = [];
+    const names = fs.readdirSync(dir);
+    const intervals = new Set(names.map(file => INTERVALS_RE.exec(file)).filter(Boolean).map(match => match[1]));
+    for (const file of names) {
+        const match = SEALED_RE.exec(file);
+        if (match && match[1] < expiry) {
+            fs.unlinkSync(path.join(dir, file));
+            expiredDays.push(match[1]);
+        } else if (match && intervalsStale(dir, match[1], intervals.has(match[1]))) {
+            writeIntervals(dir, kind, match[1]);
+        }
+    }
+
+    // The running total keeps this independent of how many days have been sealed
+    let totals = rollups.total;
+    const open = [...partsByDay.values()].flat().sort();
+    for (const file of open) {
+        totals = mergeFooters(kind, totals, readFooter(path.join(dir, file)));
+    }
+    totals = { ...totals, day: null, parts: [] };
+
+    let recent = null;
+    if (options.recent) {
+        recent = Buffer.concat(open.map(file => readSegmentLines(path.join(dir, file))));
+    }
+    return { rotatedBytes, sealedDays, expiredDays, totals, recent };
+}
+
+// Files holding the lines rotated out of the live log at or after sinceMs, in the order
+// they were logged: [{ file, type: 'segment' | 'part' | 'rotated' }]. A sealed day is
+// listed whole if any of its parts qualifies.
+function filesSince(dir, sinceMs) {
+    const sinceDay = dayName(Math.floor(sinceMs / DAY_MS));
+    const files = [];
+    let names;
+    try {
+        names = fs.readdirSync(dir);
+    } catch (err) {
+        if (err.code === 'ENOENT') {
+            return [];
+        }
+        throw err;
+    }
+    for (const name of names) {
+        const file = path.join(dir, name);
+        let match;
+        if ((match = SEALED_RE.exec(name)) && match[1] >= sinceDay) {
+            const parts = readFooter(file).parts.filter(ms => ms >= sinceMs);
+            if (parts.length > 0) {
+                files.push({ file, type: 'segment', ms: Math.min(...parts), day: match[1] });
+            }
+        } else if ((match = PART_RE.exec(name)) && Number(match[2]) >= sinceMs) {
+            files.push({ file, type: 'part', ms: Number(match[2]), day: match[1] });
+        } else if ((match = ROTATED_RE.exec(name)) && Number(match[1]) >= sinceMs) {
+            files.push({ file, type: 'rotated', ms: Number(match[1]), day: '' });
+        }
+    }
+    // A rotation's lines run from its earliest day to its latest
+    return files
+        .sort((a, b) => a.ms - b.ms || (a.day < b.day ? -1 : a.day > b.day ? 1 : 0))
+        .map(({ file, type }) => ({ file, type }));
+}
+
+module.exports = {
+    KINDS,
+    compactDir,
+    filesSince,
+    readFooter,
+    readSegmentLines,
+    decodeSegment
+};
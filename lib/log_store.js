@@ -0,0 +1,232 @@
+// log_store.js
+//
+// Keeps a telemetry log (cat_data.csv, cat_status_log.txt) bounded on disk and in query
+// time. Writers keep appending to the live file; every COMPACT_INTERVAL_MS, or sooner
+// once it reaches MAX_LIVE_BYTES, the live file is renamed aside and a low-priority
+// worker thread compacts it into per-day gzip segments with per-cat summary footers
+// (format in lib/log_segments.js).
+//
+// Queries read the live file plus the totals the last compaction returned, so the
+// leader and chart cost the same on day 400 as on day 1:
+//   totals(cb)  all-time per-cat summary (sealed rollups + today's parts + live file)
+//   recent(cb)  raw lines of today's parts + live file, for the charts
+//   follow(cb)  every complete line appended to the live file from now on, in batches
+//   replaySince(ms, cb)  the lines logged since ms, for a restart to catch up from a checkpoint
+//
+// Raw day segments are kept for LOG_RAW_DAYS (default 30) days; rollups are kept forever.
+// Each log must be compacted by one process only: the server that owns it.
+
+const fs = require('fs');
+const path = require('path');
+const { Worker } = require('worker_threads');
+const { KINDS, filesSince, readSegmentLines } = require('./log_segments');
+
+const COMPACT_INTERVAL_MS = Number(process.env.LOG_COMPACT_INTERVAL_MS) || 3600000;
+const MAX_LIVE_BYTES = Number(process.env.LOG_MAX_LIVE_BYTES) || 16 * 1048576;
+const RAW_DAYS = process.env.LOG_RAW_DAYS !== undefined ? Number(process.env.LOG_RAW_DAYS) : 30;
+const CHECK_MS = 60000;
+const ROTATE_GRACE_MS = 1000; // Lets an append that opened the file before the rename finish
+const FOLLOW_MS = 1000;
+const REPLAY_MARGIN_MS = 60000; // Replays reach back this much further, past the rotation grace
+
+// Resolves with { data, offset }: file's bytes from offset on, or all of them if it
+// is now shorter than offset (replaced from outside)
+function readFrom(file, offset) {
+    return fs.promises.open(file, 'r').then(handle => handle.stat()
+        .then((stats) => {
+            const from = stats.size < offset ? 0 : offset;
+            const data = Buffer.alloc(stats.size - from);
+            return handle.read(data, 0, data.length, from).then(({ bytesRead }) => ({ data: data.subarray(0, bytesRead), offset: from }));
+        })
+        .finally(() => handle.close()));
+}
+
+class LogStore {
+    // kind: 'status' or 'data' (see KINDS in lib/log_segments.js)
+    constructor(livePath, kind, options = {}) {
+        this.livePath = livePath;
+        this.kind = kind;
+        this.dir = path.join(path.dirname(livePath), 'logs', path.basename(livePath, path.extname(livePath)));
+        this.rawDays = options.rawDays === undefined ? RAW_DAYS : options.rawDays;
+        this.intervalMs = options.intervalMs || COMPACT_INTERVAL_MS;
+        this.maxLiveBytes = options.maxLiveBytes || MAX_LIVE_BYTES;
+        this.keepRecent = Boolean(options.recent);
+
+        this.compacted = { totals: null, recent: Buffer.alloc(0) };
+        this.follower = null; // { onLines, offset, reading }
+        this.running = null;
+        this.lastRun = 0;
+        // Queries wait for the first compaction, which picks up a crashed run's leftovers.
+        // It leaves the live file in place, so starting up does not wait out a rotation.
+        this.ready = this.compact(false);
+        this.timer = setInterval(() => this.maybeCompact(), CHECK_MS);
+        this.timer.unref();
+    }
+
+    maybeCompact() {
+        fs.stat(this.livePath, (err, stats) => {
+            const due = Date.now() - this.lastRun >= this.intervalMs;
+            if (!err && stats.size > 0 && (due || stats.size >= this.maxLiveBytes)) {
+                this.compact();
+            }
+        });
+    }
+
+    // Rotate the live file (unless rotate is false) and compact; resolves once the new
+    // totals are in place
+    compact(rotate = true) {
+        if (this.running) {
+            return this.running;
+        }
+        this.running = (rotate ? this.rotate() : Promise.resolve())
+            .then(() => this.runWorker())
+            .then((result) => {
+                this.compacted = {
+                    totals: result.totals,
+                    recent: result.recent ? Buffer.from(result.recent.buffer, result.recent.byteOffset, result.recent.length) : Buffer.alloc(0)
+                };
+                if (result.rotatedBytes > 0 || result.expiredDays.length > 0) {
+                    console.log(`Compacted ${path.basename(this.livePath)}: ${result.rotatedBytes} bytes, ` +
+                        `sealed ${result.sealedDays.length} day(s), expired ${result.expiredDays.length}`);
+                }
+            })
+            .catch((err) => {
+                // Rotated files stay on disk and are picked up by the next run
+                console.error(`Compacting ${path.basename(this.livePath)} failed:`, err);
+            })
+            .finally(() => {
+                this.lastRun = Date.now();
+                this.running = null;
+            });
+        return this.running;
+    }
+
+    rotate() {
+        const rotated = path.join(this.dir, `rotated-${Date.now()}.log`);
+        return fs.promises.mkdir(this.dir, { recursive: true })
+            .then(() => fs.promises.rename(this.livePath, rotated))
+            .then(() => new Promise(resolve => setTimeout(resolve, ROTATE_GRACE_MS)))
+            .then(() => this.readFollowed(rotated, true))
+            .catch((err) => {
+                if (err.code !== 'ENOENT') {
+                    throw err;
+                }
+            });
+    }
+
+    runWorker() {
+        return new Promise((resolve, reject) => {
+            const worker = new Worker(path.join(__dirname, 'log_compact_worker.js'), {
+                workerData: {
+                    dir: this.dir,
+                    kind: this.kind,
+                    options: { rawDays: this.rawDays, recent: this.keepRecent }
+                }
+            });
+            worker.once('message', resolve);
+            worker.once('error', reject);
+            worker.once('exit', (code) => {
+                if (code !== 0) {
+                    reject(new Error(`Compaction worker exited with ${code}`));
+                }
+            });
+        });
+    }
+
+    readLive(callback) {
+        this.ready.then(() => {
+            fs.readFile(this.livePath, (err, data) => {
+                if (err && err.code === 'ENOENT') {
+                    callback(null, Buffer.alloc(0));
+                    return;
+                }
+                callback(err, data);
+            });
+        });
+    }
+
+    // onLines(Buffer) gets each batch of complete lines appended to the live file after
+    // its first offset bytes, once the first compaction is done, including any the next
+    // rotation moves aside
+    follow(onLines, offset = 0) {
+        this.ready.then(() => {
+            this.follower = { onLines, offset, reading: Promise.resolve() };
+            const timer = setInterval(() => this.readFollowed(this.livePath, false), FOLLOW_MS);
+            timer.unref();
+        });
+    }
+
+    // Hand the follower what file has gained since its offset. Reads are queued so the
+    // one that drains a rotated file runs after any poll of the live file before it.
+    readFollowed(file, rotated) {
+        const follower = this.follower;
+        if (!follower) {
+            return Promise.resolve();
+        }
+        follower.reading = follower.reading.then(() => readFrom(file, follower.offset)).then(({ data, offset }) => {
+            const end = data.lastIndexOf(10) + 1;
+            if (end > 0) {
+                follower.onLines(data.subarray(0, end));
+            }
+            follower.offset = rotated ? 0 : offset + end;
+        }).catch((err) => {
+            if (err.code !== 'ENOENT') {
+                console.error(`Following ${path.basename(this.livePath)} failed:`, err);
+            }
+        });
+        return follower.reading;
+    }
+
+    // onLines(Buffer) gets every line logged since sinceMs: each file rotated out since
+    // (from a little earlier, so lines a reader had not reached yet are included), then
+    // the live file. Resolves with the live file's length read, for follow() to go on from.
+    // Lines from before sinceMs come too; readers skip what they have already applied.
+    replaySince(sinceMs, onLines) {
+        return this.ready.then(() => {
+            filesSince(this.dir, sinceMs - REPLAY_MARGIN_MS).forEach(({ file, type }) => {
+                onLines(type === 'rotated' ? fs.readFileSync(file) : readSegmentLines(file));
+            });
+            let live = Buffer.alloc(0);
+            try {
+                live = fs.readFileSync(this.livePath);
+            } catch (err) {
+                if (err.code !== 'ENOENT') {
+                    throw err;
+                }
+            }
+            const end = live.lastIndexOf(10) + 1;
+            if (end > 0) {
+                onLines(live.subarray(0, end));
+            }
+            return end;
+        });
+    }
+
+    // callback(err, summary): the kind's per-cat summary over the whole history
+    totals(callback) {
+        this.readLive((err, live) => {
+            if (err) {
+                callback(err);
+                return;
+            }
+            const kind = KINDS[this.kind];
+            const compacted = this.compacted.totals ? this.compacted.totals.summary : kind.empty();
+            callback(null, kind.merge(compacted, kind.summarise(live)));
+        });
+    }
+
+    // callback(err, Buffer): today's raw lines, in the live file's format
+    recent(callback) {
+        this.readLive((err, live) => {
+            if (err) {
+                callback(err);
+                return;
+            }
+            callback(null, this.compacted.recent.length > 0 ? Buffer.concat([this.compacted.recent, live]) : live);
+        });
+    }
+}
+
+module.exports = {
+    LogStore
+};
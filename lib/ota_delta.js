@@ -0,0 +1,527 @@
+// ota_delta.js
+//
+// Builds the compressed firmware deltas applied by main/ota_patch.c (the format
+// is described there) and decodes them again to check every patch before it is
+// served.
+//
+// The diff is bsdiff's: find an approximate alignment of each region of the new
+// image in the old one, store the bytewise difference over the aligned part and
+// the unaligned remainder verbatim. A rebuild shifts code and data by a few
+// bytes, so most pointers change by the same small amount and the differences
+// are sparse and repetitive. bsdiff finds matches with a suffix array; a hash
+// of the next MATCH_BYTES bytes with bounded chains is enough for a 1-2 MB image
+// and keeps this dependency free. The op stream is then compressed with LZSS in
+// heatshrink's bit format, which the collar decodes with a 2-4 KB window.
+
+const crypto = require('crypto');
+
+const MAGIC = 'CCDP';
+const FORMAT = 1;
+const HEADER_LEN = 80;
+
+const OP_COPY = 0;
+const OP_ADD = 1;
+const OP_INSERT = 2;
+const OP_SEEK = 3;
+
+const DEFAULTS = {
+    windowBits: 11,   // 2 KB decoder window on the collar
+    lookaheadBits: 6  // Matches up to 64 bytes
+};
+
+const MATCH_BYTES = 8;        // Shortest exact match the diff search looks for
+const MATCH_CHAIN = 64;       // Candidates tried per position
+const MATCH_HASH_BITS = 20;
+const COPY_MIN_ZEROS = 8;     // Shorter runs of unchanged bytes stay inside an ADD
+const LZ_CHAIN = 128;
+const LZ_HASH_BITS = 16;
+
+function sha256(buf) {
+    return crypto.createHash('sha256').update(buf).digest();
+}
+
+// Diff ////////////////////////////////////////////////////////////////////////
+
+function hashAt(buf, pos, bits) {
+    let h = 0;
+    for (let i = 0; i < MATCH_BYTES; i++) {
+        h = Math.imul(h ^ buf[pos + i], 0x9e3779b1);
+    }
+    return h >>> (32 - bits);
+}
+
+// Exact-match index over every position of the old image
+function buildIndex(old) {
+    const head = new Int32Array(1 << MATCH_HASH_BITS).fill(-1);
+    const prev = new Int32Array(Math.max(old.length, 1));
+    for (let pos = 0; pos + MATCH_BYTES <= old.length; pos++) {
+        const h = hashAt(old, pos, MATCH_HASH_BITS);
+        prev[pos] = head[h];
+        head[h] = pos;
+    }
+    return { head, prev };
+}
+
+// Longest exact match of next[scan..] in old, as { pos, len }; len is 0 below MATCH_BYTES
+function search(index, old, next, scan) {
+    const best = { pos: 0, len: 0 };
+    if (scan + MATCH_BYTES > next.length) {
+        return best;
+    }
+    let cand = index.head[hashAt(next, scan, MATCH_HASH_BITS)];
+    for (let tries = 0; cand >= 0 && tries < MATCH_CHAIN; tries++, cand = index.prev[cand]) {
+        let len = 0;
+        while (cand + len < old.length && scan + len < next.length && old[cand + len] === next[scan + len]) {
+            len++;
+        }
+        if (len > best.len) {
+            best.pos = cand;
+            best.len = len;
+        }
+    }
+    if (best.len < MATCH_BYTES) {
+        best.len = 0;
+    }
+    return best;
+}
+
+// bsdiff's main loop; calls emit(lastscan, lastpos, lenf, extraLen, seek) per record
+function bsdiff(old, next, emit) {
+    const index = buildIndex(old);
+    let scan = 0, len = 0, pos = 0;
+    let lastscan = 0, lastpos = 0, lastoffset = 0;
+
+    while (scan < next.length) {
+        let oldscore = 0;
+        let scsc = scan += len;
+        for (; scan < next.length; scan++) {
+            ({ pos, len } = search(index, old, next, scan));
+            for (; scsc < scan + len; scsc++) {
+                if (scsc + lastoffset < old.length && old[scsc + lastoffset] === next[scsc]) {
+                    oldscore++;
+                }
+            }
+            if ((len === oldscore && len !== 0) || len > oldscore + 8) {
+                break;
+            }
+            if (scan + lastoffset < old.length && old[scan + lastoffset] === next[scan]) {
+                oldscore--;
+            }
+        }
+
+        if (len !== oldscore || scan === next.length) {
+            // Extend the previous alignment forward and the new one backward while they mostly match
+            let s = 0, sf = 0, lenf = 0;
+            for (let i = 0; lastscan + i < scan && lastpos + i < old.length;) {
+                if (old[lastpos + i] === next[lastscan + i]) {
+                    s++;
+                }
+                i++;
+                if (s * 2 - i > sf * 2 - lenf) {
+                    sf = s;
+                    lenf = i;
+                }
+            }
+
+            let lenb = 0;
+            if (scan < next.length) {
+                let sb = 0;
+                s = 0;
+                for (let i = 1; scan >= lastscan + i && pos >= i; i++) {
+                    if (old[pos - i] === next[scan - i]) {
+                        s++;
+                    }
+                    if (s * 2 - i > sb * 2 - lenb) {
+                        sb = s;
+                        lenb = i;
+                    }
+                }
+            }
+
+            if (lastscan + lenf > scan - lenb) {
+                const overlap = (lastscan + lenf) - (scan - lenb);
+                let ss = 0, lens = 0;
+                s = 0;
+                for (let i = 0; i < overlap; i++) {
+                    if (next[lastscan + lenf - overlap + i] === old[lastpos + lenf - overlap + i]) {
+                        s++;
+                    }
+                    if (next[scan - lenb + i] === old[pos - lenb + i]) {
+                        s--;
+                    }
+                    if (s > ss) {
+                        ss = s;
+                        lens = i + 1;
+                    }
+                }
+                lenf += lens - overlap;
+                lenb -= lens;
+            }
+
+            emit(lastscan, lastpos, lenf, (scan - lenb) - (lastscan + lenf), (pos - lenb) - (lastpos + lenf));
+            lastscan = scan - lenb;
+            lastpos = pos - lenb;
+            lastoffset = pos - scan;
+        }
+    }
+}
+
+// Op stream ///////////////////////////////////////////////////////////////////
+
+class OpWriter {
+    constructor() {
+        this.chunks = [];
+        this.bytes = [];
+        this.counts = { copy: 0, add: 0, insert: 0, seek: 0 };
+    }
+
+    varint(value) {
+        while (value >= 0x80) {
+            this.bytes.push((value % 0x80) | 0x80);
+            value = Math.floor(value / 0x80);
+        }
+        this.bytes.push(value);
+    }
+
+    op(code, n) {
+        this.varint(n * 4 + code);
+    }
+
+    payload(buf) {
+        this.flushBytes();
+        this.chunks.push(buf);
+    }
+
+    flushBytes() {
+        if (this.bytes.length > 0) {
+            this.chunks.push(Buffer.from(this.bytes));
+            this.bytes = [];
+        }
+    }
+
+    toBuffer() {
+        this.flushBytes();
+        return Buffer.concat(this.chunks);
+    }
+}
+
+function encodeOps(old, next) {
+    const out = new OpWriter();
+
+    bsdiff(old, next, (newPos, oldPos, diffLen, extraLen, seek) => {
+        // Aligned part: unchanged runs become COPY, everything else ADD
+        let i = 0;
+        while (i < diffLen) {
+            let zeros = 0;
+            while (i + zeros < diffLen && old[oldPos + i + zeros] === next[newPos + i + zeros]) {
+                zeros++;
+            }
+            if (zeros >= COPY_MIN_ZEROS || i + zeros === diffLen) {
+                if (zeros > 0) {
+                    out.op(OP_COPY, zeros);
+                    out.counts.copy += zeros;
+                }
+                i += zeros;
+                continue;
+            }
+
+            // ADD until the next run of unchanged bytes long enough to COPY
+            let end = i + zeros;
+            let run = 0;
+            while (end < diffLen && run < COPY_MIN_ZEROS) {
+                run = (old[oldPos + end] === next[newPos + end]) ? run + 1 : 0;
+                end++;
+            }
+            if (run >= COPY_MIN_ZEROS) {
+                end -= run;
+            }
+            const diff = Buffer.alloc(end - i);
+            for (let k = 0; k < diff.length; k++) {
+                diff[k] = (next[newPos + i + k] - old[oldPos + i + k]) & 0xff;
+            }
+            out.op(OP_ADD, diff.length);
+            out.payload(diff);
+            out.counts.add += diff.length;
+            i = end;
+        }
+
+        if (extraLen > 0) {
+            const start = newPos + diffLen;
+            out.op(OP_INSERT, extraLen);
+            out.payload(next.subarray(start, start + extraLen));
+            out.counts.insert += extraLen;
+        }
+        if (seek !== 0 && newPos + diffLen + extraLen < next.length) {
+            out.op(OP_SEEK, seek >= 0 ? seek * 2 : -seek * 2 - 1);
+            out.counts.seek++;
+        }
+    });
+
+    return { ops: out.toBuffer(), counts: out.counts };
+}
+
+// LZSS (heatshrink bit format) ////////////////////////////////////////////////
+
+class BitWriter {
+    constructor(capacity) {
+        this.buf = Buffer.alloc(capacity);
+        this.len = 0;
+        this.acc = 0;
+        this.bits = 0;
+    }
+
+    write(value, count) {
+        for (let i = count - 1; i >= 0; i--) {
+            this.acc = (this.acc << 1) | ((value >>> i) & 1);
+            if (++this.bits === 8) {
+                this.push(this.acc);
+                this.acc = 0;
+                this.bits = 0;
+            }
+        }
+    }
+
+    push(byte) {
+        if (this.len === this.buf.length) {
+            const grown = Buffer.alloc(this.buf.length * 2);
+            this.buf.copy(grown);
+            this.buf = grown;
+        }
+        this.buf[this.len++] = byte;
+    }
+
+    finish() {
+        if (this.bits > 0) {
+            this.push(this.acc << (8 - this.bits)); // Zero padding never decodes as a symbol
+        }
+        return this.buf.subarray(0, this.len);
+    }
+}
+
+function lzssCompress(data, windowBits, lookaheadBits) {
+    const maxDist = 1 << windowBits;
+    const maxLen = 1 << lookaheadBits;
+    // A back-reference has to beat the literals it replaces
+    const minLen = Math.floor((1 + windowBits + lookaheadBits) / 9) + 1;
+    const head = new Int32Array(1 << LZ_HASH_BITS).fill(-1);
+    const prev = new Int32Array(Math.max(data.length, 1));
+    const hash = (pos) => (Math.imul((data[pos] << 16) | (data[pos + 1] << 8) | data[pos + 2], 0x9e3779b1) >>> (32 - LZ_HASH_BITS));
+
+    const insert = (pos) => {
+        if (pos + 3 <= data.length) {
+            const h = hash(pos);
+            prev[pos] = head[h];
+            head[h] = pos;
+        }
+    };
+
+    const longest = (pos) => {
+        const best = { dist: 0, len: 0 };
+        if (pos + 3 > data.length) {
+            return best;
+        }
+        const limit = Math.min(maxLen, data.length - pos);
+        let cand = head[hash(pos)];
+        for (let tries = 0; cand >= 0 && pos - cand <= maxDist && tries < LZ_CHAIN; tries++, cand = prev[cand]) {
+            let len = 0;
+            while (len < limit && data[cand + len] === data[pos + len]) {
+                len++;
+            }
+            if (len > best.len) {
+                best.dist = pos - cand;
+                best.len = len;
+                if (len === limit) {
+                    break;
+                }
+            }
+        }
+        return best;
+    };
+
+    const out = new BitWriter(Math.max(64, data.length >> 1));
+    let pos = 0;
+    while (pos < data.length) {
+        const match = longest(pos);
+        if (match.len >= minLen) {
+            // One-step lazy match: a longer match at the next byte is worth a literal
+            insert(pos);
+            const next = longest(pos + 1);
+            if (next.len > match.len + 1) {
+                out.write(1, 1);
+                out.write(data[pos], 8);
+                pos++;
+                continue;
+            }
+            out.write(0, 1);
+            out.write(match.dist - 1, windowBits);
+            out.write(match.len - 1, lookaheadBits);
+            for (let i = 1; i < match.len; i++) {
+                insert(pos + i);
+            }
+            pos += match.len;
+        } else {
+            out.write(1, 1);
+            out.write(data[pos], 8);
+            insert(pos);
+            pos++;
+        }
+    }
+    return out.finish();
+}
+
+function lzssDecompress(data, windowBits, lookaheadBits) {
+    let out = Buffer.alloc(Math.max(64, data.length * 2));
+    let len = 0;
+    const reserve = (count) => {
+        if (len + count > out.length) {
+            const grown = Buffer.alloc(Math.max(out.length * 2, len + count));
+            out.copy(grown, 0, 0, len);
+            out = grown;
+        }
+    };
+    let bitPos = 0;
+    const totalBits = data.length * 8;
+    const read = (count) => {
+        let value = 0;
+        for (let i = 0; i < count; i++, bitPos++) {
+            value = (value << 1) | ((data[bitPos >> 3] >> (7 - (bitPos & 7))) & 1);
+        }
+        return value;
+    };
+
+    while (bitPos < totalBits) {
+        if (read(1)) {
+            if (bitPos + 8 > totalBits) {
+                break;
+            }
+            reserve(1);
+            out[len++] = read(8);
+        } else {
+            if (bitPos + windowBits + lookaheadBits > totalBits) {
+                break;
+            }
+            const dist = read(windowBits) + 1;
+            const count = read(lookaheadBits) + 1;
+            if (dist > len) {
+                throw new Error('Corrupt LZSS stream');
+            }
+            reserve(count);
+            for (let i = 0; i < count; i++, len++) {
+                out[len] = out[len - dist];
+            }
+        }
+    }
+    return out.subarray(0, len);
+}
+
+// Patch ///////////////////////////////////////////////////////////////////////
+
+function buildHeader(old, next, windowBits, lookaheadBits) {
+    const header = Buffer.alloc(HEADER_LEN);
+    header.write(MAGIC, 0, 'latin1');
+    header[4] = FORMAT;
+    header[5] = windowBits;
+    header[6] = lookaheadBits;
+    header.writeUInt32LE(old.length, 8);
+    header.writeUInt32LE(next.length, 12);
+    sha256(old).copy(header, 16);
+    sha256(next).copy(header, 48);
+    return header;
+}
+
+function parseHeader(patch) {
+    if (patch.length < HEADER_LEN || patch.toString('latin1', 0, 4) !== MAGIC || patch[4] !== FORMAT) {
+        throw new Error('Not a firmware patch');
+    }
+    return {
+        windowBits: patch[5],
+        lookaheadBits: patch[6],
+        oldSize: patch.readUInt32LE(8),
+        newSize: patch.readUInt32LE(12),
+        oldSha256: patch.subarray(16, 48).toString('hex'),
+        newSha256: patch.subarray(48, 80).toString('hex')
+    };
+}
+
+// Patch turning old into next; pass an empty old for a compressed full image
+function encodePatch(old, next, options = {}) {
+    const { windowBits, lookaheadBits } = { ...DEFAULTS, ...options };
+    let ops, counts;
+    if (old.length > 0) {
+        ({ ops, counts } = encodeOps(old, next));
+    } else {
+        const out = new OpWriter();
+        out.op(OP_INSERT, next.length);
+        out.payload(next);
+        ops = out.toBuffer();
+        counts = { copy: 0, add: 0, insert: next.length, seek: 0 };
+    }
+    const body = lzssCompress(ops, windowBits, lookaheadBits);
+    return {
+        patch: Buffer.concat([buildHeader(old, next, windowBits, lookaheadBits), body]),
+        opsLength: ops.length,
+        counts
+    };
+}
+
+function readVarint(ops, state) {
+    let value = 0;
+    let scale = 1;
+    while (true) {
+        if (state.pos >= ops.length) {
+            throw new Error('Truncated op stream');
+        }
+        const byte = ops[state.pos++];
+        value += (byte & 0x7f) * scale;
+        if (!(byte & 0x80)) {
+            return value;
+        }
+        scale *= 0x80;
+    }
+}
+
+// Reference decoder; throws unless the result matches the header's checksums
+function applyPatch(old, patch) {
+    const header = parseHeader(patch);
+    if (header.oldSize > 0 && (old.length < header.oldSize || sha256(old.subarray(0, header.oldSize)).toString('hex') !== header.oldSha256)) {
+        throw new Error('Patch does not apply to this image');
+    }
+    const ops = lzssDecompress(patch.subarray(HEADER_LEN), header.windowBits, header.lookaheadBits);
+    const out = Buffer.alloc(header.newSize);
+    const state = { pos: 0 };
+    let newPos = 0, oldPos = 0;
+    while (newPos < header.newSize) {
+        const value = readVarint(ops, state);
+        const code = value % 4;
+        const n = Math.floor(value / 4);
+        if (code === OP_SEEK) {
+            oldPos += (n % 2) ? -(n + 1) / 2 : n / 2;
+            continue;
+        }
+        if (newPos + n > header.newSize || (code !== OP_INSERT && oldPos + n > header.oldSize)) {
+            throw new Error('Op runs past the image');
+        }
+        for (let i = 0; i < n; i++) {
+            if (code === OP_COPY) {
+                out[newPos++] = old[oldPos++];
+            } else if (code === OP_ADD) {
+                out[newPos++] = (old[oldPos++] + ops[state.pos++]) & 0xff;
+            } else {
+                out[newPos++] = ops[state.pos++];
+            }
+        }
+    }
+    if (sha256(out).toString('hex') !== header.newSha256) {
+        throw new Error('Patched image does not match its checksum');
+    }
+    return out;
+}
+
+module.exports = {
+    DEFAULTS,
+    HEADER_LEN,
+    encodePatch,
+    applyPatch,
+    parseHeader,
+    sha256
+};
@@ -0,0 +1,193 @@
+// ota_rollout.js
+//
+// Server side of the delta firmware updates in main/ota.c.
+//
+// firmware/<version>.bin holds every image a collar may be running. The patch
+// from the version a collar reports in its HELLO to the target is built once
+// (lib/ota_delta.js), decoded again to prove it reproduces the target, cached in
+// firmware/patches/ and served over HTTP. A collar on a version with no image
+// here gets the target as a compressed full image instead.
+//
+// A rollout updates collars in waves: the first wave is a canary, and each wave
+// must finish (collar rebooted, reconnected and reporting the new version)
+// before the next starts. Within a wave up to `parallel` collars download at
+// once. The rollout halts once more than `maxFailures` collars have failed.
+
+const fs = require('fs');
+const path = require('path');
+const { encodePatch, applyPatch, parseHeader } = require('./ota_delta');
+
+const VERSION_RE = /^[\w.+-]{1,31}$/; // Must fit OTA_VERSION_LEN and a file name
+
+const ACK_TIMEOUT_MS = 5000;
+const DOWNLOAD_TIMEOUT_MS = 180000;
+const REBOOT_TIMEOUT_MS = 90000; // Covers the collar's 60 s confirm window
+
+class FirmwareStore {
+    constructor(dir) {
+        this.dir = dir;
+        this.patchDir = path.join(dir, 'patches');
+    }
+
+    imagePath(version) {
+        if (!VERSION_RE.test(version)) {
+            throw new Error(`Bad firmware version "${version}"`);
+        }
+        return path.join(this.dir, `${version}.bin`);
+    }
+
+    has(version) {
+        return VERSION_RE.test(version) && fs.existsSync(this.imagePath(version));
+    }
+
+    // Patch taking `from` to `to`: { file, size, imageSize, delta }
+    patchFor(from, to) {
+        const next = fs.readFileSync(this.imagePath(to));
+        const delta = Boolean(from) && from !== to && this.has(from);
+        const file = delta ? `${from}_to_${to}.ccdp` : `full_${to}.ccdp`;
+        const filePath = path.join(this.patchDir, file);
+
+        if (!fs.existsSync(filePath)) {
+            const old = delta ? fs.readFileSync(this.imagePath(from)) : Buffer.alloc(0);
+            const { patch } = encodePatch(old, next);
+            applyPatch(old, patch); // Throws rather than ship a patch that does not reproduce the image
+            fs.mkdirSync(this.patchDir, { recursive: true });
+            fs.writeFileSync(`${filePath}.tmp`, patch);
+            fs.renameSync(`${filePath}.tmp`, filePath);
+        }
+
+        const size = fs.statSync(filePath).size;
+        const header = parseHeader(fs.readFileSync(filePath).subarray(0, 80));
+        return { file, size, imageSize: header.newSize, delta };
+    }
+}
+
+// Split targets into waves; the last size repeats until every collar has a wave
+function planWaves(targets, sizes) {
+    const waves = [];
+    let i = 0;
+    for (let w = 0; i < targets.length; w++) {
+        const size = Math.max(1, sizes[Math.min(w, sizes.length - 1)]);
+        waves.push(targets.slice(i, i + size));
+        i += size;
+    }
+    return waves;
+}
+
+// Run fn over items with at most `limit` in flight
+async function mapLimit(items, limit, fn) {
+    const results = new Array(items.length);
+    let next = 0;
+    const worker = async () => {
+        while (next < items.length) {
+            const index = next++;
+            results[index] = await fn(items[index]);
+        }
+    };
+    await Promise.all(Array.from({ length: Math.min(limit, items.length) }, worker));
+    return results;
+}
+
+// Update one collar; hooks are supplied by the server (see host_data.js)
+async function updateCollar(catId, version, store, hooks) {
+    const current = hooks.collarVersion(catId);
+    if (current === null) {
+        return { catId, ok: false, result: 'not connected' };
+    }
+    if (current === version) {
+        return { catId, ok: true, result: 'current', from: current };
+    }
+
+    let patch;
+    try {
+        patch = store.patchFor(current, version);
+    } catch (err) {
+        return { catId, ok: false, result: `patch failed: ${err.message}`, from: current };
+    }
+    const base = { catId, from: current, delta: patch.delta, bytes: patch.size, imageBytes: patch.imageSize };
+
+    // Listen before sending so a fast reply cannot be missed
+    const ack = hooks.waitFor(catId, text => text.startsWith(`OTA ACK ${version}`) || text.startsWith(`OTA NAK ${version}`), ACK_TIMEOUT_MS);
+    const done = hooks.waitFor(catId, text => text.startsWith(`OTA DONE ${version}`) || text.startsWith(`OTA NAK ${version}`), DOWNLOAD_TIMEOUT_MS);
+    if (!hooks.send(catId, `OTA BEGIN ${version} ${patch.size} ${hooks.patchUrl(catId, patch.file)}`)) {
+        return { ...base, ok: false, result: 'not connected' };
+    }
+
+    const ackReply = await ack;
+    if (ackReply === null || ackReply.startsWith('OTA NAK')) {
+        return { ...base, ok: false, result: ackReply || 'no ack' };
+    }
+    const doneReply = await done;
+    if (doneReply === null || doneReply.startsWith('OTA NAK')) {
+        return { ...base, ok: false, result: doneReply || 'download timeout' };
+    }
+    const ms = /ms=(\d+)/.exec(doneReply);
+
+    // Only the new image reconnecting (and so confirming itself) counts as success
+    const hello = await hooks.waitFor(catId, text => text.startsWith('HELLO '), REBOOT_TIMEOUT_MS);
+    const running = hello ? (/fw=(\S+)/.exec(hello) || [])[1] : null;
+    return {
+        ...base,
+        ok: running === version,
+        result: running === version ? 'updated' : (hello ? `rolled back to ${running}` : 'did not reconnect'),
+        radioMs: ms ? Number(ms[1]) : null
+    };
+}
+
+// Options: { version, cats: [...], waves: [1, 4, 16], parallel, maxFailures }
+// onProgress(state) is called after every collar and wave
+async function runRollout(options, store, hooks, onProgress = () => {}) {
+    const { version, cats, waves = [1, 4, 16], parallel = Infinity, maxFailures = 0 } = options;
+    if (!store.has(version)) {
+        throw new Error(`No image firmware/${version}.bin`);
+    }
+
+    const plan = planWaves(cats, waves);
+    const state = { version, waves: plan, wave: 0, results: [], halted: false, finished: false };
+    let failures = 0;
+
+    for (let w = 0; w < plan.length; w++) {
+        state.wave = w + 1;
+        onProgress(state);
+        await mapLimit(plan[w], parallel, async catId => {
+            const result = await updateCollar(catId, version, store, hooks);
+            result.wave = w + 1;
+            state.results.push(result);
+            if (!result.ok) {
+                failures++;
+            }
+            onProgress(state);
+        });
+        if (failures > maxFailures) {
+            state.halted = true;
+            for (const catId of plan.slice(w + 1).flat()) {
+                state.results.push({ catId, ok: false, result: 'skipped (rollout halted)', wave: null });
+            }
+            break;
+        }
+    }
+
+    state.finished = true;
+    state.summary = summarise(state.results);
+    onProgress(state);
+    return state;
+}
+
+function summarise(results) {
+    const sent = results.filter(r => r.bytes !== undefined && r.result !== 'current');
+    const sum = (list, key) => list.reduce((total, r) => total + (r[key] || 0), 0);
+    return {
+        updated: results.filter(r => r.result === 'updated').length,
+        current: results.filter(r => r.result === 'current').length,
+        failed: results.filter(r => !r.ok).length,
+        patchBytes: sum(sent, 'bytes'),
+        imageBytes: sum(sent, 'imageBytes'),
+        radioMs: sum(sent, 'radioMs')
+    };
+}
+
+module.exports = {
+    FirmwareStore,
+    planWaves,
+    runRollout
+};
@@ -0,0 +1,91 @@
+// relay_frames.js
+//
+// Host side of the ESP-NOW relay's UPLINK datagrams (main/relay_frame.h): what a
+// gateway collar sends to relay_port on behalf of the leaves attached to it.
+//
+//   header   magic 0xC7, type 3, seq (u16), gateway cat_id (8), epoch_ms (u64, 0 = unsynced), sections (u8)
+//   section  cat_id (8), udp_port (u16), batch seq (u16), count (u8), count x record
+//   record   state (u8), flags (u8), temp (i16, centi-°F), duration_s (u32), age_ms (u32)
+//
+// Integers are little-endian and cat IDs zero padded. A record's age counts back from
+// the moment the gateway sent the datagram.
+
+const { STATE_NAMES } = require('./telemetry');
+
+const MAGIC = 0xC7;
+const TYPE_UPLINK = 3;
+const CAT_ID_LEN = 8;
+const HEADER = 4 + CAT_ID_LEN + 8 + 1;
+const SECTION_HEADER = CAT_ID_LEN + 5;
+const RECORD_SIZE = 12;
+const RECORD_TEMP = 0x01;
+
+function readId(buf, offset) {
+    const end = buf.indexOf(0, offset);
+    return buf.toString('latin1', offset, end < 0 || end > offset + CAT_ID_LEN ? offset + CAT_ID_LEN : end);
+}
+
+// { seq, gatewayId, epochMs (null while unsynced), sections: [{ catId, udpPort, seq, records }] }, or null
+function decodeUplink(buf) {
+    if (buf.length < HEADER || buf[0] !== MAGIC || buf[1] !== TYPE_UPLINK) {
+        return null;
+    }
+    const epochMs = Number(buf.readBigUInt64LE(4 + CAT_ID_LEN));
+    const uplink = {
+        seq: buf.readUInt16LE(2),
+        gatewayId: readId(buf, 4),
+        epochMs: epochMs === 0 ? null : epochMs,
+        sections: []
+    };
+    let offset = HEADER;
+    for (let s = buf[HEADER - 1]; s > 0; s--) {
+        if (offset + SECTION_HEADER > buf.length) {
+            return null;
+        }
+        const count = buf[offset + CAT_ID_LEN + 4];
+        const section = {
+            catId: readId(buf, offset),
+            udpPort: buf.readUInt16LE(offset + CAT_ID_LEN),
+            seq: buf.readUInt16LE(offset + CAT_ID_LEN + 2),
+            records: []
+        };
+        offset += SECTION_HEADER;
+        if (offset + count * RECORD_SIZE > buf.length) {
+            return null;
+        }
+        for (let r = 0; r < count; r++, offset += RECORD_SIZE) {
+            section.records.push({
+                state: buf[offset],
+                temperature: buf[offset + 1] & RECORD_TEMP ? buf.readInt16LE(offset + 2) / 100 : null,
+                durationS: buf.readUInt32LE(offset + 4),
+                ageMs: buf.readUInt32LE(offset + 8)
+            });
+        }
+        uplink.sections.push(section);
+    }
+    return offset === buf.length ? uplink : null;
+}
+
+function pad2(n) {
+    return n < 10 ? `0${n}` : `${n}`;
+}
+
+// The status message the leaf would have sent itself (see print_status() in CatCollar.c);
+// sourceMs is when the sample was taken, or null to leave the Time field out
+function formatStatus(record, sourceMs) {
+    const d = record.durationS;
+    let text = `${pad2(Math.floor(d / 3600) % 24)}:${pad2(Math.floor(d / 60) % 60)}:${pad2(d % 60)}`;
+    if (record.temperature !== null) {
+        text += `, Temperature: ${record.temperature.toFixed(2)}°F`;
+    }
+    text += `, Cat state: ${STATE_NAMES[record.state] || STATE_NAMES[0]}`;
+    if (sourceMs !== null) {
+        text += `, Time: ${sourceMs * 1000}`;
+    }
+    return text;
+}
+
+module.exports = {
+    decodeUplink,
+    formatStatus
+};
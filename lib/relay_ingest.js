@@ -0,0 +1,140 @@
+// relay_ingest.js
+//
+// Receives the UPLINK datagrams of gateway collars (lib/relay_frames.js) and feeds
+// the status of every leaf behind them into the same logs as the Wi-Fi path:
+//
+//   cat_status_log.txt  "Port <leaf udp_port> | ID <arrival ms> | Message: <status>"
+//   cat_data.csv        "<ISO time>, relay-<gateway>:<leaf udp_port>, <status>"
+//
+// A leaf's UDP port stands in for the sender port, as with serial_ingest.js, so a
+// collar keeps its cat ID whichever way it reports. Statuses carry their sample
+// time (Time:) when the gateway's clock is synced; the arrival time is stamped
+// back by the record's age either way.
+//
+// A leaf whose ack was lost can hand the same batch to a second gateway after a
+// handover, so the last few batch seqs of every leaf are remembered and repeats
+// are dropped.
+
+const dgram = require('dgram');
+const EventEmitter = require('events');
+const path = require('path');
+const { append } = require('./log_append');
+const { decodeUplink, formatStatus } = require('./relay_frames');
+
+const ROOT = path.join(__dirname, '..');
+const DEFAULT_PORT = 3340; // COLLAR_DEFAULT_RELAY_PORT
+const SEEN_BATCHES = 16;
+
+class RelayIngest extends EventEmitter {
+    constructor(options = {}) {
+        super();
+        this.port = options.port || DEFAULT_PORT;
+        this.statusLog = options.statusLog === undefined ? path.join(ROOT, 'cat_status_log.txt') : options.statusLog;
+        this.dataLog = options.dataLog === undefined ? path.join(ROOT, 'cat_data.csv') : options.dataLog;
+        this.socket = null;
+        this.gateways = new Map(); // gatewayId -> { address, nextSeq, uplinks, lost }
+        this.seen = new Map();     // leaf catId -> recent batch seqs
+        this.counts = { uplinks: 0, malformed: 0, records: 0, repeats: 0 };
+    }
+
+    open() {
+        this.socket = dgram.createSocket({ type: 'udp4', reuseAddr: true });
+        this.socket.on('message', (msg, rinfo) => this.handle(msg, rinfo, Date.now()));
+        this.socket.on('error', err => this.emit('error', err));
+        this.socket.bind(this.port, () => this.emit('listening', this.port));
+        return this;
+    }
+
+    close() {
+        if (this.socket) {
+            this.socket.close();
+            this.socket = null;
+        }
+    }
+
+    handle(msg, rinfo, nowMs) {
+        const uplink = decodeUplink(msg);
+        if (!uplink) {
+            this.counts.malformed++;
+            return;
+        }
+        this.counts.uplinks++;
+        this.trackGateway(uplink, rinfo);
+
+        // Ages count back from the gateway's send: its own clock if synced, else our arrival
+        const sentMs = uplink.epochMs !== null ? uplink.epochMs : nowMs;
+        uplink.sections.forEach((section) => {
+            if (this.isRepeat(section)) {
+                this.counts.repeats++;
+                return;
+            }
+            section.records.forEach((record) => {
+                const sampleMs = sentMs - record.ageMs;
+                const text = formatStatus(record, uplink.epochMs !== null ? sampleMs : null);
+                this.counts.records++;
+                this.logStatus(uplink.gatewayId, section.udpPort, new Date(nowMs - record.ageMs), text);
+                this.emit('status', { gatewayId: uplink.gatewayId, catId: section.catId, port: section.udpPort, text });
+            });
+        });
+    }
+
+    trackGateway(uplink, rinfo) {
+        let gateway = this.gateways.get(uplink.gatewayId);
+        if (!gateway) {
+            gateway = { address: rinfo.address, nextSeq: uplink.seq, uplinks: 0, lost: 0 };
+            this.gateways.set(uplink.gatewayId, gateway);
+            this.emit('gateway', { gatewayId: uplink.gatewayId, address: rinfo.address });
+        }
+        const gap = (uplink.seq - gateway.nextSeq) & 0xffff;
+        if (gap < 0x8000) {
+            gateway.lost += gap;
+        }
+        gateway.address = rinfo.address;
+        gateway.nextSeq = (uplink.seq + 1) & 0xffff;
+        gateway.uplinks++;
+    }
+
+    isRepeat(section) {
+        let seqs = this.seen.get(section.catId);
+        if (!seqs) {
+            seqs = [];
+            this.seen.set(section.catId, seqs);
+        }
+        if (seqs.includes(section.seq)) {
+            return true;
+        }
+        seqs.push(section.seq);
+        if (seqs.length > SEEN_BATCHES) {
+            seqs.shift();
+        }
+        return false;
+    }
+
+    logStatus(gatewayId, port, time, text) {
+        if (this.statusLog) {
+            append(this.statusLog, `Port ${port} | ID ${time.getTime()} | Message: ${text}\n`);
+        }
+        if (this.dataLog) {
+            append(this.dataLog, `${time.toISOString()}, relay-${gatewayId}:${port}, ${text}\n`);
+        }
+    }
+
+    stats() {
+        return {
+            port: this.port,
+            ...this.counts,
+            gateways: [...this.gateways.entries()].map(([gatewayId, g]) => ({
+                gatewayId,
+                address: g.address,
+                uplinks: g.uplinks,
+                lost: g.lost
+            })),
+            leaves: this.seen.size
+        };
+    }
+}
+
+module.exports = {
+    RelayIngest,
+    DEFAULT_PORT
+};
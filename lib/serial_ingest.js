@@ -0,0 +1,203 @@
+// serial_ingest.js
+//
+// Reads collars that stream over UART (uart_baud set in their config) and feeds
+// their status into the same logs as the Wi-Fi path, so host_data.js and
+// read_data.js show wired and wireless collars side by side:
+//
+//   cat_status_log.txt  "Port <udp_port> | ID <arrival ms> | Message: <status>"
+//   cat_data.csv        "<ISO time>, <tty>:<udp_port>, <status>"
+//
+// The collar's UDP port (from its HELLO frame) stands in for the sender port, so a
+// collar keeps its cat ID whichever way it reports. Status that arrives before the
+// first HELLO is held until it does.
+//
+// SAMPLES frames are written to captures/<cat>-<start>.csv (named after the tty if
+// no HELLO has arrived yet) in the simulator's trace format (t_ms,x_g,y_g,z_g), so a
+// bench recording replays with catcollar_sim --trace. Appends are batched per file
+// across all open ports.
+
+const EventEmitter = require('events');
+const fs = require('fs');
+const path = require('path');
+const { SerialPort } = require('serialport');
+const { append, flushAll } = require('./log_append');
+const frames = require('./uart_frames');
+
+const ROOT = path.join(__dirname, '..');
+const HELLO_PERIOD_MS = 5000;
+const MAX_HELD_LINES = 1000;
+
+// Raw ADXL343 counts (4 mg each) as g with three decimals, without going through floats
+function countsToG(counts) {
+    const mg = Math.abs(counts) * 4;
+    const frac = mg % 1000;
+    return `${counts < 0 ? '-' : ''}${(mg - frac) / 1000}.${frac < 10 ? '00' : frac < 100 ? '0' : ''}${frac}`;
+}
+
+class SerialIngest extends EventEmitter {
+    // options: { baudRate, statusLog, dataLog, captureDir } (paths default to the repo root;
+    // pass null to skip one)
+    constructor(portPath, options = {}) {
+        super();
+        this.path = portPath;
+        this.name = path.basename(portPath).replace(/:/g, '_');
+        this.baudRate = options.baudRate || 921600;
+        this.statusLog = options.statusLog !== undefined ? options.statusLog : path.join(ROOT, 'cat_status_log.txt');
+        this.dataLog = options.dataLog !== undefined ? options.dataLog : path.join(ROOT, 'cat_data.csv');
+        this.captureDir = options.captureDir !== undefined ? options.captureDir : path.join(ROOT, 'captures');
+
+        this.decoder = frames.createFrameDecoder();
+        this.hello = null;
+        this.held = [];
+        this.collarStats = null;
+        this.counts = { status: 0, samples: 0, log: 0, text: 0 };
+        this.capture = null;
+        this.txSeq = 0;
+        this.port = null;
+        this.helloTimer = null;
+    }
+
+    open() {
+        this.port = new SerialPort({ path: this.path, baudRate: this.baudRate }, (err) => {
+            if (err) {
+                this.emit('error', err);
+                return;
+            }
+            this.emit('open');
+            this.greet();
+            this.helloTimer = setInterval(() => this.greet(), HELLO_PERIOD_MS);
+        });
+        this.port.on('data', (data) => this.onData(data));
+        this.port.on('error', (err) => this.emit('error', err));
+        this.port.on('close', () => this.emit('close'));
+        return this;
+    }
+
+    close(callback) {
+        clearInterval(this.helloTimer);
+        flushAll();
+        if (this.port && this.port.isOpen) {
+            this.port.close(callback);
+        } else if (callback) {
+            callback();
+        }
+    }
+
+    // Send a TEXT frame ("CFG GET", "CFG SET rev=<n> key=value ...")
+    send(text) {
+        if (this.port && this.port.isOpen) {
+            this.port.write(frames.encodeFrame(frames.TYPES.TEXT, this.txSeq++, Buffer.from(text)));
+        }
+    }
+
+    // Any valid frame confirms a pending config on the collar, like a WebSocket connect
+    greet() {
+        this.send('HELLO host');
+    }
+
+    onData(data) {
+        const batch = this.decoder.push(data);
+        for (let i = 0; i < batch.count; i++) {
+            const payload = batch.data.subarray(batch.offset[i], batch.offset[i] + batch.length[i]);
+            this.onFrame(batch.type[i], payload);
+        }
+    }
+
+    onFrame(type, payload) {
+        switch (type) {
+            case frames.TYPES.HELLO: {
+                const hello = frames.parseHello(payload);
+                if (hello) {
+                    const first = !this.hello;
+                    this.hello = hello;
+                    if (first) {
+                        this.held.forEach(({ time, text }) => this.logStatus(time, text));
+                        this.held = [];
+                        this.emit('hello', hello);
+                    }
+                }
+                break;
+            }
+            case frames.TYPES.STATUS: {
+                const text = payload.toString();
+                this.counts.status++;
+                if (this.hello) {
+                    this.logStatus(new Date(), text);
+                } else if (this.held.length < MAX_HELD_LINES) {
+                    this.held.push({ time: new Date(), text });
+                }
+                this.emit('status', text);
+                break;
+            }
+            case frames.TYPES.SAMPLES: {
+                const samples = frames.parseSamples(payload);
+                if (samples) {
+                    this.counts.samples += samples.x.length;
+                    this.writeSamples(samples);
+                    this.emit('samples', samples);
+                }
+                break;
+            }
+            case frames.TYPES.LOG:
+                this.counts.log++;
+                this.emit('log', payload.toString());
+                break;
+            case frames.TYPES.STATS:
+                this.collarStats = frames.parseStats(payload);
+                this.emit('stats', this.collarStats);
+                break;
+            case frames.TYPES.TEXT:
+                this.counts.text++;
+                this.emit('text', payload.toString());
+                break;
+            default:
+                break;
+        }
+    }
+
+    logStatus(time, text) {
+        const port = this.hello.port;
+        if (this.statusLog) {
+            append(this.statusLog, `Port ${port} | ID ${time.getTime()} | Message: ${text}\n`);
+        }
+        if (this.dataLog) {
+            append(this.dataLog, `${time.toISOString()}, ${this.name}:${port}, ${text}\n`);
+        }
+    }
+
+    writeSamples({ t0Us, periodUs, x, y, z }) {
+        if (!this.captureDir) {
+            return;
+        }
+        if (!this.capture) {
+            fs.mkdirSync(this.captureDir, { recursive: true });
+            const cat = this.hello ? this.hello.catId : this.name;
+            const stamp = new Date().toISOString().replace(/[:.]/g, '-');
+            this.capture = { file: path.join(this.captureDir, `${cat}-${stamp}.csv`), originUs: t0Us };
+            append(this.capture.file, `# ADXL343 capture of cat ${cat} from ${this.path}: t_ms,x_g,y_g,z_g\n`);
+        }
+        let text = '';
+        for (let i = 0; i < x.length; i++) {
+            const tMs = Math.round((t0Us - this.capture.originUs + i * periodUs) / 1000);
+            text += `${tMs},${countsToG(x[i])},${countsToG(y[i])},${countsToG(z[i])}\n`;
+        }
+        append(this.capture.file, text);
+    }
+
+    stats() {
+        return {
+            path: this.path,
+            catId: this.hello ? this.hello.catId : null,
+            udpPort: this.hello ? this.hello.port : null,
+            fw: this.hello ? this.hello.fw : null,
+            ...this.decoder.stats(),
+            ...this.counts,
+            collar: this.collarStats
+        };
+    }
+}
+
+module.exports = {
+    SerialIngest,
+    flushAll
+};
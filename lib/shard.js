@@ -0,0 +1,358 @@
+// shard.js
+//
+// One ingest shard, run in its own process by ShardCoordinator (lib/shard_coordinator.js).
+// Every shard binds the same collar UDP ports, so the kernel hands each datagram to
+// whichever shard is free to read it. A shard then looks up the collar's owner on the
+// hash ring (lib/shard_ring.js) and, if the owner is another shard, passes the
+// datagram on over a TCP link to it. The owner logs it the way lib/udp_ingest.js does:
+//
+//   cat_status_log.txt  "Port <port> | ID <arrival ms> | Message: <status>"
+//   cat_data.csv        "<ISO time>, <collar address>:<port>, <status>"
+//
+// It also ranks the collar on its own Leaderboard. A collar's ID is its
+// "<address>:<port>" source, the key read_data.js charts it under.
+// Each collar has one owner, so the coordinator gets any top K, for all cats or a
+// group, by merging each shard's top K.
+//
+// Passing datagrams on costs more than taking them in, so an owner pins each collar
+// it hears from. It opens a UDP socket on the same port, connected to the collar's
+// address and port, and Linux delivers a datagram to the socket that matches it most
+// closely. From then on the collar reaches its owner directly. Pins are dropped when
+// the collar moves to another shard or has been silent for PIN_IDLE_MS. A collar that
+// reboots sends from a new port and is pinned again.
+//
+// Forwarded datagrams get one header line,
+// "FWD <hops> <port> <arrival ms> <collar address> <collar port>\n", ahead of the
+// collar's bytes, and a u32 LE length in front of that. The arrival stamp is kept
+// from the first shard. Links are TCP, not UDP, because a busy owner must slow its
+// peers down rather than lose what they pass on. Frames go out in one write per link
+// per turn of the event loop.
+//
+// Rings change when a shard joins or leaves, each change numbered by an epoch. When
+// one joins, every other shard hands its collars that now belong to the new one over
+// as a snapshot of their records (Leaderboard.extract), after writing out what it
+// has logged for them. Until every snapshot is in, the new shard holds its own
+// collars' records. It then rebuilds its board from the snapshots and applies what
+// it held. A shard that leaves takes its collars' boards with it. They start
+// again on their new owners, and the logs keep everything either way.
+
+const dgram = require('dgram');
+const net = require('net');
+const { STATE_NAMES, parseMessage } = require('./telemetry');
+const { Leaderboard, mergeSnapshots } = require('./leaderboard');
+const { HashRing } = require('./shard_ring');
+const { append, flushAll } = require('./log_append');
+
+const MAX_HOPS = 2; // While rings change, a datagram may be passed on once more
+const FORWARD_HOST = '127.0.0.1';
+const MAX_PINS = Number(process.env.SHARD_MAX_PINS) || 16384; // A file descriptor each
+const PIN_IDLE_MS = 10 * 60000;
+
+class IngestShard {
+    // options: { id, ports, statusLog, dataLog, weights, groups } (null logs are skipped);
+    // send(message) reaches the coordinator
+    constructor(options, send) {
+        this.id = options.id;
+        this.ports = options.ports;
+        this.statusLog = options.statusLog;
+        this.dataLog = options.dataLog;
+        this.boardOptions = { weights: options.weights, groups: options.groups };
+        this.board = new Leaderboard(this.boardOptions);
+        this.send = send;
+        this.sockets = [];
+        this.server = null;
+        this.links = new Map(); // shard ID -> { socket, frames, scheduled }
+        this.pins = new Map(); // collar ID -> { socket, remotePort, lastMs }
+        this.sweeper = null;
+        this.ring = null;
+        this.epoch = 0;
+        this.peers = new Map(); // shard ID -> forward port
+        this.joining = null; // { epoch, waiting: shard IDs, snapshots, held: [args of ingest] }
+        this.counts = {
+            datagrams: 0, direct: 0, records: 0, empty: 0, forwarded: 0, received: 0, held: 0, handedOver: 0, takenOver: 0
+        };
+    }
+
+    // Opens the forward port; the collar ports open with the first ring
+    open() {
+        this.server = net.createServer(socket => this.accept(socket));
+        // Exclusive: in a cluster worker, port 0 would otherwise be one port shared by all
+        this.server.listen({ port: 0, host: FORWARD_HOST, exclusive: true }, () => {
+            this.send({ type: 'ready', forwardPort: this.server.address().port });
+        });
+        return this;
+    }
+
+    listen() {
+        this.sockets = this.ports.map((port) => {
+            const socket = dgram.createSocket({ type: 'udp4', reuseAddr: true });
+            socket.on('message', (msg, rinfo) => {
+                this.counts.datagrams++;
+                this.receive(port, rinfo.address, rinfo.port, Date.now(), msg, 0);
+            });
+            socket.on('error', err => this.send({ type: 'error', message: `UDP ${port}: ${err.message}` }));
+            socket.bind(port);
+            return socket;
+        });
+        this.sweeper = setInterval(() => this.sweepPins(Date.now()), PIN_IDLE_MS / 10);
+        this.sweeper.unref();
+    }
+
+    receive(port, address, remotePort, nowMs, msg, hops) {
+        const source = `${address}:${port}`;
+        const owner = this.ring.owner(source);
+        if (owner !== this.id && hops < MAX_HOPS && this.peers.has(owner)) {
+            this.counts.forwarded++;
+            this.forwardTo(owner, Buffer.from(`FWD ${hops + 1} ${port} ${nowMs} ${address} ${remotePort}\n`), msg);
+            return;
+        }
+        const pin = this.pins.get(source);
+        if (pin && pin.remotePort === remotePort) {
+            pin.lastMs = nowMs;
+        } else if (owner === this.id) {
+            this.pin(port, address, remotePort, source, nowMs);
+        }
+        if (this.joining) {
+            this.counts.held++;
+            this.joining.held.push([port, source, nowMs, msg]);
+            return;
+        }
+        this.ingest(port, source, nowMs, msg);
+    }
+
+    // Have the collar's datagrams come straight here
+    pin(port, address, remotePort, source, nowMs) {
+        this.unpin(source);
+        if (this.pins.size >= MAX_PINS) {
+            return;
+        }
+        const socket = dgram.createSocket({ type: 'udp4', reuseAddr: true });
+        const pin = { socket, remotePort, lastMs: nowMs };
+        this.pins.set(source, pin);
+        socket.on('message', (msg, rinfo) => {
+            this.counts.datagrams++;
+            this.counts.direct++;
+            this.receive(port, rinfo.address, rinfo.port, Date.now(), msg, 0);
+        });
+        socket.on('error', () => {
+            if (this.pins.get(source) === pin) {
+                this.unpin(source);
+            }
+        });
+        // Exclusive: its own socket, not the one the cluster shares for the port
+        socket.bind({ port, exclusive: true }, () => {
+            if (this.pins.get(source) === pin) {
+                socket.connect(remotePort, address);
+            }
+        });
+    }
+
+    unpin(source) {
+        const pin = this.pins.get(source);
+        if (pin) {
+            this.pins.delete(source);
+            pin.socket.close();
+        }
+    }
+
+    // Drop the pins of collars gone quiet or no longer ours
+    sweepPins(nowMs) {
+        for (const [source, pin] of this.pins) {
+            if (nowMs - pin.lastMs > PIN_IDLE_MS || this.ring.owner(source) !== this.id) {
+                this.unpin(source);
+            }
+        }
+    }
+
+    forwardTo(owner, header, msg) {
+        let link = this.links.get(owner);
+        if (!link) {
+            const socket = net.connect(this.peers.get(owner), FORWARD_HOST);
+            socket.setNoDelay(true);
+            socket.on('error', (err) => {
+                this.send({ type: 'error', message: `link to shard ${owner}: ${err.message}` });
+            });
+            socket.on('close', () => {
+                if (this.links.get(owner) === link) {
+                    this.links.delete(owner);
+                }
+            });
+            link = { socket, frames: [], scheduled: false };
+            this.links.set(owner, link);
+        }
+        const length = Buffer.alloc(4);
+        length.writeUInt32LE(header.length + msg.length);
+        link.frames.push(length, header, msg);
+        if (!link.scheduled) {
+            link.scheduled = true;
+            setImmediate(() => {
+                link.scheduled = false;
+                if (!link.socket.destroyed) {
+                    link.socket.write(Buffer.concat(link.frames));
+                }
+                link.frames = [];
+            });
+        }
+    }
+
+    // A link from another shard: length-prefixed frames
+    accept(socket) {
+        let pending = Buffer.alloc(0);
+        socket.on('data', (chunk) => {
+            pending = pending.length > 0 ? Buffer.concat([pending, chunk]) : chunk;
+            let offset = 0;
+            while (pending.length - offset >= 4) {
+                const end = offset + 4 + pending.readUInt32LE(offset);
+                if (end > pending.length) {
+                    break;
+                }
+                this.receiveForwarded(pending.subarray(offset + 4, end));
+                offset = end;
+            }
+            pending = pending.subarray(offset);
+        });
+        socket.on('error', () => socket.destroy());
+    }
+
+    receiveForwarded(msg) {
+        const end = msg.indexOf(10);
+        const fields = end > 0 ? msg.toString('latin1', 0, end).split(' ') : [];
+        if (fields.length !== 6 || fields[0] !== 'FWD') {
+            return;
+        }
+        this.counts.received++;
+        this.receive(Number(fields[2]), fields[4], Number(fields[5]), Number(fields[3]), msg.subarray(end + 1), Number(fields[1]));
+    }
+
+    ingest(port, source, nowMs, msg) {
+        const lines = msg.toString('utf8').split('\n').map(line => line.trim()).filter(line => line !== '');
+        if (lines.length === 0) {
+            this.counts.empty++;
+            return;
+        }
+        const time = new Date(nowMs).toISOString();
+        lines.forEach((text) => {
+            this.counts.records++;
+            if (this.statusLog) {
+                append(this.statusLog, `Port ${port} | ID ${nowMs} | Message: ${text}\n`);
+            }
+            if (this.dataLog) {
+                append(this.dataLog, `${time}, ${source}, ${text}\n`);
+            }
+            const record = parseMessage(text);
+            const state = STATE_NAMES.indexOf(record.state);
+            if (state >= 0) {
+                this.board.update(source, nowMs, state, record.duration);
+            }
+        });
+    }
+
+    // Write out the logs' pending lines, before exiting
+    close() {
+        clearInterval(this.sweeper);
+        this.sockets.forEach(socket => socket.close());
+        this.sockets = [];
+        [...this.pins.keys()].forEach(source => this.unpin(source));
+        this.links.forEach(link => link.socket.destroy());
+        this.links.clear();
+        flushAll();
+    }
+
+    // A message from the coordinator
+    handle(message) {
+        if (message.type === 'ring') {
+            this.setRing(message);
+        } else if (message.type === 'handover') {
+            this.takeOver(message);
+        } else if (message.type === 'top') {
+            const boards = {};
+            message.horizons.forEach((horizon) => {
+                boards[horizon] = this.board.top(horizon, message.group, message.k);
+            });
+            this.send({ type: 'reply', request: message.request, boards });
+        } else if (message.type === 'stats') {
+            this.send({ type: 'reply', request: message.request, stats: this.stats() });
+        }
+    }
+
+    // { epoch, shards: [{ id, forwardPort }], joined: the new shard's ID or null }
+    setRing({ epoch, shards, joined }) {
+        const first = this.ring === null;
+        this.epoch = epoch;
+        this.ring = new HashRing(shards.map(shard => shard.id));
+        this.peers = new Map(shards.map(shard => [shard.id, shard.forwardPort]));
+        [...this.links.keys()].filter(id => !this.peers.has(id)).forEach((id) => {
+            this.links.get(id).socket.destroy();
+            this.links.delete(id);
+        });
+        if (!first) {
+            this.sweepPins(Date.now());
+        }
+        if (joined === this.id) {
+            const waiting = new Set(shards.map(shard => shard.id).filter(id => id !== this.id));
+            this.joining = { epoch, waiting, snapshots: [], held: [] };
+        } else if (joined !== null && !first) {
+            this.handOver(joined);
+        }
+        if (this.joining) {
+            // Shards that left will not hand anything over
+            [...this.joining.waiting].filter(id => !this.peers.has(id)).forEach(id => this.joining.waiting.delete(id));
+            this.settle();
+        }
+        if (first) {
+            this.listen();
+        }
+    }
+
+    // Give the collars that now belong to shard `to` to it
+    handOver(to) {
+        const moving = this.board.catIds.filter(catId => this.ring.owner(catId) === to);
+        // Their lines so far go out before the new owner logs any more
+        flushAll();
+        const snapshot = this.board.extract(moving);
+        this.counts.handedOver += snapshot.catIds.length;
+        this.send({ type: 'handover', epoch: this.epoch, from: this.id, to, snapshot });
+    }
+
+    // { epoch, from, snapshot }
+    takeOver({ epoch, from, snapshot }) {
+        if (!this.joining || epoch !== this.joining.epoch) {
+            return;
+        }
+        this.joining.waiting.delete(from);
+        this.joining.snapshots.push(snapshot);
+        this.settle();
+    }
+
+    settle() {
+        if (!this.joining || this.joining.waiting.size > 0) {
+            return;
+        }
+        const { snapshots, held } = this.joining;
+        this.joining = null;
+        const board = new Leaderboard(this.boardOptions);
+        board.restore(mergeSnapshots([this.board.snapshot(), ...snapshots]));
+        this.board = board;
+        this.counts.takenOver += snapshots.reduce((sum, snapshot) => sum + snapshot.catIds.length, 0);
+        held.forEach(args => this.ingest(...args));
+        this.send({ type: 'settled', epoch: this.epoch, collars: this.counts.takenOver, held: held.length });
+    }
+
+    stats() {
+        const cpu = process.cpuUsage();
+        return {
+            id: this.id,
+            epoch: this.epoch,
+            ...this.counts,
+            collars: this.board.catIds.filter(catId => this.ring && this.ring.owner(catId) === this.id).length,
+            pins: this.pins.size,
+            ringRecords: this.board.stats().ringRecords,
+            cpuMs: (cpu.user + cpu.system) / 1000,
+            rssBytes: process.memoryUsage.rss()
+        };
+    }
+}
+
+module.exports = {
+    IngestShard
+};
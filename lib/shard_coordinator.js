@@ -0,0 +1,183 @@
+// shard_coordinator.js
+//
+// Runs ingest shards (lib/shard.js) as cluster workers on this machine and answers
+// for them as one. Cluster workers that bind the same UDP port share one socket, so
+// every shard reads from the collar ports. The coordinator does no ingest itself. It
+// keeps the list of shards, sends every shard the ring each time the list changes,
+// relays handovers to a joining shard, and merges the shards' leaderboards. Each
+// collar belongs to one shard, so the top K of a group across shards is the top K
+// of the shards' top Ks put together.
+//
+// Ring changes go one at a time. add() starts a shard and resolves once it has taken
+// over its collars. A shard that exits is dropped from the ring, and its collars move
+// to the others.
+
+const cluster = require('cluster');
+const EventEmitter = require('events');
+const path = require('path');
+const { DEFAULT_K } = require('./leaderboard');
+
+const REPLY_TIMEOUT_MS = 5000;
+
+class ShardCoordinator extends EventEmitter {
+    // options: { ports, statusLog, dataLog, weights, groups }, passed to every shard
+    constructor(options) {
+        super();
+        this.options = options;
+        this.shards = new Map(); // shard ID -> { id, worker, forwardPort, onSettled }
+        this.nextId = 0;
+        this.epoch = 0;
+        this.requests = new Map(); // request number -> { resolve, timer }
+        this.nextRequest = 0;
+        this.changes = Promise.resolve();
+        this.rebalances = [];
+        this.stopping = false;
+        // 'advanced' so handovers keep their typed arrays
+        cluster.setupPrimary({ exec: path.join(__dirname, 'shard_worker.js'), serialization: 'advanced' });
+    }
+
+    // Start count shards; resolves once they all listen
+    start(count) {
+        return this.change(async () => {
+            await Promise.all(Array.from({ length: count }, () => this.spawn()));
+            this.sendRing(null);
+        });
+    }
+
+    // Start one more shard; resolves with { id, epoch, shards, collars, held, ms } once
+    // it has taken over its collars
+    add() {
+        return this.change(async () => {
+            const startedMs = Date.now();
+            const shard = await this.spawn();
+            const settled = new Promise((resolve) => {
+                shard.onSettled = resolve;
+            });
+            this.sendRing(shard.id);
+            const { collars, held } = await settled;
+            const rebalance = { id: shard.id, epoch: this.epoch, shards: this.shards.size, collars, held, ms: Date.now() - startedMs };
+            this.rebalances.push(rebalance);
+            this.emit('rebalanced', rebalance);
+            return rebalance;
+        });
+    }
+
+    change(fn) {
+        const next = this.changes.then(fn);
+        this.changes = next.catch(() => {});
+        return next;
+    }
+
+    spawn() {
+        const id = this.nextId++;
+        const worker = cluster.fork({ SHARD_OPTIONS: JSON.stringify({ ...this.options, id }) });
+        const shard = { id, worker, forwardPort: null, onSettled: null };
+        return new Promise((resolve, reject) => {
+            worker.on('message', (message) => {
+                if (message.type === 'ready') {
+                    shard.forwardPort = message.forwardPort;
+                    this.shards.set(id, shard);
+                    resolve(shard);
+                } else {
+                    this.receive(shard, message);
+                }
+            });
+            worker.on('exit', (code, signal) => {
+                if (!this.shards.delete(id)) {
+                    reject(new Error(`Shard ${id} exited before it was ready`));
+                    return;
+                }
+                if (shard.onSettled) {
+                    shard.onSettled({ collars: 0, held: 0 });
+                }
+                if (!this.stopping) {
+                    this.emit('exit', { id, code, signal });
+                    this.change(async () => this.sendRing(null));
+                }
+            });
+        });
+    }
+
+    receive(shard, message) {
+        if (message.type === 'handover') {
+            const to = this.shards.get(message.to);
+            if (to) {
+                to.worker.send(message);
+            }
+        } else if (message.type === 'settled') {
+            if (shard.onSettled) {
+                shard.onSettled(message);
+                shard.onSettled = null;
+            }
+        } else if (message.type === 'reply') {
+            const request = this.requests.get(message.request);
+            if (request) {
+                clearTimeout(request.timer);
+                this.requests.delete(message.request);
+                request.resolve(message);
+            }
+        } else if (message.type === 'error') {
+            this.emit('error', new Error(`Shard ${shard.id}: ${message.message}`));
+        }
+    }
+
+    // Every shard gets the new ring; joined is the ID of a shard to hand collars to, or null
+    sendRing(joined) {
+        this.epoch++;
+        const shards = [...this.shards.values()].map(shard => ({ id: shard.id, forwardPort: shard.forwardPort }));
+        const message = { type: 'ring', epoch: this.epoch, shards, joined };
+        this.shards.forEach(shard => shard.worker.send(message));
+    }
+
+    // Every shard's reply to message, with null for any that did not answer in time
+    ask(message) {
+        return Promise.all([...this.shards.values()].map(shard => new Promise((resolve) => {
+            const request = this.nextRequest++;
+            const timer = setTimeout(() => {
+                this.requests.delete(request);
+                resolve(null);
+            }, REPLY_TIMEOUT_MS);
+            this.requests.set(request, { resolve, timer });
+            shard.worker.send({ ...message, request });
+        })));
+    }
+
+    // { <horizon>: [{ rank, catId, score }] } of the top k across every shard, as
+    // Leaderboard.top gives for one; null for an unknown horizon or group
+    async top(horizons, group, k = DEFAULT_K) {
+        const replies = (await this.ask({ type: 'top', horizons, group, k })).filter(Boolean);
+        const boards = {};
+        for (const horizon of horizons) {
+            if (replies.some(reply => reply.boards[horizon] === null)) {
+                return null;
+            }
+            boards[horizon] = replies.flatMap(reply => reply.boards[horizon])
+                .sort((a, b) => b.score - a.score)
+                .slice(0, k)
+                .map((entry, i) => ({ ...entry, rank: i + 1 }));
+        }
+        return boards;
+    }
+
+    async stats() {
+        const shards = (await this.ask({ type: 'stats' })).filter(Boolean).map(reply => reply.stats);
+        const totals = {};
+        ['datagrams', 'direct', 'records', 'forwarded', 'collars', 'pins', 'cpuMs'].forEach((key) => {
+            totals[key] = shards.reduce((sum, shard) => sum + shard[key], 0);
+        });
+        return { epoch: this.epoch, shards, totals, rebalances: this.rebalances };
+    }
+
+    // Stop every shard; resolves once they have written out their logs and exited
+    stop() {
+        this.stopping = true;
+        return Promise.all([...this.shards.values()].map(shard => new Promise((resolve) => {
+            shard.worker.once('exit', resolve);
+            shard.worker.send({ type: 'stop' });
+        })));
+    }
+}
+
+module.exports = {
+    ShardCoordinator
+};
@@ -0,0 +1,84 @@
+// shard_ring.js
+//
+// Consistent hashing of collar IDs onto ingest shards (lib/shard.js). Every shard
+// puts VNODES points on a 32-bit ring, hashed from its ID, and a collar belongs to
+// the shard of the first point at or after the collar's own hash. Each process
+// builds the ring from the same list of shard IDs, so they all agree on an owner
+// without asking anyone. Adding a shard only moves collars to the new one, about
+// 1/N of them, and the points spread each shard's share to within about 15%.
+//
+// Hashes are FNV-1a over the UTF-8 bytes, finished with murmur3's fmix32 so that
+// IDs that differ only in their last characters still land far apart.
+
+const VNODES = 128;
+
+function mix(h) {
+    h ^= h >>> 16;
+    h = Math.imul(h, 0x85ebca6b);
+    h ^= h >>> 13;
+    h = Math.imul(h, 0xc2b2ae35);
+    h ^= h >>> 16;
+    return h >>> 0;
+}
+
+function hash(text) {
+    const key = String(text);
+    let h = 0x811c9dc5;
+    for (let i = 0; i < key.length; i++) {
+        const code = key.charCodeAt(i);
+        if (code >= 0x80) {
+            // Collar IDs are addresses and ports; anything else takes the slow way
+            const bytes = Buffer.from(key, 'utf8');
+            h = 0x811c9dc5;
+            for (let j = 0; j < bytes.length; j++) {
+                h = Math.imul(h ^ bytes[j], 0x01000193);
+            }
+            return mix(h);
+        }
+        h = Math.imul(h ^ code, 0x01000193);
+    }
+    return mix(h);
+}
+
+class HashRing {
+    // shards: shard IDs (numbers or strings)
+    constructor(shards, vnodes = VNODES) {
+        this.shards = shards.slice();
+        const points = [];
+        this.shards.forEach((shard, s) => {
+            for (let v = 0; v < vnodes; v++) {
+                points.push({ at: hash(`${shard}#${v}`), s });
+            }
+        });
+        // Ties (two shards on one point) go to the shard listed first
+        points.sort((a, b) => a.at - b.at || a.s - b.s);
+        this.points = Uint32Array.from(points, point => point.at);
+        this.owners = Uint16Array.from(points, point => point.s);
+    }
+
+    // The shard ID a collar ID belongs to, or undefined on an empty ring
+    owner(key) {
+        const n = this.points.length;
+        if (n === 0) {
+            return undefined;
+        }
+        const h = hash(key);
+        let lo = 0;
+        let hi = n;
+        while (lo < hi) {
+            const mid = (lo + hi) >> 1;
+            if (this.points[mid] < h) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+        return this.shards[this.owners[lo === n ? 0 : lo]];
+    }
+}
+
+module.exports = {
+    HashRing,
+    VNODES,
+    hash
+};
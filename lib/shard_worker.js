@@ -0,0 +1,25 @@
+// shard_worker.js
+//
+// Process entry point of one ingest shard (lib/shard.js), forked by ShardCoordinator
+// with its options in SHARD_OPTIONS.
+
+const { IngestShard } = require('./shard');
+
+const shard = new IngestShard(JSON.parse(process.env.SHARD_OPTIONS), message => process.send(message));
+
+process.on('message', (message) => {
+    if (message.type === 'stop') {
+        shard.close();
+        process.exit(0);
+    }
+    shard.handle(message);
+});
+
+// The coordinator stops the shards itself; a Ctrl-C reaches the whole process group
+process.on('SIGINT', () => {});
+process.on('SIGTERM', () => {
+    shard.close();
+    process.exit(0);
+});
+
+shard.open();
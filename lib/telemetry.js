@@ -0,0 +1,269 @@
+// telemetry.js
+//
+// Parsing shared by host_data.js and read_data.js.
+//
+// Collar status message (UDP payload):
+//   "00:03:01, Temperature: 81.62°F, Cat state: Wander Time, Time: 1729875494654321"
+//   The temperature field is omitted until the collar has a reading, and by older firmware.
+//   Time is when the collar measured the state, in epoch microseconds from its synced
+//   clock (see lib/timesync.js); it is omitted until the first sync, and by older firmware.
+//
+// cat_status_log.txt line:
+//   "Port 3334 | ID 1729875494654 | Message: <status message>"
+//
+// cat_data.csv line:
+//   "<ISO time>, [<host>:<port>, ]<status message>"
+//
+// Whole-log functions (parseStatusLog, aggregateStatusLog, groupDataLog) use the native addon in
+// native/ when it has been built (npm run build:native) and fall back to the
+// line-by-line JS parsers otherwise. Both paths return the same shapes.
+
+const path = require('path');
+
+let native = null;
+try {
+    native = require('node-gyp-build')(path.join(__dirname, '..', 'native'));
+} catch (err) {
+    native = null;
+}
+
+const STATE_NAMES = ['Sleepy Time', 'Wander Time', 'Moonwalk Time'];
+
+// Cat IDs by the UDP port each collar reports to
+const PORT_TO_CAT = {
+    '3333': '1',
+    '3334': '2',
+    '3335': '3'
+};
+
+// Function to parse duration string into seconds
+function parseDuration(durationStr) {
+    const parts = durationStr.split(':').map(Number);
+    let seconds = 0;
+    if (parts.length === 3) {
+        // HH:MM:SS
+        seconds = parts[0] * 3600 + parts[1] * 60 + parts[2];
+    } else if (parts.length === 2) {
+        // MM:SS
+        seconds = parts[0] * 60 + parts[1];
+    } else if (parts.length === 1) {
+        // SS
+        seconds = parts[0];
+    }
+    return seconds;
+}
+
+const DURATION_RE = /^\d+(:\d+){0,2}$/;
+
+const SOURCE_TIME_RE = /^\d+$/;
+
+// Parse a collar status message into { duration, temperature, state, sourceTimeUs }
+function parseMessage(content) {
+    const record = { duration: 0, temperature: null, state: '', sourceTimeUs: null };
+    content.split(',').forEach(rawField => {
+        const field = rawField.trim();
+        if (field.startsWith('Cat state:')) {
+            record.state = field.substring('Cat state:'.length).trim();
+        } else if (field.startsWith('Temperature:')) {
+            const value = parseFloat(field.substring('Temperature:'.length));
+            record.temperature = Number.isNaN(value) ? null : value;
+        } else if (field.startsWith('Time:')) {
+            const value = field.substring('Time:'.length).trim();
+            record.sourceTimeUs = SOURCE_TIME_RE.test(value) ? Number(value) : null;
+        } else if (DURATION_RE.test(field)) {
+            record.duration = parseDuration(field);
+        }
+    });
+    return record;
+}
+
+// Parse a cat_status_log.txt line into { port, catId, id, ...message } or null
+function parseStatusLine(line) {
+    let port = null;
+    let id = null;
+    let content = null;
+
+    line.split(' | ').forEach(part => {
+        if (part.startsWith('Port ')) {
+            port = part.substring('Port '.length).trim();
+        } else if (part.startsWith('ID ')) {
+            id = part.substring('ID '.length).trim();
+        } else if (part.startsWith('Message: ')) {
+            content = part.substring('Message: '.length).trim();
+        }
+    });
+
+    if (!port || !content) {
+        return null;
+    }
+    return { port, catId: PORT_TO_CAT[port] || null, id, ...parseMessage(content) };
+}
+
+const SOURCE_RE = /^[\w.-]+:\d+$/;
+
+// Parse a cat_data.csv line into { time, source, ...message } or null
+function parseDataLine(line) {
+    const firstComma = line.indexOf(',');
+    if (firstComma < 0) {
+        return null;
+    }
+    const time = line.substring(0, firstComma).trim();
+    let rest = line.substring(firstComma + 1).trim();
+
+    let source = null;
+    const secondComma = rest.indexOf(',');
+    if (secondComma > 0 && SOURCE_RE.test(rest.substring(0, secondComma).trim())) {
+        source = rest.substring(0, secondComma).trim();
+        rest = rest.substring(secondComma + 1);
+    }
+    return { time, source, ...parseMessage(rest) };
+}
+
+// Cats every leaderboard starts with, so a silent collar still shows up with zero
+function emptyCatStates() {
+    const catStates = {};
+    Object.values(PORT_TO_CAT).forEach(catId => {
+        catStates[catId] = {};
+    });
+    return catStates;
+}
+
+const LEADER_WEIGHTS = { 'Wander Time': 1, 'Moonwalk Time': 1 };
+
+// Most weighted time wins (Wander + Moonwalk by default); ties go to the first cat
+function leaderOf(catStates, weights = LEADER_WEIGHTS) {
+    let leaderId = null;
+    let maxDuration = -1;
+    for (const catId in catStates) {
+        const states = catStates[catId];
+        let active = 0;
+        for (const state in states) {
+            active += states[state] * (weights[state] || 0);
+        }
+        if (active > maxDuration) {
+            maxDuration = active;
+            leaderId = catId;
+        }
+    }
+    return leaderId;
+}
+
+function aggregateStatusLogJs(data) {
+    const catStates = emptyCatStates();
+    data.toString('utf8').split('\n').forEach(line => {
+        if (line.trim() === '') return;
+        const record = parseStatusLine(line);
+        if (!record || !record.catId || !record.state) return;
+        const states = catStates[record.catId];
+        states[record.state] = (states[record.state] || 0) + record.duration;
+    });
+    return { catStates, leaderId: leaderOf(catStates) };
+}
+
+function aggregateStatusLogNative(data) {
+    const totals = native.aggregateStatusLog(data);
+    const catStates = emptyCatStates();
+    totals.ports.forEach((port, i) => {
+        const catId = PORT_TO_CAT[port];
+        if (!catId) return;
+        STATE_NAMES.forEach((name, s) => {
+            const cell = i * STATE_NAMES.length + s;
+            if (totals.records[cell] > 0) {
+                catStates[catId][name] = (catStates[catId][name] || 0) + totals.seconds[cell];
+            }
+        });
+    });
+    return { catStates, leaderId: leaderOf(catStates) };
+}
+
+// Sum seconds per state per cat over a whole cat_status_log.txt Buffer
+// Returns { catStates: { '1': { 'Wander Time': 120, ... }, ... }, leaderId }
+function aggregateStatusLog(data) {
+    return native ? aggregateStatusLogNative(data) : aggregateStatusLogJs(data);
+}
+
+function parseStatusLogJs(data) {
+    const lines = data.toString('utf8').split('\n');
+    const cols = {
+        count: 0,
+        port: new Uint16Array(lines.length),
+        id: new Float64Array(lines.length),
+        sourceTime: new Float64Array(lines.length),
+        duration: new Uint32Array(lines.length),
+        temperature: new Float32Array(lines.length),
+        state: new Uint8Array(lines.length)
+    };
+    lines.forEach(line => {
+        const record = line.trim() === '' ? null : parseStatusLine(line);
+        if (!record) return;
+        const i = cols.count++;
+        const state = STATE_NAMES.indexOf(record.state);
+        cols.port[i] = Number(record.port);
+        cols.id[i] = record.id === null ? NaN : Number(record.id);
+        cols.sourceTime[i] = record.sourceTimeUs === null ? NaN : record.sourceTimeUs;
+        cols.duration[i] = record.duration;
+        cols.temperature[i] = record.temperature === null ? NaN : record.temperature;
+        cols.state[i] = state < 0 ? 255 : state;
+    });
+    return cols;
+}
+
+// Columns of a whole cat_status_log.txt Buffer:
+// { count, port, id, sourceTime (µs, NaN when absent), duration, temperature, state (index into STATE_NAMES, 255 if unknown) }
+function parseStatusLog(data) {
+    return native ? native.parseStatusLog(data) : parseStatusLogJs(data);
+}
+
+function groupDataLogJs(data) {
+    const grouped = {};
+    data.toString('utf8').trim().split('\n').forEach(line => {
+        const record = parseDataLine(line);
+        if (!record) return;
+        const { source, temperature, state } = record;
+        // Collar stamps beat arrival times, which carry Wi-Fi jitter and retries
+        const time = record.sourceTimeUs !== null ? new Date(record.sourceTimeUs / 1000).toISOString() : record.time;
+        (grouped[source] = grouped[source] || []).push({ time, source, temperature, state });
+    });
+    return grouped;
+}
+
+function groupDataLogNative(data) {
+    const cols = native.parseDataLog(data);
+    const grouped = {};
+    for (let i = 0; i < cols.count; i++) {
+        const source = cols.sourceIndex[i] === 0xFFFF ? null : cols.sources[cols.sourceIndex[i]];
+        const ms = cols.time[i];
+        const temperature = cols.temperature[i];
+        (grouped[source] = grouped[source] || []).push({
+            time: Number.isNaN(ms) ? null : new Date(ms).toISOString(),
+            source,
+            temperature: Number.isNaN(temperature) ? null : Math.round(temperature * 100) / 100,
+            state: STATE_NAMES[cols.state[i]] || ''
+        });
+    }
+    return grouped;
+}
+
+// Group a whole cat_data.csv Buffer by source: { '<host>:<port>': [{ time, source, temperature, state }] }
+// time is the collar's own stamp when it sent one, otherwise the logged arrival time
+function groupDataLog(data) {
+    return native ? groupDataLogNative(data) : groupDataLogJs(data);
+}
+
+module.exports = {
+    PORT_TO_CAT,
+    STATE_NAMES,
+    native,
+    parseDuration,
+    parseMessage,
+    parseStatusLine,
+    parseDataLine,
+    LEADER_WEIGHTS,
+    leaderOf,
+    parseStatusLog,
+    parseStatusLogJs,
+    aggregateStatusLog,
+    aggregateStatusLogJs,
+    groupDataLog,
+    groupDataLogJs
+};
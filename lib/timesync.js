@@ -0,0 +1,33 @@
+// timesync.js
+//
+// Server side of the collar time sync (main/timesync.c).
+//
+// Collar:  "TSYNC REQ <seq> <t1>"             t1 = collar's local clock, microseconds
+// Server:  "TSYNC RESP <seq> <t1> <t2> <t3>"  t2/t3 = receive/send time, epoch microseconds
+//
+// Stamps come from the monotonic hrtime clock anchored to the wall clock once at
+// startup, so a wall-clock adjustment on the server never makes collar time jump.
+
+const originUs = BigInt(Date.now()) * 1000n - process.hrtime.bigint() / 1000n;
+
+// Epoch microseconds as a BigInt
+function epochUs() {
+    return process.hrtime.bigint() / 1000n + originUs;
+}
+
+const REQUEST_RE = /^TSYNC REQ (\d+) (-?\d+)$/;
+
+// Reply to a TSYNC request received at receivedUs (from epochUs()), or null if text is not one.
+// The send time is stamped as late as possible, when the reply is built.
+function timesyncReply(text, receivedUs) {
+    const match = REQUEST_RE.exec(text);
+    if (!match) {
+        return null;
+    }
+    return `TSYNC RESP ${match[1]} ${match[2]} ${receivedUs} ${epochUs()}`;
+}
+
+module.exports = {
+    epochUs,
+    timesyncReply
+};
@@ -0,0 +1,181 @@
+// trace.js
+//
+// Latency tracing for status records, from the collar's sampling window to the
+// leader buzz and the dashboard. Every record a collar classifies carries
+//
+//   "Trace: <id> window=<µs> send=<µs>"
+//
+// id is 8 hex digits, counting up from a random start each boot. window is how long
+// the sampling window ran before the state was classified, and send is how long the
+// record took from classification to being handed to the network stack. Both are
+// measured on the collar's own timer, so they need no time sync. Time: (the
+// classification, on the synced clock) places the record on the server's clock,
+// which times every hop after that:
+//
+//   window   sampling window                                    collar
+//   send     classification to send                             collar
+//   network  send to the ingest receiving it                    needs Time:; to the ms, as ingests log ms
+//   store    ingest to the server reading the logged line       append batching and LogStore.follow polling
+//   leader   line read to the next leader computation           host_data.js: the interval and the totals reread
+//   buzz     leader computed to sent on /buzz                   host_data.js
+//   emit     line read to the socket.io push                    read_data.js: grouping the new lines
+//   render   push to the dashboard's next frame                 read_data.js, acked by the page (so plus the ack's trip)
+//   total    start of the window to the server's last hop       from the ingest when the collar is unsynced
+//
+// Each server keeps a Tracer with a LatencyHistogram per stage it sees and serves
+// tracer.metrics() on GET /metrics (tools/latency_report.js prints them). Only lines
+// logged after the server started are traced, so replays of old lines do not count.
+
+const SUB_BITS = 3; // 8 buckets per power of two, so a bucket is within 12.5% of its values
+const SUB_BUCKETS = 1 << SUB_BITS;
+const MAX_EXPONENT = 40; // 2^40 µs is 12 days; longer is counted there
+const BUCKETS = (MAX_EXPONENT - SUB_BITS + 2) * SUB_BUCKETS;
+const MAX_PENDING = 65536; // Traces held for a later hop; the oldest go first
+
+const TRACE_RE = /Trace: ([0-9a-f]{8}) window=(-?\d+) send=(-?\d+)/;
+
+// Parse the Trace field of a status message into { id, windowUs, sendUs }, or null
+function parseTrace(text) {
+    const match = TRACE_RE.exec(text);
+    if (!match) {
+        return null;
+    }
+    return { id: match[1], windowUs: Number(match[2]), sendUs: Number(match[3]) };
+}
+
+function bucketOf(us) {
+    if (us < SUB_BUCKETS) {
+        return us;
+    }
+    const exponent = Math.min(Math.floor(Math.log2(us)), MAX_EXPONENT);
+    const mantissa = Math.min(Math.floor(us / 2 ** (exponent - SUB_BITS)), 2 * SUB_BUCKETS - 1);
+    return (exponent - SUB_BITS + 1) * SUB_BUCKETS + mantissa - SUB_BUCKETS;
+}
+
+// Middle of a bucket's range of values
+function bucketValue(index) {
+    if (index < SUB_BUCKETS) {
+        return index;
+    }
+    const exponent = Math.floor(index / SUB_BUCKETS) + SUB_BITS - 1;
+    const mantissa = (index % SUB_BUCKETS) + SUB_BUCKETS;
+    return (mantissa + 0.5) * 2 ** (exponent - SUB_BITS);
+}
+
+// Log-linear histogram of microsecond latencies, fixed size whatever it counts
+class LatencyHistogram {
+    constructor() {
+        this.counts = new Float64Array(BUCKETS);
+        this.count = 0;
+        this.sum = 0;
+        this.max = 0;
+        this.negative = 0; // Hops that ran backwards: clock skew between collar and server
+    }
+
+    record(us) {
+        let value = Math.round(us);
+        if (!(value >= 0)) {
+            this.negative++;
+            value = 0;
+        }
+        this.counts[bucketOf(value)]++;
+        this.count++;
+        this.sum += value;
+        this.max = Math.max(this.max, value);
+    }
+
+    percentile(p) {
+        if (this.count === 0) {
+            return null;
+        }
+        const rank = Math.max(1, Math.ceil(p * this.count));
+        let seen = 0;
+        for (let i = 0; i < BUCKETS; i++) {
+            seen += this.counts[i];
+            if (seen >= rank) {
+                return Math.min(Math.round(bucketValue(i)), this.max);
+            }
+        }
+        return this.max;
+    }
+
+    summary() {
+        return {
+            count: this.count,
+            meanUs: this.count ? Math.round(this.sum / this.count) : null,
+            p50Us: this.percentile(0.5),
+            p90Us: this.percentile(0.9),
+            p99Us: this.percentile(0.99),
+            maxUs: this.count ? this.max : null,
+            negative: this.negative
+        };
+    }
+}
+
+class Tracer {
+    constructor(stages) {
+        this.startedMs = Date.now();
+        this.stages = new Map(stages.map(stage => [stage, new LatencyHistogram()]));
+        this.pending = new Map(); // key -> whatever the next hop needs, oldest first
+        this.counts = { traced: 0, unsynced: 0, dropped: 0 };
+    }
+
+    record(stage, us) {
+        this.stages.get(stage).record(us);
+    }
+
+    // A traced line was read at readUs after its ingest logged it at ingestUs; records the
+    // hops up to here and returns where the trace starts on the server's clock
+    arrive(trace, sourceTimeUs, ingestUs, readUs) {
+        this.counts.traced++;
+        this.record('window', trace.windowUs);
+        this.record('send', trace.sendUs);
+        this.record('store', readUs - ingestUs);
+        if (sourceTimeUs === null) {
+            this.counts.unsynced++;
+            return ingestUs;
+        }
+        this.record('network', ingestUs - (sourceTimeUs + trace.sendUs));
+        return sourceTimeUs - trace.windowUs;
+    }
+
+    // Whether a line logged at ingestMs is recent enough to trace
+    live(ingestMs) {
+        return ingestMs >= this.startedMs;
+    }
+
+    hold(key, value) {
+        if (this.pending.size >= MAX_PENDING) {
+            this.pending.delete(this.pending.keys().next().value);
+            this.counts.dropped++;
+        }
+        this.pending.set(key, value);
+    }
+
+    take(key) {
+        const value = this.pending.get(key);
+        this.pending.delete(key);
+        return value;
+    }
+
+    // Everything held, in arrival order, and forget it
+    drain() {
+        const values = [...this.pending.values()];
+        this.pending.clear();
+        return values;
+    }
+
+    metrics() {
+        const stages = {};
+        for (const [stage, histogram] of this.stages) {
+            stages[stage] = histogram.summary();
+        }
+        return { since: new Date(this.startedMs).toISOString(), ...this.counts, pending: this.pending.size, stages };
+    }
+}
+
+module.exports = {
+    LatencyHistogram,
+    Tracer,
+    parseTrace
+};
@@ -0,0 +1,227 @@
+// uart_frames.js
+//
+// Host side of the collar's binary UART stream (main/uart_frame.h, main/uart_stream.h).
+//
+// Frame: type (u8), seq (u16 LE), payload, CRC-16/CCITT-FALSE (u16 LE) over the rest,
+// COBS-encoded and terminated by a single 0x00.
+//
+// createFrameDecoder() uses the native addon's FrameDecoder (the firmware's own
+// uart_frame.c) when it has been built and falls back to the JS decoder below
+// otherwise. Both return the same columnar batches from push(buf):
+//   { count, type, seq, offset, length, data }  payload i = data.subarray(offset[i], offset[i] + length[i])
+
+const { native } = require('./telemetry');
+
+const TYPES = {
+    HELLO: 1,
+    STATUS: 2,
+    SAMPLES: 3,
+    LOG: 4,
+    STATS: 5,
+    TEXT: 6
+};
+
+const MAX_PAYLOAD = 512;
+const OVERHEAD = 5;
+const MAX_ENCODED = MAX_PAYLOAD + OVERHEAD + Math.floor((MAX_PAYLOAD + OVERHEAD) / 254) + 2;
+const SAMPLES_HEADER = 13;
+const SAMPLE_SIZE = 6;
+const ADXL343_G_PER_COUNT = 0.004; // ADXL343_MG2G_MULTIPLIER
+
+const CRC_TABLE = new Uint16Array(256);
+for (let i = 0; i < 256; i++) {
+    let crc = i << 8;
+    for (let bit = 0; bit < 8; bit++) {
+        crc = crc & 0x8000 ? ((crc << 1) ^ 0x1021) & 0xffff : (crc << 1) & 0xffff;
+    }
+    CRC_TABLE[i] = crc;
+}
+
+function crc16(buf, start, end, crc = 0xffff) {
+    for (let i = start; i < end; i++) {
+        crc = ((crc << 8) & 0xffff) ^ CRC_TABLE[(crc >> 8) ^ buf[i]];
+    }
+    return crc;
+}
+
+// One frame as it goes on the wire. The leading 0x00 ends whatever the collar's
+// decoder holds (noise, or nothing), so even the first frame after opening the port counts.
+function encodeFrame(type, seq, payload) {
+    payload = Buffer.isBuffer(payload) ? payload : Buffer.from(payload || '');
+    if (payload.length > MAX_PAYLOAD) {
+        throw new RangeError(`Payload of ${payload.length} bytes exceeds ${MAX_PAYLOAD}`);
+    }
+    const raw = Buffer.alloc(payload.length + OVERHEAD);
+    raw[0] = type;
+    raw.writeUInt16LE(seq & 0xffff, 1);
+    payload.copy(raw, 3);
+    raw.writeUInt16LE(crc16(raw, 0, raw.length - 2), raw.length - 2);
+
+    const out = Buffer.alloc(raw.length + Math.floor(raw.length / 254) + 3);
+    let len = 1;
+    out[len++] = 0; // Placeholder for the first code byte, fixed up below
+    let codeAt = 1;
+    let code = 1;
+    for (const byte of raw) {
+        if (byte !== 0) {
+            out[len++] = byte;
+            code++;
+        }
+        if (byte === 0 || code === 0xff) {
+            out[codeAt] = code;
+            codeAt = len++;
+            code = 1;
+        }
+    }
+    out[codeAt] = code;
+    out[len++] = 0;
+    return out.subarray(0, len);
+}
+
+// Same behaviour and counters as uart_frame_decode() in main/uart_frame.c
+class JsFrameDecoder {
+    constructor() {
+        this.buf = Buffer.alloc(MAX_ENCODED);
+        this.len = 0;
+        this.overflow = false;
+        this.synced = false;
+        this.nextSeq = -1;
+        this.counters = { bytes: 0, frames: 0, crcErrors: 0, overflows: 0, lost: 0 };
+    }
+
+    push(data) {
+        const frames = [];
+        this.counters.bytes += data.length;
+        let start = 0;
+        while (start < data.length) {
+            const zero = data.indexOf(0, start);
+            const end = zero < 0 ? data.length : zero;
+            const take = Math.min(end - start, this.buf.length - this.len);
+            data.copy(this.buf, this.len, start, start + take);
+            this.len += take;
+            if (take < end - start && !this.overflow) {
+                this.overflow = true;
+                this.counters.overflows++;
+            }
+            if (zero < 0) {
+                break;
+            }
+            if (this.synced && !this.overflow && this.len > 0) {
+                this.finish(frames);
+            }
+            this.synced = true;
+            this.overflow = false;
+            this.len = 0;
+            start = zero + 1;
+        }
+        return this.batch(frames);
+    }
+
+    finish(frames) {
+        // COBS decode in place
+        const buf = this.buf;
+        let i = 0;
+        let n = 0;
+        while (i < this.len) {
+            const code = buf[i++];
+            if (i + code - 1 > this.len) {
+                this.counters.crcErrors++;
+                return;
+            }
+            buf.copy(buf, n, i, i + code - 1);
+            n += code - 1;
+            i += code - 1;
+            if (code !== 0xff && i < this.len) {
+                buf[n++] = 0;
+            }
+        }
+        if (n < OVERHEAD || crc16(buf, 0, n - 2) !== buf.readUInt16LE(n - 2)) {
+            this.counters.crcErrors++;
+            return;
+        }
+        const seq = buf.readUInt16LE(1);
+        if (this.nextSeq >= 0) {
+            this.counters.lost += (seq - this.nextSeq) & 0xffff;
+        }
+        this.nextSeq = (seq + 1) & 0xffff;
+        this.counters.frames++;
+        frames.push({ type: buf[0], seq, payload: Buffer.from(buf.subarray(3, n - 2)) });
+    }
+
+    batch(frames) {
+        const count = frames.length;
+        const type = new Uint8Array(count);
+        const seq = new Uint16Array(count);
+        const offset = new Uint32Array(count);
+        const length = new Uint32Array(count);
+        let at = 0;
+        frames.forEach((frame, i) => {
+            type[i] = frame.type;
+            seq[i] = frame.seq;
+            offset[i] = at;
+            length[i] = frame.payload.length;
+            at += frame.payload.length;
+        });
+        return { count, type, seq, offset, length, data: Buffer.concat(frames.map(f => f.payload), at) };
+    }
+
+    stats() {
+        return { ...this.counters };
+    }
+}
+
+function createFrameDecoder() {
+    return native && native.FrameDecoder ? new native.FrameDecoder() : new JsFrameDecoder();
+}
+
+// SAMPLES payload -> { t0Us, periodUs, x, y, z } with x/y/z in raw counts (Int16Array)
+function parseSamples(payload) {
+    const count = payload.length >= SAMPLES_HEADER ? payload[12] : 0;
+    if (payload.length < SAMPLES_HEADER + count * SAMPLE_SIZE) {
+        return null;
+    }
+    const x = new Int16Array(count);
+    const y = new Int16Array(count);
+    const z = new Int16Array(count);
+    for (let i = 0; i < count; i++) {
+        const at = SAMPLES_HEADER + i * SAMPLE_SIZE;
+        x[i] = payload.readInt16LE(at);
+        y[i] = payload.readInt16LE(at + 2);
+        z[i] = payload.readInt16LE(at + 4);
+    }
+    return { t0Us: Number(payload.readBigInt64LE(0)), periodUs: payload.readUInt32LE(8), x, y, z };
+}
+
+// STATS payload -> { framesSent, framesDropped, bytesSent, rxErrors }
+function parseStats(payload) {
+    if (payload.length < 16) {
+        return null;
+    }
+    return {
+        framesSent: payload.readUInt32LE(0),
+        framesDropped: payload.readUInt32LE(4),
+        bytesSent: payload.readUInt32LE(8),
+        rxErrors: payload.readUInt32LE(12)
+    };
+}
+
+// HELLO payload -> { catId, port, fw }
+const HELLO_RE = /^HELLO (\S+) port=(\d+) fw=(\S*)$/;
+
+function parseHello(payload) {
+    const match = HELLO_RE.exec(payload.toString());
+    return match ? { catId: match[1], port: Number(match[2]), fw: match[3] } : null;
+}
+
+module.exports = {
+    TYPES,
+    MAX_PAYLOAD,
+    ADXL343_G_PER_COUNT,
+    crc16,
+    encodeFrame,
+    JsFrameDecoder,
+    createFrameDecoder,
+    parseSamples,
+    parseStats,
+    parseHello
+};
@@ -0,0 +1,80 @@
+// udp_ingest.js
+//
+// Receives the status datagrams collars send over Wi-Fi (print_status in
+// main/CatCollar.c, one "<status>\n" per datagram) and logs them like the other
+// ingest paths:
+//
+//   cat_status_log.txt  "Port <port> | ID <arrival ms> | Message: <status>"
+//   cat_data.csv        "<ISO time>, <collar address>:<port>, <status>"
+//
+// <port> is the port the datagram arrived on, the collar's udp_port, which is how
+// the servers tell cats apart (PORT_TO_CAT in lib/telemetry.js). One socket per
+// port; appends are batched per file (lib/log_append.js).
+
+const dgram = require('dgram');
+const EventEmitter = require('events');
+const path = require('path');
+const { append } = require('./log_append');
+
+const ROOT = path.join(__dirname, '..');
+const DEFAULT_PORTS = [3333, 3334, 3335];
+
+class UdpIngest extends EventEmitter {
+    // options: { ports, statusLog, dataLog } (paths default to the repo root; pass null to skip one)
+    constructor(options = {}) {
+        super();
+        this.ports = options.ports && options.ports.length > 0 ? options.ports : DEFAULT_PORTS;
+        this.statusLog = options.statusLog === undefined ? path.join(ROOT, 'cat_status_log.txt') : options.statusLog;
+        this.dataLog = options.dataLog === undefined ? path.join(ROOT, 'cat_data.csv') : options.dataLog;
+        this.sockets = [];
+        this.collars = new Set(); // "<address>:<port>"
+        this.counts = { datagrams: 0, records: 0, empty: 0 };
+    }
+
+    open() {
+        this.sockets = this.ports.map((port) => {
+            const socket = dgram.createSocket({ type: 'udp4', reuseAddr: true });
+            socket.on('message', (msg, rinfo) => this.handle(port, msg, rinfo, Date.now()));
+            socket.on('error', err => this.emit('error', err));
+            socket.bind(port, () => this.emit('listening', port));
+            return socket;
+        });
+        return this;
+    }
+
+    close() {
+        this.sockets.forEach(socket => socket.close());
+        this.sockets = [];
+    }
+
+    handle(port, msg, rinfo, nowMs) {
+        this.counts.datagrams++;
+        const time = new Date(nowMs);
+        const source = `${rinfo.address}:${port}`;
+        this.collars.add(source);
+        const lines = msg.toString('utf8').split('\n').map(line => line.trim()).filter(line => line !== '');
+        if (lines.length === 0) {
+            this.counts.empty++;
+            return;
+        }
+        lines.forEach((text) => {
+            this.counts.records++;
+            if (this.statusLog) {
+                append(this.statusLog, `Port ${port} | ID ${nowMs} | Message: ${text}\n`);
+            }
+            if (this.dataLog) {
+                append(this.dataLog, `${time.toISOString()}, ${source}, ${text}\n`);
+            }
+            this.emit('status', { source, port, text });
+        });
+    }
+
+    stats() {
+        return { ports: this.ports, ...this.counts, collars: this.collars.size };
+    }
+}
+
+module.exports = {
+    UdpIngest,
+    DEFAULT_PORTS
+};
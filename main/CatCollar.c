@@ -1,4 +1,5 @@
 #include <stdio.h>
+#include <inttypes.h>
 #include <math.h>
 #include <string.h>
 #include <sys/param.h>
@@ -6,7 +7,6 @@
 #include "driver/i2c.h"
 #include "driver/uart.h"
 #include "driver/gpio.h"
-// #include "esp_adc/adc_oneshot.h"
 #include "esp_log.h"
 #include "esp_timer.h"
 #include "esp_vfs_dev.h"
@@ -16,12 +16,12 @@
 #include "freertos/queue.h"
 #include "freertos/event_groups.h"
 
+#include "esp_random.h"
 #include "esp_system.h"
 #include "esp_wifi.h"
 #include "esp_event.h"
 #include "nvs_flash.h"
 #include "esp_netif.h"
-#include "esp_websocket_client.h"
 #include "esp_event.h"
 
 #include "lwip/err.h"
@@ -30,6 +30,18 @@
 #include <lwip/netdb.h>
 
 #include "./ADXL343.h"
+#include "./boot.h"
+#include "./button.h"
+#include "./collar_config.h"
+#include "./dlog.h"
+#include "./net.h"
+#include "./ota.h"
+#include "./relay.h"
+#include "./static_alloc.h"
+#include "./task_plan.h"
+#include "./temperature.h"
+#include "./timesync.h"
+#include "./uart_stream.h"
 #include <arpa/inet.h> // For socket functions
 #include <unistd.h>
 
@@ -68,9 +80,15 @@
 #define VISIBLE_CHARACTERS 4  // Number of characters visible on the display
 #define SCROLL_THRESHOLD 4    // Threshold to decide whether to scroll
 
+// The collar's own I2C devices, as bits of the boot cache (boot.h)
+#define I2C_DEVICE_ADXL 0x01
+#define I2C_DEVICE_DISPLAY 0x02
+
 #define UART_NUM UART_NUM_0 // Using UART0
 #define BUF_SIZE (1024)     // UART buffer size
 
+#define I2C_TIMEOUT_TICKS (1000 / portTICK_PERIOD_MS)
+
 /* The event group allows multiple bits for each event, but we only care about two events:
  * - we are connected to the AP with an IP
  * - we failed to connect after the maximum amount of retries */
@@ -80,9 +98,6 @@
 #define EXAMPLE_ESP_WIFI_PASS "smartsys"
 #define EXAMPLE_ESP_MAXIMUM_RETRY 5
 
-#define HOST_IP_ADDR "192.168.1.103"
-#define PORT 3333
-
 // cat collar definitions
 
 bool is_leader = false;
@@ -98,140 +113,84 @@ CatState previousState = CAT_SLEEP; // Initialize to CAT_SLEEP or another defaul
 TickType_t stateStartTime = 0;      // Initialize to zero
 CatState current_cat_state = CAT_SLEEP;
 SemaphoreHandle_t data_mutex;
+static StaticSemaphore_t data_mutex_buf;
 int64_t reset_time = 0;
 static EventGroupHandle_t s_wifi_event_group; /* FreeRTOS event group to signal when we are connected*/
+static StaticEventGroup_t s_wifi_event_group_buf;
 
 static const char *TAG = "wifi station";
 
 static int s_retry_num = 0;
+static bool s_associate = true; // False on a relay leaf, which never joins the AP
 
-esp_websocket_client_handle_t client;
 bool isBuzzing = false;
-const char *catId = "1"; // Set this ID for each device (change for each tracker)
 
 
 
 #define MAX_LEADER_ID_LEN 40  // Adjust as needed
+#define BUZZ_PULSE_MS 500
 
 // Global variables
 char current_leader_id[MAX_LEADER_ID_LEN] = "";
 char previous_leader_id[MAX_LEADER_ID_LEN] = "";
 
-void buzz(bool isBuzzing, const char *received_leader_id)
+// Ends a buzz; the network task that starts one never waits for it
+static esp_timer_handle_t s_buzz_timer;
+
+static void buzz_off_cb(void *arg)
 {
-    xSemaphoreTake(data_mutex, portMAX_DELAY);
-    // Compare the received leader ID with the current leader ID
-    if (isBuzzing)
-        {
-            gpio_set_level(BUZZER_GPIO, 1); // Turn on the buzzer
-            vTaskDelay(500 / portTICK_PERIOD_MS); // Buzz for 500ms
-            ESP_LOGI(TAG, "Buzzing on");
-            gpio_set_level(BUZZER_GPIO, 0); // Turn off the buzzer
-            vTaskDelay(500 / portTICK_PERIOD_MS); // Pause for 500ms
-    }
-    else if (strcmp(received_leader_id, current_leader_id) != 0)
-    {
-        // Leader has changed, buzz
-        ESP_LOGI(TAG, "Leader has changed from %s to %s", current_leader_id, received_leader_id);
-        // Leader has changed
-        strcpy(previous_leader_id, current_leader_id);
-        strcpy(current_leader_id, received_leader_id);
+    gpio_set_level(BUZZER_GPIO, 0); // Turn off the buzzer
+}
 
-        gpio_set_level(BUZZER_GPIO, 1); // Turn on the buzzer
-        vTaskDelay(500 / portTICK_PERIOD_MS); // Buzz for 500ms
-        ESP_LOGI(TAG, "Buzzing once");
-        gpio_set_level(BUZZER_GPIO, 0); // Turn off the buzzer
-        vTaskDelay(500 / portTICK_PERIOD_MS); // Pause for 500ms
-    }
-    else
+// One BUZZ_PULSE_MS buzz, unless one is already sounding
+static void buzz_pulse(void)
+{
+    if (s_buzz_timer == NULL || esp_timer_is_active(s_buzz_timer))
     {
-        // Ensure the buzzer is off
-        gpio_set_level(BUZZER_GPIO, 0);
-        vTaskDelay(100 / portTICK_PERIOD_MS);
+        return;
     }
-    xSemaphoreGive(data_mutex);
-
+    gpio_set_level(BUZZER_GPIO, 1); // Turn on the buzzer
+    esp_timer_start_once(s_buzz_timer, BUZZ_PULSE_MS * 1000);
 }
 
-static void websocket_event_handler(void *arg, esp_event_base_t event_base, int32_t event_id, void *event_data)
+// A leader update, from the network task or (on a relay leaf) from the gateway's beacons
+static void handle_leader(const char *received_leader_id)
 {
-    esp_websocket_event_data_t *data = (esp_websocket_event_data_t *)event_data;
+    DLOGI(BUZZ, "Received leader ID: %s", received_leader_id);
 
-    switch (event_id)
-    {
-    case WEBSOCKET_EVENT_DATA:
-        ESP_LOGI(TAG, "Received data: %.*s", data->data_len, (char *)data->data_ptr);
+    // Check if the received leader ID matches this device's catId
+    collar_config_t cfg;
+    config_get(&cfg);
+    bool leading = strcmp(received_leader_id, cfg.cat_id) == 0;
 
-        // Ensure data_len does not exceed buffer size - 1 for null terminator
-    if (data->data_len < MAX_LEADER_ID_LEN)
+    xSemaphoreTake(data_mutex, portMAX_DELAY);
+    bool changed = strcmp(received_leader_id, current_leader_id) != 0;
+    if (changed)
     {
-        char received_leader_id[MAX_LEADER_ID_LEN];
-        memcpy(received_leader_id, data->data_ptr, data->data_len);
-        received_leader_id[data->data_len] = '\0'; // Null-terminate the string
-        buzz(isBuzzing, received_leader_id);
-    }
-
-
-        // Null-terminate the received data
-        char received_leader_id[MAX_LEADER_ID_LEN];
-        memcpy(received_leader_id, data->data_ptr, data->data_len);
-        received_leader_id[data->data_len] = '\0';
-        ESP_LOGI(TAG, "Received leader ID: %s", received_leader_id);
-
-        // Check if the received leader ID matches this device's catId
-        if (strcmp(received_leader_id, catId) == 0)
-        {
-            isBuzzing = true; // Start buzzing if this device is the leader
-            ESP_LOGI(TAG, "This device is the leader. Buzzing started.");
-        }
-        else
-        {
-            isBuzzing = false; // Stop buzzing if another cat is the leader
-            ESP_LOGI(TAG, "This device is not the leader. Buzzing stopped.");
-        }
-        break;
-
-    case WEBSOCKET_EVENT_CONNECTED:
-        ESP_LOGI(TAG, "WebSocket connected");
-        break;
-
-    case WEBSOCKET_EVENT_DISCONNECTED:
-        ESP_LOGI(TAG, "WebSocket disconnected");
-        break;
-
-    default:
-        break;
+        DLOGI(BUZZ, "Leader has changed from %s to %s", current_leader_id, received_leader_id);
+        strcpy(previous_leader_id, current_leader_id);
+        strcpy(current_leader_id, received_leader_id);
     }
-}
-
-
-static void initialize_websocket_client()
-{
-    esp_websocket_client_config_t websocket_cfg = {
-        .uri = "ws://192.168.1.103:3000/buzz", // Replace with your Raspberry Pi IP and correct port
-    };
+    xSemaphoreGive(data_mutex);
 
-    client = esp_websocket_client_init(&websocket_cfg);
-    if (client == NULL) {
-        ESP_LOGE(TAG, "Failed to initialize WebSocket client");
-        return;
+    // Once on a change, and on every push while this device leads
+    if (changed || leading)
+    {
+        buzz_pulse();
     }
-
-    esp_err_t ret = esp_websocket_register_events(client, WEBSOCKET_EVENT_ANY, websocket_event_handler, (void *)client);
-    if (ret != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to register WebSocket events: %s", esp_err_to_name(ret));
-        esp_websocket_client_destroy(client);
-        return;
+    if (leading && !isBuzzing)
+    {
+        isBuzzing = true; // Buzz on every push while this device is the leader
+        DLOGI(BUZZ, "This device is the leader. Buzzing started.");
     }
-
-    ret = esp_websocket_client_start(client);
-    if (ret != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to start WebSocket client: %s", esp_err_to_name(ret));
-        esp_websocket_client_destroy(client);
-        return;
+    else if (!leading && isBuzzing)
+    {
+        isBuzzing = false;
+        DLOGI(BUZZ, "This device is not the leader. Buzzing stopped.");
     }
 
-    ESP_LOGI(TAG, "WebSocket client initialized and started");
+    // A relay gateway passes it on to its leaves (a no-op otherwise)
+    relay_set_leader(received_leader_id);
 }
 
 static void event_handler(void *arg, esp_event_base_t event_base,
@@ -239,10 +198,18 @@ static void event_handler(void *arg, esp_event_base_t event_base,
 {
     if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_START)
     {
-        esp_wifi_connect();
+        if (s_associate)
+        {
+            esp_wifi_connect();
+        }
+        else
+        {
+            xEventGroupSetBits(s_wifi_event_group, WIFI_FAIL_BIT);
+        }
     }
     else if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_DISCONNECTED)
     {
+        relay_set_uplink(false);
         if (s_retry_num < EXAMPLE_ESP_MAXIMUM_RETRY)
         {
             esp_wifi_connect();
@@ -260,13 +227,16 @@ static void event_handler(void *arg, esp_event_base_t event_base,
         ip_event_got_ip_t *event = (ip_event_got_ip_t *)event_data;
         ESP_LOGI(TAG, "got ip:" IPSTR, IP2STR(&event->ip_info.ip));
         s_retry_num = 0;
+        relay_set_uplink(true);
         xEventGroupSetBits(s_wifi_event_group, WIFI_CONNECTED_BIT);
     }
 }
 
-void wifi_init_sta(void)
+// Returns whether the station got an IP; a relay leaf starts the radio without associating
+bool wifi_init_sta(const collar_config_t *collar_cfg)
 {
-    s_wifi_event_group = xEventGroupCreate();
+    s_associate = collar_cfg->relay_mode != RELAY_MODE_LEAF;
+    s_wifi_event_group = xEventGroupCreateStatic(&s_wifi_event_group_buf);
 
     ESP_ERROR_CHECK(esp_netif_init());
 
@@ -320,6 +290,11 @@ void wifi_init_sta(void)
     {
         ESP_LOGI(TAG, "connected to ap SSID:%s password:%s",
                  EXAMPLE_ESP_WIFI_SSID, EXAMPLE_ESP_WIFI_PASS);
+        return true;
+    }
+    else if (!s_associate)
+    {
+        ESP_LOGI(TAG, "Relay leaf, not joining SSID:%s", EXAMPLE_ESP_WIFI_SSID);
     }
     else if (bits & WIFI_FAIL_BIT)
     {
@@ -330,10 +305,18 @@ void wifi_init_sta(void)
     {
         ESP_LOGE(TAG, "UNEXPECTED EVENT");
     }
+    return false;
 }
 
 float roll = 0, pitch = 0, x = 0, y = 0, z = 0;
 
+// Trace IDs for status records (see lib/trace.js), seeded at boot so they differ between boots
+static uint32_t s_trace_id;
+
+// A state change came before the network task was up (or found its queue full); app_main() sends the
+// current state once it is
+static bool s_status_missed;
+
 // Function to get the current time as a string
 void get_timestamp(char *buffer, size_t max_len)
 {
@@ -347,7 +330,9 @@ void get_timestamp(char *buffer, size_t max_len)
     snprintf(buffer, max_len, "%02d:%02d:%02d", hours, minutes, day_seconds);
 }
 
-void print_status()
+// sample_us is the esp_timer_get_time() of the measurement, stamped onto the record once synced;
+// window_start_us is when its sampling window began (the same as sample_us if it had none)
+void print_status(int64_t window_start_us, int64_t sample_us)
 {
     char timestamp[16];
     get_timestamp(timestamp, sizeof(timestamp));
@@ -355,42 +340,60 @@ void print_status()
     const char *state_str = (current_cat_state == CAT_SLEEP) ? "Sleepy Time" : (current_cat_state == CAT_WANDER) ? "Wander Time"
                                                                                                                  : "Moonwalk Time";
 
-    char message[64]; // Buffer for the message
-    snprintf(message, sizeof(message), "%s, Cat state: %s\n", timestamp, state_str);
+    char message[192]; // Buffer for the message
+    float temperature = temperature_get_f();
+    int len;
+    if (isnan(temperature))
+    {
+        len = snprintf(message, sizeof(message), "%s, Cat state: %s", timestamp, state_str);
+    }
+    else
+    {
+        len = snprintf(message, sizeof(message), "%s, Temperature: %.2f°F, Cat state: %s", timestamp, temperature, state_str);
+    }
 
-    // Create a UDP socket
-    int sockfd = socket(AF_INET, SOCK_DGRAM, 0);
-    if (sockfd < 0)
+    // Source timestamp, so the server can order records without trusting arrival times
+    int64_t epoch_us;
+    if (timesync_epoch_us(sample_us, &epoch_us))
+    {
+        len += snprintf(message + len, sizeof(message) - len, ", Time: %lld", (long long)epoch_us);
+    }
+    // Trace: how long the window ran before classification, and classification to send, on
+    // the collar's own timer; the server times the hops after that
+    len += snprintf(message + len, sizeof(message) - len, ", Trace: %08" PRIx32 " window=%lld send=%lld", ++s_trace_id,
+                    (long long)(sample_us - window_start_us), (long long)(esp_timer_get_time() - sample_us));
+    len = MIN(len, (int)sizeof(message) - 2); // Room for the newline
+    // Wired collars also carry the record on the UART stream (a no-op on the text console)
+    uart_stream_send(UART_FRAME_STATUS, message, MIN((size_t)len, sizeof(message) - 1));
+    snprintf(message + len, sizeof(message) - len, "\n");
+
+    // A relay leaf has no route to the server of its own; its gateway forwards the record
+    if (relay_is_leaf())
     {
-        perror("Socket creation failed");
+        relay_send_status(current_cat_state, temperature, (uint32_t)((esp_timer_get_time() - reset_time) / 1000000),
+                          sample_us);
         return;
     }
 
-    // Set up the server address structure
-    struct sockaddr_in server_addr;
-    memset(&server_addr, 0, sizeof(server_addr));
-    server_addr.sin_family = AF_INET;
-    server_addr.sin_port = htons(PORT);
-    inet_pton(AF_INET, HOST_IP_ADDR, &server_addr.sin_addr);
-
-    // Send the message
-    ssize_t sent_bytes = sendto(sockfd, message, strlen(message), 0,
-                                (struct sockaddr *)&server_addr, sizeof(server_addr));
-    if (sent_bytes < 0)
+    // The network task sends it, batched with any others waiting
+    if (!net_send_status(message, strlen(message)))
     {
-        perror("Failed to send message");
+        s_status_missed = true;
     }
-
-    // Close the socket
-    close(sockfd);
 }
 
 // UART configuration parameters
 #define UART_NUM UART_NUM_0 // Using UART0
 #define BUF_SIZE (1024)     // UART buffer size
 
-void init_uart()
+void init_uart(const collar_config_t *cfg)
 {
+    // A configured baud turns UART0 into the binary telemetry stream instead of the console
+    if (uart_stream_init(cfg->uart_baud, TASK_UART_PRIO, TASK_UART_CORE, TASK_UART_STACK))
+    {
+        return;
+    }
+
     // Install UART driver, using the default UART0
     uart_driver_install(UART_NUM, BUF_SIZE, BUF_SIZE, 0, NULL, 0);
 
@@ -398,19 +401,19 @@ void init_uart()
     esp_vfs_dev_uart_use_driver(UART_NUM);
 }
 
-CatState getCatState(float roll, float pitch, float x, float z, float y)
+CatState getCatState(const collar_config_t *cfg, float roll, float pitch, float x, float z, float y)
 {
     // CAT_SLEEP: if roll is significant and Z is close to -1 (cat on its back)
-    if (fabs(z) < 11 && fabs(y) < 2.0 && fabs(x) < 2.0)
+    if (fabs(z) < cfg->sleep_z_max && fabs(y) < cfg->still_xy_max && fabs(x) < cfg->still_xy_max)
     {
         return CAT_SLEEP;
     }
     // CAT_WANDER: if X-axis acceleration is greater than 1 (cat is moving)
-    else if ((fabs(x) > 2.0 || fabs(y) > 2.0) && fabs(pitch) < 70)
+    else if ((fabs(x) > cfg->wander_xy_min || fabs(y) > cfg->wander_xy_min) && fabs(pitch) < cfg->moonwalk_pitch_deg)
     {
         return CAT_WANDER;
     }
-    else if (fabs(pitch) >= 70)
+    else if (fabs(pitch) >= cfg->moonwalk_pitch_deg)
     {
         return CAT_SPEED_MOONWALK;
     }
@@ -418,7 +421,7 @@ CatState getCatState(float roll, float pitch, float x, float z, float y)
 }
 
 // Function to track time and cat state, and print them on the same line
-void trackStateTime(CatState currentState)
+void trackStateTime(CatState currentState, int64_t window_start_us, int64_t sample_us)
 {
     if (currentState != current_cat_state)
     {
@@ -426,7 +429,7 @@ void trackStateTime(CatState currentState)
         xSemaphoreTake(data_mutex, portMAX_DELAY);
         CatState prev_state = current_cat_state;
         current_cat_state = currentState;
-        print_status(); // Print time and cat state on the same line
+        print_status(window_start_us, sample_us); // Print time and cat state on the same line
         if (prev_state != current_cat_state)
         {
             reset_time = esp_timer_get_time();
@@ -437,40 +440,14 @@ void trackStateTime(CatState currentState)
 
 // Button Logic
 
-// Global variable to track the display mode
-int display_mode = 0; // Start with mode 1 by default
-
-void task_button_presses(void *pvParameters)
-{
-    int lastButtonState = 1; // Previous state of the button
-
-    while (1)
-    {
-        // Read the current button state
-        int currentState = gpio_get_level(BUTTON_GPIO);
-
-        // Detect if the button is pressed (transition from HIGH to LOW)
-        if (currentState == 0 && lastButtonState == 1)
-        {
-
-            // Cycle through display modes (1, 2, 3)
-            display_mode = (display_mode + 1) % 3;
-        }
-
-        // Update last button state for debounce handling
-        lastButtonState = currentState;
-
-        vTaskDelay(10 / portTICK_PERIOD_MS); // Small delay to avoid bouncing
-    }
-}
+// Button events (see button.c): short press cycles display modes, double click
+// returns to the home screen, long press captures and uplinks the current state now
+static QueueHandle_t display_button_queue;
+static QueueHandle_t capture_button_queue;
 
 // Function to initiate i2c -- note the MSB declaration!
 static void i2c_master_init()
 {
-    // Debug
-
-    printf("\n>> i2c Config\n");
-
     int err;
 
     // Port configuration
@@ -487,7 +464,7 @@ static void i2c_master_init()
     err = i2c_param_config(i2c_master_port, &conf);     // Configure
     if (err == ESP_OK)
     {
-        printf("- parameters: ok\n");
+        DLOGI(APP, "i2c parameters: ok");
     }
 
     // Install I2C driver
@@ -496,7 +473,7 @@ static void i2c_master_init()
                              I2C_EXAMPLE_MASTER_TX_BUF_DISABLE, 0);
     if (err == ESP_OK)
     {
-        printf("- initialized: yes\n");
+        DLOGI(APP, "i2c initialized: yes");
     }
 
     // Data in MSB mode
@@ -505,41 +482,30 @@ static void i2c_master_init()
 
 // Utility  Functions //////////////////////////////////////////////////////////
 
-// Utility function to test for I2C device address -- not used in deploy
+// The driver's device helpers build their command link in a buffer on the
+// caller's stack, so register accesses and display frames never touch the heap
+static esp_err_t i2c_write(uint8_t addr, const uint8_t *data, size_t len)
+{
+    return i2c_master_write_to_device(I2C_EXAMPLE_MASTER_NUM, addr, data, len, I2C_TIMEOUT_TICKS);
+}
+
+static esp_err_t i2c_read_reg(uint8_t addr, uint8_t reg, uint8_t *data)
+{
+    return i2c_master_write_read_device(I2C_EXAMPLE_MASTER_NUM, addr, &reg, 1, data, 1, I2C_TIMEOUT_TICKS);
+}
+
+// Utility function to test for I2C device address (timeout in ms)
 int testConnection(uint8_t devAddr, int32_t timeout)
 {
     i2c_cmd_handle_t cmd = i2c_cmd_link_create();
     i2c_master_start(cmd);
     i2c_master_write_byte(cmd, (devAddr << 1) | I2C_MASTER_WRITE, ACK_CHECK_EN);
     i2c_master_stop(cmd);
-    int err = i2c_master_cmd_begin(I2C_EXAMPLE_MASTER_NUM, cmd, 1000 / portTICK_PERIOD_MS);
+    int err = i2c_master_cmd_begin(I2C_EXAMPLE_MASTER_NUM, cmd, MAX(pdMS_TO_TICKS(timeout), 1));
     i2c_cmd_link_delete(cmd);
     return err;
 }
 
-// Utility function to scan for i2c device
-static void i2c_scanner()
-{
-    int32_t scanTimeout = 1000;
-    printf("\n>> I2C scanning ..."
-           "\n");
-    uint8_t count = 0;
-    for (uint8_t i = 1; i < 127; i++)
-    {
-        // printf("0x%X%s",i,"\n");
-        if (testConnection(i, scanTimeout) == ESP_OK)
-        {
-            printf("- Device found at address: 0x%X%s", i, "\n");
-            count++;
-        }
-    }
-    if (count == 0)
-    {
-        printf("- No I2C devices found!"
-               "\n");
-    }
-}
-
 ////////////////////////////////////////////////////////////////////////////////
 
 // Display Functions ///////////////////////////////////////////////////////////
@@ -662,77 +628,67 @@ uint16_t encode_character(char c)
 // Turn on oscillator for alpha display
 int alpha_oscillator()
 {
-    int ret;
-    i2c_cmd_handle_t cmd = i2c_cmd_link_create();
-    i2c_master_start(cmd);
-    i2c_master_write_byte(cmd, (SLAVE_DISPLAY << 1) | WRITE_BIT, ACK_CHECK_EN);
-    i2c_master_write_byte(cmd, OSC, ACK_CHECK_EN);
-    i2c_master_stop(cmd);
-    ret = i2c_master_cmd_begin(I2C_EXAMPLE_MASTER_NUM, cmd, 1000 / portTICK_PERIOD_MS);
-    i2c_cmd_link_delete(cmd);
-    vTaskDelay(200 / portTICK_PERIOD_MS);
-    return ret;
+    const uint8_t cmd = OSC;
+    return i2c_write(SLAVE_DISPLAY, &cmd, 1);
 }
 
 // Set blink rate to off
 int no_blink()
 {
-    int ret;
-    i2c_cmd_handle_t cmd2 = i2c_cmd_link_create();
-    i2c_master_start(cmd2);
-    i2c_master_write_byte(cmd2, (SLAVE_DISPLAY << 1) | WRITE_BIT, ACK_CHECK_EN);
-    i2c_master_write_byte(cmd2, HT16K33_BLINK_CMD | HT16K33_BLINK_DISPLAYON | (HT16K33_BLINK_OFF << 1), ACK_CHECK_EN);
-    i2c_master_stop(cmd2);
-    ret = i2c_master_cmd_begin(I2C_EXAMPLE_MASTER_NUM, cmd2, 1000 / portTICK_PERIOD_MS);
-    i2c_cmd_link_delete(cmd2);
-    vTaskDelay(200 / portTICK_PERIOD_MS);
-    return ret;
+    const uint8_t cmd = HT16K33_BLINK_CMD | HT16K33_BLINK_DISPLAYON | (HT16K33_BLINK_OFF << 1);
+    return i2c_write(SLAVE_DISPLAY, &cmd, 1);
 }
 
 // Set Brightness
 int set_brightness_max(uint8_t val)
 {
-    int ret;
-    i2c_cmd_handle_t cmd3 = i2c_cmd_link_create();
-    i2c_master_start(cmd3);
-    i2c_master_write_byte(cmd3, (SLAVE_DISPLAY << 1) | WRITE_BIT, ACK_CHECK_EN);
-    i2c_master_write_byte(cmd3, HT16K33_CMD_BRIGHTNESS | val, ACK_CHECK_EN);
-    i2c_master_stop(cmd3);
-    ret = i2c_master_cmd_begin(I2C_EXAMPLE_MASTER_NUM, cmd3, 1000 / portTICK_PERIOD_MS);
-    i2c_cmd_link_delete(cmd3);
-    vTaskDelay(200 / portTICK_PERIOD_MS);
-    return ret;
+    const uint8_t cmd = HT16K33_CMD_BRIGHTNESS | val;
+    return i2c_write(SLAVE_DISPLAY, &cmd, 1);
 }
-void test_alpha_display(void *arg)
+// Write the four characters to display RAM from address 0
+static int display_write(const uint16_t *displaybuffer)
 {
-    // Debug
-    int ret;
-    printf(">> Test Alphanumeric Display: \n");
+    uint8_t frame[1 + 2 * VISIBLE_CHARACTERS] = {0x00};
+    for (int i = 0; i < VISIBLE_CHARACTERS; i++)
+    {
+        frame[1 + 2 * i] = displaybuffer[i] & 0xFF;
+        frame[2 + 2 * i] = displaybuffer[i] >> 8;
+    }
+    return i2c_write(SLAVE_DISPLAY, frame, sizeof(frame));
+}
 
-    // Set up routines
-    ret = alpha_oscillator(); // Turn on alpha oscillator
-    if (ret == ESP_OK)
+// Set up routines, run at boot; the HT16K33 takes each command at once, so there is nothing to wait for
+static bool display_init(void)
+{
+    if (alpha_oscillator() != ESP_OK) // Turn on alpha oscillator
     {
-        printf("- oscillator: ok \n");
+        return false;
     }
-    ret = no_blink(); // Set display blink off
-    if (ret == ESP_OK)
+    DLOGI(APP, "Display oscillator: ok");
+    if (no_blink() == ESP_OK) // Set display blink off
     {
-        printf("- blink: off \n");
+        DLOGI(APP, "Display blink: off");
     }
-    ret = set_brightness_max(0xF); // Set brightness to max
-    if (ret == ESP_OK)
+    if (set_brightness_max(0xF) == ESP_OK) // Set brightness to max
     {
-        printf("- brightness: max \n");
+        DLOGI(APP, "Display brightness: max");
     }
+    return true;
+}
 
+void test_alpha_display(void *arg)
+{
     uint16_t displaybuffer[VISIBLE_CHARACTERS];
 
     // Declare the message buffer here so it's available throughout the function
     char message[MAX_MESSAGE_LENGTH + 1]; // Buffer to store the message
+    collar_config_t cfg;
+    int display_mode = 0; // Owned by this task, changed only through button events
 
     while (1)
     {
+        config_get(&cfg);
+
         // Prepare the message based on the current display mode
         if (display_mode == 0)
         {
@@ -741,8 +697,9 @@ void test_alpha_display(void *arg)
         else if (display_mode == 1)
         {
             // Use current sensor data to set the message
-            CatState currentState = getCatState(roll, pitch, x, z, y); // Ensure you update roll, pitch, x, y, z in your main task
-            trackStateTime(currentState);
+            CatState currentState = getCatState(&cfg, roll, pitch, x, z, y); // Ensure you update roll, pitch, x, y, z in your main task
+            int64_t now_us = esp_timer_get_time();
+            trackStateTime(currentState, now_us, now_us);
             if (currentState == CAT_SLEEP)
             {
                 snprintf(message, MAX_MESSAGE_LENGTH + 1, "Sleepy Time");
@@ -766,6 +723,19 @@ void test_alpha_display(void *arg)
             // Format the message to show the elapsed time
             snprintf(message, MAX_MESSAGE_LENGTH + 1, "%d.%01d", (int)elapsedTimeSeconds, (int)((elapsedTimeSeconds - (int)elapsedTimeSeconds) * 10));
         }
+        else if (display_mode == 3)
+        {
+            // Latest filtered temperature, e.g. "81F"
+            float temperature = temperature_get_f();
+            if (isnan(temperature))
+            {
+                snprintf(message, MAX_MESSAGE_LENGTH + 1, "--F");
+            }
+            else
+            {
+                snprintf(message, MAX_MESSAGE_LENGTH + 1, "%dF", (int)lroundf(temperature));
+            }
+        }
 
         // Ensure the message is null-terminated
         message[MAX_MESSAGE_LENGTH] = '\0';
@@ -776,7 +746,7 @@ void test_alpha_display(void *arg)
         {
             message_length = MAX_MESSAGE_LENGTH;
             message[MAX_MESSAGE_LENGTH] = '\0'; // Truncate the message if needed
-            printf("Message truncated to 16 characters.\n");
+            DLOGW(APP, "Message truncated to 16 characters.");
         }
 
         if (message_length <= SCROLL_THRESHOLD)
@@ -790,18 +760,7 @@ void test_alpha_display(void *arg)
             }
 
             // Send characters to display over I2C
-            i2c_cmd_handle_t cmd4 = i2c_cmd_link_create();
-            i2c_master_start(cmd4);
-            i2c_master_write_byte(cmd4, (SLAVE_DISPLAY << 1) | WRITE_BIT, ACK_CHECK_EN);
-            i2c_master_write_byte(cmd4, (uint8_t)0x00, ACK_CHECK_EN);
-            for (uint8_t i = 0; i < VISIBLE_CHARACTERS; i++)
-            {
-                i2c_master_write_byte(cmd4, displaybuffer[i] & 0xFF, ACK_CHECK_EN);
-                i2c_master_write_byte(cmd4, displaybuffer[i] >> 8, ACK_CHECK_EN);
-            }
-            i2c_master_stop(cmd4);
-            ret = i2c_master_cmd_begin(I2C_EXAMPLE_MASTER_NUM, cmd4, 1000 / portTICK_PERIOD_MS);
-            i2c_cmd_link_delete(cmd4);
+            display_write(displaybuffer);
         }
         else
         {
@@ -834,41 +793,31 @@ void test_alpha_display(void *arg)
                 }
 
                 // Send characters to display over I2C
-                i2c_cmd_handle_t cmd4 = i2c_cmd_link_create();
-                i2c_master_start(cmd4);
-                i2c_master_write_byte(cmd4, (SLAVE_DISPLAY << 1) | WRITE_BIT, ACK_CHECK_EN);
-                i2c_master_write_byte(cmd4, (uint8_t)0x00, ACK_CHECK_EN);
-                for (uint8_t i = 0; i < VISIBLE_CHARACTERS; i++)
-                {
-                    i2c_master_write_byte(cmd4, displaybuffer[i] & 0xFF, ACK_CHECK_EN);
-                    i2c_master_write_byte(cmd4, displaybuffer[i] >> 8, ACK_CHECK_EN);
-                }
-                i2c_master_stop(cmd4);
-                ret = i2c_master_cmd_begin(I2C_EXAMPLE_MASTER_NUM, cmd4, 1000 / portTICK_PERIOD_MS);
-                i2c_cmd_link_delete(cmd4);
+                display_write(displaybuffer);
 
-                vTaskDelay(pdMS_TO_TICKS(300));
+                vTaskDelay(pdMS_TO_TICKS(cfg.scroll_step_ms));
                 offset++;
             }
 
             // Clear the display after scrolling
             memset(displaybuffer, 0x0000, sizeof(displaybuffer));
-            i2c_cmd_handle_t cmd_clear = i2c_cmd_link_create();
-            i2c_master_start(cmd_clear);
-            i2c_master_write_byte(cmd_clear, (SLAVE_DISPLAY << 1) | WRITE_BIT, ACK_CHECK_EN);
-            i2c_master_write_byte(cmd_clear, (uint8_t)0x00, ACK_CHECK_EN);
-            for (uint8_t i = 0; i < VISIBLE_CHARACTERS; i++)
+            display_write(displaybuffer);
+        }
+
+        // Wait before refreshing again, but switch modes as soon as the button is pressed
+        button_event_t event;
+        if (xQueueReceive(display_button_queue, &event, pdMS_TO_TICKS(cfg.display_refresh_ms)) == pdTRUE)
+        {
+            if (event == BUTTON_EVENT_SHORT_PRESS)
+            {
+                // Cycle through display modes 0-3: "Cats", activity state, timer, temperature
+                display_mode = (display_mode + 1) % 4;
+            }
+            else if (event == BUTTON_EVENT_DOUBLE_CLICK)
             {
-                i2c_master_write_byte(cmd_clear, displaybuffer[i] & 0xFF, ACK_CHECK_EN);
-                i2c_master_write_byte(cmd_clear, displaybuffer[i] >> 8, ACK_CHECK_EN);
+                display_mode = 0;
             }
-            i2c_master_stop(cmd_clear);
-            ret = i2c_master_cmd_begin(I2C_EXAMPLE_MASTER_NUM, cmd_clear, 1000 / portTICK_PERIOD_MS);
-            i2c_cmd_link_delete(cmd_clear);
         }
-
-        // Add delay before checking the display mode again
-        vTaskDelay(100 / portTICK_PERIOD_MS);
     }
 }
 
@@ -877,49 +826,22 @@ void test_alpha_display(void *arg)
 // Get Device ID
 int getDeviceID(uint8_t *data)
 {
-    int ret;
-    i2c_cmd_handle_t cmd = i2c_cmd_link_create();
-    i2c_master_start(cmd);
-    i2c_master_write_byte(cmd, (SLAVE_ADXL << 1) | WRITE_BIT, ACK_CHECK_EN);
-    i2c_master_write_byte(cmd, ADXL343_REG_DEVID, ACK_CHECK_EN);
-    i2c_master_start(cmd);
-    i2c_master_write_byte(cmd, (SLAVE_ADXL << 1) | READ_BIT, ACK_CHECK_EN);
-    i2c_master_read_byte(cmd, data, ACK_CHECK_DIS);
-    i2c_master_stop(cmd);
-    ret = i2c_master_cmd_begin(I2C_EXAMPLE_MASTER_NUM, cmd, 1000 / portTICK_PERIOD_MS);
-    i2c_cmd_link_delete(cmd);
-    return ret;
+    return i2c_read_reg(SLAVE_ADXL, ADXL343_REG_DEVID, data);
 }
 
 // Write one byte to register
 int writeRegister(uint8_t reg, uint8_t data)
 {
-    i2c_cmd_handle_t cmd = i2c_cmd_link_create();
-    i2c_master_start(cmd);
-    i2c_master_write_byte(cmd, (SLAVE_ADXL << 1) | I2C_MASTER_WRITE, ACK_CHECK_EN); // Device address + Write
-    i2c_master_write_byte(cmd, reg, ACK_CHECK_EN);                                  // Register address
-    i2c_master_write_byte(cmd, data, ACK_CHECK_EN);                                 // Data to write
-    i2c_master_stop(cmd);
-    int ret = i2c_master_cmd_begin(I2C_EXAMPLE_MASTER_NUM, cmd, 1000 / portTICK_PERIOD_MS); // Execute
-    i2c_cmd_link_delete(cmd);
-    return ret; // Return result
+    const uint8_t bytes[2] = {reg, data}; // Register address, then the data to write
+    return i2c_write(SLAVE_ADXL, bytes, sizeof(bytes));
 }
 
 // Read register
 uint8_t readRegister(uint8_t reg)
 {
-    uint8_t data;
-    i2c_cmd_handle_t cmd = i2c_cmd_link_create();
-    i2c_master_start(cmd);
-    i2c_master_write_byte(cmd, (SLAVE_ADXL << 1) | I2C_MASTER_WRITE, ACK_CHECK_EN); // Write device address
-    i2c_master_write_byte(cmd, reg, ACK_CHECK_EN);                                  // Send register address
-    i2c_master_start(cmd);                                                          // Repeat start
-    i2c_master_write_byte(cmd, (SLAVE_ADXL << 1) | I2C_MASTER_READ, ACK_CHECK_EN);  // Device address + read
-    i2c_master_read_byte(cmd, &data, I2C_MASTER_NACK);                              // Read data
-    i2c_master_stop(cmd);
-    i2c_master_cmd_begin(I2C_EXAMPLE_MASTER_NUM, cmd, 1000 / portTICK_PERIOD_MS); // Execute command
-    i2c_cmd_link_delete(cmd);
-    return data; // Return the byte read
+    uint8_t data = 0;
+    i2c_read_reg(SLAVE_ADXL, reg, &data); // Register address, repeated start, one byte back
+    return data;
 }
 
 // read 16 bits (2 bytes)
@@ -972,77 +894,17 @@ void set_cat_leader_status(bool is_currently_leader)
     xSemaphoreGive(data_mutex);
 }
 
-// Task to listen for leader notifications
-void network_listener_task(void *pvParameters)
-{
-    // Create a UDP socket
-    int sockfd = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
-    if (sockfd < 0)
-    {
-        ESP_LOGE(TAG, "Failed to create socket");
-        vTaskDelete(NULL);
-        return;
-    }
-
-    // Bind the socket to the specified port
-    struct sockaddr_in local_addr = {
-        .sin_family = AF_INET,
-        .sin_port = htons(PORT),
-        .sin_addr.s_addr = htonl(INADDR_ANY),
-    };
-
-    if (bind(sockfd, (struct sockaddr *)&local_addr, sizeof(local_addr)) < 0)
-    {
-        ESP_LOGE(TAG, "Socket unable to bind: errno %d", errno);
-        close(sockfd);
-        vTaskDelete(NULL);
-        return;
-    }
-
-    ESP_LOGI(TAG, "Listening for leader notifications on port %d", PORT);
-
-    char rx_buffer[128];
-
-    while (1)
-    {
-        // Listen for messages (this is just an example, adjust to your needs)
-        struct sockaddr_in source_addr;
-        socklen_t socklen = sizeof(source_addr);
-        int len = recvfrom(sockfd, rx_buffer, sizeof(rx_buffer) - 1, 0, (struct sockaddr *)&source_addr, &socklen);
-
-        if (len > 0)
-        {
-            rx_buffer[len] = '\0'; // Null-terminate received data
-            ESP_LOGI(TAG, "Received message: %s", rx_buffer);
-
-            // Assuming the received message is the new leader ID
-            char received_leader_id[MAX_LEADER_ID_LEN];
-            strncpy(received_leader_id, rx_buffer, MAX_LEADER_ID_LEN - 1);
-            received_leader_id[MAX_LEADER_ID_LEN - 1] = '\0'; // Ensure null-terminated
-
-            // Call buzz function with all parameters
-            buzz(isBuzzing, received_leader_id);
-        }
-        else
-        {
-            ESP_LOGE(TAG, "Error receiving data");
-        }
-
-        vTaskDelay(100 / portTICK_PERIOD_MS); // Adjust delay as needed
-    }
-
-    close(sockfd);
-    vTaskDelete(NULL);
-}
-
 ////////////////////////////////////////////////////////////////////////////////
 
-// function to get acceleration
-void getAccel(float *xp, float *yp, float *zp)
+// function to get acceleration (raw keeps the ADXL343 counts for the UART stream)
+void getAccel(int16_t raw[3], float *xp, float *yp, float *zp)
 {
-    *xp = read16(ADXL343_REG_DATAX0) * ADXL343_MG2G_MULTIPLIER * SENSORS_GRAVITY_STANDARD;
-    *yp = read16(ADXL343_REG_DATAY0) * ADXL343_MG2G_MULTIPLIER * SENSORS_GRAVITY_STANDARD;
-    *zp = read16(ADXL343_REG_DATAZ0) * ADXL343_MG2G_MULTIPLIER * SENSORS_GRAVITY_STANDARD;
+    raw[0] = read16(ADXL343_REG_DATAX0);
+    raw[1] = read16(ADXL343_REG_DATAY0);
+    raw[2] = read16(ADXL343_REG_DATAZ0);
+    *xp = raw[0] * ADXL343_MG2G_MULTIPLIER * SENSORS_GRAVITY_STANDARD;
+    *yp = raw[1] * ADXL343_MG2G_MULTIPLIER * SENSORS_GRAVITY_STANDARD;
+    *zp = raw[2] * ADXL343_MG2G_MULTIPLIER * SENSORS_GRAVITY_STANDARD;
     // printf("X: %.2f \t Y: %.2f \t Z: %.2f\n", *xp, *yp, *zp);
 }
 
@@ -1050,18 +912,30 @@ void getAccel(float *xp, float *yp, float *zp)
 // Task to continuously poll acceleration and calculate roll and pitch
 static void test_adxl343()
 {
-    printf("\n>> Polling ADXL343\n");
+    DLOGI(APP, "Polling ADXL343");
+    collar_config_t cfg;
+    TickType_t last_wake = xTaskGetTickCount();
     while (1)
     {
+        // Pick up pushed sampling parameters at window boundaries
+        config_get(&cfg);
+
         // Get acceleration data and calculate roll and pitch as before
         float xSum = 0, ySum = 0, zSum = 0;
         int numSamples = 0;
 
-        // Collect data for 2 seconds (4 samples with 500ms delay)
-        for (int i = 0; i < 4; i++)
+        // Collect data for one window (default 4 samples with 500ms delay = 2 seconds)
+        int64_t window_start_us = esp_timer_get_time();
+        for (uint32_t i = 0; i < cfg.samples_per_window; i++)
         {
+            int16_t raw[3];
             float xVal, yVal, zVal;
-            getAccel(&xVal, &yVal, &zVal);
+            getAccel(raw, &xVal, &yVal, &zVal);
+            boot_mark(BOOT_MARK_FIRST_SAMPLE);
+            uart_stream_sample(raw, esp_timer_get_time(), cfg.sample_period_ms * 1000);
+
+            // Temperature rides on the same sample schedule (oversampled and decimated per window)
+            temperature_sample(&cfg);
 
             // Accumulate readings
             xSum += xVal;
@@ -1069,10 +943,14 @@ static void test_adxl343()
             zSum += zVal;
             numSamples++;
 
-            // Delay for 500ms before the next reading
-            vTaskDelay(500 / portTICK_PERIOD_MS);
+            // Wait for the next sample slot; unlike a plain delay this doesn't drift by the I2C time
+            vTaskDelayUntil(&last_wake, pdMS_TO_TICKS(cfg.sample_period_ms));
+            task_plan_record_sample(cfg.sample_period_ms);
         }
 
+        // The window's state is stamped at its last sample
+        int64_t window_end_us = esp_timer_get_time();
+
         // Calculate average values
         x = xSum / numSamples;
         y = ySum / numSamples;
@@ -1083,33 +961,103 @@ static void test_adxl343()
         pitch = atan2(-x, sqrt(y * y + z * z)) * 57.3;
         // printf("z: %f \t roll: %.2f \t pitch: %.2f \n", z, roll, pitch);
         // Determine the cat state and update the shared state
-        CatState currentState = getCatState(roll, pitch, x, z, y);
-        trackStateTime(currentState);
+        CatState currentState = getCatState(&cfg, roll, pitch, x, z, y);
+        trackStateTime(currentState, window_start_us, window_end_us);
+
+        // Long press: send the current state right away instead of waiting for a change
+        button_event_t event;
+        while (xQueueReceive(capture_button_queue, &event, 0) == pdTRUE)
+        {
+            if (event == BUTTON_EVENT_LONG_PRESS)
+            {
+                xSemaphoreTake(data_mutex, portMAX_DELAY);
+                int64_t now_us = esp_timer_get_time();
+                print_status(now_us, now_us);
+                xSemaphoreGive(data_mutex);
+            }
+        }
     }
 }
 
-void app_main()
+// Check for ADXL343, then set it measuring
+static bool adxl343_init(void)
 {
-    // Initialize the mutex
-    data_mutex = xSemaphoreCreateMutex();
+    uint8_t deviceID = 0;
+    if (getDeviceID(&deviceID) != ESP_OK || deviceID != 0xE5)
+    {
+        return false;
+    }
+    DLOGI(APP, "Found ADXL343");
 
-    // Routine
-    i2c_master_init();
-    i2c_scanner();
+    // Disable interrupts
+    writeRegister(ADXL343_REG_INT_ENABLE, 0);
 
-    // Initialize UART
-    init_uart();
+    // Enable measurements
+    writeRegister(ADXL343_REG_POWER_CTL, 0x08);
+    return true;
+}
 
-    // Set up the button GPIO
-    gpio_reset_pin(BUTTON_GPIO);
-    gpio_set_direction(BUTTON_GPIO, GPIO_MODE_INPUT);
+// Each device's setup starts with a transfer to it, so it doubles as the probe
+static const struct
+{
+    uint8_t bit;
+    uint8_t address;
+    const char *name;
+    bool (*init)(void);
+} s_i2c_devices[] = {
+    {I2C_DEVICE_ADXL, SLAVE_ADXL, "ADXL343", adxl343_init},
+    {I2C_DEVICE_DISPLAY, SLAVE_DISPLAY, "display", display_init},
+};
 
-    // Initialize the buzzer GPIO
-    gpio_reset_pin(BUZZER_GPIO);
-    gpio_set_direction(BUZZER_GPIO, GPIO_MODE_OUTPUT);
-    gpio_set_level(BUZZER_GPIO, 0); // Ensure the buzzer is off initially
+// Bring up the devices the boot cache (boot.h) expects; returns those that answered. A device missing
+// last boot is left out and put in *skipped, so a bus with nothing on it cannot hold up sampling.
+static uint8_t i2c_devices_init(uint8_t cached, uint8_t *skipped)
+{
+    uint8_t found = 0;
+    *skipped = 0;
+    for (size_t i = 0; i < sizeof(s_i2c_devices) / sizeof(s_i2c_devices[0]); i++)
+    {
+        if (cached != BOOT_DEVICES_UNKNOWN && !(cached & s_i2c_devices[i].bit))
+        {
+            *skipped |= s_i2c_devices[i].bit;
+            continue;
+        }
+        if (cached == BOOT_DEVICES_UNKNOWN && testConnection(s_i2c_devices[i].address, BOOT_PROBE_TIMEOUT_MS) != ESP_OK)
+        {
+            continue;
+        }
+        if (s_i2c_devices[i].init())
+        {
+            found |= s_i2c_devices[i].bit;
+        }
+    }
+    return found;
+}
 
-    // Connect to network
+// Give the devices skipped at boot one full-length probe, once nothing is waiting on them
+static uint8_t i2c_devices_retry(uint8_t skipped)
+{
+    uint8_t found = 0;
+    for (size_t i = 0; i < sizeof(s_i2c_devices) / sizeof(s_i2c_devices[0]); i++)
+    {
+        if ((skipped & s_i2c_devices[i].bit) && testConnection(s_i2c_devices[i].address, 1000) == ESP_OK &&
+            s_i2c_devices[i].init())
+        {
+            DLOGI(APP, "I2C device found at address: 0x%X (%s)", s_i2c_devices[i].address, s_i2c_devices[i].name);
+            found |= s_i2c_devices[i].bit;
+        }
+    }
+    return found;
+}
+
+// Sensors first, so sampling starts within milliseconds of power-up; then the network, which can take
+// seconds (or never come) and runs here in the main task while the acquisition task samples
+void app_main()
+{
+    // Initialize the mutex
+    data_mutex = xSemaphoreCreateMutexStatic(&data_mutex_buf);
+
+    // Tuning and the device cache live in NVS
     esp_err_t ret = nvs_flash_init();
     if (ret == ESP_ERR_NVS_NO_FREE_PAGES || ret == ESP_ERR_NVS_NEW_VERSION_FOUND)
     {
@@ -1118,35 +1066,101 @@ void app_main()
     }
     ESP_ERROR_CHECK(ret);
 
-    ESP_LOGI(TAG, "ESP_WIFI_MODE_STA");
-    wifi_init_sta(); // Initialize Wi-Fi
+    // Load tuning and network settings persisted by earlier config pushes
+    config_init();
+    collar_config_t boot_cfg;
+    config_get(&boot_cfg);
+
+    // Initialize UART (after the config, which picks console or binary stream)
+    init_uart(&boot_cfg);
 
-    // Check for ADXL343
-    uint8_t deviceID;
-    getDeviceID(&deviceID);
-    if (deviceID == 0xE5)
+    // Deferred log drain, created after the UART so it writes to whichever console that set up;
+    // what was logged before now waits in the rings
+    dlog_init(TASK_DLOG_PRIO, TASK_DLOG_CORE, TASK_DLOG_STACK);
+
+    // Routine: the accelerometer and display, as the last boot found them
+    i2c_master_init();
+    uint8_t i2c_cached = boot_devices_load();
+    uint8_t i2c_skipped;
+    uint8_t i2c_found = i2c_devices_init(i2c_cached, &i2c_skipped);
+    if (i2c_found == 0 && i2c_skipped == 0)
     {
-        printf("\n>> Found ADAXL343\n");
+        DLOGW(APP, "No I2C devices found!");
     }
 
-    // Disable interrupts
-    writeRegister(ADXL343_REG_INT_ENABLE, 0);
+    // Initialize the buzzer GPIO
+    gpio_reset_pin(BUZZER_GPIO);
+    gpio_set_direction(BUZZER_GPIO, GPIO_MODE_OUTPUT);
+    gpio_set_level(BUZZER_GPIO, 0); // Ensure the buzzer is off initially
+    const esp_timer_create_args_t buzz_timer_args = {.callback = buzz_off_cb, .name = "buzz"};
+    esp_timer_create(&buzz_timer_args, &s_buzz_timer);
 
-    // Enable measurements
-    writeRegister(ADXL343_REG_POWER_CTL, 0x08);
+    // Thermistor on ADC1, sampled from the accelerometer task
+    temperature_init();
 
-    // Create task to poll ADXL343 (accelerometer)
-    xTaskCreate(test_adxl343, "test_adxl343", 4096, NULL, 5, NULL);
+    // Differs between boots; mixed with the radio's entropy once it is on
+    s_trace_id = esp_random();
 
-    // Create task for handling button presses (to switch display modes)
-    xTaskCreate(task_button_presses, "task_button_presses", 2048, NULL, 5, NULL);
+    // Create task to poll ADXL343 (accelerometer) and classify, alone on APP_CPU
+    task_plan_create(test_adxl343, "test_adxl343", TASK_ACQUISITION_STACK, NULL,
+                     TASK_ACQUISITION_PRIO, TASK_ACQUISITION_CORE, NULL);
+
+    // Button interrupt and input task (to switch display modes and trigger captures)
+    display_button_queue = button_subscribe();
+    capture_button_queue = button_subscribe();
+    button_init(BUTTON_GPIO, TASK_BUTTON_PRIO, TASK_BUTTON_CORE, TASK_BUTTON_STACK);
 
     // Create task for alphanumeric display
-    xTaskCreate(test_alpha_display, "test_alpha_display", 4096, NULL, 5, NULL);
+    task_plan_create(test_alpha_display, "test_alpha_display", TASK_DISPLAY_STACK, NULL,
+                     TASK_DISPLAY_PRIO, TASK_DISPLAY_CORE, NULL);
+
+    // Stack high-water and jitter reports (compiled out unless enabled in task_plan.h)
+    task_plan_start_diagnostics();
+
+    // Connect to network
+    ESP_LOGI(TAG, "ESP_WIFI_MODE_STA");
+    bool associated = wifi_init_sta(&boot_cfg); // Initialize Wi-Fi
+    if (associated)
+    {
+        boot_mark(BOOT_MARK_NETWORK);
+    }
+
+    // Out of the AP's range (or told to), report through a gateway collar over ESP-NOW instead
+    relay_mode_t relay_role = relay_init(&boot_cfg, associated, handle_leader, TASK_RELAY_PRIO, TASK_RELAY_CORE,
+                                         TASK_RELAY_STACK);
+
+    // Update task, and the rollback timer if this is the first boot of a new image; its replies go out
+    // through the network task, which confirms the image once it reaches the server
+    ota_init(net_send_text, TASK_OTA_PRIO, TASK_OTA_CORE, TASK_OTA_STACK);
+
+    // One task for every socket: leader notifications, status records and, unless this is a relay leaf
+    // (which cannot reach the server), the /buzz WebSocket
+    net_init(&boot_cfg, relay_role != RELAY_MODE_LEAF, handle_leader, TASK_NETWORK_PRIO, TASK_NETWORK_CORE,
+             TASK_NETWORK_STACK);
+
+    // Truly random now that the radio is on; and whatever changed while joining goes out now that it can
+    xSemaphoreTake(data_mutex, portMAX_DELAY);
+    s_trace_id ^= esp_random();
+    if (s_status_missed)
+    {
+        s_status_missed = false;
+        int64_t now_us = esp_timer_get_time();
+        print_status(now_us, now_us);
+    }
+    xSemaphoreGive(data_mutex);
+
+    // A relay leaf gets its leader from the gateway and cannot reach the server for anything else;
+    // the others discipline the clock against the server so telemetry carries source timestamps
+    if (relay_role != RELAY_MODE_LEAF)
+    {
+        timesync_init(net_send_text, TASK_TIMESYNC_PRIO, TASK_TIMESYNC_CORE, TASK_TIMESYNC_STACK);
+    }
 
-    // Create task for network listener for leader status updates
-    xTaskCreate(network_listener_task, "network_listener_task", 4096, NULL, 5, NULL);
+    // Devices missing at boot get their full probe now, and the cache is kept for the next boot
+    i2c_found |= i2c_devices_retry(i2c_skipped);
+    boot_devices_store(i2c_found);
 
-    // Initialize WebSocket connection and start receiving leader updates
-    initialize_websocket_client();
+    // Boot is over once the tasks have done their own setup; from here the collar's tasks never allocate
+    vTaskDelay(pdMS_TO_TICKS(STATIC_ALLOC_SETTLE_MS));
+    static_alloc_seal();
 }
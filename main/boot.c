@@ -0,0 +1,65 @@
+#include <stdatomic.h>
+
+#include "esp_timer.h"
+#include "nvs.h"
+
+#include "./boot.h"
+#include "./dlog.h"
+
+#define BOOT_NVS_NAMESPACE "boot"
+#define BOOT_KEY_DEVICES "i2c"
+
+static const char *const s_mark_names[BOOT_MARKS] = {"first sample", "network", "first uplink"};
+static _Atomic int32_t s_marks_ms[BOOT_MARKS] = {-1, -1, -1};
+static uint8_t s_devices_loaded = BOOT_DEVICES_UNKNOWN;
+
+void boot_mark(boot_mark_t mark)
+{
+    if (atomic_load_explicit(&s_marks_ms[mark], memory_order_relaxed) >= 0)
+    {
+        return;
+    }
+    int32_t unset = -1;
+    int32_t now_ms = (int32_t)(esp_timer_get_time() / 1000);
+    if (atomic_compare_exchange_strong(&s_marks_ms[mark], &unset, now_ms))
+    {
+        DLOGI(APP, "Boot: %s at %d ms", s_mark_names[mark], (int)now_ms);
+    }
+}
+
+int32_t boot_mark_ms(boot_mark_t mark)
+{
+    return atomic_load_explicit(&s_marks_ms[mark], memory_order_relaxed);
+}
+
+uint8_t boot_devices_load(void)
+{
+    nvs_handle_t nvs;
+    if (nvs_open(BOOT_NVS_NAMESPACE, NVS_READONLY, &nvs) == ESP_OK)
+    {
+        if (nvs_get_u8(nvs, BOOT_KEY_DEVICES, &s_devices_loaded) != ESP_OK)
+        {
+            s_devices_loaded = BOOT_DEVICES_UNKNOWN;
+        }
+        nvs_close(nvs);
+    }
+    return s_devices_loaded;
+}
+
+void boot_devices_store(uint8_t mask)
+{
+    if (mask == s_devices_loaded)
+    {
+        return; // Spare the flash
+    }
+    nvs_handle_t nvs;
+    if (nvs_open(BOOT_NVS_NAMESPACE, NVS_READWRITE, &nvs) != ESP_OK)
+    {
+        return;
+    }
+    if (nvs_set_u8(nvs, BOOT_KEY_DEVICES, mask) == ESP_OK && nvs_commit(nvs) == ESP_OK)
+    {
+        s_devices_loaded = mask;
+    }
+    nvs_close(nvs);
+}
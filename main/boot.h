@@ -0,0 +1,54 @@
+/*
+  Boot sequencing support: milestones and the I2C device cache.
+
+  app_main() brings the sensors up first and starts sampling before it joins
+  the access point, so a slow or missing AP no longer holds up measurement.
+  Wi-Fi, the relay, the WebSocket and time sync are set up afterwards in the
+  main task while the acquisition task already runs on APP_CPU.
+
+  Each milestone is stamped once, in milliseconds of esp_timer_get_time()
+  (which starts just before app_main), and logged as it is reached:
+    first_sample  the acquisition task read the accelerometer
+    network       the station got an IP
+    first_uplink  something reached the server: a status datagram was sent,
+                  the WebSocket connected, or a relay leaf's first batch was acked
+  The WebSocket HELLO carries boot_sample= and boot_uplink= so the server can
+  list them per collar (GET /config).
+
+  Only the collar's own I2C devices are probed, and the result is kept in NVS.
+  A device that answered last boot is initialized straight away, without a
+  probe, and its first transfer confirms it. A device that did not is left
+  out of the boot path and probed once more after the network is up. With no
+  cache yet, each device is probed with a short timeout.
+*/
+
+#ifndef BOOT_H
+#define BOOT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef enum
+{
+    BOOT_MARK_FIRST_SAMPLE = 0,
+    BOOT_MARK_NETWORK,
+    BOOT_MARK_FIRST_UPLINK,
+    BOOT_MARKS,
+} boot_mark_t;
+
+#define BOOT_DEVICES_UNKNOWN 0xFF // No cache in NVS yet
+#define BOOT_PROBE_TIMEOUT_MS 10  // Probe of a device the cache knows nothing about
+
+// Stamp a milestone the first time it is reached; later calls return at once
+void boot_mark(boot_mark_t mark);
+
+// Milliseconds from start to the milestone, or -1 if it has not been reached
+int32_t boot_mark_ms(boot_mark_t mark);
+
+// The device bit mask the last boot found, or BOOT_DEVICES_UNKNOWN
+uint8_t boot_devices_load(void);
+
+// Remember which devices answered; NVS is only written when the mask changed
+void boot_devices_store(uint8_t mask);
+
+#endif // BOOT_H
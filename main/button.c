@@ -0,0 +1,106 @@
+#include "esp_log.h"
+#include "freertos/task.h"
+
+#include "./button.h"
+#include "./task_plan.h"
+
+#define BUTTON_EDGE_QUEUE_LEN 16 // Bounces beyond this are dropped; only the settle time matters
+
+static const char *TAG = "button";
+
+static gpio_num_t s_gpio;
+static QueueHandle_t s_edge_queue;
+static StaticQueue_t s_edge_queue_buf;
+static uint8_t s_edge_storage[BUTTON_EDGE_QUEUE_LEN * sizeof(uint32_t)];
+static QueueHandle_t s_subscribers[BUTTON_MAX_SUBSCRIBERS];
+static StaticQueue_t s_subscriber_bufs[BUTTON_MAX_SUBSCRIBERS];
+static uint8_t s_subscriber_storage[BUTTON_MAX_SUBSCRIBERS][BUTTON_SUBSCRIBER_QUEUE_LEN * sizeof(button_event_t)];
+static int s_subscriber_count = 0;
+
+static uint32_t now_ms(void)
+{
+    return xTaskGetTickCount() * portTICK_PERIOD_MS;
+}
+
+static void IRAM_ATTR button_isr(void *arg)
+{
+    uint32_t edge_ms = xTaskGetTickCountFromISR() * portTICK_PERIOD_MS;
+    BaseType_t woken = pdFALSE;
+    xQueueSendFromISR(s_edge_queue, &edge_ms, &woken);
+    portYIELD_FROM_ISR(woken);
+}
+
+static void broadcast(button_event_t event)
+{
+    for (int i = 0; i < s_subscriber_count; i++)
+    {
+        // Never block input handling on a slow consumer
+        if (xQueueSend(s_subscribers[i], &event, 0) != pdTRUE)
+        {
+            ESP_LOGW(TAG, "Subscriber %d full, dropped event %d", i, event);
+        }
+    }
+}
+
+static void button_task(void *arg)
+{
+    button_fsm_t fsm;
+    button_fsm_init(&fsm, 0, gpio_get_level(s_gpio));
+
+    while (1)
+    {
+        int32_t wait_ms = button_fsm_next_deadline(&fsm, now_ms());
+        TickType_t wait = (wait_ms < 0) ? portMAX_DELAY : pdMS_TO_TICKS(wait_ms) + 1;
+
+        uint32_t edge_ms;
+        if (xQueueReceive(s_edge_queue, &edge_ms, wait) == pdTRUE)
+        {
+            button_fsm_edge(&fsm, edge_ms);
+            continue;
+        }
+
+        button_event_t event = button_fsm_update(&fsm, now_ms(), gpio_get_level(s_gpio));
+        if (event != BUTTON_EVENT_NONE)
+        {
+            broadcast(event);
+        }
+    }
+}
+
+QueueHandle_t button_subscribe(void)
+{
+    if (s_subscriber_count >= BUTTON_MAX_SUBSCRIBERS)
+    {
+        ESP_LOGE(TAG, "Too many subscribers");
+        return NULL;
+    }
+    int i = s_subscriber_count++;
+    QueueHandle_t queue = xQueueCreateStatic(BUTTON_SUBSCRIBER_QUEUE_LEN, sizeof(button_event_t), s_subscriber_storage[i],
+                                             &s_subscriber_bufs[i]);
+    s_subscribers[i] = queue;
+    return queue;
+}
+
+void button_init(gpio_num_t gpio, UBaseType_t prio, BaseType_t core, uint32_t stack)
+{
+    s_gpio = gpio;
+    s_edge_queue = xQueueCreateStatic(BUTTON_EDGE_QUEUE_LEN, sizeof(uint32_t), s_edge_storage, &s_edge_queue_buf);
+
+    gpio_config_t io_conf = {
+        .pin_bit_mask = 1ULL << gpio,
+        .mode = GPIO_MODE_INPUT,
+        .pull_up_en = GPIO_PULLUP_ENABLE,
+        .pull_down_en = GPIO_PULLDOWN_DISABLE,
+        .intr_type = GPIO_INTR_ANYEDGE,
+    };
+    ESP_ERROR_CHECK(gpio_config(&io_conf));
+
+    esp_err_t err = gpio_install_isr_service(0);
+    if (err != ESP_OK && err != ESP_ERR_INVALID_STATE) // INVALID_STATE: already installed
+    {
+        ESP_ERROR_CHECK(err);
+    }
+    ESP_ERROR_CHECK(gpio_isr_handler_add(gpio, button_isr, NULL));
+
+    task_plan_create(button_task, "button_task", stack, NULL, prio, core, NULL);
+}
@@ -0,0 +1,28 @@
+/*
+  Interrupt-driven button input.
+
+  The GPIO ISR only timestamps edges into a queue; a task blocked on that queue
+  runs the debounce/gesture logic in button_fsm.c and broadcasts the resulting
+  events to every subscriber queue. With nobody touching the collar the task
+  sleeps on portMAX_DELAY, so idle wakeups are zero and light sleep is not held off.
+*/
+
+#ifndef BUTTON_H
+#define BUTTON_H
+
+#include "driver/gpio.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+
+#include "./button_fsm.h"
+
+#define BUTTON_MAX_SUBSCRIBERS 4
+#define BUTTON_SUBSCRIBER_QUEUE_LEN 4
+
+// Configure the pin (pull-up, active low), install the ISR and start the input task
+void button_init(gpio_num_t gpio, UBaseType_t prio, BaseType_t core, uint32_t stack);
+
+// Create a queue of button_event_t that receives every event; call before button_init()
+QueueHandle_t button_subscribe(void);
+
+#endif // BUTTON_H
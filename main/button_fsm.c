@@ -0,0 +1,127 @@
+#include "./button_fsm.h"
+
+// True once now has reached deadline, robust to 32-bit wraparound
+static int reached(uint32_t now, uint32_t deadline)
+{
+    return (int32_t)(now - deadline) >= 0;
+}
+
+void button_fsm_init(button_fsm_t *fsm, int pressed_level, int current_level)
+{
+    fsm->state = BUTTON_STATE_IDLE;
+    fsm->pressed_level = pressed_level;
+    fsm->stable_level = current_level;
+    fsm->debouncing = 0;
+    fsm->gesture_pending = 0;
+    fsm->debounce_ms = 0;
+    fsm->deadline_ms = 0;
+}
+
+void button_fsm_edge(button_fsm_t *fsm, uint32_t now_ms)
+{
+    // Every bounce pushes the settle time out again
+    fsm->debouncing = 1;
+    fsm->debounce_ms = now_ms + BUTTON_DEBOUNCE_MS;
+}
+
+static void arm(button_fsm_t *fsm, uint32_t deadline_ms)
+{
+    fsm->gesture_pending = 1;
+    fsm->deadline_ms = deadline_ms;
+}
+
+static button_event_t on_press(button_fsm_t *fsm, uint32_t now_ms)
+{
+    switch (fsm->state)
+    {
+    case BUTTON_STATE_IDLE:
+        fsm->state = BUTTON_STATE_PRESSED;
+        arm(fsm, now_ms + BUTTON_LONG_PRESS_MS);
+        break;
+    case BUTTON_STATE_WAIT_SECOND:
+        fsm->state = BUTTON_STATE_SECOND_PRESSED;
+        fsm->gesture_pending = 0;
+        break;
+    default:
+        break;
+    }
+    return BUTTON_EVENT_NONE;
+}
+
+static button_event_t on_release(button_fsm_t *fsm, uint32_t now_ms)
+{
+    switch (fsm->state)
+    {
+    case BUTTON_STATE_PRESSED:
+        fsm->state = BUTTON_STATE_WAIT_SECOND;
+        arm(fsm, now_ms + BUTTON_DOUBLE_CLICK_MS);
+        return BUTTON_EVENT_NONE;
+    case BUTTON_STATE_SECOND_PRESSED:
+        fsm->state = BUTTON_STATE_IDLE;
+        return BUTTON_EVENT_DOUBLE_CLICK;
+    case BUTTON_STATE_LONG_HELD:
+        fsm->state = BUTTON_STATE_IDLE;
+        return BUTTON_EVENT_NONE;
+    default:
+        return BUTTON_EVENT_NONE;
+    }
+}
+
+static button_event_t on_timeout(button_fsm_t *fsm)
+{
+    fsm->gesture_pending = 0;
+    switch (fsm->state)
+    {
+    case BUTTON_STATE_PRESSED:
+        fsm->state = BUTTON_STATE_LONG_HELD;
+        return BUTTON_EVENT_LONG_PRESS;
+    case BUTTON_STATE_WAIT_SECOND:
+        fsm->state = BUTTON_STATE_IDLE;
+        return BUTTON_EVENT_SHORT_PRESS;
+    default:
+        return BUTTON_EVENT_NONE;
+    }
+}
+
+button_event_t button_fsm_update(button_fsm_t *fsm, uint32_t now_ms, int level)
+{
+    if (fsm->debouncing && reached(now_ms, fsm->debounce_ms))
+    {
+        fsm->debouncing = 0;
+        if (level != fsm->stable_level)
+        {
+            fsm->stable_level = level;
+            // Timestamp the transition at the first quiet moment, not at the first bounce
+            uint32_t settled_ms = fsm->debounce_ms;
+            button_event_t event = (level == fsm->pressed_level) ? on_press(fsm, settled_ms)
+                                                                 : on_release(fsm, settled_ms);
+            if (event != BUTTON_EVENT_NONE)
+            {
+                return event;
+            }
+        }
+    }
+
+    if (fsm->gesture_pending && reached(now_ms, fsm->deadline_ms))
+    {
+        return on_timeout(fsm);
+    }
+    return BUTTON_EVENT_NONE;
+}
+
+int32_t button_fsm_next_deadline(const button_fsm_t *fsm, uint32_t now_ms)
+{
+    int32_t wait = -1;
+    if (fsm->debouncing)
+    {
+        int32_t left = (int32_t)(fsm->debounce_ms - now_ms);
+        wait = left > 0 ? left : 0;
+    }
+    if (fsm->gesture_pending)
+    {
+        int32_t left = (int32_t)(fsm->deadline_ms - now_ms);
+        left = left > 0 ? left : 0;
+        wait = (wait < 0 || left < wait) ? left : wait;
+    }
+    return wait;
+}
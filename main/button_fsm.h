@@ -0,0 +1,61 @@
+/*
+  Debounce and gesture recognition for the collar button.
+
+  Pure logic with no ESP-IDF dependencies so it can be exercised on the host.
+  Times are milliseconds from any monotonic clock; wraparound is handled.
+
+  The driver feeds it every raw edge from the GPIO interrupt and calls
+  button_fsm_update() whenever button_fsm_next_deadline() expires, passing the
+  pin level at that moment. A press is only accepted once the pin has been quiet
+  for BUTTON_DEBOUNCE_MS, so contact bounce never reaches the gesture logic.
+*/
+
+#ifndef BUTTON_FSM_H
+#define BUTTON_FSM_H
+
+#include <stdint.h>
+
+#define BUTTON_DEBOUNCE_MS 30     // Pin must be quiet this long before its level counts
+#define BUTTON_LONG_PRESS_MS 800  // Held at least this long is a long press
+#define BUTTON_DOUBLE_CLICK_MS 250 // Second press within this window after release is a double click
+
+typedef enum
+{
+    BUTTON_EVENT_NONE = 0,
+    BUTTON_EVENT_SHORT_PRESS,
+    BUTTON_EVENT_LONG_PRESS,
+    BUTTON_EVENT_DOUBLE_CLICK
+} button_event_t;
+
+typedef enum
+{
+    BUTTON_STATE_IDLE = 0,
+    BUTTON_STATE_PRESSED,     // First press held, long press timer running
+    BUTTON_STATE_LONG_HELD,   // Long press reported, waiting for release
+    BUTTON_STATE_WAIT_SECOND, // Released after a short press, double click window open
+    BUTTON_STATE_SECOND_PRESSED
+} button_state_t;
+
+typedef struct
+{
+    button_state_t state;
+    int pressed_level;       // Pin level while pressed (0 for a pull-up button)
+    int stable_level;        // Last debounced level
+    uint8_t debouncing;      // Raw edge seen, waiting for the pin to settle
+    uint8_t gesture_pending; // deadline_ms is armed
+    uint32_t debounce_ms;    // When the pin counts as settled
+    uint32_t deadline_ms;    // Long press or double click timeout
+} button_fsm_t;
+
+void button_fsm_init(button_fsm_t *fsm, int pressed_level, int current_level);
+
+// A raw edge happened at now_ms (called with timestamps from the ISR)
+void button_fsm_edge(button_fsm_t *fsm, uint32_t now_ms);
+
+// Advance timers and debounced level; returns at most one event
+button_event_t button_fsm_update(button_fsm_t *fsm, uint32_t now_ms, int level);
+
+// Milliseconds until button_fsm_update() is needed, or -1 when fully idle
+int32_t button_fsm_next_deadline(const button_fsm_t *fsm, uint32_t now_ms);
+
+#endif // BUTTON_FSM_H
@@ -0,0 +1,507 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "esp_log.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "nvs.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+#include "./collar_config.h"
+#include "./static_alloc.h"
+
+#define CONFIG_NVS_NAMESPACE "collar"
+#define CONFIG_KEY_ACTIVE "cfg"
+#define CONFIG_KEY_PREVIOUS "cfg_prev"
+#define CONFIG_KEY_PENDING "pending"
+
+#define CONFIG_RESTART_DELAY_US (1000 * 1000) // Give the ack time to leave before rebooting
+
+static const char *TAG = "config";
+
+static collar_config_t s_active;
+static SemaphoreHandle_t s_config_mutex;
+static StaticSemaphore_t s_config_mutex_buf;
+static esp_timer_handle_t s_confirm_timer;
+
+// Field table //////////////////////////////////////////////////////////////////
+
+typedef enum
+{
+    CFG_FIELD_STR,
+    CFG_FIELD_U32,
+    CFG_FIELD_FLOAT
+} cfg_field_type_t;
+
+typedef struct
+{
+    const char *key;
+    cfg_field_type_t type;
+    size_t offset;
+    size_t size;
+    float min; // Inclusive range for numbers, max length for strings is size - 1
+    float max;
+    bool needs_reboot;
+} cfg_field_t;
+
+#define CFG_STR_FIELD(name, reboot) \
+    {#name, CFG_FIELD_STR, offsetof(collar_config_t, name), sizeof(((collar_config_t *)0)->name), 0, 0, reboot}
+#define CFG_U32_FIELD(name, lo, hi, reboot) \
+    {#name, CFG_FIELD_U32, offsetof(collar_config_t, name), sizeof(uint32_t), lo, hi, reboot}
+#define CFG_FLOAT_FIELD(name, lo, hi) \
+    {#name, CFG_FIELD_FLOAT, offsetof(collar_config_t, name), sizeof(float), lo, hi, false}
+
+static const cfg_field_t s_fields[] = {
+    CFG_STR_FIELD(cat_id, true),
+    CFG_STR_FIELD(host_ip, true),
+    CFG_U32_FIELD(udp_port, 1, 65535, true),
+    CFG_STR_FIELD(ws_uri, true),
+    CFG_U32_FIELD(sample_period_ms, 10, 10000, false),
+    CFG_U32_FIELD(samples_per_window, 1, 64, false),
+    CFG_U32_FIELD(display_refresh_ms, 20, 5000, false),
+    CFG_U32_FIELD(scroll_step_ms, 50, 2000, false),
+    CFG_FLOAT_FIELD(sleep_z_max, 0, 40),
+    CFG_FLOAT_FIELD(still_xy_max, 0, 40),
+    CFG_FLOAT_FIELD(wander_xy_min, 0, 40),
+    CFG_FLOAT_FIELD(moonwalk_pitch_deg, 0, 90),
+    CFG_FLOAT_FIELD(temp_cal_gain, 0.5f, 1.5f),
+    CFG_FLOAT_FIELD(temp_cal_offset_f, -20, 20),
+    CFG_U32_FIELD(uart_baud, 0, 3000000, true),
+    CFG_U32_FIELD(relay_mode, 0, 3, true),
+    CFG_U32_FIELD(relay_port, 1, 65535, true),
+};
+
+#define CFG_FIELD_COUNT (sizeof(s_fields) / sizeof(s_fields[0]))
+
+static const cfg_field_t *find_field(const char *key, size_t key_len)
+{
+    for (size_t i = 0; i < CFG_FIELD_COUNT; i++)
+    {
+        if (strlen(s_fields[i].key) == key_len && strncmp(s_fields[i].key, key, key_len) == 0)
+        {
+            return &s_fields[i];
+        }
+    }
+    return NULL;
+}
+
+// Parse value into the field of cfg; returns false if malformed or out of range
+static bool set_field(collar_config_t *cfg, const cfg_field_t *field, const char *value)
+{
+    char *base = (char *)cfg + field->offset;
+    char *end = NULL;
+
+    switch (field->type)
+    {
+    case CFG_FIELD_STR:
+        if (strlen(value) == 0 || strlen(value) >= field->size)
+        {
+            return false;
+        }
+        memset(base, 0, field->size);
+        strcpy(base, value);
+        return true;
+
+    case CFG_FIELD_U32:
+    {
+        unsigned long v = strtoul(value, &end, 10);
+        if (end == value || *end != '\0' || v < field->min || v > field->max)
+        {
+            return false;
+        }
+        *(uint32_t *)base = (uint32_t)v;
+        return true;
+    }
+
+    case CFG_FIELD_FLOAT:
+    {
+        float v = strtof(value, &end);
+        if (end == value || *end != '\0' || v < field->min || v > field->max)
+        {
+            return false;
+        }
+        *(float *)base = v;
+        return true;
+    }
+    }
+    return false;
+}
+
+static bool reboot_fields_differ(const collar_config_t *a, const collar_config_t *b)
+{
+    for (size_t i = 0; i < CFG_FIELD_COUNT; i++)
+    {
+        if (s_fields[i].needs_reboot &&
+            memcmp((const char *)a + s_fields[i].offset, (const char *)b + s_fields[i].offset, s_fields[i].size) != 0)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Defaults and persistence ////////////////////////////////////////////////////
+
+void config_defaults(collar_config_t *cfg)
+{
+    memset(cfg, 0, sizeof(*cfg));
+    cfg->schema = COLLAR_CONFIG_SCHEMA_VERSION;
+    strcpy(cfg->cat_id, COLLAR_DEFAULT_CAT_ID);
+    strcpy(cfg->host_ip, COLLAR_DEFAULT_HOST_IP);
+    cfg->udp_port = COLLAR_DEFAULT_UDP_PORT;
+    strcpy(cfg->ws_uri, COLLAR_DEFAULT_WS_URI);
+    cfg->sample_period_ms = COLLAR_DEFAULT_SAMPLE_PERIOD_MS;
+    cfg->samples_per_window = COLLAR_DEFAULT_SAMPLES_PER_WINDOW;
+    cfg->display_refresh_ms = COLLAR_DEFAULT_DISPLAY_REFRESH_MS;
+    cfg->scroll_step_ms = COLLAR_DEFAULT_SCROLL_STEP_MS;
+    cfg->sleep_z_max = 11.0f;
+    cfg->still_xy_max = 2.0f;
+    cfg->wander_xy_min = 2.0f;
+    cfg->moonwalk_pitch_deg = 70.0f;
+    cfg->temp_cal_gain = 1.0f;
+    cfg->temp_cal_offset_f = 0.0f;
+    cfg->uart_baud = COLLAR_DEFAULT_UART_BAUD;
+    cfg->relay_mode = COLLAR_DEFAULT_RELAY_MODE;
+    cfg->relay_port = COLLAR_DEFAULT_RELAY_PORT;
+}
+
+// Size of each schema's blob; fields are only ever appended, so an older blob
+// is a prefix of the current struct and the missing tail keeps its defaults
+static const size_t s_schema_sizes[COLLAR_CONFIG_SCHEMA_VERSION + 1] = {
+    [1] = offsetof(collar_config_t, temp_cal_gain),
+    [2] = offsetof(collar_config_t, uart_baud),
+    [3] = offsetof(collar_config_t, relay_mode),
+    [4] = sizeof(collar_config_t),
+};
+
+// Read a config blob, migrating older schemas; anything unrecognized is rejected
+static bool load_blob(nvs_handle_t nvs, const char *key, collar_config_t *out)
+{
+    collar_config_t stored;
+    config_defaults(&stored);
+
+    size_t size = sizeof(stored);
+    if (nvs_get_blob(nvs, key, &stored, &size) != ESP_OK)
+    {
+        return false;
+    }
+    if (stored.schema == 0 || stored.schema > COLLAR_CONFIG_SCHEMA_VERSION || size != s_schema_sizes[stored.schema])
+    {
+        ESP_LOGW(TAG, "Ignoring %s: schema %u, %u bytes", key, stored.schema, (unsigned)size);
+        return false;
+    }
+    if (stored.schema != COLLAR_CONFIG_SCHEMA_VERSION)
+    {
+        ESP_LOGI(TAG, "Migrating %s from schema %u", key, stored.schema);
+        stored.schema = COLLAR_CONFIG_SCHEMA_VERSION;
+    }
+    *out = stored;
+    out->cat_id[CONFIG_CAT_ID_LEN - 1] = '\0';
+    out->host_ip[CONFIG_HOST_IP_LEN - 1] = '\0';
+    out->ws_uri[CONFIG_WS_URI_LEN - 1] = '\0';
+    return true;
+}
+
+// Write next as active and previous as the rollback copy in one NVS commit
+static esp_err_t persist(const collar_config_t *next, const collar_config_t *previous, bool pending)
+{
+    nvs_handle_t nvs;
+    esp_err_t err = nvs_open(CONFIG_NVS_NAMESPACE, NVS_READWRITE, &nvs);
+    if (err != ESP_OK)
+    {
+        return err;
+    }
+    err = nvs_set_blob(nvs, CONFIG_KEY_PREVIOUS, previous, sizeof(*previous));
+    if (err == ESP_OK)
+    {
+        err = nvs_set_blob(nvs, CONFIG_KEY_ACTIVE, next, sizeof(*next));
+    }
+    if (err == ESP_OK)
+    {
+        err = nvs_set_u8(nvs, CONFIG_KEY_PENDING, pending ? 1 : 0);
+    }
+    if (err == ESP_OK)
+    {
+        err = nvs_commit(nvs);
+    }
+    nvs_close(nvs);
+    return err;
+}
+
+static void swap_active(const collar_config_t *next)
+{
+    xSemaphoreTake(s_config_mutex, portMAX_DELAY);
+    s_active = *next;
+    xSemaphoreGive(s_config_mutex);
+}
+
+static void restart_cb(void *arg)
+{
+    esp_restart();
+}
+
+static void schedule_restart(void)
+{
+    static esp_timer_handle_t restart_timer;
+    if (restart_timer == NULL)
+    {
+        const esp_timer_create_args_t args = {.callback = restart_cb, .name = "cfg_restart"};
+        if (esp_timer_create(&args, &restart_timer) != ESP_OK)
+        {
+            esp_restart();
+        }
+    }
+    esp_timer_start_once(restart_timer, CONFIG_RESTART_DELAY_US);
+}
+
+// Restore the rollback copy; returns false if there is none
+static bool rollback(bool *needs_reboot)
+{
+    collar_config_t previous;
+    nvs_handle_t nvs;
+    if (nvs_open(CONFIG_NVS_NAMESPACE, NVS_READONLY, &nvs) != ESP_OK)
+    {
+        return false;
+    }
+    bool found = load_blob(nvs, CONFIG_KEY_PREVIOUS, &previous);
+    nvs_close(nvs);
+    if (!found)
+    {
+        return false;
+    }
+
+    collar_config_t current;
+    config_get(&current);
+    if (persist(&previous, &current, false) != ESP_OK)
+    {
+        return false;
+    }
+    *needs_reboot = reboot_fields_differ(&previous, &current);
+    swap_active(&previous);
+    ESP_LOGW(TAG, "Rolled back from rev %u to rev %u", (unsigned)current.revision, (unsigned)previous.revision);
+    return true;
+}
+
+static void confirm_timeout_cb(void *arg)
+{
+    bool needs_reboot = false;
+    ESP_LOGE(TAG, "Pushed config was never confirmed, rolling back");
+    rollback(&needs_reboot);
+    esp_restart();
+}
+
+// Public API //////////////////////////////////////////////////////////////////
+
+void config_init(void)
+{
+    s_config_mutex = xSemaphoreCreateMutexStatic(&s_config_mutex_buf);
+    config_defaults(&s_active);
+
+    nvs_handle_t nvs;
+    if (nvs_open(CONFIG_NVS_NAMESPACE, NVS_READWRITE, &nvs) != ESP_OK)
+    {
+        ESP_LOGE(TAG, "NVS unavailable, using defaults");
+        return;
+    }
+
+    collar_config_t stored;
+    if (load_blob(nvs, CONFIG_KEY_ACTIVE, &stored))
+    {
+        s_active = stored;
+    }
+
+    uint8_t pending = 0;
+    nvs_get_u8(nvs, CONFIG_KEY_PENDING, &pending);
+    nvs_close(nvs);
+
+    ESP_LOGI(TAG, "Config rev %u: cat %s, server %s:%u, %u x %u ms",
+             (unsigned)s_active.revision, s_active.cat_id, s_active.host_ip, (unsigned)s_active.udp_port,
+             (unsigned)s_active.samples_per_window, (unsigned)s_active.sample_period_ms);
+
+    if (pending)
+    {
+        // Booted into a config that changed the network settings; it must prove itself
+        const esp_timer_create_args_t args = {.callback = confirm_timeout_cb, .name = "cfg_confirm"};
+        if (esp_timer_create(&args, &s_confirm_timer) == ESP_OK)
+        {
+            esp_timer_start_once(s_confirm_timer, (uint64_t)COLLAR_CONFIG_CONFIRM_TIMEOUT_MS * 1000);
+        }
+    }
+}
+
+void config_get(collar_config_t *out)
+{
+    xSemaphoreTake(s_config_mutex, portMAX_DELAY);
+    *out = s_active;
+    xSemaphoreGive(s_config_mutex);
+}
+
+void config_confirm(void)
+{
+    if (s_confirm_timer == NULL)
+    {
+        return;
+    }
+    esp_timer_stop(s_confirm_timer);
+    esp_timer_delete(s_confirm_timer);
+    s_confirm_timer = NULL;
+
+    nvs_handle_t nvs;
+    static_alloc_exempt_begin(); // NVS allocates while writing; this happens once per config
+    if (nvs_open(CONFIG_NVS_NAMESPACE, NVS_READWRITE, &nvs) == ESP_OK)
+    {
+        nvs_set_u8(nvs, CONFIG_KEY_PENDING, 0);
+        nvs_commit(nvs);
+        nvs_close(nvs);
+    }
+    static_alloc_exempt_end();
+    ESP_LOGI(TAG, "Config rev %u confirmed", (unsigned)s_active.revision);
+}
+
+// Apply "key=value ..." on top of the active config; nothing changes unless every pair is valid
+static void handle_set(char *args, char *reply, size_t reply_len)
+{
+    collar_config_t current, staged;
+    config_get(&current);
+    staged = current;
+
+    uint32_t revision = current.revision + 1;
+    char *save = NULL;
+    for (char *tok = strtok_r(args, " ", &save); tok != NULL; tok = strtok_r(NULL, " ", &save))
+    {
+        char *eq = strchr(tok, '=');
+        if (eq == NULL)
+        {
+            snprintf(reply, reply_len, "CFG NAK rev=%u malformed %s", (unsigned)revision, tok);
+            return;
+        }
+        *eq = '\0';
+        const char *value = eq + 1;
+
+        if (strcmp(tok, "rev") == 0)
+        {
+            char *end = NULL;
+            unsigned long v = strtoul(value, &end, 10);
+            if (end == value || *end != '\0' || v > UINT32_MAX)
+            {
+                snprintf(reply, reply_len, "CFG NAK rev=%u malformed rev", (unsigned)revision);
+                return;
+            }
+            revision = (uint32_t)v;
+            continue;
+        }
+
+        const cfg_field_t *field = find_field(tok, strlen(tok));
+        if (field == NULL)
+        {
+            snprintf(reply, reply_len, "CFG NAK rev=%u unknown %s", (unsigned)revision, tok);
+            return;
+        }
+        if (!set_field(&staged, field, value))
+        {
+            snprintf(reply, reply_len, "CFG NAK rev=%u invalid %s", (unsigned)revision, tok);
+            return;
+        }
+    }
+
+    if (staged.still_xy_max > staged.wander_xy_min)
+    {
+        snprintf(reply, reply_len, "CFG NAK rev=%u invalid still_xy_max>wander_xy_min", (unsigned)revision);
+        return;
+    }
+
+    staged.revision = revision;
+    bool needs_reboot = reboot_fields_differ(&staged, &current);
+
+    esp_err_t err = persist(&staged, &current, needs_reboot);
+    if (err != ESP_OK)
+    {
+        snprintf(reply, reply_len, "CFG NAK rev=%u nvs %s", (unsigned)revision, esp_err_to_name(err));
+        return;
+    }
+
+    if (needs_reboot)
+    {
+        // Network settings only take effect after a restart; the new config
+        // has to reconnect within COLLAR_CONFIG_CONFIRM_TIMEOUT_MS or it is rolled back
+        snprintf(reply, reply_len, "CFG ACK rev=%u reboot", (unsigned)revision);
+        schedule_restart();
+    }
+    else
+    {
+        swap_active(&staged);
+        snprintf(reply, reply_len, "CFG ACK rev=%u", (unsigned)revision);
+    }
+    ESP_LOGI(TAG, "Applied config rev %u%s", (unsigned)revision, needs_reboot ? " (rebooting)" : "");
+}
+
+static void handle_get(char *reply, size_t reply_len)
+{
+    collar_config_t cfg;
+    config_get(&cfg);
+    snprintf(reply, reply_len,
+             "CFG VAL rev=%u cat_id=%s host_ip=%s udp_port=%u ws_uri=%s sample_period_ms=%u samples_per_window=%u "
+             "display_refresh_ms=%u scroll_step_ms=%u sleep_z_max=%.2f still_xy_max=%.2f wander_xy_min=%.2f "
+             "moonwalk_pitch_deg=%.1f temp_cal_gain=%.3f temp_cal_offset_f=%.2f uart_baud=%u relay_mode=%u "
+             "relay_port=%u",
+             (unsigned)cfg.revision, cfg.cat_id, cfg.host_ip, (unsigned)cfg.udp_port, cfg.ws_uri,
+             (unsigned)cfg.sample_period_ms, (unsigned)cfg.samples_per_window, (unsigned)cfg.display_refresh_ms,
+             (unsigned)cfg.scroll_step_ms, cfg.sleep_z_max, cfg.still_xy_max, cfg.wander_xy_min,
+             cfg.moonwalk_pitch_deg, cfg.temp_cal_gain, cfg.temp_cal_offset_f, (unsigned)cfg.uart_baud,
+             (unsigned)cfg.relay_mode, (unsigned)cfg.relay_port);
+}
+
+bool config_handle_message(const char *msg, size_t len, char *reply, size_t reply_len)
+{
+    if (len < 4 || strncmp(msg, "CFG ", 4) != 0)
+    {
+        return false;
+    }
+
+    char command[256];
+    if (len >= sizeof(command))
+    {
+        snprintf(reply, reply_len, "CFG NAK rev=0 too_long");
+        return true;
+    }
+    memcpy(command, msg, len);
+    command[len] = '\0';
+
+    char *body = command + 4;
+    if (strncmp(body, "SET", 3) == 0)
+    {
+        // A change is not steady state: NVS writes and the restart timer allocate
+        static_alloc_exempt_begin();
+        handle_set(body + 3, reply, reply_len);
+        static_alloc_exempt_end();
+    }
+    else if (strncmp(body, "GET", 3) == 0)
+    {
+        handle_get(reply, reply_len);
+    }
+    else if (strncmp(body, "ROLLBACK", 8) == 0)
+    {
+        bool needs_reboot = false;
+        static_alloc_exempt_begin();
+        bool restored = rollback(&needs_reboot);
+        if (restored && needs_reboot)
+        {
+            schedule_restart();
+        }
+        static_alloc_exempt_end();
+        if (!restored)
+        {
+            snprintf(reply, reply_len, "CFG NAK rev=%u no_previous", (unsigned)s_active.revision);
+            return true;
+        }
+        snprintf(reply, reply_len, "CFG ACK rev=%u%s", (unsigned)s_active.revision, needs_reboot ? " reboot" : "");
+    }
+    else
+    {
+        snprintf(reply, reply_len, "CFG NAK rev=%u unknown_command", (unsigned)s_active.revision);
+    }
+    return true;
+}
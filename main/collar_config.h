@@ -0,0 +1,106 @@
+/*
+  Runtime configuration for the cat collar.
+
+  Everything that used to be a #define or literal in CatCollar.c (server address,
+  cat ID, sampling period, classification thresholds, display timing) lives in a
+  versioned struct that is persisted in NVS and can be updated over the WebSocket
+  channel without reflashing.
+
+  Wire protocol (text frames on the /buzz WebSocket):
+    server -> collar   CFG SET rev=<n> key=value key=value ...
+                       CFG ROLLBACK
+                       CFG GET
+    collar -> server   CFG ACK rev=<n> [reboot]
+                       CFG NAK rev=<n> <reason>
+                       CFG VAL rev=<n> key=value ...
+*/
+
+#ifndef COLLAR_CONFIG_H
+#define COLLAR_CONFIG_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+
+// Bump whenever collar_config_t changes layout; older blobs are migrated in config_init()
+#define COLLAR_CONFIG_SCHEMA_VERSION 4
+
+// Factory defaults (what used to be hardcoded in CatCollar.c)
+#define COLLAR_DEFAULT_CAT_ID "1"
+#define COLLAR_DEFAULT_HOST_IP "192.168.1.103"
+#define COLLAR_DEFAULT_UDP_PORT 3333
+#define COLLAR_DEFAULT_WS_URI "ws://192.168.1.103:3000/buzz"
+#define COLLAR_DEFAULT_SAMPLE_PERIOD_MS 500
+#define COLLAR_DEFAULT_SAMPLES_PER_WINDOW 4
+#define COLLAR_DEFAULT_DISPLAY_REFRESH_MS 100
+#define COLLAR_DEFAULT_SCROLL_STEP_MS 300
+#define COLLAR_DEFAULT_UART_BAUD 0 // Text console
+#define COLLAR_DEFAULT_RELAY_MODE 0 // No ESP-NOW relay
+#define COLLAR_DEFAULT_RELAY_PORT 3340
+
+// A pushed config that needs a reboot must be confirmed by a WebSocket connect
+// within this window, otherwise the previous config is restored
+#define COLLAR_CONFIG_CONFIRM_TIMEOUT_MS 60000
+
+#define CONFIG_CAT_ID_LEN 8
+#define CONFIG_HOST_IP_LEN 16
+#define CONFIG_WS_URI_LEN 64
+#define CONFIG_REPLY_MAX 448 // CFG VAL with every string and number at its longest is 410 bytes
+
+typedef struct
+{
+    uint16_t schema;   // COLLAR_CONFIG_SCHEMA_VERSION of this blob
+    uint16_t reserved;
+    uint32_t revision; // Set by the server on every push, echoed in acks
+
+    // Identity and network (changing these requires a reboot)
+    char cat_id[CONFIG_CAT_ID_LEN];
+    char host_ip[CONFIG_HOST_IP_LEN];
+    uint32_t udp_port;
+    char ws_uri[CONFIG_WS_URI_LEN];
+
+    // Acquisition
+    uint32_t sample_period_ms;   // Delay between accelerometer reads
+    uint32_t samples_per_window; // Reads averaged per classification
+
+    // Display
+    uint32_t display_refresh_ms; // Delay between display updates
+    uint32_t scroll_step_ms;     // Delay between scroll steps
+
+    // Classification thresholds (see getCatState)
+    float sleep_z_max;        // |Z| below this (with X/Y still) means sleeping
+    float still_xy_max;       // |X| and |Y| below this means no motion
+    float wander_xy_min;      // |X| or |Y| above this means moving
+    float moonwalk_pitch_deg; // |pitch| at or above this means upright
+
+    // Schema 2: thermistor two-point correction (see temperature_filter.h)
+    float temp_cal_gain;
+    float temp_cal_offset_f;
+
+    // Schema 3: UART0 as a binary telemetry stream at this baud, 0 for the text console (see uart_stream.h)
+    uint32_t uart_baud;
+
+    // Schema 4: ESP-NOW relay role (relay_mode_t in relay.h) and the server port gateways uplink to
+    uint32_t relay_mode;
+    uint32_t relay_port;
+} collar_config_t;
+
+// Load the active config from NVS (nvs_flash_init() must have run first)
+void config_init(void);
+
+// Fill cfg with the factory defaults (also used by the host simulator to provision NVS)
+void config_defaults(collar_config_t *cfg);
+
+// Copy the active config into out; safe to call from any task
+void config_get(collar_config_t *out);
+
+// Handle a "CFG ..." frame and write the reply frame into reply
+// Returns true if the frame was a config frame (reply is then always set)
+bool config_handle_message(const char *msg, size_t len, char *reply, size_t reply_len);
+
+// Mark a pending (reboot-applied) config as good; call once the server is reachable
+void config_confirm(void);
+
+#endif // COLLAR_CONFIG_H
@@ -0,0 +1,84 @@
+#include <stdio.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+
+#include "esp_system.h"
+
+#include "./dlog.h"
+#include "./task_plan.h"
+
+static dlog_ring_t s_rings[portNUM_PROCESSORS];
+static SemaphoreHandle_t s_drain_mutex; // dlog_flush() and the task take turns reading
+static StaticSemaphore_t s_drain_mutex_buf;
+
+dlog_ring_t *dlog_ring_for_core(void)
+{
+    return &s_rings[xPortGetCoreID()];
+}
+
+// The console line for one record, written in one call so lines never interleave
+static void write_record(const dlog_record_t *record)
+{
+    char line[DLOG_LINE_MAX];
+    int len = snprintf(line, sizeof(line), "%c (%u) %s: ", record->site->level, (unsigned)record->time_ms,
+                       record->site->tag);
+    if (len < 0 || len >= (int)sizeof(line) - 2)
+    {
+        return;
+    }
+    int text = dlog_ring_format(record, line + len, sizeof(line) - len - 1);
+    len += (text < (int)sizeof(line) - len - 1) ? text : (int)sizeof(line) - len - 2;
+    line[len++] = '\n';
+    line[len] = '\0';
+    fputs(line, stdout);
+}
+
+static void drain(void)
+{
+    for (int i = 0; i < portNUM_PROCESSORS; i++)
+    {
+        dlog_record_t record;
+        while (dlog_ring_read(&s_rings[i], &record))
+        {
+            write_record(&record);
+        }
+        uint32_t dropped = dlog_ring_take_dropped(&s_rings[i]);
+        if (dropped > 0)
+        {
+            printf("W (%u) %s: %u records dropped on core %d\n", (unsigned)DLOG_NOW_MS(), DLOG_TAG_DLOG,
+                   (unsigned)dropped, i);
+        }
+    }
+    fflush(stdout);
+}
+
+void dlog_flush(void)
+{
+    if (s_drain_mutex == NULL)
+    {
+        return;
+    }
+    xSemaphoreTake(s_drain_mutex, portMAX_DELAY);
+    drain();
+    xSemaphoreGive(s_drain_mutex);
+}
+
+// Polls rather than waits on a notification, so logging never touches the scheduler
+static void dlog_task(void *arg)
+{
+    TickType_t last_wake = xTaskGetTickCount();
+    while (1)
+    {
+        dlog_flush();
+        vTaskDelayUntil(&last_wake, pdMS_TO_TICKS(DLOG_DRAIN_PERIOD_MS));
+    }
+}
+
+void dlog_init(UBaseType_t prio, BaseType_t core, uint32_t stack)
+{
+    s_drain_mutex = xSemaphoreCreateMutexStatic(&s_drain_mutex_buf);
+    esp_register_shutdown_handler(dlog_flush); // What a restart would otherwise lose
+    task_plan_create(dlog_task, "dlog", stack, NULL, prio, core, NULL);
+}
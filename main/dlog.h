@@ -0,0 +1,105 @@
+/*
+  Deferred logging for the collar's hot paths.
+
+  ESP_LOGI and printf format on the caller's stack and write to UART0 before
+  they return, which at console baud is about 87 us a character. DLOGI and
+  friends store the call site and the raw arguments into a lock-free ring for
+  the caller's core instead (dlog_ring.h). A low-priority task formats them and
+  writes them out later, in the console's own "I (<ms>) <tag>: <message>"
+  form, with the time of the call. A full ring drops the record rather than
+  wait, and the drain task reports how many went missing.
+
+  What gets logged is decided at compile time. A call below DLOG_LEVEL, or for
+  a module missing from DLOG_MODULES, compiles to nothing:
+
+    idf.py -DDLOG_LEVEL=2 build        errors and warnings only
+    idf.py -DDLOG_MODULES=0x0C build   only the WebSocket and buzzer modules
+
+  The simulator takes the same as -DSIM_DLOG_LEVEL and -DSIM_DLOG_MODULES.
+
+  Arguments must be ints, longs, long longs, floats, doubles, strings or void
+  pointers; cast other pointers to void *. Strings are copied when the call is
+  made, and a record keeps DLOG_ARG_BYTES of arguments, so long strings are cut
+  short. Keep ESP_LOG for long or rare messages.
+*/
+
+#ifndef DLOG_H
+#define DLOG_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "./dlog_ring.h"
+
+#define DLOG_LEVEL_NONE 0
+#define DLOG_LEVEL_ERROR 1
+#define DLOG_LEVEL_WARN 2
+#define DLOG_LEVEL_INFO 3
+#define DLOG_LEVEL_DEBUG 4
+#define DLOG_LEVEL_VERBOSE 5
+
+#ifndef DLOG_LEVEL
+#define DLOG_LEVEL DLOG_LEVEL_INFO
+#endif
+
+// Modules, each logged under its own tag
+#define DLOG_MODULE_APP 0x01  // "app": boot and peripherals
+#define DLOG_MODULE_NET 0x02  // "net": status datagrams and leader notifications
+#define DLOG_MODULE_WS 0x04   // "ws": the /buzz WebSocket
+#define DLOG_MODULE_BUZZ 0x08 // "buzz": leader changes and the buzzer
+#define DLOG_MODULE_DLOG 0x10 // "dlog": the drain task's own reports
+
+#ifndef DLOG_MODULES
+#define DLOG_MODULES 0xFF
+#endif
+
+#define DLOG_TAG_APP "app"
+#define DLOG_TAG_NET "net"
+#define DLOG_TAG_WS "ws"
+#define DLOG_TAG_BUZZ "buzz"
+#define DLOG_TAG_DLOG "dlog"
+
+#define DLOG_DRAIN_PERIOD_MS 50
+#define DLOG_LINE_MAX 160
+
+// The ring for the calling task's core
+dlog_ring_t *dlog_ring_for_core(void);
+
+// Start the drain task; records logged before this wait in the rings
+void dlog_init(UBaseType_t prio, BaseType_t core, uint32_t stack);
+
+// Format and write out everything logged so far, from the calling task
+void dlog_flush(void);
+
+// Never called: lets the compiler check each call's format against its arguments
+static inline __attribute__((format(printf, 1, 2))) void dlog_check_format(const char *fmt, ...)
+{
+}
+
+// The tick count, as esp_log_timestamp() uses once the scheduler runs
+#define DLOG_NOW_MS() ((uint32_t)(xTaskGetTickCount() * portTICK_PERIOD_MS))
+
+#define DLOG_AT(level, letter, module, fmt, ...)                                                            \
+    do                                                                                                        \
+    {                                                                                                         \
+        if ((level) <= DLOG_LEVEL && (DLOG_MODULES & DLOG_MODULE_##module))                                   \
+        {                                                                                                     \
+            static const dlog_site_t dlog_site_ = {fmt, DLOG_TAG_##module, letter};                           \
+            DLOG_RING_WRITE(dlog_ring_for_core(), &dlog_site_, DLOG_NOW_MS(), ##__VA_ARGS__);                \
+        }                                                                                                     \
+        if (0)                                                                                                \
+        {                                                                                                     \
+            dlog_check_format(fmt, ##__VA_ARGS__);                                                            \
+        }                                                                                                     \
+    } while (0)
+
+#define DLOGE(module, fmt, ...) DLOG_AT(DLOG_LEVEL_ERROR, 'E', module, fmt, ##__VA_ARGS__)
+#define DLOGW(module, fmt, ...) DLOG_AT(DLOG_LEVEL_WARN, 'W', module, fmt, ##__VA_ARGS__)
+#define DLOGI(module, fmt, ...) DLOG_AT(DLOG_LEVEL_INFO, 'I', module, fmt, ##__VA_ARGS__)
+#define DLOGD(module, fmt, ...) DLOG_AT(DLOG_LEVEL_DEBUG, 'D', module, fmt, ##__VA_ARGS__)
+#define DLOGV(module, fmt, ...) DLOG_AT(DLOG_LEVEL_VERBOSE, 'V', module, fmt, ##__VA_ARGS__)
+
+#endif // DLOG_H
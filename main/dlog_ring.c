@@ -0,0 +1,210 @@
+#include <stdio.h>
+#include <sys/param.h>
+
+#include "./dlog_ring.h"
+
+#define DLOG_SPEC_MAX 24 // One conversion, flags and all
+
+bool dlog_ring_read(dlog_ring_t *ring, dlog_record_t *out)
+{
+    dlog_record_t *record = &ring->records[ring->tail & (DLOG_RING_RECORDS - 1)];
+    uint32_t lap = ring->tail & ~(uint32_t)(DLOG_RING_RECORDS - 1);
+    if (atomic_load_explicit(&record->seq, memory_order_acquire) != lap + 1)
+    {
+        return false; // Empty, or the writer is still filling it in
+    }
+    out->time_ms = record->time_ms;
+    out->site = record->site;
+    out->len = record->len;
+    out->truncated = record->truncated;
+    memcpy(out->args, record->args, record->len);
+    atomic_store_explicit(&record->seq, lap + DLOG_RING_RECORDS, memory_order_release);
+    ring->tail++;
+    return true;
+}
+
+uint32_t dlog_ring_take_dropped(dlog_ring_t *ring)
+{
+    return atomic_exchange_explicit(&ring->dropped, 0, memory_order_relaxed);
+}
+
+// Reads the next argument of size bytes; false once the record has run out
+static bool take(const dlog_record_t *record, size_t *at, void *value, size_t size)
+{
+    if (*at + size > record->len)
+    {
+        return false;
+    }
+    memcpy(value, record->args + *at, size);
+    *at += size;
+    return true;
+}
+
+int dlog_ring_format(const dlog_record_t *record, char *out, size_t out_len)
+{
+    const char *fmt = record->site->fmt;
+    size_t at = 0;
+    int len = 0;
+    bool complete = true;
+#define DLOG_OUT (out_len > (size_t)len ? out + len : NULL)
+#define DLOG_ROOM (out_len > (size_t)len ? out_len - (size_t)len : 0)
+#define DLOG_PRINT(v)                                                              \
+    (star_count == 2   ? snprintf(DLOG_OUT, DLOG_ROOM, spec, stars[0], stars[1], v) \
+     : star_count == 1 ? snprintf(DLOG_OUT, DLOG_ROOM, spec, stars[0], v)           \
+                       : snprintf(DLOG_OUT, DLOG_ROOM, spec, v))
+    while (*fmt != '\0')
+    {
+        // Literal text up to the next conversion
+        const char *pct = strchr(fmt, '%');
+        size_t literal = pct ? (size_t)(pct - fmt) : strlen(fmt);
+        if (literal > 0)
+        {
+            len += MAX(snprintf(DLOG_OUT, DLOG_ROOM, "%.*s", (int)literal, fmt), 0);
+            fmt += literal;
+            continue;
+        }
+        if (fmt[1] == '%')
+        {
+            len += MAX(snprintf(DLOG_OUT, DLOG_ROOM, "%%"), 0);
+            fmt += 2;
+            continue;
+        }
+
+        // One conversion: copy its flags, width, precision and length, taking * from the arguments
+        char spec[DLOG_SPEC_MAX];
+        size_t n = 0;
+        int stars[2];
+        int star_count = 0;
+        const char *p = fmt + 1;
+        spec[n++] = '%';
+        while (*p != '\0' && strchr("-+ #0123456789.*hljztL", *p) != NULL && n < sizeof(spec) - 2)
+        {
+            if (*p == '*')
+            {
+                if (star_count == 2 || !take(record, &at, &stars[star_count], sizeof(int)))
+                {
+                    complete = false;
+                    break;
+                }
+                star_count++;
+            }
+            spec[n++] = *p++;
+        }
+        if (!complete || *p == '\0')
+        {
+            break;
+        }
+        char conv = *p++;
+        spec[n++] = conv;
+        spec[n] = '\0';
+        fmt = p;
+
+        // The length modifier picks the argument's size, as the writer's _Generic did
+        bool ll = strstr(spec, "ll") != NULL || strchr(spec, 'j') != NULL;
+        bool l = !ll && strchr(spec, 'l') != NULL;
+        bool z = strchr(spec, 'z') != NULL || strchr(spec, 't') != NULL;
+        int written = 0;
+        switch (conv)
+        {
+        case 'd':
+        case 'i':
+        case 'u':
+        case 'x':
+        case 'X':
+        case 'o':
+        case 'c':
+            if (ll)
+            {
+                long long v;
+                complete = take(record, &at, &v, sizeof(v));
+                if (complete)
+                {
+                    written = DLOG_PRINT(v);
+                }
+            }
+            else if (l || (z && sizeof(size_t) == sizeof(long)))
+            {
+                long v;
+                complete = take(record, &at, &v, sizeof(v));
+                if (complete)
+                {
+                    written = DLOG_PRINT(v);
+                }
+            }
+            else
+            {
+                int v;
+                complete = take(record, &at, &v, sizeof(v));
+                if (complete)
+                {
+                    written = DLOG_PRINT(v);
+                }
+            }
+            break;
+        case 'f':
+        case 'F':
+        case 'e':
+        case 'E':
+        case 'g':
+        case 'G':
+        case 'a':
+        case 'A':
+        {
+            double v;
+            complete = !strchr(spec, 'L') && take(record, &at, &v, sizeof(v));
+            if (complete)
+            {
+                written = DLOG_PRINT(v);
+            }
+            break;
+        }
+        case 's':
+        {
+            // Stored inline: up to and including its NUL
+            const char *v = (const char *)record->args + at;
+            const void *nul = at < record->len ? memchr(v, '\0', record->len - at) : NULL;
+            complete = nul != NULL;
+            if (complete)
+            {
+                at += (size_t)((const char *)nul - v) + 1;
+                written = DLOG_PRINT(v);
+            }
+            break;
+        }
+        case 'p':
+        {
+            void *v;
+            complete = take(record, &at, &v, sizeof(v));
+            if (complete)
+            {
+                written = snprintf(DLOG_OUT, DLOG_ROOM, spec, v);
+            }
+            break;
+        }
+        default:
+            // %n and anything unknown are left out
+            break;
+        }
+        if (!complete)
+        {
+            break;
+        }
+        len += MAX(written, 0);
+        if (record->truncated && at >= record->len)
+        {
+            break; // The last argument that fit; the text after it would read as if nothing was missing
+        }
+    }
+    if (!complete || record->truncated)
+    {
+        len += MAX(snprintf(DLOG_OUT, DLOG_ROOM, "..."), 0);
+    }
+#undef DLOG_OUT
+#undef DLOG_ROOM
+#undef DLOG_PRINT
+    if (out_len > 0 && (size_t)len >= out_len)
+    {
+        out[out_len - 1] = '\0';
+    }
+    return len;
+}
@@ -0,0 +1,239 @@
+/*
+  Deferred log records (dlog.h) and the rings that hold them until they are
+  formatted.
+
+  Pure C with no ESP-IDF dependencies, so the host benchmark (sim/bench/)
+  builds this same file.
+
+  A call site logs a pointer to its dlog_site_t, which holds the format string,
+  tag and level and serves as the format's ID, plus the raw arguments, each
+  stored in its own type's size:
+    int and smaller, long, long long   as the native integer
+    float, double                      as a double
+    char *                             copied, NUL-terminated, cut short to fit
+    void *                             as the pointer
+  Nothing is formatted on the logging side. dlog_ring_format() later walks the
+  format string and reads the arguments back in the same order. A string or
+  argument that did not fit marks the record truncated, and its text ends in
+  "...".
+
+  A ring has many writers and one reader. It is a bounded queue of fixed
+  records, where each slot's sequence number says whose turn it is (Vyukov's
+  MPMC queue, with one consumer). A writer claims a slot with one
+  compare-and-swap, fills it in place and publishes it with one store. It never
+  waits: on a full ring the record is dropped and counted. Sequence numbers
+  count laps rather than positions, so a zeroed ring is an empty one.
+*/
+
+#ifndef DLOG_RING_H
+#define DLOG_RING_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#define DLOG_RECORD_SIZE 64
+#define DLOG_RING_RECORDS 32 // Per ring; a power of two
+
+typedef struct
+{
+    const char *fmt;
+    const char *tag;
+    char level; // 'E', 'W', 'I', 'D' or 'V', as on the console
+} dlog_site_t;
+
+#define DLOG_HEADER_SIZE (sizeof(atomic_uint) + sizeof(uint32_t) + sizeof(const dlog_site_t *) + 2)
+#define DLOG_ARG_BYTES (DLOG_RECORD_SIZE - DLOG_HEADER_SIZE)
+
+typedef struct
+{
+    atomic_uint seq; // Start of the lap it was written in + 1 once written; start of the next lap once read
+    uint32_t time_ms;
+    const dlog_site_t *site;
+    uint8_t len; // Argument bytes used
+    uint8_t truncated;
+    uint8_t args[DLOG_ARG_BYTES];
+} dlog_record_t;
+
+_Static_assert(sizeof(dlog_record_t) == DLOG_RECORD_SIZE, "dlog_record_t has padding");
+
+typedef struct
+{
+    dlog_record_t records[DLOG_RING_RECORDS];
+    atomic_uint head; // Next position to claim
+    uint32_t tail;    // Next position to read (reader only)
+    atomic_uint dropped;
+} dlog_ring_t;
+
+// A record being written; args go in with the dlog_put_* calls
+typedef struct
+{
+    dlog_record_t *record;
+    uint32_t pos;
+    uint8_t len;
+    uint8_t truncated;
+} dlog_writer_t;
+
+// Claim the next record for site; false (and counted as dropped) if the ring is full
+static inline bool dlog_ring_begin(dlog_ring_t *ring, dlog_writer_t *w, const dlog_site_t *site, uint32_t time_ms)
+{
+    uint32_t pos = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    for (;;)
+    {
+        dlog_record_t *record = &ring->records[pos & (DLOG_RING_RECORDS - 1)];
+        uint32_t seq = atomic_load_explicit(&record->seq, memory_order_acquire);
+        int32_t diff = (int32_t)(seq - (pos & ~(uint32_t)(DLOG_RING_RECORDS - 1)));
+        if (diff == 0)
+        {
+            // Free and ours to claim, unless another writer got here first (pos is then reloaded)
+            if (atomic_compare_exchange_weak_explicit(&ring->head, &pos, pos + 1, memory_order_relaxed,
+                                                      memory_order_relaxed))
+            {
+                record->site = site;
+                record->time_ms = time_ms;
+                w->record = record;
+                w->pos = pos;
+                w->len = 0;
+                w->truncated = 0;
+                return true;
+            }
+        }
+        else if (diff < 0)
+        {
+            // Still holds a record from one lap ago
+            atomic_fetch_add_explicit(&ring->dropped, 1, memory_order_relaxed);
+            return false;
+        }
+        else
+        {
+            pos = atomic_load_explicit(&ring->head, memory_order_relaxed);
+        }
+    }
+}
+
+static inline void dlog_ring_commit(dlog_writer_t *w)
+{
+    w->record->len = w->len;
+    w->record->truncated = w->truncated;
+    atomic_store_explicit(&w->record->seq, (w->pos & ~(uint32_t)(DLOG_RING_RECORDS - 1)) + 1, memory_order_release);
+}
+
+static inline void dlog_put_bytes(dlog_writer_t *w, const void *value, size_t size)
+{
+    // Once one argument is left out, so is everything after it
+    if (w->truncated || w->len + size > DLOG_ARG_BYTES)
+    {
+        w->truncated = 1;
+        return;
+    }
+    memcpy(w->record->args + w->len, value, size);
+    w->len += size;
+}
+
+static inline void dlog_put_int(dlog_writer_t *w, int value)
+{
+    dlog_put_bytes(w, &value, sizeof(value));
+}
+
+static inline void dlog_put_long(dlog_writer_t *w, long value)
+{
+    dlog_put_bytes(w, &value, sizeof(value));
+}
+
+static inline void dlog_put_llong(dlog_writer_t *w, long long value)
+{
+    dlog_put_bytes(w, &value, sizeof(value));
+}
+
+static inline void dlog_put_double(dlog_writer_t *w, double value)
+{
+    dlog_put_bytes(w, &value, sizeof(value));
+}
+
+static inline void dlog_put_ptr(dlog_writer_t *w, const void *value)
+{
+    dlog_put_bytes(w, &value, sizeof(value));
+}
+
+static inline void dlog_put_str(dlog_writer_t *w, const char *value)
+{
+    if (value == NULL)
+    {
+        value = "(null)";
+    }
+    size_t room = DLOG_ARG_BYTES - w->len;
+    if (w->truncated || room == 0)
+    {
+        w->truncated = 1;
+        return;
+    }
+    char *out = (char *)w->record->args + w->len;
+    size_t n = 0;
+    while (n + 1 < room && value[n] != '\0')
+    {
+        out[n] = value[n];
+        n++;
+    }
+    out[n] = '\0';
+    w->len += n + 1;
+    if (value[n] != '\0')
+    {
+        w->truncated = 1; // What fits is kept
+    }
+}
+
+// One argument, stored by its type
+#define DLOG_PUT(w, x)                                                                                        \
+    _Generic((x),                                                                                             \
+        char *: dlog_put_str,                                                                                 \
+        const char *: dlog_put_str,                                                                           \
+        float: dlog_put_double,                                                                               \
+        double: dlog_put_double,                                                                              \
+        long: dlog_put_long,                                                                                  \
+        unsigned long: dlog_put_long,                                                                         \
+        long long: dlog_put_llong,                                                                            \
+        unsigned long long: dlog_put_llong,                                                                   \
+        void *: dlog_put_ptr,                                                                                 \
+        const void *: dlog_put_ptr,                                                                           \
+        default: dlog_put_int)(w, x)
+
+#define DLOG_COUNT_(_0, _1, _2, _3, _4, _5, _6, _7, _8, n, ...) n
+#define DLOG_COUNT(...) DLOG_COUNT_(_, ##__VA_ARGS__, 8, 7, 6, 5, 4, 3, 2, 1, 0)
+#define DLOG_PUT_0(w)
+#define DLOG_PUT_1(w, a) DLOG_PUT(w, a)
+#define DLOG_PUT_2(w, a, ...) DLOG_PUT(w, a); DLOG_PUT_1(w, __VA_ARGS__)
+#define DLOG_PUT_3(w, a, ...) DLOG_PUT(w, a); DLOG_PUT_2(w, __VA_ARGS__)
+#define DLOG_PUT_4(w, a, ...) DLOG_PUT(w, a); DLOG_PUT_3(w, __VA_ARGS__)
+#define DLOG_PUT_5(w, a, ...) DLOG_PUT(w, a); DLOG_PUT_4(w, __VA_ARGS__)
+#define DLOG_PUT_6(w, a, ...) DLOG_PUT(w, a); DLOG_PUT_5(w, __VA_ARGS__)
+#define DLOG_PUT_7(w, a, ...) DLOG_PUT(w, a); DLOG_PUT_6(w, __VA_ARGS__)
+#define DLOG_PUT_8(w, a, ...) DLOG_PUT(w, a); DLOG_PUT_7(w, __VA_ARGS__)
+#define DLOG_CAT_(a, b) a##b
+#define DLOG_CAT(a, b) DLOG_CAT_(a, b)
+#define DLOG_PUT_ALL(w, ...) DLOG_CAT(DLOG_PUT_, DLOG_COUNT(__VA_ARGS__))(w, ##__VA_ARGS__)
+
+// Write one record of site and the arguments to ring, or count it dropped
+#define DLOG_RING_WRITE(ring, site, time_ms, ...)                                                           \
+    do                                                                                                        \
+    {                                                                                                         \
+        dlog_writer_t dlog_w_;                                                                                \
+        if (dlog_ring_begin((ring), &dlog_w_, (site), (time_ms)))                                             \
+        {                                                                                                     \
+            DLOG_PUT_ALL(&dlog_w_, ##__VA_ARGS__);                                                            \
+            dlog_ring_commit(&dlog_w_);                                                                       \
+        }                                                                                                     \
+    } while (0)
+
+// Copy the oldest unread record out and free its slot; false if there is none yet
+bool dlog_ring_read(dlog_ring_t *ring, dlog_record_t *out);
+
+// Records dropped since the last call
+uint32_t dlog_ring_take_dropped(dlog_ring_t *ring);
+
+// The record's message, as printf would have written it from the same format and arguments
+// Returns the length it would have had, as snprintf does
+int dlog_ring_format(const dlog_record_t *record, char *out, size_t out_len);
+
+#endif // DLOG_RING_H
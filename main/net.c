@@ -0,0 +1,659 @@
+#include <errno.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/param.h>
+#include <unistd.h>
+
+#include "esp_log.h"
+#include "esp_random.h"
+#include "esp_timer.h"
+#include "esp_vfs_eventfd.h"
+#include "freertos/queue.h"
+#include "freertos/task.h"
+
+#include "lwip/netdb.h"
+#include "lwip/sockets.h"
+
+#include "./boot.h"
+#include "./collar_config.h"
+#include "./dlog.h"
+#include "./net.h"
+#include "./net_proto.h"
+#include "./ota.h"
+#include "./static_alloc.h"
+#include "./task_plan.h"
+#include "./timesync.h"
+
+#include <arpa/inet.h>
+
+static const char *TAG = "net";
+
+typedef struct
+{
+    uint16_t len;
+    char text[NET_STATUS_MAX];
+} net_status_t;
+
+typedef struct
+{
+    uint16_t len;
+    char text[NET_TEXT_MAX];
+} net_text_t;
+
+typedef enum
+{
+    WS_OFF,        // Not used on this collar
+    WS_WAITING,    // Until retry_us
+    WS_CONNECTING, // TCP connect in progress
+    WS_UPGRADING,  // Upgrade request sent, reading the response
+    WS_OPEN,
+} ws_state_t;
+
+static QueueHandle_t s_status_queue;
+static StaticQueue_t s_status_queue_buf;
+static uint8_t s_status_storage[NET_STATUS_QUEUE_LEN * sizeof(net_status_t)];
+static QueueHandle_t s_text_queue;
+static StaticQueue_t s_text_queue_buf;
+static uint8_t s_text_storage[NET_TEXT_QUEUE_LEN * sizeof(net_text_t)];
+static int s_wake_fd = -1;
+
+static net_leader_fn s_on_leader;
+static net_seq_t s_leader_seq;
+static net_stats_t s_stats;
+
+// UDP: leader datagrams in, status records out
+static int s_udp_fd = -1;
+static struct sockaddr_in s_server_addr;
+
+// The WebSocket; only the network task touches it, other tasks read s_ws_open
+static struct
+{
+    ws_state_t state;
+    int fd;
+    int64_t retry_us;    // WS_WAITING: when to connect again
+    int64_t deadline_us; // WS_CONNECTING, WS_UPGRADING: when to give up
+    int64_t last_rx_us;
+    int64_t last_tx_us;
+    char host[CONFIG_WS_URI_LEN];
+    char port[8];
+    char path[CONFIG_WS_URI_LEN];
+    uint8_t nonce[NET_WS_NONCE_LEN]; // Of the upgrade in progress, to check the server's accept key
+    size_t rx_len;
+    uint8_t rx[NET_WS_RX_BUFFER];
+} s_ws = {.state = WS_OFF, .fd = -1};
+static atomic_bool s_ws_open;
+
+// Counted by the sending tasks, which run on either core; folded into the stats on read
+static atomic_uint s_dropped;
+
+static void wake(void)
+{
+    uint64_t one = 1;
+    write(s_wake_fd, &one, sizeof(one));
+}
+
+// WebSocket ///////////////////////////////////////////////////////////////////
+
+static void ws_drop(const char *reason)
+{
+    if (s_ws.fd >= 0)
+    {
+        close(s_ws.fd);
+        s_ws.fd = -1;
+    }
+    if (s_ws.state == WS_OPEN)
+    {
+        atomic_store(&s_ws_open, false);
+        s_stats.ws_connected = false;
+        DLOGI(WS, "WebSocket disconnected: %s", reason);
+    }
+    else
+    {
+        DLOGW(WS, "WebSocket connect failed: %s", reason);
+    }
+    s_ws.state = WS_WAITING;
+    s_ws.retry_us = esp_timer_get_time() + NET_WS_RECONNECT_MS * 1000LL;
+    s_ws.rx_len = 0;
+}
+
+// Write all of buf, waiting for room in the socket's send buffer up to NET_WS_SEND_TIMEOUT_MS
+static bool ws_write(const uint8_t *buf, size_t len)
+{
+    int64_t deadline_us = esp_timer_get_time() + NET_WS_SEND_TIMEOUT_MS * 1000LL;
+    while (len > 0)
+    {
+        static_alloc_exempt_begin(); // lwIP's pbufs
+        ssize_t sent = send(s_ws.fd, buf, len, 0);
+        static_alloc_exempt_end();
+        if (sent > 0)
+        {
+            buf += sent;
+            len -= (size_t)sent;
+            continue;
+        }
+        if (sent < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        int64_t left_us = deadline_us - esp_timer_get_time();
+        if (sent == 0 || (errno != EAGAIN && errno != EWOULDBLOCK) || left_us <= 0)
+        {
+            return false;
+        }
+        fd_set writable;
+        FD_ZERO(&writable);
+        FD_SET(s_ws.fd, &writable);
+        struct timeval timeout = {.tv_sec = left_us / 1000000, .tv_usec = left_us % 1000000};
+        select(s_ws.fd + 1, NULL, &writable, NULL, &timeout);
+    }
+    return true;
+}
+
+// One masked frame; drops the connection if it cannot be sent
+static bool ws_send(uint8_t op, const void *payload, size_t len)
+{
+    if (s_ws.state != WS_OPEN || len > NET_WS_TX_MAX)
+    {
+        return false;
+    }
+    uint8_t frame[NET_WS_HEADER_MAX + NET_WS_TX_MAX];
+    uint32_t mask_word = esp_random();
+    uint8_t mask[4];
+    memcpy(mask, &mask_word, sizeof(mask));
+    size_t header = net_ws_frame_header(frame, op, len, mask);
+    memcpy(frame + header, payload, len);
+    net_ws_mask(frame + header, len, mask);
+    if (!ws_write(frame, header + len))
+    {
+        ws_drop("send failed");
+        return false;
+    }
+    s_ws.last_tx_us = esp_timer_get_time();
+    s_stats.ws_tx_frames++;
+    return true;
+}
+
+static void ws_connect(void)
+{
+    struct addrinfo hints = {.ai_family = AF_INET, .ai_socktype = SOCK_STREAM};
+    struct addrinfo *res = NULL;
+    static_alloc_exempt_begin(); // The resolver and lwIP's PCBs
+    int fd = -1;
+    if (getaddrinfo(s_ws.host, s_ws.port, &hints, &res) == 0 && res != NULL)
+    {
+        fd = socket(res->ai_family, res->ai_socktype, res->ai_protocol);
+        if (fd >= 0)
+        {
+            fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+            if (connect(fd, res->ai_addr, res->ai_addrlen) != 0 && errno != EINPROGRESS)
+            {
+                close(fd);
+                fd = -1;
+            }
+        }
+    }
+    if (res != NULL)
+    {
+        freeaddrinfo(res);
+    }
+    static_alloc_exempt_end();
+
+    s_ws.fd = fd;
+    s_ws.state = WS_CONNECTING;
+    s_ws.deadline_us = esp_timer_get_time() + NET_WS_CONNECT_TIMEOUT_MS * 1000LL;
+    if (fd < 0)
+    {
+        ws_drop("no connection");
+    }
+}
+
+// The TCP connection is up: ask for the upgrade
+static void ws_upgrade(void)
+{
+    int err = 0;
+    socklen_t err_len = sizeof(err);
+    if (getsockopt(s_ws.fd, SOL_SOCKET, SO_ERROR, &err, &err_len) != 0 || err != 0)
+    {
+        ws_drop("connect refused");
+        return;
+    }
+    esp_fill_random(s_ws.nonce, sizeof(s_ws.nonce));
+    char request[NET_WS_TX_MAX];
+    size_t len = net_ws_handshake_request(request, sizeof(request), s_ws.host, s_ws.port, s_ws.path, s_ws.nonce);
+    s_ws.rx_len = 0;
+    if (len == 0 || !ws_write((const uint8_t *)request, len))
+    {
+        ws_drop("upgrade not sent");
+        return;
+    }
+    s_ws.state = WS_UPGRADING;
+}
+
+static void ws_opened(void)
+{
+    s_ws.state = WS_OPEN;
+    s_ws.last_rx_us = s_ws.last_tx_us = esp_timer_get_time();
+    atomic_store(&s_ws_open, true);
+    s_stats.ws_connected = true;
+    s_stats.ws_connects++;
+    DLOGI(WS, "WebSocket connected");
+
+    // Reaching the server proves a freshly pushed network config (or firmware) works
+    config_confirm();
+    ota_confirm();
+
+    boot_mark(BOOT_MARK_FIRST_UPLINK);
+
+    // Tell the server which cat this is so it can address config pushes and pick OTA patches,
+    // how long this boot took to start sampling and to reach it, and that leaders may be numbered
+    collar_config_t cfg;
+    config_get(&cfg);
+    char hello[160];
+    int len = snprintf(hello, sizeof(hello), "HELLO %s rev=%u fw=%s boot_sample=%d boot_uplink=%d leader=seq",
+                       cfg.cat_id, (unsigned)cfg.revision, ota_running_version(),
+                       (int)boot_mark_ms(BOOT_MARK_FIRST_SAMPLE), (int)boot_mark_ms(BOOT_MARK_FIRST_UPLINK));
+    ws_send(NET_WS_OP_TEXT, hello, (size_t)MIN(len, (int)sizeof(hello) - 1));
+}
+
+// Messages ////////////////////////////////////////////////////////////////////
+
+// A leader push from either path; numbered ones are handled once
+static void handle_leader(const char *msg, size_t len)
+{
+    char leader_id[CONFIG_CAT_ID_LEN];
+    uint32_t seq;
+    bool has_seq;
+    if (!net_leader_parse(msg, len, leader_id, sizeof(leader_id), &seq, &has_seq))
+    {
+        DLOGD(NET, "Ignored %d bytes", (int)len);
+        return;
+    }
+    if (has_seq && !net_seq_fresh(&s_leader_seq, seq))
+    {
+        s_stats.duplicates++;
+        return;
+    }
+    s_stats.leaders++;
+    s_on_leader(leader_id);
+}
+
+static void handle_text(const char *msg, size_t len)
+{
+    // Time sync replies first and quietly: their receive stamp must not wait on anything
+    if (timesync_handle_message(msg, len))
+    {
+        return;
+    }
+    DLOGD(WS, "Received %d bytes", (int)len);
+
+    // Config pushes share the channel with leader updates
+    char reply[NET_WS_TX_MAX];
+    if (config_handle_message(msg, len, reply, sizeof(reply)))
+    {
+        ESP_LOGI(TAG, "%s", reply);
+        ws_send(NET_WS_OP_TEXT, reply, strlen(reply));
+        return;
+    }
+
+    // Firmware updates run in their own task and reply through net_send_text
+    if (ota_handle_message(msg, len))
+    {
+        return;
+    }
+    handle_leader(msg, len);
+}
+
+// Everything complete in the receive buffer
+static void ws_read_frames(void)
+{
+    size_t at = 0;
+    while (s_ws.state == WS_OPEN)
+    {
+        net_ws_frame_t frame;
+        int used = net_ws_frame_parse(s_ws.rx + at, s_ws.rx_len - at, sizeof(s_ws.rx), &frame);
+        if (used < 0)
+        {
+            ws_drop("frame too large or malformed");
+            return;
+        }
+        if (used == 0)
+        {
+            break;
+        }
+        at += (size_t)used;
+        s_stats.ws_rx_frames++;
+        switch (frame.op)
+        {
+        case NET_WS_OP_TEXT:
+            if (frame.fin)
+            {
+                handle_text((const char *)frame.payload, frame.len);
+            }
+            break;
+        case NET_WS_OP_PING:
+            ws_send(NET_WS_OP_PONG, frame.payload, frame.len);
+            break;
+        case NET_WS_OP_CLOSE:
+            ws_send(NET_WS_OP_CLOSE, frame.payload, MIN(frame.len, (size_t)2));
+            ws_drop("closed by the server");
+            return;
+        default:
+            break; // Pongs, binary frames and fragments: the server sends none of these to collars
+        }
+    }
+    // A failed pong or config reply drops the connection, which has already emptied the buffer
+    if (s_ws.state != WS_OPEN)
+    {
+        return;
+    }
+    memmove(s_ws.rx, s_ws.rx + at, s_ws.rx_len - at);
+    s_ws.rx_len -= at;
+}
+
+static void ws_readable(void)
+{
+    ssize_t n = recv(s_ws.fd, s_ws.rx + s_ws.rx_len, sizeof(s_ws.rx) - s_ws.rx_len, 0);
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+    {
+        return;
+    }
+    if (n <= 0)
+    {
+        ws_drop(n == 0 ? "closed" : "receive failed");
+        return;
+    }
+    s_ws.rx_len += (size_t)n;
+    s_ws.last_rx_us = esp_timer_get_time();
+
+    if (s_ws.state == WS_UPGRADING)
+    {
+        int header = net_ws_handshake_response(s_ws.rx, s_ws.rx_len, s_ws.nonce);
+        if (header < 0 || (header == 0 && s_ws.rx_len == sizeof(s_ws.rx)))
+        {
+            ws_drop("upgrade refused");
+            return;
+        }
+        if (header == 0)
+        {
+            return;
+        }
+        memmove(s_ws.rx, s_ws.rx + header, s_ws.rx_len - (size_t)header);
+        s_ws.rx_len -= (size_t)header;
+        ws_opened();
+    }
+    ws_read_frames();
+}
+
+// Deadlines: reconnects, connect timeouts, pings and silence; returns the next one
+static int64_t ws_timers(int64_t now_us)
+{
+    switch (s_ws.state)
+    {
+    case WS_WAITING:
+        if (now_us < s_ws.retry_us)
+        {
+            return s_ws.retry_us;
+        }
+        ws_connect();
+        return s_ws.state == WS_WAITING ? s_ws.retry_us : s_ws.deadline_us;
+    case WS_CONNECTING:
+    case WS_UPGRADING:
+        if (now_us >= s_ws.deadline_us)
+        {
+            ws_drop("timed out");
+            return s_ws.retry_us;
+        }
+        return s_ws.deadline_us;
+    case WS_OPEN:
+        if (now_us - s_ws.last_rx_us >= NET_WS_SILENCE_MS * 1000LL)
+        {
+            ws_drop("silent");
+            return s_ws.retry_us;
+        }
+        if (now_us - s_ws.last_tx_us >= NET_WS_PING_MS * 1000LL)
+        {
+            ws_send(NET_WS_OP_PING, NULL, 0);
+        }
+        return MIN(s_ws.last_tx_us + NET_WS_PING_MS * 1000LL, s_ws.last_rx_us + NET_WS_SILENCE_MS * 1000LL);
+    default:
+        return INT64_MAX;
+    }
+}
+
+// Queues //////////////////////////////////////////////////////////////////////
+
+static void send_datagram(const char *buf, size_t len, int records)
+{
+    static_alloc_exempt_begin(); // lwIP's netbuf and pbuf
+    ssize_t sent = sendto(s_udp_fd, buf, len, 0, (struct sockaddr *)&s_server_addr, sizeof(s_server_addr));
+    static_alloc_exempt_end();
+    if (sent < 0)
+    {
+        DLOGE(NET, "Failed to send status: errno %d", errno);
+        return;
+    }
+    s_stats.datagrams++;
+    s_stats.records += (uint32_t)records;
+    boot_mark(BOOT_MARK_FIRST_UPLINK);
+}
+
+// Status records waiting together share a datagram, one per line
+static void drain_status(void)
+{
+    char datagram[NET_DATAGRAM_MAX];
+    size_t used = 0;
+    int records = 0;
+    net_status_t status;
+    while (xQueueReceive(s_status_queue, &status, 0) == pdTRUE)
+    {
+        if (used + status.len > sizeof(datagram))
+        {
+            send_datagram(datagram, used, records);
+            used = 0;
+            records = 0;
+        }
+        memcpy(datagram + used, status.text, status.len);
+        used += status.len;
+        records++;
+    }
+    if (records > 0)
+    {
+        send_datagram(datagram, used, records);
+    }
+}
+
+static void drain_text(void)
+{
+    net_text_t text;
+    while (xQueueReceive(s_text_queue, &text, 0) == pdTRUE)
+    {
+        ws_send(NET_WS_OP_TEXT, text.text, text.len); // Dropped if the connection went meanwhile
+    }
+}
+
+// Task ////////////////////////////////////////////////////////////////////////
+
+static void udp_readable(void)
+{
+    char rx[64];
+    for (;;)
+    {
+        struct sockaddr_in source;
+        socklen_t source_len = sizeof(source);
+        int len = recvfrom(s_udp_fd, rx, sizeof(rx), 0, (struct sockaddr *)&source, &source_len);
+        if (len < 0)
+        {
+            if (errno != EAGAIN && errno != EWOULDBLOCK)
+            {
+                DLOGE(NET, "Error receiving data: errno %d", errno);
+            }
+            return;
+        }
+        handle_leader(rx, (size_t)len);
+    }
+}
+
+static void net_task(void *arg)
+{
+    for (;;)
+    {
+        int64_t next_us = ws_timers(esp_timer_get_time());
+
+        fd_set readable;
+        fd_set writable;
+        FD_ZERO(&readable);
+        FD_ZERO(&writable);
+        FD_SET(s_wake_fd, &readable);
+        int max_fd = s_wake_fd;
+        if (s_udp_fd >= 0)
+        {
+            FD_SET(s_udp_fd, &readable);
+            max_fd = MAX(max_fd, s_udp_fd);
+        }
+        if (s_ws.fd >= 0)
+        {
+            FD_SET(s_ws.fd, s_ws.state == WS_CONNECTING ? &writable : &readable);
+            max_fd = MAX(max_fd, s_ws.fd);
+        }
+
+        struct timeval timeout;
+        struct timeval *wait = NULL;
+        if (next_us != INT64_MAX)
+        {
+            int64_t left_us = MAX(next_us - esp_timer_get_time(), 0);
+            timeout = (struct timeval){.tv_sec = left_us / 1000000, .tv_usec = left_us % 1000000};
+            wait = &timeout;
+        }
+        int ready = select(max_fd + 1, &readable, &writable, NULL, wait);
+        s_stats.wakeups++;
+        if (ready < 0)
+        {
+            if (errno != EINTR)
+            {
+                DLOGE(NET, "select failed: errno %d", errno);
+                vTaskDelay(pdMS_TO_TICKS(100)); // Not a hot loop if it keeps failing
+            }
+            continue;
+        }
+
+        if (FD_ISSET(s_wake_fd, &readable))
+        {
+            uint64_t count;
+            read(s_wake_fd, &count, sizeof(count));
+        }
+        if (s_udp_fd >= 0 && FD_ISSET(s_udp_fd, &readable))
+        {
+            udp_readable();
+        }
+        if (s_ws.fd >= 0 && s_ws.state == WS_CONNECTING && FD_ISSET(s_ws.fd, &writable))
+        {
+            ws_upgrade();
+        }
+        else if (s_ws.fd >= 0 && FD_ISSET(s_ws.fd, &readable))
+        {
+            ws_readable();
+        }
+
+        // The queues are cheap to look at, so every wake-up drains them
+        drain_status();
+        drain_text();
+    }
+}
+
+// API /////////////////////////////////////////////////////////////////////////
+
+void net_init(const collar_config_t *cfg, bool websocket, net_leader_fn on_leader, UBaseType_t prio,
+              BaseType_t core, uint32_t stack)
+{
+    s_on_leader = on_leader;
+    s_status_queue = xQueueCreateStatic(NET_STATUS_QUEUE_LEN, sizeof(net_status_t), s_status_storage,
+                                        &s_status_queue_buf);
+    s_text_queue = xQueueCreateStatic(NET_TEXT_QUEUE_LEN, sizeof(net_text_t), s_text_storage, &s_text_queue_buf);
+
+    const esp_vfs_eventfd_config_t eventfd_cfg = ESP_VFS_EVENTD_CONFIG_DEFAULT();
+    esp_vfs_eventfd_register(&eventfd_cfg);
+    s_wake_fd = eventfd(0, 0);
+    if (s_wake_fd < 0)
+    {
+        ESP_LOGE(TAG, "No eventfd: errno %d", errno);
+        return;
+    }
+
+    memset(&s_server_addr, 0, sizeof(s_server_addr));
+    s_server_addr.sin_family = AF_INET;
+    s_server_addr.sin_port = htons(cfg->udp_port);
+    inet_pton(AF_INET, cfg->host_ip, &s_server_addr.sin_addr);
+
+    s_udp_fd = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    struct sockaddr_in local_addr = {
+        .sin_family = AF_INET,
+        .sin_port = htons(cfg->udp_port),
+        .sin_addr.s_addr = htonl(INADDR_ANY),
+    };
+    if (s_udp_fd < 0 || bind(s_udp_fd, (struct sockaddr *)&local_addr, sizeof(local_addr)) < 0)
+    {
+        ESP_LOGE(TAG, "UDP socket unavailable: errno %d", errno);
+    }
+    else
+    {
+        fcntl(s_udp_fd, F_SETFL, fcntl(s_udp_fd, F_GETFL, 0) | O_NONBLOCK);
+        ESP_LOGI(TAG, "Listening for leader notifications on port %u", (unsigned)cfg->udp_port);
+    }
+
+    if (websocket)
+    {
+        if (net_ws_parse_uri(cfg->ws_uri, s_ws.host, sizeof(s_ws.host), s_ws.port, sizeof(s_ws.port), s_ws.path,
+                             sizeof(s_ws.path)))
+        {
+            s_ws.state = WS_WAITING; // The task connects as soon as it starts
+            s_ws.retry_us = 0;
+        }
+        else
+        {
+            ESP_LOGE(TAG, "Unsupported WebSocket URI: %s", cfg->ws_uri);
+        }
+    }
+
+    task_plan_create(net_task, "net", stack, NULL, prio, core, NULL);
+}
+
+bool net_send_status(const char *record, size_t len)
+{
+    if (s_status_queue == NULL || s_wake_fd < 0)
+    {
+        return false;
+    }
+    net_status_t status = {.len = (uint16_t)MIN(len, sizeof(status.text))};
+    memcpy(status.text, record, status.len);
+    if (xQueueSend(s_status_queue, &status, 0) != pdTRUE)
+    {
+        atomic_fetch_add(&s_dropped, 1);
+        return false;
+    }
+    wake();
+    return true;
+}
+
+int net_send_text(const char *msg, int len)
+{
+    if (!atomic_load(&s_ws_open) || len < 0 || len > NET_TEXT_MAX)
+    {
+        return -1;
+    }
+    net_text_t text = {.len = (uint16_t)len};
+    memcpy(text.text, msg, (size_t)len);
+    if (xQueueSend(s_text_queue, &text, 0) != pdTRUE)
+    {
+        atomic_fetch_add(&s_dropped, 1);
+        return -1;
+    }
+    wake();
+    return len;
+}
+
+void net_get_stats(net_stats_t *out)
+{
+    *out = s_stats;
+    out->dropped = atomic_load(&s_dropped);
+}
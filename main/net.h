@@ -0,0 +1,81 @@
+/*
+  The collar's network task: one task and one select() for every socket.
+
+  It owns the UDP socket on the collar's port and the /buzz WebSocket, a
+  minimal ws:// client of its own (net_proto.h). The UDP socket takes leader
+  datagrams and sends the status records. The WebSocket takes leader and
+  config pushes, OTA commands and time sync replies, and carries everything
+  the collar says to the server. The task replaces the UDP listener, which
+  slept 100 ms after every datagram, and esp_websocket_client with its own
+  task and heap buffers.
+
+  Other tasks never touch a socket. They queue status records
+  (net_send_status) and text for the server (net_send_text), and an eventfd
+  in the same select() wakes the task at once. Records waiting together go
+  out in one datagram, one per line.
+
+  What arrives is handled as it is read. Time sync replies come first, so
+  their receive stamp is not held up by anything else. Config replies are
+  sent from here, and OTA commands go to the OTA task's queue. Each leader
+  push goes to on_leader once, from whichever path brought it first, so
+  on_leader must not block.
+
+  The WebSocket reconnects NET_WS_RECONNECT_MS after it drops. It pings the
+  server every NET_WS_PING_MS and gives up on a connection that has been
+  silent for NET_WS_SILENCE_MS.
+*/
+
+#ifndef NET_H
+#define NET_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "freertos/FreeRTOS.h"
+
+#include "./collar_config.h"
+
+#define NET_STATUS_MAX 192           // One status record, newline included
+#define NET_STATUS_QUEUE_LEN 4
+#define NET_TEXT_MAX 128             // Time sync requests and OTA replies
+#define NET_TEXT_QUEUE_LEN 4
+#define NET_DATAGRAM_MAX 512         // Status records batched into one datagram
+#define NET_WS_RX_BUFFER 1024        // Largest frame the server sends, a config push
+#define NET_WS_TX_MAX CONFIG_REPLY_MAX // Largest message the collar sends, a config reply
+#define NET_WS_CONNECT_TIMEOUT_MS 10000 // TCP connect and the upgrade
+#define NET_WS_SEND_TIMEOUT_MS 1000
+#define NET_WS_RECONNECT_MS 10000
+#define NET_WS_PING_MS 10000
+#define NET_WS_SILENCE_MS 30000
+
+// Called in the network task with each new leader
+typedef void (*net_leader_fn)(const char *leader_id);
+
+typedef struct
+{
+    bool ws_connected;
+    uint32_t ws_connects;
+    uint32_t ws_rx_frames;
+    uint32_t ws_tx_frames;
+    uint32_t wakeups;       // Returns from select()
+    uint32_t leaders;       // Leader pushes handed to on_leader
+    uint32_t duplicates;    // Pushes already handled, from the other path
+    uint32_t datagrams;     // Status datagrams sent
+    uint32_t records;       // Status records in them
+    uint32_t dropped;       // Records and text the queues had no room for
+} net_stats_t;
+
+// Bind the UDP socket and start the task; websocket is false on a relay leaf, which cannot reach the server
+void net_init(const collar_config_t *cfg, bool websocket, net_leader_fn on_leader, UBaseType_t prio,
+              BaseType_t core, uint32_t stack);
+
+// Queue one status record, newline included; false if the task is not running or the queue is full
+bool net_send_status(const char *record, size_t len);
+
+// Queue one text message for the WebSocket; returns len, or -1 while disconnected or full
+int net_send_text(const char *msg, int len);
+
+void net_get_stats(net_stats_t *out);
+
+#endif // NET_H
@@ -0,0 +1,290 @@
+#include <ctype.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+
+#include "mbedtls/sha1.h"
+
+#include "./net_proto.h"
+
+#define NET_WS_DEFAULT_PORT "80"
+#define NET_WS_CONTROL_MAX 125 // Longest control frame payload
+#define NET_WS_GUID "258EAFA5-E914-47DA-95CA-C5AB0DC85B11" // RFC 6455, section 1.3
+#define NET_WS_KEY_LEN (4 * ((NET_WS_NONCE_LEN + 2) / 3))
+
+bool net_ws_parse_uri(const char *uri, char *host, size_t host_len, char *port, size_t port_len, char *path,
+                      size_t path_len)
+{
+    if (uri == NULL || strncmp(uri, "ws://", 5) != 0)
+    {
+        return false;
+    }
+    const char *start = uri + 5;
+    const char *slash = strchr(start, '/');
+    const char *host_end = slash ? slash : start + strlen(start);
+    const char *colon = memchr(start, ':', (size_t)(host_end - start));
+
+    size_t name_len = (size_t)((colon ? colon : host_end) - start);
+    size_t digits = colon ? (size_t)(host_end - colon - 1) : strlen(NET_WS_DEFAULT_PORT);
+    const char *rest = slash ? slash : "/";
+    if (name_len == 0 || name_len >= host_len || digits == 0 || digits >= port_len || strlen(rest) >= path_len)
+    {
+        return false;
+    }
+    memcpy(host, start, name_len);
+    host[name_len] = '\0';
+    memcpy(port, colon ? colon + 1 : NET_WS_DEFAULT_PORT, digits);
+    port[digits] = '\0';
+    strcpy(path, rest);
+    return true;
+}
+
+static void base64_encode(const uint8_t *in, size_t len, char *out)
+{
+    static const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    size_t o = 0;
+    for (size_t i = 0; i < len; i += 3)
+    {
+        uint32_t chunk = (uint32_t)in[i] << 16;
+        chunk |= (i + 1 < len) ? (uint32_t)in[i + 1] << 8 : 0;
+        chunk |= (i + 2 < len) ? in[i + 2] : 0;
+        out[o++] = alphabet[(chunk >> 18) & 0x3F];
+        out[o++] = alphabet[(chunk >> 12) & 0x3F];
+        out[o++] = (i + 1 < len) ? alphabet[(chunk >> 6) & 0x3F] : '=';
+        out[o++] = (i + 2 < len) ? alphabet[chunk & 0x3F] : '=';
+    }
+    out[o] = '\0';
+}
+
+size_t net_ws_handshake_request(char *out, size_t out_len, const char *host, const char *port, const char *path,
+                                const uint8_t nonce[NET_WS_NONCE_LEN])
+{
+    char key[NET_WS_KEY_LEN + 1];
+    base64_encode(nonce, NET_WS_NONCE_LEN, key);
+    int len = snprintf(out, out_len,
+                       "GET %s HTTP/1.1\r\n"
+                       "Host: %s:%s\r\n"
+                       "Upgrade: websocket\r\n"
+                       "Connection: Upgrade\r\n"
+                       "Sec-WebSocket-Key: %s\r\n"
+                       "Sec-WebSocket-Version: 13\r\n"
+                       "\r\n",
+                       path, host, port, key);
+    return (len > 0 && (size_t)len < out_len) ? (size_t)len : 0;
+}
+
+void net_ws_accept_key(const uint8_t nonce[NET_WS_NONCE_LEN], char out[NET_WS_ACCEPT_LEN + 1])
+{
+    char keyed[NET_WS_KEY_LEN + sizeof(NET_WS_GUID)];
+    base64_encode(nonce, NET_WS_NONCE_LEN, keyed);
+    memcpy(keyed + NET_WS_KEY_LEN, NET_WS_GUID, sizeof(NET_WS_GUID) - 1);
+    uint8_t digest[20];
+    mbedtls_sha1((const unsigned char *)keyed, NET_WS_KEY_LEN + sizeof(NET_WS_GUID) - 1, digest);
+    base64_encode(digest, sizeof(digest), out);
+}
+
+// The value of header name (case-insensitive) in headers, trimmed; false if it is not there
+static bool find_header(const char *headers, size_t len, const char *name, const char **value, size_t *value_len)
+{
+    size_t name_len = strlen(name);
+    const char *end = headers + len;
+    for (const char *line = headers; line < end;)
+    {
+        const char *eol = memchr(line, '\r', (size_t)(end - line));
+        eol = eol ? eol : end;
+        if ((size_t)(eol - line) > name_len && line[name_len] == ':' && strncasecmp(line, name, name_len) == 0)
+        {
+            const char *v = line + name_len + 1;
+            const char *v_end = eol;
+            while (v < v_end && (*v == ' ' || *v == '\t'))
+            {
+                v++;
+            }
+            while (v_end > v && (v_end[-1] == ' ' || v_end[-1] == '\t'))
+            {
+                v_end--;
+            }
+            *value = v;
+            *value_len = (size_t)(v_end - v);
+            return true;
+        }
+        line = eol + 2; // Past "\r\n"
+    }
+    return false;
+}
+
+int net_ws_handshake_response(const uint8_t *buf, size_t len, const uint8_t nonce[NET_WS_NONCE_LEN])
+{
+    static const char status[] = "HTTP/1.1 101";
+    for (size_t i = 0; i + 4 <= len; i++)
+    {
+        if (memcmp(buf + i, "\r\n\r\n", 4) != 0)
+        {
+            continue;
+        }
+        if (i + 4 < sizeof(status) - 1 || memcmp(buf, status, sizeof(status) - 1) != 0)
+        {
+            return -1;
+        }
+        // Only a server that read our key can answer with its hash
+        char expected[NET_WS_ACCEPT_LEN + 1];
+        net_ws_accept_key(nonce, expected);
+        const char *accept;
+        size_t accept_len;
+        if (!find_header((const char *)buf, i + 2, "Sec-WebSocket-Accept", &accept, &accept_len) ||
+            accept_len != NET_WS_ACCEPT_LEN || memcmp(accept, expected, NET_WS_ACCEPT_LEN) != 0)
+        {
+            return -1;
+        }
+        return (int)(i + 4);
+    }
+    return 0;
+}
+
+void net_ws_mask(uint8_t *payload, size_t len, const uint8_t mask[4])
+{
+    for (size_t i = 0; i < len; i++)
+    {
+        payload[i] ^= mask[i & 3];
+    }
+}
+
+size_t net_ws_frame_header(uint8_t *out, uint8_t op, size_t len, const uint8_t mask[4])
+{
+    size_t n = 0;
+    out[n++] = 0x80 | (op & 0x0F); // Always final
+    if (len < 126)
+    {
+        out[n++] = 0x80 | (uint8_t)len;
+    }
+    else if (len <= 0xFFFF)
+    {
+        out[n++] = 0x80 | 126;
+        out[n++] = (uint8_t)(len >> 8);
+        out[n++] = (uint8_t)len;
+    }
+    else
+    {
+        out[n++] = 0x80 | 127;
+        for (int shift = 56; shift >= 0; shift -= 8)
+        {
+            out[n++] = (uint8_t)((uint64_t)len >> shift);
+        }
+    }
+    memcpy(out + n, mask, 4);
+    return n + 4;
+}
+
+int net_ws_frame_parse(uint8_t *buf, size_t len, size_t buf_cap, net_ws_frame_t *frame)
+{
+    if (len < 2)
+    {
+        return 0;
+    }
+    uint8_t op = buf[0] & 0x0F;
+    bool masked = (buf[1] & 0x80) != 0;
+    uint64_t payload_len = buf[1] & 0x7F;
+    size_t header = 2;
+    if ((buf[0] & 0x70) != 0 || (op >= NET_WS_OP_CLOSE && payload_len > NET_WS_CONTROL_MAX))
+    {
+        return -1; // Extensions were never negotiated, and control frames are short
+    }
+    if (payload_len >= 126)
+    {
+        size_t ext = payload_len == 126 ? 2 : 8;
+        if (len < header + ext)
+        {
+            return 0;
+        }
+        payload_len = 0;
+        for (size_t i = 0; i < ext; i++)
+        {
+            payload_len = (payload_len << 8) | buf[header + i];
+        }
+        header += ext;
+    }
+    if (masked)
+    {
+        header += 4;
+    }
+    if (payload_len > buf_cap || header + payload_len > buf_cap)
+    {
+        return -1;
+    }
+    if (len < header + payload_len)
+    {
+        return 0;
+    }
+    frame->op = op;
+    frame->fin = (buf[0] & 0x80) != 0;
+    frame->payload = buf + header;
+    frame->len = (size_t)payload_len;
+    if (masked)
+    {
+        net_ws_mask(frame->payload, frame->len, buf + header - 4);
+    }
+    return (int)(header + payload_len);
+}
+
+// Leader messages /////////////////////////////////////////////////////////////
+
+// A cat ID: at least one character, no spaces or control characters, and room for the terminator
+static bool copy_id(const char *p, size_t len, char *id, size_t id_len)
+{
+    if (len == 0 || len >= id_len)
+    {
+        return false;
+    }
+    for (size_t i = 0; i < len; i++)
+    {
+        if ((unsigned char)p[i] <= ' ')
+        {
+            return false;
+        }
+    }
+    memcpy(id, p, len);
+    id[len] = '\0';
+    return true;
+}
+
+bool net_leader_parse(const char *msg, size_t len, char *id, size_t id_len, uint32_t *seq, bool *has_seq)
+{
+    static const char prefix[] = "LEADER ";
+    while (len > 0 && (msg[len - 1] == '\n' || msg[len - 1] == '\r'))
+    {
+        len--; // UDP senders may end the line
+    }
+    if (len < sizeof(prefix) - 1 || memcmp(msg, prefix, sizeof(prefix) - 1) != 0)
+    {
+        *has_seq = false;
+        return copy_id(msg, len, id, id_len);
+    }
+
+    size_t at = sizeof(prefix) - 1;
+    uint64_t value = 0;
+    size_t digits = 0;
+    while (at < len && msg[at] >= '0' && msg[at] <= '9' && digits < 10)
+    {
+        value = value * 10 + (uint64_t)(msg[at++] - '0');
+        digits++;
+    }
+    if (digits == 0 || value > UINT32_MAX || at >= len || msg[at] != ' ')
+    {
+        return false;
+    }
+    at++;
+    *seq = (uint32_t)value;
+    *has_seq = true;
+    return copy_id(msg + at, len - at, id, id_len);
+}
+
+bool net_seq_fresh(net_seq_t *state, uint32_t seq)
+{
+    if (state->seen && (int32_t)(seq - state->last) <= 0)
+    {
+        return false;
+    }
+    state->last = seq;
+    state->seen = true;
+    return true;
+}
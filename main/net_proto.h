@@ -0,0 +1,93 @@
+/*
+  Wire formats of the network task (net.c): the /buzz WebSocket as a minimal
+  ws:// client, and the leader messages that come over it and over UDP.
+
+  Pure C with no ESP-IDF dependencies beyond mbedtls's SHA-1.
+
+  WebSocket (RFC 6455, client side only): an HTTP/1.1 upgrade request, then
+  frames. The server's 101 must carry the Sec-WebSocket-Accept derived from
+  the request's key, so a proxy or another endpoint that merely answers 101
+  is not taken for the server. Frames from the collar are masked, as a client's must be; frames
+  from the server are not. Fragmented messages and extensions are not
+  supported: the server sends every message as one final frame, and a frame
+  that does not fit the receive buffer drops the connection.
+
+  Leader messages, on either path:
+    LEADER <seq> <cat_id>   seq is the server's push counter, seeded from its
+                            clock so it keeps growing across restarts
+    <cat_id>                a server that does not number its pushes
+  The same push arrives on both paths; net_seq_fresh() lets only the first
+  one through.
+*/
+
+#ifndef NET_PROTO_H
+#define NET_PROTO_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define NET_WS_NONCE_LEN 16
+#define NET_WS_HEADER_MAX 14 // Client frame header: 2, 8 of extended length, 4 of mask
+#define NET_WS_ACCEPT_LEN 28 // base64 of a SHA-1
+
+typedef enum
+{
+    NET_WS_OP_CONT = 0x0,
+    NET_WS_OP_TEXT = 0x1,
+    NET_WS_OP_BINARY = 0x2,
+    NET_WS_OP_CLOSE = 0x8,
+    NET_WS_OP_PING = 0x9,
+    NET_WS_OP_PONG = 0xA,
+} net_ws_op_t;
+
+// One frame from the server; payload points into the receive buffer
+typedef struct
+{
+    uint8_t op;
+    bool fin;
+    uint8_t *payload;
+    size_t len;
+} net_ws_frame_t;
+
+// Split ws://host[:port][/path]; false for any other scheme or a field too long
+bool net_ws_parse_uri(const char *uri, char *host, size_t host_len, char *port, size_t port_len, char *path,
+                      size_t path_len);
+
+// The upgrade request, with the nonce as its key; returns its length, or 0 if out is too small
+size_t net_ws_handshake_request(char *out, size_t out_len, const char *host, const char *port, const char *path,
+                                const uint8_t nonce[NET_WS_NONCE_LEN]);
+
+// Length of the response headers once they are complete, 0 while they are not, or -1
+// if the server did not switch protocols or its Sec-WebSocket-Accept does not match nonce
+int net_ws_handshake_response(const uint8_t *buf, size_t len, const uint8_t nonce[NET_WS_NONCE_LEN]);
+
+// The Sec-WebSocket-Accept a server must answer the request made with nonce:
+// base64(SHA-1(base64(nonce) + the RFC 6455 GUID)), terminated
+void net_ws_accept_key(const uint8_t nonce[NET_WS_NONCE_LEN], char out[NET_WS_ACCEPT_LEN + 1]);
+
+// Write the header of a masked client frame of len bytes and mask payload in place; returns the header length
+size_t net_ws_frame_header(uint8_t *out, uint8_t op, size_t len, const uint8_t mask[4]);
+void net_ws_mask(uint8_t *payload, size_t len, const uint8_t mask[4]);
+
+// Parse the frame at the start of buf, unmasking it in place if the server masked it.
+// Returns the bytes it takes, 0 if it is not all there yet, or -1 if it can never fit
+// in buf_cap bytes or is malformed
+int net_ws_frame_parse(uint8_t *buf, size_t len, size_t buf_cap, net_ws_frame_t *frame);
+
+// Leader messages /////////////////////////////////////////////////////////////
+
+// Parse a leader message into id (terminated); has_seq is false for a bare ID.
+// Returns false for anything else, such as the server's welcome text
+bool net_leader_parse(const char *msg, size_t len, char *id, size_t id_len, uint32_t *seq, bool *has_seq);
+
+typedef struct
+{
+    uint32_t last;
+    bool seen;
+} net_seq_t;
+
+// True, and remembered, if seq is newer than every one seen (serial arithmetic, so it may wrap)
+bool net_seq_fresh(net_seq_t *state, uint32_t seq);
+
+#endif // NET_PROTO_H
@@ -0,0 +1,365 @@
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "esp_app_desc.h"
+#include "esp_http_client.h"
+#include "esp_log.h"
+#include "esp_ota_ops.h"
+#include "esp_partition.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "freertos/queue.h"
+#include "freertos/task.h"
+#include "mbedtls/sha256.h"
+
+#include "./ota.h"
+#include "./ota_patch.h"
+#include "./static_alloc.h"
+#include "./task_plan.h"
+
+#define OTA_HASH_CHUNK 1024
+
+static const char *TAG = "ota";
+
+typedef struct
+{
+    char version[OTA_VERSION_LEN];
+    char url[OTA_URL_LEN];
+    uint32_t size; // Patch bytes, as announced
+} ota_request_t;
+
+// State of one update, shared with the ota_patch callbacks
+typedef struct
+{
+    const esp_partition_t *running;
+    const esp_partition_t *target;
+    esp_ota_handle_t handle;
+    bool begun;
+    mbedtls_sha256_context sha;
+    const char *reason; // Set by a callback that refuses to go on
+} ota_job_t;
+
+static ota_send_fn s_send;
+static QueueHandle_t s_requests;
+static StaticQueue_t s_requests_buf;
+static uint8_t s_requests_storage[sizeof(ota_request_t)];
+static volatile bool s_busy;
+static esp_timer_handle_t s_confirm_timer;
+
+// Kept off the task stack: the LZSS window and buffers are ~6 KB
+static ota_patch_t s_patch;
+static uint8_t s_buf[OTA_READ_CHUNK];
+static uint8_t s_hash_buf[OTA_HASH_CHUNK]; // s_buf is still being fed when the base is hashed
+
+static void reply(const char *fmt, const char *version, const char *detail)
+{
+    char msg[96];
+    int len = snprintf(msg, sizeof(msg), fmt, version, detail);
+    ESP_LOGI(TAG, "%s", msg);
+    if (s_send != NULL)
+    {
+        s_send(msg, len);
+    }
+}
+
+// Patch callbacks /////////////////////////////////////////////////////////////
+
+static bool base_matches(ota_job_t *job, const ota_patch_header_t *header)
+{
+    if (header->old_size > job->running->size)
+    {
+        return false;
+    }
+    uint8_t digest[32];
+    mbedtls_sha256_context sha;
+    mbedtls_sha256_init(&sha);
+    mbedtls_sha256_starts(&sha, 0);
+    bool ok = true;
+    for (uint32_t offset = 0; offset < header->old_size && ok; offset += OTA_HASH_CHUNK)
+    {
+        uint32_t len = header->old_size - offset;
+        len = (len > OTA_HASH_CHUNK) ? OTA_HASH_CHUNK : len;
+        ok = esp_partition_read(job->running, offset, s_hash_buf, len) == ESP_OK;
+        mbedtls_sha256_update(&sha, s_hash_buf, len);
+    }
+    mbedtls_sha256_finish(&sha, digest);
+    mbedtls_sha256_free(&sha);
+    return ok && memcmp(digest, header->old_sha256, sizeof(digest)) == 0;
+}
+
+static int patch_begin(void *ctx, const ota_patch_header_t *header)
+{
+    ota_job_t *job = ctx;
+    if (header->new_size > job->target->size)
+    {
+        job->reason = "too_large";
+        return -1;
+    }
+    // The running image is the base; a patch for another build would produce garbage
+    if (header->old_size > 0 && !base_matches(job, header))
+    {
+        job->reason = "wrong_base";
+        return -1;
+    }
+    esp_err_t err = esp_ota_begin(job->target, OTA_WITH_SEQUENTIAL_WRITES, &job->handle);
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "esp_ota_begin: %s", esp_err_to_name(err));
+        job->reason = "begin_failed";
+        return -1;
+    }
+    job->begun = true;
+    mbedtls_sha256_starts(&job->sha, 0);
+    ESP_LOGI(TAG, "Patching %" PRIu32 " -> %" PRIu32 " bytes into %s", header->old_size, header->new_size,
+             job->target->label);
+    return 0;
+}
+
+static int patch_read_old(void *ctx, uint32_t offset, uint8_t *buf, size_t len)
+{
+    ota_job_t *job = ctx;
+    return esp_partition_read(job->running, offset, buf, len) == ESP_OK ? 0 : -1;
+}
+
+static int patch_write_new(void *ctx, const uint8_t *buf, size_t len)
+{
+    ota_job_t *job = ctx;
+    mbedtls_sha256_update(&job->sha, buf, len);
+    return esp_ota_write(job->handle, buf, len) == ESP_OK ? 0 : -1;
+}
+
+// Update //////////////////////////////////////////////////////////////////////
+
+// Download and apply one patch; returns NULL on success or the NAK reason
+static const char *stream_patch(ota_job_t *job, const ota_request_t *request, uint32_t *received)
+{
+    esp_http_client_config_t config = {
+        .url = request->url,
+        .timeout_ms = OTA_HTTP_TIMEOUT_MS,
+    };
+    esp_http_client_handle_t http = esp_http_client_init(&config);
+    if (http == NULL)
+    {
+        return "http_init";
+    }
+    if (esp_http_client_open(http, 0) != ESP_OK)
+    {
+        esp_http_client_cleanup(http);
+        return "connect";
+    }
+    esp_http_client_fetch_headers(http);
+    if (esp_http_client_get_status_code(http) != 200)
+    {
+        esp_http_client_close(http);
+        esp_http_client_cleanup(http);
+        return "http_status";
+    }
+
+    const ota_patch_io_t io = {
+        .ctx = job,
+        .begin = patch_begin,
+        .read_old = patch_read_old,
+        .write_new = patch_write_new,
+    };
+    ota_patch_init(&s_patch, &io);
+
+    ota_patch_status_t status = OTA_PATCH_OK;
+    const char *reason = NULL;
+    while (status == OTA_PATCH_OK)
+    {
+        int n = esp_http_client_read(http, (char *)s_buf, sizeof(s_buf));
+        if (n < 0)
+        {
+            reason = "download";
+            break;
+        }
+        if (n == 0)
+        {
+            reason = "truncated";
+            break;
+        }
+        *received += n;
+        status = ota_patch_feed(&s_patch, s_buf, n);
+    }
+    // Anything after the image would have been data the patch did not describe
+    if (status == OTA_PATCH_DONE && esp_http_client_read(http, (char *)s_buf, 1) > 0)
+    {
+        status = OTA_PATCH_ERR_CORRUPT;
+    }
+    esp_http_client_close(http);
+    esp_http_client_cleanup(http);
+
+    if (status < 0)
+    {
+        reason = (status == OTA_PATCH_ERR_REJECTED && job->reason) ? job->reason : ota_patch_status_name(status);
+    }
+    return reason;
+}
+
+static const char *run_update(const ota_request_t *request, uint32_t *received)
+{
+    ota_job_t job = {
+        .running = esp_ota_get_running_partition(),
+        .target = esp_ota_get_next_update_partition(NULL),
+    };
+    if (job.running == NULL || job.target == NULL)
+    {
+        return "no_partition";
+    }
+    mbedtls_sha256_init(&job.sha);
+
+    const char *reason = stream_patch(&job, request, received);
+    if (job.begun)
+    {
+        uint8_t digest[32];
+        mbedtls_sha256_finish(&job.sha, digest);
+        if (reason == NULL && memcmp(digest, s_patch.header.new_sha256, sizeof(digest)) != 0)
+        {
+            reason = "checksum";
+        }
+    }
+    mbedtls_sha256_free(&job.sha);
+    if (reason != NULL)
+    {
+        if (job.begun)
+        {
+            esp_ota_abort(job.handle);
+        }
+        return reason;
+    }
+
+    // esp_ota_end() validates the image layout and its own appended hash
+    if (esp_ota_end(job.handle) != ESP_OK)
+    {
+        return "invalid_image";
+    }
+    if (esp_ota_set_boot_partition(job.target) != ESP_OK)
+    {
+        return "set_boot";
+    }
+    return NULL;
+}
+
+static void ota_task(void *arg)
+{
+    ota_request_t request;
+    while (1)
+    {
+        if (xQueueReceive(s_requests, &request, portMAX_DELAY) != pdTRUE)
+        {
+            continue;
+        }
+
+        // An update is not steady state: the HTTP client and the flash writes use the heap
+        static_alloc_exempt_begin();
+        ESP_LOGI(TAG, "Updating to %s from %s (%" PRIu32 " bytes)", request.version, request.url, request.size);
+        int64_t start_us = esp_timer_get_time();
+        uint32_t received = 0;
+        const char *reason = run_update(&request, &received);
+        if (reason != NULL)
+        {
+            reply("OTA NAK %s %s", request.version, reason);
+            s_busy = false;
+            static_alloc_exempt_end();
+            continue;
+        }
+
+        // Download time is what the radio spent on the update
+        char detail[48];
+        snprintf(detail, sizeof(detail), "bytes=%" PRIu32 " ms=%" PRId64, received,
+                 (esp_timer_get_time() - start_us) / 1000);
+        reply("OTA DONE %s %s", request.version, detail);
+        vTaskDelay(pdMS_TO_TICKS(OTA_RESTART_DELAY_MS));
+        esp_restart();
+    }
+}
+
+// Public API //////////////////////////////////////////////////////////////////
+
+const char *ota_running_version(void)
+{
+    return esp_app_get_description()->version;
+}
+
+static void confirm_timeout_cb(void *arg)
+{
+    ESP_LOGE(TAG, "Updated image never reached the server, rolling back");
+    esp_ota_mark_app_invalid_rollback_and_reboot();
+}
+
+void ota_init(ota_send_fn send, UBaseType_t prio, BaseType_t core, uint32_t stack)
+{
+    s_send = send;
+    s_requests = xQueueCreateStatic(1, sizeof(ota_request_t), s_requests_storage, &s_requests_buf);
+    task_plan_create(ota_task, "ota", stack, NULL, prio, core, NULL);
+
+    const esp_partition_t *running = esp_ota_get_running_partition();
+    esp_ota_img_states_t state;
+    ESP_LOGI(TAG, "Running %s from %s", ota_running_version(), running ? running->label : "?");
+    if (running != NULL && esp_ota_get_state_partition(running, &state) == ESP_OK &&
+        state == ESP_OTA_IMG_PENDING_VERIFY)
+    {
+        // First boot of an update; it must prove itself like a pushed network config
+        const esp_timer_create_args_t args = {.callback = confirm_timeout_cb, .name = "ota_confirm"};
+        if (esp_timer_create(&args, &s_confirm_timer) == ESP_OK)
+        {
+            esp_timer_start_once(s_confirm_timer, (uint64_t)OTA_CONFIRM_TIMEOUT_MS * 1000);
+        }
+    }
+}
+
+void ota_confirm(void)
+{
+    if (s_confirm_timer == NULL)
+    {
+        return;
+    }
+    esp_timer_stop(s_confirm_timer);
+    esp_timer_delete(s_confirm_timer);
+    s_confirm_timer = NULL;
+    esp_ota_mark_app_valid_cancel_rollback();
+    ESP_LOGI(TAG, "Image %s confirmed", ota_running_version());
+}
+
+bool ota_handle_message(const char *msg, size_t len)
+{
+    static const char prefix[] = "OTA BEGIN ";
+    if (len < sizeof(prefix) - 1 || strncmp(msg, prefix, sizeof(prefix) - 1) != 0)
+    {
+        return false;
+    }
+
+    char text[OTA_VERSION_LEN + OTA_URL_LEN + 32];
+    ota_request_t request = {0};
+    if (len >= sizeof(text))
+    {
+        reply("OTA NAK %s %s", "?", "too_long");
+        return true;
+    }
+    memcpy(text, msg, len);
+    text[len] = '\0';
+
+    // Field widths follow OTA_VERSION_LEN and OTA_URL_LEN
+    if (sscanf(text + sizeof(prefix) - 1, "%31s %" SCNu32 " %127s", request.version, &request.size, request.url) != 3)
+    {
+        reply("OTA NAK %s %s", "?", "bad_request");
+        return true;
+    }
+    if (strcmp(request.version, ota_running_version()) == 0)
+    {
+        reply("OTA NAK %s %s", request.version, "current");
+        return true;
+    }
+    if (s_requests == NULL || s_busy || s_confirm_timer != NULL)
+    {
+        // Never stack an update on one that has not proven itself yet
+        reply("OTA NAK %s %s", request.version, "busy");
+        return true;
+    }
+
+    s_busy = true;
+    xQueueSend(s_requests, &request, 0);
+    reply("OTA ACK %s%s", request.version, "");
+    return true;
+}
@@ -0,0 +1,53 @@
+/*
+  Delta firmware updates over Wi-Fi.
+
+  The server (lib/ota_rollout.js) picks a patch built against the image this
+  collar reports in its HELLO and announces it on the /buzz WebSocket:
+    server -> collar   OTA BEGIN <version> <patch bytes> <url>
+    collar -> server   OTA ACK <version>
+                       OTA DONE <version> bytes=<n> ms=<n>
+                       OTA NAK <version> <reason>
+  A low-priority task downloads the patch over HTTP and streams it through
+  ota_patch.c straight into the inactive app partition, reading the old image
+  from the running one. Nothing is switched unless the base image and the
+  result both match the SHA-256 sums in the patch header and esp_ota_end()
+  accepts the image. The collar then reboots into it.
+
+  A new image boots as pending (CONFIG_BOOTLOADER_APP_ROLLBACK_ENABLE) and is
+  only marked valid by ota_confirm() once it reaches the server again. If that
+  does not happen within OTA_CONFIRM_TIMEOUT_MS, or the image crashes before
+  it, the bootloader returns to the previous one.
+*/
+
+#ifndef OTA_H
+#define OTA_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "freertos/FreeRTOS.h"
+
+#define OTA_CONFIRM_TIMEOUT_MS 60000
+#define OTA_HTTP_TIMEOUT_MS 10000
+#define OTA_RESTART_DELAY_MS 1000 // Give the DONE reply time to leave before rebooting
+#define OTA_READ_CHUNK 1024
+#define OTA_VERSION_LEN 32
+#define OTA_URL_LEN 128
+
+// Sends one text message to the server; returns bytes sent or a negative error
+typedef int (*ota_send_fn)(const char *msg, int len);
+
+// Start the update task and, if this image is still on trial, the confirm timer
+void ota_init(ota_send_fn send, UBaseType_t prio, BaseType_t core, uint32_t stack);
+
+// Call from the network task; true if msg was an OTA command (replies go through send)
+bool ota_handle_message(const char *msg, size_t len);
+
+// Mark a freshly updated image as good; call once the server is reachable
+void ota_confirm(void);
+
+// Version string of the running image (PROJECT_VER)
+const char *ota_running_version(void);
+
+#endif // OTA_H
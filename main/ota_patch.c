@@ -0,0 +1,356 @@
+#include <string.h>
+
+#include "./ota_patch.h"
+
+typedef enum
+{
+    LZ_TAG,
+    LZ_LITERAL,
+    LZ_INDEX,
+    LZ_COUNT
+} lz_state_t;
+
+static uint32_t read_u32(const uint8_t *p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+void ota_patch_init(ota_patch_t *patch, const ota_patch_io_t *io)
+{
+    memset(patch, 0, sizeof(*patch));
+    patch->io = *io;
+    patch->lz_state = LZ_TAG;
+}
+
+const char *ota_patch_status_name(ota_patch_status_t status)
+{
+    switch (status)
+    {
+    case OTA_PATCH_OK:
+        return "ok";
+    case OTA_PATCH_DONE:
+        return "done";
+    case OTA_PATCH_ERR_HEADER:
+        return "bad_header";
+    case OTA_PATCH_ERR_CORRUPT:
+        return "corrupt";
+    case OTA_PATCH_ERR_READ:
+        return "read_failed";
+    case OTA_PATCH_ERR_WRITE:
+        return "write_failed";
+    case OTA_PATCH_ERR_REJECTED:
+        return "rejected";
+    }
+    return "unknown";
+}
+
+static ota_patch_status_t parse_header(ota_patch_t *patch)
+{
+    const uint8_t *h = patch->header_buf;
+    ota_patch_header_t *header = &patch->header;
+    if (memcmp(h, OTA_PATCH_MAGIC, 4) != 0)
+    {
+        return OTA_PATCH_ERR_HEADER;
+    }
+    header->format = h[4];
+    header->window_bits = h[5];
+    header->lookahead_bits = h[6];
+    header->old_size = read_u32(h + 8);
+    header->new_size = read_u32(h + 12);
+    memcpy(header->old_sha256, h + 16, 32);
+    memcpy(header->new_sha256, h + 48, 32);
+
+    // heatshrink's constraint: the lookahead must be shorter than the window
+    if (header->format != OTA_PATCH_FORMAT || header->window_bits < OTA_PATCH_MIN_WINDOW_BITS ||
+        header->window_bits > OTA_PATCH_MAX_WINDOW_BITS || header->lookahead_bits < 3 ||
+        header->lookahead_bits >= header->window_bits || header->new_size == 0)
+    {
+        return OTA_PATCH_ERR_HEADER;
+    }
+    if (patch->io.begin != NULL && patch->io.begin(patch->io.ctx, header) != 0)
+    {
+        return OTA_PATCH_ERR_REJECTED;
+    }
+    return OTA_PATCH_OK;
+}
+
+// Output //////////////////////////////////////////////////////////////////////
+
+static ota_patch_status_t flush_new(ota_patch_t *patch)
+{
+    if (patch->new_buf_len > 0 && patch->io.write_new(patch->io.ctx, patch->new_buf, patch->new_buf_len) != 0)
+    {
+        return OTA_PATCH_ERR_WRITE;
+    }
+    patch->new_buf_len = 0;
+    return OTA_PATCH_OK;
+}
+
+static ota_patch_status_t put_new(ota_patch_t *patch, uint8_t byte)
+{
+    patch->new_buf[patch->new_buf_len++] = byte;
+    patch->new_pos++;
+    return (patch->new_buf_len == OTA_PATCH_NEW_CHUNK) ? flush_new(patch) : OTA_PATCH_OK;
+}
+
+// Next old byte at the read position (range already checked by the op)
+static ota_patch_status_t take_old(ota_patch_t *patch, uint8_t *byte)
+{
+    uint32_t pos = (uint32_t)patch->old_pos;
+    if (pos < patch->old_buf_start || pos >= patch->old_buf_start + patch->old_buf_len)
+    {
+        uint32_t len = patch->header.old_size - pos;
+        if (len > OTA_PATCH_OLD_CHUNK)
+        {
+            len = OTA_PATCH_OLD_CHUNK;
+        }
+        if (patch->io.read_old(patch->io.ctx, pos, patch->old_buf, len) != 0)
+        {
+            return OTA_PATCH_ERR_READ;
+        }
+        patch->old_buf_start = pos;
+        patch->old_buf_len = len;
+    }
+    *byte = patch->old_buf[pos - patch->old_buf_start];
+    patch->old_pos++;
+    return OTA_PATCH_OK;
+}
+
+// Ops /////////////////////////////////////////////////////////////////////////
+
+static ota_patch_status_t finish_op(ota_patch_t *patch)
+{
+    if (patch->new_pos == patch->header.new_size)
+    {
+        ota_patch_status_t status = flush_new(patch);
+        return (status == OTA_PATCH_OK) ? OTA_PATCH_DONE : status;
+    }
+    return OTA_PATCH_OK;
+}
+
+static ota_patch_status_t start_op(ota_patch_t *patch, uint64_t value)
+{
+    ota_patch_op_t op = (ota_patch_op_t)(value & 3);
+    uint64_t n = value >> 2;
+    uint64_t new_end = patch->new_pos + n;
+    uint64_t old_end = (uint64_t)patch->old_pos + n;
+
+    if (op != OTA_OP_SEEK && new_end > patch->header.new_size)
+    {
+        return OTA_PATCH_ERR_CORRUPT;
+    }
+    if ((op == OTA_OP_COPY || op == OTA_OP_ADD) && old_end > patch->header.old_size)
+    {
+        return OTA_PATCH_ERR_CORRUPT;
+    }
+
+    switch (op)
+    {
+    case OTA_OP_COPY:
+        for (uint64_t i = 0; i < n; i++)
+        {
+            uint8_t byte;
+            ota_patch_status_t status = take_old(patch, &byte);
+            if (status == OTA_PATCH_OK)
+            {
+                status = put_new(patch, byte);
+            }
+            if (status != OTA_PATCH_OK)
+            {
+                return status;
+            }
+        }
+        return finish_op(patch);
+
+    case OTA_OP_ADD:
+    case OTA_OP_INSERT:
+        patch->op = op;
+        patch->op_left = (uint32_t)n;
+        return (n == 0) ? finish_op(patch) : OTA_PATCH_OK;
+
+    case OTA_OP_SEEK:
+    {
+        int64_t delta = (int64_t)(n >> 1) ^ -(int64_t)(n & 1);
+        int64_t pos = patch->old_pos + delta;
+        if (pos < 0 || pos > (int64_t)patch->header.old_size)
+        {
+            return OTA_PATCH_ERR_CORRUPT;
+        }
+        patch->old_pos = pos;
+        return OTA_PATCH_OK;
+    }
+    }
+    return OTA_PATCH_ERR_CORRUPT;
+}
+
+// One decompressed byte of the op stream
+static ota_patch_status_t op_byte(ota_patch_t *patch, uint8_t byte)
+{
+    if (patch->op_left > 0)
+    {
+        ota_patch_status_t status;
+        if (patch->op == OTA_OP_ADD)
+        {
+            uint8_t old;
+            status = take_old(patch, &old);
+            if (status != OTA_PATCH_OK)
+            {
+                return status;
+            }
+            byte = (uint8_t)(byte + old);
+        }
+        status = put_new(patch, byte);
+        if (status != OTA_PATCH_OK)
+        {
+            return status;
+        }
+        return (--patch->op_left == 0) ? finish_op(patch) : OTA_PATCH_OK;
+    }
+
+    if (patch->varint_shift > 63)
+    {
+        return OTA_PATCH_ERR_CORRUPT;
+    }
+    patch->varint |= (uint64_t)(byte & 0x7f) << patch->varint_shift;
+    if (byte & 0x80)
+    {
+        patch->varint_shift += 7;
+        return OTA_PATCH_OK;
+    }
+    uint64_t value = patch->varint;
+    patch->varint = 0;
+    patch->varint_shift = 0;
+    return start_op(patch, value);
+}
+
+// LZSS ////////////////////////////////////////////////////////////////////////
+
+static ota_patch_status_t emit(ota_patch_t *patch, uint8_t byte)
+{
+    if (patch->status == OTA_PATCH_DONE)
+    {
+        return OTA_PATCH_ERR_CORRUPT; // Output past the end of the image
+    }
+    uint32_t mask = (1u << patch->header.window_bits) - 1;
+    patch->window[patch->window_pos & mask] = byte;
+    patch->window_pos++;
+    return op_byte(patch, byte);
+}
+
+static uint32_t take_bits(ota_patch_t *patch, uint8_t count)
+{
+    patch->bit_count -= count;
+    return (patch->bit_buf >> patch->bit_count) & ((1u << count) - 1);
+}
+
+// Decode as many symbols as the buffered bits allow
+static ota_patch_status_t decode_bits(ota_patch_t *patch)
+{
+    const ota_patch_header_t *h = &patch->header;
+    while (1)
+    {
+        switch (patch->lz_state)
+        {
+        case LZ_TAG:
+            if (patch->bit_count < 1)
+            {
+                return OTA_PATCH_OK;
+            }
+            patch->lz_state = take_bits(patch, 1) ? LZ_LITERAL : LZ_INDEX;
+            break;
+
+        case LZ_LITERAL:
+        {
+            if (patch->bit_count < 8)
+            {
+                return OTA_PATCH_OK;
+            }
+            patch->lz_state = LZ_TAG;
+            ota_patch_status_t status = emit(patch, (uint8_t)take_bits(patch, 8));
+            if (status < 0)
+            {
+                return status;
+            }
+            patch->status = status;
+            break;
+        }
+
+        case LZ_INDEX:
+            if (patch->bit_count < h->window_bits)
+            {
+                return OTA_PATCH_OK;
+            }
+            patch->backref_index = (uint16_t)take_bits(patch, h->window_bits);
+            patch->lz_state = LZ_COUNT;
+            break;
+
+        case LZ_COUNT:
+        {
+            if (patch->bit_count < h->lookahead_bits)
+            {
+                return OTA_PATCH_OK;
+            }
+            uint32_t count = take_bits(patch, h->lookahead_bits) + 1;
+            uint32_t distance = patch->backref_index + 1u;
+            uint32_t mask = (1u << h->window_bits) - 1;
+            patch->lz_state = LZ_TAG;
+            if (distance > patch->window_pos)
+            {
+                return OTA_PATCH_ERR_CORRUPT; // Reaches back before the stream started
+            }
+            for (uint32_t i = 0; i < count; i++)
+            {
+                ota_patch_status_t status = emit(patch, patch->window[(patch->window_pos - distance) & mask]);
+                if (status < 0)
+                {
+                    return status;
+                }
+                patch->status = status;
+            }
+            break;
+        }
+        }
+    }
+}
+
+// Public API //////////////////////////////////////////////////////////////////
+
+ota_patch_status_t ota_patch_feed(ota_patch_t *patch, const uint8_t *data, size_t len)
+{
+    if (patch->status < 0)
+    {
+        return patch->status;
+    }
+    for (size_t i = 0; i < len; i++)
+    {
+        if (patch->status == OTA_PATCH_DONE)
+        {
+            // Padding lives in the last byte's low bits; whole bytes after the end are not ours
+            patch->status = OTA_PATCH_ERR_CORRUPT;
+            break;
+        }
+        if (patch->header_len < OTA_PATCH_HEADER_LEN)
+        {
+            patch->header_buf[patch->header_len++] = data[i];
+            if (patch->header_len == OTA_PATCH_HEADER_LEN)
+            {
+                patch->status = parse_header(patch);
+                if (patch->status < 0)
+                {
+                    break;
+                }
+            }
+            continue;
+        }
+
+        patch->bit_buf = (patch->bit_buf << 8) | data[i];
+        patch->bit_count += 8;
+        ota_patch_status_t status = decode_bits(patch);
+        if (status < 0)
+        {
+            patch->status = status;
+            break;
+        }
+    }
+    return patch->status;
+}
@@ -0,0 +1,123 @@
+/*
+  Streaming decoder for compressed firmware deltas.
+
+  Pure logic with no ESP-IDF dependencies so it can be exercised on the host.
+  Patches are built by lib/ota_delta.js from the image a collar runs and the
+  image it should run. Bytes are fed in as they arrive from the network and
+  the new image comes out through write_new() in order, so nothing larger than
+  the LZSS window and two small buffers is ever held in RAM.
+
+  Layout (little-endian):
+    header   "CCDP", format version, window bits, lookahead bits, reserved,
+             old size (u32), new size (u32), SHA-256 of old, SHA-256 of new
+    body     LZSS in heatshrink's bit format (1 + 8 bit literal, or
+             0 + window-bit distance + lookahead-bit count, both minus one)
+
+  The decompressed body is a list of ops, each a LEB128 varint whose low two
+  bits pick the op and whose remaining bits are its argument n:
+    COPY   n bytes of the old image at the read position
+    ADD    n bytes follow; each is added to the old byte at the read position
+    INSERT n bytes follow and are copied as they are
+    SEEK   move the read position by n (zigzag encoded)
+  COPY and ADD advance the read position. This is bsdiff's diff/extra/seek
+  scheme with runs of unchanged bytes lifted out of the diff, so the long
+  stretches that survive a rebuild cost a varint instead of compressed zeros.
+  An image with no usable base (old size 0) is a single compressed INSERT.
+*/
+
+#ifndef OTA_PATCH_H
+#define OTA_PATCH_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define OTA_PATCH_MAGIC "CCDP"
+#define OTA_PATCH_FORMAT 1
+#define OTA_PATCH_HEADER_LEN 80
+#define OTA_PATCH_MIN_WINDOW_BITS 4
+#define OTA_PATCH_MAX_WINDOW_BITS 12 // 4 KB window, the largest the collar reserves
+#define OTA_PATCH_OLD_CHUNK 256      // Old image bytes read per flash access
+#define OTA_PATCH_NEW_CHUNK 1024     // New image bytes handed to write_new() at once
+
+typedef enum
+{
+    OTA_PATCH_OK = 0,   // Consumed, more input expected
+    OTA_PATCH_DONE = 1, // The whole new image has been written
+    OTA_PATCH_ERR_HEADER = -1,
+    OTA_PATCH_ERR_CORRUPT = -2, // Op runs outside either image or data follows the end
+    OTA_PATCH_ERR_READ = -3,    // read_old() failed
+    OTA_PATCH_ERR_WRITE = -4,   // write_new() failed
+    OTA_PATCH_ERR_REJECTED = -5 // begin() refused the header
+} ota_patch_status_t;
+
+typedef struct
+{
+    uint8_t format;
+    uint8_t window_bits;
+    uint8_t lookahead_bits;
+    uint32_t old_size;
+    uint32_t new_size;
+    uint8_t old_sha256[32];
+    uint8_t new_sha256[32];
+} ota_patch_header_t;
+
+typedef struct
+{
+    void *ctx;
+    // Called once the header is in; non-zero rejects the patch (wrong base, too large, ...)
+    int (*begin)(void *ctx, const ota_patch_header_t *header);
+    // Fill buf with old image bytes at offset; non-zero on failure
+    int (*read_old)(void *ctx, uint32_t offset, uint8_t *buf, size_t len);
+    // Append new image bytes; non-zero on failure
+    int (*write_new)(void *ctx, const uint8_t *buf, size_t len);
+} ota_patch_io_t;
+
+typedef enum
+{
+    OTA_OP_COPY = 0,
+    OTA_OP_ADD = 1,
+    OTA_OP_INSERT = 2,
+    OTA_OP_SEEK = 3
+} ota_patch_op_t;
+
+typedef struct
+{
+    ota_patch_io_t io;
+    ota_patch_header_t header;
+    uint8_t header_buf[OTA_PATCH_HEADER_LEN];
+    uint32_t header_len;
+    ota_patch_status_t status; // Sticky once an error or DONE is reached
+
+    // LZSS decoder
+    uint8_t window[1 << OTA_PATCH_MAX_WINDOW_BITS];
+    uint32_t window_pos;
+    uint32_t bit_buf;
+    uint8_t bit_count;
+    uint8_t lz_state;
+    uint16_t backref_index;
+
+    // Op decoder
+    uint64_t varint;
+    uint8_t varint_shift;
+    ota_patch_op_t op;
+    uint32_t op_left; // Payload bytes still due for ADD or INSERT
+    int64_t old_pos;
+    uint32_t new_pos;
+
+    uint8_t old_buf[OTA_PATCH_OLD_CHUNK];
+    uint32_t old_buf_start;
+    uint32_t old_buf_len;
+    uint8_t new_buf[OTA_PATCH_NEW_CHUNK];
+    uint32_t new_buf_len;
+} ota_patch_t;
+
+void ota_patch_init(ota_patch_t *patch, const ota_patch_io_t *io);
+
+// Feed the next bytes of the patch; returns OTA_PATCH_OK until DONE or an error
+ota_patch_status_t ota_patch_feed(ota_patch_t *patch, const uint8_t *data, size_t len);
+
+// Short reason for a status, used in OTA NAK replies
+const char *ota_patch_status_name(ota_patch_status_t status);
+
+#endif // OTA_PATCH_H
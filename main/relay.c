@@ -0,0 +1,382 @@
+#include <math.h>
+#include <string.h>
+
+#include "esp_log.h"
+#include "esp_now.h"
+#include "esp_random.h"
+#include "esp_timer.h"
+#include "esp_wifi.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+
+#include "lwip/sockets.h"
+
+#include "./boot.h"
+#include "./ota.h"
+#include "./relay.h"
+#include "./relay_mesh.h"
+#include "./static_alloc.h"
+#include "./task_plan.h"
+#include "./timesync.h"
+
+#include <arpa/inet.h>
+
+static const char *TAG = "relay";
+
+static const uint8_t s_broadcast[ESP_NOW_ETH_ALEN] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+
+// A received frame, queued by the Wi-Fi task's callback for the relay task
+typedef struct
+{
+    uint8_t mac[ESP_NOW_ETH_ALEN];
+    int8_t rssi;
+    uint16_t len;
+    uint8_t data[RELAY_FRAME_MAX];
+} relay_event_t;
+
+typedef enum
+{
+    RELAY_SENT_NONE,
+    RELAY_SENT_ACKED,
+    RELAY_SENT_FAILED,
+} relay_sent_t;
+
+static relay_mode_t s_role = RELAY_MODE_OFF;
+static relay_leader_fn s_on_leader;
+static QueueHandle_t s_events;
+static StaticQueue_t s_events_buf;
+static uint8_t s_events_storage[RELAY_EVENT_QUEUE_LEN * sizeof(relay_event_t)];
+
+// Guarded by s_mutex: the acquisition and network tasks call in as well as the relay task
+static SemaphoreHandle_t s_mutex;
+static StaticSemaphore_t s_mutex_buf;
+static union
+{
+    relay_leaf_t leaf;
+    relay_gateway_t gateway;
+} s_state; // A collar only ever takes one role
+
+// Owned by the relay task
+static uint8_t s_frame[RELAY_FRAME_MAX];
+static uint8_t s_uplink[RELAY_UPLINK_MAX];
+static int s_uplink_sockfd = -1;
+static struct sockaddr_in s_uplink_addr;
+static uint32_t s_uplink_errors;
+static uint32_t s_queue_drops; // Received frames that found the queue full
+
+// Outcome of the leaf's one batch in flight, from the send callback
+static volatile relay_sent_t s_sent = RELAY_SENT_NONE;
+
+static int64_t now_ms(void)
+{
+    return esp_timer_get_time() / 1000;
+}
+
+// ESP-NOW callbacks (Wi-Fi task) //////////////////////////////////////////////
+
+static void on_recv(const esp_now_recv_info_t *info, const uint8_t *data, int len)
+{
+    if (len <= 0 || len > RELAY_FRAME_MAX)
+    {
+        return;
+    }
+    relay_event_t event = {.rssi = info->rx_ctrl->rssi, .len = (uint16_t)len};
+    memcpy(event.mac, info->src_addr, ESP_NOW_ETH_ALEN);
+    memcpy(event.data, data, len);
+    if (xQueueSend(s_events, &event, 0) != pdTRUE)
+    {
+        s_queue_drops++;
+    }
+}
+
+static void on_sent(const uint8_t *mac, esp_now_send_status_t status)
+{
+    if (memcmp(mac, s_broadcast, ESP_NOW_ETH_ALEN) == 0)
+    {
+        return; // Beacons are never acked
+    }
+    // Picked up at the relay task's next poll; a slot rather than the queue, so it is never lost
+    s_sent = status == ESP_NOW_SEND_SUCCESS ? RELAY_SENT_ACKED : RELAY_SENT_FAILED;
+}
+
+static bool send_now(const uint8_t *mac, const uint8_t *data, size_t len)
+{
+    if (!esp_now_is_peer_exist(mac))
+    {
+        esp_now_peer_info_t peer = {.channel = 0, .ifidx = WIFI_IF_STA, .encrypt = false};
+        memcpy(peer.peer_addr, mac, ESP_NOW_ETH_ALEN);
+        if (esp_now_add_peer(&peer) != ESP_OK)
+        {
+            return false;
+        }
+    }
+    static_alloc_exempt_begin(); // The driver's TX buffers
+    esp_err_t err = esp_now_send(mac, data, len);
+    static_alloc_exempt_end();
+    return err == ESP_OK;
+}
+
+// Leaf ////////////////////////////////////////////////////////////////////////
+
+void relay_send_status(uint8_t state, float temp_f, uint32_t duration_s, int64_t sample_us)
+{
+    if (s_role != RELAY_MODE_LEAF)
+    {
+        return;
+    }
+    relay_record_t record = {.state = state, .duration_s = duration_s};
+    if (!isnan(temp_f))
+    {
+        record.flags |= RELAY_RECORD_TEMP;
+        record.temp_centi_f = (int16_t)lroundf(temp_f * 100.0f);
+    }
+    xSemaphoreTake(s_mutex, portMAX_DELAY);
+    relay_leaf_queue(&s_state.leaf, &record, sample_us / 1000);
+    xSemaphoreGive(s_mutex);
+}
+
+static void leaf_handle(const relay_event_t *event)
+{
+    char leader[RELAY_CAT_ID_LEN + 1] = "";
+    xSemaphoreTake(s_mutex, portMAX_DELAY);
+    if (relay_frame_type(event->data, event->len) == RELAY_FRAME_BEACON &&
+        relay_leaf_on_beacon(&s_state.leaf, event->mac, event->rssi, event->data, event->len, now_ms()))
+    {
+        strcpy(leader, s_state.leaf.leader_id);
+    }
+    xSemaphoreGive(s_mutex);
+
+    if (leader[0] != '\0' && s_on_leader != NULL)
+    {
+        s_on_leader(leader);
+    }
+}
+
+static void leaf_poll(int64_t *next_hop_ms, uint8_t *channel)
+{
+    uint8_t mac[RELAY_MAC_LEN];
+    xSemaphoreTake(s_mutex, portMAX_DELAY);
+    relay_sent_t sent = s_sent;
+    if (sent != RELAY_SENT_NONE)
+    {
+        s_sent = RELAY_SENT_NONE;
+        uint32_t acked_before = s_state.leaf.stats.batches;
+        relay_leaf_on_sent(&s_state.leaf, sent == RELAY_SENT_ACKED, now_ms());
+        if (acked_before == 0 && s_state.leaf.stats.batches == 1)
+        {
+            // A gateway took our first batch: as good as reaching the server gets for a leaf
+            config_confirm();
+            ota_confirm();
+            boot_mark(BOOT_MARK_FIRST_UPLINK);
+        }
+    }
+    bool attached = relay_leaf_gateway(&s_state.leaf) != NULL;
+    size_t n = relay_leaf_poll(&s_state.leaf, now_ms(), s_frame, sizeof(s_frame), mac);
+    xSemaphoreGive(s_mutex);
+
+    if (n > 0 && !send_now(mac, s_frame, n))
+    {
+        xSemaphoreTake(s_mutex, portMAX_DELAY);
+        relay_leaf_on_sent(&s_state.leaf, false, now_ms());
+        xSemaphoreGive(s_mutex);
+    }
+
+    // Hop until a gateway is heard, then stay on its channel
+    if (!attached && now_ms() >= *next_hop_ms)
+    {
+        *channel = *channel % RELAY_CHANNELS + 1;
+        esp_wifi_set_channel(*channel, WIFI_SECOND_CHAN_NONE);
+        *next_hop_ms = now_ms() + RELAY_SCAN_DWELL_MS;
+    }
+}
+
+// Gateway /////////////////////////////////////////////////////////////////////
+
+void relay_set_leader(const char *leader_id)
+{
+    if (s_role != RELAY_MODE_GATEWAY)
+    {
+        return;
+    }
+    xSemaphoreTake(s_mutex, portMAX_DELAY);
+    relay_gateway_set_leader(&s_state.gateway, leader_id, now_ms());
+    xSemaphoreGive(s_mutex);
+}
+
+void relay_set_uplink(bool up)
+{
+    if (s_role != RELAY_MODE_GATEWAY)
+    {
+        return;
+    }
+    xSemaphoreTake(s_mutex, portMAX_DELAY);
+    relay_gateway_set_uplink(&s_state.gateway, up);
+    xSemaphoreGive(s_mutex);
+}
+
+static void gateway_handle(const relay_event_t *event)
+{
+    if (relay_frame_type(event->data, event->len) != RELAY_FRAME_BATCH)
+    {
+        return;
+    }
+    xSemaphoreTake(s_mutex, portMAX_DELAY);
+    relay_gateway_on_batch(&s_state.gateway, event->mac, event->data, event->len, now_ms());
+    xSemaphoreGive(s_mutex);
+}
+
+static void gateway_poll(void)
+{
+    int64_t epoch_us = 0;
+    bool synced = timesync_epoch_us(esp_timer_get_time(), &epoch_us);
+
+    xSemaphoreTake(s_mutex, portMAX_DELAY);
+    size_t beacon = relay_gateway_beacon(&s_state.gateway, now_ms(), s_frame, sizeof(s_frame));
+    size_t uplink = relay_gateway_uplink(&s_state.gateway, now_ms(), synced ? (uint64_t)(epoch_us / 1000) : 0, s_uplink,
+                                         sizeof(s_uplink));
+    xSemaphoreGive(s_mutex);
+
+    if (beacon > 0)
+    {
+        send_now(s_broadcast, s_frame, beacon);
+    }
+    if (uplink > 0 && s_uplink_sockfd >= 0)
+    {
+        static_alloc_exempt_begin(); // lwIP's netbuf and pbuf
+        ssize_t sent = sendto(s_uplink_sockfd, s_uplink, uplink, 0, (struct sockaddr *)&s_uplink_addr,
+                              sizeof(s_uplink_addr));
+        static_alloc_exempt_end();
+        if (sent < 0)
+        {
+            s_uplink_errors++;
+        }
+    }
+}
+
+// Task ////////////////////////////////////////////////////////////////////////
+
+static void log_stats(void)
+{
+    xSemaphoreTake(s_mutex, portMAX_DELAY);
+    if (s_role == RELAY_MODE_LEAF)
+    {
+        const relay_gateway_entry_t *gw = relay_leaf_gateway(&s_state.leaf);
+        relay_leaf_stats_t st = s_state.leaf.stats;
+        ESP_LOGI(TAG, "leaf: gateway %s (%d dBm), %d queued, %u records in %u batches, %u sends, %u failures, "
+                      "%u handovers, %u overflows",
+                 gw ? gw->cat_id : "none", gw ? gw->rssi : 0, s_state.leaf.count, (unsigned)st.records,
+                 (unsigned)st.batches, (unsigned)st.sends, (unsigned)st.failures, (unsigned)st.handovers,
+                 (unsigned)st.overflows);
+    }
+    else
+    {
+        relay_gateway_stats_t st = s_state.gateway.stats;
+        ESP_LOGI(TAG, "gateway: %d leaves, %u records in %u batches (%u repeats), %u uplinks (%u bytes, %u errors), "
+                      "%u overflows, %u rejected, %u evicted",
+                 relay_gateway_load(&s_state.gateway, now_ms()), (unsigned)st.records, (unsigned)st.batches,
+                 (unsigned)st.duplicates, (unsigned)st.uplinks, (unsigned)st.uplink_bytes, (unsigned)s_uplink_errors,
+                 (unsigned)st.overflows, (unsigned)st.rejected, (unsigned)st.evictions);
+    }
+    xSemaphoreGive(s_mutex);
+    if (s_queue_drops > 0)
+    {
+        ESP_LOGW(TAG, "%u received frames dropped on a full queue", (unsigned)s_queue_drops);
+    }
+}
+
+static void relay_task(void *arg)
+{
+    int64_t next_hop_ms = 0;
+    int64_t next_stats_ms = now_ms() + RELAY_STATS_PERIOD_MS;
+    uint8_t channel = 0;
+    static relay_event_t event;
+    while (1)
+    {
+        // Wait up to a poll period for a frame, then take whatever else has queued
+        BaseType_t got = xQueueReceive(s_events, &event, pdMS_TO_TICKS(RELAY_POLL_MS));
+        while (got == pdTRUE)
+        {
+            if (s_role == RELAY_MODE_LEAF)
+            {
+                leaf_handle(&event);
+            }
+            else
+            {
+                gateway_handle(&event);
+            }
+            got = xQueueReceive(s_events, &event, 0);
+        }
+
+        if (s_role == RELAY_MODE_LEAF)
+        {
+            leaf_poll(&next_hop_ms, &channel);
+        }
+        else
+        {
+            gateway_poll();
+        }
+
+        if (now_ms() >= next_stats_ms)
+        {
+            log_stats();
+            next_stats_ms = now_ms() + RELAY_STATS_PERIOD_MS;
+        }
+    }
+}
+
+// Init ////////////////////////////////////////////////////////////////////////
+
+relay_mode_t relay_init(const collar_config_t *cfg, bool associated, relay_leader_fn on_leader, UBaseType_t prio,
+                        BaseType_t core, uint32_t stack)
+{
+    relay_mode_t role = (relay_mode_t)cfg->relay_mode;
+    if (role == RELAY_MODE_AUTO)
+    {
+        role = associated ? RELAY_MODE_GATEWAY : RELAY_MODE_LEAF;
+    }
+    if (role != RELAY_MODE_LEAF && role != RELAY_MODE_GATEWAY)
+    {
+        return RELAY_MODE_OFF;
+    }
+
+    s_mutex = xSemaphoreCreateMutexStatic(&s_mutex_buf);
+    s_events = xQueueCreateStatic(RELAY_EVENT_QUEUE_LEN, sizeof(relay_event_t), s_events_storage, &s_events_buf);
+    s_on_leader = on_leader;
+
+    if (role == RELAY_MODE_GATEWAY)
+    {
+        relay_gateway_init(&s_state.gateway, cfg->cat_id, now_ms());
+        relay_gateway_set_uplink(&s_state.gateway, associated);
+        s_uplink_sockfd = socket(AF_INET, SOCK_DGRAM, 0);
+        s_uplink_addr.sin_family = AF_INET;
+        s_uplink_addr.sin_port = htons(cfg->relay_port);
+        inet_pton(AF_INET, cfg->host_ip, &s_uplink_addr.sin_addr);
+    }
+    else
+    {
+        relay_leaf_init(&s_state.leaf, cfg->cat_id, (uint16_t)cfg->udp_port, (uint16_t)esp_random());
+    }
+
+    if (esp_now_init() != ESP_OK || esp_now_register_recv_cb(on_recv) != ESP_OK ||
+        esp_now_register_send_cb(on_sent) != ESP_OK)
+    {
+        ESP_LOGE(TAG, "ESP-NOW failed to start, relay off");
+        return RELAY_MODE_OFF;
+    }
+    s_role = role;
+
+    uint8_t primary = 0;
+    wifi_second_chan_t second;
+    esp_wifi_get_channel(&primary, &second);
+    ESP_LOGI(TAG, "Relaying as a %s on channel %u", role == RELAY_MODE_LEAF ? "leaf" : "gateway",
+             (unsigned)primary);
+
+    task_plan_create(relay_task, "relay", stack, NULL, prio, core, NULL);
+    return role;
+}
+
+bool relay_is_leaf(void)
+{
+    return s_role == RELAY_MODE_LEAF;
+}
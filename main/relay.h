@@ -0,0 +1,67 @@
+/*
+  ESP-NOW relay for collars out of the access point's range.
+
+  relay_mode in the config picks the role at boot:
+    0  off: status goes straight to the server over UDP, as always
+    1  leaf: never associates; status goes to the nearest gateway collar
+    2  gateway: associates as usual and also relays for leaves in ESP-NOW range
+    3  auto: a gateway if wifi_init_sta() got an IP, otherwise a leaf
+
+  Gateways beacon on the access point's channel; a leaf hops across the
+  channels until it hears one, then stays there (relay_mesh.h has the routing
+  and batching). A gateway sends what its leaves report to relay_port on the
+  server in UPLINK datagrams (relay_frame.h), which tools/relay_ingest.js turns
+  into ordinary status lines, and passes the leader it gets over the WebSocket
+  down in its beacons, so a leaf buzzes like any other collar.
+
+  A leaf has no WebSocket, so it gets no config pushes, firmware updates or
+  time sync. It does confirm a pending config (and firmware) once its first
+  batch is acked, since a gateway hearing it is as much as it ever reaches.
+
+  Everything is static: the state machines, the event queue and the frames.
+*/
+
+#ifndef RELAY_H
+#define RELAY_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "freertos/FreeRTOS.h"
+
+#include "./collar_config.h"
+
+typedef enum
+{
+    RELAY_MODE_OFF = 0,
+    RELAY_MODE_LEAF = 1,
+    RELAY_MODE_GATEWAY = 2,
+    RELAY_MODE_AUTO = 3,
+} relay_mode_t;
+
+#define RELAY_EVENT_QUEUE_LEN 8
+#define RELAY_POLL_MS 20            // Batch and beacon timing resolution
+#define RELAY_SCAN_DWELL_MS 1100    // Per channel while looking for a gateway (just over a beacon period)
+#define RELAY_CHANNELS 13
+#define RELAY_STATS_PERIOD_MS 30000
+
+// Called with the leader a leaf's gateway announces, from the relay task
+typedef void (*relay_leader_fn)(const char *leader_id);
+
+// Pick the role from cfg->relay_mode and start the relay task unless it is off.
+// associated is whether wifi_init_sta() got an IP. Returns the role taken
+// (RELAY_MODE_OFF, RELAY_MODE_LEAF or RELAY_MODE_GATEWAY).
+relay_mode_t relay_init(const collar_config_t *cfg, bool associated, relay_leader_fn on_leader, UBaseType_t prio,
+                        BaseType_t core, uint32_t stack);
+
+bool relay_is_leaf(void);
+
+// Leaf: hand one status record to the gateway. sample_us is the
+// esp_timer_get_time() of the sample; temp_f may be NAN.
+void relay_send_status(uint8_t state, float temp_f, uint32_t duration_s, int64_t sample_us);
+
+// Gateway: beacon the leader the server named, and whether the server can be reached
+void relay_set_leader(const char *leader_id);
+void relay_set_uplink(bool up);
+
+#endif // RELAY_H
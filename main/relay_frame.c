@@ -0,0 +1,164 @@
+#include <string.h>
+
+#include "./relay_frame.h"
+
+static void put_le(uint8_t *p, uint64_t value, int bytes)
+{
+    for (int i = 0; i < bytes; i++)
+    {
+        p[i] = (uint8_t)(value >> (8 * i));
+    }
+}
+
+static uint64_t get_le(const uint8_t *p, int bytes)
+{
+    uint64_t value = 0;
+    for (int i = bytes - 1; i >= 0; i--)
+    {
+        value = (value << 8) | p[i];
+    }
+    return value;
+}
+
+static void put_id(uint8_t *p, const char *id)
+{
+    memset(p, 0, RELAY_CAT_ID_LEN);
+    if (id != NULL)
+    {
+        memcpy(p, id, strnlen(id, RELAY_CAT_ID_LEN));
+    }
+}
+
+static void get_id(const uint8_t *p, char *out)
+{
+    memcpy(out, p, RELAY_CAT_ID_LEN);
+    out[RELAY_CAT_ID_LEN] = '\0';
+}
+
+static size_t put_header(uint8_t type, uint16_t seq, uint8_t *out)
+{
+    out[0] = RELAY_FRAME_MAGIC;
+    out[1] = type;
+    put_le(out + 2, seq, 2);
+    return 4;
+}
+
+uint8_t relay_frame_type(const uint8_t *data, size_t len)
+{
+    if (len < 4 || data[0] != RELAY_FRAME_MAGIC)
+    {
+        return 0;
+    }
+    return data[1];
+}
+
+// Beacons /////////////////////////////////////////////////////////////////////
+
+size_t relay_frame_encode_beacon(const relay_beacon_t *beacon, uint8_t *out, size_t out_len)
+{
+    if (out_len < RELAY_BEACON_SIZE)
+    {
+        return 0;
+    }
+    size_t n = put_header(RELAY_FRAME_BEACON, beacon->seq, out);
+    put_id(out + n, beacon->gateway_id);
+    n += RELAY_CAT_ID_LEN;
+    out[n++] = beacon->load;
+    out[n++] = beacon->flags;
+    put_id(out + n, beacon->leader_id);
+    return n + RELAY_CAT_ID_LEN;
+}
+
+bool relay_frame_decode_beacon(const uint8_t *data, size_t len, relay_beacon_t *out)
+{
+    if (len != RELAY_BEACON_SIZE || relay_frame_type(data, len) != RELAY_FRAME_BEACON)
+    {
+        return false;
+    }
+    out->seq = (uint16_t)get_le(data + 2, 2);
+    get_id(data + 4, out->gateway_id);
+    out->load = data[4 + RELAY_CAT_ID_LEN];
+    out->flags = data[5 + RELAY_CAT_ID_LEN];
+    get_id(data + 6 + RELAY_CAT_ID_LEN, out->leader_id);
+    return out->gateway_id[0] != '\0';
+}
+
+// Batches /////////////////////////////////////////////////////////////////////
+
+size_t relay_frame_batch_header(uint16_t seq, const char *cat_id, uint16_t udp_port, uint8_t count, uint8_t *out,
+                                size_t out_len)
+{
+    if (count > RELAY_BATCH_MAX_RECORDS || out_len < RELAY_BATCH_HEADER + (size_t)count * RELAY_RECORD_SIZE)
+    {
+        return 0;
+    }
+    size_t n = put_header(RELAY_FRAME_BATCH, seq, out);
+    put_id(out + n, cat_id);
+    n += RELAY_CAT_ID_LEN;
+    put_le(out + n, udp_port, 2);
+    out[n + 2] = count;
+    return n + 3;
+}
+
+bool relay_frame_decode_batch(const uint8_t *data, size_t len, relay_batch_t *out)
+{
+    if (len < RELAY_BATCH_HEADER || relay_frame_type(data, len) != RELAY_FRAME_BATCH)
+    {
+        return false;
+    }
+    out->seq = (uint16_t)get_le(data + 2, 2);
+    get_id(data + 4, out->cat_id);
+    out->udp_port = (uint16_t)get_le(data + 4 + RELAY_CAT_ID_LEN, 2);
+    out->count = data[6 + RELAY_CAT_ID_LEN];
+    out->records = data + RELAY_BATCH_HEADER;
+    return out->cat_id[0] != '\0' && len == RELAY_BATCH_HEADER + (size_t)out->count * RELAY_RECORD_SIZE;
+}
+
+void relay_frame_put_record(uint8_t *p, const relay_record_t *record)
+{
+    p[0] = record->state;
+    p[1] = record->flags;
+    put_le(p + 2, (uint16_t)record->temp_centi_f, 2);
+    put_le(p + 4, record->duration_s, 4);
+    put_le(p + 8, record->age_ms, 4);
+}
+
+void relay_frame_get_record(const uint8_t *p, relay_record_t *out)
+{
+    out->state = p[0];
+    out->flags = p[1];
+    out->temp_centi_f = (int16_t)get_le(p + 2, 2);
+    out->duration_s = (uint32_t)get_le(p + 4, 4);
+    out->age_ms = (uint32_t)get_le(p + 8, 4);
+}
+
+// Uplink //////////////////////////////////////////////////////////////////////
+
+size_t relay_frame_uplink_header(uint16_t seq, const char *gateway_id, uint64_t epoch_ms, uint8_t sections,
+                                 uint8_t *out, size_t out_len)
+{
+    if (out_len < RELAY_UPLINK_HEADER)
+    {
+        return 0;
+    }
+    size_t n = put_header(RELAY_FRAME_UPLINK, seq, out);
+    put_id(out + n, gateway_id);
+    n += RELAY_CAT_ID_LEN;
+    put_le(out + n, epoch_ms, 8);
+    out[n + 8] = sections;
+    return n + 9;
+}
+
+size_t relay_frame_section_header(const char *cat_id, uint16_t udp_port, uint16_t seq, uint8_t count, uint8_t *out,
+                                  size_t out_len)
+{
+    if (out_len < RELAY_SECTION_HEADER)
+    {
+        return 0;
+    }
+    put_id(out, cat_id);
+    put_le(out + RELAY_CAT_ID_LEN, udp_port, 2);
+    put_le(out + RELAY_CAT_ID_LEN + 2, seq, 2);
+    out[RELAY_CAT_ID_LEN + 4] = count;
+    return RELAY_SECTION_HEADER;
+}
@@ -0,0 +1,112 @@
+/*
+  Wire format of the ESP-NOW relay (relay.c).
+
+  Pure C with no ESP-IDF dependencies: the relay simulator (sim/mesh) builds
+  this same file, and lib/relay_frames.js decodes the uplink on the server.
+
+  All integers are little-endian. Every frame starts with RELAY_FRAME_MAGIC and
+  a type byte. Cat IDs are fixed RELAY_CAT_ID_LEN fields, zero padded.
+
+  BEACON   gateway -> broadcast, every RELAY_BEACON_MS and on a leader change
+    magic, type, seq (u16), gateway cat_id, load (u8), flags (u8), leader cat_id
+  BATCH    leaf -> its gateway (ESP-NOW unicast, so the MAC layer acks it)
+    magic, type, seq (u16), cat_id, udp_port (u16), count (u8), count x record
+  UPLINK   gateway -> server (one UDP datagram to relay_port)
+    magic, type, seq (u16), gateway cat_id, epoch_ms (u64, 0 until synced),
+    sections (u8), then per leaf: cat_id, udp_port (u16), batch seq (u16),
+    count (u8), count x record
+
+  A record is one status message, 12 bytes:
+    state (u8), flags (u8), temp (i16, centi-degrees F), duration_s (u32),
+    age_ms (u32)
+  age_ms is how long ago the leaf took the sample, counted back from the
+  moment the frame carrying it is sent. Neither leaf nor gateway needs a synced
+  clock: the server subtracts the age from the gateway's epoch_ms (or from the
+  arrival time while the gateway is unsynced).
+*/
+
+#ifndef RELAY_FRAME_H
+#define RELAY_FRAME_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define RELAY_FRAME_MAGIC 0xC7
+#define RELAY_FRAME_MAX 250 // ESP_NOW_MAX_DATA_LEN
+#define RELAY_UPLINK_MAX 1400 // One unfragmented UDP datagram
+#define RELAY_CAT_ID_LEN 8    // CONFIG_CAT_ID_LEN
+
+#define RELAY_RECORD_SIZE 12
+#define RELAY_BEACON_SIZE (4 + 2 * RELAY_CAT_ID_LEN + 2)
+#define RELAY_BATCH_HEADER (4 + RELAY_CAT_ID_LEN + 3)
+#define RELAY_BATCH_MAX_RECORDS ((RELAY_FRAME_MAX - RELAY_BATCH_HEADER) / RELAY_RECORD_SIZE)
+#define RELAY_UPLINK_HEADER (4 + RELAY_CAT_ID_LEN + 8 + 1)
+#define RELAY_SECTION_HEADER (RELAY_CAT_ID_LEN + 5)
+
+typedef enum
+{
+    RELAY_FRAME_BEACON = 1,
+    RELAY_FRAME_BATCH = 2,
+    RELAY_FRAME_UPLINK = 3,
+} relay_frame_type_t;
+
+#define RELAY_BEACON_UPLINK 0x01 // flags: the gateway's own link to the server is up
+#define RELAY_RECORD_TEMP 0x01   // flags: temp is valid
+
+typedef struct
+{
+    uint16_t seq;
+    char gateway_id[RELAY_CAT_ID_LEN + 1];
+    uint8_t load; // Leaves the gateway has heard from recently
+    uint8_t flags;
+    char leader_id[RELAY_CAT_ID_LEN + 1]; // Empty until the server has named one
+} relay_beacon_t;
+
+typedef struct
+{
+    uint8_t state; // CatState
+    uint8_t flags;
+    int16_t temp_centi_f;
+    uint32_t duration_s; // Time in this state when the status was taken
+    uint32_t age_ms;
+} relay_record_t;
+
+typedef struct
+{
+    uint16_t seq;
+    char cat_id[RELAY_CAT_ID_LEN + 1];
+    uint16_t udp_port;
+    uint8_t count;
+    const uint8_t *records; // count x RELAY_RECORD_SIZE
+} relay_batch_t;
+
+// Returns the frame type, or 0 if data is not a relay frame
+uint8_t relay_frame_type(const uint8_t *data, size_t len);
+
+size_t relay_frame_encode_beacon(const relay_beacon_t *beacon, uint8_t *out, size_t out_len);
+bool relay_frame_decode_beacon(const uint8_t *data, size_t len, relay_beacon_t *out);
+
+// Write a BATCH header; the count records follow at out + RELAY_BATCH_HEADER
+size_t relay_frame_batch_header(uint16_t seq, const char *cat_id, uint16_t udp_port, uint8_t count, uint8_t *out,
+                                size_t out_len);
+bool relay_frame_decode_batch(const uint8_t *data, size_t len, relay_batch_t *out);
+
+void relay_frame_put_record(uint8_t *p, const relay_record_t *record);
+void relay_frame_get_record(const uint8_t *p, relay_record_t *out);
+
+// UPLINK building: header, then for each leaf a section header and its records
+size_t relay_frame_uplink_header(uint16_t seq, const char *gateway_id, uint64_t epoch_ms, uint8_t sections,
+                                 uint8_t *out, size_t out_len);
+size_t relay_frame_section_header(const char *cat_id, uint16_t udp_port, uint16_t seq, uint8_t count, uint8_t *out,
+                                  size_t out_len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // RELAY_FRAME_H
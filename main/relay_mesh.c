@@ -0,0 +1,503 @@
+#include <string.h>
+
+#include "./relay_mesh.h"
+
+static void copy_id(char *dst, const char *src)
+{
+    size_t len = strnlen(src, RELAY_CAT_ID_LEN);
+    memcpy(dst, src, len);
+    dst[len] = '\0';
+}
+
+static uint32_t age_ms(int64_t now_ms, int64_t t_ms)
+{
+    int64_t age = now_ms - t_ms;
+    return age < 0 ? 0 : age > (int64_t)UINT32_MAX ? UINT32_MAX : (uint32_t)age;
+}
+
+// Leaf ////////////////////////////////////////////////////////////////////////
+
+void relay_leaf_init(relay_leaf_t *leaf, const char *cat_id, uint16_t udp_port, uint16_t first_seq)
+{
+    memset(leaf, 0, sizeof(*leaf));
+    copy_id(leaf->cat_id, cat_id);
+    leaf->udp_port = udp_port;
+    leaf->current = -1;
+    leaf->seq = first_seq;
+}
+
+bool relay_leaf_queue(relay_leaf_t *leaf, const relay_record_t *record, int64_t t_ms)
+{
+    bool kept_all = true;
+    if (leaf->count == RELAY_LEAF_QUEUE)
+    {
+        leaf->head = (leaf->head + 1) % RELAY_LEAF_QUEUE;
+        leaf->count--;
+        leaf->stats.overflows++;
+        kept_all = false;
+        // The dropped record was part of the unacked batch; once none is left the seq is spent
+        if (leaf->batch_count > 0 && --leaf->batch_count == 0)
+        {
+            leaf->seq++;
+        }
+    }
+    relay_queued_t *slot = &leaf->queue[(leaf->head + leaf->count) % RELAY_LEAF_QUEUE];
+    slot->record = *record;
+    slot->t_ms = t_ms;
+    leaf->count++;
+    leaf->stats.queued++;
+    return kept_all;
+}
+
+static int gateway_score(const relay_gateway_entry_t *gw)
+{
+    int penalty = gw->load * RELAY_LOAD_PENALTY_DB;
+    return gw->rssi - (penalty > RELAY_LOAD_PENALTY_MAX ? RELAY_LOAD_PENALTY_MAX : penalty);
+}
+
+static void forget_gateway(relay_leaf_t *leaf, int index)
+{
+    leaf->gateways[index].used = false;
+    if (leaf->current == index)
+    {
+        leaf->current = -1;
+        leaf->failures = 0;
+    }
+}
+
+// Drop silent gateways, then attach to (or move to) the best one left
+static void elect(relay_leaf_t *leaf, int64_t now_ms)
+{
+    int best = -1;
+    for (int i = 0; i < RELAY_MAX_GATEWAYS; i++)
+    {
+        if (!leaf->gateways[i].used)
+        {
+            continue;
+        }
+        if (now_ms - leaf->gateways[i].heard_ms > RELAY_GATEWAY_EXPIRY_MS)
+        {
+            forget_gateway(leaf, i);
+            continue;
+        }
+        if (best < 0 || gateway_score(&leaf->gateways[i]) > gateway_score(&leaf->gateways[best]))
+        {
+            best = i;
+        }
+    }
+    if (best < 0 || best == leaf->current)
+    {
+        return;
+    }
+    if (leaf->current < 0 ||
+        gateway_score(&leaf->gateways[best]) >= gateway_score(&leaf->gateways[leaf->current]) + RELAY_HYSTERESIS_DB)
+    {
+        leaf->current = best;
+        leaf->failures = 0;
+        leaf->retry_ms = 0;
+        leaf->stats.handovers++;
+    }
+}
+
+bool relay_leaf_on_beacon(relay_leaf_t *leaf, const uint8_t mac[RELAY_MAC_LEN], int rssi, const uint8_t *data,
+                          size_t len, int64_t now_ms)
+{
+    relay_beacon_t beacon;
+    if (!relay_frame_decode_beacon(data, len, &beacon))
+    {
+        return false;
+    }
+
+    int slot = -1;
+    int free_slot = -1;
+    int weakest = -1;
+    for (int i = 0; i < RELAY_MAX_GATEWAYS; i++)
+    {
+        relay_gateway_entry_t *gw = &leaf->gateways[i];
+        if (!gw->used)
+        {
+            free_slot = free_slot < 0 ? i : free_slot;
+        }
+        else if (memcmp(gw->mac, mac, RELAY_MAC_LEN) == 0)
+        {
+            slot = i;
+        }
+        else if (i != leaf->current && (weakest < 0 || gw->rssi < leaf->gateways[weakest].rssi))
+        {
+            weakest = i;
+        }
+    }
+
+    if (!(beacon.flags & RELAY_BEACON_UPLINK))
+    {
+        // A gateway that cannot reach the server is no use to a leaf
+        if (slot >= 0)
+        {
+            forget_gateway(leaf, slot);
+        }
+        return false;
+    }
+
+    if (slot >= 0)
+    {
+        leaf->gateways[slot].rssi = (3 * leaf->gateways[slot].rssi + rssi) / 4;
+    }
+    else
+    {
+        slot = free_slot >= 0 ? free_slot : (weakest >= 0 && leaf->gateways[weakest].rssi < rssi ? weakest : -1);
+        if (slot < 0)
+        {
+            return false;
+        }
+        memcpy(leaf->gateways[slot].mac, mac, RELAY_MAC_LEN);
+        leaf->gateways[slot].used = true;
+        leaf->gateways[slot].rssi = rssi;
+    }
+    relay_gateway_entry_t *gw = &leaf->gateways[slot];
+    copy_id(gw->cat_id, beacon.gateway_id);
+    copy_id(gw->leader_id, beacon.leader_id);
+    gw->load = beacon.load;
+    gw->heard_ms = now_ms;
+
+    elect(leaf, now_ms);
+
+    if (leaf->current < 0)
+    {
+        return false;
+    }
+    const char *leader = leaf->gateways[leaf->current].leader_id;
+    if (leader[0] == '\0' || strcmp(leader, leaf->leader_id) == 0)
+    {
+        return false;
+    }
+    copy_id(leaf->leader_id, leader);
+    return true;
+}
+
+size_t relay_leaf_poll(relay_leaf_t *leaf, int64_t now_ms, uint8_t *out, size_t out_len, uint8_t mac_out[RELAY_MAC_LEN])
+{
+    elect(leaf, now_ms);
+    if (leaf->in_flight || leaf->current < 0 || leaf->count == 0 || now_ms < leaf->retry_ms)
+    {
+        return 0;
+    }
+
+    // A retry carries exactly the records of the first attempt, under the same seq
+    int count = leaf->batch_count;
+    if (count == 0)
+    {
+        if (leaf->count < (int)RELAY_BATCH_MAX_RECORDS && now_ms - leaf->queue[leaf->head].t_ms < RELAY_LEAF_HOLD_MS)
+        {
+            return 0;
+        }
+        count = leaf->count < (int)RELAY_BATCH_MAX_RECORDS ? leaf->count : (int)RELAY_BATCH_MAX_RECORDS;
+    }
+
+    size_t n = relay_frame_batch_header(leaf->seq, leaf->cat_id, leaf->udp_port, (uint8_t)count, out, out_len);
+    if (n == 0)
+    {
+        return 0;
+    }
+    for (int i = 0; i < count; i++)
+    {
+        const relay_queued_t *queued = &leaf->queue[(leaf->head + i) % RELAY_LEAF_QUEUE];
+        relay_record_t record = queued->record;
+        record.age_ms = age_ms(now_ms, queued->t_ms);
+        relay_frame_put_record(out + n, &record);
+        n += RELAY_RECORD_SIZE;
+    }
+
+    leaf->batch_count = (uint8_t)count;
+    leaf->in_flight = true;
+    leaf->stats.sends++;
+    memcpy(mac_out, leaf->gateways[leaf->current].mac, RELAY_MAC_LEN);
+    return n;
+}
+
+void relay_leaf_on_sent(relay_leaf_t *leaf, bool acked, int64_t now_ms)
+{
+    if (!leaf->in_flight)
+    {
+        return;
+    }
+    leaf->in_flight = false;
+
+    if (acked)
+    {
+        if (leaf->batch_count > 0)
+        {
+            leaf->head = (leaf->head + leaf->batch_count) % RELAY_LEAF_QUEUE;
+            leaf->count -= leaf->batch_count;
+            leaf->stats.batches++;
+            leaf->stats.records += leaf->batch_count;
+            leaf->batch_count = 0;
+            leaf->seq++;
+        }
+        leaf->failures = 0;
+        leaf->retry_ms = 0;
+        return;
+    }
+
+    leaf->stats.failures++;
+    leaf->failures++;
+    leaf->retry_ms = now_ms + (int64_t)RELAY_RETRY_MS * leaf->failures;
+    if (leaf->failures >= RELAY_MAX_SEND_FAILURES && leaf->current >= 0)
+    {
+        // Out of range; whichever gateway is elected next gets the same batch
+        forget_gateway(leaf, leaf->current);
+        elect(leaf, now_ms);
+        leaf->retry_ms = 0;
+    }
+}
+
+const relay_gateway_entry_t *relay_leaf_gateway(const relay_leaf_t *leaf)
+{
+    return leaf->current < 0 ? NULL : &leaf->gateways[leaf->current];
+}
+
+// Gateway /////////////////////////////////////////////////////////////////////
+
+void relay_gateway_init(relay_gateway_t *gw, const char *cat_id, int64_t now_ms)
+{
+    memset(gw, 0, sizeof(*gw));
+    copy_id(gw->cat_id, cat_id);
+    gw->next_beacon_ms = now_ms;
+    gw->jitter = 2166136261u; // FNV-1a of the ID, so every gateway draws differently
+    for (const char *p = gw->cat_id; *p; p++)
+    {
+        gw->jitter = (gw->jitter ^ (uint8_t)*p) * 16777619u;
+    }
+    gw->jitter |= 1;
+}
+
+static int64_t beacon_jitter(relay_gateway_t *gw)
+{
+    gw->jitter ^= gw->jitter << 13;
+    gw->jitter ^= gw->jitter >> 17;
+    gw->jitter ^= gw->jitter << 5;
+    return gw->jitter % RELAY_BEACON_JITTER_MS;
+}
+
+static bool leaf_has_held(const relay_gateway_t *gw, int index)
+{
+    for (int i = 0; i < gw->held_count; i++)
+    {
+        if (gw->held[i].leaf == index)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Index of the leaf with this MAC, adding it in place of the stalest if need be
+static int find_leaf(relay_gateway_t *gw, const uint8_t mac[RELAY_MAC_LEN], bool *added)
+{
+    int free_slot = -1;
+    int stalest = -1;
+    *added = false;
+    for (int i = 0; i < RELAY_MAX_LEAVES; i++)
+    {
+        const relay_leaf_entry_t *leaf = &gw->leaves[i];
+        if (!leaf->used)
+        {
+            free_slot = free_slot < 0 ? i : free_slot;
+        }
+        else if (memcmp(leaf->mac, mac, RELAY_MAC_LEN) == 0)
+        {
+            return i;
+        }
+        else if ((stalest < 0 || leaf->heard_ms < gw->leaves[stalest].heard_ms) && !leaf_has_held(gw, i))
+        {
+            stalest = i;
+        }
+    }
+    int slot = free_slot;
+    if (slot < 0 && stalest >= 0)
+    {
+        slot = stalest;
+        gw->stats.evictions++;
+    }
+    if (slot >= 0)
+    {
+        memset(&gw->leaves[slot], 0, sizeof(gw->leaves[slot]));
+        gw->leaves[slot].used = true;
+        memcpy(gw->leaves[slot].mac, mac, RELAY_MAC_LEN);
+        *added = true;
+    }
+    return slot;
+}
+
+bool relay_gateway_on_batch(relay_gateway_t *gw, const uint8_t mac[RELAY_MAC_LEN], const uint8_t *data, size_t len,
+                            int64_t now_ms)
+{
+    relay_batch_t batch;
+    bool added;
+    int index;
+    if (!relay_frame_decode_batch(data, len, &batch) || (index = find_leaf(gw, mac, &added)) < 0)
+    {
+        gw->stats.rejected++;
+        return false;
+    }
+
+    relay_leaf_entry_t *leaf = &gw->leaves[index];
+    leaf->heard_ms = now_ms;
+    int16_t ahead = (int16_t)(batch.seq - leaf->last_seq);
+    if (!added && ahead <= 0 && ahead > -RELAY_SEQ_WINDOW)
+    {
+        gw->stats.duplicates++;
+        return true;
+    }
+    leaf->last_seq = batch.seq;
+    copy_id(leaf->cat_id, batch.cat_id);
+    leaf->udp_port = batch.udp_port;
+    gw->stats.batches++;
+
+    for (int i = 0; i < batch.count; i++)
+    {
+        if (gw->held_count == RELAY_GATEWAY_QUEUE)
+        {
+            // Uplink down for a while: keep the newest
+            memmove(&gw->held[0], &gw->held[1], (RELAY_GATEWAY_QUEUE - 1) * sizeof(gw->held[0]));
+            gw->held_count--;
+            gw->stats.overflows++;
+        }
+        if (gw->held_count == 0)
+        {
+            gw->held_since_ms = now_ms;
+        }
+        relay_held_t *held = &gw->held[gw->held_count++];
+        relay_frame_get_record(batch.records + i * RELAY_RECORD_SIZE, &held->record);
+        held->t_ms = now_ms - held->record.age_ms;
+        held->seq = batch.seq;
+        held->leaf = (uint8_t)index;
+        gw->stats.records++;
+    }
+    return true;
+}
+
+void relay_gateway_set_leader(relay_gateway_t *gw, const char *leader_id, int64_t now_ms)
+{
+    if (strncmp(gw->leader_id, leader_id, RELAY_CAT_ID_LEN) != 0)
+    {
+        copy_id(gw->leader_id, leader_id);
+        gw->next_beacon_ms = now_ms + beacon_jitter(gw);
+    }
+}
+
+void relay_gateway_set_uplink(relay_gateway_t *gw, bool up)
+{
+    gw->uplink_up = up;
+}
+
+int relay_gateway_load(const relay_gateway_t *gw, int64_t now_ms)
+{
+    int load = 0;
+    for (int i = 0; i < RELAY_MAX_LEAVES; i++)
+    {
+        if (gw->leaves[i].used && now_ms - gw->leaves[i].heard_ms <= RELAY_LEAF_ACTIVE_MS)
+        {
+            load++;
+        }
+    }
+    return load;
+}
+
+size_t relay_gateway_beacon(relay_gateway_t *gw, int64_t now_ms, uint8_t *out, size_t out_len)
+{
+    if (now_ms < gw->next_beacon_ms)
+    {
+        return 0;
+    }
+    relay_beacon_t beacon = {
+        .seq = gw->beacon_seq,
+        .load = (uint8_t)relay_gateway_load(gw, now_ms),
+        .flags = gw->uplink_up ? RELAY_BEACON_UPLINK : 0,
+    };
+    copy_id(beacon.gateway_id, gw->cat_id);
+    copy_id(beacon.leader_id, gw->leader_id);
+    size_t n = relay_frame_encode_beacon(&beacon, out, out_len);
+    if (n > 0)
+    {
+        gw->beacon_seq++;
+        gw->next_beacon_ms = now_ms + RELAY_BEACON_MS - RELAY_BEACON_JITTER_MS / 2 + beacon_jitter(gw);
+        gw->stats.beacons++;
+    }
+    return n;
+}
+
+// Held records from start that make whole sections fitting in room; returns the bytes
+static size_t sections_that_fit(const relay_gateway_t *gw, size_t room, int *records, int *sections)
+{
+    size_t bytes = 0;
+    *records = 0;
+    *sections = 0;
+    int i = 0;
+    while (i < gw->held_count && *sections < 255)
+    {
+        int end = i + 1;
+        while (end < gw->held_count && end - i < 255 && gw->held[end].leaf == gw->held[i].leaf &&
+               gw->held[end].seq == gw->held[i].seq)
+        {
+            end++;
+        }
+        size_t size = RELAY_SECTION_HEADER + (size_t)(end - i) * RELAY_RECORD_SIZE;
+        if (bytes + size > room)
+        {
+            break;
+        }
+        bytes += size;
+        *records = end;
+        (*sections)++;
+        i = end;
+    }
+    return bytes;
+}
+
+size_t relay_gateway_uplink(relay_gateway_t *gw, int64_t now_ms, uint64_t epoch_ms, uint8_t *out, size_t out_len)
+{
+    if (gw->held_count == 0 || !gw->uplink_up || out_len < RELAY_UPLINK_HEADER)
+    {
+        return 0;
+    }
+    size_t room = (out_len < RELAY_UPLINK_MAX ? out_len : RELAY_UPLINK_MAX) - RELAY_UPLINK_HEADER;
+    int records;
+    int sections;
+    size_t bytes = sections_that_fit(gw, room, &records, &sections);
+    // Hold until the oldest record has waited long enough, unless another full batch would not fit
+    bool full = records < gw->held_count ||
+                room - bytes < RELAY_SECTION_HEADER + RELAY_BATCH_MAX_RECORDS * RELAY_RECORD_SIZE;
+    if (records == 0 || (!full && now_ms - gw->held_since_ms < RELAY_UPLINK_HOLD_MS))
+    {
+        return 0;
+    }
+
+    size_t n = relay_frame_uplink_header(gw->uplink_seq, gw->cat_id, epoch_ms, (uint8_t)sections, out, out_len);
+    for (int i = 0; i < records;)
+    {
+        const relay_held_t *first = &gw->held[i];
+        const relay_leaf_entry_t *leaf = &gw->leaves[first->leaf];
+        int end = i + 1;
+        while (end < records && end - i < 255 && gw->held[end].leaf == first->leaf && gw->held[end].seq == first->seq)
+        {
+            end++;
+        }
+        n += relay_frame_section_header(leaf->cat_id, leaf->udp_port, first->seq, (uint8_t)(end - i), out + n,
+                                        out_len - n);
+        for (; i < end; i++)
+        {
+            relay_record_t record = gw->held[i].record;
+            record.age_ms = age_ms(now_ms, gw->held[i].t_ms);
+            relay_frame_put_record(out + n, &record);
+            n += RELAY_RECORD_SIZE;
+        }
+    }
+
+    gw->held_count -= records;
+    memmove(&gw->held[0], &gw->held[records], (size_t)gw->held_count * sizeof(gw->held[0]));
+    gw->held_since_ms = now_ms;
+    gw->uplink_seq++;
+    gw->stats.uplinks++;
+    gw->stats.uplink_bytes += (uint32_t)n;
+    return n;
+}
@@ -0,0 +1,213 @@
+/*
+  Routing and aggregation for the ESP-NOW relay.
+
+  Pure logic with no ESP-IDF dependencies, driven by relay.c on the collar and
+  by the relay simulator (sim/mesh/relay_sim.c) for fleets of hundreds. Time
+  is passed in as milliseconds on any monotonic clock; addresses are the
+  6-byte MACs ESP-NOW uses.
+
+  The relay is a star around each gateway: a collar with its own Wi-Fi link
+  (a gateway) beacons; collars without one (leaves) attach to the best gateway
+  they hear and hand it their status, and the gateway forwards everything it
+  collects in one UDP datagram at a time. The leader flows the other way in
+  every beacon.
+
+  Leaf: keeps the gateways it has heard in a small table and attaches to the
+  one with the best RSSI after a penalty for its load. It only moves to another
+  gateway that beats the current one by RELAY_HYSTERESIS_DB, so two gateways
+  at similar range do not take turns. A gateway is dropped after
+  RELAY_GATEWAY_EXPIRY_MS without a beacon, or after RELAY_MAX_SEND_FAILURES
+  unacknowledged batches in a row. Status records wait in a ring (the oldest
+  is dropped when it is full) and go out at most RELAY_BATCH_MAX_RECORDS per
+  batch, one batch in flight at a time, so whatever queues while a batch is
+  out is aggregated into the next. A batch that is not acked is sent again
+  with the same seq.
+
+  Gateway: remembers up to RELAY_MAX_LEAVES leaves and the last batch seq of
+  each, so a batch whose ack was lost is forwarded only once. When the table
+  is full the leaf heard from longest ago makes room (the server drops the odd
+  repeat that lets through). Beacons are jittered, since a leader change
+  reaches every gateway at once. Records are
+  held up to RELAY_UPLINK_HOLD_MS, or until a datagram is nearly full, then
+  sent together, one section per leaf batch.
+*/
+
+#ifndef RELAY_MESH_H
+#define RELAY_MESH_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "./relay_frame.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define RELAY_MAC_LEN 6
+
+#define RELAY_BEACON_MS 1000
+#define RELAY_BEACON_JITTER_MS 100 // Spread over this much so gateways that booted together do not collide
+#define RELAY_GATEWAY_EXPIRY_MS (3 * RELAY_BEACON_MS + 500) // Three missed beacons
+#define RELAY_MAX_GATEWAYS 8
+#define RELAY_HYSTERESIS_DB 6
+#define RELAY_LOAD_PENALTY_DB 1 // Per leaf already on the gateway, in dB ...
+#define RELAY_LOAD_PENALTY_MAX 12 // ... up to this much
+#define RELAY_MAX_SEND_FAILURES 4
+#define RELAY_RETRY_MS 50 // Backoff after a failed send, times the failures in a row
+#define RELAY_LEAF_QUEUE 64
+#define RELAY_LEAF_HOLD_MS 100 // A lone record waits this long for company
+
+#define RELAY_MAX_LEAVES 32
+#define RELAY_LEAF_ACTIVE_MS 60000 // A leaf counts towards the load this long after its last batch
+#define RELAY_SEQ_WINDOW 256 // A seq this far behind the last means the leaf rebooted
+#define RELAY_GATEWAY_QUEUE 128
+#define RELAY_UPLINK_HOLD_MS 1000
+
+typedef struct
+{
+    relay_record_t record; // age_ms unused while queued
+    int64_t t_ms;          // When the sample was taken
+} relay_queued_t;
+
+typedef struct
+{
+    bool used;
+    uint8_t mac[RELAY_MAC_LEN];
+    char cat_id[RELAY_CAT_ID_LEN + 1];
+    int rssi; // Smoothed over beacons
+    uint8_t load;
+    char leader_id[RELAY_CAT_ID_LEN + 1];
+    int64_t heard_ms;
+} relay_gateway_entry_t;
+
+typedef struct
+{
+    uint32_t queued;
+    uint32_t overflows; // Oldest records dropped from a full queue
+    uint32_t batches;   // Acked batches
+    uint32_t records;   // Records in acked batches
+    uint32_t sends;     // Batch transmissions, including retries
+    uint32_t failures;  // Unacked transmissions
+    uint32_t handovers; // Changes of gateway, including the first attach
+} relay_leaf_stats_t;
+
+typedef struct
+{
+    char cat_id[RELAY_CAT_ID_LEN + 1];
+    uint16_t udp_port;
+    relay_gateway_entry_t gateways[RELAY_MAX_GATEWAYS];
+    int current; // Index into gateways, -1 while detached
+
+    relay_queued_t queue[RELAY_LEAF_QUEUE];
+    int head;
+    int count;
+
+    uint16_t seq;
+    uint8_t batch_count; // Oldest records bound to seq until it is acked
+    bool in_flight;      // Waiting for the send callback
+    int failures;        // In a row
+    int64_t retry_ms;
+
+    char leader_id[RELAY_CAT_ID_LEN + 1];
+    relay_leaf_stats_t stats;
+} relay_leaf_t;
+
+// first_seq should differ between boots (esp_random()) so the gateway does not
+// take the new batches for repeats of the old ones
+void relay_leaf_init(relay_leaf_t *leaf, const char *cat_id, uint16_t udp_port, uint16_t first_seq);
+
+// Queue one status record taken at t_ms; returns false if it pushed out the oldest
+bool relay_leaf_queue(relay_leaf_t *leaf, const relay_record_t *record, int64_t t_ms);
+
+// A beacon arrived; returns true when the leader announced by this leaf's
+// gateway changed, with the new one in leaf->leader_id
+bool relay_leaf_on_beacon(relay_leaf_t *leaf, const uint8_t mac[RELAY_MAC_LEN], int rssi, const uint8_t *data,
+                          size_t len, int64_t now_ms);
+
+// Build the next batch if one is due, to be sent to mac_out; returns its length or 0
+size_t relay_leaf_poll(relay_leaf_t *leaf, int64_t now_ms, uint8_t *out, size_t out_len, uint8_t mac_out[RELAY_MAC_LEN]);
+
+// Outcome of the batch returned by the last poll (the ESP-NOW send callback)
+void relay_leaf_on_sent(relay_leaf_t *leaf, bool acked, int64_t now_ms);
+
+// Current gateway, NULL while detached
+const relay_gateway_entry_t *relay_leaf_gateway(const relay_leaf_t *leaf);
+
+typedef struct
+{
+    bool used;
+    uint8_t mac[RELAY_MAC_LEN];
+    char cat_id[RELAY_CAT_ID_LEN + 1];
+    uint16_t udp_port;
+    uint16_t last_seq;
+    int64_t heard_ms;
+} relay_leaf_entry_t;
+
+typedef struct
+{
+    int64_t t_ms;          // When the leaf took the sample, on the gateway's clock
+    relay_record_t record; // age_ms unused while held
+    uint16_t seq;          // Of the batch it came in
+    uint8_t leaf;          // Index into leaves
+} relay_held_t;            // In this order it packs into 24 bytes
+
+typedef struct
+{
+    uint32_t batches;    // New batches accepted
+    uint32_t duplicates; // Batches seen before (their ack was lost)
+    uint32_t rejected;   // Malformed, or no room for another leaf
+    uint32_t evictions;  // Leaves forgotten to make room for another
+    uint32_t records;
+    uint32_t overflows; // Records dropped because the uplink queue was full
+    uint32_t uplinks;
+    uint32_t uplink_bytes;
+    uint32_t beacons;
+} relay_gateway_stats_t;
+
+typedef struct
+{
+    char cat_id[RELAY_CAT_ID_LEN + 1];
+    relay_leaf_entry_t leaves[RELAY_MAX_LEAVES];
+
+    relay_held_t held[RELAY_GATEWAY_QUEUE];
+    int held_count;
+    int64_t held_since_ms; // When the oldest held record arrived (about)
+
+    uint16_t beacon_seq;
+    uint16_t uplink_seq;
+    int64_t next_beacon_ms;
+    uint32_t jitter; // xorshift state, seeded from cat_id
+    bool uplink_up;
+    char leader_id[RELAY_CAT_ID_LEN + 1];
+    relay_gateway_stats_t stats;
+} relay_gateway_t;
+
+void relay_gateway_init(relay_gateway_t *gw, const char *cat_id, int64_t now_ms);
+
+// A BATCH arrived from mac; returns false if it was malformed or refused
+bool relay_gateway_on_batch(relay_gateway_t *gw, const uint8_t mac[RELAY_MAC_LEN], const uint8_t *data, size_t len,
+                            int64_t now_ms);
+
+// The server named a leader; a change is beaconed at once
+void relay_gateway_set_leader(relay_gateway_t *gw, const char *leader_id, int64_t now_ms);
+
+// Leaves only attach to a gateway whose own link is up
+void relay_gateway_set_uplink(relay_gateway_t *gw, bool up);
+
+// Leaves heard from in the last RELAY_LEAF_ACTIVE_MS
+int relay_gateway_load(const relay_gateway_t *gw, int64_t now_ms);
+
+// Build the next beacon if one is due; returns its length or 0
+size_t relay_gateway_beacon(relay_gateway_t *gw, int64_t now_ms, uint8_t *out, size_t out_len);
+
+// Build the next uplink datagram if one is due (epoch_ms 0 while the clock is
+// unsynced); the records in it are released, so send it or lose it
+size_t relay_gateway_uplink(relay_gateway_t *gw, int64_t now_ms, uint64_t epoch_ms, uint8_t *out, size_t out_len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // RELAY_MESH_H
@@ -0,0 +1,80 @@
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include "esp_log.h"
+#include "esp_rom_sys.h"
+#include "sdkconfig.h"
+
+#include "./static_alloc.h"
+
+#if STATIC_ALLOC && !CONFIG_HEAP_USE_HOOKS
+#error "STATIC_ALLOC needs CONFIG_HEAP_USE_HOOKS=y to check the steady state"
+#endif
+
+static const char *TAG = "static_alloc";
+
+static volatile bool s_sealed = false;
+static uint32_t s_boot = 0;
+static uint32_t s_steady = 0;
+static uint32_t s_exempt = 0;
+
+// Per task: set once at task entry, so the hook needs no lookup
+static __thread bool t_watched = false;
+static __thread int t_exempt_depth = 0;
+
+void static_alloc_watch_task(void)
+{
+    t_watched = true;
+}
+
+void static_alloc_seal(void)
+{
+    s_sealed = true;
+    ESP_LOGI(TAG, "Sealed after %u allocations by collar tasks%s", (unsigned)__atomic_load_n(&s_boot, __ATOMIC_RELAXED),
+             STATIC_ALLOC ? "; any more will abort" : "");
+}
+
+void static_alloc_exempt_begin(void)
+{
+    t_exempt_depth++;
+}
+
+void static_alloc_exempt_end(void)
+{
+    t_exempt_depth--;
+}
+
+void static_alloc_get_stats(static_alloc_stats_t *out)
+{
+    out->boot = __atomic_load_n(&s_boot, __ATOMIC_RELAXED);
+    out->steady = __atomic_load_n(&s_steady, __ATOMIC_RELAXED);
+    out->exempt = __atomic_load_n(&s_exempt, __ATOMIC_RELAXED);
+}
+
+#if STATIC_ALLOC
+// Called by the heap on every allocation (CONFIG_HEAP_USE_HOOKS); must not allocate itself
+void esp_heap_trace_alloc_hook(void *ptr, size_t size, uint32_t caps)
+{
+    if (!t_watched)
+    {
+        return; // Wi-Fi, lwIP, esp_timer and the other system tasks manage their own memory
+    }
+    if (!s_sealed)
+    {
+        __atomic_add_fetch(&s_boot, 1, __ATOMIC_RELAXED);
+        return;
+    }
+    if (t_exempt_depth > 0)
+    {
+        __atomic_add_fetch(&s_exempt, 1, __ATOMIC_RELAXED);
+        return;
+    }
+    __atomic_add_fetch(&s_steady, 1, __ATOMIC_RELAXED);
+    esp_rom_printf("static_alloc: %u byte allocation at %p in steady state\n", (unsigned)size, ptr);
+    abort();
+}
+
+void esp_heap_trace_free_hook(void *ptr)
+{
+}
+#endif
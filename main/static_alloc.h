@@ -0,0 +1,55 @@
+/*
+  Zero-heap runtime mode.
+
+  Built with STATIC_ALLOC 1 (idf.py -DSTATIC_ALLOC=1 build, or the simulator's
+  SIM_STATIC_ALLOC option), every task created through task_plan_create() gets
+  its stack and TCB from a static arena sized in task_plan.h instead of the heap.
+  Queues, mutexes and the Wi-Fi event group are static in every build, and the
+  hot paths (I2C register access and display frames, status datagrams) never
+  allocate.
+
+  After boot, app_main() calls static_alloc_seal(). From then on, a heap
+  allocation made by one of the collar's own tasks is a bug: the heap hook
+  reports it and aborts, so a long soak (or a simulator run) either stays
+  allocation-free or stops at the culprit. Calls into lwIP, the OTA job and
+  config changes are bracketed with static_alloc_exempt_begin()/end(). lwIP
+  takes its pbufs from the heap internally whatever the caller does, and an
+  update or a config push (NVS writes, the restart timer) is not steady
+  state. Exempt allocations are only counted.
+
+  The mode needs CONFIG_HEAP_USE_HOOKS=y in the ESP-IDF build. Its post-build
+  step (tools/mem_budget.js) reports the image's static RAM per source file and
+  fails the build when main/ goes over its budget.
+*/
+
+#ifndef STATIC_ALLOC_H
+#define STATIC_ALLOC_H
+
+#include <stdint.h>
+
+#ifndef STATIC_ALLOC
+#define STATIC_ALLOC 0
+#endif
+
+#define STATIC_ALLOC_SETTLE_MS 5000 // Tasks finish their own setup (sockets, first log lines) before the seal
+
+typedef struct
+{
+    uint32_t boot;   // Allocations by collar tasks before the seal
+    uint32_t steady; // After the seal: always 0 unless the hook is off
+    uint32_t exempt; // After the seal, inside an exempt bracket
+} static_alloc_stats_t;
+
+// Count the calling task as one of the collar's own (task_plan_create() does this)
+void static_alloc_watch_task(void);
+
+// Boot is over; allocations by watched tasks are fatal from now on
+void static_alloc_seal(void);
+
+// Allow allocations by the calling task until the matching end (nests)
+void static_alloc_exempt_begin(void);
+void static_alloc_exempt_end(void);
+
+void static_alloc_get_stats(static_alloc_stats_t *out);
+
+#endif // STATIC_ALLOC_H
@@ -0,0 +1,261 @@
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/param.h>
+
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#include "lwip/sockets.h"
+#include <arpa/inet.h>
+
+#include "./collar_config.h"
+#include "./static_alloc.h"
+#include "./task_plan.h"
+#include "./uart_stream.h"
+
+#define TASK_PLAN_MAX_TASKS 12
+#define TASK_PLAN_STACK_ALIGN 16
+#define JITTER_LOAD_PAYLOAD 512 // Bytes per synthetic UDP packet
+
+static const char *TAG = "task_plan";
+
+// What a task runs, so every task starts in task_entry()
+typedef struct
+{
+    TaskFunction_t fn;
+    void *arg;
+} task_start_t;
+
+static TaskHandle_t s_tasks[TASK_PLAN_MAX_TASKS];
+static task_start_t s_starts[TASK_PLAN_MAX_TASKS];
+static int s_task_count = 0;
+
+// Where STATIC_ALLOC takes task stacks from
+typedef struct
+{
+    StackType_t *base;
+    size_t size;
+    size_t used;
+    const char *name; // For the error when it is full
+} stack_arena_t;
+
+#if STATIC_ALLOC
+static StackType_t s_stack_arena[TASK_PLAN_STACK_ARENA / sizeof(StackType_t)] __attribute__((aligned(TASK_PLAN_STACK_ALIGN)));
+static stack_arena_t s_arena = {s_stack_arena, sizeof(s_stack_arena), 0, "TASK_PLAN_STACK_ARENA"};
+#if TASK_PLAN_DIAG_ARENA > 0
+// Named for tools/mem_budget.js, which reports it apart from the budget
+static StackType_t s_diag_stack_arena[TASK_PLAN_DIAG_ARENA / sizeof(StackType_t)] __attribute__((aligned(TASK_PLAN_STACK_ALIGN)));
+static stack_arena_t s_diag_arena = {s_diag_stack_arena, sizeof(s_diag_stack_arena), 0, "TASK_PLAN_DIAG_ARENA"};
+#else
+static stack_arena_t s_diag_arena = {NULL, 0, 0, "TASK_PLAN_DIAG_ARENA"};
+#endif
+static StaticTask_t s_tcbs[TASK_PLAN_MAX_TASKS];
+#endif
+
+static void task_entry(void *arg)
+{
+    const task_start_t *start = arg;
+    static_alloc_watch_task();
+#if STATIC_ALLOC
+    // newlib's float formatting allocates this task's Bigint cache on first use; get it over with at boot
+    char warm[32];
+    snprintf(warm, sizeof(warm), "%.2f %.6f", 81.62, 1e-3);
+#endif
+    start->fn(start->arg);
+}
+
+// arena is only used under STATIC_ALLOC
+static BaseType_t create(TaskFunction_t fn, const char *name, uint32_t stack, void *arg, UBaseType_t prio,
+                         BaseType_t core, TaskHandle_t *out, stack_arena_t *arena)
+{
+    // Tasks are only created from app_main() and the modules' init calls, one at a time
+    if (s_task_count >= TASK_PLAN_MAX_TASKS)
+    {
+        ESP_LOGE(TAG, "No slot for %s, raise TASK_PLAN_MAX_TASKS", name);
+        return pdFAIL;
+    }
+    task_start_t *start = &s_starts[s_task_count];
+    start->fn = fn;
+    start->arg = arg;
+
+    TaskHandle_t handle = NULL;
+#if STATIC_ALLOC
+    size_t rounded = (stack + TASK_PLAN_STACK_ALIGN - 1) / TASK_PLAN_STACK_ALIGN * TASK_PLAN_STACK_ALIGN;
+    if (arena->used + rounded > arena->size)
+    {
+        ESP_LOGE(TAG, "Stack arena full at %s (%u of %u bytes used), add it to %s", name, (unsigned)arena->used,
+                 (unsigned)arena->size, arena->name);
+        return pdFAIL;
+    }
+    handle = xTaskCreateStaticPinnedToCore(task_entry, name, stack, start, prio,
+                                           (StackType_t *)((uint8_t *)arena->base + arena->used),
+                                           &s_tcbs[s_task_count], core);
+    BaseType_t ret = (handle != NULL) ? pdPASS : pdFAIL;
+    if (ret == pdPASS)
+    {
+        arena->used += rounded;
+    }
+#else
+    BaseType_t ret = xTaskCreatePinnedToCore(task_entry, name, stack, start, prio, &handle, core);
+#endif
+    if (ret != pdPASS)
+    {
+        ESP_LOGE(TAG, "Failed to create %s (%u bytes, prio %u, core %d)", name, (unsigned)stack, (unsigned)prio, (int)core);
+        return ret;
+    }
+    s_tasks[s_task_count++] = handle;
+    if (out != NULL)
+    {
+        *out = handle;
+    }
+    return ret;
+}
+
+BaseType_t task_plan_create(TaskFunction_t fn, const char *name, uint32_t stack, void *arg,
+                            UBaseType_t prio, BaseType_t core, TaskHandle_t *out)
+{
+#if STATIC_ALLOC
+    return create(fn, name, stack, arg, prio, core, out, &s_arena);
+#else
+    return create(fn, name, stack, arg, prio, core, out, NULL);
+#endif
+}
+
+BaseType_t task_plan_create_diag(TaskFunction_t fn, const char *name, UBaseType_t prio, BaseType_t core)
+{
+#if STATIC_ALLOC
+    return create(fn, name, TASK_DIAG_STACK, NULL, prio, core, NULL, &s_diag_arena);
+#else
+    return create(fn, name, TASK_DIAG_STACK, NULL, prio, core, NULL, NULL);
+#endif
+}
+
+// Jitter benchmark ////////////////////////////////////////////////////////////
+
+#if TASK_PLAN_JITTER_BENCH
+static portMUX_TYPE s_jitter_lock = portMUX_INITIALIZER_UNLOCKED;
+static int64_t s_last_sample_us = 0;
+static uint32_t s_jitter_count = 0;
+static int64_t s_jitter_min_us = INT64_MAX;
+static int64_t s_jitter_max_us = INT64_MIN;
+static double s_jitter_sum_us = 0;
+static double s_jitter_sumsq_us = 0;
+static uint32_t s_load_packets = 0;
+#endif
+
+void task_plan_record_sample(uint32_t period_ms)
+{
+#if TASK_PLAN_JITTER_BENCH
+    int64_t now = esp_timer_get_time();
+    portENTER_CRITICAL(&s_jitter_lock);
+    if (s_last_sample_us != 0)
+    {
+        // Deviation of the actual period from the intended one
+        int64_t error_us = (now - s_last_sample_us) - (int64_t)period_ms * 1000;
+        s_jitter_min_us = MIN(s_jitter_min_us, error_us);
+        s_jitter_max_us = MAX(s_jitter_max_us, error_us);
+        s_jitter_sum_us += error_us;
+        s_jitter_sumsq_us += (double)error_us * error_us;
+        s_jitter_count++;
+    }
+    s_last_sample_us = now;
+    portEXIT_CRITICAL(&s_jitter_lock);
+#endif
+}
+
+#if TASK_PLAN_JITTER_BENCH
+// Synthetic network load: flood the server with UDP from PRO_CPU at the lowest priority
+static void jitter_load_task(void *arg)
+{
+    static_alloc_exempt_begin(); // Synthetic load, lwIP pbufs and all
+    collar_config_t cfg;
+    config_get(&cfg);
+
+    int sockfd = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (sockfd < 0)
+    {
+        ESP_LOGE(TAG, "Jitter load: socket failed");
+        vTaskDelete(NULL);
+        return;
+    }
+
+    struct sockaddr_in server_addr = {0};
+    server_addr.sin_family = AF_INET;
+    server_addr.sin_port = htons(cfg.udp_port + 1000); // Nobody listens there, the packets only load the stack
+    inet_pton(AF_INET, cfg.host_ip, &server_addr.sin_addr);
+
+    static char payload[JITTER_LOAD_PAYLOAD];
+    memset(payload, 'x', sizeof(payload));
+
+    while (1)
+    {
+        for (int i = 0; i < 32; i++)
+        {
+            if (sendto(sockfd, payload, sizeof(payload), 0, (struct sockaddr *)&server_addr, sizeof(server_addr)) > 0)
+            {
+                s_load_packets++;
+            }
+        }
+        vTaskDelay(1); // Let the idle task feed the watchdog
+    }
+}
+
+static void report_jitter(void)
+{
+    portENTER_CRITICAL(&s_jitter_lock);
+    uint32_t count = s_jitter_count;
+    int64_t min_us = s_jitter_min_us;
+    int64_t max_us = s_jitter_max_us;
+    double sum = s_jitter_sum_us;
+    double sumsq = s_jitter_sumsq_us;
+    uint32_t packets = s_load_packets;
+    s_jitter_count = 0;
+    s_jitter_min_us = INT64_MAX;
+    s_jitter_max_us = INT64_MIN;
+    s_jitter_sum_us = 0;
+    s_jitter_sumsq_us = 0;
+    s_load_packets = 0;
+    portEXIT_CRITICAL(&s_jitter_lock);
+
+    if (count == 0)
+    {
+        ESP_LOGI(TAG, "Jitter: no samples");
+        return;
+    }
+    double mean = sum / count;
+    double stddev = sqrt(MAX(0.0, sumsq / count - mean * mean));
+    ESP_LOGI(TAG, "Jitter over %u periods: mean %+.1f us, stddev %.1f us, min %+lld us, max %+lld us (load %u pkts)",
+             (unsigned)count, mean, stddev, (long long)min_us, (long long)max_us, (unsigned)packets);
+}
+#endif
+
+#if TASK_PLAN_STACK_REPORT || TASK_PLAN_JITTER_BENCH
+static void diagnostics_task(void *arg)
+{
+    while (1)
+    {
+        vTaskDelay(pdMS_TO_TICKS(TASK_PLAN_REPORT_PERIOD_MS));
+#if TASK_PLAN_STACK_REPORT
+        for (int i = 0; i < s_task_count; i++)
+        {
+            ESP_LOGI(TAG, "Stack %-24s %5u bytes free at worst", pcTaskGetName(s_tasks[i]),
+                     (unsigned)uxTaskGetStackHighWaterMark(s_tasks[i]));
+        }
+#endif
+#if TASK_PLAN_JITTER_BENCH
+        report_jitter();
+#endif
+    }
+}
+#endif
+
+void task_plan_start_diagnostics(void)
+{
+#if TASK_PLAN_STACK_REPORT || TASK_PLAN_JITTER_BENCH
+    task_plan_create_diag(diagnostics_task, "task_plan_diag", 2, PRO_CPU);
+#endif
+#if TASK_PLAN_JITTER_BENCH
+    task_plan_create_diag(jitter_load_task, "jitter_load", 1, PRO_CPU);
+#endif
+}
@@ -0,0 +1,117 @@
+/*
+  Execution plan for the dual-core ESP32.
+
+  PRO_CPU (core 0) already runs the Wi-Fi driver, lwIP (CONFIG_LWIP_TCPIP_TASK_AFFINITY_CPU0)
+  and esp_timer, so everything that talks to the network or the display lives there too.
+  APP_CPU (core 1) is left to acquisition and classification so sampling is never
+  preempted by radio or socket work.
+
+  Stack sizes are in bytes. Build with TASK_PLAN_STACK_REPORT 1 to log every task's
+  high-water mark each TASK_PLAN_REPORT_PERIOD_MS and re-tune them after code changes:
+  each size is the deepest use seen plus 512 bytes of headroom, rounded up to 256.
+  The marks below are from the simulator (-DSIM_TASK_PLAN_STACK_REPORT=ON), whose exit
+  report has every task's deepest use ("stack_used"). The run had two collars
+  relaying, button gestures through every display mode, config SET/GET/ROLLBACK, an
+  OTA delta update and the UART stream. These are x86-64 marks and host frames are
+  not Xtensa frames (glibc's printf alone takes 2-3 KB, more than newlib's), so the
+  sizes must be re-checked on a collar with TASK_PLAN_STACK_REPORT 1 before shipping
+  and before cutting any of them.
+
+  With STATIC_ALLOC (static_alloc.h) the stacks come from an arena of exactly
+  TASK_PLAN_STACK_ARENA bytes, so a task added here must be added to it too.
+  The debug tasks below have their own arena, TASK_PLAN_DIAG_ARENA.
+*/
+
+#ifndef TASK_PLAN_H
+#define TASK_PLAN_H
+
+#include <stdint.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#define PRO_CPU 0
+#define APP_CPU 1
+
+// Acquisition + classification: highest application priority, alone on APP_CPU
+#define TASK_ACQUISITION_CORE APP_CPU
+#define TASK_ACQUISITION_PRIO 10
+#define TASK_ACQUISITION_STACK 4864 // 4216 measured
+
+// Network (net.h): one select() over the UDP socket, the /buzz WebSocket and the send queues
+#define TASK_NETWORK_CORE PRO_CPU
+#define TASK_NETWORK_PRIO 6
+#define TASK_NETWORK_STACK 6144 // 5592 measured
+
+// Button input (blocks on the ISR edge queue, only runs when the button moves)
+#define TASK_BUTTON_CORE PRO_CPU
+#define TASK_BUTTON_PRIO 5
+#define TASK_BUTTON_STACK 3328 // 2688 measured
+
+// ESP-NOW relay (relay.h): beacons, batches and the gateway's uplink; only started when relaying
+#define TASK_RELAY_CORE PRO_CPU
+#define TASK_RELAY_PRIO 5
+#define TASK_RELAY_STACK 4352 // 3832 measured
+
+// Alphanumeric display: lowest priority, only cosmetic
+#define TASK_DISPLAY_CORE PRO_CPU
+#define TASK_DISPLAY_PRIO 3
+#define TASK_DISPLAY_STACK 4352 // 3640 measured
+
+// Time sync bursts over the WebSocket (stamps are taken in the network task, so priority is not critical)
+#define TASK_TIMESYNC_CORE PRO_CPU
+#define TASK_TIMESYNC_PRIO 2
+#define TASK_TIMESYNC_STACK 4352 // 3640 measured
+
+// Firmware download and patching: background work, lowest application priority
+#define TASK_OTA_CORE PRO_CPU
+#define TASK_OTA_PRIO 1
+#define TASK_OTA_STACK 5120 // 4600 measured
+
+// Binary UART stream: host commands and periodic HELLO/STATS (sending happens in the callers' tasks)
+#define TASK_UART_CORE PRO_CPU
+#define TASK_UART_PRIO 2
+#define TASK_UART_STACK 4096 // 3448 measured
+
+// Deferred log drain (dlog.h): formats and writes what the other tasks logged, when nothing else needs the CPU
+#define TASK_DLOG_CORE PRO_CPU
+#define TASK_DLOG_PRIO 1
+#define TASK_DLOG_STACK 4352 // 3704 measured
+
+// Debug switches (0 for deployment)
+#ifndef TASK_PLAN_STACK_REPORT
+#define TASK_PLAN_STACK_REPORT 0
+#endif
+#ifndef TASK_PLAN_JITTER_BENCH
+#define TASK_PLAN_JITTER_BENCH 0 // Measure sampling jitter while flooding the network from PRO_CPU
+#endif
+
+#define TASK_PLAN_REPORT_PERIOD_MS 10000
+#define TASK_DIAG_STACK 4096 // Each of the debug tasks above; 3576 measured
+
+// Every stack task_plan_create() hands out under STATIC_ALLOC
+#define TASK_PLAN_STACK_ARENA                                                                                   \
+    (TASK_ACQUISITION_STACK + TASK_NETWORK_STACK + TASK_BUTTON_STACK + TASK_DISPLAY_STACK + TASK_TIMESYNC_STACK + \
+     TASK_OTA_STACK + TASK_UART_STACK + TASK_RELAY_STACK + TASK_DLOG_STACK)
+
+// The debug tasks' stacks (task_plan_create_diag()), in an arena of their own that
+// tools/mem_budget.js leaves out of the budget, so the switches work with STATIC_ALLOC
+#define TASK_PLAN_DIAG_ARENA                                                                         \
+    (TASK_DIAG_STACK * (TASK_PLAN_STACK_REPORT || TASK_PLAN_JITTER_BENCH) + TASK_DIAG_STACK * TASK_PLAN_JITTER_BENCH + \
+     TASK_DIAG_STACK * UART_STREAM_BENCH)
+
+// Create a task according to the plan and remember it for stack reports; its
+// allocations are checked after static_alloc_seal()
+BaseType_t task_plan_create(TaskFunction_t fn, const char *name, uint32_t stack, void *arg,
+                            UBaseType_t prio, BaseType_t core, TaskHandle_t *out);
+
+// The same for a debug task, with TASK_DIAG_STACK from TASK_PLAN_DIAG_ARENA
+BaseType_t task_plan_create_diag(TaskFunction_t fn, const char *name, UBaseType_t prio, BaseType_t core);
+
+// Start the stack report and/or jitter benchmark tasks when enabled above
+void task_plan_start_diagnostics(void);
+
+// Called by the acquisition task at every sample with the intended period
+void task_plan_record_sample(uint32_t period_ms);
+
+#endif // TASK_PLAN_H
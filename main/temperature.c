@@ -0,0 +1,106 @@
+#include <math.h>
+
+#include "esp_adc/adc_cali.h"
+#include "esp_adc/adc_cali_scheme.h"
+#include "esp_adc/adc_oneshot.h"
+#include "esp_log.h"
+
+#include "./collar_config.h"
+#include "./temperature.h"
+#include "./temperature_filter.h"
+
+static const char *TAG = "temperature";
+
+static adc_oneshot_unit_handle_t s_adc;
+static adc_cali_handle_t s_cali;
+static temp_filter_t s_filter;
+static volatile float s_latest_f = NAN; // Single aligned word, safe to read from any task
+
+esp_err_t temperature_init(void)
+{
+    adc_oneshot_unit_init_cfg_t unit_cfg = {
+        .unit_id = ADC_UNIT_1,
+    };
+    esp_err_t err = adc_oneshot_new_unit(&unit_cfg, &s_adc);
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "ADC unit init failed: %s", esp_err_to_name(err));
+        return err;
+    }
+
+    adc_oneshot_chan_cfg_t chan_cfg = {
+        .atten = ADC_ATTEN_DB_12, // Full 0-3.1 V range for the divider
+        .bitwidth = ADC_BITWIDTH_DEFAULT,
+    };
+    err = adc_oneshot_config_channel(s_adc, TEMP_ADC_CHANNEL, &chan_cfg);
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "ADC channel config failed: %s", esp_err_to_name(err));
+        return err;
+    }
+
+    // eFuse-based line fitting corrects the per-chip ADC reference error
+    adc_cali_line_fitting_config_t cali_cfg = {
+        .unit_id = ADC_UNIT_1,
+        .atten = ADC_ATTEN_DB_12,
+        .bitwidth = ADC_BITWIDTH_DEFAULT,
+    };
+    if (adc_cali_create_scheme_line_fitting(&cali_cfg, &s_cali) != ESP_OK)
+    {
+        ESP_LOGW(TAG, "No ADC calibration in eFuse, readings will be less accurate");
+        s_cali = NULL;
+    }
+
+    temp_filter_init(&s_filter, TEMP_FILTER_ALPHA, COLLAR_DEFAULT_SAMPLES_PER_WINDOW);
+    return ESP_OK;
+}
+
+void temperature_sample(const collar_config_t *cfg)
+{
+    if (s_adc == NULL)
+    {
+        return;
+    }
+
+    int sum = 0;
+    int reads = 0;
+    for (int i = 0; i < TEMP_OVERSAMPLE; i++)
+    {
+        int raw;
+        if (adc_oneshot_read(s_adc, TEMP_ADC_CHANNEL, &raw) == ESP_OK)
+        {
+            sum += raw;
+            reads++;
+        }
+    }
+    if (reads == 0)
+    {
+        return;
+    }
+
+    // Round the average rather than truncating so oversampling adds resolution
+    int raw_avg = (sum + reads / 2) / reads;
+    int mv = 0;
+    if (s_cali != NULL)
+    {
+        adc_cali_raw_to_voltage(s_cali, raw_avg, &mv);
+    }
+    else
+    {
+        mv = raw_avg * 3100 / 4095;
+    }
+
+    float sample = temp_apply_calibration(temp_thermistor_mv_to_f((float)mv), cfg->temp_cal_gain, cfg->temp_cal_offset_f);
+
+    s_filter.decimation = cfg->samples_per_window;
+    float out;
+    if (temp_filter_push(&s_filter, sample, &out))
+    {
+        s_latest_f = out;
+    }
+}
+
+float temperature_get_f(void)
+{
+    return s_latest_f;
+}
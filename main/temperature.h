@@ -0,0 +1,30 @@
+/*
+  Thermistor temperature acquisition on ADC1.
+
+  There is no separate sampling task: the accelerometer task calls
+  temperature_sample() at every sample slot, so both sensors share one schedule.
+  Each call oversamples the ADC, converts and filters (temperature_filter.c) and
+  publishes a decimated reading once per classification window.
+*/
+
+#ifndef TEMPERATURE_H
+#define TEMPERATURE_H
+
+#include <stdint.h>
+
+#include "esp_err.h"
+
+#include "./collar_config.h"
+
+#define TEMP_ADC_CHANNEL ADC_CHANNEL_6 // GPIO34 (A2 on the Feather)
+#define TEMP_OVERSAMPLE 16             // ADC reads averaged per sample
+
+esp_err_t temperature_init(void);
+
+// Take one oversampled reading; a value is published every cfg->samples_per_window calls
+void temperature_sample(const collar_config_t *cfg);
+
+// Latest decimated reading in degrees Fahrenheit, NaN until the first one is ready
+float temperature_get_f(void);
+
+#endif // TEMPERATURE_H
@@ -0,0 +1,85 @@
+#include <math.h>
+
+#include "./temperature_filter.h"
+
+float temp_thermistor_mv_to_f(float mv)
+{
+    if (mv <= 0.0f || mv >= THERMISTOR_SUPPLY_MV)
+    {
+        return NAN;
+    }
+
+    // Divider: Vout = Vs * Rt / (Rs + Rt)  =>  Rt = Rs * Vout / (Vs - Vout)
+    float ohms = THERMISTOR_SERIES_OHMS * mv / (THERMISTOR_SUPPLY_MV - mv);
+
+    // Beta equation: 1/T = 1/T0 + ln(R/R0)/B
+    float inv_kelvin = 1.0f / THERMISTOR_NOMINAL_K + logf(ohms / THERMISTOR_NOMINAL_OHMS) / THERMISTOR_BETA;
+    float celsius = 1.0f / inv_kelvin - 273.15f;
+    return celsius * 9.0f / 5.0f + 32.0f;
+}
+
+void temp_filter_init(temp_filter_t *f, float alpha, uint32_t decimation)
+{
+    f->filled = 0;
+    f->next = 0;
+    f->has_ewma = false;
+    f->ewma = 0;
+    f->alpha = alpha;
+    f->decimation = decimation > 0 ? decimation : 1;
+    f->count = 0;
+}
+
+static float median3(float a, float b, float c)
+{
+    if (a > b)
+    {
+        float t = a;
+        a = b;
+        b = t;
+    }
+    // Now a <= b; the median is b clamped into [a, c] order
+    if (c < a)
+    {
+        return a;
+    }
+    if (c > b)
+    {
+        return b;
+    }
+    return c;
+}
+
+bool temp_filter_push(temp_filter_t *f, float sample, float *out)
+{
+    if (isnan(sample))
+    {
+        return false;
+    }
+
+    f->history[f->next] = sample;
+    f->next = (f->next + 1) % 3;
+    if (f->filled < 3)
+    {
+        f->filled++;
+    }
+
+    float despiked = (f->filled < 3) ? sample : median3(f->history[0], f->history[1], f->history[2]);
+
+    if (!f->has_ewma)
+    {
+        f->ewma = despiked;
+        f->has_ewma = true;
+    }
+    else
+    {
+        f->ewma += f->alpha * (despiked - f->ewma);
+    }
+
+    if (++f->count >= f->decimation)
+    {
+        f->count = 0;
+        *out = f->ewma;
+        return true;
+    }
+    return false;
+}
@@ -0,0 +1,57 @@
+/*
+  Temperature filtering and calibration math.
+
+  Pure C with no ESP-IDF dependencies so it runs on the host, where
+  sim/bench/temp_bench.c drives it with synthetic ADC traces (Gaussian read noise
+  and Wi-Fi TX dips), not recordings from a collar. The acquisition path is:
+
+    16x oversampled ADC average (temperature.c)
+      -> millivolts (ESP-IDF line-fitting ADC calibration)
+      -> degrees (thermistor Beta curve, then the per-collar two-point correction)
+      -> median of 3 (rejects single-sample spikes from Wi-Fi TX current draw)
+      -> EWMA low-pass
+      -> decimated to one output per classification window
+*/
+
+#ifndef TEMPERATURE_FILTER_H
+#define TEMPERATURE_FILTER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// 10k NTC thermistor (B = 3435) on the low side of a divider with a 10k resistor from 3.3 V
+#define THERMISTOR_SUPPLY_MV 3300.0f
+#define THERMISTOR_SERIES_OHMS 10000.0f
+#define THERMISTOR_NOMINAL_OHMS 10000.0f
+#define THERMISTOR_NOMINAL_K 298.15f
+#define THERMISTOR_BETA 3435.0f
+
+#define TEMP_FILTER_ALPHA 0.2f // EWMA weight of each new sample
+
+typedef struct
+{
+    float history[3];  // Last three samples for the median
+    uint8_t filled;    // How many of history are valid
+    uint8_t next;      // Ring index into history
+    bool has_ewma;
+    float ewma;
+    float alpha;
+    uint32_t decimation; // Samples per output
+    uint32_t count;      // Samples since the last output
+} temp_filter_t;
+
+// Thermistor divider voltage to degrees Fahrenheit (NaN when the sensor is open or shorted)
+float temp_thermistor_mv_to_f(float mv);
+
+// Per-collar two-point correction: corrected = raw * gain + offset
+static inline float temp_apply_calibration(float raw_f, float gain, float offset_f)
+{
+    return raw_f * gain + offset_f;
+}
+
+void temp_filter_init(temp_filter_t *f, float alpha, uint32_t decimation);
+
+// Push one calibrated sample; returns true and writes *out when a decimated output is due
+bool temp_filter_push(temp_filter_t *f, float sample, float *out);
+
+#endif // TEMPERATURE_FILTER_H
@@ -0,0 +1,149 @@
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/queue.h"
+#include "freertos/task.h"
+
+#include "./task_plan.h"
+#include "./timesync.h"
+#include "./timesync_clock.h"
+
+#define TIMESYNC_REPLY_QUEUE_LEN 4
+
+static const char *TAG = "timesync";
+
+typedef struct
+{
+    uint32_t seq;
+    timesync_sample_t sample;
+} timesync_reply_t;
+
+static timesync_send_fn s_send;
+static QueueHandle_t s_replies;
+static StaticQueue_t s_replies_buf;
+static uint8_t s_replies_storage[TIMESYNC_REPLY_QUEUE_LEN * sizeof(timesync_reply_t)];
+static timesync_clock_t s_clock;
+static portMUX_TYPE s_clock_lock = portMUX_INITIALIZER_UNLOCKED;
+
+bool timesync_handle_message(const char *msg, size_t len)
+{
+    // Stamp before parsing so t4 is as close to arrival as this task allows
+    int64_t t4 = esp_timer_get_time();
+    static const char prefix[] = "TSYNC RESP ";
+    if (len < sizeof(prefix) - 1 || strncmp(msg, prefix, sizeof(prefix) - 1) != 0)
+    {
+        return false;
+    }
+
+    char text[96];
+    if (len >= sizeof(text) || s_replies == NULL)
+    {
+        return true;
+    }
+    memcpy(text, msg, len);
+    text[len] = '\0';
+
+    timesync_reply_t reply = {.sample.t4 = t4};
+    if (sscanf(text + sizeof(prefix) - 1, "%" SCNu32 " %" SCNd64 " %" SCNd64 " %" SCNd64,
+               &reply.seq, &reply.sample.t1, &reply.sample.t2, &reply.sample.t3) == 4)
+    {
+        xQueueSend(s_replies, &reply, 0);
+    }
+    return true;
+}
+
+bool timesync_epoch_us(int64_t local_us, int64_t *epoch_us)
+{
+    portENTER_CRITICAL(&s_clock_lock);
+    bool synced = s_clock.synced;
+    if (synced)
+    {
+        *epoch_us = timesync_clock_epoch_us(&s_clock, local_us);
+    }
+    portEXIT_CRITICAL(&s_clock_lock);
+    return synced;
+}
+
+// One burst; returns true and the fastest exchange if any reply came back
+static bool run_burst(uint32_t *seq, timesync_sample_t *best)
+{
+    bool have = false;
+    for (int i = 0; i < TIMESYNC_BURST; i++)
+    {
+        if (i > 0)
+        {
+            vTaskDelay(pdMS_TO_TICKS(TIMESYNC_BURST_GAP_MS));
+        }
+
+        // Replies to earlier, timed-out requests are stale
+        xQueueReset(s_replies);
+        uint32_t this_seq = ++(*seq);
+        char request[48];
+        int len = snprintf(request, sizeof(request), "TSYNC REQ %" PRIu32 " %" PRId64, this_seq, esp_timer_get_time());
+        if (s_send(request, len) < 0)
+        {
+            return have; // Not connected; try again next round
+        }
+
+        timesync_reply_t reply;
+        while (xQueueReceive(s_replies, &reply, pdMS_TO_TICKS(TIMESYNC_REPLY_TIMEOUT_MS)) == pdTRUE)
+        {
+            if (reply.seq != this_seq)
+            {
+                continue;
+            }
+            if (!have || timesync_sample_delay(&reply.sample) < timesync_sample_delay(best))
+            {
+                *best = reply.sample;
+                have = true;
+            }
+            break;
+        }
+    }
+    return have;
+}
+
+static void timesync_task(void *arg)
+{
+    uint32_t seq = 0;
+    while (1)
+    {
+        timesync_sample_t best;
+        if (run_burst(&seq, &best) && timesync_sample_delay(&best) <= TIMESYNC_MAX_DELAY_US)
+        {
+            portENTER_CRITICAL(&s_clock_lock);
+            bool stepped = timesync_clock_update(&s_clock, &best);
+            timesync_clock_t snapshot = s_clock;
+            portEXIT_CRITICAL(&s_clock_lock);
+
+            if (stepped)
+            {
+                ESP_LOGI(TAG, "Clock set (step %" PRIu32 "), delay %" PRId64 " us", snapshot.steps,
+                         snapshot.last_delay_us);
+            }
+            else
+            {
+                ESP_LOGD(TAG, "Offset %" PRId64 " us, delay %" PRId64 " us, freq %.1f ppm",
+                         snapshot.last_offset_us, snapshot.last_delay_us, snapshot.freq_ppm);
+            }
+        }
+
+        bool synced;
+        portENTER_CRITICAL(&s_clock_lock);
+        synced = s_clock.synced;
+        portEXIT_CRITICAL(&s_clock_lock);
+        vTaskDelay(pdMS_TO_TICKS(synced ? TIMESYNC_POLL_MS : TIMESYNC_POLL_UNSYNCED_MS));
+    }
+}
+
+void timesync_init(timesync_send_fn send, UBaseType_t prio, BaseType_t core, uint32_t stack)
+{
+    s_send = send;
+    timesync_clock_init(&s_clock);
+    s_replies = xQueueCreateStatic(TIMESYNC_REPLY_QUEUE_LEN, sizeof(timesync_reply_t), s_replies_storage, &s_replies_buf);
+    task_plan_create(timesync_task, "timesync", stack, NULL, prio, core, NULL);
+}
@@ -0,0 +1,39 @@
+/*
+  Fleet time sync over the /buzz WebSocket.
+
+  A low-priority task sends bursts of "TSYNC REQ <seq> <t1>" (t1 in local
+  microseconds); the server answers "TSYNC RESP <seq> <t1> <t2> <t3>" with its
+  receive and send times in epoch microseconds. The lowest-delay exchange of each
+  burst disciplines the clock in timesync_clock.c. Telemetry is then stamped with
+  epoch time at the moment it was measured, so the server can order and window
+  records from many collars without trusting arrival times.
+*/
+
+#ifndef TIMESYNC_H
+#define TIMESYNC_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "freertos/FreeRTOS.h"
+
+#define TIMESYNC_BURST 4                 // Exchanges per round; the fastest one is used
+#define TIMESYNC_BURST_GAP_MS 100
+#define TIMESYNC_REPLY_TIMEOUT_MS 1000
+#define TIMESYNC_MAX_DELAY_US 250000     // Rounds whose best exchange is slower are ignored
+#define TIMESYNC_POLL_UNSYNCED_MS 2000
+#define TIMESYNC_POLL_MS 16000
+
+// Sends one text message to the server; returns bytes sent or a negative error
+typedef int (*timesync_send_fn)(const char *msg, int len);
+
+void timesync_init(timesync_send_fn send, UBaseType_t prio, BaseType_t core, uint32_t stack);
+
+// Call from the network task as early as possible; true if msg was a TSYNC reply
+bool timesync_handle_message(const char *msg, size_t len);
+
+// Epoch microseconds at a local esp_timer_get_time() stamp; false until the first sync
+bool timesync_epoch_us(int64_t local_us, int64_t *epoch_us);
+
+#endif // TIMESYNC_H
@@ -0,0 +1,127 @@
+#include <string.h>
+
+#include "./timesync_clock.h"
+
+static double clamp(double value, double limit)
+{
+    return (value > limit) ? limit : (value < -limit) ? -limit : value;
+}
+
+void timesync_clock_init(timesync_clock_t *clock)
+{
+    memset(clock, 0, sizeof(*clock));
+}
+
+int64_t timesync_sample_delay(const timesync_sample_t *sample)
+{
+    return (sample->t4 - sample->t1) - (sample->t3 - sample->t2);
+}
+
+int64_t timesync_clock_epoch_us(const timesync_clock_t *clock, int64_t local_us)
+{
+    int64_t elapsed = local_us - clock->ref_local_us;
+    int64_t slewed = elapsed;
+    if (local_us > clock->slew_end_us)
+    {
+        slewed = clock->slew_end_us - clock->ref_local_us;
+    }
+    return clock->ref_epoch_us + elapsed + (int64_t)(elapsed * clock->freq_ppm * 1e-6) +
+           (int64_t)(slewed * clock->slew_ppm * 1e-6);
+}
+
+static void fit_add(timesync_clock_t *clock, const timesync_sample_t *sample)
+{
+    // Midpoints cancel symmetric path delay; only asymmetry is left as noise
+    double local_mid = sample->t1 + (sample->t4 - sample->t1) / 2.0;
+    double server_mid = sample->t2 + (sample->t3 - sample->t2) / 2.0;
+    clock->fit[clock->fit_next] = (timesync_point_t){.local_us = local_mid, .offset_us = server_mid - local_mid};
+    clock->fit_next = (clock->fit_next + 1) % TIMESYNC_FIT_SAMPLES;
+    if (clock->fit_count < TIMESYNC_FIT_SAMPLES)
+    {
+        clock->fit_count++;
+    }
+}
+
+// Fitted server time at local_us; *freq_ppm is the fitted slope
+static double fit_epoch_us(const timesync_clock_t *clock, int64_t local_us, double *freq_ppm)
+{
+    double mean_x = 0, mean_y = 0;
+    for (uint32_t i = 0; i < clock->fit_count; i++)
+    {
+        mean_x += clock->fit[i].local_us;
+        mean_y += clock->fit[i].offset_us;
+    }
+    mean_x /= clock->fit_count;
+    mean_y /= clock->fit_count;
+
+    double sxx = 0, sxy = 0;
+    for (uint32_t i = 0; i < clock->fit_count; i++)
+    {
+        double dx = clock->fit[i].local_us - mean_x;
+        sxx += dx * dx;
+        sxy += dx * (clock->fit[i].offset_us - mean_y);
+    }
+    // Too short a baseline says nothing about frequency; keep the current estimate
+    double slope = (clock->fit_count >= 2 && sxx > 0) ? sxy / sxx : clock->freq_ppm * 1e-6;
+    slope = clamp(slope, TIMESYNC_MAX_FREQ_PPM * 1e-6);
+    *freq_ppm = slope * 1e6;
+    return local_us + mean_y + slope * (local_us - mean_x);
+}
+
+static void step(timesync_clock_t *clock, const timesync_sample_t *sample)
+{
+    // Server time at t4 is t3 plus the return half of the round trip
+    clock->ref_local_us = sample->t4;
+    clock->ref_epoch_us = sample->t3 + timesync_sample_delay(sample) / 2;
+    clock->slew_ppm = 0;
+    clock->slew_end_us = sample->t4;
+    clock->synced = true;
+    clock->steps++;
+
+    // Exchanges from before a step describe a different timeline
+    clock->fit_count = 0;
+    clock->fit_next = 0;
+    fit_add(clock, sample);
+}
+
+bool timesync_clock_update(timesync_clock_t *clock, const timesync_sample_t *sample)
+{
+    clock->last_delay_us = timesync_sample_delay(sample);
+    clock->updates++;
+
+    if (!clock->synced)
+    {
+        clock->last_offset_us = 0;
+        step(clock, sample);
+        return true;
+    }
+
+    // A single exchange this far off means the server's clock (or ours) jumped
+    int64_t c4 = timesync_clock_epoch_us(clock, sample->t4);
+    int64_t measured = sample->t3 + clock->last_delay_us / 2 - c4;
+    if (measured > TIMESYNC_STEP_US || measured < -TIMESYNC_STEP_US)
+    {
+        clock->last_offset_us = measured;
+        step(clock, sample);
+        return true;
+    }
+
+    fit_add(clock, sample);
+    double freq_ppm;
+    int64_t offset = (int64_t)(fit_epoch_us(clock, sample->t4, &freq_ppm) - c4);
+    clock->last_offset_us = offset;
+
+    // Re-anchor where the old mapping was so the clock stays continuous, then slew onto the fit
+    double slew_us = TIMESYNC_SLEW_US;
+    double needed_us = (offset < 0 ? -offset : offset) * 1e6 / TIMESYNC_MAX_SLEW_PPM;
+    if (needed_us > slew_us)
+    {
+        slew_us = needed_us;
+    }
+    clock->ref_local_us = sample->t4;
+    clock->ref_epoch_us = c4;
+    clock->freq_ppm = freq_ppm;
+    clock->slew_ppm = offset * 1e6 / slew_us;
+    clock->slew_end_us = sample->t4 + (int64_t)slew_us;
+    return false;
+}
@@ -0,0 +1,73 @@
+/*
+  Disciplined clock for fleet time sync.
+
+  Pure logic with no ESP-IDF dependencies so it can be exercised on the host.
+  Maps the collar's local microsecond clock (esp_timer_get_time()) onto the
+  server's Unix epoch in microseconds.
+
+  Each exchange gives four stamps, NTP style: t1 local send, t2 server receive,
+  t3 server send, t4 local receive. The driver keeps the lowest-delay exchange of
+  a burst and feeds it to timesync_clock_update(). A least-squares line through
+  the last TIMESYNC_FIT_SAMPLES exchanges gives both the offset and the
+  oscillator's frequency error, averaging out the asymmetric Wi-Fi delays that
+  make any single exchange noisy. The first exchange (or one that disagrees by
+  more than TIMESYNC_STEP_US) steps the clock; after that the clock is slewed
+  onto the fitted line over TIMESYNC_SLEW_US, so the mapping stays continuous
+  and never runs backwards between updates.
+*/
+
+#ifndef TIMESYNC_CLOCK_H
+#define TIMESYNC_CLOCK_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define TIMESYNC_STEP_US 128000      // Larger errors are stepped instead of slewed
+#define TIMESYNC_SLEW_US 8000000     // Phase errors are removed over this long
+#define TIMESYNC_MAX_SLEW_PPM 500.0  // Steepest phase correction
+#define TIMESYNC_MAX_FREQ_PPM 500.0  // Crystal spec is +/-40 ppm; anything past this is a bad fit
+#define TIMESYNC_FIT_SAMPLES 16      // Exchanges in the offset/frequency fit (~4 min at the normal poll)
+
+typedef struct
+{
+    int64_t t1; // Local send
+    int64_t t2; // Server receive (epoch)
+    int64_t t3; // Server send (epoch)
+    int64_t t4; // Local receive
+} timesync_sample_t;
+
+typedef struct
+{
+    double local_us;  // Local midpoint of the exchange
+    double offset_us; // Server midpoint minus local midpoint
+} timesync_point_t;
+
+typedef struct
+{
+    bool synced;
+    int64_t ref_local_us;   // Local time of the last update
+    int64_t ref_epoch_us;   // Epoch time at ref_local_us
+    double freq_ppm;        // Local oscillator rate error being corrected
+    double slew_ppm;        // Phase correction in progress
+    int64_t slew_end_us;    // Local time the phase correction stops
+    int64_t last_offset_us; // Phase error corrected by the last update
+    int64_t last_delay_us;  // Round trip of the last update
+    timesync_point_t fit[TIMESYNC_FIT_SAMPLES];
+    uint32_t fit_count;
+    uint32_t fit_next;
+    uint32_t updates;
+    uint32_t steps;
+} timesync_clock_t;
+
+void timesync_clock_init(timesync_clock_t *clock);
+
+// Round trip of an exchange, excluding the server's turnaround
+int64_t timesync_sample_delay(const timesync_sample_t *sample);
+
+// Apply one exchange; returns true if the clock was stepped rather than slewed
+bool timesync_clock_update(timesync_clock_t *clock, const timesync_sample_t *sample);
+
+// Epoch microseconds at the given local time (only meaningful once synced)
+int64_t timesync_clock_epoch_us(const timesync_clock_t *clock, int64_t local_us);
+
+#endif // TIMESYNC_CLOCK_H
@@ -0,0 +1,93 @@
+/*
+  Framing for the binary UART stream (uart_stream.c).
+
+  Pure C with no ESP-IDF dependencies: the native host addon (native/) builds
+  this same file to decode what the collar sends.
+
+  A frame before encoding (little-endian):
+    type (u8), seq (u16), payload (0..UART_FRAME_MAX_PAYLOAD bytes), CRC-16 (u16)
+  The CRC is CRC-16/CCITT-FALSE over type, seq and payload. On the wire each
+  frame is COBS-encoded, so it contains no zero bytes, and is followed by a
+  single 0x00. A receiver that starts mid-stream, or loses bytes to a FIFO
+  overrun, drops at most the frame it is in and resynchronises at the next zero.
+
+  seq counts every frame the collar sends (wrapping at 65536), so the receiver
+  can tell how many frames were lost between two that arrived.
+*/
+
+#ifndef UART_FRAME_H
+#define UART_FRAME_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define UART_FRAME_MAX_PAYLOAD 512
+#define UART_FRAME_OVERHEAD 5 // type, seq, CRC
+#define UART_FRAME_MAX_DECODED (UART_FRAME_MAX_PAYLOAD + UART_FRAME_OVERHEAD)
+// COBS adds one byte per 254 plus one, then the delimiter
+#define UART_FRAME_MAX_ENCODED (UART_FRAME_MAX_DECODED + UART_FRAME_MAX_DECODED / 254 + 2)
+
+typedef enum
+{
+    UART_FRAME_HELLO = 1,   // collar -> host: "HELLO <cat_id> port=<udp_port> fw=<version>"
+    UART_FRAME_STATUS = 2,  // collar -> host: status message, as sent over UDP
+    UART_FRAME_SAMPLES = 3, // collar -> host: raw accelerometer samples (uart_frame_samples_t)
+    UART_FRAME_LOG = 4,     // collar -> host: console output (stdout and ESP_LOG)
+    UART_FRAME_STATS = 5,   // collar -> host: uart_frame_stats_t
+    UART_FRAME_TEXT = 6,    // either way: a command ("CFG ...") or its reply
+} uart_frame_type_t;
+
+// SAMPLES payload: header, then count x (x, y, z) as int16 raw ADXL343 counts
+#define UART_FRAME_SAMPLES_HEADER 13 // t0_us (i64), period_us (u32), count (u8)
+#define UART_FRAME_SAMPLE_SIZE 6
+#define UART_FRAME_MAX_SAMPLES ((UART_FRAME_MAX_PAYLOAD - UART_FRAME_SAMPLES_HEADER) / UART_FRAME_SAMPLE_SIZE)
+
+// STATS payload: four u32 counters since boot
+typedef struct
+{
+    uint32_t frames_sent;
+    uint32_t frames_dropped; // TX buffer full; these never got a seq
+    uint32_t bytes_sent;
+    uint32_t rx_errors; // FIFO overruns and frames from the host that failed their CRC
+} uart_frame_stats_t;
+
+uint16_t uart_frame_crc16(uint16_t crc, const uint8_t *data, size_t len);
+
+// Encode one frame into out, including the trailing zero
+// Returns the bytes written, or 0 if the payload is too long or out is too small
+size_t uart_frame_encode(uint8_t type, uint16_t seq, const uint8_t *payload, size_t len, uint8_t *out, size_t out_len);
+
+typedef void (*uart_frame_cb)(void *ctx, uint8_t type, uint16_t seq, const uint8_t *payload, size_t len);
+
+typedef struct
+{
+    uint8_t buf[UART_FRAME_MAX_ENCODED];
+    size_t len;
+    bool overflow; // Current frame is too long; skip to the next zero
+    bool synced;   // Seen a delimiter, so buf starts at a frame boundary
+    bool have_seq;
+    uint16_t next_seq;
+
+    // Counters since init
+    uint64_t bytes;
+    uint32_t frames;
+    uint32_t crc_errors; // Also counts malformed COBS and runt frames
+    uint32_t overflows;
+    uint32_t lost; // Frames missing from the seq sequence
+} uart_frame_decoder_t;
+
+void uart_frame_decoder_init(uart_frame_decoder_t *dec);
+
+// Feed received bytes; cb is called for every complete frame that passes its CRC
+void uart_frame_decode(uart_frame_decoder_t *dec, const uint8_t *data, size_t len, uart_frame_cb cb, void *ctx);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // UART_FRAME_H
@@ -0,0 +1,296 @@
+#define _GNU_SOURCE // fopencookie()
+
+#include <stdio.h>
+#include <string.h>
+
+#include "driver/uart.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+
+#include "./collar_config.h"
+#include "./ota.h"
+#include "./task_plan.h"
+#include "./uart_stream.h"
+
+#define UART_STREAM_TX_MARGIN 32 // The driver stores each write with a small header in its ring
+#define UART_STREAM_RX_CHUNK 256
+
+static const char *TAG = "uart_stream";
+
+static bool s_active;
+static QueueHandle_t s_events;
+static SemaphoreHandle_t s_tx_mutex;
+static StaticSemaphore_t s_tx_mutex_buf;
+static uint16_t s_seq;
+static uart_frame_stats_t s_stats;
+static uart_frame_decoder_t s_rx;
+
+// Guarded by s_tx_mutex
+static uint8_t s_tx_buf[UART_FRAME_MAX_ENCODED];
+
+// Owned by the one task that calls uart_stream_sample()
+static uint8_t s_samples[UART_FRAME_SAMPLES_HEADER + UART_STREAM_SAMPLE_BATCH * UART_FRAME_SAMPLE_SIZE];
+static uint8_t s_sample_count;
+
+static void put_le(uint8_t *p, uint64_t value, int bytes)
+{
+    for (int i = 0; i < bytes; i++)
+    {
+        p[i] = (uint8_t)(value >> (8 * i));
+    }
+}
+
+// Send path ///////////////////////////////////////////////////////////////////
+
+static bool send_frame(uart_frame_type_t type, const void *payload, size_t len)
+{
+    if (!s_active)
+    {
+        return false;
+    }
+    xSemaphoreTake(s_tx_mutex, portMAX_DELAY);
+    bool sent = false;
+    size_t free_bytes = 0;
+    size_t n = uart_frame_encode(type, s_seq, payload, len, s_tx_buf, sizeof(s_tx_buf));
+    if (n > 0 && uart_get_tx_buffer_free_size(UART_STREAM_PORT, &free_bytes) == ESP_OK &&
+        free_bytes >= n + UART_STREAM_TX_MARGIN)
+    {
+        // The driver copies the frame into its ring in one call, so frames never interleave
+        sent = uart_write_bytes(UART_STREAM_PORT, s_tx_buf, n) == (int)n;
+    }
+    if (sent)
+    {
+        s_seq++;
+        s_stats.frames_sent++;
+        s_stats.bytes_sent += n;
+    }
+    else
+    {
+        s_stats.frames_dropped++;
+    }
+    xSemaphoreGive(s_tx_mutex);
+    return sent;
+}
+
+bool uart_stream_send(uart_frame_type_t type, const void *payload, size_t len)
+{
+    return send_frame(type, payload, len);
+}
+
+static void flush_samples(void)
+{
+    if (s_sample_count == 0)
+    {
+        return;
+    }
+    s_samples[12] = s_sample_count;
+    send_frame(UART_FRAME_SAMPLES, s_samples, UART_FRAME_SAMPLES_HEADER + s_sample_count * UART_FRAME_SAMPLE_SIZE);
+    s_sample_count = 0;
+}
+
+void uart_stream_sample(const int16_t raw[3], int64_t t_us, uint32_t period_us)
+{
+    if (!s_active)
+    {
+        return;
+    }
+    // Times are rebuilt on the host from t0 and the period, so a new period (config push) starts a new frame
+    static int64_t batch_t0;
+    static uint32_t batch_period;
+    if (s_sample_count > 0 && batch_period != period_us)
+    {
+        flush_samples();
+    }
+    if (s_sample_count == 0)
+    {
+        batch_t0 = t_us;
+        batch_period = period_us;
+        put_le(s_samples, (uint64_t)t_us, 8);
+        put_le(s_samples + 8, period_us, 4);
+    }
+    uint8_t *p = s_samples + UART_FRAME_SAMPLES_HEADER + s_sample_count * UART_FRAME_SAMPLE_SIZE;
+    for (int axis = 0; axis < 3; axis++)
+    {
+        put_le(p + 2 * axis, (uint16_t)raw[axis], 2);
+    }
+    s_sample_count++;
+
+    // Flush before the next sample would push the batch past its age limit
+    if (s_sample_count == UART_STREAM_SAMPLE_BATCH ||
+        t_us + period_us - batch_t0 >= (int64_t)UART_STREAM_SAMPLE_MAX_MS * 1000)
+    {
+        flush_samples();
+    }
+}
+
+// stdout lands here once the stream owns the UART, one LOG frame per line
+static ssize_t console_write(void *cookie, const char *buf, size_t size)
+{
+    for (size_t done = 0; done < size; done += UART_FRAME_MAX_PAYLOAD)
+    {
+        size_t n = size - done;
+        send_frame(UART_FRAME_LOG, buf + done, n > UART_FRAME_MAX_PAYLOAD ? UART_FRAME_MAX_PAYLOAD : n);
+    }
+    return (ssize_t)size; // Dropped lines are counted, not retried
+}
+
+// Receive path ////////////////////////////////////////////////////////////////
+
+static void send_hello(void)
+{
+    collar_config_t cfg;
+    config_get(&cfg);
+    char hello[96];
+    int len = snprintf(hello, sizeof(hello), "HELLO %s port=%u fw=%s", cfg.cat_id, (unsigned)cfg.udp_port,
+                       ota_running_version());
+    send_frame(UART_FRAME_HELLO, hello, (size_t)len < sizeof(hello) ? (size_t)len : sizeof(hello) - 1);
+}
+
+static void send_stats(void)
+{
+    uint8_t payload[16];
+    put_le(payload, s_stats.frames_sent, 4);
+    put_le(payload + 4, s_stats.frames_dropped, 4);
+    put_le(payload + 8, s_stats.bytes_sent, 4);
+    put_le(payload + 12, s_stats.rx_errors, 4);
+    send_frame(UART_FRAME_STATS, payload, sizeof(payload));
+}
+
+static void on_host_frame(void *ctx, uint8_t type, uint16_t seq, const uint8_t *payload, size_t len)
+{
+    // A host that can talk to us proves a pushed config works, as a WebSocket connect would
+    config_confirm();
+
+    char reply[CONFIG_REPLY_MAX];
+    if (type == UART_FRAME_TEXT && config_handle_message((const char *)payload, len, reply, sizeof(reply)))
+    {
+        send_frame(UART_FRAME_TEXT, reply, strlen(reply));
+    }
+}
+
+static void uart_stream_task(void *arg)
+{
+    static uint8_t rx[UART_STREAM_RX_CHUNK];
+    int64_t next_report_us = 0;
+    uint32_t overruns = 0;
+    while (1)
+    {
+        uart_event_t event;
+        if (xQueueReceive(s_events, &event, pdMS_TO_TICKS(UART_STREAM_STATS_PERIOD_MS)) == pdTRUE)
+        {
+            switch (event.type)
+            {
+            case UART_DATA:
+            {
+                int n;
+                while ((n = uart_read_bytes(UART_STREAM_PORT, rx, sizeof(rx), 0)) > 0)
+                {
+                    uart_frame_decode(&s_rx, rx, n, on_host_frame, NULL);
+                }
+                break;
+            }
+            case UART_FIFO_OVF:
+            case UART_BUFFER_FULL:
+                // Whatever is buffered is now missing bytes; start over at the next frame
+                uart_flush_input(UART_STREAM_PORT);
+                xQueueReset(s_events);
+                overruns++;
+                break;
+            default:
+                break;
+            }
+        }
+        s_stats.rx_errors = overruns + s_rx.crc_errors;
+
+        if (esp_timer_get_time() >= next_report_us)
+        {
+            send_hello();
+            send_stats();
+            next_report_us = esp_timer_get_time() + (int64_t)UART_STREAM_STATS_PERIOD_MS * 1000;
+        }
+    }
+}
+
+#if UART_STREAM_BENCH
+// Saturate the link with full SAMPLES frames, waiting for room instead of dropping
+static void uart_stream_bench_task(void *arg)
+{
+    uint8_t payload[UART_FRAME_SAMPLES_HEADER + UART_FRAME_MAX_SAMPLES * UART_FRAME_SAMPLE_SIZE];
+    for (size_t i = 0; i < sizeof(payload); i++)
+    {
+        payload[i] = (uint8_t)(i * 7);
+    }
+    put_le(payload + 8, 1000, 4); // Nominal 1 kHz so captures of the flood still parse
+    payload[12] = UART_FRAME_MAX_SAMPLES;
+    size_t free_bytes = 0;
+    while (1)
+    {
+        put_le(payload, (uint64_t)esp_timer_get_time(), 8);
+        uart_get_tx_buffer_free_size(UART_STREAM_PORT, &free_bytes);
+        if (free_bytes < UART_FRAME_MAX_ENCODED + UART_STREAM_TX_MARGIN)
+        {
+            vTaskDelay(1);
+            continue;
+        }
+        send_frame(UART_FRAME_SAMPLES, payload, sizeof(payload));
+    }
+}
+#endif
+
+// Init ////////////////////////////////////////////////////////////////////////
+
+bool uart_stream_init(uint32_t baud, UBaseType_t prio, BaseType_t core, uint32_t stack)
+{
+    if (baud == 0)
+    {
+        return false;
+    }
+    const uart_config_t config = {
+        .baud_rate = (int)baud,
+        .data_bits = UART_DATA_8_BITS,
+        .parity = UART_PARITY_DISABLE,
+        .stop_bits = UART_STOP_BITS_1,
+        .flow_ctrl = UART_HW_FLOWCTRL_DISABLE,
+        .source_clk = UART_SCLK_DEFAULT,
+    };
+    if (uart_driver_install(UART_STREAM_PORT, UART_STREAM_RX_BUF, UART_STREAM_TX_BUF, UART_STREAM_EVENT_QUEUE,
+                            &s_events, 0) != ESP_OK ||
+        uart_param_config(UART_STREAM_PORT, &config) != ESP_OK)
+    {
+        ESP_LOGE(TAG, "UART driver failed, keeping the text console");
+        return false;
+    }
+    ESP_LOGI(TAG, "Switching UART0 to the binary stream at %u baud", (unsigned)baud);
+    uart_wait_tx_done(UART_STREAM_PORT, pdMS_TO_TICKS(100));
+
+    s_tx_mutex = xSemaphoreCreateMutexStatic(&s_tx_mutex_buf);
+    uart_frame_decoder_init(&s_rx);
+    s_active = true;
+
+    // A lone delimiter first, so the host does not take the boot log as part of our first frame
+    const uint8_t zero = 0;
+    uart_write_bytes(UART_STREAM_PORT, &zero, 1);
+
+    // Tasks created after this inherit the new stdout
+    FILE *console = fopencookie(NULL, "w", (cookie_io_functions_t){.write = console_write});
+    if (console != NULL)
+    {
+        setvbuf(console, NULL, _IOLBF, UART_FRAME_MAX_PAYLOAD);
+#ifdef _GLOBAL_REENT
+        _GLOBAL_REENT->_stdout = console;
+#endif
+        stdout = console;
+    }
+
+    // Say who we are before the first samples, so a host already listening can name its capture
+    send_hello();
+
+    task_plan_create(uart_stream_task, "uart_stream", stack, NULL, prio, core, NULL);
+#if UART_STREAM_BENCH
+    task_plan_create_diag(uart_stream_bench_task, "uart_bench", 1, core);
+#endif
+    return true;
+}
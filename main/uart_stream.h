@@ -0,0 +1,54 @@
+/*
+  Binary telemetry stream over UART0 for bench capture and wired gateways.
+
+  With uart_baud = 0 (the default) UART0 stays the text console. Otherwise it
+  runs at that baud and carries only framed, CRC-checked data (uart_frame.h):
+  status messages, every raw accelerometer sample, periodic HELLO and STATS
+  frames, and the console itself, since stdout is rerouted into LOG frames.
+  tools/serial_ingest.js reads any number of such collars at once and logs
+  their status alongside the Wi-Fi telemetry.
+
+  Sending never blocks: frames are encoded straight into the UART driver's TX
+  ring buffer, which the driver's interrupt drains into the FIFO, and a frame
+  that does not fit is dropped and counted in STATS. The host sees every other
+  loss as a gap in the frame sequence numbers. A task on the driver's event
+  queue handles what the host sends: TEXT frames carrying "CFG ..." commands
+  get their reply in a TEXT frame, and any valid frame confirms a pending
+  config the same way reaching the WebSocket server does.
+*/
+
+#ifndef UART_STREAM_H
+#define UART_STREAM_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "freertos/FreeRTOS.h"
+
+#include "./uart_frame.h"
+
+#define UART_STREAM_PORT 0              // UART0, the USB bridge on the dev boards
+#define UART_STREAM_TX_BUF 8192         // ~90 ms of line time at 921600 baud
+#define UART_STREAM_RX_BUF 1024
+#define UART_STREAM_EVENT_QUEUE 16
+#define UART_STREAM_STATS_PERIOD_MS 5000 // HELLO and STATS
+#define UART_STREAM_SAMPLE_BATCH 32      // Samples per SAMPLES frame (at most UART_FRAME_MAX_SAMPLES)
+#define UART_STREAM_SAMPLE_MAX_MS 1000   // ...or fewer, so slow sampling still reaches the host promptly
+
+// Debug switch (0 for deployment): flood SAMPLES frames as fast as the link takes them
+#ifndef UART_STREAM_BENCH
+#define UART_STREAM_BENCH 0
+#endif
+
+// Switch UART0 to the binary stream at baud and start the event task
+// Returns false, leaving the console alone, when baud is 0 or the driver fails
+bool uart_stream_init(uint32_t baud, UBaseType_t prio, BaseType_t core, uint32_t stack);
+
+// Queue one frame; false if the stream is off or the TX buffer is full
+bool uart_stream_send(uart_frame_type_t type, const void *payload, size_t len);
+
+// Add one raw sample (ADXL343 counts) to the current SAMPLES frame; call from one task only
+void uart_stream_sample(const int16_t raw[3], int64_t t_us, uint32_t period_us);
+
+#endif // UART_STREAM_H
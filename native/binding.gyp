@@ -0,0 +1,23 @@
+{
+  'targets': [{
+    'target_name': 'telemetry_native',
+    'sources': [
+      'src/telemetry_core.c',
+      'src/addon.cc',
+      '../main/uart_frame.c'
+    ],
+    'include_dirs': [
+      "<!(node -p \"require('node-addon-api').include_dir\")",
+      '../main'
+    ],
+    'cflags': [ '-O3' ],
+    'cflags_cc': [ '-O3', '-std=c++17' ],
+    'cflags!': [ '-fno-exceptions' ],
+    'cflags_cc!': [ '-fno-exceptions' ],
+    'defines': [ 'NAPI_CPP_EXCEPTIONS', 'NAPI_VERSION=8' ],
+    'xcode_settings': {
+      'GCC_ENABLE_CPP_EXCEPTIONS': 'YES',
+      'OTHER_CFLAGS': [ '-O3' ]
+    }
+  }]
+}
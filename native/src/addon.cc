@@ -0,0 +1,266 @@
+// N-API wrapper around telemetry_core.c.
+//
+// Every entry point takes a Buffer and reads it in place; results come back as
+// typed arrays (one per column) so JS never materializes per-record objects
+// unless it wants to.
+
+#include <napi.h>
+
+#include <cmath>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "telemetry_core.h"
+#include "uart_frame.h"
+
+namespace {
+
+constexpr size_t kMaxCats = 4096;
+
+template <typename T>
+Napi::TypedArrayOf<T> Column(Napi::Env env, size_t capacity, T **data) {
+    auto array = Napi::TypedArrayOf<T>::New(env, capacity);
+    *data = array.Data();
+    return array;
+}
+
+// Shrink a column to the parsed record count without copying
+template <typename T>
+Napi::TypedArrayOf<T> Trim(Napi::Env env, Napi::TypedArrayOf<T> array, size_t count) {
+    return Napi::TypedArrayOf<T>::New(env, count, array.ArrayBuffer(), 0);
+}
+
+Napi::Buffer<char> BufferArg(const Napi::CallbackInfo &info) {
+    if (info.Length() < 1 || !info[0].IsBuffer()) {
+        throw Napi::TypeError::New(info.Env(), "Expected a Buffer");
+    }
+    return info[0].As<Napi::Buffer<char>>();
+}
+
+// parseStatusLog(buf) -> { count, port, id, sourceTime, duration, temperature, state }
+// sourceTime is the collar's epoch stamp in microseconds, NaN when it sent none
+Napi::Value ParseStatusLog(const Napi::CallbackInfo &info) {
+    Napi::Env env = info.Env();
+    Napi::Buffer<char> buf = BufferArg(info);
+    const char *p = buf.Data();
+    const char *end = p + buf.Length();
+    size_t capacity = tc_count_lines(p, buf.Length());
+
+    uint16_t *port;
+    double *id;
+    double *sourceTime;
+    uint32_t *duration;
+    float *temperature;
+    uint8_t *state;
+    auto portCol = Column(env, capacity, &port);
+    auto idCol = Column(env, capacity, &id);
+    auto sourceTimeCol = Column(env, capacity, &sourceTime);
+    auto durationCol = Column(env, capacity, &duration);
+    auto temperatureCol = Column(env, capacity, &temperature);
+    auto stateCol = Column(env, capacity, &state);
+
+    size_t count = 0;
+    tc_status_record_t rec;
+    while (p < end) {
+        const char *nl = tc_line_end(p, end);
+        if (tc_parse_status_line(p, nl, &rec) == 0) {
+            port[count] = rec.port;
+            id[count] = rec.id;
+            sourceTime[count] = rec.msg.source_time_us;
+            duration[count] = rec.msg.duration;
+            temperature[count] = rec.msg.temperature;
+            state[count] = rec.msg.state;
+            count++;
+        }
+        p = nl + 1;
+    }
+
+    Napi::Object result = Napi::Object::New(env);
+    result.Set("count", Napi::Number::New(env, static_cast<double>(count)));
+    result.Set("port", Trim(env, portCol, count));
+    result.Set("id", Trim(env, idCol, count));
+    result.Set("sourceTime", Trim(env, sourceTimeCol, count));
+    result.Set("duration", Trim(env, durationCol, count));
+    result.Set("temperature", Trim(env, temperatureCol, count));
+    result.Set("state", Trim(env, stateCol, count));
+    return result;
+}
+
+// parseDataLog(buf) -> { count, time, duration, temperature, state, sourceIndex, sources }
+// sourceIndex is 0xFFFF for lines without a host:port source
+Napi::Value ParseDataLog(const Napi::CallbackInfo &info) {
+    Napi::Env env = info.Env();
+    Napi::Buffer<char> buf = BufferArg(info);
+    const char *base = buf.Data();
+    const char *p = base;
+    const char *end = base + buf.Length();
+    size_t capacity = tc_count_lines(p, buf.Length());
+
+    double *time;
+    uint32_t *duration;
+    float *temperature;
+    uint8_t *state;
+    uint16_t *sourceIndex;
+    auto timeCol = Column(env, capacity, &time);
+    auto durationCol = Column(env, capacity, &duration);
+    auto temperatureCol = Column(env, capacity, &temperature);
+    auto stateCol = Column(env, capacity, &state);
+    auto sourceCol = Column(env, capacity, &sourceIndex);
+
+    std::unordered_map<std::string, uint16_t> sourceIds;
+    Napi::Array sources = Napi::Array::New(env);
+
+    size_t count = 0;
+    tc_data_record_t rec;
+    while (p < end) {
+        const char *nl = tc_line_end(p, end);
+        if (tc_parse_data_line(base, p, nl, &rec) == 0) {
+            uint16_t index = 0xFFFF;
+            if (rec.source_length > 0) {
+                std::string key(base + rec.source_offset, rec.source_length);
+                auto it = sourceIds.find(key);
+                if (it == sourceIds.end() && sourceIds.size() < 0xFFFF) {
+                    uint16_t next = static_cast<uint16_t>(sourceIds.size());
+                    it = sourceIds.emplace(key, next).first;
+                    sources.Set(next, Napi::String::New(env, key));
+                }
+                if (it != sourceIds.end()) {
+                    index = it->second;
+                }
+            }
+            time[count] = rec.time_ms;
+            duration[count] = rec.msg.duration;
+            temperature[count] = rec.msg.temperature;
+            state[count] = rec.msg.state;
+            sourceIndex[count] = index;
+            count++;
+        }
+        p = nl + 1;
+    }
+
+    Napi::Object result = Napi::Object::New(env);
+    result.Set("count", Napi::Number::New(env, static_cast<double>(count)));
+    result.Set("time", Trim(env, timeCol, count));
+    result.Set("duration", Trim(env, durationCol, count));
+    result.Set("temperature", Trim(env, temperatureCol, count));
+    result.Set("state", Trim(env, stateCol, count));
+    result.Set("sourceIndex", Trim(env, sourceCol, count));
+    result.Set("sources", sources);
+    return result;
+}
+
+// aggregateStatusLog(buf) -> { ports, records, seconds, leader }
+// records and seconds are ports.length x 3 (one column per state), row-major
+Napi::Value AggregateStatusLog(const Napi::CallbackInfo &info) {
+    Napi::Env env = info.Env();
+    Napi::Buffer<char> buf = BufferArg(info);
+
+    std::vector<tc_cat_totals_t> totals(kMaxCats);
+    size_t cats = tc_aggregate_status_log(buf.Data(), buf.Length(), totals.data(), totals.size());
+    int leader = tc_leader(totals.data(), cats);
+
+    auto ports = Napi::Uint16Array::New(env, cats);
+    auto records = Napi::Uint32Array::New(env, cats * TC_STATE_COUNT);
+    auto seconds = Napi::Float64Array::New(env, cats * TC_STATE_COUNT);
+    for (size_t i = 0; i < cats; i++) {
+        ports[i] = totals[i].port;
+        for (size_t s = 0; s < TC_STATE_COUNT; s++) {
+            records[i * TC_STATE_COUNT + s] = totals[i].records[s];
+            seconds[i * TC_STATE_COUNT + s] = totals[i].seconds[s];
+        }
+    }
+
+    Napi::Object result = Napi::Object::New(env);
+    result.Set("ports", ports);
+    result.Set("records", records);
+    result.Set("seconds", seconds);
+    result.Set("leader", Napi::Number::New(env, leader));
+    return result;
+}
+
+// new FrameDecoder(): the collar's own uart_frame.c decoder, fed as serial data arrives
+// push(buf) -> { count, type, seq, offset, length, data }: payload i is
+// data[offset[i], offset[i] + length[i]), a view into one Buffer per call
+// stats() -> { bytes, frames, crcErrors, overflows, lost }
+class FrameDecoder : public Napi::ObjectWrap<FrameDecoder> {
+public:
+    static Napi::Function Define(Napi::Env env) {
+        return DefineClass(env, "FrameDecoder",
+                           {InstanceMethod("push", &FrameDecoder::Push), InstanceMethod("stats", &FrameDecoder::Stats)});
+    }
+
+    explicit FrameDecoder(const Napi::CallbackInfo &info) : Napi::ObjectWrap<FrameDecoder>(info) {
+        uart_frame_decoder_init(&dec_);
+    }
+
+private:
+    struct Frame {
+        uint8_t type;
+        uint16_t seq;
+        uint32_t offset;
+        uint32_t length;
+    };
+
+    static void OnFrame(void *ctx, uint8_t type, uint16_t seq, const uint8_t *payload, size_t len) {
+        auto *self = static_cast<FrameDecoder *>(ctx);
+        self->frames_.push_back({type, seq, static_cast<uint32_t>(self->data_.size()), static_cast<uint32_t>(len)});
+        self->data_.insert(self->data_.end(), payload, payload + len);
+    }
+
+    Napi::Value Push(const Napi::CallbackInfo &info) {
+        Napi::Env env = info.Env();
+        Napi::Buffer<char> buf = BufferArg(info);
+        frames_.clear();
+        data_.clear();
+        uart_frame_decode(&dec_, reinterpret_cast<const uint8_t *>(buf.Data()), buf.Length(), OnFrame, this);
+
+        size_t count = frames_.size();
+        auto type = Napi::Uint8Array::New(env, count);
+        auto seq = Napi::Uint16Array::New(env, count);
+        auto offset = Napi::Uint32Array::New(env, count);
+        auto length = Napi::Uint32Array::New(env, count);
+        for (size_t i = 0; i < count; i++) {
+            type[i] = frames_[i].type;
+            seq[i] = frames_[i].seq;
+            offset[i] = frames_[i].offset;
+            length[i] = frames_[i].length;
+        }
+
+        Napi::Object result = Napi::Object::New(env);
+        result.Set("count", Napi::Number::New(env, static_cast<double>(count)));
+        result.Set("type", type);
+        result.Set("seq", seq);
+        result.Set("offset", offset);
+        result.Set("length", length);
+        result.Set("data", Napi::Buffer<uint8_t>::Copy(env, data_.data(), data_.size()));
+        return result;
+    }
+
+    Napi::Value Stats(const Napi::CallbackInfo &info) {
+        Napi::Env env = info.Env();
+        Napi::Object result = Napi::Object::New(env);
+        result.Set("bytes", Napi::Number::New(env, static_cast<double>(dec_.bytes)));
+        result.Set("frames", Napi::Number::New(env, dec_.frames));
+        result.Set("crcErrors", Napi::Number::New(env, dec_.crc_errors));
+        result.Set("overflows", Napi::Number::New(env, dec_.overflows));
+        result.Set("lost", Napi::Number::New(env, dec_.lost));
+        return result;
+    }
+
+    uart_frame_decoder_t dec_;
+    std::vector<Frame> frames_;
+    std::vector<uint8_t> data_;
+};
+
+Napi::Object Init(Napi::Env env, Napi::Object exports) {
+    exports.Set("parseStatusLog", Napi::Function::New(env, ParseStatusLog));
+    exports.Set("parseDataLog", Napi::Function::New(env, ParseDataLog));
+    exports.Set("aggregateStatusLog", Napi::Function::New(env, AggregateStatusLog));
+    exports.Set("FrameDecoder", FrameDecoder::Define(env));
+    return exports;
+}
+
+}  // namespace
+
+NODE_API_MODULE(telemetry_native, Init)
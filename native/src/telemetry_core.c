@@ -0,0 +1,389 @@
+#include <math.h>
+#include <string.h>
+
+#include "telemetry_core.h"
+
+#define STARTS_WITH(p, end, lit) ((size_t)((end) - (p)) >= sizeof(lit) - 1 && memcmp((p), (lit), sizeof(lit) - 1) == 0)
+
+static const char *skip_spaces(const char *p, const char *end)
+{
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\r'))
+    {
+        p++;
+    }
+    return p;
+}
+
+static const char *trim_end(const char *p, const char *end)
+{
+    while (end > p && (end[-1] == ' ' || end[-1] == '\t' || end[-1] == '\r'))
+    {
+        end--;
+    }
+    return end;
+}
+
+static const char *find_char(const char *p, const char *end, char c)
+{
+    const char *hit = memchr(p, c, (size_t)(end - p));
+    return hit != NULL ? hit : end;
+}
+
+// Parse digits into *out; returns the first non-digit
+static const char *parse_uint(const char *p, const char *end, uint64_t *out)
+{
+    uint64_t v = 0;
+    while (p < end && *p >= '0' && *p <= '9')
+    {
+        v = v * 10 + (uint64_t)(*p - '0');
+        p++;
+    }
+    *out = v;
+    return p;
+}
+
+// Decimal float without exponent, enough for "81.62"
+static const char *parse_float(const char *p, const char *end, float *out)
+{
+    int negative = 0;
+    if (p < end && (*p == '-' || *p == '+'))
+    {
+        negative = (*p == '-');
+        p++;
+    }
+    const char *start = p;
+    uint64_t whole;
+    p = parse_uint(p, end, &whole);
+    double v = (double)whole;
+    if (p < end && *p == '.')
+    {
+        double scale = 0.1;
+        for (p++; p < end && *p >= '0' && *p <= '9'; p++, scale *= 0.1)
+        {
+            v += (*p - '0') * scale;
+        }
+    }
+    *out = (p == start) ? NAN : (float)(negative ? -v : v);
+    return p;
+}
+
+static uint8_t parse_state(const char *p, const char *end)
+{
+    if (STARTS_WITH(p, end, "Sleepy Time"))
+    {
+        return TC_STATE_SLEEP;
+    }
+    if (STARTS_WITH(p, end, "Wander Time"))
+    {
+        return TC_STATE_WANDER;
+    }
+    if (STARTS_WITH(p, end, "Moonwalk Time"))
+    {
+        return TC_STATE_MOONWALK;
+    }
+    return TC_STATE_UNKNOWN;
+}
+
+// "SS", "MM:SS" or "HH:MM:SS"; returns 0 if the whole field is a duration
+static int parse_duration(const char *p, const char *end, uint32_t *out)
+{
+    uint64_t parts[3];
+    int n = 0;
+    while (p < end && n < 3)
+    {
+        const char *next = parse_uint(p, end, &parts[n]);
+        if (next == p)
+        {
+            return -1;
+        }
+        n++;
+        p = next;
+        if (p < end)
+        {
+            if (*p != ':')
+            {
+                return -1;
+            }
+            p++;
+        }
+    }
+    if (p != end || n == 0)
+    {
+        return -1;
+    }
+    uint64_t seconds = 0;
+    for (int i = 0; i < n; i++)
+    {
+        seconds = seconds * 60 + parts[i];
+    }
+    *out = (uint32_t)seconds;
+    return 0;
+}
+
+int tc_parse_message(const char *p, const char *end, tc_message_t *out)
+{
+    out->duration = 0;
+    out->temperature = NAN;
+    out->state = TC_STATE_UNKNOWN;
+    out->source_time_us = NAN;
+
+    while (p < end)
+    {
+        const char *comma = find_char(p, end, ',');
+        const char *field = skip_spaces(p, comma);
+        const char *field_end = trim_end(field, comma);
+
+        if (STARTS_WITH(field, field_end, "Cat state:"))
+        {
+            out->state = parse_state(skip_spaces(field + 10, field_end), field_end);
+        }
+        else if (STARTS_WITH(field, field_end, "Temperature:"))
+        {
+            parse_float(skip_spaces(field + 12, field_end), field_end, &out->temperature);
+        }
+        else if (STARTS_WITH(field, field_end, "Time:"))
+        {
+            const char *digits = skip_spaces(field + 5, field_end);
+            uint64_t us;
+            if (parse_uint(digits, field_end, &us) == field_end && digits != field_end)
+            {
+                out->source_time_us = (double)us;
+            }
+        }
+        else
+        {
+            uint32_t duration;
+            if (parse_duration(field, field_end, &duration) == 0)
+            {
+                out->duration = duration;
+            }
+        }
+        p = comma + 1;
+    }
+    return out->state == TC_STATE_UNKNOWN ? -1 : 0;
+}
+
+size_t tc_count_lines(const char *buf, size_t len)
+{
+    size_t lines = 0;
+    const char *p = buf;
+    const char *end = buf + len;
+    while (p < end)
+    {
+        const char *nl = memchr(p, '\n', (size_t)(end - p));
+        lines++;
+        if (nl == NULL)
+        {
+            break;
+        }
+        p = nl + 1;
+    }
+    return lines;
+}
+
+const char *tc_line_end(const char *p, const char *end)
+{
+    return find_char(p, end, '\n');
+}
+
+// "Port 3334 | ID 1729875494654 | Message: ..."
+int tc_parse_status_line(const char *p, const char *end, tc_status_record_t *out)
+{
+    int have_port = 0;
+    int have_msg = 0;
+    out->id = NAN;
+
+    while (p < end)
+    {
+        const char *sep = end;
+        // Parts are separated by " | "; the message part runs to the end of the line
+        for (const char *q = p; q + 2 < end; q++)
+        {
+            if (q[0] == ' ' && q[1] == '|' && q[2] == ' ')
+            {
+                sep = q;
+                break;
+            }
+        }
+        const char *part = skip_spaces(p, sep);
+
+        if (STARTS_WITH(part, sep, "Port "))
+        {
+            uint64_t port;
+            have_port = parse_uint(part + 5, sep, &port) != part + 5;
+            out->port = (uint16_t)port;
+        }
+        else if (STARTS_WITH(part, sep, "ID "))
+        {
+            uint64_t id;
+            if (parse_uint(part + 3, sep, &id) != part + 3)
+            {
+                out->id = (double)id;
+            }
+        }
+        else if (STARTS_WITH(part, end, "Message: "))
+        {
+            have_msg = tc_parse_message(part + 9, end, &out->msg) == 0;
+            break;
+        }
+        p = (sep == end) ? end : sep + 3;
+    }
+    return (have_port && have_msg) ? 0 : -1;
+}
+
+// Days since 1970-01-01 for a proleptic Gregorian date (Howard Hinnant's days_from_civil)
+static int64_t days_from_civil(int64_t y, unsigned m, unsigned d)
+{
+    y -= m <= 2;
+    const int64_t era = (y >= 0 ? y : y - 399) / 400;
+    const unsigned yoe = (unsigned)(y - era * 400);
+    const unsigned doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+    const unsigned doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + (int64_t)doe - 719468;
+}
+
+// "2024-10-04T17:32:11.539Z" as written by Date.toISOString()
+static double parse_iso_ms(const char *p, const char *end)
+{
+    uint64_t f[6];
+    static const char seps[6] = {'-', '-', 'T', ':', ':', 0};
+    for (int i = 0; i < 6; i++)
+    {
+        const char *next = parse_uint(p, end, &f[i]);
+        if (next == p)
+        {
+            return NAN;
+        }
+        p = next;
+        if (seps[i] != 0)
+        {
+            if (p >= end || *p != seps[i])
+            {
+                return NAN;
+            }
+            p++;
+        }
+    }
+    double ms = 0;
+    if (p < end && *p == '.')
+    {
+        double scale = 100;
+        for (p++; p < end && *p >= '0' && *p <= '9'; p++, scale /= 10)
+        {
+            ms += (*p - '0') * scale;
+        }
+    }
+    int64_t days = days_from_civil((int64_t)f[0], (unsigned)f[1], (unsigned)f[2]);
+    return (double)(days * 86400 + (int64_t)(f[3] * 3600 + f[4] * 60 + f[5])) * 1000.0 + ms;
+}
+
+// "host:port" with no spaces and exactly one colon (so "00:00:12" is not a source)
+static int looks_like_source(const char *p, const char *end)
+{
+    const char *colon = NULL;
+    for (const char *q = p; q < end; q++)
+    {
+        if (*q == ' ' || (*q == ':' && colon != NULL))
+        {
+            return 0;
+        }
+        if (*q == ':')
+        {
+            colon = q;
+        }
+    }
+    if (colon == NULL || colon == p || colon + 1 == end)
+    {
+        return 0;
+    }
+    for (const char *q = colon + 1; q < end; q++)
+    {
+        if (*q < '0' || *q > '9')
+        {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+int tc_parse_data_line(const char *base, const char *p, const char *end, tc_data_record_t *out)
+{
+    const char *comma = find_char(p, end, ',');
+    if (comma == end)
+    {
+        return -1;
+    }
+    out->time_ms = parse_iso_ms(skip_spaces(p, comma), comma);
+    out->source_offset = 0;
+    out->source_length = 0;
+
+    const char *rest = comma + 1;
+    const char *second = find_char(rest, end, ',');
+    const char *src = skip_spaces(rest, second);
+    const char *src_end = trim_end(src, second);
+    if (second < end && looks_like_source(src, src_end))
+    {
+        out->source_offset = (uint32_t)(src - base);
+        out->source_length = (uint16_t)(src_end - src);
+        rest = second + 1;
+    }
+    int err = tc_parse_message(rest, end, &out->msg);
+
+    // Collar stamps beat arrival times, which carry Wi-Fi jitter and retries
+    if (!isnan(out->msg.source_time_us))
+    {
+        out->time_ms = out->msg.source_time_us / 1000.0;
+    }
+    return err;
+}
+
+size_t tc_aggregate_status_log(const char *buf, size_t len, tc_cat_totals_t *totals, size_t max_cats)
+{
+    size_t cats = 0;
+    const char *p = buf;
+    const char *end = buf + len;
+    tc_status_record_t rec;
+
+    while (p < end)
+    {
+        const char *nl = find_char(p, end, '\n');
+        if (tc_parse_status_line(p, nl, &rec) == 0 && rec.msg.state < TC_STATE_COUNT)
+        {
+            // A handful of collars: linear search beats hashing
+            size_t i = 0;
+            while (i < cats && totals[i].port != rec.port)
+            {
+                i++;
+            }
+            if (i == cats && cats < max_cats)
+            {
+                memset(&totals[cats], 0, sizeof(totals[cats]));
+                totals[cats].port = rec.port;
+                cats++;
+            }
+            if (i < cats)
+            {
+                totals[i].seconds[rec.msg.state] += rec.msg.duration;
+                totals[i].records[rec.msg.state]++;
+            }
+        }
+        p = nl + 1;
+    }
+    return cats;
+}
+
+int tc_leader(const tc_cat_totals_t *totals, size_t count)
+{
+    int leader = -1;
+    double best = -1;
+    for (size_t i = 0; i < count; i++)
+    {
+        double active = totals[i].seconds[TC_STATE_WANDER] + totals[i].seconds[TC_STATE_MOONWALK];
+        if (active > best)
+        {
+            best = active;
+            leader = (int)i;
+        }
+    }
+    return leader;
+}
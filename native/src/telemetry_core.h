@@ -0,0 +1,86 @@
+/*
+  Telemetry parsing and per-cat aggregation for the servers.
+
+  Plain C over (pointer, length) ranges: nothing is copied or NUL-terminated, so
+  the N-API wrapper in addon.cc can hand in a Node Buffer directly. Formats are
+  the ones documented in lib/telemetry.js, which stays the reference implementation.
+*/
+
+#ifndef TELEMETRY_CORE_H
+#define TELEMETRY_CORE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum
+{
+    TC_STATE_SLEEP = 0,
+    TC_STATE_WANDER = 1,
+    TC_STATE_MOONWALK = 2,
+    TC_STATE_COUNT = 3,
+    TC_STATE_UNKNOWN = 255
+} tc_state_t;
+
+// Parsed collar status message
+typedef struct
+{
+    uint32_t duration;     // Seconds in the state so far
+    float temperature;     // Fahrenheit, NaN when absent
+    uint8_t state;         // tc_state_t
+    double source_time_us; // Collar's synced epoch stamp, NaN when absent
+} tc_message_t;
+
+// One cat_status_log.txt line
+typedef struct
+{
+    uint16_t port;
+    double id; // Arrival time in ms as written by the UDP logger
+    tc_message_t msg;
+} tc_status_record_t;
+
+// One cat_data.csv line; source is a range inside the input buffer (length 0 when absent)
+typedef struct
+{
+    double time_ms; // Epoch ms: the collar's stamp if it sent one, else the logged arrival time (NaN if unparsable)
+    uint32_t source_offset;
+    uint16_t source_length;
+    tc_message_t msg;
+} tc_data_record_t;
+
+// Per-port state totals
+typedef struct
+{
+    uint16_t port;
+    uint32_t records[TC_STATE_COUNT];
+    double seconds[TC_STATE_COUNT];
+} tc_cat_totals_t;
+
+// Upper bound on records in buf (number of newline-terminated or trailing lines)
+size_t tc_count_lines(const char *buf, size_t len);
+
+// Parse "HH:MM:SS, Temperature: 81.62°F, Cat state: Wander Time[, Time: <epoch us>]"; returns 0 on success
+int tc_parse_message(const char *p, const char *end, tc_message_t *out);
+
+// End of the line starting at p (the '\n' or end)
+const char *tc_line_end(const char *p, const char *end);
+
+// Parse one line without its '\n'; return 0 on success, -1 for malformed lines
+int tc_parse_status_line(const char *p, const char *end, tc_status_record_t *out);
+// base is the start of the buffer, so source_offset can point back into it
+int tc_parse_data_line(const char *base, const char *p, const char *end, tc_data_record_t *out);
+
+// Sum state durations per port; returns the number of ports seen (at most max_cats)
+size_t tc_aggregate_status_log(const char *buf, size_t len, tc_cat_totals_t *totals, size_t max_cats);
+
+// Index into totals of the port with the most Wander + Moonwalk time, or -1
+int tc_leader(const tc_cat_totals_t *totals, size_t count);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // TELEMETRY_CORE_H
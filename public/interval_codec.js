@@ -0,0 +1,672 @@
+// interval_codec.js
+//
+// Compact encoding of activity history. A cat's state holds from one record until its
+// next, so instead of a line per record a collar's history is stored as intervals:
+// runs of one state, each (start, end, state), which is what every duration
+// aggregation wants anyway. Temperatures stay per record, as a time series.
+//
+// A run ends at the collar's next record in another state, or at its own last record
+// when the collar then went silent for longer than maxGapMs, as lib/analytics.js
+// credits time; end - start is then the time the state held.
+//
+// Series (one collar):
+//   [varint runs][varint readings]
+//   runs:      [f64 first start][varint gaps > 0][gaps, if any are][durations][states]
+//              gaps (from the previous run's end) and durations are whole ms in Stream
+//              VByte: a control byte of four 2-bit lengths, then each value's 1-4 bytes
+//              LE, all controls ahead of all data, so decoding a value never waits on a
+//              continuation bit. States are 2 bits each.
+//   readings:  [u8 decimals][f64 first time][f64 first value][bit stream]
+//              Gorilla-style: times as delta-of-delta in prefix-coded buckets (or one
+//              bit when a reading is at the next run's start), values XOR'd with the
+//              previous one. Collars report temperatures to 2 decimals,
+//              so the mantissa bits below that precision are cleared first and the
+//              value rounded back on decoding (decimals = 255 keeps every bit).
+//
+// Block (several collars), with a directory so a reader decodes only the ones it needs:
+//   ["CIVL"][u8 version][varint maxGapMs][varint series]
+//   [per series: varint key length, key (UTF-8), varint bytes][series...]
+//
+// Decoding fills typed arrays in tight loops over one column at a time. There is no
+// SIMD in JavaScript; the layout is the one SIMD varint decoders take, should the
+// native addon ever decode it.
+//
+// Loads as a browser global (IntervalCodec) and as a CommonJS module.
+
+(function (root) {
+    'use strict';
+
+    const MAGIC = [0x43, 0x49, 0x56, 0x4C]; // "CIVL"
+    const VERSION = 1;
+    const LOSSLESS = 255;
+    const MAX_DECIMALS = 4;
+    const UNKNOWN_STATE = 255;
+    const MAX_U32 = 0xFFFFFFFF;
+
+    const f64 = new Float64Array(1);
+    const f64Bytes = new Uint8Array(f64.buffer);
+    const f64Words = new Uint32Array(f64.buffer); // [low, high] on little-endian hosts
+
+    // Growable output buffer
+    class ByteWriter {
+        constructor(size = 256) {
+            this.bytes = new Uint8Array(size);
+            this.length = 0;
+            this.current = 0; // Bit stream: the byte being filled, from its top bit
+            this.bit = 0;
+        }
+
+        ensure(n) {
+            if (this.length + n > this.bytes.length) {
+                const next = new Uint8Array(Math.max(this.length + n, this.bytes.length * 2));
+                next.set(this.bytes.subarray(0, this.length));
+                this.bytes = next;
+            }
+        }
+
+        u8(value) {
+            this.ensure(1);
+            this.bytes[this.length++] = value;
+        }
+
+        varint(value) {
+            this.ensure(8);
+            while (value >= 0x80) {
+                this.bytes[this.length++] = (value % 0x80) | 0x80;
+                value = Math.floor(value / 0x80);
+            }
+            this.bytes[this.length++] = value;
+        }
+
+        f64(value) {
+            this.ensure(8);
+            f64[0] = value;
+            this.bytes.set(f64Bytes, this.length);
+            this.length += 8;
+        }
+
+        raw(bytes) {
+            this.ensure(bytes.length);
+            this.bytes.set(bytes, this.length);
+            this.length += bytes.length;
+        }
+
+        // The low n (<= 32) bits of value, most significant first
+        bits(value, n) {
+            while (n > 0) {
+                const room = 8 - this.bit;
+                const take = n < room ? n : room;
+                this.current |= ((value >>> (n - take)) & ((1 << take) - 1)) << (room - take);
+                this.bit += take;
+                n -= take;
+                if (this.bit === 8) {
+                    this.u8(this.current);
+                    this.current = 0;
+                    this.bit = 0;
+                }
+            }
+        }
+
+        flushBits() {
+            if (this.bit > 0) {
+                this.u8(this.current);
+                this.current = 0;
+                this.bit = 0;
+            }
+        }
+
+        result() {
+            return this.bytes.slice(0, this.length);
+        }
+    }
+
+    class ByteReader {
+        constructor(bytes, pos = 0) {
+            this.bytes = bytes;
+            this.pos = pos;
+            this.bit = 0;
+        }
+
+        u8() {
+            return this.bytes[this.pos++];
+        }
+
+        varint() {
+            let value = 0;
+            let scale = 1;
+            let byte;
+            do {
+                byte = this.bytes[this.pos++];
+                value += (byte & 0x7F) * scale;
+                scale *= 0x80;
+            } while (byte & 0x80);
+            return value;
+        }
+
+        f64() {
+            for (let i = 0; i < 8; i++) {
+                f64Bytes[i] = this.bytes[this.pos++];
+            }
+            return f64[0];
+        }
+
+        bits(n) {
+            let value = 0;
+            while (n > 0) {
+                const room = 8 - this.bit;
+                const take = n < room ? n : room;
+                value = value * (1 << take) + ((this.bytes[this.pos] >>> (room - take)) & ((1 << take) - 1));
+                this.bit += take;
+                n -= take;
+                if (this.bit === 8) {
+                    this.pos++;
+                    this.bit = 0;
+                }
+            }
+            return value;
+        }
+
+        bit1() {
+            const value = (this.bytes[this.pos] >>> (7 - this.bit)) & 1;
+            if (++this.bit === 8) {
+                this.pos++;
+                this.bit = 0;
+            }
+            return value;
+        }
+    }
+
+    // Stream VByte ///////////////////////////////////////////////////////////////
+
+    function writeVByte(out, values, count) {
+        const control = out.length;
+        out.ensure(((count + 3) >> 2) + count * 4);
+        out.bytes.fill(0, control, control + ((count + 3) >> 2));
+        let data = control + ((count + 3) >> 2);
+        const bytes = out.bytes;
+        for (let i = 0; i < count; i++) {
+            const value = values[i];
+            if (!(value >= 0 && value <= MAX_U32)) {
+                throw new RangeError(`interval of ${value} ms does not fit a series`);
+            }
+            const code = value < 0x100 ? 0 : value < 0x10000 ? 1 : value < 0x1000000 ? 2 : 3;
+            bytes[control + (i >> 2)] |= code << ((i & 3) << 1);
+            bytes[data++] = value & 0xFF;
+            if (code > 0) {
+                bytes[data++] = (value >>> 8) & 0xFF;
+                if (code > 1) {
+                    bytes[data++] = (value >>> 16) & 0xFF;
+                    if (code > 2) {
+                        bytes[data++] = value >>> 24;
+                    }
+                }
+            }
+        }
+        out.length = data;
+    }
+
+    // Decode count values into out (at out[0..count)); returns the position after them
+    function readVByte(bytes, pos, count, out) {
+        let data = pos + ((count + 3) >> 2);
+        for (let i = 0; i < count; i++) {
+            const code = (bytes[pos + (i >> 2)] >>> ((i & 3) << 1)) & 3;
+            let value = bytes[data];
+            if (code > 0) {
+                value |= bytes[data + 1] << 8;
+                if (code > 1) {
+                    value |= bytes[data + 2] << 16;
+                    if (code > 2) {
+                        value = (value | (bytes[data + 3] << 24)) >>> 0;
+                    }
+                }
+            }
+            out[i] = value;
+            data += code + 1;
+        }
+        return data;
+    }
+
+    // Runs ///////////////////////////////////////////////////////////////////////
+
+    // Runs of one state from records in time order (whole ms); unknown states are skipped
+    function toRuns(time, state, count, maxGapMs) {
+        const start = new Float64Array(count);
+        const end = new Float64Array(count);
+        const runState = new Uint8Array(count);
+        let runs = 0;
+        let prev = -1;
+        for (let i = 0; i < count; i++) {
+            if (state[i] === UNKNOWN_STATE) {
+                continue;
+            }
+            if (prev < 0) {
+                start[0] = time[i];
+                runState[0] = state[i];
+                runs = 1;
+            } else if (time[i] - time[prev] > maxGapMs) {
+                end[runs - 1] = time[prev];
+                start[runs] = time[i];
+                runState[runs++] = state[i];
+            } else if (state[i] !== state[prev]) {
+                end[runs - 1] = time[i];
+                start[runs] = time[i];
+                runState[runs++] = state[i];
+            }
+            prev = i;
+        }
+        if (runs > 0) {
+            end[runs - 1] = time[prev];
+        }
+        return { count: runs, start, end, state: runState };
+    }
+
+    function writeRuns(out, runs) {
+        const n = runs.count;
+        out.f64(runs.start[0]);
+        const scratch = new Float64Array(n);
+        let silences = 0;
+        for (let i = 1; i < n; i++) {
+            scratch[i - 1] = runs.start[i] - runs.end[i - 1];
+            silences += scratch[i - 1] > 0 ? 1 : 0;
+        }
+        // Runs usually follow on from each other; the gaps are left out when they all do
+        out.varint(silences);
+        if (silences > 0) {
+            writeVByte(out, scratch, n - 1);
+        }
+        for (let i = 0; i < n; i++) {
+            scratch[i] = runs.end[i] - runs.start[i];
+        }
+        writeVByte(out, scratch, n);
+        const packed = new Uint8Array((n + 3) >> 2);
+        for (let i = 0; i < n; i++) {
+            packed[i >> 2] |= runs.state[i] << ((i & 3) << 1);
+        }
+        out.raw(packed);
+    }
+
+    function readRuns(reader, n) {
+        const start = new Float64Array(n);
+        const end = new Float64Array(n);
+        const state = new Uint8Array(n);
+        const bytes = reader.bytes;
+        start[0] = reader.f64();
+        const gaps = new Uint32Array(n);
+        const durations = new Uint32Array(n);
+        let pos = reader.varint() > 0 ? readVByte(bytes, reader.pos, n - 1, gaps) : reader.pos;
+        pos = readVByte(bytes, pos, n, durations);
+        let t = start[0] + durations[0];
+        end[0] = t;
+        for (let i = 1; i < n; i++) {
+            t += gaps[i - 1];
+            start[i] = t;
+            t += durations[i];
+            end[i] = t;
+        }
+        for (let i = 0; i < n; i++) {
+            state[i] = (bytes[pos + (i >> 2)] >>> ((i & 3) << 1)) & 3;
+        }
+        reader.pos = pos + ((n + 3) >> 2);
+        return { count: n, start, end, state };
+    }
+
+    // Readings ///////////////////////////////////////////////////////////////////
+
+    // Fewest decimals (up to MAX_DECIMALS) that write every value exactly, or LOSSLESS
+    function decimalsOf(values, count) {
+        let decimals = 0;
+        for (let i = 0; i < count; i++) {
+            while (decimals <= MAX_DECIMALS && Math.round(values[i] * 10 ** decimals) / 10 ** decimals !== values[i]) {
+                decimals++;
+            }
+            if (decimals > MAX_DECIMALS) {
+                return LOSSLESS;
+            }
+        }
+        return decimals;
+    }
+
+    // value with the mantissa bits below 2^-(bits needed for decimals + 1) cleared, so it
+    // is within half a last decimal of value; leaves the result in f64Words
+    function erase(value, decimals) {
+        f64[0] = value;
+        if (decimals === LOSSLESS) {
+            return;
+        }
+        const exponent = ((f64Words[1] >>> 20) & 0x7FF) - 1023;
+        if (exponent === -1023) {
+            return; // Zero or subnormal
+        }
+        const fractionBits = Math.ceil(decimals * Math.log2(10)) + 1;
+        const clear = Math.min(52, Math.max(0, 52 - exponent - fractionBits));
+        if (clear >= 32) {
+            f64Words[0] = 0;
+            f64Words[1] &= ~((1 << (clear - 32)) - 1);
+        } else if (clear > 0) {
+            f64Words[0] &= ~((1 << clear) - 1);
+        }
+    }
+
+    function restore(value, decimals) {
+        if (decimals === LOSSLESS) {
+            return value;
+        }
+        const scale = 10 ** decimals;
+        return Math.round(value * scale) / scale;
+    }
+
+    function clz64(hi, lo) {
+        return hi !== 0 ? Math.clz32(hi) : 32 + Math.clz32(lo);
+    }
+
+    function ctz32(x) {
+        return 31 - Math.clz32(x & -x);
+    }
+
+    function ctz64(hi, lo) {
+        return lo !== 0 ? ctz32(lo) : 32 + ctz32(hi);
+    }
+
+    // The n bits of (hi:lo) from bit shift up, most significant first
+    function writeBits64(out, hi, lo, shift, n) {
+        let h = hi;
+        let l = lo;
+        if (shift >= 32) {
+            l = hi >>> (shift - 32);
+            h = 0;
+        } else if (shift > 0) {
+            l = ((lo >>> shift) | (hi << (32 - shift))) >>> 0;
+            h = hi >>> shift;
+        }
+        if (n > 32) {
+            out.bits(h, n - 32);
+            out.bits(l, 32);
+        } else {
+            out.bits(l, n);
+        }
+    }
+
+    function writeReadings(out, time, value, count, runs) {
+        const decimals = decimalsOf(value, count);
+        // Every value must come back exactly from its cleared bits, or all bits are kept
+        for (let i = 0; i < count && decimals !== LOSSLESS; i++) {
+            erase(value[i], decimals);
+            if (restore(f64[0], decimals) !== value[i]) {
+                return writeReadingsAs(out, time, value, count, runs, LOSSLESS);
+            }
+        }
+        return writeReadingsAs(out, time, value, count, runs, decimals);
+    }
+
+    function writeReadingsAs(out, time, value, count, runs, decimals) {
+        out.u8(decimals);
+        out.f64(time[0]);
+        erase(value[0], decimals);
+        out.f64(f64[0]);
+        let prevHi = f64Words[1];
+        let prevLo = f64Words[0];
+        let prevLead = -1;
+        let prevTrail = 0;
+        let prevDelta = 0;
+        let next = 0; // First run starting after the last reading
+        for (let i = 1; i < count; i++) {
+            // Time: 0 if at the next run's start, as readings of collars that report on
+            // each change are; else 1 and the delta-of-delta zigzagged into 1-36 bits
+            const delta = time[i] - time[i - 1];
+            const dod = delta - prevDelta;
+            prevDelta = delta;
+            while (next < runs.count && runs.start[next] <= time[i - 1]) {
+                next++;
+            }
+            const zigzag = ((dod << 1) ^ (dod >> 31)) >>> 0;
+            if (next < runs.count && time[i] === runs.start[next]) {
+                out.bits(0, 1);
+            } else if (!(dod >= -0x80000000 && dod <= 0x7FFFFFFF)) {
+                throw new RangeError(`reading ${delta} ms after the last does not fit a series`);
+            } else if (zigzag === 0) {
+                out.bits(0b10, 2);
+            } else if (zigzag < 0x80) {
+                out.bits(0b110, 3);
+                out.bits(zigzag, 7);
+            } else if (zigzag < 0x200) {
+                out.bits(0b1110, 4);
+                out.bits(zigzag, 9);
+            } else if (zigzag < 0x1000) {
+                out.bits(0b11110, 5);
+                out.bits(zigzag, 12);
+            } else {
+                out.bits(0b11111, 5);
+                out.bits(zigzag, 32);
+            }
+
+            // Value: XOR with the last, its meaningful bits in the last window if they fit
+            erase(value[i], decimals);
+            const hi = f64Words[1];
+            const lo = f64Words[0];
+            const xhi = (hi ^ prevHi) >>> 0;
+            const xlo = (lo ^ prevLo) >>> 0;
+            prevHi = hi;
+            prevLo = lo;
+            if (xhi === 0 && xlo === 0) {
+                out.bits(0, 1);
+                continue;
+            }
+            const lead = Math.min(31, clz64(xhi, xlo));
+            const trail = ctz64(xhi, xlo);
+            if (prevLead >= 0 && lead >= prevLead && trail >= prevTrail) {
+                out.bits(0b10, 2);
+                writeBits64(out, xhi, xlo, prevTrail, 64 - prevLead - prevTrail);
+            } else {
+                const meaningful = 64 - lead - trail;
+                out.bits(0b11, 2);
+                out.bits(lead, 5);
+                out.bits(meaningful - 1, 6);
+                writeBits64(out, xhi, xlo, trail, meaningful);
+                prevLead = lead;
+                prevTrail = trail;
+            }
+        }
+        out.flushBits();
+    }
+
+    function readReadings(reader, count, runs) {
+        const time = new Float64Array(count);
+        const value = new Float64Array(count);
+        const decimals = reader.u8();
+        time[0] = reader.f64();
+        f64[0] = reader.f64();
+        let hi = f64Words[1];
+        let lo = f64Words[0];
+        value[0] = restore(f64[0], decimals);
+        let lead = 0;
+        let trail = 0;
+        let delta = 0;
+        let next = 0;
+        for (let i = 1; i < count; i++) {
+            while (next < runs.count && runs.start[next] <= time[i - 1]) {
+                next++;
+            }
+            if (reader.bit1() === 0) {
+                time[i] = runs.start[next];
+                delta = time[i] - time[i - 1];
+            } else {
+                let zigzag = 0;
+                if (reader.bit1() === 1) {
+                    if (reader.bit1() === 0) {
+                        zigzag = reader.bits(7);
+                    } else if (reader.bit1() === 0) {
+                        zigzag = reader.bits(9);
+                    } else if (reader.bit1() === 0) {
+                        zigzag = reader.bits(12);
+                    } else {
+                        zigzag = reader.bits(32);
+                    }
+                }
+                delta += (zigzag >>> 1) ^ -(zigzag & 1);
+                time[i] = time[i - 1] + delta;
+            }
+
+            if (reader.bit1() === 1) {
+                if (reader.bit1() === 1) {
+                    lead = reader.bits(5);
+                    trail = 64 - lead - (reader.bits(6) + 1);
+                }
+                const n = 64 - lead - trail;
+                let h = n > 32 ? reader.bits(n - 32) : 0;
+                let l = reader.bits(n > 32 ? 32 : n);
+                if (trail >= 32) {
+                    h = (l << (trail - 32)) >>> 0;
+                    l = 0;
+                } else if (trail > 0) {
+                    h = ((h << trail) | (l >>> (32 - trail))) >>> 0;
+                    l = (l << trail) >>> 0;
+                }
+                hi = (hi ^ h) >>> 0;
+                lo = (lo ^ l) >>> 0;
+            }
+            f64Words[1] = hi;
+            f64Words[0] = lo;
+            value[i] = restore(f64[0], decimals);
+        }
+        if (reader.bit > 0) {
+            reader.pos++;
+            reader.bit = 0;
+        }
+        return { count, time, value, decimals };
+    }
+
+    // Series and blocks //////////////////////////////////////////////////////////
+
+    // One collar's records: { count, time (ms), state (index, 255 if unknown),
+    // temperature (NaN if none) }. Times are rounded to whole ms; records may come
+    // a little out of order.
+    function encodeSeries(records, maxGapMs) {
+        const count = records.count;
+        let order = null;
+        for (let i = 1; i < count; i++) {
+            if (records.time[i] < records.time[i - 1]) {
+                order = Array.from({ length: count }, (_, k) => k).sort((a, b) => records.time[a] - records.time[b] || a - b);
+                break;
+            }
+        }
+        const time = new Float64Array(count);
+        const state = new Uint8Array(count);
+        const readingTime = new Float64Array(count);
+        const readingValue = new Float64Array(count);
+        let readings = 0;
+        for (let k = 0; k < count; k++) {
+            const i = order ? order[k] : k;
+            time[k] = Math.round(records.time[i]);
+            state[k] = records.state[i];
+            if (!Number.isNaN(records.temperature[i])) {
+                readingTime[readings] = time[k];
+                readingValue[readings++] = records.temperature[i];
+            }
+        }
+
+        const runs = toRuns(time, state, count, maxGapMs);
+        const out = new ByteWriter(64 + runs.count * 4 + readings * 3);
+        out.varint(runs.count);
+        out.varint(readings);
+        if (runs.count > 0) {
+            writeRuns(out, runs);
+        }
+        if (readings > 0) {
+            writeReadings(out, readingTime, readingValue, readings, runs);
+        }
+        return out.result();
+    }
+
+    // { runs: { count, start, end, state }, readings: { count, time, value } | null }
+    // from the series at bytes[offset]; options.readings false skips the temperatures
+    function decodeSeries(bytes, offset = 0, options = {}) {
+        const reader = new ByteReader(bytes, offset);
+        const runCount = reader.varint();
+        const readingCount = reader.varint();
+        const runs = runCount > 0
+            ? readRuns(reader, runCount)
+            : { count: 0, start: new Float64Array(0), end: new Float64Array(0), state: new Uint8Array(0) };
+        let readings = null;
+        if (options.readings !== false) {
+            readings = readingCount > 0
+                ? readReadings(reader, readingCount, runs)
+                : { count: 0, time: new Float64Array(0), value: new Float64Array(0), decimals: 0 };
+        }
+        return { runs, readings };
+    }
+
+    function utf8(text) {
+        return typeof TextEncoder !== 'undefined' ? new TextEncoder().encode(text) : Buffer.from(text, 'utf8');
+    }
+
+    // Block of several collars: series is [{ key, records }], maxGapMs as in encodeSeries
+    function encodeBlock(series, maxGapMs) {
+        if (!Number.isSafeInteger(maxGapMs) || maxGapMs < 0) {
+            throw new RangeError(`maxGapMs must be a whole number of ms, not ${maxGapMs}`);
+        }
+        const encoded = series.map(({ key, records }) => ({ key: utf8(key), bytes: encodeSeries(records, maxGapMs) }));
+        const out = new ByteWriter(64 + encoded.reduce((sum, s) => sum + s.key.length + s.bytes.length + 8, 0));
+        out.raw(MAGIC);
+        out.u8(VERSION);
+        out.varint(maxGapMs);
+        out.varint(encoded.length);
+        encoded.forEach(({ key, bytes }) => {
+            out.varint(key.length);
+            out.raw(key);
+            out.varint(bytes.length);
+        });
+        encoded.forEach(({ bytes }) => out.raw(bytes));
+        return out.result();
+    }
+
+    // The directory of a block: { maxGapMs, series: [{ key, offset, length }] }, where
+    // decodeSeries(bytes, offset) decodes one; throws if bytes are not a block
+    function readBlock(bytes) {
+        if (!(bytes instanceof Uint8Array)) {
+            bytes = new Uint8Array(bytes);
+        }
+        if (bytes.length < 6 || MAGIC.some((byte, i) => bytes[i] !== byte)) {
+            throw new Error('not an interval block');
+        }
+        if (bytes[4] !== VERSION) {
+            throw new Error(`interval block version ${bytes[4]}, expected ${VERSION}`);
+        }
+        const reader = new ByteReader(bytes, 5);
+        const maxGapMs = reader.varint();
+        const count = reader.varint();
+        const decoder = typeof TextDecoder !== 'undefined' ? new TextDecoder() : null;
+        const entries = [];
+        for (let i = 0; i < count; i++) {
+            const keyLength = reader.varint();
+            const keyBytes = bytes.subarray(reader.pos, reader.pos + keyLength);
+            reader.pos += keyLength;
+            const key = decoder ? decoder.decode(keyBytes) : Buffer.from(keyBytes).toString('utf8');
+            entries.push({ key, length: reader.varint() });
+        }
+        let offset = reader.pos;
+        const series = entries.map(({ key, length }) => {
+            const entry = { key, offset, length };
+            offset += length;
+            return entry;
+        });
+        if (offset > bytes.length) {
+            throw new Error('truncated interval block');
+        }
+        return { bytes, maxGapMs, series };
+    }
+
+    const IntervalCodec = {
+        UNKNOWN_STATE,
+        encodeSeries,
+        decodeSeries,
+        encodeBlock,
+        readBlock,
+        toRuns
+    };
+
+    if (typeof module !== 'undefined' && module.exports) {
+        module.exports = IntervalCodec;
+    } else {
+        root.IntervalCodec = IntervalCodec;
+    }
+})(this);
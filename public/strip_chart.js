@@ -0,0 +1,365 @@
+// strip_chart.js
+//
+// Live strip chart of every cat's state for the dashboard (index.html). Each cat has a
+// lane, coloured by its state over the last spanMs, with now at the right edge.
+//
+// Records go into fixed typed-array rings, one per cat, as read_data.js pushes them;
+// nothing is rebuilt per push. The plot lives in an off-screen canvas used as a ring of
+// one-pixel columns. A frame paints only the columns time has exposed since the last
+// one, plus the stretch of a lane a late record changed, then copies the ring to the
+// screen in two slices and redraws the time axis. Frames are capped at maxFps and
+// skipped while nothing has changed, and once the lanes are laid out a frame allocates
+// nothing. A new cat, or a resize, repaints everything once.
+//
+// Loads as a browser global (StripChart) and as a CommonJS module (tools/bench_chart.js
+// drives it with a stand-in canvas).
+
+(function (root) {
+    'use strict';
+
+    const STATE_NAMES = ['Sleepy Time', 'Wander Time', 'Moonwalk Time'];
+    const STATE_COLORS = ['#85929E', '#2E86C1', '#D68910'];
+    const BACKGROUND = '#F4F1EA'; // Before a cat's first record
+    const AXIS_COLOR = '#695A42';
+    const LABEL_WIDTH = 110;
+    const AXIS_HEIGHT = 24;
+    const MAX_LANE_HEIGHT = 40;
+    const TICK_STEPS_MS = [1000, 2000, 5000, 10000, 15000, 30000, 60000, 120000, 300000, 600000, 900000, 1800000, 3600000];
+    const LABEL_SLOTS = 16; // Tick labels kept between frames; a span never shows more ticks
+
+    const ADD_DROPPED = 0; // A repeat, or older than a full ring's oldest record
+    const ADD_APPENDED = 1;
+    const ADD_INSERTED = 2;
+
+    function mod(a, n) {
+        const r = a % n;
+        return r < 0 ? r + n : r;
+    }
+
+    function createCanvas(width, height) {
+        const canvas = document.createElement('canvas');
+        canvas.width = width;
+        canvas.height = height;
+        return canvas;
+    }
+
+    function formatTime(ms) {
+        const d = new Date(ms);
+        const pad = n => (n < 10 ? '0' : '') + n;
+        return `${pad(d.getHours())}:${pad(d.getMinutes())}:${pad(d.getSeconds())}`;
+    }
+
+    // One cat's records in time order, in fixed arrays; the oldest go once it is full
+    class CatRing {
+        constructor(source, capacity) {
+            this.source = source;
+            this.label = String(source);
+            this.times = new Float64Array(capacity);
+            this.states = new Uint8Array(capacity);
+            this.capacity = capacity;
+            this.head = 0; // Slot of the oldest record
+            this.length = 0;
+            this.dirtyFromMs = Infinity; // Earliest painted time a late record changed
+        }
+
+        slot(i) {
+            const s = this.head + i;
+            return s < this.capacity ? s : s - this.capacity;
+        }
+
+        timeAt(i) {
+            return this.times[this.slot(i)];
+        }
+
+        stateAt(i) {
+            return this.states[this.slot(i)];
+        }
+
+        // Index of the last record before limitMs, or -1
+        indexBefore(limitMs) {
+            let lo = 0;
+            let hi = this.length - 1;
+            let found = -1;
+            while (lo <= hi) {
+                const mid = (lo + hi) >> 1;
+                if (this.timeAt(mid) < limitMs) {
+                    found = mid;
+                    lo = mid + 1;
+                } else {
+                    hi = mid - 1;
+                }
+            }
+            return found;
+        }
+
+        add(timeMs, state) {
+            // After every record at or before timeMs: appends in the usual case, and a
+            // record pushed twice (history, then the follower's first batch) lands next to itself
+            let at = this.length;
+            if (at > 0 && timeMs < this.timeAt(at - 1)) {
+                at = this.indexBefore(timeMs) + 1;
+                while (at < this.length && this.timeAt(at) === timeMs) {
+                    at++;
+                }
+            }
+            if (at > 0 && this.timeAt(at - 1) === timeMs && this.stateAt(at - 1) === state) {
+                return ADD_DROPPED;
+            }
+            if (this.length === this.capacity) {
+                if (at === 0) {
+                    return ADD_DROPPED;
+                }
+                this.head = this.slot(1);
+                this.length--;
+                at--;
+            }
+            for (let i = this.length; i > at; i--) {
+                const to = this.slot(i);
+                const from = this.slot(i - 1);
+                this.times[to] = this.times[from];
+                this.states[to] = this.states[from];
+            }
+            const s = this.slot(at);
+            this.times[s] = timeMs;
+            this.states[s] = state;
+            this.length++;
+            return at === this.length - 1 ? ADD_APPENDED : ADD_INSERTED;
+        }
+    }
+
+    class StripChart {
+        // options: spanMs (10 min), maxCats (64), capacity (records kept per cat, 4096),
+        // maxFps (60); now and createCanvas stand in for Date.now and the DOM in benches
+        constructor(canvas, options = {}) {
+            this.canvas = canvas;
+            this.spanMs = options.spanMs || 10 * 60 * 1000;
+            this.maxCats = options.maxCats || 64;
+            this.capacity = options.capacity || 4096;
+            this.minFrameMs = 1000 / (options.maxFps || 60);
+            this.now = options.now || Date.now;
+            this.createCanvas = options.createCanvas || createCanvas;
+            this.cats = [];
+            this.bySource = new Map();
+            this.stats = { frames: 0, idle: 0, capped: 0, repaints: 0, columns: 0, late: 0, dropped: 0 };
+            this.labelTicks = new Float64Array(LABEL_SLOTS).fill(NaN);
+            this.labels = new Array(LABEL_SLOTS).fill('');
+            this.lastFrameTs = -Infinity;
+            this.running = false;
+            this.tick = this.tick.bind(this);
+            this.resize();
+        }
+
+        // Lay the chart out for the canvas's current size (call on window resize)
+        resize() {
+            const ratio = (typeof window !== 'undefined' && window.devicePixelRatio) || 1;
+            const width = this.canvas.clientWidth || this.canvas.width;
+            const height = this.canvas.clientHeight || this.canvas.height;
+            this.ratio = ratio;
+            this.canvas.width = Math.round(width * ratio);
+            this.canvas.height = Math.round(height * ratio);
+            this.ctx = this.canvas.getContext('2d');
+            this.plotWidth = Math.max(1, Math.floor(width) - LABEL_WIDTH);
+            this.plotHeight = Math.max(1, Math.floor(height) - AXIS_HEIGHT);
+            this.msPerColumn = this.spanMs / this.plotWidth;
+            this.originMs = this.now(); // Columns count from here, so they stay small integers
+            this.tickMs = TICK_STEPS_MS.find(step => step * 6 >= this.spanMs) || TICK_STEPS_MS[TICK_STEPS_MS.length - 1];
+            this.ring = this.createCanvas(Math.round(this.plotWidth * ratio), Math.round(this.plotHeight * ratio));
+            this.ringCtx = this.ring.getContext('2d');
+            this.ringCtx.setTransform(ratio, 0, 0, ratio, 0, 0);
+            this.labelTicks.fill(NaN);
+            this.invalidate();
+        }
+
+        // Repaint everything on the next frame
+        invalidate() {
+            this.drawnColumn = -Infinity;
+        }
+
+        reset() {
+            this.cats = [];
+            this.bySource.clear();
+            this.invalidate();
+        }
+
+        // Add a record: state is an index into STATE_NAMES. Returns whether it was new
+        add(source, timeMs, state) {
+            if (!(state >= 0 && state < STATE_COLORS.length) || !Number.isFinite(timeMs)) {
+                return false;
+            }
+            let cat = this.bySource.get(source);
+            if (!cat) {
+                if (this.cats.length >= this.maxCats) {
+                    this.stats.dropped++;
+                    return false;
+                }
+                cat = new CatRing(source, this.capacity);
+                this.cats.push(cat);
+                this.bySource.set(source, cat);
+                this.invalidate();
+            }
+            if (cat.add(timeMs, state) === ADD_DROPPED) {
+                return false;
+            }
+            if (timeMs < this.originMs + (this.drawnColumn + 1) * this.msPerColumn) {
+                cat.dirtyFromMs = Math.min(cat.dirtyFromMs, timeMs);
+                this.stats.late++;
+            }
+            return true;
+        }
+
+        start() {
+            if (!this.running) {
+                this.running = true;
+                requestAnimationFrame(this.tick);
+            }
+        }
+
+        stop() {
+            this.running = false;
+        }
+
+        tick(ts) {
+            if (!this.running) {
+                return;
+            }
+            this.frame(ts);
+            requestAnimationFrame(this.tick);
+        }
+
+        // Bring the screen up to now; ts is the animation frame's timestamp
+        frame(ts) {
+            if (ts - this.lastFrameTs < this.minFrameMs - 1) {
+                this.stats.capped++;
+                return;
+            }
+            this.lastFrameTs = ts;
+
+            const nowColumn = this.columnOf(this.now());
+            const firstColumn = nowColumn - this.plotWidth + 1;
+            if (this.drawnColumn < firstColumn - 1) {
+                this.repaint(firstColumn, nowColumn);
+            } else {
+                let changed = nowColumn > this.drawnColumn;
+                for (let i = 0; i < this.cats.length; i++) {
+                    const cat = this.cats[i];
+                    if (cat.dirtyFromMs !== Infinity) {
+                        const from = Math.max(firstColumn, this.columnOf(cat.dirtyFromMs));
+                        this.paintLane(cat, i, from, Math.min(this.drawnColumn, nowColumn));
+                        cat.dirtyFromMs = Infinity;
+                        changed = true;
+                    }
+                    if (nowColumn > this.drawnColumn) {
+                        this.paintLane(cat, i, this.drawnColumn + 1, nowColumn);
+                    }
+                }
+                if (!changed) {
+                    this.stats.idle++;
+                    return;
+                }
+                this.stats.columns += Math.max(0, nowColumn - this.drawnColumn);
+            }
+            this.drawnColumn = nowColumn;
+            this.compose(nowColumn);
+            this.stats.frames++;
+        }
+
+        repaint(firstColumn, nowColumn) {
+            const ctx = this.ctx;
+            this.laneHeight = Math.max(1, Math.min(MAX_LANE_HEIGHT, Math.floor(this.plotHeight / Math.max(1, this.cats.length))));
+            this.ringCtx.fillStyle = BACKGROUND;
+            this.ringCtx.fillRect(0, 0, this.plotWidth, this.plotHeight);
+            for (let i = 0; i < this.cats.length; i++) {
+                this.cats[i].dirtyFromMs = Infinity;
+                this.paintLane(this.cats[i], i, firstColumn, nowColumn);
+            }
+
+            // Lane labels, left of the plot
+            ctx.setTransform(this.ratio, 0, 0, this.ratio, 0, 0);
+            ctx.clearRect(0, 0, LABEL_WIDTH, this.plotHeight + AXIS_HEIGHT);
+            const fontSize = Math.min(12, this.laneHeight - 1);
+            if (fontSize >= 7) {
+                ctx.fillStyle = AXIS_COLOR;
+                ctx.font = `${fontSize}px Arial`;
+                ctx.textAlign = 'right';
+                ctx.textBaseline = 'middle';
+                this.cats.forEach((cat, i) => {
+                    ctx.fillText(cat.label, LABEL_WIDTH - 6, (i + 0.5) * this.laneHeight, LABEL_WIDTH - 10);
+                });
+            }
+            this.stats.repaints++;
+        }
+
+        columnOf(timeMs) {
+            return Math.floor((timeMs - this.originMs) / this.msPerColumn);
+        }
+
+        // Paint columns from..to of a cat's lane: each column shows the last record before its end
+        paintLane(cat, lane, from, to) {
+            const ctx = this.ringCtx;
+            const y = lane * this.laneHeight;
+            const h = this.laneHeight > 3 ? this.laneHeight - 1 : this.laneHeight;
+            let i = cat.indexBefore(this.originMs + (from + 1) * this.msPerColumn);
+            let column = from;
+            while (column <= to) {
+                const next = i + 1 < cat.length ? this.columnOf(cat.timeAt(i + 1)) : Infinity;
+                const end = Math.min(to + 1, next);
+                if (end > column) {
+                    ctx.fillStyle = i < 0 ? BACKGROUND : STATE_COLORS[cat.stateAt(i)];
+                    const x = mod(column, this.plotWidth);
+                    const width = end - column;
+                    if (x + width <= this.plotWidth) {
+                        ctx.fillRect(x, y, width, h);
+                    } else {
+                        ctx.fillRect(x, y, this.plotWidth - x, h);
+                        ctx.fillRect(0, y, width - (this.plotWidth - x), h);
+                    }
+                    column = end;
+                }
+                i++;
+            }
+        }
+
+        // Copy the column ring to the screen, oldest column at the left, and draw the axis
+        compose(nowColumn) {
+            const ctx = this.ctx;
+            const ring = this.ring;
+            const left = Math.round(LABEL_WIDTH * this.ratio);
+            const split = Math.round(mod(nowColumn + 1, this.plotWidth) * this.ratio); // Oldest column on screen
+            ctx.setTransform(1, 0, 0, 1, 0, 0);
+            if (ring.width > split) {
+                ctx.drawImage(ring, split, 0, ring.width - split, ring.height, left, 0, ring.width - split, ring.height);
+            }
+            if (split > 0) {
+                ctx.drawImage(ring, 0, 0, split, ring.height, left + ring.width - split, 0, split, ring.height);
+            }
+
+            ctx.setTransform(this.ratio, 0, 0, this.ratio, 0, 0);
+            ctx.clearRect(LABEL_WIDTH - 30, this.plotHeight, this.plotWidth + 30, AXIS_HEIGHT);
+            ctx.fillStyle = AXIS_COLOR;
+            ctx.font = '11px Arial';
+            ctx.textAlign = 'center';
+            ctx.textBaseline = 'top';
+            const lastX = LABEL_WIDTH + this.plotWidth - 1;
+            const nowMs = this.originMs + (nowColumn + 1) * this.msPerColumn;
+            for (let t = Math.ceil((nowMs - this.spanMs) / this.tickMs) * this.tickMs; t <= nowMs; t += this.tickMs) {
+                const x = lastX - (nowColumn - this.columnOf(t));
+                const slot = mod(Math.round(t / this.tickMs), LABEL_SLOTS);
+                if (this.labelTicks[slot] !== t) {
+                    this.labelTicks[slot] = t;
+                    this.labels[slot] = formatTime(t);
+                }
+                ctx.fillRect(x, this.plotHeight, 1, 4);
+                ctx.fillText(this.labels[slot], x, this.plotHeight + 6);
+            }
+        }
+    }
+
+    StripChart.STATE_NAMES = STATE_NAMES;
+    StripChart.STATE_COLORS = STATE_COLORS;
+
+    if (typeof module !== 'undefined' && module.exports) {
+        module.exports = { StripChart };
+    } else {
+        root.StripChart = StripChart;
+    }
+})(this);
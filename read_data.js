@@ -4,6 +4,14 @@ const path = require('path');
 const express = require('express');
 const http = require('http');
 const socketIo = require('socket.io');
+const { STATE_NAMES, groupDataLog, parseDataLine, parseMessage } = require('./lib/telemetry');
+const { LogStore } = require('./lib/log_store');
+const { KINDS } = require('./lib/log_segments');
+const { HlsRelay } = require('./lib/hls_relay');
+const { AnomalyDetector } = require('./lib/anomaly');
+const { epochUs } = require('./lib/timesync');
+const { Tracer, parseTrace } = require('./lib/trace');
+const { Checkpoint, Watermarks } = require('./lib/checkpoint');
 
 // Define the IP addresses and ports of the ESP32 devices
 const devices = [
@@ -20,18 +28,74 @@ const io = socketIo(server);
 // Path to the CSV file
 const logFilePath = path.join(__dirname, 'cat_data.csv');
 
-// Function to log data to CSV
+// Older lines are compacted into logs/cat_data/ day segments; the chart gets today's
+const dataLog = new LogStore(logFilePath, 'data', { recent: true });
+
+// Function to log data to CSV (clients get it from the follower below, with every other ingest's lines)
 function logDataToFile(logEntry) {
     fs.appendFile(logFilePath, logEntry, (err) => {
         if (err) {
             console.error('Error writing to file', err);
         } else {
             console.log('Data written:', logEntry.trim());
+        }
+    });
+}
 
-            // Emit the new data immediately to connected clients
-            readAndEmitData(); // Emit data after logging it
+// Latency of each status record from the collar's sampling window to the dashboard drawing
+// it, by stage (see lib/trace.js); GET /metrics
+const tracer = new Tracer(['window', 'send', 'network', 'store', 'emit', 'render', 'total']);
+let emitSeq = 0;
+
+// Traces of the lines in a followed batch read at readUs
+function traceLines(lines, readUs) {
+    const traced = [];
+    lines.toString('utf8').split('\n').forEach((line) => {
+        const trace = parseTrace(line);
+        const record = trace ? parseDataLine(line) : null;
+        const ingestMs = record ? Date.parse(record.time) : NaN;
+        if (record && tracer.live(ingestMs)) {
+            traced.push({ originUs: tracer.arrive(trace, record.sourceTimeUs, ingestMs * 1000, readUs), readUs });
         }
     });
+    return traced;
+}
+
+// Streaming anomaly detection: every record in the data log updates the cat's baseline
+// as it arrives
+const detector = new AnomalyDetector();
+detector.on('alert', (alert) => {
+    console.log(`Alert ${alert.raised ? 'raised' : 'cleared'}: ${alert.type} on ${alert.source}`);
+    io.emit('alert', alert);
+});
+
+// Quiet collars are sleeping cats (or gone); close their bins once a minute
+setInterval(() => detector.tick(Date.now()), 60000).unref();
+
+// The baselines are checkpointed into logs/cat_data/checkpoint.bin every minute and on
+// shutdown, with each collar's last record applied; a restart restores them and replays
+// only the lines logged since (see lib/checkpoint.js)
+const checkpoint = new Checkpoint(path.join(dataLog.dir, 'checkpoint.bin'));
+const watermarks = new Watermarks();
+
+// Replays skip the records the checkpoint already holds
+function detect(lines, replay) {
+    lines.toString('utf8').split('\n').forEach((line) => {
+        const record = line.trim() === '' ? null : parseDataLine(line);
+        const ms = record ? Date.parse(record.time) : NaN;
+        if (!record || !record.source || Number.isNaN(ms)) {
+            return;
+        }
+        if (replay) {
+            if (!watermarks.replayed(record.source, ms)) {
+                return;
+            }
+        } else {
+            watermarks.note(record.source, ms);
+        }
+        const t = record.sourceTimeUs === null ? ms : record.sourceTimeUs / 1000;
+        detector.update(record.source, t, STATE_NAMES.indexOf(record.state), record.temperature);
+    });
 }
 
 // Function to connect to an ESP32
@@ -67,45 +131,93 @@ function connectToDevice(device) {
 // Connect to all ESP32 devices
 devices.forEach(device => connectToDevice(device));
 
-// Function to read and emit data from the CSV file
-const readAndEmitData = () => {
-    fs.readFile(logFilePath, 'utf8', (err, data) => {
+// Dashboards get today's records once when they connect ('history', as intervals) and
+// then only the lines the log gains ('data'), grouped by source; they draw them as they arrive.
+// traced are the records in lines, and the dashboard acks the push once it has drawn them
+function emitData(lines, traced) {
+    io.emit('data', groupDataLog(lines));
+
+    const emittedUs = Number(epochUs());
+    traced.forEach(({ readUs }) => tracer.record('emit', emittedUs - readUs));
+    if (traced.length > 0) {
+        emitSeq++;
+        tracer.hold(emitSeq, { emittedUs, traced });
+        io.emit('trace', { seq: emitSeq });
+    }
+}
+
+function sendHistory(socket) {
+    dataLog.recent((err, data) => {
         if (err) {
             console.error('Error reading cat_data.csv:', err);
-            io.emit('data', { error: 'Failed to load data.' });
+            socket.emit('history', { error: 'Failed to load data.' });
             return;
         }
-
-        const lines = data.trim().split('\n');
-        const records = lines.map(line => {
-            const [time, source, state] = line.split(',').map(s => s.trim());
-            return { time, source, state };
-        });
-
-        // Group data by source
-        const groupedData = records.reduce((acc, record) => {
-            if (!acc[record.source]) {
-                acc[record.source] = [];
-            }
-            acc[record.source].push(record);
-            return acc;
-        }, {});
-
-        // Emit the grouped data to connected clients
-        io.emit('data', groupedData);
+        // Runs of one state plus the temperatures, a few bytes where each line took about 80
+        socket.emit('history', { intervals: KINDS.data.intervals(data) });
     });
-};
+}
+
+// Restore the last checkpoint and replay what was logged since, then push every line the
+// data log gains, whoever wrote it (TCP collars above, tools/*_ingest.js)
+const startedMs = Date.now();
+const saved = checkpoint.load();
+const restored = saved !== null && detector.restore(saved.state.detector);
+if (restored) {
+    watermarks.restore(saved.state.watermarks);
+}
+const replayFromMs = restored ? saved.savedMs : startedMs;
+dataLog.replaySince(replayFromMs, lines => detect(lines, true)).then((offset) => {
+    dataLog.follow((lines) => {
+        emitData(lines, traceLines(lines, Number(epochUs())));
+        detect(lines, false);
+    }, offset);
+    checkpoint.start(() => ({ detector: detector.snapshot(), watermarks: watermarks.snapshot() }));
+    console.log(`Anomaly baselines ready in ${Date.now() - startedMs} ms (` +
+        (restored ? `checkpoint from ${new Date(saved.savedMs).toISOString()}, ${detector.cats.size} cats` : 'no checkpoint') + ')');
+}).catch((err) => {
+    console.error('Error loading the anomaly baselines:', err);
+});
 
 // WebSocket connection
 io.on('connection', (socket) => {
     console.log('New client connected to data server');
-    readAndEmitData(); // Emit data immediately when a new client connects
+    sendHistory(socket);
+
+    // The first dashboard to draw a traced push ends its records' traces
+    socket.on('rendered', (seq) => {
+        const push = tracer.take(seq);
+        if (!push) {
+            return;
+        }
+        const renderedUs = Number(epochUs());
+        push.traced.forEach(({ originUs }) => {
+            tracer.record('render', renderedUs - push.emittedUs);
+            tracer.record('total', renderedUs - originUs);
+        });
+    });
 
     socket.on('disconnect', () => {
         console.log('Client disconnected from data server');
     });
 });
 
+app.get('/metrics', (req, res) => {
+    res.json(tracer.metrics());
+});
+
+// Recent alerts, and those still raised by source
+app.get('/alerts', (req, res) => {
+    res.json({ recent: detector.alerts, active: detector.active(), stats: detector.stats(), checkpoint: checkpoint.stats() });
+});
+
+// Camera stream relay: viewers load /hls/stream.m3u8 from here and only the relay talks to the Pi
+const hlsRelay = new HlsRelay(process.env.HLS_ORIGIN || 'http://192.168.1.103:8000/');
+app.use('/hls', hlsRelay.middleware());
+app.get('/hls-stats', (req, res) => {
+    res.json(hlsRelay.stats());
+});
+
 // Serve the public directory for static assets
 app.use(express.static(path.join(__dirname, 'public')));
 
@@ -115,8 +227,10 @@ server.listen(PORT, () => {
     console.log(`Data server running on port ${PORT}`);
 });
 
-// Keep the process alive
-process.on('SIGINT', () => {
-    console.log('Exiting...');
-    process.exit();
+// Checkpoint once more on the way out, so the next start has nothing to replay
+['SIGINT', 'SIGTERM'].forEach((signal) => {
+    process.on(signal, () => {
+        console.log('Exiting...');
+        checkpoint.stop().finally(() => process.exit());
+    });
 });
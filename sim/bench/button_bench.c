@@ -0,0 +1,524 @@
+/*
+  Benchmark for the button debounce and gesture logic (main/button_fsm.c) on
+  the host.
+
+  Drives the FSM the way main/button.c does: each raw edge calls
+  button_fsm_edge() and then button_fsm_update() with the pin level, and
+  whenever button_fsm_next_deadline() expires button_fsm_update() runs again.
+  The pin is pulled up, so pressed is level 0.
+
+  First, fixed scripts with contact bounce check which events come out and
+  when: a short press, a long press with nothing on release, a double click, a
+  glitch shorter than BUTTON_DEBOUNCE_MS, two slow presses and a press across
+  the 32-bit millisecond wraparound.
+
+  Then --gestures random short presses, long presses and double clicks, each
+  edge bouncing up to four times, must give back exactly the gestures that
+  were generated. The calls that stream made are replayed --iterations times
+  and timed per pass of the driver loop, in ns and in cycles of the host's
+  timestamp counter.
+
+    sim/build/button_bench [--gestures 10000] [--iterations 100] [--seed 1]
+*/
+
+#define _GNU_SOURCE
+
+#include <getopt.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_TSC 1
+#else
+#define HAVE_TSC 0
+#endif
+
+#include "button_fsm.h"
+
+#define BUTTON_BENCH_PRESSED 0
+#define BUTTON_BENCH_RELEASED 1
+#define BUTTON_BENCH_MAX_EVENTS 8
+#define BUTTON_BENCH_MAX_BOUNCES 4 // Extra pairs of edges after each clean edge
+#define BUTTON_BENCH_BOUNCE_MS 3   // Longest gap between bounces
+
+typedef struct
+{
+    int gestures;
+    long iterations;
+    unsigned seed;
+} options_t;
+
+static options_t s_opts = {.gestures = 10000, .iterations = 100, .seed = 1};
+
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// Timestamp counter ticks per ns, or 0 without one
+static double s_ticks_per_ns = 0;
+
+static void calibrate(void)
+{
+#if HAVE_TSC
+    double start_ns = now_ns();
+    uint64_t start = __rdtsc();
+    while (now_ns() - start_ns < 100e6)
+    {
+    }
+    s_ticks_per_ns = (double)(__rdtsc() - start) / (now_ns() - start_ns);
+#endif
+}
+
+static void print_cost(const char *label, double ns)
+{
+    if (s_ticks_per_ns > 0)
+    {
+        printf("  %-8s %8.1f ns %8.0f cycles\n", label, ns, ns * s_ticks_per_ns);
+    }
+    else
+    {
+        printf("  %-8s %8.1f ns\n", label, ns);
+    }
+}
+
+static const char *event_name(button_event_t event)
+{
+    switch (event)
+    {
+    case BUTTON_EVENT_SHORT_PRESS:
+        return "short";
+    case BUTTON_EVENT_LONG_PRESS:
+        return "long";
+    case BUTTON_EVENT_DOUBLE_CLICK:
+        return "double";
+    default:
+        return "none";
+    }
+}
+
+// Raw pin stream //////////////////////////////////////////////////////////////
+
+typedef struct
+{
+    uint32_t t_ms;
+    int level;
+} edge_t;
+
+typedef struct
+{
+    edge_t *edges;
+    size_t count;
+    size_t capacity;
+} stream_t;
+
+static void stream_push(stream_t *stream, uint32_t t_ms, int level)
+{
+    if (stream->count == stream->capacity)
+    {
+        stream->capacity = stream->capacity ? stream->capacity * 2 : 64;
+        stream->edges = realloc(stream->edges, stream->capacity * sizeof(edge_t));
+        if (!stream->edges)
+        {
+            perror("realloc");
+            exit(2);
+        }
+    }
+    stream->edges[stream->count].t_ms = t_ms;
+    stream->edges[stream->count].level = level;
+    stream->count++;
+}
+
+// Move the pin to level at t_ms, bouncing back and forth pairs times a gap_ms
+// apart; returns the time of the last edge
+static uint32_t stream_bounce(stream_t *stream, uint32_t t_ms, int level, int pairs, uint32_t gap_ms)
+{
+    stream_push(stream, t_ms, level);
+    for (int i = 0; i < pairs; i++)
+    {
+        t_ms += gap_ms;
+        stream_push(stream, t_ms, !level);
+        t_ms += gap_ms;
+        stream_push(stream, t_ms, level);
+    }
+    return t_ms;
+}
+
+// One call the driver made, kept for the timed replay
+typedef struct
+{
+    uint32_t t_ms;
+    int8_t level;
+    int8_t edge;
+} call_t;
+
+typedef struct
+{
+    call_t *calls;
+    size_t count;
+    size_t capacity;
+} calls_t;
+
+static void calls_push(calls_t *calls, uint32_t t_ms, int level, int edge)
+{
+    if (!calls)
+    {
+        return;
+    }
+    if (calls->count == calls->capacity)
+    {
+        calls->capacity = calls->capacity ? calls->capacity * 2 : 256;
+        calls->calls = realloc(calls->calls, calls->capacity * sizeof(call_t));
+        if (!calls->calls)
+        {
+            perror("realloc");
+            exit(2);
+        }
+    }
+    calls->calls[calls->count].t_ms = t_ms;
+    calls->calls[calls->count].level = (int8_t)level;
+    calls->calls[calls->count].edge = (int8_t)edge;
+    calls->count++;
+}
+
+typedef struct
+{
+    button_event_t event;
+    uint32_t t_ms;
+} seen_t;
+
+typedef void (*on_event_fn)(void *ctx, button_event_t event, uint32_t t_ms);
+
+// Run the stream through the FSM as main/button.c would, until it goes idle
+// after the last edge
+static void drive(const stream_t *stream, uint32_t start_ms, calls_t *calls, on_event_fn on_event, void *ctx)
+{
+    button_fsm_t fsm;
+    int level = BUTTON_BENCH_RELEASED;
+    uint32_t now = start_ms;
+    size_t next = 0;
+    button_fsm_init(&fsm, BUTTON_BENCH_PRESSED, level);
+
+    for (;;)
+    {
+        int32_t wait = button_fsm_next_deadline(&fsm, now);
+        int have_edge = next < stream->count;
+        if (!have_edge && wait < 0)
+        {
+            break;
+        }
+        int take_edge = have_edge && (wait < 0 || (int32_t)(stream->edges[next].t_ms - now) <= wait);
+        if (take_edge)
+        {
+            now = stream->edges[next].t_ms;
+            level = stream->edges[next].level;
+            next++;
+            button_fsm_edge(&fsm, now);
+        }
+        else
+        {
+            now += (uint32_t)wait;
+        }
+        calls_push(calls, now, level, take_edge);
+        button_event_t event = button_fsm_update(&fsm, now, level);
+        if (event != BUTTON_EVENT_NONE)
+        {
+            on_event(ctx, event, now);
+        }
+    }
+}
+
+// Fixed scripts ///////////////////////////////////////////////////////////////
+
+static int s_checked = 0;
+static int s_failed = 0;
+
+typedef struct
+{
+    seen_t seen[BUTTON_BENCH_MAX_EVENTS];
+    int count;
+} script_result_t;
+
+static void record_event(void *ctx, button_event_t event, uint32_t t_ms)
+{
+    script_result_t *result = ctx;
+    if (result->count < BUTTON_BENCH_MAX_EVENTS)
+    {
+        result->seen[result->count].event = event;
+        result->seen[result->count].t_ms = t_ms;
+    }
+    result->count++;
+}
+
+// expected holds {event, time} pairs relative to start_ms, ended by NONE;
+// times must match to the millisecond, since the FSM stamps transitions when
+// the pin settles
+static void check_script(const char *name, const stream_t *stream, uint32_t start_ms, const seen_t *expected)
+{
+    script_result_t result = {0};
+    int expected_count = 0;
+    while (expected[expected_count].event != BUTTON_EVENT_NONE)
+    {
+        expected_count++;
+    }
+    s_checked++;
+    drive(stream, start_ms, NULL, record_event, &result);
+
+    int ok = result.count == expected_count;
+    for (int i = 0; ok && i < expected_count; i++)
+    {
+        ok = result.seen[i].event == expected[i].event && result.seen[i].t_ms - start_ms == expected[i].t_ms;
+    }
+    if (ok)
+    {
+        printf("  %-12s", name);
+        for (int i = 0; i < result.count; i++)
+        {
+            printf(" %s at %" PRIu32 " ms", event_name(result.seen[i].event), result.seen[i].t_ms - start_ms);
+        }
+        printf("%s\n", result.count ? "" : " nothing");
+        return;
+    }
+
+    s_failed++;
+    printf("  FAIL: %s gave", name);
+    for (int i = 0; i < result.count && i < BUTTON_BENCH_MAX_EVENTS; i++)
+    {
+        printf(" %s at %" PRIu32, event_name(result.seen[i].event), result.seen[i].t_ms - start_ms);
+    }
+    printf("%s, expected", result.count ? "" : " nothing");
+    for (int i = 0; i < expected_count; i++)
+    {
+        printf(" %s at %" PRIu32, event_name(expected[i].event), expected[i].t_ms);
+    }
+    printf("%s\n", expected_count ? "" : " nothing");
+}
+
+#define SCRIPT(name, start_ms, build, ...)                                                           \
+    do                                                                                               \
+    {                                                                                                \
+        stream_t stream = {0};                                                                       \
+        uint32_t base = (start_ms);                                                                  \
+        build;                                                                                       \
+        const seen_t expected[] = {__VA_ARGS__};                                                     \
+        check_script(name, &stream, base, expected);                                                 \
+        free(stream.edges);                                                                          \
+    } while (0)
+
+#define PRESS(t, pairs) stream_bounce(&stream, base + (t), BUTTON_BENCH_PRESSED, pairs, 2)
+#define RELEASE(t, pairs) stream_bounce(&stream, base + (t), BUTTON_BENCH_RELEASED, pairs, 2)
+#define AT(event, t) {BUTTON_EVENT_##event, t}
+#define END AT(NONE, 0)
+
+static void check_scripts(void)
+{
+    const uint32_t settle = BUTTON_DEBOUNCE_MS;
+    const uint32_t window = BUTTON_DOUBLE_CLICK_MS;
+    const uint32_t hold = BUTTON_LONG_PRESS_MS;
+
+    printf("Scripts (times from the first edge, ms):\n");
+
+    // Released at 150, settled at 150 + 30; short once the double click window closes
+    SCRIPT("short", 0, (PRESS(0, 0), RELEASE(150, 0)), AT(SHORT_PRESS, 150 + settle + window), END);
+
+    // Three bounce pairs 2 ms apart on each edge push the settle time out by 12 ms
+    SCRIPT("bouncy", 0, (PRESS(0, 3), RELEASE(150, 3)), AT(SHORT_PRESS, 150 + 12 + settle + window), END);
+
+    // Long press fires while held, 800 ms after the press settles; the release is silent
+    SCRIPT("long", 0, (PRESS(0, 2), RELEASE(1200, 2)), AT(LONG_PRESS, 8 + settle + hold), END);
+
+    // Second press 200 ms after the first release settles; double click on its release
+    SCRIPT("double", 0, (PRESS(0, 1), RELEASE(100, 2), PRESS(100 + 8 + 200, 1), RELEASE(450, 1)),
+           AT(DOUBLE_CLICK, 450 + 4 + settle), END);
+
+    // Down for 5 ms with the pin quiet well before the debounce time; the level never changes
+    SCRIPT("glitch", 0, (PRESS(0, 0), RELEASE(5, 0)), END);
+
+    // Second press after the window has closed is a press of its own
+    SCRIPT("two slow", 0, (PRESS(0, 0), RELEASE(100, 0), PRESS(100 + settle + window + 50, 0), RELEASE(600, 0)),
+           AT(SHORT_PRESS, 100 + settle + window), AT(SHORT_PRESS, 600 + settle + window), END);
+
+    // Pressed 100 ms before millis() wraps, released after it
+    SCRIPT("wraparound", UINT32_MAX - 99, (PRESS(0, 1), RELEASE(200, 1)),
+           AT(SHORT_PRESS, 200 + 4 + settle + window), END);
+
+    printf("\n");
+}
+
+// Random gestures /////////////////////////////////////////////////////////////
+
+static uint32_t s_rng;
+
+static uint32_t rng_next(void)
+{
+    // xorshift32
+    s_rng ^= s_rng << 13;
+    s_rng ^= s_rng >> 17;
+    s_rng ^= s_rng << 5;
+    return s_rng;
+}
+
+static uint32_t rng_range(uint32_t lo, uint32_t hi)
+{
+    return lo + rng_next() % (hi - lo + 1);
+}
+
+static uint32_t random_bounce(stream_t *stream, uint32_t t_ms, int level)
+{
+    return stream_bounce(stream, t_ms, level, (int)rng_range(0, BUTTON_BENCH_MAX_BOUNCES),
+                         rng_range(1, BUTTON_BENCH_BOUNCE_MS));
+}
+
+// Build a stream of random gestures; kinds[] gets the event each should give.
+// Holds and gaps keep clear of the thresholds by more than the bounce can
+// move them (BUTTON_BENCH_MAX_BOUNCES * 2 * BUTTON_BENCH_BOUNCE_MS = 24 ms).
+static void build_gestures(stream_t *stream, button_event_t *kinds, int count, uint32_t start_ms)
+{
+    uint32_t t = start_ms;
+    for (int i = 0; i < count; i++)
+    {
+        button_event_t kind = (button_event_t)rng_range(BUTTON_EVENT_SHORT_PRESS, BUTTON_EVENT_DOUBLE_CLICK);
+        kinds[i] = kind;
+        uint32_t last = random_bounce(stream, t, BUTTON_BENCH_PRESSED);
+        switch (kind)
+        {
+        case BUTTON_EVENT_SHORT_PRESS:
+            last = random_bounce(stream, last + rng_range(BUTTON_DEBOUNCE_MS + 10, BUTTON_LONG_PRESS_MS - 100),
+                                 BUTTON_BENCH_RELEASED);
+            break;
+        case BUTTON_EVENT_LONG_PRESS:
+            last = random_bounce(stream, last + rng_range(BUTTON_LONG_PRESS_MS + 100, 3000), BUTTON_BENCH_RELEASED);
+            break;
+        default:
+            last = random_bounce(stream, last + rng_range(BUTTON_DEBOUNCE_MS + 10, 200), BUTTON_BENCH_RELEASED);
+            last = random_bounce(stream, last + rng_range(BUTTON_DEBOUNCE_MS + 10, BUTTON_DOUBLE_CLICK_MS - 60),
+                                 BUTTON_BENCH_PRESSED);
+            last = random_bounce(stream, last + rng_range(BUTTON_DEBOUNCE_MS + 10, 200), BUTTON_BENCH_RELEASED);
+            break;
+        }
+        // Quiet until the short press timer has fired
+        t = last + rng_range(BUTTON_DEBOUNCE_MS + BUTTON_DOUBLE_CLICK_MS + 100, 2000);
+    }
+}
+
+typedef struct
+{
+    const button_event_t *kinds;
+    int count;
+    int next;
+    int mismatched;
+} gesture_result_t;
+
+static void match_event(void *ctx, button_event_t event, uint32_t t_ms)
+{
+    gesture_result_t *result = ctx;
+    if (result->next < result->count && result->kinds[result->next] != event && result->mismatched++ < 5)
+    {
+        printf("  FAIL: gesture %d gave %s at %" PRIu32 ", expected %s\n", result->next, event_name(event), t_ms,
+               event_name(result->kinds[result->next]));
+    }
+    result->next++;
+}
+
+static void run_gestures(void)
+{
+    stream_t stream = {0};
+    calls_t calls = {0};
+    button_event_t *kinds = malloc((size_t)s_opts.gestures * sizeof(button_event_t));
+    if (!kinds)
+    {
+        perror("malloc");
+        exit(2);
+    }
+
+    s_rng = s_opts.seed ? s_opts.seed : 1;
+    // Start just short of the wraparound so the stream crosses it
+    uint32_t start_ms = UINT32_MAX - 60000;
+    build_gestures(&stream, kinds, s_opts.gestures, start_ms);
+
+    gesture_result_t result = {.kinds = kinds, .count = s_opts.gestures};
+    drive(&stream, start_ms, &calls, match_event, &result);
+    s_checked++;
+    if (result.next != result.count || result.mismatched)
+    {
+        s_failed++;
+        printf("  FAIL: %d events for %d gestures, %d wrong\n", result.next, result.count, result.mismatched);
+    }
+    printf("Gestures: %d events for %d random gestures, %d wrong (%zu raw edges)\n\n", result.next, result.count,
+           result.mismatched, stream.count);
+
+    // Replay the recorded calls; each is one pass of the driver loop
+    volatile int sink = 0;
+    double start = now_ns();
+    for (long it = 0; it < s_opts.iterations; it++)
+    {
+        button_fsm_t fsm;
+        button_fsm_init(&fsm, BUTTON_BENCH_PRESSED, BUTTON_BENCH_RELEASED);
+        for (size_t i = 0; i < calls.count; i++)
+        {
+            const call_t *call = &calls.calls[i];
+            if (call->edge)
+            {
+                button_fsm_edge(&fsm, call->t_ms);
+            }
+            sink += button_fsm_update(&fsm, call->t_ms, call->level);
+            sink += button_fsm_next_deadline(&fsm, call->t_ms);
+        }
+    }
+    double elapsed = now_ns() - start;
+    double passes = (double)calls.count * (double)s_opts.iterations;
+    printf("Driver loop, %zu passes x %ld (edge if any, update, next deadline):\n", calls.count, s_opts.iterations);
+    print_cost("pass", elapsed / passes);
+    print_cost("gesture", elapsed / ((double)s_opts.gestures * (double)s_opts.iterations));
+    (void)sink;
+
+    free(kinds);
+    free(stream.edges);
+    free(calls.calls);
+}
+
+int main(int argc, char **argv)
+{
+    static const struct option long_options[] = {
+        {"gestures", required_argument, NULL, 'g'},
+        {"iterations", required_argument, NULL, 'i'},
+        {"seed", required_argument, NULL, 's'},
+        {NULL, 0, NULL, 0},
+    };
+    int opt;
+    while ((opt = getopt_long(argc, argv, "", long_options, NULL)) != -1)
+    {
+        switch (opt)
+        {
+        case 'g':
+            s_opts.gestures = atoi(optarg);
+            break;
+        case 'i':
+            s_opts.iterations = atol(optarg);
+            break;
+        case 's':
+            s_opts.seed = (unsigned)strtoul(optarg, NULL, 0);
+            break;
+        default:
+            fprintf(stderr, "usage: %s [--gestures N] [--iterations N] [--seed N]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (s_opts.gestures < 1 || s_opts.iterations < 1)
+    {
+        fprintf(stderr, "--gestures and --iterations must be at least 1\n");
+        return 2;
+    }
+
+    calibrate();
+    check_scripts();
+    run_gestures();
+    printf("\n%d of %d checks passed\n", s_checked - s_failed, s_checked);
+    return s_failed == 0 ? 0 : 1;
+}
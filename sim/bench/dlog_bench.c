@@ -0,0 +1,364 @@
+/*
+  Benchmark for deferred logging (main/dlog_ring.c) on the host.
+
+  Checks first that records format back to exactly what snprintf writes from
+  the same format and arguments, and that records cut short end in "...".
+
+  Then times the hot-path messages of CatCollar.c three ways:
+    deferred    DLOG_RING_WRITE into a ring, which is all a DLOGI call does
+                besides reading the tick count and the core ID
+    drain       formatting that record later, as the drain task does
+    sync        formatting the console line on the spot and writing it out,
+                as ESP_LOGI does, plus the time the line takes on a UART at
+                --baud, which ESP_LOGI waits for once the UART FIFO is full
+  Costs are per call, in ns and in cycles of the host's timestamp counter.
+
+  Last, --threads writers share one ring while a reader drains it, and every
+  record read back is checked against what its writer wrote. Each record is
+  either read back intact and in order or counted as dropped.
+
+    sim/build/dlog_bench [--iterations 1000000] [--threads 4] [--baud 115200]
+*/
+
+#define _GNU_SOURCE
+
+#include <getopt.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_TSC 1
+#else
+#define HAVE_TSC 0
+#endif
+
+#include "dlog_ring.h"
+
+#define DLOG_BENCH_LINE 160
+#define DLOG_BENCH_BURST 8         // Records a writer thread logs between yields
+#define DLOG_BENCH_THREAD_SHARE 20 // Each writer thread logs --iterations / this
+
+typedef struct
+{
+    long iterations;
+    int threads;
+    int baud;
+} options_t;
+
+static options_t s_opts = {.iterations = 1000000, .threads = 4, .baud = 115200};
+
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// Timestamp counter ticks per ns, or 0 without one
+static double s_ticks_per_ns = 0;
+
+static void calibrate(void)
+{
+#if HAVE_TSC
+    double start_ns = now_ns();
+    uint64_t start = __rdtsc();
+    while (now_ns() - start_ns < 100e6)
+    {
+    }
+    s_ticks_per_ns = (double)(__rdtsc() - start) / (now_ns() - start_ns);
+#endif
+}
+
+static void print_cost(const char *label, double ns)
+{
+    if (s_ticks_per_ns > 0)
+    {
+        printf("  %-8s %8.1f ns %8.0f cycles\n", label, ns, ns * s_ticks_per_ns);
+    }
+    else
+    {
+        printf("  %-8s %8.1f ns\n", label, ns);
+    }
+}
+
+// Formatting //////////////////////////////////////////////////////////////////
+
+static int s_checked = 0;
+static int s_failed = 0;
+
+static void check_record(dlog_ring_t *ring, const char *expected, int expected_len)
+{
+    dlog_record_t record;
+    char text[DLOG_BENCH_LINE];
+    s_checked++;
+    if (!dlog_ring_read(ring, &record))
+    {
+        printf("  FAIL: no record for \"%s\"\n", expected);
+        s_failed++;
+        return;
+    }
+    int len = dlog_ring_format(&record, text, sizeof(text));
+    if (!record.truncated)
+    {
+        if (len != expected_len || strcmp(text, expected) != 0)
+        {
+            printf("  FAIL: \"%s\" (%d), expected \"%s\" (%d)\n", text, len, expected, expected_len);
+            s_failed++;
+        }
+        return;
+    }
+    // Cut short: what is there must start the full text, followed by "..."
+    size_t kept = strlen(text) - 3;
+    if (strlen(text) < 3 || strcmp(text + kept, "...") != 0 || strncmp(text, expected, kept) != 0)
+    {
+        printf("  FAIL: \"%s\" does not cut short \"%s\"\n", text, expected);
+        s_failed++;
+    }
+}
+
+#define CHECK(fmt, ...)                                                                              \
+    do                                                                                               \
+    {                                                                                                \
+        static const dlog_site_t site = {fmt, "bench", 'I'};                                         \
+        char expected[DLOG_BENCH_LINE];                                                              \
+        int expected_len = snprintf(expected, sizeof(expected), fmt, ##__VA_ARGS__);                  \
+        DLOG_RING_WRITE(&ring, &site, 0, ##__VA_ARGS__);                                             \
+        check_record(&ring, expected, expected_len);                                                 \
+    } while (0)
+
+static void check_formats(void)
+{
+    static dlog_ring_t ring;
+    const char *leader = "cat-12";
+    char rx_buffer[128] = "cat-3";
+    int64_t epoch_us = 1729500000123456;
+    uint32_t trace = 0xdeadbeef;
+    size_t len = 42;
+    float temperature = 81.625f;
+
+    CHECK("Buzzing on");
+    CHECK("100%% done");
+    CHECK("Leader has changed from %s to %s", leader, "cat-7");
+    CHECK("Received message: %s", rx_buffer);
+    CHECK("Failed to send status: errno %d", 105);
+    CHECK("I2C device found at address: 0x%X", 0x53);
+    CHECK("Temperature: %.2f F, %5.1f%%, %e", temperature, 99.5, 1e-3);
+    CHECK("Time: %lld, Trace: %08" PRIx32, (long long)epoch_us, trace);
+    CHECK("%" PRId64 " us", epoch_us);
+    CHECK("%zu bytes, %ld, %lu, %u, %hhd, %c", len, -7L, 7UL, 4000000000U, (signed char)-3, 'x');
+    CHECK("[%-8s|%8s|%.3s|%*d|%-*.*f]", "ab", "cd", "truncate", 6, 42, 9, 2, 3.14159);
+    CHECK("%p %s", (void *)&ring, (const char *)NULL);
+    CHECK("%d %d %d %d %d %d %d %d", 1, 2, 3, 4, 5, 6, 7, 8);
+    // Too long for one record: cut short
+    CHECK("Received message: %s", "a-leader-id-much-longer-than-the-forty-odd-bytes-a-record-has");
+    CHECK("%s then %d", "a-leader-id-much-longer-than-the-forty-odd-bytes-a-record-has", 5);
+    CHECK("%lld %lld %lld %lld %lld %lld %lld", 1LL, 2LL, 3LL, 4LL, 5LL, 6LL, 7LL);
+
+    printf("Formatting: %d of %d records match snprintf\n\n", s_checked - s_failed, s_checked);
+}
+
+// Cost per call ///////////////////////////////////////////////////////////////
+
+static FILE *s_console;
+
+// One ESP_LOGI-style line formatted and written out on the spot; returns its length
+#define SYNC_LINE(site, ...)                                                                         \
+    ({                                                                                               \
+        char line_[DLOG_BENCH_LINE];                                                                 \
+        int n_ = snprintf(line_, sizeof(line_), "%c (%u) %s: ", (site)->level, 1234u, (site)->tag);  \
+        n_ += snprintf(line_ + n_, sizeof(line_) - n_, (site)->fmt, ##__VA_ARGS__);                  \
+        fputs(line_, s_console);                                                                     \
+        fputc('\n', s_console);                                                                      \
+        fflush(s_console);                                                                           \
+        n_ + 1;                                                                                      \
+    })
+
+#define TIME_CASE(title, site, ...)                                                                  \
+    do                                                                                               \
+    {                                                                                                \
+        static dlog_ring_t ring;                                                                     \
+        double write_ns = 0, format_ns = 0;                                                          \
+        long calls = 0;                                                                              \
+        char text[DLOG_BENCH_LINE];                                                                  \
+        volatile uint32_t tick = 0; /* The tick count is a plain load on the target */               \
+        while (calls < s_opts.iterations)                                                            \
+        {                                                                                            \
+            double t0 = now_ns();                                                                    \
+            for (int i = 0; i < DLOG_RING_RECORDS; i++)                                              \
+            {                                                                                        \
+                DLOG_RING_WRITE(&ring, (site), tick, ##__VA_ARGS__);                                 \
+            }                                                                                        \
+            double t1 = now_ns();                                                                    \
+            dlog_record_t record;                                                                    \
+            while (dlog_ring_read(&ring, &record))                                                   \
+            {                                                                                        \
+                dlog_ring_format(&record, text, sizeof(text));                                       \
+            }                                                                                        \
+            double t2 = now_ns();                                                                    \
+            write_ns += t1 - t0;                                                                     \
+            format_ns += t2 - t1;                                                                    \
+            calls += DLOG_RING_RECORDS;                                                              \
+        }                                                                                            \
+        long sync_calls = s_opts.iterations / 10;                                                    \
+        int line_len = 0;                                                                            \
+        double t3 = now_ns();                                                                        \
+        for (long i = 0; i < sync_calls; i++)                                                        \
+        {                                                                                            \
+            line_len = SYNC_LINE((site), ##__VA_ARGS__);                                             \
+        }                                                                                            \
+        double sync_ns = (now_ns() - t3) / sync_calls;                                               \
+        printf("%s\n", title);                                                                       \
+        print_cost("deferred", write_ns / calls - s_clock_ns / DLOG_RING_RECORDS);                  \
+        print_cost("drain", format_ns / calls);                                                      \
+        print_cost("sync", sync_ns);                                                                 \
+        printf("  %-8s %8.1f us for %d characters at %d baud\n\n", "+ UART", line_len * 10e6 / s_opts.baud, \
+               line_len, s_opts.baud);                                                               \
+    } while (0)
+
+static double s_clock_ns = 0; // now_ns() called back to back
+
+static void time_calls(void)
+{
+    double t0 = now_ns();
+    for (int i = 0; i < 100000; i++)
+    {
+        now_ns();
+    }
+    s_clock_ns = (now_ns() - t0) / 100000;
+
+    static const dlog_site_t leader = {"Leader has changed from %s to %s", "buzz", 'I'};
+    static const dlog_site_t message = {"Received message: %s", "net", 'I'};
+    static const dlog_site_t send_error = {"Failed to send status: errno %d", "net", 'E'};
+    static const dlog_site_t found = {"I2C device found at address: 0x%X", "app", 'I'};
+    static const dlog_site_t reading = {"Temperature %.2f F, state %d, window %lld us", "app", 'I'};
+
+    TIME_CASE("Leader change, two strings", &leader, "cat-12", "cat-7");
+    TIME_CASE("Leader notification, one string", &message, "cat-3");
+    TIME_CASE("Send error, one int", &send_error, 105);
+    TIME_CASE("I2C scan, one int", &found, 0x53);
+    TIME_CASE("Reading, double, int and long long", &reading, 81.62, 1, (long long)2000123);
+}
+
+// Writers sharing a ring //////////////////////////////////////////////////////
+
+static dlog_ring_t s_shared;
+static const dlog_site_t s_thread_site = {"writer %d record %ld", "bench", 'I'};
+static volatile int s_writers_done = 0;
+
+static void *writer(void *arg)
+{
+    int id = (int)(intptr_t)arg;
+    for (long i = 0; i < s_opts.iterations / DLOG_BENCH_THREAD_SHARE; i++)
+    {
+        DLOG_RING_WRITE(&s_shared, &s_thread_site, 0, id, i);
+        if (i % DLOG_BENCH_BURST == DLOG_BENCH_BURST - 1)
+        {
+            sched_yield(); // Tasks log in bursts, not nonstop
+        }
+    }
+    __atomic_add_fetch(&s_writers_done, 1, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+static void run_threads(void)
+{
+    pthread_t threads[64];
+    int count = s_opts.threads < 64 ? s_opts.threads : 64;
+    long *last = calloc(count, sizeof(long));
+    for (int i = 0; i < count; i++)
+    {
+        last[i] = -1;
+    }
+
+    double t0 = now_ns();
+    for (int i = 0; i < count; i++)
+    {
+        pthread_create(&threads[i], NULL, writer, (void *)(intptr_t)i);
+    }
+    long read = 0, dropped = 0, bad = 0;
+    char text[DLOG_BENCH_LINE];
+    for (;;)
+    {
+        int done = __atomic_load_n(&s_writers_done, __ATOMIC_ACQUIRE) == count;
+        dlog_record_t record;
+        while (dlog_ring_read(&s_shared, &record))
+        {
+            int id;
+            long seq;
+            dlog_ring_format(&record, text, sizeof(text));
+            if (sscanf(text, "writer %d record %ld", &id, &seq) != 2 || id < 0 || id >= count || seq <= last[id])
+            {
+                bad++;
+                continue;
+            }
+            last[id] = seq;
+            read++;
+        }
+        dropped += dlog_ring_take_dropped(&s_shared);
+        if (done)
+        {
+            break;
+        }
+    }
+    double seconds = (now_ns() - t0) / 1e9;
+    for (int i = 0; i < count; i++)
+    {
+        pthread_join(threads[i], NULL);
+    }
+    free(last);
+
+    long written = (long)count * (s_opts.iterations / DLOG_BENCH_THREAD_SHARE);
+    printf("%d writers sharing one ring in bursts of %d, one reader: %ld records in %.2f s\n", count,
+           DLOG_BENCH_BURST, written, seconds);
+    printf("  %ld read in order, %ld dropped while the ring was full (%.1f%%), %ld corrupt; %s\n", read, dropped,
+           100.0 * dropped / written, bad, (read + dropped == written && bad == 0) ? "all accounted for" : "LOST");
+    if (read + dropped != written || bad != 0)
+    {
+        s_failed++;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    static const struct option long_options[] = {
+        {"iterations", required_argument, NULL, 'i'},
+        {"threads", required_argument, NULL, 't'},
+        {"baud", required_argument, NULL, 'b'},
+        {NULL, 0, NULL, 0},
+    };
+    int opt;
+    while ((opt = getopt_long(argc, argv, "", long_options, NULL)) != -1)
+    {
+        switch (opt)
+        {
+        case 'i':
+            s_opts.iterations = atol(optarg);
+            break;
+        case 't':
+            s_opts.threads = atoi(optarg);
+            break;
+        case 'b':
+            s_opts.baud = atoi(optarg);
+            break;
+        default:
+            fprintf(stderr, "usage: %s [--iterations N] [--threads N] [--baud N]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    s_console = fopen("/dev/null", "w");
+    calibrate();
+    printf("%d-byte records, %d per ring, %zu bytes of arguments each\n\n", DLOG_RECORD_SIZE, DLOG_RING_RECORDS,
+           (size_t)DLOG_ARG_BYTES);
+    check_formats();
+    time_calls();
+    run_threads();
+    fclose(s_console);
+    return s_failed == 0 ? 0 : 1;
+}
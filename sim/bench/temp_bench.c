@@ -0,0 +1,445 @@
+/*
+  Benchmark for the temperature math (main/temperature_filter.c) on the host.
+
+  Builds ADC traces the way main/temperature.c reads them: a true temperature
+  goes through the divider to millivolts and raw 12-bit counts, each of the
+  16 oversampled reads gets Gaussian noise of --noise-lsb, and --spike-rate
+  of the samples get a Wi-Fi TX dip of SPIKE_MV on every read, with at least
+  two clean samples between dips. The average is
+  rounded, converted back with the uncalibrated 3100 mV scale and run through
+  temp_thermistor_mv_to_f() and temp_filter_push() (median of 3, EWMA,
+  decimation).
+
+  Checks:
+    curve      the Beta curve gives 77 F at the divider midpoint, inverts back
+               to the temperature that made each voltage, and is NaN when the
+               sensor is open or shorted
+    spikes     single spikes on a clean trace never reach the output, and NaN
+               samples are skipped
+    settled    after SETTLE_SAMPLES, every output of a noisy, spiky trace is
+               within SETTLED_BOUND_F of the true temperature
+    step       a 70 -> 100 F step reaches 63% and 90% within a sample of what
+               the median's one-sample delay and TEMP_FILTER_ALPHA predict,
+               with no overshoot beyond the noise
+    decimation one output per --window samples, each equal to the EWMA at
+               that sample
+  Then times temp_thermistor_mv_to_f() and temp_filter_push() per sample, in
+  ns and in cycles of the host's timestamp counter.
+
+    sim/build/temp_bench [--samples 1000000] [--noise-lsb 8] [--spike-rate 0.02] [--window 4] [--seed 1]
+*/
+
+#define _GNU_SOURCE
+
+#include <getopt.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_TSC 1
+#else
+#define HAVE_TSC 0
+#endif
+
+#include "temperature_filter.h"
+
+#define TEMP_BENCH_OVERSAMPLE 16 // As TEMP_OVERSAMPLE in temperature.c
+#define TEMP_BENCH_FULL_SCALE_MV 3100
+#define TEMP_BENCH_MAX_RAW 4095
+#define SPIKE_MV 80.0           // Supply dip while the radio transmits, about 4 F at 100 F
+#define SETTLE_SAMPLES 30       // 0.8^30 leaves 0.1% of the starting error
+#define SETTLED_BOUND_F 0.3f
+#define SETTLED_TRACE_SAMPLES 2000
+
+typedef struct
+{
+    long samples;
+    double noise_lsb;
+    double spike_rate;
+    uint32_t window;
+    unsigned seed;
+} options_t;
+
+static options_t s_opts = {.samples = 1000000, .noise_lsb = 8, .spike_rate = 0.02, .window = 4, .seed = 1};
+
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// Timestamp counter ticks per ns, or 0 without one
+static double s_ticks_per_ns = 0;
+
+static void calibrate(void)
+{
+#if HAVE_TSC
+    double start_ns = now_ns();
+    uint64_t start = __rdtsc();
+    while (now_ns() - start_ns < 100e6)
+    {
+    }
+    s_ticks_per_ns = (double)(__rdtsc() - start) / (now_ns() - start_ns);
+#endif
+}
+
+static void print_cost(const char *label, double ns)
+{
+    if (s_ticks_per_ns > 0)
+    {
+        printf("  %-8s %8.1f ns %8.0f cycles\n", label, ns, ns * s_ticks_per_ns);
+    }
+    else
+    {
+        printf("  %-8s %8.1f ns\n", label, ns);
+    }
+}
+
+// ADC traces //////////////////////////////////////////////////////////////////
+
+static uint32_t s_rng;
+
+static uint32_t rng_next(void)
+{
+    // xorshift32
+    s_rng ^= s_rng << 13;
+    s_rng ^= s_rng >> 17;
+    s_rng ^= s_rng << 5;
+    return s_rng;
+}
+
+static double rng_uniform(void)
+{
+    return (rng_next() + 0.5) / 4294967296.0;
+}
+
+static double rng_gauss(void)
+{
+    // Box-Muller; one of the pair is enough here
+    return sqrt(-2.0 * log(rng_uniform())) * cos(2.0 * M_PI * rng_uniform());
+}
+
+// Divider voltage for a true temperature, the inverse of temp_thermistor_mv_to_f()
+static double f_to_mv(double f)
+{
+    double kelvin = (f - 32.0) * 5.0 / 9.0 + 273.15;
+    double ohms = THERMISTOR_NOMINAL_OHMS * exp(THERMISTOR_BETA * (1.0 / kelvin - 1.0 / THERMISTOR_NOMINAL_K));
+    return THERMISTOR_SUPPLY_MV * ohms / (THERMISTOR_SERIES_OHMS + ohms);
+}
+
+// Samples since the last spike. The collar transmits once per classification
+// window, so spikes have at least two clean samples between them, which is
+// what a median of 3 can reject; closer spikes would reach the EWMA.
+static int s_since_spike = 2;
+
+// One temperature.c sample of a true temperature: millivolts as read back
+static float adc_sample(double f, double noise_lsb, double spike_rate)
+{
+    double mv = f_to_mv(f);
+    if (s_since_spike >= 2 && spike_rate > 0 && rng_uniform() < spike_rate)
+    {
+        mv -= SPIKE_MV;
+        s_since_spike = 0;
+    }
+    else
+    {
+        s_since_spike++;
+    }
+    double ideal = mv * TEMP_BENCH_MAX_RAW / TEMP_BENCH_FULL_SCALE_MV;
+    int sum = 0;
+    for (int i = 0; i < TEMP_BENCH_OVERSAMPLE; i++)
+    {
+        long raw = lround(ideal + noise_lsb * rng_gauss());
+        raw = raw < 0 ? 0 : (raw > TEMP_BENCH_MAX_RAW ? TEMP_BENCH_MAX_RAW : raw);
+        sum += (int)raw;
+    }
+    int raw_avg = (sum + TEMP_BENCH_OVERSAMPLE / 2) / TEMP_BENCH_OVERSAMPLE;
+    return (float)(raw_avg * TEMP_BENCH_FULL_SCALE_MV / TEMP_BENCH_MAX_RAW);
+}
+
+// Checks //////////////////////////////////////////////////////////////////////
+
+static int s_checked = 0;
+static int s_failed = 0;
+
+static void check(int ok, const char *what)
+{
+    s_checked++;
+    if (!ok)
+    {
+        s_failed++;
+        printf("  FAIL: %s\n", what);
+    }
+}
+
+static void check_curve(void)
+{
+    printf("Curve:\n");
+    float mid = temp_thermistor_mv_to_f(THERMISTOR_SUPPLY_MV / 2);
+    printf("  %.0f mV -> %.3f F\n", THERMISTOR_SUPPLY_MV / 2, mid);
+    check(fabsf(mid - 77.0f) < 0.01f, "divider midpoint is not 77 F");
+
+    double worst = 0;
+    for (double f = 20.0; f <= 120.0; f += 0.5)
+    {
+        float back = temp_thermistor_mv_to_f((float)f_to_mv(f));
+        worst = fmax(worst, fabs(back - f));
+    }
+    printf("  20-120 F round trip, worst %.4f F\n", worst);
+    check(worst < 0.01, "Beta curve does not invert its divider voltage");
+
+    // Hotter is less resistance and less voltage
+    int rising = 1;
+    float prev = -INFINITY;
+    for (float mv = 100.0f; mv < THERMISTOR_SUPPLY_MV - 100.0f; mv += 1.0f)
+    {
+        float f = temp_thermistor_mv_to_f(mv);
+        rising &= f < prev || prev == -INFINITY;
+        prev = f;
+    }
+    check(rising, "temperature does not fall as the divider voltage rises");
+    check(isnan(temp_thermistor_mv_to_f(0.0f)) && isnan(temp_thermistor_mv_to_f(THERMISTOR_SUPPLY_MV)) &&
+              isnan(temp_thermistor_mv_to_f(-5.0f)),
+          "open or shorted sensor is not NaN");
+    printf("\n");
+}
+
+static void check_spikes(void)
+{
+    printf("Spikes:\n");
+    temp_filter_t filter;
+    temp_filter_init(&filter, TEMP_FILTER_ALPHA, 1);
+    float clean = temp_thermistor_mv_to_f((float)f_to_mv(100.0));
+    float spike = temp_thermistor_mv_to_f((float)(f_to_mv(100.0) - SPIKE_MV));
+    float out = 0;
+    float worst = 0;
+    for (int i = 0; i < 100; i++)
+    {
+        // Every third sample spikes; the median of any three has one spike at most
+        float sample = (i >= 3 && i % 3 == 0) ? spike : clean;
+        if (temp_filter_push(&filter, sample, &out))
+        {
+            worst = fmaxf(worst, fabsf(out - clean));
+        }
+    }
+    printf("  %.2f F spikes on a clean %.2f F trace, output off by at most %.4f F\n", spike - clean, clean, worst);
+    check(worst == 0.0f, "a single-sample spike reached the output");
+
+    temp_filter_t before = filter;
+    check(!temp_filter_push(&filter, NAN, &out) && memcmp(&before, &filter, sizeof(filter)) == 0,
+          "a NaN sample changed the filter");
+    printf("\n");
+}
+
+static void check_settled(void)
+{
+    printf("Settled, %d samples, %.0f LSB noise, %.0f%% spikes of %.0f mV:\n", SETTLED_TRACE_SAMPLES,
+           s_opts.noise_lsb, s_opts.spike_rate * 100, SPIKE_MV);
+    static const double temps[] = {40.0, 77.0, 101.5, 104.0};
+    for (size_t t = 0; t < sizeof(temps) / sizeof(temps[0]); t++)
+    {
+        temp_filter_t filter;
+        temp_filter_init(&filter, TEMP_FILTER_ALPHA, 1);
+        float out = 0;
+        double worst = 0;
+        double raw_worst = 0;
+        for (int i = 0; i < SETTLED_TRACE_SAMPLES; i++)
+        {
+            float sample = temp_thermistor_mv_to_f(adc_sample(temps[t], s_opts.noise_lsb, s_opts.spike_rate));
+            if (temp_filter_push(&filter, sample, &out) && i >= SETTLE_SAMPLES)
+            {
+                worst = fmax(worst, fabs(out - temps[t]));
+                raw_worst = fmax(raw_worst, fabs(sample - temps[t]));
+            }
+        }
+        printf("  %6.1f F: samples off by up to %5.2f F, output by up to %.3f F\n", temps[t], raw_worst, worst);
+        check(worst <= SETTLED_BOUND_F, "settled output is out of bounds");
+    }
+    printf("\n");
+}
+
+// Samples after the step until the output has covered fraction of it: one for
+// the median, which needs two new samples out of three, then the EWMA's
+static int predicted_samples(double fraction)
+{
+    return 1 + (int)ceil(log(1.0 - fraction) / log(1.0 - TEMP_FILTER_ALPHA));
+}
+
+static void check_step(void)
+{
+    const double from = 70.0, to = 100.0;
+    const int before = 100;
+    printf("Step, %.0f -> %.0f F:\n", from, to);
+    temp_filter_t filter;
+    temp_filter_init(&filter, TEMP_FILTER_ALPHA, 1);
+    int reached63 = -1, reached90 = -1;
+    double peak = 0;
+    float out = 0;
+    for (int i = 0; i < before + 200; i++)
+    {
+        double truth = i < before ? from : to;
+        float sample = temp_thermistor_mv_to_f(adc_sample(truth, s_opts.noise_lsb, s_opts.spike_rate));
+        if (!temp_filter_push(&filter, sample, &out) || i < before)
+        {
+            continue;
+        }
+        double covered = (out - from) / (to - from);
+        int n = i - before + 1;
+        if (reached63 < 0 && covered >= 0.63)
+        {
+            reached63 = n;
+        }
+        if (reached90 < 0 && covered >= 0.90)
+        {
+            reached90 = n;
+        }
+        peak = fmax(peak, out);
+    }
+    int want63 = predicted_samples(0.63), want90 = predicted_samples(0.90);
+    printf("  63%% after %d samples (%d predicted), 90%% after %d (%d predicted), peak %.2f F\n", reached63, want63,
+           reached90, want90, peak);
+    check(reached63 >= want63 - 1 && reached63 <= want63 + 1, "step reached 63% outside a sample of the prediction");
+    check(reached90 >= want90 - 1 && reached90 <= want90 + 1, "step reached 90% outside a sample of the prediction");
+    check(peak <= to + SETTLED_BOUND_F, "step overshoots");
+    printf("\n");
+}
+
+static void check_decimation(void)
+{
+    printf("Decimation, one output per %u samples:\n", s_opts.window);
+    temp_filter_t every, decimated;
+    temp_filter_init(&every, TEMP_FILTER_ALPHA, 1);
+    temp_filter_init(&decimated, TEMP_FILTER_ALPHA, s_opts.window);
+    int outputs = 0, matched = 0;
+    const int samples = 1000;
+    for (int i = 0; i < samples; i++)
+    {
+        float sample = temp_thermistor_mv_to_f(adc_sample(90.0, s_opts.noise_lsb, s_opts.spike_rate));
+        float ewma = 0, out = 0;
+        temp_filter_push(&every, sample, &ewma);
+        if (temp_filter_push(&decimated, sample, &out))
+        {
+            outputs++;
+            matched += (i + 1) % s_opts.window == 0 && out == ewma;
+        }
+    }
+    printf("  %d outputs for %d samples, %d at the right sample with the right value\n", outputs, samples, matched);
+    check(outputs == samples / (int)s_opts.window && matched == outputs, "decimation is off");
+    printf("\n");
+}
+
+// Timing //////////////////////////////////////////////////////////////////////
+
+static void time_samples(void)
+{
+    float *mv = malloc((size_t)s_opts.samples * sizeof(float));
+    if (!mv)
+    {
+        perror("malloc");
+        exit(2);
+    }
+    for (long i = 0; i < s_opts.samples; i++)
+    {
+        // A slow drift so the median's branches are not all taken the same way
+        mv[i] = adc_sample(95.0 + 5.0 * sin(i * 1e-3), s_opts.noise_lsb, s_opts.spike_rate);
+    }
+
+    temp_filter_t filter;
+    temp_filter_init(&filter, TEMP_FILTER_ALPHA, s_opts.window);
+    volatile float sink = 0;
+    float out;
+
+    double start = now_ns();
+    for (long i = 0; i < s_opts.samples; i++)
+    {
+        sink += temp_thermistor_mv_to_f(mv[i]);
+    }
+    double curve_ns = (now_ns() - start) / s_opts.samples;
+
+    float *f = malloc((size_t)s_opts.samples * sizeof(float));
+    if (!f)
+    {
+        perror("malloc");
+        exit(2);
+    }
+    for (long i = 0; i < s_opts.samples; i++)
+    {
+        f[i] = temp_thermistor_mv_to_f(mv[i]);
+    }
+    start = now_ns();
+    for (long i = 0; i < s_opts.samples; i++)
+    {
+        if (temp_filter_push(&filter, f[i], &out))
+        {
+            sink += out;
+        }
+    }
+    double filter_ns = (now_ns() - start) / s_opts.samples;
+
+    printf("Per sample, %ld samples:\n", s_opts.samples);
+    print_cost("curve", curve_ns);
+    print_cost("filter", filter_ns);
+    print_cost("both", curve_ns + filter_ns);
+    (void)sink;
+    free(mv);
+    free(f);
+}
+
+int main(int argc, char **argv)
+{
+    static const struct option long_options[] = {
+        {"samples", required_argument, NULL, 'n'},
+        {"noise-lsb", required_argument, NULL, 'l'},
+        {"spike-rate", required_argument, NULL, 'r'},
+        {"window", required_argument, NULL, 'w'},
+        {"seed", required_argument, NULL, 's'},
+        {NULL, 0, NULL, 0},
+    };
+    int opt;
+    while ((opt = getopt_long(argc, argv, "", long_options, NULL)) != -1)
+    {
+        switch (opt)
+        {
+        case 'n':
+            s_opts.samples = atol(optarg);
+            break;
+        case 'l':
+            s_opts.noise_lsb = atof(optarg);
+            break;
+        case 'r':
+            s_opts.spike_rate = atof(optarg);
+            break;
+        case 'w':
+            s_opts.window = (uint32_t)atoi(optarg);
+            break;
+        case 's':
+            s_opts.seed = (unsigned)strtoul(optarg, NULL, 0);
+            break;
+        default:
+            fprintf(stderr, "usage: %s [--samples N] [--noise-lsb N] [--spike-rate P] [--window N] [--seed N]\n",
+                    argv[0]);
+            return 2;
+        }
+    }
+    if (s_opts.samples < 1 || s_opts.window < 1)
+    {
+        fprintf(stderr, "--samples and --window must be at least 1\n");
+        return 2;
+    }
+    s_rng = s_opts.seed ? s_opts.seed : 1;
+
+    calibrate();
+    check_curve();
+    check_spikes();
+    check_settled();
+    check_step();
+    check_decimation();
+    time_samples();
+    printf("\n%d of %d checks passed\n", s_checked - s_failed, s_checked);
+    return s_failed == 0 ? 0 : 1;
+}
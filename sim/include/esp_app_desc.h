@@ -0,0 +1,26 @@
+/*
+  Host simulator: application description. The version comes from the
+  SIM_FW_VERSION CMake cache variable, so two builds can play old and new
+  firmware in an OTA rollout.
+*/
+
+#ifndef SIM_ESP_APP_DESC_H
+#define SIM_ESP_APP_DESC_H
+
+#include <stdint.h>
+
+typedef struct
+{
+    uint32_t magic_word;
+    uint32_t secure_version;
+    char version[32];
+    char project_name[32];
+    char time[16];
+    char date[16];
+    char idf_ver[32];
+    uint8_t app_elf_sha256[32];
+} esp_app_desc_t;
+
+const esp_app_desc_t *esp_app_get_description(void);
+
+#endif // SIM_ESP_APP_DESC_H
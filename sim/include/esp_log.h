@@ -0,0 +1,17 @@
+#ifndef SIM_ESP_LOG_H
+#define SIM_ESP_LOG_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+// Same line format as the IDF console: "I (1234) tag: message"
+uint32_t esp_log_timestamp(void);
+void esp_log_write_line(char level, const char *tag, const char *format, ...) __attribute__((format(printf, 3, 4)));
+
+#define ESP_LOGE(tag, format, ...) esp_log_write_line('E', tag, format, ##__VA_ARGS__)
+#define ESP_LOGW(tag, format, ...) esp_log_write_line('W', tag, format, ##__VA_ARGS__)
+#define ESP_LOGI(tag, format, ...) esp_log_write_line('I', tag, format, ##__VA_ARGS__)
+#define ESP_LOGD(tag, format, ...) ((void)0)
+#define ESP_LOGV(tag, format, ...) ((void)0)
+
+#endif // SIM_ESP_LOG_H
@@ -0,0 +1,10 @@
+#ifndef SIM_ESP_RANDOM_H
+#define SIM_ESP_RANDOM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+uint32_t esp_random(void);
+void esp_fill_random(void *buf, size_t len);
+
+#endif // SIM_ESP_RANDOM_H
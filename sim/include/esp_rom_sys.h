@@ -0,0 +1,7 @@
+#ifndef SIM_ESP_ROM_SYS_H
+#define SIM_ESP_ROM_SYS_H
+
+// The ROM printf, safe where the heap is off limits; unbuffered to stderr here
+int esp_rom_printf(const char *fmt, ...) __attribute__((format(printf, 1, 2)));
+
+#endif // SIM_ESP_ROM_SYS_H
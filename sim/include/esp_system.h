@@ -0,0 +1,14 @@
+#ifndef SIM_ESP_SYSTEM_H
+#define SIM_ESP_SYSTEM_H
+
+#include "esp_err.h"
+
+typedef void (*shutdown_handler_t)(void);
+
+// Run before esp_restart() restarts, and before the simulator exits
+esp_err_t esp_register_shutdown_handler(shutdown_handler_t handler);
+
+// Re-executes the simulator with the same arguments; NVS survives, RAM does not
+void esp_restart(void) __attribute__((noreturn));
+
+#endif // SIM_ESP_SYSTEM_H
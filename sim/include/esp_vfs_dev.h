@@ -0,0 +1,7 @@
+#ifndef SIM_ESP_VFS_DEV_H
+#define SIM_ESP_VFS_DEV_H
+
+// stdio already goes to the host terminal
+void esp_vfs_dev_uart_use_driver(int uart_num);
+
+#endif // SIM_ESP_VFS_DEV_H
@@ -0,0 +1,27 @@
+/*
+  Host simulator: the eventfd VFS is the host's own eventfd, so there is
+  nothing to register.
+*/
+
+#ifndef SIM_ESP_VFS_EVENTFD_H
+#define SIM_ESP_VFS_EVENTFD_H
+
+#include <stddef.h>
+#include <sys/eventfd.h>
+
+#include "esp_err.h"
+
+typedef struct
+{
+    size_t max_fds;
+} esp_vfs_eventfd_config_t;
+
+#define ESP_VFS_EVENTD_CONFIG_DEFAULT() {.max_fds = 5}
+
+static inline esp_err_t esp_vfs_eventfd_register(const esp_vfs_eventfd_config_t *config)
+{
+    (void)config;
+    return ESP_OK;
+}
+
+#endif // SIM_ESP_VFS_EVENTFD_H
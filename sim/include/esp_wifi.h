@@ -0,0 +1,114 @@
+/*
+  Host simulator: the station "associates" immediately and reports 127.0.0.1
+  (or never, with --no-ap); real traffic goes through the host's sockets (see
+  lwip/sockets.h). The channel only matters to ESP-NOW (esp_now.h).
+*/
+
+#ifndef SIM_ESP_WIFI_H
+#define SIM_ESP_WIFI_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "esp_event.h"
+#include "esp_netif.h"
+
+typedef struct
+{
+    int magic;
+} wifi_init_config_t;
+
+#define WIFI_INIT_CONFIG_DEFAULT() {0}
+
+typedef enum
+{
+    WIFI_MODE_NULL,
+    WIFI_MODE_STA,
+    WIFI_MODE_AP,
+    WIFI_MODE_APSTA,
+} wifi_mode_t;
+
+typedef enum
+{
+    WIFI_IF_STA,
+    WIFI_IF_AP,
+} wifi_interface_t;
+
+typedef enum
+{
+    WIFI_AUTH_OPEN,
+    WIFI_AUTH_WEP,
+    WIFI_AUTH_WPA_PSK,
+    WIFI_AUTH_WPA2_PSK,
+} wifi_auth_mode_t;
+
+typedef enum
+{
+    WIFI_SECOND_CHAN_NONE,
+    WIFI_SECOND_CHAN_ABOVE,
+    WIFI_SECOND_CHAN_BELOW,
+} wifi_second_chan_t;
+
+typedef struct
+{
+    signed rssi : 8;
+    unsigned channel : 4;
+} wifi_pkt_rx_ctrl_t;
+
+typedef enum
+{
+    WIFI_PS_NONE,
+    WIFI_PS_MIN_MODEM,
+    WIFI_PS_MAX_MODEM,
+} wifi_ps_type_t;
+
+typedef struct
+{
+    uint8_t ssid[32];
+    uint8_t password[64];
+    struct
+    {
+        wifi_auth_mode_t authmode;
+    } threshold;
+} wifi_sta_config_t;
+
+typedef union
+{
+    wifi_sta_config_t sta;
+} wifi_config_t;
+
+ESP_EVENT_DECLARE_BASE(WIFI_EVENT);
+ESP_EVENT_DECLARE_BASE(IP_EVENT);
+
+typedef enum
+{
+    WIFI_EVENT_STA_START = 2,
+    WIFI_EVENT_STA_STOP = 3,
+    WIFI_EVENT_STA_CONNECTED = 4,
+    WIFI_EVENT_STA_DISCONNECTED = 5,
+} wifi_event_t;
+
+typedef enum
+{
+    IP_EVENT_STA_GOT_IP = 0,
+    IP_EVENT_STA_LOST_IP = 1,
+} ip_event_t;
+
+typedef struct
+{
+    esp_netif_t *esp_netif;
+    esp_netif_ip_info_t ip_info;
+    bool ip_changed;
+} ip_event_got_ip_t;
+
+esp_err_t esp_wifi_init(const wifi_init_config_t *config);
+esp_err_t esp_wifi_set_mode(wifi_mode_t mode);
+esp_err_t esp_wifi_set_config(wifi_interface_t interface, wifi_config_t *config);
+esp_err_t esp_wifi_start(void);
+esp_err_t esp_wifi_connect(void);
+esp_err_t esp_wifi_set_ps(wifi_ps_type_t type);
+esp_err_t esp_wifi_set_channel(uint8_t primary, wifi_second_chan_t second);
+esp_err_t esp_wifi_get_channel(uint8_t *primary, wifi_second_chan_t *second);
+
+#endif // SIM_ESP_WIFI_H
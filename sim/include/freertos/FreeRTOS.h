@@ -0,0 +1,87 @@
+/*
+  Host simulator: the subset of the FreeRTOS API used by main/, implemented over
+  pthreads in sim/src/freertos_sim.c. Types and constants follow the ESP-IDF port
+  (sdkconfig has CONFIG_FREERTOS_HZ=100).
+*/
+
+#ifndef SIM_FREERTOS_H
+#define SIM_FREERTOS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef uint32_t TickType_t;
+typedef long BaseType_t;
+typedef unsigned long UBaseType_t;
+typedef uint32_t StackType_t;
+
+#define configTICK_RATE_HZ 100
+#define configMAX_PRIORITIES 25
+#define configMINIMAL_STACK_SIZE 768
+#define configMAX_TASK_NAME_LEN 16
+#define portNUM_PROCESSORS 2
+
+#define portTICK_PERIOD_MS (1000 / configTICK_RATE_HZ)
+#define portMAX_DELAY ((TickType_t)0xffffffffUL)
+#define pdMS_TO_TICKS(ms) ((TickType_t)(((uint64_t)(ms) * configTICK_RATE_HZ) / 1000U))
+#define pdTICKS_TO_MS(t) ((TickType_t)((uint64_t)(t) * 1000U / configTICK_RATE_HZ))
+
+#define pdTRUE 1
+#define pdFALSE 0
+#define pdPASS 1
+#define pdFAIL 0
+#define errQUEUE_FULL 0
+#define errQUEUE_EMPTY 0
+
+#define tskNO_AFFINITY 0x7FFFFFFF
+
+#define BIT0 0x01
+#define BIT1 0x02
+#define BIT2 0x04
+#define BIT3 0x08
+#define BIT4 0x10
+#define BIT5 0x20
+#define BIT6 0x40
+#define BIT7 0x80
+
+// Critical sections are one process-wide recursive lock; the mux argument only documents intent
+typedef struct
+{
+    int owner;
+} portMUX_TYPE;
+
+#define portMUX_INITIALIZER_UNLOCKED {0}
+
+void vPortEnterCritical(portMUX_TYPE *mux);
+void vPortExitCritical(portMUX_TYPE *mux);
+
+#define portENTER_CRITICAL(m) vPortEnterCritical(m)
+#define portEXIT_CRITICAL(m) vPortExitCritical(m)
+#define portENTER_CRITICAL_ISR(m) vPortEnterCritical(m)
+#define portEXIT_CRITICAL_ISR(m) vPortExitCritical(m)
+#define portYIELD_FROM_ISR(x) ((void)(x))
+
+// Static allocation buffers: the simulator allocates internally and ignores their contents
+typedef struct
+{
+    void *p[24];
+} StaticTask_t;
+
+typedef struct
+{
+    void *p[20];
+} StaticQueue_t;
+
+typedef StaticQueue_t StaticSemaphore_t;
+
+typedef struct
+{
+    void *p[8];
+} StaticEventGroup_t;
+
+BaseType_t xPortGetCoreID(void);
+
+#include "freertos/semphr.h"
+
+#endif // SIM_FREERTOS_H
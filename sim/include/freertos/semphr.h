@@ -0,0 +1,23 @@
+#ifndef SIM_FREERTOS_SEMPHR_H
+#define SIM_FREERTOS_SEMPHR_H
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+
+// As in FreeRTOS, semaphores are queues of zero-sized items
+typedef struct QueueDefinition *SemaphoreHandle_t; // Same type as QueueHandle_t
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void);
+SemaphoreHandle_t xSemaphoreCreateMutexStatic(StaticSemaphore_t *buf);
+SemaphoreHandle_t xSemaphoreCreateBinary(void);
+SemaphoreHandle_t xSemaphoreCreateBinaryStatic(StaticSemaphore_t *buf);
+SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t max, UBaseType_t initial);
+
+#define xSemaphoreTake(s, ticks) xQueueReceive((s), NULL, (ticks))
+#define xSemaphoreGive(s) xQueueSend((s), NULL, 0)
+#define xSemaphoreGiveFromISR(s, woken) xQueueSendFromISR((s), NULL, (woken))
+#define xSemaphoreTakeFromISR(s, woken) xQueueReceiveFromISR((s), NULL, (woken))
+#define uxSemaphoreGetCount(s) uxQueueMessagesWaiting(s)
+#define vSemaphoreDelete(s) vQueueDelete(s)
+
+#endif // SIM_FREERTOS_SEMPHR_H
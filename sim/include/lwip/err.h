@@ -0,0 +1,3 @@
+#ifndef SIM_LWIP_ERR_H
+#define SIM_LWIP_ERR_H
+#endif // SIM_LWIP_ERR_H
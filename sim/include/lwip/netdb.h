@@ -0,0 +1,6 @@
+#ifndef SIM_LWIP_NETDB_H
+#define SIM_LWIP_NETDB_H
+
+#include <netdb.h>
+
+#endif // SIM_LWIP_NETDB_H
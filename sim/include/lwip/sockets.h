@@ -0,0 +1,27 @@
+/*
+  Host simulator: lwIP's BSD socket API maps onto the host's. bind() and the
+  datagram calls are routed through sim/src/net_sim.c so that many simulated
+  collars can share one machine (listeners are moved by --udp-bind-offset and
+  share their port) and traffic is counted for the exit report.
+*/
+
+#ifndef SIM_LWIP_SOCKETS_H
+#define SIM_LWIP_SOCKETS_H
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+int sim_lwip_bind(int fd, const struct sockaddr *addr, socklen_t len);
+ssize_t sim_lwip_sendto(int fd, const void *buf, size_t len, int flags, const struct sockaddr *to, socklen_t to_len);
+ssize_t sim_lwip_recvfrom(int fd, void *buf, size_t len, int flags, struct sockaddr *from, socklen_t *from_len);
+
+#define bind sim_lwip_bind
+#define sendto sim_lwip_sendto
+#define recvfrom sim_lwip_recvfrom
+
+#endif // SIM_LWIP_SOCKETS_H
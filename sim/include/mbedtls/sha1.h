@@ -0,0 +1,13 @@
+/*
+  Host simulator: the mbedtls SHA-1 call used by the firmware (the WebSocket
+  handshake's accept key), implemented in sim/src/sha1_sim.c.
+*/
+
+#ifndef SIM_MBEDTLS_SHA1_H
+#define SIM_MBEDTLS_SHA1_H
+
+#include <stddef.h>
+
+int mbedtls_sha1(const unsigned char *input, size_t ilen, unsigned char output[20]);
+
+#endif // SIM_MBEDTLS_SHA1_H
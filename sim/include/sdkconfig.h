@@ -0,0 +1,13 @@
+/*
+  Host simulator: the sdkconfig options main/ reads directly. The heap hooks are
+  always on, fed by the malloc wrappers in sim/src/heap_sim.c.
+*/
+
+#ifndef SIM_SDKCONFIG_H
+#define SIM_SDKCONFIG_H
+
+#define CONFIG_FREERTOS_HZ 100
+#define CONFIG_FREERTOS_SUPPORT_STATIC_ALLOCATION 1
+#define CONFIG_HEAP_USE_HOOKS 1
+
+#endif // SIM_SDKCONFIG_H
@@ -0,0 +1,795 @@
+/*
+  Discrete-time simulator for the ESP-NOW relay (main/relay_mesh.c).
+
+  Runs the firmware's own leaf and gateway state machines and wire format for
+  hundreds of collars in one process, much faster than real time, and reports
+  delivery, latency, aggregation, duplicates and how fast a new leader reaches
+  the leaves. Nothing else of the firmware is involved; to run the relay task
+  itself, use catcollar_sim --relay.
+
+  The model, in 10 ms ticks:
+    - Gateways stand still; leaves wander (random waypoints at walking pace,
+      with long pauses) and take a status sample every --status-s on average.
+    - RSSI is log-distance path loss with per-frame Gaussian fading. A frame is
+      heard above RELAY_SIM_SENSITIVITY_DBM unless another frame overlaps it at
+      that receiver within RELAY_SIM_CAPTURE_DB, or the receiver is sending.
+    - Each frame starts at a random point in its tick and lasts its 1 Mbit/s
+      airtime. A sender that hears an earlier frame still on the air waits for
+      it to end (carrier sense).
+    - A batch that arrives is acked, except that --ack-loss of the acks are
+      lost, so the leaf sends the same batch again.
+    - Gateways always have their uplink; datagrams reach the server after
+      --uplink-ms. The server drops repeated (cat, batch seq) pairs as
+      tools/relay_ingest.js does.
+    - Every --leader-s the server names a new leader and tells every gateway.
+
+  Each record carries its sample number in duration_s so the server side can
+  tell which ones arrived, and how often.
+
+    sim/build/relay_sim --collars 300 --gateways 20 --duration 600
+*/
+
+#define _GNU_SOURCE
+
+#include <getopt.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "relay_frame.h"
+#include "relay_mesh.h"
+
+#define RELAY_SIM_TICK_MS 10
+#define RELAY_SIM_TX_DBM 20
+#define RELAY_SIM_PL_1M_DB 40     // Path loss at 1 m
+#define RELAY_SIM_PL_EXPONENT 3.0 // Outdoors with some clutter
+#define RELAY_SIM_FADING_DB 4.0   // Standard deviation per frame
+#define RELAY_SIM_SENSITIVITY_DBM -90
+#define RELAY_SIM_CCA_DBM -82 // Carrier sense threshold
+#define RELAY_SIM_CAPTURE_DB 6
+#define RELAY_SIM_FRAME_OVERHEAD 43 // MAC header, vendor action header, FCS
+#define RELAY_SIM_PREAMBLE_US 192
+#define RELAY_SIM_DRAIN_MS 15000 // Run on after the last sample so queues empty
+#define RELAY_SIM_SEQ_MEMORY 16  // Batch seqs the server remembers per cat
+
+typedef struct
+{
+    int collars;
+    int gateways;
+    int duration_s;
+    int area_m;
+    double status_s;
+    double ack_loss;
+    int uplink_ms;
+    int leader_s;
+    uint32_t seed;
+} options_t;
+
+static options_t s_opt = {
+    .collars = 300,
+    .gateways = 20,
+    .duration_s = 600,
+    .area_m = 600,
+    .status_s = 20,
+    .ack_loss = 0.01,
+    .uplink_ms = 5,
+    .leader_s = 60,
+    .seed = 1,
+};
+
+// Random numbers //////////////////////////////////////////////////////////////
+
+static uint32_t s_rng;
+
+// mulberry32, as in the Node benches, so runs with the same seed match
+static double rnd(void)
+{
+    uint32_t t = (s_rng += 0x6D2B79F5u);
+    t = (t ^ (t >> 15)) * (t | 1u);
+    t ^= t + (t ^ (t >> 7)) * (t | 61u);
+    return (double)(t ^ (t >> 14)) / 4294967296.0;
+}
+
+static double gaussian(void)
+{
+    double u = rnd();
+    double v = rnd();
+    return sqrt(-2.0 * log(u > 0 ? u : 1e-12)) * cos(2 * M_PI * v);
+}
+
+static double exponential(double mean)
+{
+    return -mean * log(1.0 - rnd());
+}
+
+// Collars /////////////////////////////////////////////////////////////////////
+
+typedef struct
+{
+    uint32_t sample; // Sample number, carried in duration_s
+    int64_t t_ms;
+    uint16_t arrivals;
+} sample_t;
+
+typedef struct
+{
+    double x, y;
+    double to_x, to_y; // Waypoint
+    double speed;      // m/s, 0 while resting
+    int64_t rest_until_ms;
+    int64_t next_sample_ms;
+
+    uint8_t mac[RELAY_MAC_LEN];
+    bool is_gateway;
+    relay_leaf_t leaf;
+    relay_gateway_t gateway;
+
+    sample_t *samples;
+    int sample_count;
+    int sample_cap;
+
+    uint16_t server_seqs[RELAY_SIM_SEQ_MEMORY];
+    int server_seq_count;
+    bool knows_leader;
+} collar_t;
+
+static collar_t *s_collars;
+
+static void collar_mac(int index, uint8_t mac[RELAY_MAC_LEN])
+{
+    const uint8_t base[RELAY_MAC_LEN] = {0x02, 0x52, 0x53, 0x00, (uint8_t)(index >> 8), (uint8_t)index};
+    memcpy(mac, base, RELAY_MAC_LEN);
+}
+
+static int collar_by_mac(const uint8_t mac[RELAY_MAC_LEN])
+{
+    return (mac[4] << 8) | mac[5];
+}
+
+static void pick_waypoint(collar_t *c)
+{
+    c->to_x = rnd() * s_opt.area_m;
+    c->to_y = rnd() * s_opt.area_m;
+    c->speed = 0.3 + rnd() * 1.2;
+}
+
+static void move(collar_t *c, int64_t now_ms)
+{
+    if (c->is_gateway || now_ms < c->rest_until_ms)
+    {
+        return;
+    }
+    if (c->speed == 0)
+    {
+        pick_waypoint(c);
+    }
+    double dx = c->to_x - c->x;
+    double dy = c->to_y - c->y;
+    double dist = sqrt(dx * dx + dy * dy);
+    double step = c->speed * RELAY_SIM_TICK_MS / 1000.0;
+    if (dist <= step)
+    {
+        c->x = c->to_x;
+        c->y = c->to_y;
+        c->speed = 0;
+        c->rest_until_ms = now_ms + (int64_t)exponential(120000); // Cats mostly sit
+        return;
+    }
+    c->x += dx / dist * step;
+    c->y += dy / dist * step;
+}
+
+static void take_sample(collar_t *c, int64_t now_ms)
+{
+    if (c->sample_count == c->sample_cap)
+    {
+        c->sample_cap = c->sample_cap ? 2 * c->sample_cap : 64;
+        c->samples = realloc(c->samples, (size_t)c->sample_cap * sizeof(*c->samples));
+        if (c->samples == NULL)
+        {
+            perror("relay_sim");
+            exit(1);
+        }
+    }
+    sample_t *s = &c->samples[c->sample_count];
+    s->sample = (uint32_t)c->sample_count;
+    s->t_ms = now_ms;
+    s->arrivals = 0;
+    c->sample_count++;
+
+    relay_record_t record = {
+        .state = (uint8_t)(rnd() * 3),
+        .flags = RELAY_RECORD_TEMP,
+        .temp_centi_f = (int16_t)(8000 + rnd() * 300),
+        .duration_s = s->sample,
+    };
+    relay_leaf_queue(&c->leaf, &record, now_ms);
+}
+
+// Radio ///////////////////////////////////////////////////////////////////////
+
+typedef struct
+{
+    int src;
+    int dst; // -1 for broadcast
+    uint8_t data[RELAY_FRAME_MAX];
+    size_t len;
+    double start_us; // Within the tick
+    double end_us;
+} frame_t;
+
+#define RELAY_SIM_MAX_FRAMES 4096
+
+static frame_t s_frames[RELAY_SIM_MAX_FRAMES];
+static int s_frame_count;
+
+typedef struct
+{
+    uint64_t beacons;
+    uint64_t beacons_heard;
+    uint64_t batch_sends;
+    uint64_t batch_lost; // Not heard by the gateway: out of range or collided
+    uint64_t collisions; // Frames lost to another frame at a receiver that would have heard them
+    uint64_t acks_lost;
+    uint64_t deferrals;
+    uint64_t air_us;
+} radio_stats_t;
+
+static radio_stats_t s_radio;
+
+static double rssi_at(const collar_t *from, const collar_t *to)
+{
+    double dx = from->x - to->x;
+    double dy = from->y - to->y;
+    double d = sqrt(dx * dx + dy * dy);
+    d = d < 1 ? 1 : d;
+    return RELAY_SIM_TX_DBM - RELAY_SIM_PL_1M_DB - 10 * RELAY_SIM_PL_EXPONENT * log10(d);
+}
+
+static double airtime_us(size_t len)
+{
+    return RELAY_SIM_PREAMBLE_US + (double)(len + RELAY_SIM_FRAME_OVERHEAD) * 8;
+}
+
+static int by_start(const void *a, const void *b)
+{
+    double d = ((const frame_t *)a)->start_us - ((const frame_t *)b)->start_us;
+    return d < 0 ? -1 : d > 0;
+}
+
+// Place this tick's frames in time, letting later senders defer to frames they hear
+static void schedule_frames(void)
+{
+    for (int i = 0; i < s_frame_count; i++)
+    {
+        s_frames[i].start_us = rnd() * RELAY_SIM_TICK_MS * 1000;
+    }
+    qsort(s_frames, (size_t)s_frame_count, sizeof(s_frames[0]), by_start);
+    for (int i = 0; i < s_frame_count; i++)
+    {
+        frame_t *f = &s_frames[i];
+        for (int j = 0; j < i; j++)
+        {
+            const frame_t *g = &s_frames[j];
+            if (g->end_us > f->start_us && rssi_at(&s_collars[g->src], &s_collars[f->src]) >= RELAY_SIM_CCA_DBM)
+            {
+                f->start_us = g->end_us;
+                s_radio.deferrals++;
+            }
+        }
+        f->end_us = f->start_us + airtime_us(f->len);
+        s_radio.air_us += (uint64_t)airtime_us(f->len);
+    }
+}
+
+// Whether receiver rx hears frame i; rssi_out gets the level with this frame's fading
+static bool hears(int i, int rx, int *rssi_out)
+{
+    const frame_t *f = &s_frames[i];
+    double rssi = rssi_at(&s_collars[f->src], &s_collars[rx]) + gaussian() * RELAY_SIM_FADING_DB;
+    *rssi_out = (int)lround(rssi);
+    if (rssi < RELAY_SIM_SENSITIVITY_DBM)
+    {
+        return false;
+    }
+    for (int j = 0; j < s_frame_count; j++)
+    {
+        const frame_t *g = &s_frames[j];
+        if (j == i || g->end_us <= f->start_us || g->start_us >= f->end_us)
+        {
+            continue;
+        }
+        if (g->src == rx || rssi_at(&s_collars[g->src], &s_collars[rx]) > rssi - RELAY_SIM_CAPTURE_DB)
+        {
+            s_radio.collisions++;
+            return false;
+        }
+    }
+    return true;
+}
+
+// Server //////////////////////////////////////////////////////////////////////
+
+typedef struct
+{
+    uint64_t uplinks;
+    uint64_t uplink_bytes;
+    uint64_t sections;
+    uint64_t records;
+    uint64_t repeated_batches; // Dropped by the server's (cat, seq) check
+    uint64_t duplicate_records; // Arrived again after all
+    int64_t max_age_error_ms;
+} server_stats_t;
+
+static server_stats_t s_server;
+static int64_t *s_latencies;
+static size_t s_latency_count;
+static size_t s_latency_cap;
+
+static void add_latency(int64_t ms)
+{
+    if (s_latency_count == s_latency_cap)
+    {
+        s_latency_cap = s_latency_cap ? 2 * s_latency_cap : 4096;
+        s_latencies = realloc(s_latencies, s_latency_cap * sizeof(*s_latencies));
+        if (s_latencies == NULL)
+        {
+            perror("relay_sim");
+            exit(1);
+        }
+    }
+    s_latencies[s_latency_count++] = ms;
+}
+
+static uint16_t get_u16(const uint8_t *p)
+{
+    return (uint16_t)(p[0] | p[1] << 8);
+}
+
+static uint64_t get_u64(const uint8_t *p)
+{
+    uint64_t v = 0;
+    for (int i = 7; i >= 0; i--)
+    {
+        v = v << 8 | p[i];
+    }
+    return v;
+}
+
+static bool server_seen(collar_t *c, uint16_t seq)
+{
+    for (int i = 0; i < c->server_seq_count && i < RELAY_SIM_SEQ_MEMORY; i++)
+    {
+        if (c->server_seqs[i] == seq)
+        {
+            return true;
+        }
+    }
+    c->server_seqs[c->server_seq_count++ % RELAY_SIM_SEQ_MEMORY] = seq;
+    return false;
+}
+
+// One UPLINK datagram arriving at arrive_ms; the gateway's clock is the sim's clock
+static void server_receive(const uint8_t *data, size_t len, int64_t arrive_ms)
+{
+    s_server.uplinks++;
+    s_server.uplink_bytes += len;
+    uint64_t epoch_ms = get_u64(data + 4 + RELAY_CAT_ID_LEN);
+    int sections = data[RELAY_UPLINK_HEADER - 1];
+    size_t off = RELAY_UPLINK_HEADER;
+    for (int s = 0; s < sections && off + RELAY_SECTION_HEADER <= len; s++)
+    {
+        const uint8_t *section = data + off;
+        char cat_id[RELAY_CAT_ID_LEN + 1] = {0};
+        memcpy(cat_id, section, RELAY_CAT_ID_LEN);
+        uint16_t seq = get_u16(section + RELAY_CAT_ID_LEN + 2);
+        int count = section[RELAY_CAT_ID_LEN + 4];
+        off += RELAY_SECTION_HEADER + (size_t)count * RELAY_RECORD_SIZE;
+        s_server.sections++;
+
+        collar_t *c = &s_collars[atoi(cat_id) - 1];
+        if (server_seen(c, seq))
+        {
+            s_server.repeated_batches++;
+            continue;
+        }
+        for (int r = 0; r < count; r++)
+        {
+            relay_record_t record;
+            relay_frame_get_record(section + RELAY_SECTION_HEADER + r * RELAY_RECORD_SIZE, &record);
+            sample_t *sample = &c->samples[record.duration_s];
+            if (sample->arrivals++ > 0)
+            {
+                s_server.duplicate_records++;
+                continue;
+            }
+            s_server.records++;
+            add_latency(arrive_ms - sample->t_ms);
+            int64_t error = llabs((int64_t)epoch_ms - (int64_t)record.age_ms - sample->t_ms);
+            s_server.max_age_error_ms = error > s_server.max_age_error_ms ? error : s_server.max_age_error_ms;
+        }
+    }
+}
+
+// Uplinks in flight to the server, in send order (all take --uplink-ms)
+typedef struct
+{
+    uint8_t data[RELAY_UPLINK_MAX];
+    size_t len;
+    int64_t arrive_ms;
+} uplink_t;
+
+#define RELAY_SIM_MAX_UPLINKS 1024
+
+static uplink_t s_uplinks[RELAY_SIM_MAX_UPLINKS];
+static int s_uplink_head;
+static int s_uplink_count;
+
+static void deliver_uplinks(int64_t now_ms)
+{
+    while (s_uplink_count > 0 && s_uplinks[s_uplink_head].arrive_ms <= now_ms)
+    {
+        const uplink_t *u = &s_uplinks[s_uplink_head];
+        server_receive(u->data, u->len, u->arrive_ms);
+        s_uplink_head = (s_uplink_head + 1) % RELAY_SIM_MAX_UPLINKS;
+        s_uplink_count--;
+    }
+}
+
+// Leader //////////////////////////////////////////////////////////////////////
+
+static char s_leader[RELAY_CAT_ID_LEN + 1];
+static int64_t s_leader_since_ms;
+static int s_leader_changes;
+static int64_t *s_leader_latencies;
+static size_t s_leader_latency_count;
+static uint64_t s_leader_missed; // Leaves that had not heard a leader by the next change
+
+static void name_leader(int64_t now_ms)
+{
+    for (int i = 0; i < s_opt.collars; i++)
+    {
+        if (!s_collars[i].is_gateway && !s_collars[i].knows_leader && s_leader_changes > 0)
+        {
+            s_leader_missed++;
+        }
+        s_collars[i].knows_leader = false;
+    }
+    snprintf(s_leader, sizeof(s_leader), "%u", 1 + (unsigned)(rnd() * s_opt.collars) % 65535);
+    s_leader_since_ms = now_ms;
+    s_leader_changes++;
+    for (int i = 0; i < s_opt.collars; i++)
+    {
+        if (s_collars[i].is_gateway)
+        {
+            relay_gateway_set_leader(&s_collars[i].gateway, s_leader, now_ms);
+        }
+    }
+}
+
+// Tick ////////////////////////////////////////////////////////////////////////
+
+static void queue_frame(int src, int dst, const uint8_t *data, size_t len)
+{
+    if (s_frame_count == RELAY_SIM_MAX_FRAMES)
+    {
+        return;
+    }
+    frame_t *f = &s_frames[s_frame_count++];
+    f->src = src;
+    f->dst = dst;
+    memcpy(f->data, data, len);
+    f->len = len;
+}
+
+static void tick(int64_t now_ms, bool sampling)
+{
+    uint8_t buf[RELAY_UPLINK_MAX];
+    uint8_t mac[RELAY_MAC_LEN];
+
+    s_frame_count = 0;
+    for (int i = 0; i < s_opt.collars; i++)
+    {
+        collar_t *c = &s_collars[i];
+        move(c, now_ms);
+        if (c->is_gateway)
+        {
+            size_t n = relay_gateway_beacon(&c->gateway, now_ms, buf, sizeof(buf));
+            if (n > 0)
+            {
+                queue_frame(i, -1, buf, n);
+                s_radio.beacons++;
+            }
+            continue;
+        }
+        if (sampling && now_ms >= c->next_sample_ms)
+        {
+            take_sample(c, now_ms);
+            c->next_sample_ms = now_ms + (int64_t)exponential(s_opt.status_s * 1000);
+        }
+        size_t n = relay_leaf_poll(&c->leaf, now_ms, buf, sizeof(buf), mac);
+        if (n > 0)
+        {
+            queue_frame(i, collar_by_mac(mac), buf, n);
+            s_radio.batch_sends++;
+        }
+    }
+
+    schedule_frames();
+    for (int i = 0; i < s_frame_count; i++)
+    {
+        const frame_t *f = &s_frames[i];
+        int rssi;
+        if (f->dst < 0)
+        {
+            for (int rx = 0; rx < s_opt.collars; rx++)
+            {
+                collar_t *c = &s_collars[rx];
+                if (c->is_gateway || !hears(i, rx, &rssi))
+                {
+                    continue;
+                }
+                s_radio.beacons_heard++;
+                relay_leaf_on_beacon(&c->leaf, s_collars[f->src].mac, rssi, f->data, f->len, now_ms);
+                if (!c->knows_leader && strcmp(c->leaf.leader_id, s_leader) == 0)
+                {
+                    c->knows_leader = true;
+                    s_leader_latencies[s_leader_latency_count++] = now_ms - s_leader_since_ms;
+                }
+            }
+            continue;
+        }
+        bool heard = hears(i, f->dst, &rssi);
+        if (heard)
+        {
+            relay_gateway_on_batch(&s_collars[f->dst].gateway, s_collars[f->src].mac, f->data, f->len, now_ms);
+        }
+        else
+        {
+            s_radio.batch_lost++;
+        }
+        bool acked = heard && rnd() >= s_opt.ack_loss;
+        if (heard && !acked)
+        {
+            s_radio.acks_lost++;
+        }
+        relay_leaf_on_sent(&s_collars[f->src].leaf, acked, now_ms);
+    }
+
+    for (int i = 0; i < s_opt.gateways; i++)
+    {
+        size_t n;
+        while ((n = relay_gateway_uplink(&s_collars[i].gateway, now_ms, (uint64_t)now_ms, buf, sizeof(buf))) > 0 &&
+               s_uplink_count < RELAY_SIM_MAX_UPLINKS)
+        {
+            uplink_t *u = &s_uplinks[(s_uplink_head + s_uplink_count++) % RELAY_SIM_MAX_UPLINKS];
+            memcpy(u->data, buf, n);
+            u->len = n;
+            u->arrive_ms = now_ms + s_opt.uplink_ms;
+        }
+    }
+    deliver_uplinks(now_ms);
+}
+
+// Report //////////////////////////////////////////////////////////////////////
+
+static int compare_i64(const void *a, const void *b)
+{
+    int64_t d = *(const int64_t *)a - *(const int64_t *)b;
+    return d < 0 ? -1 : d > 0;
+}
+
+static int64_t percentile(int64_t *values, size_t n, double p)
+{
+    if (n == 0)
+    {
+        return 0;
+    }
+    size_t i = (size_t)(p * (double)(n - 1) + 0.5);
+    return values[i];
+}
+
+static void report(void)
+{
+    uint64_t samples = 0;
+    uint64_t queued = 0;
+    relay_leaf_stats_t leaf = {0};
+    relay_gateway_stats_t gw = {0};
+    int leaves = s_opt.collars - s_opt.gateways;
+    for (int i = 0; i < s_opt.collars; i++)
+    {
+        const collar_t *c = &s_collars[i];
+        if (c->is_gateway)
+        {
+            gw.batches += c->gateway.stats.batches;
+            gw.duplicates += c->gateway.stats.duplicates;
+            gw.rejected += c->gateway.stats.rejected;
+            gw.evictions += c->gateway.stats.evictions;
+            gw.records += c->gateway.stats.records;
+            gw.overflows += c->gateway.stats.overflows;
+            continue;
+        }
+        samples += (uint64_t)c->sample_count;
+        queued += (uint64_t)c->leaf.count;
+        leaf.overflows += c->leaf.stats.overflows;
+        leaf.batches += c->leaf.stats.batches;
+        leaf.records += c->leaf.stats.records;
+        leaf.sends += c->leaf.stats.sends;
+        leaf.failures += c->leaf.stats.failures;
+        leaf.handovers += c->leaf.stats.handovers;
+    }
+
+    qsort(s_latencies, s_latency_count, sizeof(*s_latencies), compare_i64);
+    qsort(s_leader_latencies, s_leader_latency_count, sizeof(*s_leader_latencies), compare_i64);
+    double delivered = samples ? 100.0 * (double)s_server.records / (double)samples : 0;
+    double sim_s = s_opt.duration_s + RELAY_SIM_DRAIN_MS / 1000.0;
+
+    printf("relay_sim: %d collars (%d gateways, %d leaves) on %dx%d m, %d s, seed %u\n", s_opt.collars,
+           s_opt.gateways, leaves, s_opt.area_m, s_opt.area_m, s_opt.duration_s, s_opt.seed);
+    printf("records:     %llu sampled, %llu delivered (%.2f%%), %u lost to full leaf queues, %llu still queued, "
+           "%u lost to full gateway queues\n",
+           (unsigned long long)samples, (unsigned long long)s_server.records, delivered, leaf.overflows,
+           (unsigned long long)queued, gw.overflows);
+    printf("latency:     p50 %lld ms, p90 %lld ms, p99 %lld ms, max %lld ms (sample to server); age error at most %lld ms\n",
+           (long long)percentile(s_latencies, s_latency_count, 0.5),
+           (long long)percentile(s_latencies, s_latency_count, 0.9),
+           (long long)percentile(s_latencies, s_latency_count, 0.99),
+           (long long)percentile(s_latencies, s_latency_count, 1.0), (long long)s_server.max_age_error_ms);
+    printf("aggregation: %.2f records per batch, %.1f records and %.1f sections per uplink (%llu uplinks, %.0f bytes "
+           "each, %.1f/s)\n",
+           leaf.batches ? (double)leaf.records / leaf.batches : 0,
+           s_server.uplinks ? (double)(s_server.records + s_server.duplicate_records) / s_server.uplinks : 0,
+           s_server.uplinks ? (double)s_server.sections / s_server.uplinks : 0, (unsigned long long)s_server.uplinks,
+           s_server.uplinks ? (double)s_server.uplink_bytes / s_server.uplinks : 0, s_server.uplinks / sim_s);
+    printf("air:         %llu beacons (%.1f leaves heard each), %u batch sends, %u unacked (%llu not heard, %llu acks "
+           "lost), %llu collisions, %llu deferrals, %.2f%% airtime\n",
+           (unsigned long long)s_radio.beacons,
+           s_radio.beacons ? (double)s_radio.beacons_heard / s_radio.beacons : 0, leaf.sends, leaf.failures,
+           (unsigned long long)s_radio.batch_lost, (unsigned long long)s_radio.acks_lost,
+           (unsigned long long)s_radio.collisions, (unsigned long long)s_radio.deferrals,
+           100.0 * s_radio.air_us / (sim_s * 1e6));
+    printf("duplicates:  %u resent batches dropped by gateways, %llu by the server, %llu records through both\n",
+           gw.duplicates, (unsigned long long)s_server.repeated_batches,
+           (unsigned long long)s_server.duplicate_records);
+    printf("handovers:   %u (%.2f per leaf), %u leaves evicted from full gateway tables, %u batches refused\n",
+           leaf.handovers, leaves ? (double)leaf.handovers / leaves : 0, gw.evictions, gw.rejected);
+    printf("leader:      %d changes, heard by leaves after p50 %lld ms, p99 %lld ms; %llu leaf-changes missed\n",
+           s_leader_changes, (long long)percentile(s_leader_latencies, s_leader_latency_count, 0.5),
+           (long long)percentile(s_leader_latencies, s_leader_latency_count, 0.99),
+           (unsigned long long)s_leader_missed);
+}
+
+// Options /////////////////////////////////////////////////////////////////////
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "usage: %s [options]\n"
+            "  --collars N       collars in all (default 300)\n"
+            "  --gateways N      of which gateways, placed at random and standing still (default 20)\n"
+            "  --duration S      seconds of sampling, then %d s more to drain (default 600)\n"
+            "  --area M          side of the square the collars roam, in metres (default 600)\n"
+            "  --status-s S      mean seconds between a leaf's status samples (default 20)\n"
+            "  --ack-loss P      share of ESP-NOW acks lost (default 0.01)\n"
+            "  --uplink-ms MS    gateway to server delay (default 5)\n"
+            "  --leader-s S      seconds between leader changes (default 60)\n"
+            "  --seed N          random seed (default 1)\n",
+            prog, RELAY_SIM_DRAIN_MS / 1000);
+}
+
+static void parse_options(int argc, char **argv)
+{
+    static const struct option options[] = {
+        {"collars", required_argument, NULL, 'c'},
+        {"gateways", required_argument, NULL, 'g'},
+        {"duration", required_argument, NULL, 'd'},
+        {"area", required_argument, NULL, 'a'},
+        {"status-s", required_argument, NULL, 's'},
+        {"ack-loss", required_argument, NULL, 'l'},
+        {"uplink-ms", required_argument, NULL, 'u'},
+        {"leader-s", required_argument, NULL, 'L'},
+        {"seed", required_argument, NULL, 'S'},
+        {"help", no_argument, NULL, 'h'},
+        {NULL, 0, NULL, 0},
+    };
+    int opt;
+    while ((opt = getopt_long(argc, argv, "", options, NULL)) != -1)
+    {
+        switch (opt)
+        {
+        case 'c':
+            s_opt.collars = atoi(optarg);
+            break;
+        case 'g':
+            s_opt.gateways = atoi(optarg);
+            break;
+        case 'd':
+            s_opt.duration_s = atoi(optarg);
+            break;
+        case 'a':
+            s_opt.area_m = atoi(optarg);
+            break;
+        case 's':
+            s_opt.status_s = atof(optarg);
+            break;
+        case 'l':
+            s_opt.ack_loss = atof(optarg);
+            break;
+        case 'u':
+            s_opt.uplink_ms = atoi(optarg);
+            break;
+        case 'L':
+            s_opt.leader_s = atoi(optarg);
+            break;
+        case 'S':
+            s_opt.seed = (uint32_t)strtoul(optarg, NULL, 10);
+            break;
+        case 'h':
+            usage(argv[0]);
+            exit(0);
+        default:
+            usage(argv[0]);
+            exit(1);
+        }
+    }
+    // Collar indices travel in the last two bytes of the MAC
+    if (s_opt.collars < 2 || s_opt.collars > 65535 || s_opt.gateways < 1 || s_opt.gateways >= s_opt.collars ||
+        s_opt.duration_s < 1 || s_opt.area_m < 1 || s_opt.status_s <= 0 || s_opt.leader_s < 1)
+    {
+        usage(argv[0]);
+        exit(1);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    parse_options(argc, argv);
+    s_rng = s_opt.seed;
+
+    s_collars = calloc((size_t)s_opt.collars, sizeof(*s_collars));
+    int64_t total_ms = (int64_t)s_opt.duration_s * 1000 + RELAY_SIM_DRAIN_MS;
+    s_leader_latencies = calloc((size_t)(total_ms / ((int64_t)s_opt.leader_s * 1000) + 2) * (size_t)s_opt.collars,
+                                sizeof(*s_leader_latencies));
+    if (s_collars == NULL || s_leader_latencies == NULL)
+    {
+        perror("relay_sim");
+        return 1;
+    }
+
+    // Gateways first, so collar i + 1 is cat ID i + 1 and gateways are 1..N
+    for (int i = 0; i < s_opt.collars; i++)
+    {
+        collar_t *c = &s_collars[i];
+        char cat_id[RELAY_CAT_ID_LEN + 1];
+        snprintf(cat_id, sizeof(cat_id), "%u", (unsigned)(i + 1) % 65536);
+        collar_mac(i, c->mac);
+        c->x = rnd() * s_opt.area_m;
+        c->y = rnd() * s_opt.area_m;
+        c->is_gateway = i < s_opt.gateways;
+        if (c->is_gateway)
+        {
+            // Collars boot at different times, so their beacons are spread out
+            relay_gateway_init(&c->gateway, cat_id, (int64_t)(rnd() * RELAY_BEACON_MS));
+            relay_gateway_set_uplink(&c->gateway, true);
+        }
+        else
+        {
+            relay_leaf_init(&c->leaf, cat_id, (uint16_t)(3333 + i), (uint16_t)(rnd() * 65536));
+            c->next_sample_ms = (int64_t)exponential(s_opt.status_s * 1000);
+            c->rest_until_ms = (int64_t)exponential(120000);
+        }
+    }
+
+    for (int64_t now = 0; now < total_ms; now += RELAY_SIM_TICK_MS)
+    {
+        if (now % ((int64_t)s_opt.leader_s * 1000) == 0)
+        {
+            name_leader(now);
+        }
+        tick(now, now < (int64_t)s_opt.duration_s * 1000);
+    }
+    deliver_uplinks(INT64_MAX);
+    report();
+    return 0;
+}
@@ -0,0 +1,521 @@
+/*
+  ESP-IDF system services: logging, error names, esp_timer, the default event
+  loop and a Wi-Fi station that is always in range.
+
+  esp_timer callbacks run in an "esp_timer" task and events in a "sys_evt" task,
+  like on the target, so firmware code sees the same threading.
+*/
+
+#define _GNU_SOURCE
+
+#include <arpa/inet.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/random.h>
+
+#include "esp_err.h"
+#include "esp_event.h"
+#include "esp_log.h"
+#include "esp_netif.h"
+#include "esp_random.h"
+#include "esp_timer.h"
+#include "esp_vfs_dev.h"
+#include "esp_wifi.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/task.h"
+
+#include "./sim.h"
+
+#define ESP_TIMER_TASK_PRIO 22 // As in ESP-IDF
+#define ESP_TIMER_TASK_STACK 3584
+#define SYS_EVT_TASK_PRIO 20
+#define SYS_EVT_TASK_STACK 2304
+#define SYS_EVT_QUEUE_LEN 32
+#define SIM_AP_CHANNEL 6
+#define WIFI_TASK_PRIO 23 // As in ESP-IDF
+#define WIFI_TASK_STACK 2048
+#define MAX_EVENT_HANDLERS 16
+
+// Logging /////////////////////////////////////////////////////////////////////
+
+static pthread_mutex_t s_log_lock = PTHREAD_MUTEX_INITIALIZER;
+
+uint32_t esp_log_timestamp(void)
+{
+    return (uint32_t)(sim_now_us() / 1000);
+}
+
+void esp_log_write_line(char level, const char *tag, const char *format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    pthread_mutex_lock(&s_log_lock);
+    printf("%c (%u) %s: ", level, (unsigned)esp_log_timestamp(), tag);
+    vprintf(format, args);
+    putchar('\n');
+    pthread_mutex_unlock(&s_log_lock);
+    va_end(args);
+}
+
+const char *esp_err_to_name(esp_err_t code)
+{
+    switch (code)
+    {
+    case ESP_OK:
+        return "ESP_OK";
+    case ESP_FAIL:
+        return "ESP_FAIL";
+    case ESP_ERR_NO_MEM:
+        return "ESP_ERR_NO_MEM";
+    case ESP_ERR_INVALID_ARG:
+        return "ESP_ERR_INVALID_ARG";
+    case ESP_ERR_INVALID_STATE:
+        return "ESP_ERR_INVALID_STATE";
+    case ESP_ERR_INVALID_SIZE:
+        return "ESP_ERR_INVALID_SIZE";
+    case ESP_ERR_NOT_FOUND:
+        return "ESP_ERR_NOT_FOUND";
+    case ESP_ERR_NOT_SUPPORTED:
+        return "ESP_ERR_NOT_SUPPORTED";
+    case ESP_ERR_TIMEOUT:
+        return "ESP_ERR_TIMEOUT";
+    case ESP_ERR_INVALID_RESPONSE:
+        return "ESP_ERR_INVALID_RESPONSE";
+    case ESP_ERR_INVALID_CRC:
+        return "ESP_ERR_INVALID_CRC";
+    case ESP_ERR_INVALID_VERSION:
+        return "ESP_ERR_INVALID_VERSION";
+    case ESP_ERR_NVS_NOT_INITIALIZED:
+        return "ESP_ERR_NVS_NOT_INITIALIZED";
+    case ESP_ERR_NVS_NOT_FOUND:
+        return "ESP_ERR_NVS_NOT_FOUND";
+    case ESP_ERR_NVS_TYPE_MISMATCH:
+        return "ESP_ERR_NVS_TYPE_MISMATCH";
+    case ESP_ERR_NVS_READ_ONLY:
+        return "ESP_ERR_NVS_READ_ONLY";
+    case ESP_ERR_NVS_NOT_ENOUGH_SPACE:
+        return "ESP_ERR_NVS_NOT_ENOUGH_SPACE";
+    case ESP_ERR_NVS_INVALID_NAME:
+        return "ESP_ERR_NVS_INVALID_NAME";
+    case ESP_ERR_NVS_INVALID_HANDLE:
+        return "ESP_ERR_NVS_INVALID_HANDLE";
+    case ESP_ERR_NVS_KEY_TOO_LONG:
+        return "ESP_ERR_NVS_KEY_TOO_LONG";
+    case ESP_ERR_NVS_INVALID_LENGTH:
+        return "ESP_ERR_NVS_INVALID_LENGTH";
+    case ESP_ERR_NVS_NO_FREE_PAGES:
+        return "ESP_ERR_NVS_NO_FREE_PAGES";
+    case ESP_ERR_NVS_NEW_VERSION_FOUND:
+        return "ESP_ERR_NVS_NEW_VERSION_FOUND";
+    default:
+        return "UNKNOWN ERROR";
+    }
+}
+
+void esp_vfs_dev_uart_use_driver(int uart_num)
+{
+}
+
+// esp_timer ///////////////////////////////////////////////////////////////////
+
+struct esp_timer
+{
+    esp_timer_cb_t callback;
+    void *arg;
+    const char *name;
+    uint64_t period_us; // 0 for one-shot
+    int64_t due_us;     // Boot-relative
+    bool active;
+    struct esp_timer *next;
+};
+
+static pthread_mutex_t s_timer_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t s_timer_cond;
+static struct esp_timer *s_timers;
+static bool s_timer_task_started;
+
+int64_t esp_timer_get_time(void)
+{
+    return sim_now_us();
+}
+
+static void esp_timer_task(void *arg)
+{
+    pthread_mutex_lock(&s_timer_lock);
+    while (1)
+    {
+        struct esp_timer *due = NULL;
+        for (struct esp_timer *t = s_timers; t != NULL; t = t->next)
+        {
+            if (t->active && (due == NULL || t->due_us < due->due_us))
+            {
+                due = t;
+            }
+        }
+
+        int64_t now = sim_now_us();
+        if (due == NULL || due->due_us > now)
+        {
+            if (due == NULL)
+            {
+                pthread_cond_wait(&s_timer_cond, &s_timer_lock);
+            }
+            else
+            {
+                int64_t wake = sim_monotonic_us() + (due->due_us - now);
+                struct timespec ts = {.tv_sec = wake / 1000000, .tv_nsec = (wake % 1000000) * 1000};
+                pthread_cond_timedwait(&s_timer_cond, &s_timer_lock, &ts);
+            }
+            continue;
+        }
+
+        if (due->period_us > 0)
+        {
+            due->due_us += due->period_us;
+        }
+        else
+        {
+            due->active = false;
+        }
+        esp_timer_cb_t callback = due->callback;
+        void *cb_arg = due->arg;
+        pthread_mutex_unlock(&s_timer_lock);
+        callback(cb_arg);
+        pthread_mutex_lock(&s_timer_lock);
+    }
+}
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t *args, esp_timer_handle_t *out)
+{
+    if (args == NULL || args->callback == NULL || out == NULL)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    struct esp_timer *timer = calloc(1, sizeof(*timer));
+    if (timer == NULL)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    timer->callback = args->callback;
+    timer->arg = args->arg;
+    timer->name = args->name;
+
+    pthread_mutex_lock(&s_timer_lock);
+    timer->next = s_timers;
+    s_timers = timer;
+    bool start_task = !s_timer_task_started;
+    s_timer_task_started = true;
+    if (start_task)
+    {
+        pthread_condattr_t attr;
+        pthread_condattr_init(&attr);
+        pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+        pthread_cond_init(&s_timer_cond, &attr);
+        pthread_condattr_destroy(&attr);
+    }
+    pthread_mutex_unlock(&s_timer_lock);
+
+    if (start_task)
+    {
+        xTaskCreatePinnedToCore(esp_timer_task, "esp_timer", ESP_TIMER_TASK_STACK, NULL, ESP_TIMER_TASK_PRIO, NULL, 0);
+    }
+    *out = timer;
+    return ESP_OK;
+}
+
+static esp_err_t timer_start(esp_timer_handle_t timer, uint64_t first_us, uint64_t period_us)
+{
+    pthread_mutex_lock(&s_timer_lock);
+    if (timer->active)
+    {
+        pthread_mutex_unlock(&s_timer_lock);
+        return ESP_ERR_INVALID_STATE;
+    }
+    timer->due_us = sim_now_us() + (int64_t)first_us;
+    timer->period_us = period_us;
+    timer->active = true;
+    pthread_cond_signal(&s_timer_cond);
+    pthread_mutex_unlock(&s_timer_lock);
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout_us)
+{
+    return timer_start(timer, timeout_us, 0);
+}
+
+esp_err_t esp_timer_start_periodic(esp_timer_handle_t timer, uint64_t period_us)
+{
+    return timer_start(timer, period_us, period_us);
+}
+
+esp_err_t esp_timer_stop(esp_timer_handle_t timer)
+{
+    pthread_mutex_lock(&s_timer_lock);
+    bool was_active = timer->active;
+    timer->active = false;
+    pthread_mutex_unlock(&s_timer_lock);
+    return was_active ? ESP_OK : ESP_ERR_INVALID_STATE;
+}
+
+esp_err_t esp_timer_delete(esp_timer_handle_t timer)
+{
+    pthread_mutex_lock(&s_timer_lock);
+    if (timer->active)
+    {
+        pthread_mutex_unlock(&s_timer_lock);
+        return ESP_ERR_INVALID_STATE;
+    }
+    for (struct esp_timer **p = &s_timers; *p != NULL; p = &(*p)->next)
+    {
+        if (*p == timer)
+        {
+            *p = timer->next;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&s_timer_lock);
+    free(timer);
+    return ESP_OK;
+}
+
+bool esp_timer_is_active(esp_timer_handle_t timer)
+{
+    pthread_mutex_lock(&s_timer_lock);
+    bool active = timer->active;
+    pthread_mutex_unlock(&s_timer_lock);
+    return active;
+}
+
+// Default event loop //////////////////////////////////////////////////////////
+
+ESP_EVENT_DEFINE_BASE(WIFI_EVENT);
+ESP_EVENT_DEFINE_BASE(IP_EVENT);
+
+typedef struct
+{
+    esp_event_base_t base;
+    int32_t id;
+    esp_event_handler_t handler;
+    void *arg;
+} event_handler_t;
+
+typedef struct
+{
+    esp_event_base_t base;
+    int32_t id;
+    void *data; // Heap copy, freed after dispatch
+} event_t;
+
+static QueueHandle_t s_event_queue;
+static event_handler_t s_handlers[MAX_EVENT_HANDLERS];
+static int s_handler_count;
+static pthread_mutex_t s_handler_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void sys_evt_task(void *arg)
+{
+    event_t event;
+    while (1)
+    {
+        xQueueReceive(s_event_queue, &event, portMAX_DELAY);
+
+        pthread_mutex_lock(&s_handler_lock);
+        int count = s_handler_count;
+        event_handler_t handlers[MAX_EVENT_HANDLERS];
+        memcpy(handlers, s_handlers, sizeof(handlers));
+        pthread_mutex_unlock(&s_handler_lock);
+
+        for (int i = 0; i < count; i++)
+        {
+            bool base_match = handlers[i].base == ESP_EVENT_ANY_BASE || handlers[i].base == event.base;
+            bool id_match = handlers[i].id == ESP_EVENT_ANY_ID || handlers[i].id == event.id;
+            if (base_match && id_match)
+            {
+                handlers[i].handler(handlers[i].arg, event.base, event.id, event.data);
+            }
+        }
+        free(event.data);
+    }
+}
+
+esp_err_t esp_event_loop_create_default(void)
+{
+    if (s_event_queue != NULL)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    s_event_queue = xQueueCreate(SYS_EVT_QUEUE_LEN, sizeof(event_t));
+    xTaskCreatePinnedToCore(sys_evt_task, "sys_evt", SYS_EVT_TASK_STACK, NULL, SYS_EVT_TASK_PRIO, NULL, 0);
+    return ESP_OK;
+}
+
+esp_err_t esp_event_handler_register(esp_event_base_t base, int32_t id, esp_event_handler_t handler, void *arg)
+{
+    pthread_mutex_lock(&s_handler_lock);
+    if (s_handler_count >= MAX_EVENT_HANDLERS)
+    {
+        pthread_mutex_unlock(&s_handler_lock);
+        return ESP_ERR_NO_MEM;
+    }
+    s_handlers[s_handler_count++] = (event_handler_t){base, id, handler, arg};
+    pthread_mutex_unlock(&s_handler_lock);
+    return ESP_OK;
+}
+
+esp_err_t esp_event_handler_instance_register(esp_event_base_t base, int32_t id, esp_event_handler_t handler,
+                                              void *arg, esp_event_handler_instance_t *instance)
+{
+    if (instance != NULL)
+    {
+        *instance = NULL;
+    }
+    return esp_event_handler_register(base, id, handler, arg);
+}
+
+esp_err_t esp_event_post(esp_event_base_t base, int32_t id, const void *data, size_t size, TickType_t ticks)
+{
+    if (s_event_queue == NULL)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    event_t event = {.base = base, .id = id, .data = NULL};
+    if (data != NULL && size > 0)
+    {
+        event.data = malloc(size);
+        if (event.data == NULL)
+        {
+            return ESP_ERR_NO_MEM;
+        }
+        memcpy(event.data, data, size);
+    }
+    if (xQueueSend(s_event_queue, &event, ticks) != pdTRUE)
+    {
+        free(event.data);
+        return ESP_ERR_TIMEOUT;
+    }
+    return ESP_OK;
+}
+
+// Wi-Fi station ///////////////////////////////////////////////////////////////
+
+static int s_netif_placeholder;
+
+esp_err_t esp_netif_init(void)
+{
+    return ESP_OK;
+}
+
+esp_netif_t *esp_netif_create_default_wifi_sta(void)
+{
+    return (esp_netif_t *)&s_netif_placeholder;
+}
+
+esp_err_t esp_wifi_init(const wifi_init_config_t *config)
+{
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_set_mode(wifi_mode_t mode)
+{
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_set_config(wifi_interface_t interface, wifi_config_t *config)
+{
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_set_ps(wifi_ps_type_t type)
+{
+    return ESP_OK;
+}
+
+static atomic_int s_channel = SIM_AP_CHANNEL;
+
+esp_err_t esp_wifi_set_channel(uint8_t primary, wifi_second_chan_t second)
+{
+    if (primary < 1 || primary > 13)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    s_channel = primary;
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_get_channel(uint8_t *primary, wifi_second_chan_t *second)
+{
+    *primary = (uint8_t)s_channel;
+    *second = WIFI_SECOND_CHAN_NONE;
+    return ESP_OK;
+}
+
+int sim_wifi_channel(void)
+{
+    return s_channel;
+}
+
+esp_err_t esp_wifi_start(void)
+{
+    return esp_event_post(WIFI_EVENT, WIFI_EVENT_STA_START, NULL, 0, portMAX_DELAY);
+}
+
+// Association always succeeds (unless --no-ap); the station gets the loopback address.
+// With --assoc-ms it takes that long, in a "wifi" task, so the caller does not wait.
+static void associate(void)
+{
+    if (g_sim.no_ap)
+    {
+        esp_event_post(WIFI_EVENT, WIFI_EVENT_STA_DISCONNECTED, NULL, 0, portMAX_DELAY);
+        return;
+    }
+    s_channel = SIM_AP_CHANNEL;
+    esp_event_post(WIFI_EVENT, WIFI_EVENT_STA_CONNECTED, NULL, 0, portMAX_DELAY);
+
+    ip_event_got_ip_t got_ip = {.esp_netif = esp_netif_create_default_wifi_sta()};
+    got_ip.ip_info.ip.addr = htonl(INADDR_LOOPBACK);
+    esp_event_post(IP_EVENT, IP_EVENT_STA_GOT_IP, &got_ip, sizeof(got_ip), portMAX_DELAY);
+}
+
+static void associate_task(void *arg)
+{
+    vTaskDelay(pdMS_TO_TICKS(g_sim.assoc_ms));
+    associate();
+    vTaskDelete(NULL);
+}
+
+esp_err_t esp_wifi_connect(void)
+{
+    if (g_sim.assoc_ms <= 0)
+    {
+        associate();
+        return ESP_OK;
+    }
+    return xTaskCreate(associate_task, "wifi", WIFI_TASK_STACK, NULL, WIFI_TASK_PRIO, NULL) == pdPASS
+               ? ESP_OK
+               : ESP_ERR_NO_MEM;
+}
+
+uint32_t esp_random(void)
+{
+    uint32_t value = 0;
+    if (getrandom(&value, sizeof(value), 0) != sizeof(value))
+    {
+        value = (uint32_t)sim_monotonic_us();
+    }
+    return value;
+}
+
+void esp_fill_random(void *buf, size_t len)
+{
+    if (getrandom(buf, len, 0) != (ssize_t)len)
+    {
+        for (size_t i = 0; i < len; i++)
+        {
+            ((uint8_t *)buf)[i] = (uint8_t)esp_random();
+        }
+    }
+}
@@ -0,0 +1,325 @@
+/*
+  ESP-NOW between simulator processes.
+
+  The "air" is loopback UDP: collar N listens on --espnow-base + N, and a
+  frame to the broadcast address is sent to every collar from 1 to
+  --espnow-nodes. Each datagram carries the sender's channel and receivers drop
+  frames from other channels, so a leaf has to find its gateway's channel like
+  on the target. A unicast is acked by the receiving process; the send
+  callback reports failure if no ack comes within SIM_ESPNOW_ACK_MS.
+
+  Receive and send callbacks run in a "wifi" task, as they do in the Wi-Fi
+  driver's task on the target. Every frame is received at SIM_ESPNOW_RSSI.
+*/
+
+#include <arpa/inet.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "esp_log.h"
+#include "esp_now.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "./sim.h"
+
+// Reach the host calls behind the lwIP names; air traffic is not counted as UDP
+#undef bind
+#undef sendto
+#undef recvfrom
+
+#define SIM_ESPNOW_MAGIC 0xE5
+#define SIM_ESPNOW_DATA 0
+#define SIM_ESPNOW_ACK 1
+#define SIM_ESPNOW_HEADER 19 // magic, kind, channel, token (u32), src, dst
+#define SIM_ESPNOW_ACK_MS 30
+#define SIM_ESPNOW_MAX_PEERS 20 // As in ESP-IDF for unencrypted peers
+#define SIM_ESPNOW_PENDING 8
+#define SIM_ESPNOW_RSSI -55
+#define SIM_ESPNOW_POLL_MS 5
+#define WIFI_TASK_PRIO 23 // As in ESP-IDF
+#define WIFI_TASK_STACK 3584
+
+static const char *TAG = "espnow";
+
+static const uint8_t s_broadcast[ESP_NOW_ETH_ALEN] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+
+typedef struct
+{
+    bool used;
+    uint32_t token;
+    uint8_t mac[ESP_NOW_ETH_ALEN];
+    int64_t deadline_us;
+} pending_t;
+
+static pthread_mutex_t s_lock = PTHREAD_MUTEX_INITIALIZER;
+static int s_fd = -1;
+static esp_now_recv_cb_t s_recv_cb;
+static esp_now_send_cb_t s_send_cb;
+static uint8_t s_peers[SIM_ESPNOW_MAX_PEERS][ESP_NOW_ETH_ALEN];
+static int s_peer_count;
+static pending_t s_pending[SIM_ESPNOW_PENDING];
+static uint32_t s_next_token = 1;
+
+static uint64_t s_tx_frames;
+static uint64_t s_tx_broadcasts;
+static uint64_t s_rx_frames;
+static uint64_t s_rx_other_channel;
+static uint64_t s_acked;
+static uint64_t s_unacked;
+
+static int node_of(const uint8_t mac[ESP_NOW_ETH_ALEN])
+{
+    return (mac[4] << 8) | mac[5];
+}
+
+void sim_espnow_mac(uint8_t mac[ESP_NOW_ETH_ALEN])
+{
+    int node = atoi(g_sim.id);
+    const uint8_t base[ESP_NOW_ETH_ALEN] = {0x02, 0x53, 0x49, 0x4D, (uint8_t)(node >> 8), (uint8_t)node};
+    memcpy(mac, base, ESP_NOW_ETH_ALEN);
+}
+
+static void air_send(int node, const uint8_t *frame, size_t len)
+{
+    struct sockaddr_in to = {.sin_family = AF_INET, .sin_port = htons((uint16_t)(g_sim.espnow_base + node))};
+    to.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    sendto(s_fd, frame, len, MSG_NOSIGNAL, (struct sockaddr *)&to, sizeof(to));
+}
+
+static size_t put_header(uint8_t *frame, uint8_t kind, uint32_t token, const uint8_t *dst)
+{
+    frame[0] = SIM_ESPNOW_MAGIC;
+    frame[1] = kind;
+    frame[2] = (uint8_t)sim_wifi_channel();
+    memcpy(frame + 3, &token, 4);
+    sim_espnow_mac(frame + 7);
+    memcpy(frame + 13, dst, ESP_NOW_ETH_ALEN);
+    return SIM_ESPNOW_HEADER;
+}
+
+static void wifi_task(void *arg)
+{
+    uint8_t frame[SIM_ESPNOW_HEADER + ESP_NOW_MAX_DATA_LEN];
+    uint8_t self[ESP_NOW_ETH_ALEN];
+    sim_espnow_mac(self);
+    while (1)
+    {
+        ssize_t n = recv(s_fd, frame, sizeof(frame), 0);
+        if (n >= SIM_ESPNOW_HEADER && frame[0] == SIM_ESPNOW_MAGIC)
+        {
+            uint32_t token;
+            memcpy(&token, frame + 3, 4);
+            const uint8_t *src = frame + 7;
+            const uint8_t *dst = frame + 13;
+            bool for_us = memcmp(dst, self, ESP_NOW_ETH_ALEN) == 0;
+            if (frame[1] == SIM_ESPNOW_ACK && for_us)
+            {
+                esp_now_send_cb_t cb = NULL;
+                pthread_mutex_lock(&s_lock);
+                for (int i = 0; i < SIM_ESPNOW_PENDING; i++)
+                {
+                    if (s_pending[i].used && s_pending[i].token == token)
+                    {
+                        s_pending[i].used = false;
+                        s_acked++;
+                        cb = s_send_cb;
+                    }
+                }
+                pthread_mutex_unlock(&s_lock);
+                if (cb != NULL)
+                {
+                    cb(src, ESP_NOW_SEND_SUCCESS);
+                }
+            }
+            else if (frame[1] == SIM_ESPNOW_DATA && (for_us || memcmp(dst, s_broadcast, ESP_NOW_ETH_ALEN) == 0) &&
+                     memcmp(src, self, ESP_NOW_ETH_ALEN) != 0)
+            {
+                if (frame[2] != sim_wifi_channel())
+                {
+                    s_rx_other_channel++;
+                    continue;
+                }
+                if (for_us)
+                {
+                    uint8_t ack[SIM_ESPNOW_HEADER];
+                    air_send(node_of(src), ack, put_header(ack, SIM_ESPNOW_ACK, token, src));
+                }
+                s_rx_frames++;
+                uint8_t src_copy[ESP_NOW_ETH_ALEN];
+                uint8_t dst_copy[ESP_NOW_ETH_ALEN];
+                memcpy(src_copy, src, ESP_NOW_ETH_ALEN);
+                memcpy(dst_copy, dst, ESP_NOW_ETH_ALEN);
+                wifi_pkt_rx_ctrl_t rx_ctrl = {.rssi = SIM_ESPNOW_RSSI, .channel = frame[2]};
+                esp_now_recv_info_t info = {.src_addr = src_copy, .des_addr = dst_copy, .rx_ctrl = &rx_ctrl};
+                if (s_recv_cb != NULL)
+                {
+                    s_recv_cb(&info, frame + SIM_ESPNOW_HEADER, (int)(n - SIM_ESPNOW_HEADER));
+                }
+            }
+        }
+
+        // Unicasts nobody acked in time
+        int64_t now = sim_monotonic_us();
+        for (int i = 0; i < SIM_ESPNOW_PENDING; i++)
+        {
+            uint8_t mac[ESP_NOW_ETH_ALEN];
+            esp_now_send_cb_t cb = NULL;
+            pthread_mutex_lock(&s_lock);
+            if (s_pending[i].used && now >= s_pending[i].deadline_us)
+            {
+                s_pending[i].used = false;
+                s_unacked++;
+                memcpy(mac, s_pending[i].mac, ESP_NOW_ETH_ALEN);
+                cb = s_send_cb;
+            }
+            pthread_mutex_unlock(&s_lock);
+            if (cb != NULL)
+            {
+                cb(mac, ESP_NOW_SEND_FAIL);
+            }
+        }
+    }
+}
+
+esp_err_t esp_now_init(void)
+{
+    if (s_fd >= 0)
+    {
+        return ESP_OK;
+    }
+    int node = atoi(g_sim.id);
+    if (node < 1 || node > 0xFFFF)
+    {
+        ESP_LOGE(TAG, "The simulated air needs a numeric cat ID, not %s", g_sim.id);
+        return ESP_FAIL;
+    }
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    struct sockaddr_in addr = {.sin_family = AF_INET, .sin_port = htons((uint16_t)(g_sim.espnow_base + node))};
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (fd < 0 || bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0)
+    {
+        ESP_LOGE(TAG, "Cannot bind the air port %d", g_sim.espnow_base + node);
+        if (fd >= 0)
+        {
+            close(fd);
+        }
+        return ESP_FAIL;
+    }
+    struct timeval timeout = {.tv_usec = SIM_ESPNOW_POLL_MS * 1000};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    s_fd = fd;
+    xTaskCreate(wifi_task, "wifi", WIFI_TASK_STACK, NULL, WIFI_TASK_PRIO, NULL);
+    return ESP_OK;
+}
+
+esp_err_t esp_now_register_recv_cb(esp_now_recv_cb_t cb)
+{
+    s_recv_cb = cb;
+    return ESP_OK;
+}
+
+esp_err_t esp_now_register_send_cb(esp_now_send_cb_t cb)
+{
+    s_send_cb = cb;
+    return ESP_OK;
+}
+
+bool esp_now_is_peer_exist(const uint8_t *peer_addr)
+{
+    pthread_mutex_lock(&s_lock);
+    bool found = false;
+    for (int i = 0; i < s_peer_count && !found; i++)
+    {
+        found = memcmp(s_peers[i], peer_addr, ESP_NOW_ETH_ALEN) == 0;
+    }
+    pthread_mutex_unlock(&s_lock);
+    return found;
+}
+
+esp_err_t esp_now_add_peer(const esp_now_peer_info_t *peer)
+{
+    if (esp_now_is_peer_exist(peer->peer_addr))
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    pthread_mutex_lock(&s_lock);
+    esp_err_t err = ESP_ERR_NO_MEM;
+    if (s_peer_count < SIM_ESPNOW_MAX_PEERS)
+    {
+        memcpy(s_peers[s_peer_count++], peer->peer_addr, ESP_NOW_ETH_ALEN);
+        err = ESP_OK;
+    }
+    pthread_mutex_unlock(&s_lock);
+    return err;
+}
+
+esp_err_t esp_now_send(const uint8_t *peer_addr, const uint8_t *data, size_t len)
+{
+    if (s_fd < 0 || len > ESP_NOW_MAX_DATA_LEN)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (!esp_now_is_peer_exist(peer_addr))
+    {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    bool broadcast = memcmp(peer_addr, s_broadcast, ESP_NOW_ETH_ALEN) == 0;
+    uint32_t token = 0;
+    if (!broadcast)
+    {
+        pthread_mutex_lock(&s_lock);
+        int slot = -1;
+        for (int i = 0; i < SIM_ESPNOW_PENDING && slot < 0; i++)
+        {
+            slot = s_pending[i].used ? -1 : i;
+        }
+        if (slot >= 0)
+        {
+            token = s_next_token++;
+            s_pending[slot] = (pending_t){.used = true, .token = token,
+                                          .deadline_us = sim_monotonic_us() + SIM_ESPNOW_ACK_MS * 1000};
+            memcpy(s_pending[slot].mac, peer_addr, ESP_NOW_ETH_ALEN);
+        }
+        pthread_mutex_unlock(&s_lock);
+        if (slot < 0)
+        {
+            return ESP_ERR_NO_MEM; // ESP_ERR_ESPNOW_NO_MEM on the target
+        }
+    }
+
+    uint8_t frame[SIM_ESPNOW_HEADER + ESP_NOW_MAX_DATA_LEN];
+    size_t n = put_header(frame, SIM_ESPNOW_DATA, token, peer_addr);
+    memcpy(frame + n, data, len);
+    if (broadcast)
+    {
+        for (int node = 1; node <= g_sim.espnow_nodes; node++)
+        {
+            air_send(node, frame, n + len);
+        }
+        s_tx_broadcasts++;
+        if (s_send_cb != NULL)
+        {
+            s_send_cb(peer_addr, ESP_NOW_SEND_SUCCESS);
+        }
+    }
+    else
+    {
+        air_send(node_of(peer_addr), frame, n + len);
+    }
+    s_tx_frames++;
+    return ESP_OK;
+}
+
+void sim_espnow_report(FILE *out)
+{
+    fprintf(out, "\"espnow\":{\"active\":%s,\"tx\":%llu,\"tx_broadcasts\":%llu,\"rx\":%llu,\"rx_other_channel\":%llu,"
+                 "\"acked\":%llu,\"unacked\":%llu}",
+            s_fd >= 0 ? "true" : "false", (unsigned long long)s_tx_frames, (unsigned long long)s_tx_broadcasts,
+            (unsigned long long)s_rx_frames, (unsigned long long)s_rx_other_channel, (unsigned long long)s_acked,
+            (unsigned long long)s_unacked);
+}
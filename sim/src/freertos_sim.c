@@ -0,0 +1,907 @@
+/*
+  FreeRTOS API over pthreads.
+
+  Every task is a host thread. Scheduling is the host's: priorities only become
+  SCHED_FIFO priorities when SIM_REALTIME=1 (and the process may use them), and
+  cores only become CPU affinity when SIM_PIN_CORES=1. Ticks are derived from
+  CLOCK_MONOTONIC so delays line up with esp_timer_get_time().
+
+  Each task records how late it wakes from timed delays (vTaskDelay and
+  xTaskDelayUntil, i.e. sampling jitter) and from queue/semaphore sends that
+  unblocked it (hand-off latency, e.g. button ISR to button task). Both are
+  reported at exit by sim_freertos_report().
+*/
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/param.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/event_groups.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+
+#include "./sim.h"
+
+#define TICK_US (1000000 / configTICK_RATE_HZ)
+#define HOST_STACK_SCALE 16           // Host frames (glibc printf) are much larger than Xtensa ones
+#define HOST_STACK_MIN (256 * 1024)   // Reserved address space only; untouched pages cost nothing
+#define LATENCY_BUCKETS 24            // log2 microsecond buckets, the last one is open-ended
+
+typedef struct
+{
+    uint64_t count;
+    int64_t sum_us;
+    int64_t max_us;
+    uint64_t buckets[LATENCY_BUCKETS];
+} latency_t;
+
+struct tskTaskControlBlock
+{
+    pthread_t thread;
+    char name[configMAX_TASK_NAME_LEN];
+    TaskFunction_t fn;
+    void *arg;
+    UBaseType_t prio;
+    BaseType_t core;
+    uint32_t stack_bytes; // As requested by the firmware
+    uint8_t *host_stack;
+    size_t host_stack_size;
+    size_t host_stack_entry; // In use before the task function starts: glibc's thread descriptor and TLS
+
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    uint32_t notify_count;
+    bool suspended;
+
+    latency_t delay_late; // Timed delays: actual wake - intended wake
+    latency_t wake_late;  // Blocked on a queue: wake - send that unblocked it
+
+    struct tskTaskControlBlock *next;
+};
+
+struct QueueDefinition
+{
+    pthread_mutex_t lock;
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+    uint8_t *storage;
+    UBaseType_t length;
+    UBaseType_t item_size;
+    UBaseType_t head;
+    UBaseType_t count;
+    int waiting_receivers;
+    int64_t signal_us; // When a send last woke a blocked receiver
+};
+
+struct EventGroupDef_t
+{
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    EventBits_t bits;
+};
+
+static int64_t s_boot_us;
+static pthread_key_t s_current_key;
+static pthread_mutex_t s_registry_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct tskTaskControlBlock *s_tasks;
+static pthread_mutex_t s_critical = PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP;
+static bool s_realtime;
+static bool s_pin_cores;
+
+// Time ////////////////////////////////////////////////////////////////////////
+
+int64_t sim_monotonic_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+int64_t sim_now_us(void)
+{
+    return sim_monotonic_us() - s_boot_us;
+}
+
+static struct timespec to_timespec(int64_t monotonic_us)
+{
+    struct timespec ts = {
+        .tv_sec = monotonic_us / 1000000,
+        .tv_nsec = (monotonic_us % 1000000) * 1000,
+    };
+    return ts;
+}
+
+void sim_sleep_until_us(int64_t boot_us)
+{
+    struct timespec ts = to_timespec(s_boot_us + boot_us);
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR)
+    {
+    }
+}
+
+void sim_sleep_us(int64_t us)
+{
+    sim_sleep_until_us(sim_now_us() + us);
+}
+
+TickType_t xTaskGetTickCount(void)
+{
+    return (TickType_t)(sim_now_us() / TICK_US);
+}
+
+TickType_t xTaskGetTickCountFromISR(void)
+{
+    return xTaskGetTickCount();
+}
+
+// Absolute CLOCK_MONOTONIC deadline for a blocking call, NULL when waiting forever
+static const struct timespec *deadline_for(TickType_t ticks, struct timespec *ts)
+{
+    if (ticks == portMAX_DELAY)
+    {
+        return NULL;
+    }
+    *ts = to_timespec(sim_monotonic_us() + (int64_t)ticks * TICK_US);
+    return ts;
+}
+
+static int wait_on(pthread_cond_t *cond, pthread_mutex_t *lock, const struct timespec *deadline)
+{
+    return deadline ? pthread_cond_timedwait(cond, lock, deadline) : pthread_cond_wait(cond, lock);
+}
+
+static void init_cond(pthread_cond_t *cond)
+{
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(cond, &attr);
+    pthread_condattr_destroy(&attr);
+}
+
+// Latency statistics //////////////////////////////////////////////////////////
+
+static void latency_add(latency_t *l, int64_t us)
+{
+    if (us < 0)
+    {
+        us = 0;
+    }
+    int bucket = 0;
+    while (bucket < LATENCY_BUCKETS - 1 && (1LL << bucket) <= us)
+    {
+        bucket++;
+    }
+    l->count++;
+    l->sum_us += us;
+    if (us > l->max_us)
+    {
+        l->max_us = us;
+    }
+    l->buckets[bucket]++;
+}
+
+// Upper bound of the bucket holding the given percentile (never above the max seen)
+static int64_t latency_percentile(const latency_t *l, double pct)
+{
+    if (l->count == 0)
+    {
+        return 0;
+    }
+    uint64_t target = (uint64_t)(l->count * pct / 100.0);
+    uint64_t seen = 0;
+    for (int b = 0; b < LATENCY_BUCKETS; b++)
+    {
+        seen += l->buckets[b];
+        if (seen > target)
+        {
+            int64_t bound = (b == 0) ? 1 : (1LL << b);
+            return (bound < l->max_us) ? bound : l->max_us;
+        }
+    }
+    return l->max_us;
+}
+
+static void latency_json(FILE *out, const char *name, const latency_t *l)
+{
+    fprintf(out, "\"%s\":{\"n\":%" PRIu64 ",\"mean_us\":%.1f,\"p99_us\":%" PRId64 ",\"max_us\":%" PRId64 "}",
+            name, l->count, l->count ? (double)l->sum_us / l->count : 0.0, latency_percentile(l, 99.0), l->max_us);
+}
+
+// Tasks ///////////////////////////////////////////////////////////////////////
+
+static struct tskTaskControlBlock *new_tcb(const char *name, uint32_t stack, UBaseType_t prio, BaseType_t core)
+{
+    struct tskTaskControlBlock *tcb = calloc(1, sizeof(*tcb));
+    if (tcb == NULL)
+    {
+        return NULL;
+    }
+    snprintf(tcb->name, sizeof(tcb->name), "%s", name ? name : "");
+    tcb->stack_bytes = stack;
+    tcb->prio = prio;
+    tcb->core = core;
+    pthread_mutex_init(&tcb->lock, NULL);
+    init_cond(&tcb->cond);
+
+    pthread_mutex_lock(&s_registry_lock);
+    tcb->next = s_tasks;
+    s_tasks = tcb;
+    pthread_mutex_unlock(&s_registry_lock);
+    return tcb;
+}
+
+static struct tskTaskControlBlock *current(void)
+{
+    struct tskTaskControlBlock *tcb = pthread_getspecific(s_current_key);
+    if (tcb == NULL)
+    {
+        // A host thread that was not created as a task (should not happen in practice)
+        tcb = new_tcb("host", 0, 0, tskNO_AFFINITY);
+        tcb->thread = pthread_self();
+        pthread_setspecific(s_current_key, tcb);
+    }
+    return tcb;
+}
+
+void sim_freertos_init(void)
+{
+    s_boot_us = sim_monotonic_us();
+    pthread_key_create(&s_current_key, NULL);
+    s_realtime = getenv("SIM_REALTIME") && strcmp(getenv("SIM_REALTIME"), "1") == 0;
+    s_pin_cores = getenv("SIM_PIN_CORES") && strcmp(getenv("SIM_PIN_CORES"), "1") == 0;
+
+    // app_main() runs on the process's main thread, like the IDF "main" task
+    struct tskTaskControlBlock *main_task = new_tcb("main", 3584, 1, 0);
+    main_task->thread = pthread_self();
+    pthread_setspecific(s_current_key, main_task);
+}
+
+static void *task_entry(void *arg)
+{
+    struct tskTaskControlBlock *tcb = arg;
+    pthread_setspecific(s_current_key, tcb);
+    pthread_setname_np(pthread_self(), tcb->name);
+    if (tcb->host_stack != NULL)
+    {
+        tcb->host_stack_entry = (size_t)(tcb->host_stack + tcb->host_stack_size - (uint8_t *)__builtin_frame_address(0));
+    }
+    tcb->fn(tcb->arg);
+
+    // FreeRTOS tasks must never return; treat it like vTaskDelete(NULL)
+    return NULL;
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t fn, const char *name, uint32_t stack, void *arg,
+                                   UBaseType_t prio, TaskHandle_t *out, BaseType_t core)
+{
+    struct tskTaskControlBlock *tcb = new_tcb(name, stack, prio, core);
+    if (tcb == NULL)
+    {
+        return pdFAIL;
+    }
+    tcb->fn = fn;
+    tcb->arg = arg;
+
+    // Own the stack so its high-water mark can be read back with mincore()
+    long page = sysconf(_SC_PAGESIZE);
+    size_t size = (size_t)stack * HOST_STACK_SCALE;
+    size = (size < HOST_STACK_MIN) ? HOST_STACK_MIN : size;
+    size = (size + page - 1) / page * page;
+    uint8_t *mem = mmap(NULL, size + page, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (mem == MAP_FAILED)
+    {
+        return pdFAIL;
+    }
+    mprotect(mem, page, PROT_NONE); // Guard page below the stack
+    tcb->host_stack = mem + page;
+    tcb->host_stack_size = size;
+
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setstack(&attr, tcb->host_stack, tcb->host_stack_size);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    if (s_realtime)
+    {
+        struct sched_param param = {.sched_priority = 1 + (int)prio};
+        pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+        pthread_attr_setschedpolicy(&attr, SCHED_FIFO);
+        pthread_attr_setschedparam(&attr, &param);
+    }
+    if (s_pin_cores && core != tskNO_AFFINITY)
+    {
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(core % sysconf(_SC_NPROCESSORS_ONLN), &cpus);
+        pthread_attr_setaffinity_np(&attr, sizeof(cpus), &cpus);
+    }
+
+    int err = pthread_create(&tcb->thread, &attr, task_entry, tcb);
+    if (err == EPERM && s_realtime)
+    {
+        // Not allowed to use SCHED_FIFO here; fall back to normal scheduling
+        pthread_attr_setinheritsched(&attr, PTHREAD_INHERIT_SCHED);
+        err = pthread_create(&tcb->thread, &attr, task_entry, tcb);
+    }
+    pthread_attr_destroy(&attr);
+    if (err != 0)
+    {
+        return pdFAIL;
+    }
+    if (out != NULL)
+    {
+        *out = tcb;
+    }
+    return pdPASS;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t fn, const char *name, uint32_t stack, void *arg,
+                       UBaseType_t prio, TaskHandle_t *out)
+{
+    return xTaskCreatePinnedToCore(fn, name, stack, arg, prio, out, tskNO_AFFINITY);
+}
+
+TaskHandle_t xTaskCreateStaticPinnedToCore(TaskFunction_t fn, const char *name, uint32_t stack, void *arg,
+                                           UBaseType_t prio, StackType_t *stack_buf, StaticTask_t *tcb,
+                                           BaseType_t core)
+{
+    TaskHandle_t handle = NULL;
+    xTaskCreatePinnedToCore(fn, name, stack, arg, prio, &handle, core);
+    return handle;
+}
+
+TaskHandle_t xTaskCreateStatic(TaskFunction_t fn, const char *name, uint32_t stack, void *arg,
+                               UBaseType_t prio, StackType_t *stack_buf, StaticTask_t *tcb)
+{
+    return xTaskCreateStaticPinnedToCore(fn, name, stack, arg, prio, stack_buf, tcb, tskNO_AFFINITY);
+}
+
+void vTaskDelete(TaskHandle_t task)
+{
+    if (task == NULL || task == current())
+    {
+        pthread_exit(NULL);
+    }
+    // Deleting another task is not used by the firmware; cancellation would leak its locks
+    fprintf(stderr, "sim: vTaskDelete(%s) from another task is not supported\n", task->name);
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void)
+{
+    return current();
+}
+
+const char *pcTaskGetName(TaskHandle_t task)
+{
+    return (task ? task : current())->name;
+}
+
+BaseType_t xPortGetCoreID(void)
+{
+    BaseType_t core = current()->core;
+    return (core == tskNO_AFFINITY) ? 0 : core;
+}
+
+void vTaskPrioritySet(TaskHandle_t task, UBaseType_t prio)
+{
+    (task ? task : current())->prio = prio;
+}
+
+UBaseType_t uxTaskPriorityGet(TaskHandle_t task)
+{
+    return (task ? task : current())->prio;
+}
+
+// Deepest the task function has reached into its host stack, in bytes: found
+// with mincore() and then the first non-zero byte of the deepest page (fresh
+// pages are zero-filled), not counting glibc's thread descriptor and TLS above
+// the entry frame
+static size_t host_stack_used(const struct tskTaskControlBlock *tcb)
+{
+    // On the stack rather than the heap: STATIC_ALLOC builds would count it against the calling task
+    unsigned char resident[256];
+    long page = sysconf(_SC_PAGESIZE);
+    size_t pages = MIN(tcb->host_stack_size / page, sizeof(resident));
+    if (mincore(tcb->host_stack, pages * page, resident) != 0)
+    {
+        return 0;
+    }
+    size_t untouched = 0;
+    while (untouched < pages && !(resident[untouched] & 1))
+    {
+        untouched++;
+    }
+    untouched *= page;
+    while (untouched < tcb->host_stack_size && tcb->host_stack[untouched] == 0)
+    {
+        untouched++;
+    }
+    size_t used = tcb->host_stack_size - untouched;
+    return used > tcb->host_stack_entry ? used - tcb->host_stack_entry : 0;
+}
+
+// Bytes of the firmware's stack never reached, counting host bytes 1:1 against
+// what the firmware asked for; 0 means the task would have overflowed it. Host
+// frames are not Xtensa frames: glibc's vprintf, the deepest call in most
+// tasks, takes about 2.5 KB here, more than newlib's on the ESP32.
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t task)
+{
+    struct tskTaskControlBlock *tcb = task ? task : current();
+    if (tcb->host_stack == NULL)
+    {
+        return 0;
+    }
+    size_t used = host_stack_used(tcb);
+    return (UBaseType_t)(used < tcb->stack_bytes ? tcb->stack_bytes - used : 0);
+}
+
+void vTaskSuspend(TaskHandle_t task)
+{
+    struct tskTaskControlBlock *tcb = task ? task : current();
+    if (tcb != current())
+    {
+        fprintf(stderr, "sim: vTaskSuspend(%s) from another task is not supported\n", tcb->name);
+        return;
+    }
+    pthread_mutex_lock(&tcb->lock);
+    tcb->suspended = true;
+    while (tcb->suspended)
+    {
+        pthread_cond_wait(&tcb->cond, &tcb->lock);
+    }
+    pthread_mutex_unlock(&tcb->lock);
+}
+
+void vTaskResume(TaskHandle_t task)
+{
+    pthread_mutex_lock(&task->lock);
+    task->suspended = false;
+    pthread_cond_broadcast(&task->cond);
+    pthread_mutex_unlock(&task->lock);
+}
+
+// Delays //////////////////////////////////////////////////////////////////////
+
+// Sleep until the given tick and record how late the wakeup was
+static void sleep_until_tick(TickType_t tick)
+{
+    int64_t target_us = (int64_t)tick * TICK_US;
+    sim_sleep_until_us(target_us);
+    latency_add(&current()->delay_late, sim_now_us() - target_us);
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+    if (ticks == 0)
+    {
+        sched_yield();
+        return;
+    }
+    sleep_until_tick(xTaskGetTickCount() + ticks);
+}
+
+BaseType_t xTaskDelayUntil(TickType_t *prev_wake, TickType_t increment)
+{
+    TickType_t wake = *prev_wake + increment;
+    *prev_wake = wake;
+    if ((int32_t)(wake - xTaskGetTickCount()) <= 0)
+    {
+        // Already overdue: FreeRTOS returns immediately, which is a missed period
+        latency_add(&current()->delay_late, sim_now_us() - (int64_t)wake * TICK_US);
+        return pdFALSE;
+    }
+    sleep_until_tick(wake);
+    return pdTRUE;
+}
+
+// Notifications ///////////////////////////////////////////////////////////////
+
+uint32_t ulTaskNotifyTake(BaseType_t clear_on_exit, TickType_t ticks)
+{
+    struct tskTaskControlBlock *tcb = current();
+    struct timespec ts;
+    const struct timespec *deadline = deadline_for(ticks, &ts);
+
+    pthread_mutex_lock(&tcb->lock);
+    while (tcb->notify_count == 0 && ticks != 0)
+    {
+        if (wait_on(&tcb->cond, &tcb->lock, deadline) == ETIMEDOUT)
+        {
+            break;
+        }
+    }
+    uint32_t value = tcb->notify_count;
+    if (value > 0)
+    {
+        tcb->notify_count = clear_on_exit ? 0 : value - 1;
+    }
+    pthread_mutex_unlock(&tcb->lock);
+    return value;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task)
+{
+    pthread_mutex_lock(&task->lock);
+    task->notify_count++;
+    pthread_cond_broadcast(&task->cond);
+    pthread_mutex_unlock(&task->lock);
+    return pdPASS;
+}
+
+void vTaskNotifyGiveFromISR(TaskHandle_t task, BaseType_t *woken)
+{
+    xTaskNotifyGive(task);
+    if (woken != NULL)
+    {
+        *woken = pdTRUE;
+    }
+}
+
+// Queues and semaphores ///////////////////////////////////////////////////////
+
+static QueueHandle_t queue_new(UBaseType_t length, UBaseType_t item_size, UBaseType_t initial_count)
+{
+    struct QueueDefinition *q = calloc(1, sizeof(*q));
+    if (q == NULL)
+    {
+        return NULL;
+    }
+    if (item_size > 0)
+    {
+        q->storage = calloc(length, item_size);
+        if (q->storage == NULL)
+        {
+            free(q);
+            return NULL;
+        }
+    }
+    q->length = length;
+    q->item_size = item_size;
+    q->count = initial_count;
+    pthread_mutex_init(&q->lock, NULL);
+    init_cond(&q->not_empty);
+    init_cond(&q->not_full);
+    return q;
+}
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size)
+{
+    return queue_new(length, item_size, 0);
+}
+
+QueueHandle_t xQueueCreateStatic(UBaseType_t length, UBaseType_t item_size, uint8_t *storage, StaticQueue_t *buf)
+{
+    return queue_new(length, item_size, 0);
+}
+
+void vQueueDelete(QueueHandle_t q)
+{
+    pthread_mutex_destroy(&q->lock);
+    pthread_cond_destroy(&q->not_empty);
+    pthread_cond_destroy(&q->not_full);
+    free(q->storage);
+    free(q);
+}
+
+static void queue_put(QueueHandle_t q, const void *item, bool front)
+{
+    if (q->item_size > 0)
+    {
+        UBaseType_t slot;
+        if (front)
+        {
+            q->head = (q->head + q->length - 1) % q->length;
+            slot = q->head;
+        }
+        else
+        {
+            slot = (q->head + q->count) % q->length;
+        }
+        memcpy(q->storage + slot * q->item_size, item, q->item_size);
+    }
+    q->count++;
+    if (q->waiting_receivers > 0 && q->signal_us == 0)
+    {
+        q->signal_us = sim_now_us();
+    }
+    pthread_cond_signal(&q->not_empty);
+}
+
+static BaseType_t queue_send(QueueHandle_t q, const void *item, TickType_t ticks, bool front)
+{
+    struct timespec ts;
+    const struct timespec *deadline = deadline_for(ticks, &ts);
+
+    pthread_mutex_lock(&q->lock);
+    while (q->count >= q->length)
+    {
+        if (ticks == 0 || wait_on(&q->not_full, &q->lock, deadline) == ETIMEDOUT)
+        {
+            pthread_mutex_unlock(&q->lock);
+            return errQUEUE_FULL;
+        }
+    }
+    queue_put(q, item, front);
+    pthread_mutex_unlock(&q->lock);
+    return pdPASS;
+}
+
+BaseType_t xQueueSend(QueueHandle_t q, const void *item, TickType_t ticks)
+{
+    return queue_send(q, item, ticks, false);
+}
+
+BaseType_t xQueueSendToBack(QueueHandle_t q, const void *item, TickType_t ticks)
+{
+    return queue_send(q, item, ticks, false);
+}
+
+BaseType_t xQueueSendToFront(QueueHandle_t q, const void *item, TickType_t ticks)
+{
+    return queue_send(q, item, ticks, true);
+}
+
+BaseType_t xQueueSendFromISR(QueueHandle_t q, const void *item, BaseType_t *woken)
+{
+    BaseType_t ret = queue_send(q, item, 0, false);
+    if (woken != NULL)
+    {
+        *woken = pdTRUE;
+    }
+    return ret;
+}
+
+BaseType_t xQueueOverwrite(QueueHandle_t q, const void *item)
+{
+    pthread_mutex_lock(&q->lock);
+    if (q->count >= q->length)
+    {
+        q->count = 0; // Only valid for length-1 queues, as in FreeRTOS
+        q->head = 0;
+    }
+    queue_put(q, item, false);
+    pthread_mutex_unlock(&q->lock);
+    return pdPASS;
+}
+
+static BaseType_t queue_receive(QueueHandle_t q, void *out, TickType_t ticks, bool peek)
+{
+    struct timespec ts;
+    const struct timespec *deadline = deadline_for(ticks, &ts);
+    bool blocked = false;
+
+    pthread_mutex_lock(&q->lock);
+    while (q->count == 0)
+    {
+        if (ticks == 0)
+        {
+            pthread_mutex_unlock(&q->lock);
+            return pdFALSE;
+        }
+        q->waiting_receivers++;
+        blocked = true;
+        int err = wait_on(&q->not_empty, &q->lock, deadline);
+        q->waiting_receivers--;
+        if (err == ETIMEDOUT && q->count == 0)
+        {
+            pthread_mutex_unlock(&q->lock);
+            return pdFALSE;
+        }
+    }
+
+    if (q->signal_us != 0)
+    {
+        if (blocked)
+        {
+            latency_add(&current()->wake_late, sim_now_us() - q->signal_us);
+        }
+        q->signal_us = 0;
+    }
+
+    if (q->item_size > 0 && out != NULL)
+    {
+        memcpy(out, q->storage + q->head * q->item_size, q->item_size);
+    }
+    if (!peek)
+    {
+        q->head = (q->item_size > 0) ? (q->head + 1) % q->length : 0;
+        q->count--;
+        pthread_cond_signal(&q->not_full);
+    }
+    pthread_mutex_unlock(&q->lock);
+    return pdTRUE;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t q, void *out, TickType_t ticks)
+{
+    return queue_receive(q, out, ticks, false);
+}
+
+BaseType_t xQueueReceiveFromISR(QueueHandle_t q, void *out, BaseType_t *woken)
+{
+    return queue_receive(q, out, 0, false);
+}
+
+BaseType_t xQueuePeek(QueueHandle_t q, void *out, TickType_t ticks)
+{
+    return queue_receive(q, out, ticks, true);
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t q)
+{
+    pthread_mutex_lock(&q->lock);
+    UBaseType_t count = q->count;
+    pthread_mutex_unlock(&q->lock);
+    return count;
+}
+
+UBaseType_t uxQueueSpacesAvailable(QueueHandle_t q)
+{
+    pthread_mutex_lock(&q->lock);
+    UBaseType_t spaces = q->length - q->count;
+    pthread_mutex_unlock(&q->lock);
+    return spaces;
+}
+
+BaseType_t xQueueReset(QueueHandle_t q)
+{
+    pthread_mutex_lock(&q->lock);
+    q->count = 0;
+    q->head = 0;
+    pthread_cond_broadcast(&q->not_full);
+    pthread_mutex_unlock(&q->lock);
+    return pdPASS;
+}
+
+// Mutexes are not recursive and have no priority inheritance here
+SemaphoreHandle_t xSemaphoreCreateMutex(void)
+{
+    return queue_new(1, 0, 1);
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutexStatic(StaticSemaphore_t *buf)
+{
+    return xSemaphoreCreateMutex();
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary(void)
+{
+    return queue_new(1, 0, 0);
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinaryStatic(StaticSemaphore_t *buf)
+{
+    return xSemaphoreCreateBinary();
+}
+
+SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t max, UBaseType_t initial)
+{
+    return queue_new(max, 0, initial);
+}
+
+// Event groups ////////////////////////////////////////////////////////////////
+
+EventGroupHandle_t xEventGroupCreate(void)
+{
+    struct EventGroupDef_t *group = calloc(1, sizeof(*group));
+    if (group == NULL)
+    {
+        return NULL;
+    }
+    pthread_mutex_init(&group->lock, NULL);
+    init_cond(&group->changed);
+    return group;
+}
+
+EventGroupHandle_t xEventGroupCreateStatic(StaticEventGroup_t *buf)
+{
+    return xEventGroupCreate();
+}
+
+void vEventGroupDelete(EventGroupHandle_t group)
+{
+    pthread_mutex_destroy(&group->lock);
+    pthread_cond_destroy(&group->changed);
+    free(group);
+}
+
+EventBits_t xEventGroupSetBits(EventGroupHandle_t group, EventBits_t bits)
+{
+    pthread_mutex_lock(&group->lock);
+    group->bits |= bits;
+    EventBits_t now = group->bits;
+    pthread_cond_broadcast(&group->changed);
+    pthread_mutex_unlock(&group->lock);
+    return now;
+}
+
+EventBits_t xEventGroupClearBits(EventGroupHandle_t group, EventBits_t bits)
+{
+    pthread_mutex_lock(&group->lock);
+    EventBits_t before = group->bits;
+    group->bits &= ~bits;
+    pthread_mutex_unlock(&group->lock);
+    return before;
+}
+
+EventBits_t xEventGroupGetBits(EventGroupHandle_t group)
+{
+    pthread_mutex_lock(&group->lock);
+    EventBits_t bits = group->bits;
+    pthread_mutex_unlock(&group->lock);
+    return bits;
+}
+
+EventBits_t xEventGroupWaitBits(EventGroupHandle_t group, EventBits_t bits, BaseType_t clear_on_exit,
+                                BaseType_t wait_for_all, TickType_t ticks)
+{
+    struct timespec ts;
+    const struct timespec *deadline = deadline_for(ticks, &ts);
+
+    pthread_mutex_lock(&group->lock);
+    while (1)
+    {
+        EventBits_t set = group->bits & bits;
+        bool satisfied = wait_for_all ? (set == bits) : (set != 0);
+        if (satisfied || ticks == 0 || wait_on(&group->changed, &group->lock, deadline) == ETIMEDOUT)
+        {
+            EventBits_t result = group->bits;
+            if (satisfied && clear_on_exit)
+            {
+                group->bits &= ~bits;
+            }
+            pthread_mutex_unlock(&group->lock);
+            return result;
+        }
+    }
+}
+
+// Critical sections ///////////////////////////////////////////////////////////
+
+void vPortEnterCritical(portMUX_TYPE *mux)
+{
+    pthread_mutex_lock(&s_critical);
+}
+
+void vPortExitCritical(portMUX_TYPE *mux)
+{
+    pthread_mutex_unlock(&s_critical);
+}
+
+// Report //////////////////////////////////////////////////////////////////////
+
+void sim_freertos_report(FILE *out)
+{
+    fprintf(out, "\"tasks\":[");
+    pthread_mutex_lock(&s_registry_lock);
+    bool first = true;
+    for (struct tskTaskControlBlock *t = s_tasks; t != NULL; t = t->next)
+    {
+        fprintf(out, "%s{\"name\":\"%s\",\"prio\":%lu,\"core\":%ld,\"stack\":%u,",
+                first ? "" : ",", t->name, (unsigned long)t->prio,
+                (t->core == tskNO_AFFINITY) ? -1L : (long)t->core, (unsigned)t->stack_bytes);
+        if (t->host_stack != NULL)
+        {
+            // Deepest use at exit, so tasks that end in a reboot (OTA) are measured too
+            fprintf(out, "\"stack_used\":%zu,", host_stack_used(t));
+        }
+        latency_json(out, "delay_late", &t->delay_late);
+        fputc(',', out);
+        latency_json(out, "wake_late", &t->wake_late);
+        fputc('}', out);
+        first = false;
+    }
+    pthread_mutex_unlock(&s_registry_lock);
+    fputc(']', out);
+}
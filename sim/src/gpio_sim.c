@@ -0,0 +1,329 @@
+/*
+  Simulated GPIO: levels in memory, edge interrupts delivered by calling the
+  registered handler from the thread that drives the pin (standing in for the
+  ISR), and output changes (the buzzer) logged to <out>/collar-<id>.gpio as
+  "<ms> <gpio> <level>".
+
+  Button scripts press the button like a hand would, bounce included. One
+  action per line, "<t_ms> press|release|click|double|long", with t_ms since
+  boot; lines starting with '#' are comments.
+*/
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "driver/gpio.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "./sim.h"
+
+#define BOUNCE_EDGES 3      // Extra toggles before a press or release settles
+#define BOUNCE_GAP_US 1000
+#define CLICK_HOLD_MS 80
+#define DOUBLE_GAP_MS 180
+#define LONG_HOLD_MS 1200
+#define BUTTON_SCRIPT_PRIO 24 // Above every firmware task, as an interrupt would be
+#define BUTTON_SCRIPT_STACK 4096
+
+typedef struct
+{
+    gpio_mode_t mode;
+    gpio_int_type_t intr_type;
+    bool intr_enabled;
+    gpio_isr_t isr;
+    void *isr_arg;
+    int level;
+} gpio_pin_t;
+
+static gpio_pin_t s_pins[GPIO_NUM_MAX];
+static pthread_mutex_t s_gpio_lock = PTHREAD_MUTEX_INITIALIZER;
+static FILE *s_gpio_log;
+static uint64_t s_isr_calls;
+
+static bool valid(gpio_num_t gpio)
+{
+    return gpio >= 0 && gpio < GPIO_NUM_MAX;
+}
+
+static bool edge_matches(gpio_int_type_t type, int old_level, int new_level)
+{
+    switch (type)
+    {
+    case GPIO_INTR_POSEDGE:
+        return old_level == 0 && new_level == 1;
+    case GPIO_INTR_NEGEDGE:
+        return old_level == 1 && new_level == 0;
+    case GPIO_INTR_ANYEDGE:
+        return old_level != new_level;
+    case GPIO_INTR_LOW_LEVEL:
+        return new_level == 0;
+    case GPIO_INTR_HIGH_LEVEL:
+        return new_level == 1;
+    default:
+        return false;
+    }
+}
+
+void sim_gpio_drive(int gpio, int level)
+{
+    if (!valid(gpio))
+    {
+        return;
+    }
+    pthread_mutex_lock(&s_gpio_lock);
+    gpio_pin_t *pin = &s_pins[gpio];
+    int old_level = pin->level;
+    pin->level = level ? 1 : 0;
+    gpio_isr_t isr = (pin->intr_enabled && edge_matches(pin->intr_type, old_level, pin->level)) ? pin->isr : NULL;
+    void *arg = pin->isr_arg;
+    pthread_mutex_unlock(&s_gpio_lock);
+
+    if (isr != NULL)
+    {
+        s_isr_calls++;
+        isr(arg);
+    }
+}
+
+esp_err_t gpio_config(const gpio_config_t *config)
+{
+    pthread_mutex_lock(&s_gpio_lock);
+    for (int gpio = 0; gpio < GPIO_NUM_MAX; gpio++)
+    {
+        if ((config->pin_bit_mask & (1ULL << gpio)) == 0)
+        {
+            continue;
+        }
+        gpio_pin_t *pin = &s_pins[gpio];
+        pin->mode = config->mode;
+        pin->intr_type = config->intr_type;
+        pin->intr_enabled = config->intr_type != GPIO_INTR_DISABLE;
+        if (config->pull_up_en == GPIO_PULLUP_ENABLE)
+        {
+            pin->level = 1;
+        }
+        else if (config->pull_down_en == GPIO_PULLDOWN_ENABLE)
+        {
+            pin->level = 0;
+        }
+    }
+    pthread_mutex_unlock(&s_gpio_lock);
+    return ESP_OK;
+}
+
+esp_err_t gpio_reset_pin(gpio_num_t gpio)
+{
+    if (!valid(gpio))
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    pthread_mutex_lock(&s_gpio_lock);
+    s_pins[gpio] = (gpio_pin_t){.mode = GPIO_MODE_INPUT, .level = 1}; // Reset enables the pull-up
+    pthread_mutex_unlock(&s_gpio_lock);
+    return ESP_OK;
+}
+
+esp_err_t gpio_set_direction(gpio_num_t gpio, gpio_mode_t mode)
+{
+    if (!valid(gpio))
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    s_pins[gpio].mode = mode;
+    return ESP_OK;
+}
+
+esp_err_t gpio_set_level(gpio_num_t gpio, uint32_t level)
+{
+    if (!valid(gpio))
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    pthread_mutex_lock(&s_gpio_lock);
+    int old_level = s_pins[gpio].level;
+    s_pins[gpio].level = level ? 1 : 0;
+    if (s_gpio_log != NULL && old_level != s_pins[gpio].level)
+    {
+        fprintf(s_gpio_log, "%lld %d %d\n", (long long)(sim_now_us() / 1000), gpio, s_pins[gpio].level);
+        fflush(s_gpio_log);
+    }
+    pthread_mutex_unlock(&s_gpio_lock);
+    return ESP_OK;
+}
+
+int gpio_get_level(gpio_num_t gpio)
+{
+    return valid(gpio) ? s_pins[gpio].level : 0;
+}
+
+esp_err_t gpio_set_intr_type(gpio_num_t gpio, gpio_int_type_t type)
+{
+    if (!valid(gpio))
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    s_pins[gpio].intr_type = type;
+    return ESP_OK;
+}
+
+esp_err_t gpio_install_isr_service(int flags)
+{
+    static bool installed;
+    if (installed)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    installed = true;
+    return ESP_OK;
+}
+
+esp_err_t gpio_isr_handler_add(gpio_num_t gpio, gpio_isr_t isr, void *arg)
+{
+    if (!valid(gpio))
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    pthread_mutex_lock(&s_gpio_lock);
+    s_pins[gpio].isr = isr;
+    s_pins[gpio].isr_arg = arg;
+    pthread_mutex_unlock(&s_gpio_lock);
+    return ESP_OK;
+}
+
+esp_err_t gpio_isr_handler_remove(gpio_num_t gpio)
+{
+    return gpio_isr_handler_add(gpio, NULL, NULL);
+}
+
+esp_err_t gpio_intr_enable(gpio_num_t gpio)
+{
+    if (!valid(gpio))
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    s_pins[gpio].intr_enabled = true;
+    return ESP_OK;
+}
+
+esp_err_t gpio_intr_disable(gpio_num_t gpio)
+{
+    if (!valid(gpio))
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    s_pins[gpio].intr_enabled = false;
+    return ESP_OK;
+}
+
+esp_err_t gpio_wakeup_enable(gpio_num_t gpio, gpio_int_type_t type)
+{
+    return valid(gpio) ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+// Button scripts //////////////////////////////////////////////////////////////
+
+typedef struct
+{
+    int gpio;
+    FILE *script;
+} button_script_t;
+
+// Active low: pressed pulls the pin to ground
+static void settle(int gpio, int level)
+{
+    for (int i = 0; i < BOUNCE_EDGES; i++)
+    {
+        sim_gpio_drive(gpio, (i % 2 == 0) ? level : !level);
+        sim_sleep_us(BOUNCE_GAP_US);
+    }
+    sim_gpio_drive(gpio, level);
+}
+
+static void click(int gpio, int hold_ms)
+{
+    settle(gpio, 0);
+    sim_sleep_us((int64_t)hold_ms * 1000);
+    settle(gpio, 1);
+}
+
+static void button_script_task(void *arg)
+{
+    button_script_t *ctx = arg;
+    char line[128];
+    while (fgets(line, sizeof(line), ctx->script) != NULL)
+    {
+        long long t_ms;
+        char action[16];
+        if (line[0] == '#' || sscanf(line, "%lld %15s", &t_ms, action) != 2)
+        {
+            continue;
+        }
+        sim_sleep_until_us(t_ms * 1000);
+
+        if (strcmp(action, "press") == 0)
+        {
+            settle(ctx->gpio, 0);
+        }
+        else if (strcmp(action, "release") == 0)
+        {
+            settle(ctx->gpio, 1);
+        }
+        else if (strcmp(action, "click") == 0)
+        {
+            click(ctx->gpio, CLICK_HOLD_MS);
+        }
+        else if (strcmp(action, "double") == 0)
+        {
+            click(ctx->gpio, CLICK_HOLD_MS);
+            sim_sleep_us(DOUBLE_GAP_MS * 1000);
+            click(ctx->gpio, CLICK_HOLD_MS);
+        }
+        else if (strcmp(action, "long") == 0)
+        {
+            click(ctx->gpio, LONG_HOLD_MS);
+        }
+        else
+        {
+            fprintf(stderr, "sim: unknown button action '%s'\n", action);
+        }
+    }
+    fclose(ctx->script);
+    free(ctx);
+    vTaskDelete(NULL);
+}
+
+void sim_gpio_start_button_script(int gpio, const char *path)
+{
+    s_gpio_log = sim_open_log("gpio");
+    if (path == NULL)
+    {
+        return;
+    }
+
+    button_script_t *ctx = malloc(sizeof(*ctx));
+    ctx->gpio = gpio;
+    ctx->script = fopen(path, "r");
+    if (ctx->script == NULL)
+    {
+        fprintf(stderr, "sim: cannot open button script %s\n", path);
+        free(ctx);
+        return;
+    }
+    xTaskCreate(button_script_task, "sim_button", BUTTON_SCRIPT_STACK, ctx, BUTTON_SCRIPT_PRIO, NULL);
+}
+
+void sim_gpio_close(void)
+{
+    if (s_gpio_log != NULL)
+    {
+        fclose(s_gpio_log);
+        s_gpio_log = NULL;
+    }
+}
+
+void sim_gpio_report(FILE *out)
+{
+    fprintf(out, "\"gpio_isr_calls\":%llu", (unsigned long long)s_isr_calls);
+}
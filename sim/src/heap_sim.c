@@ -0,0 +1,73 @@
+/*
+  Heap hooks for the host build. The linker routes every malloc/calloc/realloc
+  call made by main/ and sim/src through these wrappers (-Wl,--wrap), which
+  count them and call esp_heap_trace_alloc_hook() like ESP-IDF does with
+  CONFIG_HEAP_USE_HOOKS. The firmware defines the hook in STATIC_ALLOC builds
+  and otherwise the weak no-op below is used. The C library's own allocations
+  are not seen.
+*/
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "esp_rom_sys.h"
+
+#include "./sim.h"
+#include "static_alloc.h"
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t count, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+
+static uint64_t s_allocs;
+static uint64_t s_bytes;
+
+__attribute__((weak)) void esp_heap_trace_alloc_hook(void *ptr, size_t size, uint32_t caps)
+{
+}
+
+static void *track(void *ptr, size_t size)
+{
+    if (ptr != NULL)
+    {
+        __atomic_add_fetch(&s_allocs, 1, __ATOMIC_RELAXED);
+        __atomic_add_fetch(&s_bytes, size, __ATOMIC_RELAXED);
+        esp_heap_trace_alloc_hook(ptr, size, 0);
+    }
+    return ptr;
+}
+
+void *__wrap_malloc(size_t size)
+{
+    return track(__real_malloc(size), size);
+}
+
+void *__wrap_calloc(size_t count, size_t size)
+{
+    return track(__real_calloc(count, size), count * size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size)
+{
+    return track(__real_realloc(ptr, size), size);
+}
+
+int esp_rom_printf(const char *fmt, ...)
+{
+    va_list args;
+    va_start(args, fmt);
+    int n = vfprintf(stderr, fmt, args);
+    va_end(args);
+    return n;
+}
+
+void sim_heap_report(FILE *out)
+{
+    static_alloc_stats_t stats;
+    static_alloc_get_stats(&stats);
+    fprintf(out, "\"heap\":{\"allocs\":%llu,\"bytes\":%llu,\"static_alloc\":%d,\"task_boot\":%u,\"task_steady\":%u,\"task_exempt\":%u}",
+            (unsigned long long)__atomic_load_n(&s_allocs, __ATOMIC_RELAXED),
+            (unsigned long long)__atomic_load_n(&s_bytes, __ATOMIC_RELAXED), STATIC_ALLOC, (unsigned)stats.boot,
+            (unsigned)stats.steady, (unsigned)stats.exempt);
+}
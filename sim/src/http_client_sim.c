@@ -0,0 +1,228 @@
+/*
+  esp_http_client for OTA downloads: one GET per handle over a host TCP
+  socket, "Connection: close", body delimited by Content-Length or by the
+  server closing. Chunked transfer encoding is not supported (express sends
+  static files with a length).
+*/
+
+#include <errno.h>
+#include <netdb.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include "esp_http_client.h"
+#include "esp_log.h"
+
+#include "./sim.h"
+
+#define HTTP_DEFAULT_PORT "80"
+#define HTTP_DEFAULT_TIMEOUT_MS 5000
+#define HTTP_HEADER_MAX 4096
+
+static const char *TAG = "http_client";
+
+struct esp_http_client
+{
+    char host[128];
+    char port[8];
+    char path[256];
+    int timeout_ms;
+    int fd;
+    int status;
+    int64_t content_length; // -1 until known, or if the server did not say
+    int64_t body_read;
+    char header[HTTP_HEADER_MAX];
+    size_t header_len;
+    size_t body_start; // Body bytes that arrived with the header: header[body_start..header_len)
+};
+
+static pthread_mutex_t s_lock = PTHREAD_MUTEX_INITIALIZER;
+static uint64_t s_requests;
+static uint64_t s_rx_bytes;
+
+static bool parse_url(struct esp_http_client *client, const char *url)
+{
+    if (url == NULL || strncmp(url, "http://", 7) != 0)
+    {
+        return false;
+    }
+    const char *host = url + 7;
+    const char *path = strchr(host, '/');
+    const char *host_end = path ? path : host + strlen(host);
+    const char *colon = memchr(host, ':', host_end - host);
+
+    size_t host_len = (colon ? colon : host_end) - host;
+    if (host_len == 0 || host_len >= sizeof(client->host))
+    {
+        return false;
+    }
+    memcpy(client->host, host, host_len);
+    client->host[host_len] = '\0';
+    snprintf(client->port, sizeof(client->port), "%.*s", colon ? (int)(host_end - colon - 1) : 0, colon ? colon + 1 : "");
+    if (client->port[0] == '\0')
+    {
+        snprintf(client->port, sizeof(client->port), "%s", HTTP_DEFAULT_PORT);
+    }
+    snprintf(client->path, sizeof(client->path), "%s", path ? path : "/");
+    return true;
+}
+
+esp_http_client_handle_t esp_http_client_init(const esp_http_client_config_t *config)
+{
+    struct esp_http_client *client = calloc(1, sizeof(*client));
+    if (client == NULL || !parse_url(client, config->url))
+    {
+        ESP_LOGE(TAG, "Unsupported URL %s", config->url ? config->url : "(null)");
+        free(client);
+        return NULL;
+    }
+    client->timeout_ms = config->timeout_ms > 0 ? config->timeout_ms : HTTP_DEFAULT_TIMEOUT_MS;
+    client->fd = -1;
+    client->content_length = -1;
+    return client;
+}
+
+esp_err_t esp_http_client_open(esp_http_client_handle_t client, int write_len)
+{
+    struct addrinfo hints = {.ai_family = AF_INET, .ai_socktype = SOCK_STREAM};
+    struct addrinfo *res = NULL;
+    if (getaddrinfo(client->host, client->port, &hints, &res) != 0 || res == NULL)
+    {
+        return ESP_FAIL;
+    }
+    client->fd = socket(res->ai_family, res->ai_socktype, res->ai_protocol);
+    struct timeval timeout = {.tv_sec = client->timeout_ms / 1000, .tv_usec = (client->timeout_ms % 1000) * 1000};
+    setsockopt(client->fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(client->fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+    int rc = connect(client->fd, res->ai_addr, res->ai_addrlen);
+    freeaddrinfo(res);
+    if (rc != 0)
+    {
+        close(client->fd);
+        client->fd = -1;
+        return ESP_FAIL;
+    }
+
+    char request[512];
+    int len = snprintf(request, sizeof(request), "GET %s HTTP/1.1\r\nHost: %s:%s\r\nConnection: close\r\n\r\n",
+                       client->path, client->host, client->port);
+    if (send(client->fd, request, len, MSG_NOSIGNAL) != len)
+    {
+        return ESP_FAIL;
+    }
+    pthread_mutex_lock(&s_lock);
+    s_requests++;
+    pthread_mutex_unlock(&s_lock);
+    return ESP_OK;
+}
+
+static void count_rx(size_t n)
+{
+    pthread_mutex_lock(&s_lock);
+    s_rx_bytes += n;
+    pthread_mutex_unlock(&s_lock);
+}
+
+int64_t esp_http_client_fetch_headers(esp_http_client_handle_t client)
+{
+    char *end = NULL;
+    while (end == NULL)
+    {
+        if (client->fd < 0 || client->header_len >= sizeof(client->header) - 1)
+        {
+            return ESP_FAIL;
+        }
+        ssize_t n = recv(client->fd, client->header + client->header_len,
+                         sizeof(client->header) - 1 - client->header_len, 0);
+        if (n <= 0)
+        {
+            return ESP_FAIL;
+        }
+        count_rx((size_t)n);
+        client->header_len += (size_t)n;
+        client->header[client->header_len] = '\0';
+        end = strstr(client->header, "\r\n\r\n");
+    }
+    client->body_start = (size_t)(end + 4 - client->header);
+
+    sscanf(client->header, "HTTP/%*s %d", &client->status);
+    for (char *line = strstr(client->header, "\r\n"); line != NULL && line < end; line = strstr(line + 2, "\r\n"))
+    {
+        if (strncasecmp(line + 2, "Content-Length:", 15) == 0)
+        {
+            client->content_length = strtoll(line + 17, NULL, 10);
+        }
+    }
+    return client->content_length;
+}
+
+int esp_http_client_get_status_code(esp_http_client_handle_t client)
+{
+    return client->status;
+}
+
+int esp_http_client_read(esp_http_client_handle_t client, char *buffer, int len)
+{
+    if (client->content_length >= 0)
+    {
+        int64_t left = client->content_length - client->body_read;
+        if (left <= 0)
+        {
+            return 0;
+        }
+        if (len > left)
+        {
+            len = (int)left;
+        }
+    }
+
+    int n;
+    if (client->body_start < client->header_len)
+    {
+        n = (int)(client->header_len - client->body_start);
+        n = (n > len) ? len : n;
+        memcpy(buffer, client->header + client->body_start, n);
+        client->body_start += n;
+    }
+    else
+    {
+        ssize_t got = recv(client->fd, buffer, len, 0);
+        if (got < 0)
+        {
+            return -1;
+        }
+        count_rx((size_t)got);
+        n = (int)got;
+    }
+    client->body_read += n;
+    return n;
+}
+
+esp_err_t esp_http_client_close(esp_http_client_handle_t client)
+{
+    if (client->fd >= 0)
+    {
+        close(client->fd);
+        client->fd = -1;
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_http_client_cleanup(esp_http_client_handle_t client)
+{
+    esp_http_client_close(client);
+    free(client);
+    return ESP_OK;
+}
+
+void sim_http_report(FILE *out)
+{
+    pthread_mutex_lock(&s_lock);
+    fprintf(out, "\"http\":{\"requests\":%llu,\"rx_bytes\":%llu}", (unsigned long long)s_requests,
+            (unsigned long long)s_rx_bytes);
+    pthread_mutex_unlock(&s_lock);
+}
@@ -0,0 +1,98 @@
+/*
+  lwIP sockets on host sockets.
+
+  UDP listeners are moved up by --udp-bind-offset so a collar never takes the
+  server's ingest port on the same machine, and share that port (SO_REUSEPORT)
+  so a whole fleet can listen on it at once. Datagram traffic is counted for the
+  exit report, along with the firmware's network task (net.h) and the
+  WebSocket it runs.
+*/
+
+#include <stdatomic.h>
+
+#include "lwip/sockets.h"
+
+#include "./sim.h"
+#include "net.h"
+
+// Reach the host calls behind the lwIP names
+#undef bind
+#undef sendto
+#undef recvfrom
+
+static atomic_ullong s_tx_datagrams;
+static atomic_ullong s_tx_bytes;
+static atomic_ullong s_tx_errors;
+static atomic_ullong s_rx_datagrams;
+static atomic_ullong s_rx_bytes;
+
+int sim_lwip_bind(int fd, const struct sockaddr *addr, socklen_t len)
+{
+    int type = 0;
+    socklen_t type_len = sizeof(type);
+    getsockopt(fd, SOL_SOCKET, SO_TYPE, &type, &type_len);
+    if (type != SOCK_DGRAM || addr->sa_family != AF_INET || len < (socklen_t)sizeof(struct sockaddr_in))
+    {
+        return bind(fd, addr, len);
+    }
+
+    struct sockaddr_in moved = *(const struct sockaddr_in *)addr;
+    if (moved.sin_port != 0)
+    {
+        moved.sin_port = htons((uint16_t)(ntohs(moved.sin_port) + g_sim.udp_bind_offset));
+    }
+    int on = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on));
+    return bind(fd, (const struct sockaddr *)&moved, sizeof(moved));
+}
+
+ssize_t sim_lwip_sendto(int fd, const void *buf, size_t len, int flags, const struct sockaddr *to, socklen_t to_len)
+{
+    ssize_t sent = sendto(fd, buf, len, flags | MSG_NOSIGNAL, to, to_len);
+    if (sent < 0)
+    {
+        s_tx_errors++;
+    }
+    else
+    {
+        s_tx_datagrams++;
+        s_tx_bytes += (unsigned long long)sent;
+    }
+    return sent;
+}
+
+ssize_t sim_lwip_recvfrom(int fd, void *buf, size_t len, int flags, struct sockaddr *from, socklen_t *from_len)
+{
+    ssize_t received = recvfrom(fd, buf, len, flags, from, from_len);
+    if (received >= 0)
+    {
+        s_rx_datagrams++;
+        s_rx_bytes += (unsigned long long)received;
+    }
+    return received;
+}
+
+void sim_net_report(FILE *out)
+{
+    fprintf(out, "\"udp\":{\"tx\":%llu,\"tx_bytes\":%llu,\"tx_errors\":%llu,\"rx\":%llu,\"rx_bytes\":%llu}",
+            (unsigned long long)s_tx_datagrams, (unsigned long long)s_tx_bytes, (unsigned long long)s_tx_errors,
+            (unsigned long long)s_rx_datagrams, (unsigned long long)s_rx_bytes);
+
+    net_stats_t net;
+    net_get_stats(&net);
+    fprintf(out,
+            ",\"net\":{\"wakeups\":%u,\"leaders\":%u,\"duplicates\":%u,\"datagrams\":%u,\"records\":%u,"
+            "\"dropped\":%u}",
+            (unsigned)net.wakeups, (unsigned)net.leaders, (unsigned)net.duplicates, (unsigned)net.datagrams,
+            (unsigned)net.records, (unsigned)net.dropped);
+}
+
+void sim_ws_report(FILE *out)
+{
+    net_stats_t net;
+    net_get_stats(&net);
+    fprintf(out, "\"ws\":{\"connected\":%s,\"connects\":%u,\"rx\":%u,\"tx\":%u}",
+            net.ws_connected ? "true" : "false", (unsigned)net.ws_connects, (unsigned)net.ws_rx_frames,
+            (unsigned)net.ws_tx_frames);
+}
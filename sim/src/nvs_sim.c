@@ -0,0 +1,482 @@
+/*
+  NVS as an in-memory table, saved to <out>/collar-<id>.nvs on every commit.
+
+  The file is a list of records: u8 namespace length, namespace, u8 key length,
+  key, u8 type, u32 value length, value. It is rewritten whole and renamed into
+  place, so an interrupted simulator never leaves half a config behind.
+*/
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "nvs.h"
+#include "nvs_flash.h"
+
+#include "collar_config.h"
+#include "./sim.h"
+
+#define NVS_KEY_NAME_MAX 16 // Includes the terminator, as on the target
+#define NVS_MAX_HANDLES 16
+#define NVS_FILE_MAGIC "SIMNVS1\n"
+
+typedef enum
+{
+    NVS_TYPE_U8 = 0x01,
+    NVS_TYPE_U32 = 0x04,
+    NVS_TYPE_BLOB = 0x42,
+} nvs_type_t;
+
+typedef struct nvs_entry
+{
+    char name_space[NVS_KEY_NAME_MAX];
+    char key[NVS_KEY_NAME_MAX];
+    nvs_type_t type;
+    uint32_t length;
+    uint8_t *value;
+    struct nvs_entry *next;
+} nvs_entry_t;
+
+typedef struct
+{
+    bool open;
+    bool writable;
+    char name_space[NVS_KEY_NAME_MAX];
+} nvs_open_handle_t;
+
+static pthread_mutex_t s_lock = PTHREAD_MUTEX_INITIALIZER;
+static nvs_entry_t *s_entries;
+static nvs_open_handle_t s_handles[NVS_MAX_HANDLES + 1]; // Handle 0 is never issued
+static bool s_initialized;
+
+static void nvs_path(char *buf, size_t len)
+{
+    sim_out_path(buf, len, "nvs");
+}
+
+static nvs_entry_t *find(const char *name_space, const char *key)
+{
+    for (nvs_entry_t *e = s_entries; e != NULL; e = e->next)
+    {
+        if (strcmp(e->name_space, name_space) == 0 && strcmp(e->key, key) == 0)
+        {
+            return e;
+        }
+    }
+    return NULL;
+}
+
+static void free_all(void)
+{
+    while (s_entries != NULL)
+    {
+        nvs_entry_t *next = s_entries->next;
+        free(s_entries->value);
+        free(s_entries);
+        s_entries = next;
+    }
+}
+
+static esp_err_t put(const char *name_space, const char *key, nvs_type_t type, const void *value, uint32_t length)
+{
+    nvs_entry_t *e = find(name_space, key);
+    if (e == NULL)
+    {
+        e = calloc(1, sizeof(*e));
+        if (e == NULL)
+        {
+            return ESP_ERR_NO_MEM;
+        }
+        snprintf(e->name_space, sizeof(e->name_space), "%s", name_space);
+        snprintf(e->key, sizeof(e->key), "%s", key);
+        e->next = s_entries;
+        s_entries = e;
+    }
+    uint8_t *copy = malloc(length ? length : 1);
+    if (copy == NULL)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    memcpy(copy, value, length);
+    free(e->value);
+    e->value = copy;
+    e->length = length;
+    e->type = type;
+    return ESP_OK;
+}
+
+static bool read_exact(FILE *f, void *buf, size_t len)
+{
+    return fread(buf, 1, len, f) == len;
+}
+
+static void load(void)
+{
+    char path[512];
+    nvs_path(path, sizeof(path));
+    FILE *f = fopen(path, "rb");
+    if (f == NULL)
+    {
+        return;
+    }
+
+    char magic[sizeof(NVS_FILE_MAGIC) - 1];
+    if (!read_exact(f, magic, sizeof(magic)) || memcmp(magic, NVS_FILE_MAGIC, sizeof(magic)) != 0)
+    {
+        fprintf(stderr, "sim: %s is not an NVS image, ignoring it\n", path);
+        fclose(f);
+        return;
+    }
+
+    while (1)
+    {
+        uint8_t ns_len, key_len, type;
+        uint32_t length;
+        char name_space[NVS_KEY_NAME_MAX] = {0};
+        char key[NVS_KEY_NAME_MAX] = {0};
+        if (!read_exact(f, &ns_len, 1) || ns_len >= NVS_KEY_NAME_MAX || !read_exact(f, name_space, ns_len) ||
+            !read_exact(f, &key_len, 1) || key_len >= NVS_KEY_NAME_MAX || !read_exact(f, key, key_len) ||
+            !read_exact(f, &type, 1) || !read_exact(f, &length, sizeof(length)))
+        {
+            break;
+        }
+        uint8_t *value = malloc(length ? length : 1);
+        if (value == NULL || !read_exact(f, value, length))
+        {
+            free(value);
+            break;
+        }
+        put(name_space, key, (nvs_type_t)type, value, length);
+        free(value);
+    }
+    fclose(f);
+}
+
+static esp_err_t save(void)
+{
+    char path[512], tmp[520];
+    nvs_path(path, sizeof(path));
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    FILE *f = fopen(tmp, "wb");
+    if (f == NULL)
+    {
+        return ESP_FAIL;
+    }
+    fwrite(NVS_FILE_MAGIC, 1, sizeof(NVS_FILE_MAGIC) - 1, f);
+    for (nvs_entry_t *e = s_entries; e != NULL; e = e->next)
+    {
+        uint8_t ns_len = strlen(e->name_space);
+        uint8_t key_len = strlen(e->key);
+        uint8_t type = e->type;
+        fwrite(&ns_len, 1, 1, f);
+        fwrite(e->name_space, 1, ns_len, f);
+        fwrite(&key_len, 1, 1, f);
+        fwrite(e->key, 1, key_len, f);
+        fwrite(&type, 1, 1, f);
+        fwrite(&e->length, sizeof(e->length), 1, f);
+        fwrite(e->value, 1, e->length, f);
+    }
+    bool ok = (fflush(f) == 0);
+    ok = (fclose(f) == 0) && ok;
+    if (!ok || rename(tmp, path) != 0)
+    {
+        remove(tmp);
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+// Flash ///////////////////////////////////////////////////////////////////////
+
+esp_err_t nvs_flash_init(void)
+{
+    pthread_mutex_lock(&s_lock);
+    if (!s_initialized)
+    {
+        load();
+        s_initialized = true;
+    }
+    pthread_mutex_unlock(&s_lock);
+    return ESP_OK;
+}
+
+esp_err_t nvs_flash_erase(void)
+{
+    char path[512];
+    nvs_path(path, sizeof(path));
+    pthread_mutex_lock(&s_lock);
+    free_all();
+    remove(path);
+    s_initialized = false;
+    pthread_mutex_unlock(&s_lock);
+    return ESP_OK;
+}
+
+// Handles /////////////////////////////////////////////////////////////////////
+
+esp_err_t nvs_open(const char *name_space, nvs_open_mode_t mode, nvs_handle_t *out)
+{
+    if (strlen(name_space) >= NVS_KEY_NAME_MAX)
+    {
+        return ESP_ERR_NVS_INVALID_NAME;
+    }
+    pthread_mutex_lock(&s_lock);
+    if (!s_initialized)
+    {
+        pthread_mutex_unlock(&s_lock);
+        return ESP_ERR_NVS_NOT_INITIALIZED;
+    }
+    // Like the target, a read-only open of a namespace that was never written fails
+    bool exists = false;
+    for (nvs_entry_t *e = s_entries; e != NULL && !exists; e = e->next)
+    {
+        exists = (strcmp(e->name_space, name_space) == 0);
+    }
+    if (mode == NVS_READONLY && !exists)
+    {
+        pthread_mutex_unlock(&s_lock);
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+    for (nvs_handle_t h = 1; h <= NVS_MAX_HANDLES; h++)
+    {
+        if (!s_handles[h].open)
+        {
+            s_handles[h].open = true;
+            s_handles[h].writable = (mode == NVS_READWRITE);
+            snprintf(s_handles[h].name_space, sizeof(s_handles[h].name_space), "%s", name_space);
+            pthread_mutex_unlock(&s_lock);
+            *out = h;
+            return ESP_OK;
+        }
+    }
+    pthread_mutex_unlock(&s_lock);
+    return ESP_ERR_NO_MEM;
+}
+
+void nvs_close(nvs_handle_t handle)
+{
+    pthread_mutex_lock(&s_lock);
+    if (handle >= 1 && handle <= NVS_MAX_HANDLES)
+    {
+        s_handles[handle].open = false;
+    }
+    pthread_mutex_unlock(&s_lock);
+}
+
+// Called with s_lock held
+static nvs_open_handle_t *handle_get(nvs_handle_t handle)
+{
+    if (handle < 1 || handle > NVS_MAX_HANDLES || !s_handles[handle].open)
+    {
+        return NULL;
+    }
+    return &s_handles[handle];
+}
+
+esp_err_t nvs_commit(nvs_handle_t handle)
+{
+    pthread_mutex_lock(&s_lock);
+    esp_err_t err = handle_get(handle) ? save() : ESP_ERR_NVS_INVALID_HANDLE;
+    pthread_mutex_unlock(&s_lock);
+    return err;
+}
+
+esp_err_t nvs_erase_key(nvs_handle_t handle, const char *key)
+{
+    pthread_mutex_lock(&s_lock);
+    nvs_open_handle_t *h = handle_get(handle);
+    esp_err_t err = ESP_ERR_NVS_NOT_FOUND;
+    if (h == NULL)
+    {
+        err = ESP_ERR_NVS_INVALID_HANDLE;
+    }
+    else if (!h->writable)
+    {
+        err = ESP_ERR_NVS_READ_ONLY;
+    }
+    else
+    {
+        for (nvs_entry_t **p = &s_entries; *p != NULL; p = &(*p)->next)
+        {
+            if (strcmp((*p)->name_space, h->name_space) == 0 && strcmp((*p)->key, key) == 0)
+            {
+                nvs_entry_t *e = *p;
+                *p = e->next;
+                free(e->value);
+                free(e);
+                err = ESP_OK;
+                break;
+            }
+        }
+    }
+    pthread_mutex_unlock(&s_lock);
+    return err;
+}
+
+esp_err_t nvs_erase_all(nvs_handle_t handle)
+{
+    pthread_mutex_lock(&s_lock);
+    nvs_open_handle_t *h = handle_get(handle);
+    esp_err_t err = ESP_OK;
+    if (h == NULL)
+    {
+        err = ESP_ERR_NVS_INVALID_HANDLE;
+    }
+    else if (!h->writable)
+    {
+        err = ESP_ERR_NVS_READ_ONLY;
+    }
+    else
+    {
+        nvs_entry_t **p = &s_entries;
+        while (*p != NULL)
+        {
+            if (strcmp((*p)->name_space, h->name_space) == 0)
+            {
+                nvs_entry_t *e = *p;
+                *p = e->next;
+                free(e->value);
+                free(e);
+            }
+            else
+            {
+                p = &(*p)->next;
+            }
+        }
+    }
+    pthread_mutex_unlock(&s_lock);
+    return err;
+}
+
+// Values //////////////////////////////////////////////////////////////////////
+
+static esp_err_t set_value(nvs_handle_t handle, const char *key, nvs_type_t type, const void *value, size_t length)
+{
+    if (strlen(key) >= NVS_KEY_NAME_MAX)
+    {
+        return ESP_ERR_NVS_KEY_TOO_LONG;
+    }
+    pthread_mutex_lock(&s_lock);
+    nvs_open_handle_t *h = handle_get(handle);
+    esp_err_t err;
+    if (h == NULL)
+    {
+        err = ESP_ERR_NVS_INVALID_HANDLE;
+    }
+    else if (!h->writable)
+    {
+        err = ESP_ERR_NVS_READ_ONLY;
+    }
+    else
+    {
+        err = put(h->name_space, key, type, value, (uint32_t)length);
+    }
+    pthread_mutex_unlock(&s_lock);
+    return err;
+}
+
+static esp_err_t get_value(nvs_handle_t handle, const char *key, nvs_type_t type, void *out, size_t *length)
+{
+    pthread_mutex_lock(&s_lock);
+    nvs_open_handle_t *h = handle_get(handle);
+    esp_err_t err = ESP_OK;
+    nvs_entry_t *e = h ? find(h->name_space, key) : NULL;
+    if (h == NULL)
+    {
+        err = ESP_ERR_NVS_INVALID_HANDLE;
+    }
+    else if (e == NULL || e->type != type)
+    {
+        err = ESP_ERR_NVS_NOT_FOUND;
+    }
+    else if (type == NVS_TYPE_BLOB && out == NULL)
+    {
+        *length = e->length; // Size query
+    }
+    else if (*length < e->length)
+    {
+        err = ESP_ERR_NVS_INVALID_LENGTH;
+    }
+    else
+    {
+        memcpy(out, e->value, e->length);
+        *length = e->length;
+    }
+    pthread_mutex_unlock(&s_lock);
+    return err;
+}
+
+esp_err_t nvs_set_blob(nvs_handle_t handle, const char *key, const void *value, size_t length)
+{
+    return set_value(handle, key, NVS_TYPE_BLOB, value, length);
+}
+
+esp_err_t nvs_get_blob(nvs_handle_t handle, const char *key, void *out, size_t *length)
+{
+    return get_value(handle, key, NVS_TYPE_BLOB, out, length);
+}
+
+esp_err_t nvs_set_u8(nvs_handle_t handle, const char *key, uint8_t value)
+{
+    return set_value(handle, key, NVS_TYPE_U8, &value, sizeof(value));
+}
+
+esp_err_t nvs_get_u8(nvs_handle_t handle, const char *key, uint8_t *out)
+{
+    size_t length = sizeof(*out);
+    return get_value(handle, key, NVS_TYPE_U8, out, &length);
+}
+
+esp_err_t nvs_set_u32(nvs_handle_t handle, const char *key, uint32_t value)
+{
+    return set_value(handle, key, NVS_TYPE_U32, &value, sizeof(value));
+}
+
+esp_err_t nvs_get_u32(nvs_handle_t handle, const char *key, uint32_t *out)
+{
+    size_t length = sizeof(*out);
+    return get_value(handle, key, NVS_TYPE_U32, out, &length);
+}
+
+// Seeding /////////////////////////////////////////////////////////////////////
+
+// First boot of a simulated collar: store a config pointing at the simulated
+// server, as if it had been provisioned. Later boots keep whatever was pushed.
+void sim_nvs_seed_config(void)
+{
+    nvs_flash_init();
+
+    nvs_handle_t nvs;
+    if (nvs_open("collar", NVS_READWRITE, &nvs) != ESP_OK)
+    {
+        return;
+    }
+    size_t size = 0;
+    if (nvs_get_blob(nvs, "cfg", NULL, &size) == ESP_OK)
+    {
+        nvs_close(nvs);
+        return;
+    }
+
+    collar_config_t cfg;
+    config_defaults(&cfg);
+    snprintf(cfg.cat_id, sizeof(cfg.cat_id), "%s", g_sim.id);
+    snprintf(cfg.host_ip, sizeof(cfg.host_ip), "%s", g_sim.server);
+    cfg.udp_port = g_sim.udp_port;
+    if (g_sim.ws_uri != NULL)
+    {
+        snprintf(cfg.ws_uri, sizeof(cfg.ws_uri), "%s", g_sim.ws_uri);
+    }
+    else
+    {
+        snprintf(cfg.ws_uri, sizeof(cfg.ws_uri), "ws://%s:3000/buzz", g_sim.server);
+    }
+    if (g_sim.uart_link != NULL)
+    {
+        cfg.uart_baud = g_sim.uart_baud;
+    }
+    cfg.relay_mode = (uint32_t)g_sim.relay_mode;
+    nvs_set_blob(nvs, "cfg", &cfg, sizeof(cfg));
+    nvs_commit(nvs);
+    nvs_close(nvs);
+}
@@ -0,0 +1,439 @@
+/*
+  App slots, otadata and the bootloader's part in OTA updates.
+
+  The two slots of partitions.csv are files, <out>/collar-<id>.ota_0 and
+  .ota_1, holding simulator executables; otadata is a one-line text file next
+  to them. Launching the simulator plays the part of flashing over USB: if the
+  launched binary is not what was last flashed (or --fresh is given), it is
+  copied into ota_0. Every boot, including esp_restart(), then runs the
+  bootloader step below: apply the rollback state machine and exec the slot it
+  selects. The image the firmware patches against is therefore the very
+  executable it runs in, as on the device.
+*/
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "esp_app_desc.h"
+#include "esp_ota_ops.h"
+#include "esp_partition.h"
+#include "esp_system.h"
+
+#include "./sim.h"
+
+#ifndef SIM_FW_VERSION
+#define SIM_FW_VERSION "dev"
+#endif
+
+#define SIM_OTA_SLOT_SIZE 0x1E0000 // As in partitions.csv
+#define SIM_OTA_BOOTED_ENV "SIM_OTA_BOOTED"
+#define SIM_OTA_COPY_CHUNK 65536
+
+typedef struct
+{
+    int boot;                   // Slot the bootloader starts
+    int previous;               // Slot to fall back to if boot is never confirmed
+    esp_ota_img_states_t state; // State of the boot slot
+    long long flashed_mtime;    // Binary last "flashed over USB" into ota_0
+    char flashed[PATH_MAX];
+} otadata_t;
+
+static const esp_partition_t s_slots[2] = {
+    {.type = ESP_PARTITION_TYPE_APP, .subtype = ESP_PARTITION_SUBTYPE_APP_OTA_0, .address = 0x20000,
+     .size = SIM_OTA_SLOT_SIZE, .erase_size = 4096, .label = "ota_0"},
+    {.type = ESP_PARTITION_TYPE_APP, .subtype = ESP_PARTITION_SUBTYPE_APP_OTA_1, .address = 0x200000,
+     .size = SIM_OTA_SLOT_SIZE, .erase_size = 4096, .label = "ota_1"},
+};
+
+static pthread_mutex_t s_lock = PTHREAD_MUTEX_INITIALIZER;
+static otadata_t s_otadata;
+static int s_running;
+static FILE *s_write;
+static int s_write_slot = -1;
+static uint32_t s_write_len;
+
+static const char *state_name(esp_ota_img_states_t state)
+{
+    switch (state)
+    {
+    case ESP_OTA_IMG_NEW:
+        return "new";
+    case ESP_OTA_IMG_PENDING_VERIFY:
+        return "pending";
+    case ESP_OTA_IMG_VALID:
+        return "valid";
+    case ESP_OTA_IMG_INVALID:
+        return "invalid";
+    case ESP_OTA_IMG_ABORTED:
+        return "aborted";
+    default:
+        return "undefined";
+    }
+}
+
+static void slot_path(char *buf, size_t len, int slot)
+{
+    sim_out_path(buf, len, s_slots[slot].label);
+}
+
+static int slot_of(const esp_partition_t *partition)
+{
+    for (int i = 0; i < 2; i++)
+    {
+        if (partition == &s_slots[i])
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// otadata /////////////////////////////////////////////////////////////////////
+
+static bool load_otadata(void)
+{
+    char path[512];
+    sim_out_path(path, sizeof(path), "otadata");
+    FILE *f = fopen(path, "r");
+    if (f == NULL)
+    {
+        return false;
+    }
+    unsigned state;
+    bool ok = fscanf(f, "boot=%d previous=%d state=%u mtime=%lld flashed=%4095[^\n]", &s_otadata.boot,
+                     &s_otadata.previous, &state, &s_otadata.flashed_mtime, s_otadata.flashed) == 5;
+    fclose(f);
+    s_otadata.state = (esp_ota_img_states_t)state;
+    return ok && s_otadata.boot >= 0 && s_otadata.boot < 2 && s_otadata.previous >= 0 && s_otadata.previous < 2;
+}
+
+static void save_otadata(void)
+{
+    char path[512], tmp[520];
+    sim_out_path(path, sizeof(path), "otadata");
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    FILE *f = fopen(tmp, "w");
+    if (f == NULL)
+    {
+        fprintf(stderr, "sim: cannot write %s: %s\n", tmp, strerror(errno));
+        return;
+    }
+    fprintf(f, "boot=%d previous=%d state=%u mtime=%lld flashed=%s\n", s_otadata.boot, s_otadata.previous,
+            (unsigned)s_otadata.state, s_otadata.flashed_mtime, s_otadata.flashed);
+    fclose(f);
+    rename(tmp, path);
+}
+
+// Bootloader //////////////////////////////////////////////////////////////////
+
+static bool copy_file(const char *from, const char *to)
+{
+    FILE *in = fopen(from, "rb");
+    FILE *out = in ? fopen(to, "wb") : NULL;
+    bool ok = in != NULL && out != NULL;
+    char *buf = malloc(SIM_OTA_COPY_CHUNK);
+    size_t n;
+    while (ok && (n = fread(buf, 1, SIM_OTA_COPY_CHUNK, in)) > 0)
+    {
+        ok = fwrite(buf, 1, n, out) == n;
+    }
+    free(buf);
+    if (in)
+    {
+        fclose(in);
+    }
+    if (out && fclose(out) != 0)
+    {
+        ok = false;
+    }
+    return ok && chmod(to, 0755) == 0;
+}
+
+void sim_ota_boot(char **argv)
+{
+    if (getenv(SIM_OTA_BOOTED_ENV) != NULL)
+    {
+        // Started by the step below; the next restart must go through it again
+        unsetenv(SIM_OTA_BOOTED_ENV);
+        load_otadata();
+        s_running = s_otadata.boot;
+        return;
+    }
+
+    char self[PATH_MAX], path[512];
+    if (realpath("/proc/self/exe", self) == NULL)
+    {
+        fprintf(stderr, "sim: cannot resolve own executable: %s\n", strerror(errno));
+        exit(1);
+    }
+    int self_slot = -1;
+    for (int i = 0; i < 2; i++)
+    {
+        char resolved[PATH_MAX];
+        slot_path(path, sizeof(path), i);
+        if (realpath(path, resolved) != NULL && strcmp(resolved, self) == 0)
+        {
+            self_slot = i;
+        }
+    }
+
+    bool loaded = load_otadata();
+    struct stat st;
+    if (self_slot < 0 && stat(self, &st) == 0 &&
+        (g_sim.fresh || !loaded || strcmp(s_otadata.flashed, self) != 0 || s_otadata.flashed_mtime != (long long)st.st_mtime))
+    {
+        // A new build was launched: "flash" it, which also clears any OTA state
+        slot_path(path, sizeof(path), 0);
+        if (!copy_file(self, path))
+        {
+            fprintf(stderr, "sim: cannot flash %s: %s\n", path, strerror(errno));
+            exit(1);
+        }
+        s_otadata = (otadata_t){.boot = 0, .previous = 0, .state = ESP_OTA_IMG_UNDEFINED,
+                                .flashed_mtime = (long long)st.st_mtime};
+        snprintf(s_otadata.flashed, sizeof(s_otadata.flashed), "%s", self);
+    }
+
+    // The bootloader's half of CONFIG_BOOTLOADER_APP_ROLLBACK_ENABLE
+    if (s_otadata.state == ESP_OTA_IMG_NEW)
+    {
+        s_otadata.state = ESP_OTA_IMG_PENDING_VERIFY;
+    }
+    else if (s_otadata.state == ESP_OTA_IMG_PENDING_VERIFY && s_otadata.previous != s_otadata.boot)
+    {
+        fprintf(stderr, "sim: %s was never confirmed, rolling back to %s\n", s_slots[s_otadata.boot].label,
+                s_slots[s_otadata.previous].label);
+        s_otadata.boot = s_otadata.previous;
+        s_otadata.state = ESP_OTA_IMG_VALID;
+    }
+    save_otadata();
+
+    s_running = s_otadata.boot;
+    if (self_slot == s_otadata.boot)
+    {
+        return;
+    }
+    slot_path(path, sizeof(path), s_otadata.boot);
+    setenv(SIM_OTA_BOOTED_ENV, "1", 1);
+    execv(path, argv);
+    fprintf(stderr, "sim: cannot boot %s: %s\n", path, strerror(errno));
+    exit(1);
+}
+
+void sim_ota_report(FILE *out)
+{
+    pthread_mutex_lock(&s_lock);
+    fprintf(out, "\"fw\":{\"version\":\"%s\",\"slot\":\"%s\",\"state\":\"%s\"}", SIM_FW_VERSION,
+            s_slots[s_running].label,
+            state_name(s_otadata.boot == s_running ? s_otadata.state : ESP_OTA_IMG_VALID));
+    pthread_mutex_unlock(&s_lock);
+}
+
+// Partitions //////////////////////////////////////////////////////////////////
+
+const esp_app_desc_t *esp_app_get_description(void)
+{
+    static const esp_app_desc_t desc = {
+        .magic_word = 0xABCD5432,
+        .version = SIM_FW_VERSION,
+        .project_name = "CatTracker",
+        .date = __DATE__,
+        .time = __TIME__,
+        .idf_ver = "sim",
+    };
+    return &desc;
+}
+
+esp_err_t esp_partition_read(const esp_partition_t *partition, size_t src_offset, void *dst, size_t size)
+{
+    int slot = slot_of(partition);
+    if (slot < 0 || src_offset + size > partition->size)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    char path[512];
+    slot_path(path, sizeof(path), slot);
+    FILE *f = fopen(path, "rb");
+    size_t n = 0;
+    if (f != NULL)
+    {
+        if (fseek(f, (long)src_offset, SEEK_SET) == 0)
+        {
+            n = fread(dst, 1, size, f);
+        }
+        fclose(f);
+    }
+    memset((uint8_t *)dst + n, 0xFF, size - n);
+    return ESP_OK;
+}
+
+const esp_partition_t *esp_ota_get_running_partition(void)
+{
+    return &s_slots[s_running];
+}
+
+const esp_partition_t *esp_ota_get_next_update_partition(const esp_partition_t *start_from)
+{
+    int from = start_from ? slot_of(start_from) : s_running;
+    return (from < 0) ? NULL : &s_slots[1 - from];
+}
+
+esp_err_t esp_ota_get_state_partition(const esp_partition_t *partition, esp_ota_img_states_t *state)
+{
+    int slot = slot_of(partition);
+    if (slot < 0 || state == NULL)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    pthread_mutex_lock(&s_lock);
+    *state = (slot == s_otadata.boot) ? s_otadata.state : ESP_OTA_IMG_VALID;
+    pthread_mutex_unlock(&s_lock);
+    return ESP_OK;
+}
+
+// Writing an image ////////////////////////////////////////////////////////////
+
+esp_err_t esp_ota_begin(const esp_partition_t *partition, size_t image_size, esp_ota_handle_t *out_handle)
+{
+    int slot = slot_of(partition);
+    if (slot < 0)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (slot == s_running)
+    {
+        return ESP_ERR_OTA_PARTITION_CONFLICT;
+    }
+    if (image_size != OTA_SIZE_UNKNOWN && image_size != OTA_WITH_SEQUENTIAL_WRITES && image_size > partition->size)
+    {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    pthread_mutex_lock(&s_lock);
+    if (s_write != NULL)
+    {
+        pthread_mutex_unlock(&s_lock);
+        return ESP_ERR_INVALID_STATE;
+    }
+    char path[512];
+    slot_path(path, sizeof(path), slot);
+    unlink(path); // Never rewrite a file an earlier image may still be executing from
+    s_write = fopen(path, "wb");
+    s_write_slot = slot;
+    s_write_len = 0;
+    pthread_mutex_unlock(&s_lock);
+    if (s_write == NULL)
+    {
+        return ESP_FAIL;
+    }
+    *out_handle = (esp_ota_handle_t)(slot + 1);
+    return ESP_OK;
+}
+
+esp_err_t esp_ota_write(esp_ota_handle_t handle, const void *data, size_t size)
+{
+    if (s_write == NULL || handle != (esp_ota_handle_t)(s_write_slot + 1))
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (s_write_len + size > s_slots[s_write_slot].size)
+    {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    s_write_len += size;
+    return fwrite(data, 1, size, s_write) == size ? ESP_OK : ESP_FAIL;
+}
+
+// A slot holds a bootable image if it starts like an executable
+static bool slot_valid(int slot)
+{
+    uint8_t magic[4];
+    return esp_partition_read(&s_slots[slot], 0, magic, sizeof(magic)) == ESP_OK && memcmp(magic, "\x7f" "ELF", 4) == 0;
+}
+
+static esp_err_t close_write(esp_ota_handle_t handle)
+{
+    if (s_write == NULL || handle != (esp_ota_handle_t)(s_write_slot + 1))
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    int failed = fclose(s_write);
+    s_write = NULL;
+    return failed ? ESP_FAIL : ESP_OK;
+}
+
+esp_err_t esp_ota_end(esp_ota_handle_t handle)
+{
+    int slot = s_write_slot;
+    esp_err_t err = close_write(handle);
+    if (err != ESP_OK)
+    {
+        return err;
+    }
+    if (!slot_valid(slot))
+    {
+        return ESP_ERR_OTA_VALIDATE_FAILED;
+    }
+    char path[512];
+    slot_path(path, sizeof(path), slot);
+    return chmod(path, 0755) == 0 ? ESP_OK : ESP_FAIL;
+}
+
+esp_err_t esp_ota_abort(esp_ota_handle_t handle)
+{
+    return close_write(handle);
+}
+
+esp_err_t esp_ota_set_boot_partition(const esp_partition_t *partition)
+{
+    int slot = slot_of(partition);
+    if (slot < 0 || !slot_valid(slot))
+    {
+        return ESP_ERR_OTA_VALIDATE_FAILED;
+    }
+    pthread_mutex_lock(&s_lock);
+    if (slot != s_running)
+    {
+        s_otadata.previous = s_running;
+        s_otadata.state = ESP_OTA_IMG_NEW;
+    }
+    s_otadata.boot = slot;
+    save_otadata();
+    pthread_mutex_unlock(&s_lock);
+    return ESP_OK;
+}
+
+// Rollback ////////////////////////////////////////////////////////////////////
+
+esp_err_t esp_ota_mark_app_valid_cancel_rollback(void)
+{
+    pthread_mutex_lock(&s_lock);
+    if (s_otadata.boot == s_running && s_otadata.state == ESP_OTA_IMG_PENDING_VERIFY)
+    {
+        s_otadata.state = ESP_OTA_IMG_VALID;
+        save_otadata();
+    }
+    pthread_mutex_unlock(&s_lock);
+    return ESP_OK;
+}
+
+esp_err_t esp_ota_mark_app_invalid_rollback_and_reboot(void)
+{
+    pthread_mutex_lock(&s_lock);
+    if (s_otadata.boot != s_running || s_otadata.previous == s_running || !slot_valid(s_otadata.previous))
+    {
+        pthread_mutex_unlock(&s_lock);
+        return ESP_ERR_OTA_ROLLBACK_FAILED;
+    }
+    s_otadata.boot = s_otadata.previous;
+    s_otadata.state = ESP_OTA_IMG_VALID;
+    save_otadata();
+    pthread_mutex_unlock(&s_lock);
+    esp_restart();
+}
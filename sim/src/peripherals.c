@@ -0,0 +1,765 @@
+/*
+  Simulated I2C bus and the devices on it, plus and the thermistor ADC.
+
+  ADXL343 (0x53): register file with auto-increment. Reading DATAX0 latches a
+  new sample from the trace (CSV "t_ms,x_g,y_g,z_g", looped) or, without one,
+  from synthetic motion that cycles sleep / wander / moonwalk every 30 s.
+
+  HT16K33 (0x70): display RAM; every change is appended to
+  <out>/collar-<id>.display as "<ms>\t<text>\t<raw words>", with the text
+  decoded through the firmware's own font table (encode_character()).
+
+  Thermistor (ADC1 channel 6): 80 F with a slow +/-3 F swing, noise, and the
+  occasional spike the median filter is there for.
+*/
+
+#include <math.h>
+#include <pthread.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "driver/i2c.h"
+#include "esp_adc/adc_cali.h"
+#include "esp_adc/adc_cali_scheme.h"
+#include "esp_adc/adc_oneshot.h"
+#include "freertos/task.h"
+
+#include "ADXL343.h"
+#include "temperature_filter.h"
+
+#include "./sim.h"
+
+#define I2C_MAX_DEVICES 8
+#define I2C_DEFAULT_CLK_HZ 100000
+#define I2C_BITS_PER_BYTE 9 // 8 data bits + ACK
+#define ADC_FULL_SCALE_MV 3100.0f // ADC_ATTEN_DB_12
+#define ADC_MAX_RAW 4095
+
+// Firmware font lookup (CatCollar.c), used to decode display frames back to text
+uint16_t encode_character(char c);
+
+// I2C bus /////////////////////////////////////////////////////////////////////
+
+typedef enum
+{
+    OP_START,
+    OP_STOP,
+    OP_WRITE,
+    OP_READ,
+} i2c_op_type_t;
+
+typedef struct
+{
+    i2c_op_type_t type;
+    bool ack_check;
+    uint8_t *data; // OP_WRITE: owned copy, OP_READ: caller's buffer
+    size_t len;
+} i2c_op_t;
+
+// Heap links grow ops and write copies with malloc, like the driver's
+// i2c_cmd_link_create(). Static links live entirely in the caller's buffer: ops
+// from the front, write copies from the back, ESP_ERR_NO_MEM when they meet.
+typedef struct
+{
+    i2c_op_t *ops;
+    size_t count;
+    size_t capacity;
+    uint8_t *data_top; // Static links: start of the write copies; NULL for heap links
+} i2c_link_t;
+
+#define I2C_LINK_ALIGN _Alignof(max_align_t)
+
+static sim_i2c_device_t s_devices[I2C_MAX_DEVICES];
+static int s_device_count;
+static uint32_t s_clk_hz[I2C_NUM_MAX] = {I2C_DEFAULT_CLK_HZ, I2C_DEFAULT_CLK_HZ};
+static pthread_mutex_t s_bus_lock[I2C_NUM_MAX] = {PTHREAD_MUTEX_INITIALIZER, PTHREAD_MUTEX_INITIALIZER};
+static uint64_t s_transactions;
+static uint64_t s_nacks;
+static int64_t s_bus_busy_us;
+
+void sim_i2c_attach(const sim_i2c_device_t *device)
+{
+    if (s_device_count < I2C_MAX_DEVICES)
+    {
+        s_devices[s_device_count++] = *device;
+    }
+}
+
+static sim_i2c_device_t *device_at(uint8_t address)
+{
+    for (int i = 0; i < s_device_count; i++)
+    {
+        if (s_devices[i].address == address)
+        {
+            return &s_devices[i];
+        }
+    }
+    return NULL;
+}
+
+esp_err_t i2c_param_config(i2c_port_t port, const i2c_config_t *config)
+{
+    if (port < 0 || port >= I2C_NUM_MAX || config == NULL)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (config->mode == I2C_MODE_MASTER && config->master.clk_speed > 0)
+    {
+        s_clk_hz[port] = config->master.clk_speed;
+    }
+    return ESP_OK;
+}
+
+esp_err_t i2c_driver_install(i2c_port_t port, i2c_mode_t mode, size_t rx_buf, size_t tx_buf, int flags)
+{
+    return (port >= 0 && port < I2C_NUM_MAX) ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+esp_err_t i2c_driver_delete(i2c_port_t port)
+{
+    return ESP_OK;
+}
+
+esp_err_t i2c_set_data_mode(i2c_port_t port, i2c_trans_mode_t tx_mode, i2c_trans_mode_t rx_mode)
+{
+    return ESP_OK;
+}
+
+i2c_cmd_handle_t i2c_cmd_link_create(void)
+{
+    return calloc(1, sizeof(i2c_link_t));
+}
+
+i2c_cmd_handle_t i2c_cmd_link_create_static(uint8_t *buffer, uint32_t size)
+{
+    uintptr_t start = ((uintptr_t)buffer + I2C_LINK_ALIGN - 1) / I2C_LINK_ALIGN * I2C_LINK_ALIGN;
+    if (buffer == NULL || start + sizeof(i2c_link_t) > (uintptr_t)buffer + size)
+    {
+        return NULL;
+    }
+    i2c_link_t *link = (i2c_link_t *)start;
+    *link = (i2c_link_t){.ops = (i2c_op_t *)(link + 1), .data_top = buffer + size};
+    link->capacity = (link->data_top > (uint8_t *)link->ops) ? (size_t)(link->data_top - (uint8_t *)link->ops) / sizeof(i2c_op_t) : 0;
+    return link;
+}
+
+void i2c_cmd_link_delete(i2c_cmd_handle_t cmd)
+{
+    i2c_link_t *link = cmd;
+    if (link == NULL || link->data_top != NULL)
+    {
+        return;
+    }
+    for (size_t i = 0; i < link->count; i++)
+    {
+        if (link->ops[i].type == OP_WRITE)
+        {
+            free(link->ops[i].data);
+        }
+    }
+    free(link->ops);
+    free(link);
+}
+
+void i2c_cmd_link_delete_static(i2c_cmd_handle_t cmd)
+{
+    // Nothing to free: the caller owns the buffer
+}
+
+static esp_err_t link_append(i2c_cmd_handle_t cmd, i2c_op_t op)
+{
+    i2c_link_t *link = cmd;
+    if (link == NULL)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (link->data_top != NULL)
+    {
+        if ((uint8_t *)(link->ops + link->count + 1) > link->data_top)
+        {
+            return ESP_ERR_NO_MEM;
+        }
+    }
+    else if (link->count == link->capacity)
+    {
+        size_t capacity = link->capacity ? link->capacity * 2 : 8;
+        i2c_op_t *ops = realloc(link->ops, capacity * sizeof(*ops));
+        if (ops == NULL)
+        {
+            return ESP_ERR_NO_MEM;
+        }
+        link->ops = ops;
+        link->capacity = capacity;
+    }
+    link->ops[link->count++] = op;
+    return ESP_OK;
+}
+
+esp_err_t i2c_master_start(i2c_cmd_handle_t cmd)
+{
+    return link_append(cmd, (i2c_op_t){.type = OP_START});
+}
+
+esp_err_t i2c_master_stop(i2c_cmd_handle_t cmd)
+{
+    return link_append(cmd, (i2c_op_t){.type = OP_STOP});
+}
+
+esp_err_t i2c_master_write(i2c_cmd_handle_t cmd, const uint8_t *data, size_t len, bool ack_en)
+{
+    i2c_link_t *link = cmd;
+    if (link == NULL)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (link->data_top != NULL)
+    {
+        // Room for the copy and one more op in front of it
+        if (link->data_top - len < (uint8_t *)(link->ops + link->count + 1))
+        {
+            return ESP_ERR_NO_MEM;
+        }
+        link->data_top -= len;
+        memcpy(link->data_top, data, len);
+        return link_append(cmd, (i2c_op_t){.type = OP_WRITE, .ack_check = ack_en, .data = link->data_top, .len = len});
+    }
+    uint8_t *copy = malloc(len ? len : 1);
+    if (copy == NULL)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    memcpy(copy, data, len);
+    esp_err_t err = link_append(cmd, (i2c_op_t){.type = OP_WRITE, .ack_check = ack_en, .data = copy, .len = len});
+    if (err != ESP_OK)
+    {
+        free(copy);
+    }
+    return err;
+}
+
+esp_err_t i2c_master_write_byte(i2c_cmd_handle_t cmd, uint8_t data, bool ack_en)
+{
+    return i2c_master_write(cmd, &data, 1, ack_en);
+}
+
+esp_err_t i2c_master_read(i2c_cmd_handle_t cmd, uint8_t *data, size_t len, i2c_ack_type_t ack)
+{
+    return link_append(cmd, (i2c_op_t){.type = OP_READ, .data = data, .len = len});
+}
+
+esp_err_t i2c_master_read_byte(i2c_cmd_handle_t cmd, uint8_t *data, i2c_ack_type_t ack)
+{
+    return i2c_master_read(cmd, data, 1, ack);
+}
+
+esp_err_t i2c_master_cmd_begin(i2c_port_t port, i2c_cmd_handle_t cmd, TickType_t ticks)
+{
+    i2c_link_t *link = cmd;
+    if (port < 0 || port >= I2C_NUM_MAX || link == NULL)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    pthread_mutex_lock(&s_bus_lock[port]);
+    int64_t start_us = sim_now_us();
+    esp_err_t err = ESP_OK;
+    sim_i2c_device_t *device = NULL;
+    bool expect_address = false;
+    size_t bits = 0;
+
+    for (size_t i = 0; i < link->count && err == ESP_OK; i++)
+    {
+        i2c_op_t *op = &link->ops[i];
+        switch (op->type)
+        {
+        case OP_START:
+            expect_address = true;
+            bits += 2;
+            break;
+
+        case OP_STOP:
+            if (device != NULL && device->stop != NULL)
+            {
+                device->stop(device->ctx);
+            }
+            device = NULL;
+            bits += 2;
+            break;
+
+        case OP_WRITE:
+            for (size_t b = 0; b < op->len; b++)
+            {
+                bits += I2C_BITS_PER_BYTE;
+                if (expect_address)
+                {
+                    expect_address = false;
+                    device = device_at(op->data[b] >> 1);
+                    if (device == NULL)
+                    {
+                        if (op->ack_check)
+                        {
+                            err = ESP_FAIL; // NACK on the address byte
+                            break;
+                        }
+                        continue;
+                    }
+                    if (device->start != NULL)
+                    {
+                        device->start(device->ctx, (op->data[b] & 1) == I2C_MASTER_READ);
+                    }
+                }
+                else if (device != NULL && device->write != NULL)
+                {
+                    device->write(device->ctx, op->data[b]);
+                }
+            }
+            break;
+
+        case OP_READ:
+            for (size_t b = 0; b < op->len; b++)
+            {
+                bits += I2C_BITS_PER_BYTE;
+                op->data[b] = (device != NULL && device->read != NULL) ? device->read(device->ctx) : 0xFF;
+            }
+            break;
+        }
+    }
+
+    // Hold the bus for as long as the transfer takes on the wire
+    int64_t wire_us = (int64_t)bits * 1000000 / s_clk_hz[port];
+    sim_sleep_until_us(start_us + wire_us);
+    s_transactions++;
+    s_nacks += (err != ESP_OK);
+    s_bus_busy_us += sim_now_us() - start_us;
+    pthread_mutex_unlock(&s_bus_lock[port]);
+    return err;
+}
+
+// Like the driver, the device helpers build their link on the stack
+static esp_err_t transfer(i2c_port_t port, uint8_t addr, const uint8_t *write, size_t write_len,
+                          uint8_t *read, size_t read_len, TickType_t ticks)
+{
+    uint8_t buffer[I2C_LINK_RECOMMENDED_SIZE(2)];
+    i2c_cmd_handle_t cmd = i2c_cmd_link_create_static(buffer, sizeof(buffer));
+    if (write_len > 0)
+    {
+        i2c_master_start(cmd);
+        i2c_master_write_byte(cmd, (addr << 1) | I2C_MASTER_WRITE, true);
+        i2c_master_write(cmd, write, write_len, true);
+    }
+    if (read_len > 0)
+    {
+        i2c_master_start(cmd);
+        i2c_master_write_byte(cmd, (addr << 1) | I2C_MASTER_READ, true);
+        i2c_master_read(cmd, read, read_len, I2C_MASTER_LAST_NACK);
+    }
+    i2c_master_stop(cmd);
+    esp_err_t err = i2c_master_cmd_begin(port, cmd, ticks);
+    i2c_cmd_link_delete_static(cmd);
+    return err;
+}
+
+esp_err_t i2c_master_write_to_device(i2c_port_t port, uint8_t addr, const uint8_t *write, size_t write_len,
+                                     TickType_t ticks)
+{
+    return transfer(port, addr, write, write_len, NULL, 0, ticks);
+}
+
+esp_err_t i2c_master_read_from_device(i2c_port_t port, uint8_t addr, uint8_t *read, size_t read_len,
+                                      TickType_t ticks)
+{
+    return transfer(port, addr, NULL, 0, read, read_len, ticks);
+}
+
+esp_err_t i2c_master_write_read_device(i2c_port_t port, uint8_t addr, const uint8_t *write, size_t write_len,
+                                       uint8_t *read, size_t read_len, TickType_t ticks)
+{
+    return transfer(port, addr, write, write_len, read, read_len, ticks);
+}
+
+void sim_i2c_report(FILE *out)
+{
+    fprintf(out, "\"i2c\":{\"transactions\":%llu,\"nacks\":%llu,\"busy_us\":%lld}",
+            (unsigned long long)s_transactions, (unsigned long long)s_nacks, (long long)s_bus_busy_us);
+}
+
+// Random numbers (per collar, reproducible) ///////////////////////////////////
+
+static uint32_t s_rng_state = 1;
+
+static float frand(void)
+{
+    // xorshift32, uniform in [-1, 1)
+    s_rng_state ^= s_rng_state << 13;
+    s_rng_state ^= s_rng_state >> 17;
+    s_rng_state ^= s_rng_state << 5;
+    return (float)(s_rng_state >> 8) / (float)(1 << 23) - 1.0f;
+}
+
+// ADXL343 /////////////////////////////////////////////////////////////////////
+
+typedef struct
+{
+    uint32_t t_ms;
+    float g[3];
+} accel_sample_t;
+
+typedef struct
+{
+    uint8_t regs[64];
+    uint8_t pointer;
+    bool pointer_set; // First byte of a write transaction selects the register
+    accel_sample_t *trace;
+    size_t trace_len;
+    uint32_t trace_period_ms;
+    float phase_s; // Staggers synthetic motion between collars
+} adxl343_t;
+
+static adxl343_t s_adxl;
+
+static void adxl_load_trace(adxl343_t *dev, const char *path)
+{
+    FILE *f = fopen(path, "r");
+    if (f == NULL)
+    {
+        fprintf(stderr, "sim: cannot open trace %s, using synthetic motion\n", path);
+        return;
+    }
+    size_t capacity = 0;
+    char line[256];
+    while (fgets(line, sizeof(line), f) != NULL)
+    {
+        accel_sample_t s;
+        if (line[0] == '#' || sscanf(line, "%u,%f,%f,%f", &s.t_ms, &s.g[0], &s.g[1], &s.g[2]) != 4)
+        {
+            continue;
+        }
+        if (dev->trace_len == capacity)
+        {
+            capacity = capacity ? capacity * 2 : 256;
+            dev->trace = realloc(dev->trace, capacity * sizeof(*dev->trace));
+        }
+        dev->trace[dev->trace_len++] = s;
+    }
+    fclose(f);
+    if (dev->trace_len > 1)
+    {
+        // Loop with the same spacing as the last two samples
+        uint32_t step = dev->trace[dev->trace_len - 1].t_ms - dev->trace[dev->trace_len - 2].t_ms;
+        dev->trace_period_ms = dev->trace[dev->trace_len - 1].t_ms + step;
+    }
+    else if (dev->trace_len == 1)
+    {
+        dev->trace_period_ms = 1;
+    }
+}
+
+static void adxl_sample(adxl343_t *dev, float g[3])
+{
+    uint32_t now_ms = (uint32_t)(sim_now_us() / 1000);
+    if (dev->trace_len > 0)
+    {
+        // Last sample at or before now (the trace holds between samples)
+        uint32_t t = now_ms % dev->trace_period_ms;
+        size_t lo = 0, hi = dev->trace_len;
+        while (hi - lo > 1)
+        {
+            size_t mid = (lo + hi) / 2;
+            if (dev->trace[mid].t_ms <= t)
+            {
+                lo = mid;
+            }
+            else
+            {
+                hi = mid;
+            }
+        }
+        memcpy(g, dev->trace[lo].g, sizeof(dev->trace[lo].g));
+        return;
+    }
+
+    float t = now_ms / 1000.0f + dev->phase_s;
+    int phase = (int)(t / 30.0f) % 3;
+    if (phase == 0)
+    {
+        // Sleeping: flat and still
+        g[0] = 0.02f;
+        g[1] = 0.02f;
+        g[2] = 0.98f;
+    }
+    else if (phase == 1)
+    {
+        // Wandering: strong fore-aft swing at a walking cadence
+        g[0] = 0.45f * sinf(2.0f * (float)M_PI * 1.6f * t);
+        g[1] = 0.30f * cosf(2.0f * (float)M_PI * 0.8f * t);
+        g[2] = 0.95f;
+    }
+    else
+    {
+        // Moonwalking: upright, gravity along -X
+        g[0] = -0.98f;
+        g[1] = 0.05f;
+        g[2] = 0.10f;
+    }
+    for (int axis = 0; axis < 3; axis++)
+    {
+        g[axis] += 0.02f * frand();
+    }
+}
+
+static void adxl_latch(adxl343_t *dev)
+{
+    float g[3];
+    adxl_sample(dev, g);
+    for (int axis = 0; axis < 3; axis++)
+    {
+        // Full resolution: 4 mg/LSB regardless of range
+        long raw = lroundf(g[axis] / ADXL343_MG2G_MULTIPLIER);
+        raw = (raw > 4095) ? 4095 : (raw < -4096) ? -4096 : raw;
+        uint16_t word = (uint16_t)(int16_t)raw;
+        dev->regs[ADXL343_REG_DATAX0 + 2 * axis] = word & 0xFF;
+        dev->regs[ADXL343_REG_DATAX0 + 2 * axis + 1] = word >> 8;
+    }
+}
+
+static void adxl_start(void *ctx, bool read)
+{
+    adxl343_t *dev = ctx;
+    if (!read)
+    {
+        dev->pointer_set = false;
+    }
+}
+
+static void adxl_write(void *ctx, uint8_t byte)
+{
+    adxl343_t *dev = ctx;
+    if (!dev->pointer_set)
+    {
+        dev->pointer = byte & 0x3F;
+        dev->pointer_set = true;
+        return;
+    }
+    // DEVID and the data registers are read-only
+    if (dev->pointer != ADXL343_REG_DEVID && (dev->pointer < ADXL343_REG_DATAX0 || dev->pointer > ADXL343_REG_DATAZ1))
+    {
+        dev->regs[dev->pointer] = byte;
+    }
+    dev->pointer = (dev->pointer + 1) & 0x3F;
+}
+
+static uint8_t adxl_read(void *ctx)
+{
+    adxl343_t *dev = ctx;
+    if (dev->pointer == ADXL343_REG_DATAX0)
+    {
+        adxl_latch(dev);
+    }
+    uint8_t value = dev->regs[dev->pointer];
+    dev->pointer = (dev->pointer + 1) & 0x3F;
+    return value;
+}
+
+// HT16K33 /////////////////////////////////////////////////////////////////////
+
+typedef struct
+{
+    uint8_t ram[16];
+    uint8_t pointer;
+    bool first_byte;
+    bool is_ram_write;
+    bool dirty;
+    bool oscillator_on;
+    bool display_on;
+    uint8_t brightness;
+    uint64_t frames;
+    FILE *log;
+} ht16k33_t;
+
+static ht16k33_t s_display;
+
+static char decode_segments(uint16_t segments)
+{
+    if (segments == 0)
+    {
+        return ' ';
+    }
+    for (char c = '!'; c <= '~'; c++)
+    {
+        if (encode_character(c) == segments)
+        {
+            return c;
+        }
+    }
+    return '?';
+}
+
+static void ht16k33_start(void *ctx, bool read)
+{
+    ht16k33_t *dev = ctx;
+    dev->first_byte = true;
+    dev->is_ram_write = false;
+}
+
+static void ht16k33_write(void *ctx, uint8_t byte)
+{
+    ht16k33_t *dev = ctx;
+    if (dev->first_byte)
+    {
+        dev->first_byte = false;
+        switch (byte & 0xF0)
+        {
+        case 0x00: // Display RAM address pointer
+            dev->pointer = byte & 0x0F;
+            dev->is_ram_write = true;
+            break;
+        case 0x20: // System setup
+            dev->oscillator_on = byte & 0x01;
+            break;
+        case 0x80: // Display setup
+            dev->display_on = byte & 0x01;
+            break;
+        case 0xE0: // Dimming
+            dev->brightness = byte & 0x0F;
+            break;
+        default:
+            break;
+        }
+        return;
+    }
+    if (dev->is_ram_write)
+    {
+        if (dev->ram[dev->pointer] != byte)
+        {
+            dev->ram[dev->pointer] = byte;
+            dev->dirty = true;
+        }
+        dev->pointer = (dev->pointer + 1) & 0x0F;
+    }
+}
+
+static void ht16k33_stop(void *ctx)
+{
+    ht16k33_t *dev = ctx;
+    if (!dev->dirty)
+    {
+        return;
+    }
+    dev->dirty = false;
+    dev->frames++;
+    if (dev->log == NULL)
+    {
+        return;
+    }
+
+    char text[5];
+    uint16_t words[4];
+    for (int i = 0; i < 4; i++)
+    {
+        words[i] = dev->ram[2 * i] | (dev->ram[2 * i + 1] << 8);
+        text[i] = decode_segments(words[i]);
+    }
+    text[4] = '\0';
+    fprintf(dev->log, "%lld\t%s\t%04x %04x %04x %04x\n", (long long)(sim_now_us() / 1000), text,
+            words[0], words[1], words[2], words[3]);
+    fflush(dev->log);
+}
+
+// Thermistor ADC //////////////////////////////////////////////////////////////
+
+static uint64_t s_adc_reads;
+
+static int thermistor_raw(void)
+{
+    float t_s = sim_now_us() / 1e6f;
+    float temp_f = 80.0f + 3.0f * sinf(2.0f * (float)M_PI * t_s / 600.0f) + 0.3f * frand();
+    float kelvin = (temp_f - 32.0f) * 5.0f / 9.0f + 273.15f;
+    float ohms = THERMISTOR_NOMINAL_OHMS * expf(THERMISTOR_BETA * (1.0f / kelvin - 1.0f / THERMISTOR_NOMINAL_K));
+    float mv = THERMISTOR_SUPPLY_MV * ohms / (THERMISTOR_SERIES_OHMS + ohms);
+    int raw = (int)lroundf(mv * ADC_MAX_RAW / ADC_FULL_SCALE_MV);
+
+    // Wi-Fi TX current spike roughly once every 200 reads
+    if (frand() > 0.99f)
+    {
+        raw += 200;
+    }
+    return (raw < 0) ? 0 : (raw > ADC_MAX_RAW) ? ADC_MAX_RAW : raw;
+}
+
+esp_err_t adc_oneshot_new_unit(const adc_oneshot_unit_init_cfg_t *config, adc_oneshot_unit_handle_t *out)
+{
+    static int unit_placeholder;
+    *out = (adc_oneshot_unit_handle_t)&unit_placeholder;
+    return ESP_OK;
+}
+
+esp_err_t adc_oneshot_config_channel(adc_oneshot_unit_handle_t handle, adc_channel_t channel,
+                                     const adc_oneshot_chan_cfg_t *config)
+{
+    return ESP_OK;
+}
+
+esp_err_t adc_oneshot_read(adc_oneshot_unit_handle_t handle, adc_channel_t channel, int *out_raw)
+{
+    s_adc_reads++;
+    *out_raw = (channel == ADC_CHANNEL_6) ? thermistor_raw() : ADC_MAX_RAW / 2;
+    return ESP_OK;
+}
+
+esp_err_t adc_cali_create_scheme_line_fitting(const adc_cali_line_fitting_config_t *config, adc_cali_handle_t *out)
+{
+    static int cali_placeholder;
+    *out = (adc_cali_handle_t)&cali_placeholder;
+    return ESP_OK;
+}
+
+esp_err_t adc_cali_raw_to_voltage(adc_cali_handle_t handle, int raw, int *out_mv)
+{
+    *out_mv = (int)lroundf(raw * ADC_FULL_SCALE_MV / ADC_MAX_RAW);
+    return ESP_OK;
+}
+
+// Setup ///////////////////////////////////////////////////////////////////////
+
+void sim_peripherals_init(void)
+{
+    // Seed from the cat ID so every collar moves differently but reproducibly
+    uint32_t seed = 2166136261u;
+    for (const char *p = g_sim.id; *p != '\0'; p++)
+    {
+        seed = (seed ^ (uint8_t)*p) * 16777619u;
+    }
+    s_rng_state = seed ? seed : 1;
+
+    s_adxl.regs[ADXL343_REG_DEVID] = 0xE5;
+    s_adxl.regs[ADXL343_REG_BW_RATE] = 0x0A;
+    s_adxl.phase_s = (float)(seed % 90);
+    if (g_sim.trace_path != NULL)
+    {
+        adxl_load_trace(&s_adxl, g_sim.trace_path);
+    }
+    sim_i2c_attach(&(sim_i2c_device_t){
+        .address = ADXL343_ADDRESS,
+        .ctx = &s_adxl,
+        .start = adxl_start,
+        .write = adxl_write,
+        .read = adxl_read,
+    });
+
+    s_display.log = sim_open_log("display");
+    sim_i2c_attach(&(sim_i2c_device_t){
+        .address = 0x70,
+        .ctx = &s_display,
+        .start = ht16k33_start,
+        .write = ht16k33_write,
+        .stop = ht16k33_stop,
+    });
+}
+
+void sim_peripherals_report(FILE *out)
+{
+    sim_i2c_report(out);
+    fprintf(out, ",\"display_frames\":%llu,\"adc_reads\":%llu",
+            (unsigned long long)s_display.frames, (unsigned long long)s_adc_reads);
+}
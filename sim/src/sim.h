@@ -0,0 +1,102 @@
+/*
+  Host simulator internals shared by the sources in sim/src.
+
+  One process simulates one collar: main/ keeps its globals, so collars are
+  isolated by running one process each (tools/sim_fleet.js starts many).
+*/
+
+#ifndef SIM_H
+#define SIM_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+typedef struct
+{
+    const char *id;            // Cat ID, also names the per-collar files in out_dir
+    const char *server;        // Host for UDP status and the WebSocket (seeds the config)
+    int udp_port;              // Collar UDP port (seeds the config)
+    const char *ws_uri;        // Overrides ws://<server>:3000/buzz
+    const char *trace_path;    // ADXL343 trace, CSV "t_ms,x_g,y_g,z_g"; synthetic motion if NULL
+    const char *button_script; // Button script, lines "<t_ms> press|release|click|double|long"
+    const char *out_dir;       // NVS, display frames, GPIO log
+    int duration_s;            // 0 runs until SIGINT/SIGTERM
+    int udp_bind_offset;       // Added to every UDP listen port
+    bool fresh;                // Erase NVS and reflash ota_0 before booting
+    const char *uart_link;     // Symlink to the pty standing in for UART0; NULL keeps it on stdout
+    int uart_baud;             // Binary UART stream baud with uart_link (seeds the config)
+    int relay_mode;            // ESP-NOW relay role, relay_mode_t (seeds the config)
+    bool no_ap;                // The access point is out of range: association always fails
+    int assoc_ms;              // Association and DHCP take this long (0: at once)
+    int espnow_base;           // ESP-NOW "air" port of collar N is espnow_base + N
+    int espnow_nodes;          // Broadcasts reach collars 1..espnow_nodes
+} sim_options_t;
+
+extern sim_options_t g_sim;
+
+// Time ////////////////////////////////////////////////////////////////////////
+
+int64_t sim_monotonic_us(void);
+int64_t sim_now_us(void); // Since the simulated boot
+void sim_sleep_until_us(int64_t boot_us);
+void sim_sleep_us(int64_t us);
+
+// Output files ////////////////////////////////////////////////////////////////
+
+// <out_dir>/collar-<id>.<suffix>
+void sim_out_path(char *buf, size_t len, const char *suffix);
+FILE *sim_open_log(const char *suffix);
+
+// Subsystems //////////////////////////////////////////////////////////////////
+
+void sim_freertos_init(void);
+void sim_freertos_report(FILE *out);
+
+void sim_nvs_seed_config(void);
+
+void sim_peripherals_init(void);
+void sim_peripherals_report(FILE *out);
+
+void sim_gpio_drive(int gpio, int level);
+void sim_gpio_start_button_script(int gpio, const char *path);
+void sim_gpio_close(void);
+void sim_gpio_report(FILE *out);
+
+void sim_uart_report(FILE *out);
+
+void sim_net_report(FILE *out); // Also the network task's "net" object
+
+// Wi-Fi channel the station is on (set by the firmware, the AP's before that)
+int sim_wifi_channel(void);
+void sim_espnow_mac(uint8_t mac[6]); // 02:53:49:4D followed by the cat ID
+void sim_espnow_report(FILE *out);
+void sim_ws_report(FILE *out); // From the network task, in net_sim.c
+void sim_http_report(FILE *out);
+
+// Bootloader: pick the app slot from otadata and exec it if it is not this image
+void sim_ota_boot(char **argv);
+void sim_ota_report(FILE *out);
+
+void sim_heap_report(FILE *out);
+
+// I2C device models attach to the simulated bus by 7-bit address
+typedef struct
+{
+    uint8_t address;
+    void *ctx;
+    void (*start)(void *ctx, bool read); // Address phase after (repeated) START
+    void (*write)(void *ctx, uint8_t byte);
+    uint8_t (*read)(void *ctx);
+    void (*stop)(void *ctx);
+} sim_i2c_device_t;
+
+void sim_i2c_attach(const sim_i2c_device_t *device);
+void sim_i2c_report(FILE *out);
+
+// Print the exit report (one "SIMREPORT {json}" line) on the process's stdout,
+// even after the firmware has rerouted stdout into the UART stream
+void sim_report(void);
+
+#endif // SIM_H
@@ -0,0 +1,361 @@
+/*
+  Entry point: parse options, provision NVS for this collar, bring up the fake
+  hardware, then run the unmodified app_main() and wait for a signal or the
+  configured duration. On exit one "SIMREPORT {json}" line is printed on stdout
+  for tools/sim_fleet.js to aggregate.
+*/
+
+#define _GNU_SOURCE
+
+#include <dirent.h>
+#include <errno.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "esp_system.h"
+#include "nvs_flash.h"
+
+#include "./sim.h"
+
+#define BUTTON_GPIO 15 // As wired in CatCollar.c
+#define SHUTDOWN_HANDLERS 5 // As many as ESP-IDF takes
+
+void app_main(void);
+
+sim_options_t g_sim = {
+    .id = "1",
+    .server = "127.0.0.1",
+    .udp_port = 3333,
+    .out_dir = "sim_out",
+    .udp_bind_offset = 10000,
+    .uart_baud = 921600,
+    .espnow_base = 47000,
+    .espnow_nodes = 64,
+};
+
+static char **s_argv;
+static FILE *s_stdout; // stdout as the process started, before app_main() can reassign it
+static shutdown_handler_t s_shutdown_handlers[SHUTDOWN_HANDLERS];
+
+// Output files ////////////////////////////////////////////////////////////////
+
+void sim_out_path(char *buf, size_t len, const char *suffix)
+{
+    snprintf(buf, len, "%s/collar-%s.%s", g_sim.out_dir, g_sim.id, suffix);
+}
+
+FILE *sim_open_log(const char *suffix)
+{
+    char path[512];
+    sim_out_path(path, sizeof(path), suffix);
+    FILE *f = fopen(path, "a");
+    if (f == NULL)
+    {
+        fprintf(stderr, "sim: cannot open %s: %s\n", path, strerror(errno));
+    }
+    return f;
+}
+
+// Report //////////////////////////////////////////////////////////////////////
+
+void sim_report(void)
+{
+    // Built in memory so that concurrent log lines cannot split it
+    char *json = NULL;
+    size_t json_len = 0;
+    FILE *out = open_memstream(&json, &json_len);
+    fprintf(out, "SIMREPORT {\"id\":\"%s\",\"uptime_s\":%.3f,", g_sim.id, sim_now_us() / 1e6);
+    sim_freertos_report(out);
+    fputc(',', out);
+    sim_peripherals_report(out);
+    fputc(',', out);
+    sim_gpio_report(out);
+    fputc(',', out);
+    sim_uart_report(out);
+    fputc(',', out);
+    sim_net_report(out);
+    fputc(',', out);
+    sim_ws_report(out);
+    fputc(',', out);
+    sim_http_report(out);
+    fputc(',', out);
+    sim_ota_report(out);
+    fputc(',', out);
+    sim_heap_report(out);
+    fputc(',', out);
+    sim_espnow_report(out);
+    fputs("}\n", out);
+    fclose(out);
+
+    fflush(s_stdout);
+    fwrite(json, 1, json_len, s_stdout);
+    fflush(s_stdout);
+    free(json);
+}
+
+esp_err_t esp_register_shutdown_handler(shutdown_handler_t handler)
+{
+    for (int i = 0; i < SHUTDOWN_HANDLERS; i++)
+    {
+        if (s_shutdown_handlers[i] == NULL)
+        {
+            s_shutdown_handlers[i] = handler;
+            return ESP_OK;
+        }
+    }
+    return ESP_ERR_NO_MEM;
+}
+
+static void run_shutdown_handlers(void)
+{
+    for (int i = SHUTDOWN_HANDLERS - 1; i >= 0; i--)
+    {
+        if (s_shutdown_handlers[i] != NULL)
+        {
+            s_shutdown_handlers[i]();
+        }
+    }
+}
+
+// Restart the collar: NVS and the app slots are kept, sim_ota_boot() picks the image
+void esp_restart(void)
+{
+    run_shutdown_handlers();
+    sim_report();
+    sim_gpio_close();
+
+    // Sockets must go or the new image cannot bind its listeners again
+    DIR *fds = opendir("/proc/self/fd");
+    if (fds != NULL)
+    {
+        int keep = dirfd(fds);
+        struct dirent *entry;
+        while ((entry = readdir(fds)) != NULL)
+        {
+            int fd = atoi(entry->d_name);
+            if (fd > STDERR_FILENO && fd != keep)
+            {
+                close(fd);
+            }
+        }
+        closedir(fds);
+    }
+
+    // Drop --fresh so the restart boots from what the firmware persisted
+    int argc = 0;
+    while (s_argv[argc] != NULL)
+    {
+        argc++;
+    }
+    char **argv = calloc(argc + 1, sizeof(*argv));
+    int out = 0;
+    for (int i = 0; i < argc; i++)
+    {
+        if (strcmp(s_argv[i], "--fresh") != 0)
+        {
+            argv[out++] = s_argv[i];
+        }
+    }
+    execv("/proc/self/exe", argv);
+    fprintf(stderr, "sim: restart failed: %s\n", strerror(errno));
+    _exit(1);
+}
+
+// Options /////////////////////////////////////////////////////////////////////
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "usage: %s [options]\n"
+            "  --id ID               cat ID (default 1)\n"
+            "  --server HOST         server for UDP status and the WebSocket (default 127.0.0.1)\n"
+            "  --port PORT           collar UDP port (default 3333)\n"
+            "  --ws-uri URI          WebSocket URI (default ws://HOST:3000/buzz)\n"
+            "  --trace FILE          ADXL343 trace, CSV t_ms,x_g,y_g,z_g (default synthetic motion)\n"
+            "  --button-script FILE  button actions, lines \"<t_ms> press|release|click|double|long\"\n"
+            "  --out DIR             NVS and logs (default sim_out)\n"
+            "  --duration S          exit after S seconds (default: run until SIGINT/SIGTERM)\n"
+            "  --udp-bind-offset N   added to UDP listen ports (default 10000)\n"
+            "  --uart LINK           UART0 on a pty symlinked at LINK, as a binary stream (default: console)\n"
+            "  --uart-baud N         stream baud with --uart (default 921600)\n"
+            "  --relay MODE          ESP-NOW relay: off, leaf, gateway or auto (default off)\n"
+            "  --no-ap               the access point is out of range (association fails)\n"
+            "  --assoc-ms N          each association attempt, with DHCP, takes N ms (default 0)\n"
+            "  --espnow-base PORT    ESP-NOW air port of collar N is PORT + N (default 47000)\n"
+            "  --espnow-nodes N      broadcasts reach collars 1..N (default 64)\n"
+            "  --fresh               erase NVS and reflash ota_0 with this binary before booting\n",
+            prog);
+}
+
+static int relay_mode_arg(const char *arg)
+{
+    static const char *const modes[] = {"off", "leaf", "gateway", "auto"}; // relay_mode_t order
+    for (int i = 0; i < 4; i++)
+    {
+        if (strcmp(arg, modes[i]) == 0)
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static void parse_options(int argc, char **argv)
+{
+    static const struct option options[] = {
+        {"id", required_argument, NULL, 'i'},
+        {"server", required_argument, NULL, 's'},
+        {"port", required_argument, NULL, 'p'},
+        {"ws-uri", required_argument, NULL, 'w'},
+        {"trace", required_argument, NULL, 't'},
+        {"button-script", required_argument, NULL, 'b'},
+        {"out", required_argument, NULL, 'o'},
+        {"duration", required_argument, NULL, 'd'},
+        {"udp-bind-offset", required_argument, NULL, 'u'},
+        {"uart", required_argument, NULL, 'U'},
+        {"uart-baud", required_argument, NULL, 'B'},
+        {"relay", required_argument, NULL, 'r'},
+        {"no-ap", no_argument, NULL, 'n'},
+        {"assoc-ms", required_argument, NULL, 'a'},
+        {"espnow-base", required_argument, NULL, 'e'},
+        {"espnow-nodes", required_argument, NULL, 'N'},
+        {"fresh", no_argument, NULL, 'f'},
+        {"help", no_argument, NULL, 'h'},
+        {NULL, 0, NULL, 0},
+    };
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "", options, NULL)) != -1)
+    {
+        switch (opt)
+        {
+        case 'i':
+            g_sim.id = optarg;
+            break;
+        case 's':
+            g_sim.server = optarg;
+            break;
+        case 'p':
+            g_sim.udp_port = atoi(optarg);
+            break;
+        case 'w':
+            g_sim.ws_uri = optarg;
+            break;
+        case 't':
+            g_sim.trace_path = optarg;
+            break;
+        case 'b':
+            g_sim.button_script = optarg;
+            break;
+        case 'o':
+            g_sim.out_dir = optarg;
+            break;
+        case 'd':
+            g_sim.duration_s = atoi(optarg);
+            break;
+        case 'u':
+            g_sim.udp_bind_offset = atoi(optarg);
+            break;
+        case 'U':
+            g_sim.uart_link = optarg;
+            break;
+        case 'B':
+            g_sim.uart_baud = atoi(optarg);
+            break;
+        case 'r':
+            g_sim.relay_mode = relay_mode_arg(optarg);
+            if (g_sim.relay_mode < 0)
+            {
+                usage(argv[0]);
+                exit(2);
+            }
+            break;
+        case 'n':
+            g_sim.no_ap = true;
+            break;
+        case 'a':
+            g_sim.assoc_ms = atoi(optarg);
+            break;
+        case 'e':
+            g_sim.espnow_base = atoi(optarg);
+            break;
+        case 'N':
+            g_sim.espnow_nodes = atoi(optarg);
+            break;
+        case 'f':
+            g_sim.fresh = true;
+            break;
+        case 'h':
+            usage(argv[0]);
+            exit(0);
+        default:
+            usage(argv[0]);
+            exit(2);
+        }
+    }
+}
+
+int main(int argc, char **argv)
+{
+    s_argv = argv;
+    parse_options(argc, argv);
+
+    // Block termination signals before any task exists so only main() sees them
+    sigset_t stop_signals;
+    sigemptyset(&stop_signals);
+    sigaddset(&stop_signals, SIGINT);
+    sigaddset(&stop_signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &stop_signals, NULL);
+    signal(SIGPIPE, SIG_IGN);
+    setvbuf(stdout, NULL, _IOLBF, 0);
+    s_stdout = stdout;
+
+    sim_freertos_init();
+    if (mkdir(g_sim.out_dir, 0755) != 0 && errno != EEXIST)
+    {
+        fprintf(stderr, "sim: cannot create %s: %s\n", g_sim.out_dir, strerror(errno));
+        return 1;
+    }
+    sim_ota_boot(argv);
+    if (g_sim.fresh)
+    {
+        nvs_flash_erase();
+    }
+    sim_nvs_seed_config();
+    sim_peripherals_init();
+    sim_gpio_start_button_script(BUTTON_GPIO, g_sim.button_script);
+
+    app_main();
+
+    // app_main() returns once its tasks are running, as on the target
+    if (g_sim.duration_s > 0)
+    {
+        struct timespec timeout = {.tv_sec = g_sim.duration_s};
+        int64_t end_us = sim_now_us() + (int64_t)g_sim.duration_s * 1000000;
+        while (sigtimedwait(&stop_signals, NULL, &timeout) < 0 && errno == EINTR)
+        {
+            int64_t left_us = end_us - sim_now_us();
+            if (left_us <= 0)
+            {
+                break;
+            }
+            timeout = (struct timespec){.tv_sec = left_us / 1000000, .tv_nsec = (left_us % 1000000) * 1000};
+        }
+    }
+    else
+    {
+        int sig;
+        sigwait(&stop_signals, &sig);
+    }
+
+    run_shutdown_handlers();
+    sim_report();
+    sim_gpio_close();
+    _exit(0);
+}
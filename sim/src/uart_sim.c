@@ -0,0 +1,337 @@
+/*
+  UART driver on a pseudo-terminal.
+
+  Without --uart, writes go straight to the process's stdout and reads return
+  no data, which is all the text console needs. With --uart LINK, UART0 is a
+  pty whose slave end is symlinked at LINK (kept across simulated restarts) so
+  host tools open it like a USB serial adapter:
+
+  - TX: uart_write_bytes() copies into a ring the size of the driver's TX
+    buffer, and a writer thread drains it into the pty at the configured baud
+    (10 bits per byte). Bytes the host is too slow to take are discarded, as a
+    real line would.
+  - RX: a reader thread fills a ring the size of the RX buffer and posts
+    UART_DATA (or UART_BUFFER_FULL) to the driver's event queue.
+*/
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/param.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include "driver/uart.h"
+#include "freertos/queue.h"
+#include "freertos/task.h"
+
+#include "./sim.h"
+
+#define UART_DEFAULT_BUF 256
+#define UART_WRITER_CHUNK 1024
+
+typedef struct
+{
+    uint8_t *data;
+    size_t size;
+    size_t head; // Next write
+    size_t count;
+} ring_t;
+
+static struct
+{
+    int master; // -1 without --uart
+    int baud;
+    QueueHandle_t events;
+    pthread_mutex_t lock;
+    pthread_cond_t tx_ready;
+    pthread_cond_t tx_empty;
+    ring_t tx;
+    ring_t rx;
+    bool tx_busy; // Writer holds bytes taken from the ring
+} s_uart = {
+    .master = -1,
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .tx_ready = PTHREAD_COND_INITIALIZER,
+    .tx_empty = PTHREAD_COND_INITIALIZER,
+};
+
+static atomic_ullong s_tx_bytes;
+static atomic_ullong s_tx_discarded;
+static atomic_ullong s_rx_bytes;
+static atomic_ullong s_rx_overflows;
+
+static void ring_init(ring_t *r, int size)
+{
+    r->size = size > 0 ? (size_t)size : UART_DEFAULT_BUF;
+    r->data = malloc(r->size);
+    r->head = 0;
+    r->count = 0;
+}
+
+static size_t ring_put(ring_t *r, const uint8_t *src, size_t len)
+{
+    size_t n = MIN(len, r->size - r->count);
+    for (size_t i = 0; i < n; i++)
+    {
+        r->data[(r->head + i) % r->size] = src[i];
+    }
+    r->head = (r->head + n) % r->size;
+    r->count += n;
+    return n;
+}
+
+static size_t ring_get(ring_t *r, uint8_t *dst, size_t len)
+{
+    size_t n = MIN(len, r->count);
+    size_t tail = (r->head + r->size - r->count) % r->size;
+    for (size_t i = 0; i < n; i++)
+    {
+        dst[i] = r->data[(tail + i) % r->size];
+    }
+    r->count -= n;
+    return n;
+}
+
+// Threads /////////////////////////////////////////////////////////////////////
+
+static void *writer_thread(void *arg)
+{
+    uint8_t chunk[UART_WRITER_CHUNK];
+    double bytes_per_us = s_uart.baud / 10.0 / 1e6;
+    int64_t line_free_us = sim_monotonic_us(); // When the line finishes what was written so far
+    while (1)
+    {
+        pthread_mutex_lock(&s_uart.lock);
+        s_uart.tx_busy = false;
+        pthread_cond_broadcast(&s_uart.tx_empty);
+        while (s_uart.tx.count == 0)
+        {
+            pthread_cond_wait(&s_uart.tx_ready, &s_uart.lock);
+        }
+        // About a millisecond of line time per write keeps the pacing smooth
+        size_t want = MIN(sizeof(chunk), (size_t)(bytes_per_us * 1000) + 1);
+        size_t n = ring_get(&s_uart.tx, chunk, want);
+        s_uart.tx_busy = true;
+        pthread_mutex_unlock(&s_uart.lock);
+
+        int64_t now = sim_monotonic_us();
+        if (line_free_us > now)
+        {
+            sim_sleep_us(line_free_us - now);
+        }
+        else
+        {
+            line_free_us = now; // Idle line: no credit for the gap
+        }
+        line_free_us += (int64_t)(n / bytes_per_us);
+
+        ssize_t written = write(s_uart.master, chunk, n);
+        if (written > 0)
+        {
+            s_tx_bytes += written;
+        }
+        s_tx_discarded += written < 0 ? n : n - written;
+    }
+    return NULL;
+}
+
+static void *reader_thread(void *arg)
+{
+    uint8_t chunk[UART_DEFAULT_BUF];
+    struct pollfd pfd = {.fd = s_uart.master, .events = POLLIN};
+    while (1)
+    {
+        if (poll(&pfd, 1, -1) < 0)
+        {
+            continue;
+        }
+        ssize_t n = read(s_uart.master, chunk, sizeof(chunk));
+        if (n <= 0)
+        {
+            sim_sleep_us(10000); // No host attached (EIO) or a spurious wakeup
+            continue;
+        }
+        s_rx_bytes += n;
+
+        pthread_mutex_lock(&s_uart.lock);
+        size_t stored = ring_put(&s_uart.rx, chunk, n);
+        pthread_mutex_unlock(&s_uart.lock);
+
+        uart_event_t event = {.type = UART_DATA, .size = stored};
+        if (stored < (size_t)n)
+        {
+            s_rx_overflows++;
+            event.type = UART_BUFFER_FULL;
+        }
+        if (s_uart.events != NULL)
+        {
+            xQueueSendFromISR(s_uart.events, &event, NULL);
+        }
+    }
+    return NULL;
+}
+
+static bool open_pty(void)
+{
+    int master = posix_openpt(O_RDWR | O_NOCTTY);
+    if (master < 0 || grantpt(master) != 0 || unlockpt(master) != 0)
+    {
+        fprintf(stderr, "sim: cannot open a pty: %s\n", strerror(errno));
+        return false;
+    }
+    const char *slave_path = ptsname(master);
+
+    // Holding the slave open keeps the master readable before a host attaches and after it leaves
+    int slave = open(slave_path, O_RDWR | O_NOCTTY);
+    struct termios tio;
+    if (slave >= 0 && tcgetattr(slave, &tio) == 0)
+    {
+        cfmakeraw(&tio);
+        tcsetattr(slave, TCSANOW, &tio);
+    }
+    fcntl(master, F_SETFL, fcntl(master, F_GETFL) | O_NONBLOCK);
+
+    unlink(g_sim.uart_link);
+    if (symlink(slave_path, g_sim.uart_link) != 0)
+    {
+        fprintf(stderr, "sim: cannot link %s: %s\n", g_sim.uart_link, strerror(errno));
+    }
+    fprintf(stderr, "sim: UART0 on %s (%s)\n", g_sim.uart_link, slave_path);
+    s_uart.master = master;
+    return true;
+}
+
+// Driver API //////////////////////////////////////////////////////////////////
+
+esp_err_t uart_driver_install(uart_port_t port, int rx_buf, int tx_buf, int queue_size, QueueHandle_t *queue,
+                              int flags)
+{
+    if (queue != NULL)
+    {
+        *queue = xQueueCreate(queue_size > 0 ? queue_size : 1, sizeof(uart_event_t));
+    }
+    if (port != UART_NUM_0 || g_sim.uart_link == NULL || s_uart.master >= 0 || !open_pty())
+    {
+        return ESP_OK;
+    }
+    s_uart.events = queue != NULL ? *queue : NULL;
+    ring_init(&s_uart.tx, tx_buf > 0 ? tx_buf : rx_buf);
+    ring_init(&s_uart.rx, rx_buf);
+    return ESP_OK;
+}
+
+esp_err_t uart_param_config(uart_port_t port, const uart_config_t *config)
+{
+    if (port != UART_NUM_0 || s_uart.master < 0 || s_uart.baud != 0)
+    {
+        return ESP_OK;
+    }
+    s_uart.baud = config->baud_rate > 0 ? config->baud_rate : 115200;
+    pthread_t thread;
+    pthread_create(&thread, NULL, writer_thread, NULL);
+    pthread_detach(thread);
+    pthread_create(&thread, NULL, reader_thread, NULL);
+    pthread_detach(thread);
+    return ESP_OK;
+}
+
+esp_err_t uart_set_pin(uart_port_t port, int tx, int rx, int rts, int cts)
+{
+    return ESP_OK;
+}
+
+int uart_write_bytes(uart_port_t port, const void *src, size_t size)
+{
+    if (port != UART_NUM_0 || s_uart.master < 0 || s_uart.baud == 0)
+    {
+        // Not through stdout: the firmware may have pointed stdout back at this UART
+        return (int)write(STDOUT_FILENO, src, size);
+    }
+    // Like the driver, block until the whole write fits
+    const uint8_t *p = src;
+    size_t done = 0;
+    pthread_mutex_lock(&s_uart.lock);
+    while (done < size)
+    {
+        size_t n = ring_put(&s_uart.tx, p + done, size - done);
+        done += n;
+        pthread_cond_signal(&s_uart.tx_ready);
+        if (done < size)
+        {
+            pthread_cond_wait(&s_uart.tx_empty, &s_uart.lock);
+        }
+    }
+    pthread_mutex_unlock(&s_uart.lock);
+    return (int)size;
+}
+
+esp_err_t uart_get_tx_buffer_free_size(uart_port_t port, size_t *size)
+{
+    pthread_mutex_lock(&s_uart.lock);
+    *size = s_uart.master >= 0 ? s_uart.tx.size - s_uart.tx.count : SIZE_MAX;
+    pthread_mutex_unlock(&s_uart.lock);
+    return ESP_OK;
+}
+
+int uart_read_bytes(uart_port_t port, void *buf, uint32_t length, TickType_t ticks)
+{
+    if (port != UART_NUM_0 || s_uart.master < 0)
+    {
+        if (ticks != portMAX_DELAY)
+        {
+            vTaskDelay(ticks);
+        }
+        return 0;
+    }
+    int64_t deadline_us = ticks == portMAX_DELAY ? INT64_MAX : sim_monotonic_us() + (int64_t)pdTICKS_TO_MS(ticks) * 1000;
+    pthread_mutex_lock(&s_uart.lock);
+    while (s_uart.rx.count < length && sim_monotonic_us() < deadline_us)
+    {
+        // The reader thread posts an event per chunk, so a short poll here costs little
+        pthread_mutex_unlock(&s_uart.lock);
+        sim_sleep_us(1000);
+        pthread_mutex_lock(&s_uart.lock);
+    }
+    int n = (int)ring_get(&s_uart.rx, buf, length);
+    pthread_mutex_unlock(&s_uart.lock);
+    return n;
+}
+
+esp_err_t uart_flush_input(uart_port_t port)
+{
+    pthread_mutex_lock(&s_uart.lock);
+    s_uart.rx.count = 0;
+    pthread_mutex_unlock(&s_uart.lock);
+    return ESP_OK;
+}
+
+esp_err_t uart_wait_tx_done(uart_port_t port, TickType_t ticks)
+{
+    if (s_uart.master < 0)
+    {
+        return ESP_OK;
+    }
+    pthread_mutex_lock(&s_uart.lock);
+    while (s_uart.tx.count > 0 || s_uart.tx_busy)
+    {
+        pthread_cond_wait(&s_uart.tx_empty, &s_uart.lock);
+    }
+    pthread_mutex_unlock(&s_uart.lock);
+    return ESP_OK;
+}
+
+// Report //////////////////////////////////////////////////////////////////////
+
+void sim_uart_report(FILE *out)
+{
+    fprintf(out, "\"uart\":{\"tx_bytes\":%llu,\"tx_discarded\":%llu,\"rx_bytes\":%llu,\"rx_overflows\":%llu}",
+            (unsigned long long)s_tx_bytes, (unsigned long long)s_tx_discarded, (unsigned long long)s_rx_bytes,
+            (unsigned long long)s_rx_overflows);
+}
@@ -0,0 +1,160 @@
+#!/usr/bin/env node
+// bench_analytics.js
+//
+// Query time of the activity analytics engine (lib/analytics.js) over a compacted
+// status log history, against re-parsing the raw text the way /chart does.
+//
+// Usage:
+//   node tools/bench_analytics.js [--cats 500] [--days 30] [--changes-per-hour 6]
+//                                 [--rotations-per-day 4] [--workers <n>] [--dir /tmp/bench_analytics]
+//
+// Each cat changes state at random, about --changes-per-hour times an hour, with a
+// night of sleep; the history is compacted day by day as LogStore would.
+
+const fs = require('fs');
+const os = require('os');
+const path = require('path');
+const { STATE_NAMES, aggregateStatusLog } = require('../lib/telemetry');
+const { compactDir } = require('../lib/log_segments');
+const { ActivityAnalytics, scanLines } = require('../lib/analytics');
+
+const DAY_MS = 86400000;
+const HOUR_MS = 3600000;
+
+function parseArgs(argv) {
+    const opts = {
+        cats: 500,
+        days: 30,
+        changesPerHour: 6,
+        rotationsPerDay: 4,
+        workers: Math.min(8, Math.max(1, os.cpus().length - 1)),
+        dir: path.join(os.tmpdir(), 'bench_analytics')
+    };
+    for (let i = 0; i < argv.length; i++) {
+        if (argv[i] === '--cats') {
+            opts.cats = parseInt(argv[++i], 10);
+        } else if (argv[i] === '--days') {
+            opts.days = parseInt(argv[++i], 10);
+        } else if (argv[i] === '--changes-per-hour') {
+            opts.changesPerHour = Number(argv[++i]);
+        } else if (argv[i] === '--rotations-per-day') {
+            opts.rotationsPerDay = parseInt(argv[++i], 10);
+        } else if (argv[i] === '--workers') {
+            opts.workers = parseInt(argv[++i], 10);
+        } else if (argv[i] === '--dir') {
+            opts.dir = argv[++i];
+        } else {
+            console.error(`Unknown argument: ${argv[i]}`);
+            process.exit(1);
+        }
+    }
+    return opts;
+}
+
+function pad(n) {
+    return String(n).padStart(2, '0');
+}
+
+function statusLine(port, ms, state, inStateS) {
+    const duration = `${pad(Math.floor(inStateS / 3600))}:${pad(Math.floor(inStateS / 60) % 60)}:${pad(inStateS % 60)}`;
+    return `Port ${port} | ID ${ms} | Message: ${duration}, Temperature: 80.50°F, Cat state: ${STATE_NAMES[state]}, Time: ${ms * 1000}\n`;
+}
+
+// One day of state changes for every cat, in arrival order
+function dayLines(opts, cats, dayStart) {
+    const events = [];
+    const meanGapMs = HOUR_MS / opts.changesPerHour;
+    cats.forEach((cat, c) => {
+        while (cat.next < dayStart + DAY_MS) {
+            const hour = Math.floor((cat.next % DAY_MS) / HOUR_MS);
+            // Mostly asleep at night, otherwise any state but the current one
+            const state = hour < 6 && Math.random() < 0.8 ? 0 : (cat.state + 1 + Math.floor(Math.random() * 2)) % 3;
+            const inStateS = Math.round((cat.next - cat.since) / 1000);
+            events.push({ ms: Math.round(cat.next), line: statusLine(3333 + c, Math.round(cat.next), state, inStateS) });
+            cat.since = cat.next;
+            cat.state = state;
+            cat.next += -Math.log(1 - Math.random()) * meanGapMs * (state === 0 ? 3 : 1);
+        }
+    });
+    events.sort((a, b) => a.ms - b.ms);
+    return events;
+}
+
+function time(fn) {
+    const start = process.hrtime.bigint();
+    return Promise.resolve(fn()).then(result => ({ result, ms: Number(process.hrtime.bigint() - start) / 1e6 }));
+}
+
+function mib(bytes) {
+    return `${(bytes / 1048576).toFixed(1)} MiB`;
+}
+
+async function main() {
+    const opts = parseArgs(process.argv.slice(2));
+    fs.rmSync(opts.dir, { recursive: true, force: true });
+    const logDir = path.join(opts.dir, 'logs', 'cat_status_log');
+    const livePath = path.join(opts.dir, 'cat_status_log.txt');
+    fs.mkdirSync(logDir, { recursive: true });
+
+    // History ending now, so the last day is today's open parts plus the live file
+    const todayStart = Math.floor(Date.now() / DAY_MS) * DAY_MS;
+    const firstDay = todayStart - (opts.days - 1) * DAY_MS;
+    const cats = Array.from({ length: opts.cats }, () => ({ state: 0, since: firstDay, next: firstDay + Math.random() * HOUR_MS }));
+    const rawChunks = [];
+    let lines = 0;
+    const genStart = Date.now();
+    for (let d = 0; d < opts.days; d++) {
+        const dayStart = firstDay + d * DAY_MS;
+        const events = dayLines(opts, cats, dayStart).filter(e => e.ms < Math.min(dayStart + DAY_MS, genStart));
+        lines += events.length;
+        for (let r = 0; r < opts.rotationsPerDay; r++) {
+            const rotatedMs = dayStart + Math.floor((r + 1) * DAY_MS / opts.rotationsPerDay) - 1;
+            const chunk = Buffer.from(events.filter(e => e.ms <= rotatedMs && e.ms > rotatedMs - DAY_MS / opts.rotationsPerDay)
+                .map(e => e.line).join(''));
+            rawChunks.push(chunk);
+            if (rotatedMs >= genStart) {
+                fs.writeFileSync(livePath, chunk); // The rest of today is still live
+                break;
+            }
+            fs.writeFileSync(path.join(logDir, `rotated-${rotatedMs}.log`), chunk);
+            compactDir(logDir, 'status', { now: rotatedMs + 1, rawDays: opts.days + 1 });
+        }
+    }
+    const raw = Buffer.concat(rawChunks);
+    const diskBytes = fs.readdirSync(logDir).reduce((sum, file) => sum + fs.statSync(path.join(logDir, file)).size, 0);
+    console.log(`${opts.cats} cats x ${opts.days} days: ${lines} status lines, ${mib(raw.length)} raw, ` +
+        `${mib(diskBytes)} compacted in ${fs.readdirSync(logDir).length} files`);
+
+    // What /chart did on every connection: parse the whole raw log, totals only
+    const chart = await time(() => aggregateStatusLog(raw));
+    // The same session analysis as the engine, but in one pass over the raw text
+    const single = await time(() => scanLines(raw));
+    console.log(`\n  raw text, totals only (old /chart)        ${chart.ms.toFixed(1).padStart(9)} ms`);
+    console.log(`  raw text, sessions in one pass             ${single.ms.toFixed(1).padStart(9)} ms`);
+
+    const store = { dir: logDir, livePath, ready: Promise.resolve() };
+    const range = { from: firstDay, to: todayStart };
+    const report = (label, { result, ms }) => {
+        console.log(`  ${label.padEnd(42)} ${ms.toFixed(1).padStart(9)} ms  (${Object.keys(result.cats).length} cats, ` +
+            `${result.stats.partitions} partitions)`);
+    };
+
+    for (const workers of [...new Set([0, opts.workers])]) {
+        const analytics = new ActivityAnalytics(store, { workers });
+        console.log(`\n  ${workers === 0 ? 'Scans on the main thread' : `${workers} scan worker(s)`}`);
+        report(`last ${opts.days} days, cold`, await time(() => analytics.query(range)));
+        report(`last ${opts.days} days, again (cached answer)`, await time(() => analytics.query(range)));
+        report('last 7 days (cached partitions)', await time(() => analytics.query({ to: todayStart })));
+        report('last 7 days, 10 cats', await time(() => analytics.query({ to: todayStart, cats: ['1', '2', '3', '3336', '3337', '3338', '3339', '3340', '3341', '3342'] })));
+        fs.appendFileSync(livePath, statusLine(3333, Date.now(), 1, 60));
+        analytics.liveRefreshMs = 0;
+        report(`last ${opts.days} days, after a live append`, await time(() => analytics.query(range)));
+        analytics.close();
+    }
+    console.log(`\n  This machine has ${os.cpus().length} core(s); scans spread over at most that many workers.`);
+}
+
+main().catch((err) => {
+    console.error(err);
+    process.exit(1);
+});
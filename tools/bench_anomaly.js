@@ -0,0 +1,223 @@
+#!/usr/bin/env node
+// bench_anomaly.js
+//
+// Replays a synthetic fleet through the streaming anomaly detector (lib/anomaly.js)
+// as fast as it will go. Reports records per second, memory per cat, detection delay
+// for injected anomalies, and false alerts on the cats left alone.
+//
+// Usage:
+//   node tools/bench_anomaly.js [--collars 2000] [--days 14] [--anomalies 100] [--seed 1]
+//
+// Cats follow a dawn/dusk activity rhythm and report on every state change, with the
+// collar temperature following the day. From a random time two to four days before the end,
+// --anomalies cats turn lethargic (a quarter of their usual activity) and another
+// --anomalies get a temperature drift of +0.5 °F/h, up to +3 °F.
+
+const v8 = require('v8');
+const vm = require('vm');
+const { AnomalyDetector, BIN_MS } = require('../lib/anomaly');
+
+const DAY_MS = 86400000;
+const HOUR_MS = 3600000;
+const START_MS = Date.UTC(2024, 0, 1);
+
+function parseArgs(argv) {
+    const opts = { collars: 2000, days: 14, anomalies: 100, seed: 1 };
+    for (let i = 0; i < argv.length; i++) {
+        if (argv[i] === '--collars') {
+            opts.collars = parseInt(argv[++i], 10);
+        } else if (argv[i] === '--days') {
+            opts.days = parseInt(argv[++i], 10);
+        } else if (argv[i] === '--anomalies') {
+            opts.anomalies = parseInt(argv[++i], 10);
+        } else if (argv[i] === '--seed') {
+            opts.seed = parseInt(argv[++i], 10);
+        } else {
+            console.error(`Unknown argument: ${argv[i]}`);
+            process.exit(1);
+        }
+    }
+    return opts;
+}
+
+// Small seeded PRNG (mulberry32) so runs are comparable
+function rng(seed) {
+    let a = seed >>> 0;
+    return () => {
+        a = (a + 0x6D2B79F5) >>> 0;
+        let t = a;
+        t = Math.imul(t ^ (t >>> 15), t | 1);
+        t ^= t + Math.imul(t ^ (t >>> 7), t | 61);
+        return ((t ^ (t >>> 14)) >>> 0) / 4294967296;
+    };
+}
+
+function gaussian(random) {
+    return Math.sqrt(-2 * Math.log(1 - random())) * Math.cos(2 * Math.PI * random());
+}
+
+// Chance a cat is up and about at this hour of its day: low overnight, peaks at dawn and dusk
+function activeChance(hour) {
+    const peak = (h, at) => Math.exp(-(((h - at + 36) % 24 - 12) ** 2) / 4);
+    return 0.12 + 0.5 * peak(hour, 6) + 0.45 * peak(hour, 19);
+}
+
+// Every record in time order as columns: t, cat, state, temperature
+function generate(opts, random) {
+    const endMs = START_MS + opts.days * DAY_MS;
+    const cats = Array.from({ length: opts.collars }, (_, c) => ({
+        c,
+        shiftH: (random() - 0.5) * 2,
+        scale: 0.7 + random() * 0.6,
+        tempBase: 79 + random() * 3,
+        state: 0,
+        next: START_MS + random() * HOUR_MS,
+        lethargicFrom: Infinity,
+        driftFrom: Infinity
+    }));
+    // The first --anomalies cats turn lethargic, the next --anomalies drift
+    const injectAt = () => endMs - 4 * DAY_MS + random() * 2 * DAY_MS;
+    cats.slice(0, opts.anomalies).forEach((cat) => {
+        cat.lethargicFrom = injectAt();
+    });
+    cats.slice(opts.anomalies, 2 * opts.anomalies).forEach((cat) => {
+        cat.driftFrom = injectAt();
+    });
+
+    // Binary heap of cats by next record time
+    const heap = cats.slice().sort((a, b) => a.next - b.next);
+    const siftDown = () => {
+        let i = 0;
+        for (;;) {
+            const l = 2 * i + 1;
+            const r = l + 1;
+            let m = i;
+            if (l < heap.length && heap[l].next < heap[m].next) m = l;
+            if (r < heap.length && heap[r].next < heap[m].next) m = r;
+            if (m === i) return;
+            [heap[i], heap[m]] = [heap[m], heap[i]];
+            i = m;
+        }
+    };
+
+    const records = { t: [], cat: [], state: [], temperature: [] };
+    while (heap[0].next < endMs) {
+        const cat = heap[0];
+        const t = cat.next;
+        const hour = ((t % DAY_MS) / HOUR_MS + cat.shiftH + 24) % 24;
+        let p = Math.min(0.95, activeChance(hour) * cat.scale);
+        const lethargic = t >= cat.lethargicFrom;
+        if (lethargic) {
+            p *= 0.25;
+        }
+
+        // Collars report only on a change of state
+        if (cat.state === 0) {
+            cat.state = random() < 0.75 ? 1 : 2;
+        } else {
+            cat.state = random() < p ? 3 - cat.state : 0;
+        }
+        const dwellMin = cat.state === 0 ? 20 + 100 * (1 - p) : (lethargic ? 4 : 8);
+        cat.next = t + Math.min(6 * HOUR_MS, -Math.log(1 - random()) * dwellMin * 60000);
+
+        const drift = t >= cat.driftFrom ? Math.min(3, 0.5 * (t - cat.driftFrom) / HOUR_MS) : 0;
+        const diurnal = 1.5 * Math.sin(2 * Math.PI * ((t % DAY_MS) / HOUR_MS - 9) / 24);
+        records.t.push(t);
+        records.cat.push(cat.c);
+        records.state.push(cat.state);
+        records.temperature.push(Math.round((cat.tempBase + diurnal + drift + 0.3 * gaussian(random)) * 100) / 100);
+        siftDown();
+    }
+    return {
+        cats,
+        t: Float64Array.from(records.t),
+        cat: Int32Array.from(records.cat),
+        state: Uint8Array.from(records.state),
+        temperature: Float32Array.from(records.temperature)
+    };
+}
+
+function pct(sorted, q) {
+    return sorted.length ? sorted[Math.min(sorted.length - 1, Math.floor(q * sorted.length))] : NaN;
+}
+
+function main() {
+    const opts = parseArgs(process.argv.slice(2));
+    const random = rng(opts.seed);
+    const data = generate(opts, random);
+    const sources = data.cats.map(cat => `10.0.${cat.c >> 8}.${cat.c & 255}:${3336 + cat.c}`);
+    console.log(`${opts.collars} collars x ${opts.days} days: ${data.t.length} records, ` +
+        `${opts.anomalies} lethargic and ${opts.anomalies} drifting for the last two to four days`);
+
+    // Heap per cat once every cat has a baseline
+    v8.setFlagsFromString('--expose-gc');
+    const gc = vm.runInNewContext('gc');
+    const used = () => {
+        gc();
+        const usage = process.memoryUsage();
+        return usage.heapUsed + usage.arrayBuffers;
+    };
+    const usedBefore = used();
+    const detector = new AnomalyDetector();
+    sources.forEach(source => detector.catOf(source));
+    const bytesPerCat = (used() - usedBefore) / opts.collars;
+
+    const raisedAlerts = [];
+    detector.on('alert', (alert) => {
+        if (alert.raised) {
+            raisedAlerts.push(alert);
+        }
+    });
+
+    // The server ticks on a timer; here the replay clock ticks once a bin
+    const start = process.hrtime.bigint();
+    let nextTick = START_MS + BIN_MS;
+    for (let i = 0; i < data.t.length; i++) {
+        const t = data.t[i];
+        while (t >= nextTick) {
+            detector.tick(nextTick);
+            nextTick += BIN_MS;
+        }
+        detector.update(sources[data.cat[i]], t, data.state[i], data.temperature[i]);
+    }
+    const seconds = Number(process.hrtime.bigint() - start) / 1e9;
+
+    const stats = detector.stats();
+    console.log(`\n  Replay          ${(data.t.length / seconds / 1e6).toFixed(2)} M records/s ` +
+        `(${seconds.toFixed(2)} s, ${stats.bins} bins closed), ${(seconds * 1e9 / data.t.length).toFixed(0)} ns/record`);
+    console.log(`  Memory          ${stats.bytesPerCat} bytes of baseline per cat, ` +
+        `${(bytesPerCat / 1024).toFixed(2)} KiB in all with its Map entry, whatever the history`);
+
+    // Detection delay in replay time, from injection to the matching alert
+    const bySource = new Map(sources.map((source, c) => [source, data.cats[c]]));
+    const report = (label, type, fromKey) => {
+        const injected = data.cats.filter(cat => cat[fromKey] < Infinity);
+        const delays = [];
+        for (const cat of injected) {
+            const hit = raisedAlerts.find(a => a.source === sources[cat.c] && a.type === type && Date.parse(a.time) >= cat[fromKey]);
+            if (hit) {
+                delays.push((Date.parse(hit.time) - cat[fromKey]) / HOUR_MS);
+            }
+        }
+        delays.sort((a, b) => a - b);
+        console.log(`  ${label.padEnd(15)} detected ${delays.length}/${injected.length}, delay p50 ${pct(delays, 0.5).toFixed(1)} h, ` +
+            `p90 ${pct(delays, 0.9).toFixed(1)} h`);
+    };
+    report('Lethargic', 'inactive', 'lethargicFrom');
+    report('Temp drift', 'temperature-high', 'driftFrom');
+
+    const falseAlerts = raisedAlerts.filter((a) => {
+        const cat = bySource.get(a.source);
+        const at = Date.parse(a.time);
+        return !((a.type === 'inactive' && at >= cat.lethargicFrom) || (a.type === 'temperature-high' && at >= cat.driftFrom));
+    });
+    const byType = {};
+    falseAlerts.forEach((a) => {
+        byType[a.type] = (byType[a.type] || 0) + 1;
+    });
+    const catDays = opts.collars * opts.days;
+    console.log(`  False alerts    ${falseAlerts.length} over ${catDays} cat-days ` +
+        `(${(falseAlerts.length / catDays * 100).toFixed(2)} per 100 cat-days) ${JSON.stringify(byType)}`);
+}
+
+main();
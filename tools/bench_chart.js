@@ -0,0 +1,195 @@
+#!/usr/bin/env node
+// bench_chart.js
+//
+// Runs the dashboard's strip chart (public/strip_chart.js) against a stand-in canvas on
+// a simulated 60 Hz clock, with synthetic collars pushed in batches as read_data.js
+// does. Reports the JavaScript cost of a frame and of a push, the canvas calls a frame
+// makes, and whether frames alone set off garbage collections. Rasterising is left to the browser;
+// public/bench_chart.html measures the real frame rate.
+//
+// For comparison it also times the old path's data step once, over the history the run
+// ends with: a point object for every record, rebuilt on every push before a new chart
+// was made from them.
+//
+// Usage:
+//   node tools/bench_chart.js [--collars 50] [--seconds 600] [--span 600] [--change 2]
+//                             [--batch 1000] [--width 1200] [--seed 1]
+//
+// --span is the seconds across the chart, --change the mean seconds between a collar's
+// state changes, and --batch the ms between pushes. Records reach the chart up to a
+// batch late, so most of them repaint part of a lane.
+
+const { PerformanceObserver } = require('perf_hooks');
+const { StripChart } = require('../public/strip_chart');
+
+const FRAME_MS = 1000 / 60;
+const HEIGHT = 500;
+
+function parseArgs(argv) {
+    const opts = { collars: 50, seconds: 600, span: 600, change: 2, batch: 1000, width: 1200, seed: 1 };
+    for (let i = 0; i < argv.length; i++) {
+        const key = argv[i].replace(/^--/, '');
+        if (argv[i].startsWith('--') && key in opts) {
+            opts[key] = Number(argv[++i]);
+        } else {
+            console.error(`Unknown argument: ${argv[i]}`);
+            process.exit(1);
+        }
+    }
+    return opts;
+}
+
+// Small seeded PRNG (mulberry32) so runs are comparable
+function rng(seed) {
+    let a = seed >>> 0;
+    return () => {
+        a = (a + 0x6D2B79F5) >>> 0;
+        let t = a;
+        t = Math.imul(t ^ (t >>> 15), t | 1);
+        t ^= t + Math.imul(t ^ (t >>> 7), t | 61);
+        return ((t ^ (t >>> 14)) >>> 0) / 4294967296;
+    };
+}
+
+// A 2D context that only counts what is drawn
+function fakeCanvas(width, height) {
+    const calls = { fillRect: 0, drawImage: 0, fillText: 0 };
+    const ctx = {
+        calls,
+        fillStyle: '',
+        font: '',
+        textAlign: '',
+        textBaseline: '',
+        setTransform() {},
+        clearRect() {},
+        fillRect() {
+            calls.fillRect++;
+        },
+        drawImage() {
+            calls.drawImage++;
+        },
+        fillText() {
+            calls.fillText++;
+        }
+    };
+    return { width, height, clientWidth: 0, clientHeight: 0, getContext: () => ctx };
+}
+
+function pct(values, p) {
+    const sorted = Float64Array.from(values).sort();
+    return sorted.length ? sorted[Math.min(sorted.length - 1, Math.floor(p * sorted.length))] : 0;
+}
+
+function main() {
+    const opts = parseArgs(process.argv.slice(2));
+    const random = rng(opts.seed);
+    const spanMs = opts.span * 1000;
+    const changeMs = opts.change * 1000;
+
+    let nowMs = Date.UTC(2024, 0, 1);
+    const startMs = nowMs;
+    const screen = fakeCanvas(opts.width, HEIGHT);
+    const ring = fakeCanvas(0, 0);
+    const chart = new StripChart(screen, {
+        spanMs,
+        maxCats: Math.max(64, opts.collars),
+        now: () => nowMs,
+        createCanvas: (width, height) => Object.assign(ring, { width, height })
+    });
+    const ctxCalls = [screen.getContext('2d').calls, ring.getContext('2d').calls];
+
+    // Each collar changes state after exponential gaps, from a span before the start
+    const sources = [];
+    const nextChange = new Float64Array(opts.collars);
+    for (let i = 0; i < opts.collars; i++) {
+        sources.push(`10.0.${i >> 8}.${i & 255}:${3333 + i}`);
+        nextChange[i] = startMs - spanMs + random() * changeMs;
+    }
+    const history = []; // What the old path rebuilt from: every record so far, as pushed
+    function batch() {
+        const grouped = {};
+        for (let i = 0; i < opts.collars; i++) {
+            while (nextChange[i] <= nowMs) {
+                const state = Math.floor(random() * 3);
+                (grouped[sources[i]] = grouped[sources[i]] || []).push({ time: new Date(nextChange[i]).toISOString(), state: StripChart.STATE_NAMES[state] });
+                nextChange[i] += -Math.log(1 - random()) * changeMs;
+            }
+        }
+        return grouped;
+    }
+
+    // Warm up over one span, then measure frames and pushes
+    const frameUs = [];
+    const pushUs = [];
+    let records = 0;
+    let nextBatchMs = nowMs;
+    const warmupFrames = Math.ceil(spanMs / FRAME_MS);
+    const measuredFrames = Math.ceil(opts.seconds * 1000 / FRAME_MS);
+    for (let f = 0; f < warmupFrames + measuredFrames; f++) {
+        const measuring = f >= warmupFrames;
+        if (f === warmupFrames) {
+            ctxCalls.forEach(calls => Object.keys(calls).forEach((key) => {
+                calls[key] = 0;
+            }));
+            Object.keys(chart.stats).forEach((key) => {
+                chart.stats[key] = 0;
+            });
+        }
+        nowMs = startMs + f * FRAME_MS;
+        if (nowMs >= nextBatchMs) {
+            nextBatchMs += opts.batch;
+            const data = JSON.parse(JSON.stringify(batch())); // As it comes off the socket
+            const start = process.hrtime.bigint();
+            Object.keys(data).forEach((source) => {
+                data[source].forEach((record) => {
+                    chart.add(source, Date.parse(record.time), StripChart.STATE_NAMES.indexOf(record.state));
+                    history.push(record);
+                });
+                records += measuring ? data[source].length : 0;
+            });
+            if (measuring) {
+                pushUs.push(Number(process.hrtime.bigint() - start) / 1000);
+            }
+        }
+        const start = process.hrtime.bigint();
+        chart.frame(nowMs - startMs);
+        if (measuring) {
+            frameUs.push(Number(process.hrtime.bigint() - start) / 1000);
+        }
+    }
+    const stats = { ...chart.stats };
+    const perFrame = ctxCalls.reduce((sum, calls) => sum + calls.fillRect + calls.drawImage + calls.fillText, 0) / measuredFrames;
+
+    // The old path, once, over the history the run ended with
+    let start = process.hrtime.bigint();
+    const points = history.map(record => ({ x: new Date(record.time), y: StripChart.STATE_NAMES.indexOf(record.state) }));
+    const rebuildMs = Number(process.hrtime.bigint() - start) / 1e6;
+
+    // Frames alone for 4 simulated hours: a frame that allocated would set off collections
+    let collections = 0;
+    const observer = new PerformanceObserver((list) => {
+        collections += list.getEntries().length;
+    });
+    const idleFrames = Math.ceil(4 * 3600000 / FRAME_MS);
+    const drawnBefore = chart.stats.frames;
+    observer.observe({ entryTypes: ['gc'] });
+    for (let f = 0; f < idleFrames; f++) {
+        nowMs += FRAME_MS;
+        chart.frame(nowMs - startMs);
+    }
+
+    setImmediate(() => {
+        observer.disconnect();
+        console.log(`${opts.collars} collars, ${opts.span} s across ${opts.width - 110} px, state changes every ${opts.change} s, ` +
+            `pushes every ${opts.batch} ms: ${records} records over ${opts.seconds} s at 60 Hz`);
+        console.log(`\n  Frames          ${measuredFrames}: ${stats.frames} drawn, ${stats.idle} idle, ${stats.repaints} full repaints, ` +
+            `${stats.columns} columns exposed, ${stats.late} late records`);
+        console.log(`  Frame cost      p50 ${pct(frameUs, 0.5).toFixed(1)} µs, p99 ${pct(frameUs, 0.99).toFixed(1)} µs, ` +
+            `max ${pct(frameUs, 1).toFixed(1)} µs, ${perFrame.toFixed(1)} canvas calls (budget ${(FRAME_MS * 1000).toFixed(0)} µs)`);
+        console.log(`  Push cost       p50 ${pct(pushUs, 0.5).toFixed(0)} µs, p99 ${pct(pushUs, 0.99).toFixed(0)} µs`);
+        console.log(`  Old rebuild     ${rebuildMs.toFixed(1)} ms for ${points.length} points per push, before drawing them`);
+        console.log(`  Without pushes  ${collections} collections over ${idleFrames} frames (${chart.stats.frames - drawnBefore} drawn)`);
+    });
+}
+
+main();
@@ -0,0 +1,152 @@
+#!/usr/bin/env node
+// bench_hls.js
+//
+// Load on the camera origin with and without the relay (lib/hls_relay.js): the
+// same viewers watch a live stream from tools/hls_origin.js, first directly,
+// then through the relay, and the origin's request and byte counts are compared.
+//
+// Usage:
+//   node tools/bench_hls.js [--viewers 50] [--duration 20] [--segment-ms 2000] [--bitrate 2000000]
+//
+// Viewers behave like hls.js on a live stream: reload the playlist every target
+// duration (half that when it has not changed) and fetch each new segment once.
+
+const express = require('express');
+const http = require('http');
+const { HlsRelay } = require('../lib/hls_relay');
+const { startOrigin } = require('./hls_origin');
+
+function parseArgs(argv) {
+    const opts = { viewers: 50, duration: 20, segmentMs: 2000, bitrate: 2000000 };
+    for (let i = 0; i < argv.length; i++) {
+        if (argv[i] === '--viewers') {
+            opts.viewers = parseInt(argv[++i], 10);
+        } else if (argv[i] === '--duration') {
+            opts.duration = parseInt(argv[++i], 10);
+        } else if (argv[i] === '--segment-ms') {
+            opts.segmentMs = parseInt(argv[++i], 10);
+        } else if (argv[i] === '--bitrate') {
+            opts.bitrate = parseInt(argv[++i], 10);
+        } else {
+            console.error(`Unknown argument: ${argv[i]}`);
+            process.exit(1);
+        }
+    }
+    return opts;
+}
+
+function get(url, agent, headers = {}) {
+    return new Promise((resolve, reject) => {
+        http.get(url, { agent, headers }, (res) => {
+            const chunks = [];
+            res.on('data', chunk => chunks.push(chunk));
+            res.on('end', () => resolve({ status: res.statusCode, headers: res.headers, body: Buffer.concat(chunks) }));
+            res.on('error', reject);
+        }).on('error', reject);
+    });
+}
+
+// One player until stopAt; returns { segments, bytes, errors, latencies }
+async function watch(playlistUrl, stopAt) {
+    const agent = new http.Agent({ keepAlive: true, maxSockets: 2 });
+    const seen = new Set();
+    const result = { segments: 0, bytes: 0, errors: 0, latencies: [] };
+    let lastPlaylist = '';
+    let etag = null;
+    while (Date.now() < stopAt) {
+        let targetMs = 2000;
+        try {
+            const res = await get(playlistUrl, agent, etag ? { 'If-None-Match': etag } : {});
+            if (res.status === 200) {
+                etag = res.headers.etag || null;
+                lastPlaylist = res.body.toString();
+            } else if (res.status !== 304) {
+                result.errors++;
+            }
+            const target = /#EXT-X-TARGETDURATION:(\d+)/.exec(lastPlaylist);
+            targetMs = target ? Number(target[1]) * 1000 : targetMs;
+            const uris = lastPlaylist.split('\n').filter(line => line && !line.startsWith('#'));
+            // A joining player starts near the live edge, like hls.js
+            if (seen.size === 0) {
+                uris.slice(0, -3).forEach(uri => seen.add(uri));
+            }
+            const fresh = uris.filter(uri => !seen.has(uri));
+            for (const uri of fresh) {
+                seen.add(uri);
+                const started = process.hrtime.bigint();
+                const seg = await get(new URL(uri, playlistUrl), agent);
+                result.latencies.push(Number(process.hrtime.bigint() - started) / 1e6);
+                if (seg.status === 200) {
+                    result.segments++;
+                    result.bytes += seg.body.length;
+                } else {
+                    result.errors++;
+                }
+            }
+            targetMs = fresh.length > 0 ? targetMs : targetMs / 2;
+        } catch (err) {
+            result.errors++;
+        }
+        await new Promise(resolve => setTimeout(resolve, targetMs));
+    }
+    agent.destroy();
+    return result;
+}
+
+async function phase(name, opts, playlistUrl, origin) {
+    const before = origin.stats();
+    const stopAt = Date.now() + opts.duration * 1000;
+    const viewers = [];
+    for (let i = 0; i < opts.viewers; i++) {
+        // Spread joins over one segment, like viewers arriving independently
+        viewers.push(new Promise(resolve => setTimeout(resolve, Math.random() * opts.segmentMs))
+            .then(() => watch(playlistUrl, stopAt)));
+    }
+    const results = await Promise.all(viewers);
+    const after = origin.stats();
+
+    const latencies = results.flatMap(r => r.latencies).sort((a, b) => a - b);
+    const pct = q => (latencies.length ? latencies[Math.min(latencies.length - 1, Math.floor(q * latencies.length))] : 0);
+    const segments = results.reduce((sum, r) => sum + r.segments, 0);
+    const bytes = results.reduce((sum, r) => sum + r.bytes, 0);
+    const errors = results.reduce((sum, r) => sum + r.errors, 0);
+    const originBytes = after.bytes - before.bytes;
+    console.log(`\n${name}`);
+    console.log(`  Viewers got   ${segments} segments, ${(bytes / 1048576).toFixed(1)} MiB, ${errors} errors; ` +
+        `segment latency p50 ${pct(0.5).toFixed(1)} ms, p99 ${pct(0.99).toFixed(1)} ms`);
+    console.log(`  Origin served ${after.requests - before.requests} requests ` +
+        `(${after.playlistRequests - before.playlistRequests} playlist, ${after.segmentRequests - before.segmentRequests} segment), ` +
+        `${(originBytes / 1048576).toFixed(1)} MiB, ${(originBytes * 8 / opts.duration / 1e6).toFixed(1)} Mbit/s uplink`);
+}
+
+async function main() {
+    const opts = parseArgs(process.argv.slice(2));
+    const origin = await startOrigin({ port: 0, segmentMs: opts.segmentMs, bitrate: opts.bitrate });
+    const originUrl = `http://127.0.0.1:${origin.port}/`;
+
+    const relay = new HlsRelay(originUrl);
+    const app = express();
+    app.use('/hls', relay.middleware());
+    const server = http.createServer(app);
+    await new Promise(resolve => server.listen(0, resolve));
+    const relayUrl = `http://127.0.0.1:${server.address().port}/hls/`;
+
+    console.log(`${opts.viewers} viewers for ${opts.duration} s each phase, ` +
+        `${origin.segmentBytes} byte segments every ${opts.segmentMs} ms`);
+    await phase('Direct to origin', opts, `${originUrl}stream.m3u8`, origin);
+    await phase('Through the relay', opts, `${relayUrl}stream.m3u8`, origin);
+
+    const s = relay.stats();
+    console.log(`  Relay         ${s.clientRequests} client requests (${s.hits} hits, ${s.coalesced} coalesced, ` +
+        `${s.notModified} not modified), ${s.originFetches} origin fetches (${s.prefetches} prefetches), ` +
+        `${s.segments} segments / ${(s.heldBytes / 1048576).toFixed(1)} MiB held`);
+
+    server.closeAllConnections();
+    server.close();
+    origin.stop();
+}
+
+main().catch((err) => {
+    console.error(err.message);
+    process.exit(1);
+});
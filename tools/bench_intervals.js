@@ -0,0 +1,254 @@
+#!/usr/bin/env node
+// bench_intervals.js
+//
+// Size and scan speed of the interval encoding (public/interval_codec.js) against the
+// text lines it stands in for:
+//
+//   history  --years of status logs for --cats cats, a day at a time as compaction seals
+//            them: raw text, the gzip'd day segment and the day's .ivl. Then every day is
+//            scanned for the activity analytics both ways (gunzip, parse and sessions vs
+//            decode and sessions), and state totals are summed straight from the runs.
+//   wire     a day of cat_data.csv for --collars collars sampling every --sample s: the
+//            JSON the dashboard's history used to be against the interval block it is now.
+//
+// Usage:
+//   node tools/bench_intervals.js [--cats 20] [--years 3] [--changes-per-hour 6]
+//                                 [--collars 20] [--sample 2] [--seed 1]
+
+const zlib = require('zlib');
+const { STATE_NAMES, groupDataLog } = require('../lib/telemetry');
+const { KINDS } = require('../lib/log_segments');
+const { scanIntervals, scanLines } = require('../lib/analytics');
+const { decodeSeries, readBlock } = require('../public/interval_codec');
+
+const DAY_MS = 86400000;
+const HOUR_MS = 3600000;
+const STATES = STATE_NAMES.length;
+
+function parseArgs(argv) {
+    const opts = { cats: 20, years: 3, changesPerHour: 6, collars: 20, sample: 2, seed: 1 };
+    for (let i = 0; i < argv.length; i++) {
+        if (argv[i] === '--cats') {
+            opts.cats = parseInt(argv[++i], 10);
+        } else if (argv[i] === '--years') {
+            opts.years = Number(argv[++i]);
+        } else if (argv[i] === '--changes-per-hour') {
+            opts.changesPerHour = Number(argv[++i]);
+        } else if (argv[i] === '--collars') {
+            opts.collars = parseInt(argv[++i], 10);
+        } else if (argv[i] === '--sample') {
+            opts.sample = Number(argv[++i]);
+        } else if (argv[i] === '--seed') {
+            opts.seed = parseInt(argv[++i], 10);
+        } else {
+            console.error(`Unknown argument: ${argv[i]}`);
+            process.exit(1);
+        }
+    }
+    return opts;
+}
+
+// Small seeded PRNG (mulberry32) so runs are comparable
+function rng(seed) {
+    let a = seed >>> 0;
+    return () => {
+        a = (a + 0x6D2B79F5) >>> 0;
+        let t = a;
+        t = Math.imul(t ^ (t >>> 15), t | 1);
+        t ^= t + Math.imul(t ^ (t >>> 7), t | 61);
+        return ((t ^ (t >>> 14)) >>> 0) / 4294967296;
+    };
+}
+
+function pad(n) {
+    return String(n).padStart(2, '0');
+}
+
+function clock(seconds) {
+    return `${pad(Math.floor(seconds / 3600))}:${pad(Math.floor(seconds / 60) % 60)}:${pad(seconds % 60)}`;
+}
+
+// A collar's temperature: a slow walk, logged to 2 decimals
+function warmer(random) {
+    let t = 79 + random() * 3;
+    return () => {
+        t = Math.min(84, Math.max(76, t + (random() - 0.5) * 0.08));
+        return t.toFixed(2);
+    };
+}
+
+// One day of status lines in arrival order: a line per state change, mostly asleep at
+// night, and now and then a capture press that repeats the state
+function statusDay(opts, random, cats, dayStart) {
+    const events = [];
+    const meanGapMs = HOUR_MS / opts.changesPerHour;
+    cats.forEach((cat, c) => {
+        while (cat.next < dayStart + DAY_MS) {
+            const ms = Math.round(cat.next);
+            const hour = Math.floor((ms % DAY_MS) / HOUR_MS);
+            let state = cat.state;
+            if (random() >= 0.05) {
+                state = hour < 6 && random() < 0.8 ? 0 : (cat.state + 1 + Math.floor(random() * 2)) % 3;
+            }
+            const inState = Math.round((ms - cat.since) / 1000);
+            events.push({
+                ms,
+                line: `Port ${3333 + c} | ID ${ms + 20 + Math.floor(random() * 30)} | Message: ${clock(inState)}, ` +
+                    `Temperature: ${cat.temperature()}°F, Cat state: ${STATE_NAMES[state]}, Time: ${ms * 1000}\n`
+            });
+            if (state !== cat.state) {
+                cat.since = ms;
+            }
+            cat.state = state;
+            cat.next += -Math.log(1 - random()) * meanGapMs * (state === 0 ? 3 : 1);
+        }
+    });
+    events.sort((a, b) => a.ms - b.ms);
+    return Buffer.from(events.map(e => e.line).join(''));
+}
+
+// Seconds per (cat, state) over a set of scans
+function stateTotals(scans) {
+    const totals = new Map();
+    for (const scan of scans) {
+        const cells = scan.cells.length / (scan.entries.length / 2);
+        for (let i = 0; i < scan.entries.length / 2; i++) {
+            const cat = scan.cats[scan.entries[i * 2]];
+            const sum = totals.get(cat) || totals.set(cat, new Float64Array(STATES)).get(cat);
+            for (let h = 0; h < 24; h++) {
+                for (let s = 0; s < STATES; s++) {
+                    sum[s] += scan.cells[i * cells + h * STATES + s];
+                }
+            }
+        }
+    }
+    return totals;
+}
+
+function time(fn) {
+    const start = process.hrtime.bigint();
+    const result = fn();
+    return { result, ms: Number(process.hrtime.bigint() - start) / 1e6 };
+}
+
+function mib(bytes) {
+    return `${(bytes / 1048576).toFixed(1)} MiB`;
+}
+
+function history(opts, random) {
+    const days = Math.round(opts.years * 365);
+    const firstDay = Date.UTC(2022, 0, 1);
+    const cats = Array.from({ length: opts.cats }, () => ({
+        state: 0, since: firstDay, next: firstDay + random() * HOUR_MS, temperature: warmer(random)
+    }));
+    const segments = [];
+    const blocks = [];
+    let raw = 0;
+    let lines = 0;
+    let gzipMs = 0;
+    let encodeMs = 0;
+    for (let d = 0; d < days; d++) {
+        const buf = statusDay(opts, random, cats, firstDay + d * DAY_MS);
+        raw += buf.length;
+        lines += buf.toString('latin1').split('\n').length - 1;
+        const gz = time(() => zlib.gzipSync(buf));
+        const ivl = time(() => KINDS.status.intervals(buf));
+        gzipMs += gz.ms;
+        encodeMs += ivl.ms;
+        segments.push(gz.result);
+        blocks.push(ivl.result);
+    }
+    const gzBytes = segments.reduce((sum, b) => sum + b.length, 0);
+    const ivlBytes = blocks.reduce((sum, b) => sum + b.length, 0);
+    console.log(`History: ${opts.cats} cats x ${days} days, ${lines} status lines (${opts.changesPerHour} changes/hour)`);
+    console.log(`  raw text        ${mib(raw).padStart(10)}  ${(raw / lines).toFixed(1).padStart(6)} B/line`);
+    console.log(`  gzip segments   ${mib(gzBytes).padStart(10)}  ${(gzBytes / lines).toFixed(1).padStart(6)} B/line  ` +
+        `${(raw / gzBytes).toFixed(1)}x smaller, ${gzipMs.toFixed(0)} ms to compress`);
+    console.log(`  intervals       ${mib(ivlBytes).padStart(10)}  ${(ivlBytes / lines).toFixed(1).padStart(6)} B/line  ` +
+        `${(raw / ivlBytes).toFixed(1)}x smaller, ${encodeMs.toFixed(0)} ms to parse and encode`);
+
+    // What the analytics do per sealed day
+    const fromText = time(() => segments.map(gz => scanLines(zlib.gunzipSync(gz))));
+    const fromIntervals = time(() => blocks.map(ivl => scanIntervals(ivl)));
+    const a = stateTotals(fromText.result);
+    const b = stateTotals(fromIntervals.result);
+    let worst = 0;
+    for (const [cat, seconds] of a) {
+        for (let s = 0; s < STATES; s++) {
+            worst = Math.max(worst, Math.abs(seconds[s] - b.get(cat)[s]));
+        }
+    }
+    console.log(`\n  Analytics scan of every day`);
+    console.log(`  gunzip + parse + sessions     ${fromText.ms.toFixed(0).padStart(7)} ms`);
+    console.log(`  decode + sessions             ${fromIntervals.ms.toFixed(0).padStart(7)} ms  ` +
+        `(${(fromText.ms / fromIntervals.ms).toFixed(1)}x; state totals agree to ${worst.toFixed(3)} s)`);
+
+    // A duration aggregation straight off the runs
+    const totals = time(() => {
+        const sums = new Map();
+        let runs = 0;
+        for (const ivl of blocks) {
+            const block = readBlock(ivl);
+            for (const { key, offset } of block.series) {
+                const { runs: r } = decodeSeries(block.bytes, offset, { readings: false });
+                const sum = sums.get(key) || sums.set(key, new Float64Array(STATES)).get(key);
+                for (let i = 0; i < r.count; i++) {
+                    sum[r.state[i]] += r.end[i] - r.start[i];
+                }
+                runs += r.count;
+            }
+        }
+        return runs;
+    });
+    console.log(`  state totals from the runs    ${totals.ms.toFixed(0).padStart(7)} ms  ` +
+        `(${totals.result} runs, ${(totals.result / totals.ms / 1000).toFixed(1)} M runs/s)`);
+}
+
+function wire(opts, random) {
+    const startMs = Date.UTC(2024, 0, 1);
+    const samples = Math.floor(86400 / opts.sample);
+    const collars = Array.from({ length: opts.collars }, (_, c) => ({
+        source: `192.168.1.${100 + c}:${3333 + c}`,
+        state: 0,
+        until: 0,
+        temperature: warmer(random)
+    }));
+    const lines = [];
+    for (let k = 0; k < samples; k++) {
+        const ms = startMs + k * opts.sample * 1000;
+        for (const collar of collars) {
+            if (ms >= collar.until) {
+                collar.state = (collar.state + 1 + Math.floor(random() * 2)) % 3;
+                collar.until = ms - Math.log(1 - random()) * HOUR_MS / opts.changesPerHour;
+            }
+            const at = ms + Math.floor(random() * 200);
+            lines.push(`${new Date(at).toISOString()}, ${collar.source}, ${clock(k * opts.sample % 86400)}, ` +
+                `Temperature: ${collar.temperature()}°F, Cat state: ${STATE_NAMES[collar.state]}\n`);
+        }
+    }
+    const buf = Buffer.from(lines.join(''));
+    const json = JSON.stringify(groupDataLog(buf));
+    const encoded = time(() => KINDS.data.intervals(buf));
+    const decoded = time(() => {
+        const block = readBlock(encoded.result);
+        let runs = 0;
+        block.series.forEach(({ offset }) => {
+            runs += decodeSeries(block.bytes, offset).runs.count;
+        });
+        return runs;
+    });
+    const jsonGz = zlib.gzipSync(json).length;
+    console.log(`\nWire: a day of cat_data.csv, ${opts.collars} collars every ${opts.sample} s (${lines.length} lines, ${mib(buf.length)})`);
+    console.log(`  history as JSON       ${mib(json.length).padStart(10)}   (${mib(jsonGz)} if gzip'd)`);
+    console.log(`  history as intervals  ${mib(encoded.result.length).padStart(10)}   ${(json.length / encoded.result.length).toFixed(0)}x smaller, ` +
+        `${decoded.result} runs; ${encoded.ms.toFixed(0)} ms to parse and encode, ${decoded.ms.toFixed(1)} ms to decode with temperatures`);
+}
+
+function main() {
+    const opts = parseArgs(process.argv.slice(2));
+    const random = rng(opts.seed);
+    history(opts, random);
+    wire(opts, random);
+}
+
+main();
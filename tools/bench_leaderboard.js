@@ -0,0 +1,228 @@
+#!/usr/bin/env node
+// bench_leaderboard.js
+//
+// Replays a synthetic fleet through the sliding-window leaderboards (lib/leaderboard.js)
+// as fast as it will go. Reports records per second, query latency for every horizon,
+// and memory, and checks each top-K against a full recomputation from the raw records,
+// which is also timed as the alternative.
+//
+// Usage:
+//   node tools/bench_leaderboard.js [--cats 100000] [--hours 26] [--groups 100] [--k 10] [--seed 1]
+//
+// Cats report on every state change, about every 40 minutes each, crediting the time
+// since their last report to their new state. Each cat is in one of --groups groups
+// as well as the whole fleet. Moonwalk counts double.
+
+const v8 = require('v8');
+const vm = require('vm');
+const { ALL, Leaderboard, parseWeights } = require('../lib/leaderboard');
+
+const HOUR_MS = 3600000;
+const START_MS = Date.UTC(2024, 0, 1);
+const CHECK_EVERY_MS = 2 * HOUR_MS;
+const QUERIES_PER_CHECK = 200;
+
+function parseArgs(argv) {
+    const opts = { cats: 100000, hours: 26, groups: 100, k: 10, seed: 1 };
+    for (let i = 0; i < argv.length; i++) {
+        if (argv[i] === '--cats') {
+            opts.cats = parseInt(argv[++i], 10);
+        } else if (argv[i] === '--hours') {
+            opts.hours = Number(argv[++i]);
+        } else if (argv[i] === '--groups') {
+            opts.groups = parseInt(argv[++i], 10);
+        } else if (argv[i] === '--k') {
+            opts.k = parseInt(argv[++i], 10);
+        } else if (argv[i] === '--seed') {
+            opts.seed = parseInt(argv[++i], 10);
+        } else {
+            console.error(`Unknown argument: ${argv[i]}`);
+            process.exit(1);
+        }
+    }
+    return opts;
+}
+
+// Small seeded PRNG (mulberry32) so runs are comparable
+function rng(seed) {
+    let a = seed >>> 0;
+    return () => {
+        a = (a + 0x6D2B79F5) >>> 0;
+        let t = a;
+        t = Math.imul(t ^ (t >>> 15), t | 1);
+        t ^= t + Math.imul(t ^ (t >>> 7), t | 61);
+        return ((t ^ (t >>> 14)) >>> 0) / 4294967296;
+    };
+}
+
+// Every record in time order as columns: t, cat, state, duration (s)
+function generate(opts, random) {
+    const endMs = START_MS + opts.hours * HOUR_MS;
+    const last = new Float64Array(opts.cats).fill(START_MS);
+    // Bucket cats by the minute of their next report instead of keeping a heap
+    const minutes = Math.ceil(opts.hours * 60);
+    const due = Array.from({ length: minutes + 1 }, () => []);
+    const next = new Float64Array(opts.cats);
+    const schedule = (c, from) => {
+        next[c] = from + Math.max(60000, -Math.log(1 - random()) * 40 * 60000);
+        const m = Math.floor((next[c] - START_MS) / 60000);
+        if (m < minutes) {
+            due[m].push(c);
+        }
+    };
+    for (let c = 0; c < opts.cats; c++) {
+        schedule(c, START_MS);
+    }
+
+    const records = { t: [], cat: [], state: [], duration: [] };
+    for (let m = 0; m < minutes; m++) {
+        const batch = due[m].sort((a, b) => next[a] - next[b]);
+        due[m] = null;
+        for (const c of batch) {
+            const t = next[c];
+            const u = random();
+            records.t.push(t);
+            records.cat.push(c);
+            records.state.push(u < 0.55 ? 0 : u < 0.9 ? 1 : 2);
+            records.duration.push(Math.round((t - last[c]) / 1000));
+            last[c] = t;
+            schedule(c, t);
+        }
+    }
+    return {
+        endMs,
+        t: Float64Array.from(records.t),
+        cat: Int32Array.from(records.cat),
+        state: Uint8Array.from(records.state),
+        duration: Float64Array.from(records.duration)
+    };
+}
+
+// The same top-K from scratch: sum every record in the window, then sort (ties to the cat seen first)
+function recompute(data, end, board, horizon, members, k) {
+    const from = board.now - horizon.ms;
+    const cap = horizon.ms / 1000;
+    const scores = new Map();
+    for (let i = end - 1; i >= 0 && data.t[i] > from; i--) {
+        const c = data.cat[i];
+        if (members && members[c] === undefined) {
+            continue;
+        }
+        const score = board.weightOf[data.state[i]] * Math.min(Math.fround(data.duration[i]), cap);
+        if (score > 0) {
+            scores.set(c, (scores.get(c) || 0) + score);
+        }
+    }
+    return [...scores.entries()]
+        .sort((a, b) => b[1] - a[1] || board.cats.get(String(a[0])) - board.cats.get(String(b[0])))
+        .slice(0, k)
+        .map(([c, score], i) => ({ rank: i + 1, catId: String(c), score: Math.round(score * 100) / 100 }));
+}
+
+function pct(sorted, q) {
+    return sorted.length ? sorted[Math.min(sorted.length - 1, Math.floor(q * sorted.length))] : NaN;
+}
+
+function main() {
+    const opts = parseArgs(process.argv.slice(2));
+    const random = rng(opts.seed);
+    const data = generate(opts, random);
+    console.log(`${opts.cats} cats x ${opts.hours} h: ${data.t.length} records, ${opts.groups} groups, top ${opts.k}`);
+
+    const groups = {};
+    const groupOf = new Int32Array(opts.cats);
+    for (let c = 0; c < opts.cats; c++) {
+        groupOf[c] = c % opts.groups;
+        const name = `group-${groupOf[c]}`;
+        (groups[name] = groups[name] || []).push(String(c));
+    }
+
+    v8.setFlagsFromString('--expose-gc');
+    const gc = vm.runInNewContext('gc');
+    const used = () => {
+        gc();
+        const usage = process.memoryUsage();
+        return usage.heapUsed + usage.arrayBuffers;
+    };
+    const usedBefore = used();
+    const board = new Leaderboard({ weights: parseWeights('moonwalk=2'), groups, k: opts.k });
+
+    const horizons = board.horizons;
+    const queryNs = horizons.map(() => []);
+    const recomputeMs = horizons.map(() => []);
+    let mismatches = 0;
+    let checks = 0;
+    let updateNs = 0n;
+
+    const check = (end) => {
+        horizons.forEach((horizon, h) => {
+            // Alternate between the whole fleet and one group
+            const group = checks % 2 === 0 ? ALL : `group-${checks % opts.groups}`;
+            for (let q = 0; q < QUERIES_PER_CHECK; q++) {
+                const start = process.hrtime.bigint();
+                board.top(horizon.name, group, opts.k, board.now);
+                queryNs[h].push(Number(process.hrtime.bigint() - start));
+            }
+            const got = board.top(horizon.name, group, opts.k, board.now);
+
+            let members = null;
+            if (group !== ALL) {
+                members = [];
+                groups[group].forEach((catId) => {
+                    members[Number(catId)] = true;
+                });
+            }
+            const start = process.hrtime.bigint();
+            const want = recompute(data, end, board, horizon, members, opts.k);
+            recomputeMs[h].push(Number(process.hrtime.bigint() - start) / 1e6);
+            if (JSON.stringify(got) !== JSON.stringify(want)) {
+                mismatches++;
+                if (mismatches <= 3) {
+                    console.error(`Mismatch at ${new Date(board.now).toISOString()} ${horizon.name} ${group}:\n` +
+                        `  got  ${JSON.stringify(got.slice(0, 3))}\n  want ${JSON.stringify(want.slice(0, 3))}`);
+                }
+            }
+        });
+        checks++;
+    };
+
+    // Cat IDs arrive as strings, as parsed from the log
+    const catIds = Array.from({ length: opts.cats }, (_, c) => String(c));
+    let nextCheck = START_MS + CHECK_EVERY_MS;
+    let start = process.hrtime.bigint();
+    for (let i = 0; i < data.t.length; i++) {
+        if (data.t[i] >= nextCheck) {
+            board.advance(nextCheck);
+            updateNs += process.hrtime.bigint() - start;
+            check(i);
+            nextCheck += CHECK_EVERY_MS;
+            start = process.hrtime.bigint();
+        }
+        board.update(catIds[data.cat[i]], data.t[i], data.state[i], data.duration[i]);
+    }
+    board.advance(data.endMs);
+    updateNs += process.hrtime.bigint() - start;
+    check(data.t.length);
+
+    const seconds = Number(updateNs) / 1e9;
+    const stats = board.stats();
+    console.log(`\n  Updates         ${(data.t.length / seconds / 1e6).toFixed(2)} M records/s ` +
+        `(${(seconds * 1e9 / data.t.length).toFixed(0)} ns/record, ${horizons.length} horizons x 2 boards each, ` +
+        `${stats.expired} expiries)`);
+    console.log(`  Memory          ${((used() - usedBefore) / 1048576).toFixed(1)} MiB, ` +
+        `${stats.ringRecords} records in the ${horizons[horizons.length - 1].name} window`);
+    console.log(`\n  Horizon   query p50    p99   recompute p50`);
+    horizons.forEach((horizon, h) => {
+        const q = queryNs[h].sort((a, b) => a - b);
+        const r = recomputeMs[h].sort((a, b) => a - b);
+        console.log(`  ${horizon.name.padEnd(8)}${(pct(q, 0.5) / 1000).toFixed(1).padStart(8)} µs` +
+            `${(pct(q, 0.99) / 1000).toFixed(1).padStart(7)} µs${pct(r, 0.5).toFixed(1).padStart(11)} ms`);
+    });
+    console.log(`\n  Checked ${checks * horizons.length} top-${opts.k} lists against recomputation: ` +
+        `${mismatches === 0 ? 'all match' : `${mismatches} mismatches`}`);
+    if (mismatches > 0) {
+        process.exit(1);
+    }
+}
+
+main();
@@ -0,0 +1,140 @@
+#!/usr/bin/env node
+// bench_logs.js
+//
+// Compact a year of synthetic telemetry logs the way LogStore does (one rotation per
+// interval) and compare the resulting query cost with reading the raw log.
+//
+// Usage:
+//   node tools/bench_logs.js [--kind status|data] [--days 365] [--lines-per-day 20000]
+//                            [--rotations-per-day 24] [--raw-days 30] [--dir /tmp/bench_logs]
+//
+// Compaction runs on this thread here so it can be timed; the servers run it on a worker.
+
+const fs = require('fs');
+const os = require('os');
+const path = require('path');
+const telemetry = require('../lib/telemetry');
+const { KINDS, compactDir } = require('../lib/log_segments');
+
+const DAY_MS = 86400000;
+const START_MS = Date.UTC(2024, 0, 1);
+
+function parseArgs(argv) {
+    const opts = {
+        kind: 'status', days: 365, linesPerDay: 20000, rotationsPerDay: 24, rawDays: 30,
+        dir: path.join(os.tmpdir(), 'bench_logs')
+    };
+    for (let i = 0; i < argv.length; i++) {
+        if (argv[i] === '--kind') {
+            opts.kind = argv[++i];
+        } else if (argv[i] === '--days') {
+            opts.days = parseInt(argv[++i], 10);
+        } else if (argv[i] === '--lines-per-day') {
+            opts.linesPerDay = parseInt(argv[++i], 10);
+        } else if (argv[i] === '--rotations-per-day') {
+            opts.rotationsPerDay = parseInt(argv[++i], 10);
+        } else if (argv[i] === '--raw-days') {
+            opts.rawDays = parseInt(argv[++i], 10);
+        } else if (argv[i] === '--dir') {
+            opts.dir = argv[++i];
+        } else {
+            console.error(`Unknown argument: ${argv[i]}`);
+            process.exit(1);
+        }
+    }
+    if (!KINDS[opts.kind]) {
+        console.error(`Unknown kind ${opts.kind}; expected status or data`);
+        process.exit(1);
+    }
+    return opts;
+}
+
+function pad(n) {
+    return String(n).padStart(2, '0');
+}
+
+// Same shapes as tools/bench_telemetry.js, stamped with the given arrival time
+function statusLine(i, ms) {
+    const port = 3333 + (i % 3);
+    const state = telemetry.STATE_NAMES[(i >> 2) % 3];
+    const seconds = i % 7200;
+    const duration = `${pad(Math.floor(seconds / 3600))}:${pad(Math.floor(seconds / 60) % 60)}:${pad(seconds % 60)}`;
+    return `Port ${port} | ID ${ms} | Message: ${duration}, Temperature: ${(78 + (i % 500) / 100).toFixed(2)}°F, Cat state: ${state}\n`;
+}
+
+function dataLine(i, ms) {
+    const source = `192.168.1.${10 + (i % 3)}:${3333 + (i % 3)}`;
+    const state = telemetry.STATE_NAMES[(i >> 2) % 3];
+    return `${new Date(ms).toISOString()}, ${source}, 00:00:02, Temperature: ${(78 + (i % 500) / 100).toFixed(2)}°F, Cat state: ${state}\n`;
+}
+
+function duSync(dir) {
+    return fs.readdirSync(dir).reduce((total, file) => total + fs.statSync(path.join(dir, file)).size, 0);
+}
+
+function mib(bytes) {
+    return `${(bytes / 1048576).toFixed(1)} MiB`;
+}
+
+function main() {
+    const opts = parseArgs(process.argv.slice(2));
+    const lineFn = opts.kind === 'status' ? statusLine : dataLine;
+    const kind = KINDS[opts.kind];
+    fs.rmSync(opts.dir, { recursive: true, force: true });
+    fs.mkdirSync(opts.dir, { recursive: true });
+
+    const linesPerRotation = Math.ceil(opts.linesPerDay / opts.rotationsPerDay);
+    const stepMs = DAY_MS / opts.linesPerDay;
+    let rawBytes = 0;
+    let compactMs = 0;
+    let worstRunMs = 0;
+    let lastDayRaw = null;
+    let i = 0;
+
+    for (let day = 0; day < opts.days; day++) {
+        const dayChunks = [];
+        for (let r = 0; r < opts.rotationsPerDay; r++) {
+            let text = '';
+            for (let n = 0; n < linesPerRotation && r * linesPerRotation + n < opts.linesPerDay; n++, i++) {
+                text += lineFn(i, Math.floor(START_MS + day * DAY_MS + (r * linesPerRotation + n) * stepMs));
+            }
+            const chunk = Buffer.from(text, 'utf8');
+            dayChunks.push(chunk);
+            rawBytes += chunk.length;
+
+            // What LogStore.rotate() leaves behind, then what the worker does with it
+            const rotatedMs = START_MS + day * DAY_MS + Math.floor((r + 1) * DAY_MS / opts.rotationsPerDay) - 1;
+            fs.writeFileSync(path.join(opts.dir, `rotated-${rotatedMs}.log`), chunk);
+            const start = process.hrtime.bigint();
+            compactDir(opts.dir, opts.kind, { now: rotatedMs + 1, rawDays: opts.rawDays });
+            const ms = Number(process.hrtime.bigint() - start) / 1e6;
+            compactMs += ms;
+            worstRunMs = Math.max(worstRunMs, ms);
+        }
+        lastDayRaw = Buffer.concat(dayChunks);
+    }
+
+    const files = fs.readdirSync(opts.dir).length;
+    const diskBytes = duSync(opts.dir);
+    console.log(`${opts.kind} log: ${opts.days} days x ${opts.linesPerDay} lines, ${opts.rotationsPerDay} rotations/day, raw kept ${opts.rawDays} days`);
+    console.log(`  raw written      ${mib(rawBytes).padStart(12)}`);
+    console.log(`  compaction       ${(compactMs / 1000).toFixed(1).padStart(10)} s  (${(rawBytes / 1048576 / (compactMs / 1000)).toFixed(1)} MiB/s, worst run ${worstRunMs.toFixed(1)} ms)`);
+    console.log(`  on disk          ${mib(diskBytes).padStart(12)}  in ${files} files`);
+
+    // Totals as LogStore serves them: last compaction's totals plus a live file
+    const live = lastDayRaw.subarray(0, Math.floor(lastDayRaw.length / opts.rotationsPerDay));
+    let start = process.hrtime.bigint();
+    const { totals } = compactDir(opts.dir, opts.kind, { now: START_MS + opts.days * DAY_MS - 1, rawDays: opts.rawDays });
+    kind.merge(totals.summary, kind.summarise(live));
+    const storeMs = Number(process.hrtime.bigint() - start) / 1e6;
+    console.log(`  totals (store)   ${storeMs.toFixed(1).padStart(10)} ms  over ${totals.lines} lines`);
+
+    // The same answer from one raw file, as the servers computed it before; a day of it
+    // is timed and scaled, since the year does not fit in a Buffer at larger settings
+    start = process.hrtime.bigint();
+    kind.summarise(lastDayRaw);
+    const rawDayMs = Number(process.hrtime.bigint() - start) / 1e6;
+    console.log(`  totals (raw)     ${(rawDayMs * opts.days).toFixed(1).padStart(10)} ms  (${rawDayMs.toFixed(1)} ms/day x ${opts.days}, reading ${mib(rawBytes)})`);
+}
+
+main();
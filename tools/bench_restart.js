@@ -0,0 +1,207 @@
+#!/usr/bin/env node
+// bench_restart.js
+//
+// How long host_data.js takes to get its leaderboards back after a restart, with and
+// without a checkpoint (lib/checkpoint.js), as the fleet grows. For each fleet size it
+// writes a status log history ending now, compacted as LogStore would, then times:
+//
+//   cold   no checkpoint: replay the last day from the history and the live file
+//   warm   load the checkpoint saved --lag seconds before the restart, restore it and
+//          replay only what was logged since
+//
+// Both start from a new LogStore, as a restarted server does, and the warm leaderboards
+// are checked against the cold ones fed the same lines.
+//
+// Usage:
+//   node tools/bench_restart.js [--cats 500,2000,8000] [--days 2] [--changes-per-hour 6]
+//                               [--rotations-per-day 24] [--lag 60] [--dir /tmp/bench_restart]
+
+const fs = require('fs');
+const os = require('os');
+const path = require('path');
+const { STATE_NAMES, parseStatusLine } = require('../lib/telemetry');
+const { compactDir } = require('../lib/log_segments');
+const { LogStore } = require('../lib/log_store');
+const { ALL, HORIZONS, Leaderboard } = require('../lib/leaderboard');
+const { Checkpoint, Watermarks, encodeSnapshot } = require('../lib/checkpoint');
+
+const DAY_MS = 86400000;
+const HOUR_MS = 3600000;
+const LONGEST_MS = HORIZONS[HORIZONS.length - 1].ms;
+
+function parseArgs(argv) {
+    const opts = {
+        cats: [500, 2000, 8000],
+        days: 2,
+        changesPerHour: 6,
+        rotationsPerDay: 24,
+        lag: 60,
+        dir: path.join(os.tmpdir(), 'bench_restart')
+    };
+    for (let i = 0; i < argv.length; i++) {
+        if (argv[i] === '--cats') {
+            opts.cats = argv[++i].split(',').map(n => parseInt(n, 10));
+        } else if (argv[i] === '--days') {
+            opts.days = parseInt(argv[++i], 10);
+        } else if (argv[i] === '--changes-per-hour') {
+            opts.changesPerHour = Number(argv[++i]);
+        } else if (argv[i] === '--rotations-per-day') {
+            opts.rotationsPerDay = parseInt(argv[++i], 10);
+        } else if (argv[i] === '--lag') {
+            opts.lag = Number(argv[++i]);
+        } else if (argv[i] === '--dir') {
+            opts.dir = argv[++i];
+        } else {
+            console.error(`Unknown argument: ${argv[i]}`);
+            process.exit(1);
+        }
+    }
+    return opts;
+}
+
+function pad(n) {
+    return String(n).padStart(2, '0');
+}
+
+function statusLine(port, ms, state, inStateS) {
+    const duration = `${pad(Math.floor(inStateS / 3600))}:${pad(Math.floor(inStateS / 60) % 60)}:${pad(inStateS % 60)}`;
+    return `Port ${port} | ID ${ms} | Message: ${duration}, Temperature: 80.50°F, Cat state: ${STATE_NAMES[state]}, Time: ${ms * 1000}\n`;
+}
+
+// Every cat's state changes from fromMs up to toMs, in arrival order
+function linesBetween(opts, cats, fromMs, toMs) {
+    const events = [];
+    const meanGapMs = HOUR_MS / opts.changesPerHour;
+    cats.forEach((cat, c) => {
+        while (cat.next < toMs) {
+            const ms = Math.round(cat.next);
+            const state = (cat.state + 1 + Math.floor(Math.random() * 2)) % 3;
+            if (ms >= fromMs) {
+                events.push({ ms, line: statusLine(3333 + c, ms, state, Math.round((cat.next - cat.since) / 1000)) });
+            }
+            cat.since = cat.next;
+            cat.state = state;
+            cat.next += -Math.log(1 - Math.random()) * meanGapMs;
+        }
+    });
+    events.sort((a, b) => a.ms - b.ms);
+    return events;
+}
+
+// History up to nowMs - lag, rotated and compacted as LogStore would, with the rest of
+// the current rotation in the live file; returns the lines logged after that
+function writeHistory(opts, dir, nowMs, cats) {
+    const logDir = path.join(dir, 'logs', 'cat_status_log');
+    const livePath = path.join(dir, 'cat_status_log.txt');
+    fs.rmSync(dir, { recursive: true, force: true });
+    fs.mkdirSync(logDir, { recursive: true });
+    const rotationMs = DAY_MS / opts.rotationsPerDay;
+    const savedMs = nowMs - opts.lag * 1000;
+    let fromMs = Math.floor(nowMs / DAY_MS) * DAY_MS - (opts.days - 1) * DAY_MS;
+    let lines = 0;
+    let bytes = 0;
+    while (fromMs + rotationMs <= savedMs) {
+        const chunk = linesBetween(opts, cats, fromMs, fromMs + rotationMs).map(e => e.line).join('');
+        fs.writeFileSync(path.join(logDir, `rotated-${fromMs + rotationMs - 1}.log`), chunk);
+        compactDir(logDir, 'status', { now: fromMs + rotationMs, rawDays: opts.days + 1 });
+        lines += chunk.split('\n').length - 1;
+        bytes += chunk.length;
+        fromMs += rotationMs;
+    }
+    const live = linesBetween(opts, cats, fromMs, savedMs).map(e => e.line).join('');
+    fs.writeFileSync(livePath, live);
+    const after = linesBetween(opts, cats, savedMs, nowMs).map(e => e.line).join('');
+    return { livePath, savedMs, lines: lines + live.split('\n').length - 1, bytes: bytes + live.length, after };
+}
+
+// host_data.js's feedLeaderboard: replays skip what the watermarks say is applied
+function feeder(leaderboard, watermarks, counts) {
+    return (lines, replay) => {
+        lines.toString('utf8').split('\n').forEach((line) => {
+            const record = line.trim() === '' ? null : parseStatusLine(line);
+            if (!record || record.id === null) {
+                return;
+            }
+            const ms = Number(record.id);
+            counts.read++;
+            if (replay) {
+                if (!watermarks.replayed(record.port, ms)) {
+                    return;
+                }
+            } else {
+                watermarks.note(record.port, ms);
+            }
+            counts.applied++;
+            const state = STATE_NAMES.indexOf(record.state);
+            if (state >= 0) {
+                leaderboard.update(record.catId || record.port, ms, state, record.duration);
+            }
+        });
+    };
+}
+
+// Start a server's leaderboards the way host_data.js does; resolves with timings
+async function start(livePath, checkpointFile, nowMs) {
+    const started = process.hrtime.bigint();
+    const phase = () => Number(process.hrtime.bigint() - started) / 1e6;
+    const leaderboard = new Leaderboard();
+    const watermarks = new Watermarks();
+    const counts = { read: 0, applied: 0 };
+    const feed = feeder(leaderboard, watermarks, counts);
+    const store = new LogStore(livePath, 'status');
+    const saved = checkpointFile ? new Checkpoint(checkpointFile).load() : null;
+    if (saved) {
+        leaderboard.restore(saved.state.leaderboard);
+        watermarks.restore(saved.state.watermarks);
+    }
+    const restoredMs = phase();
+    await store.ready;
+    const readyMs = phase();
+    const offset = await store.replaySince(Math.max(saved ? saved.savedMs : 0, nowMs - LONGEST_MS), lines => feed(lines, true));
+    clearInterval(store.timer);
+    return { leaderboard, watermarks, feed, counts, offset, restoredMs, compactMs: readyMs - restoredMs, totalMs: phase() };
+}
+
+function boards(leaderboard) {
+    return JSON.stringify(HORIZONS.map(horizon => leaderboard.top(horizon.name, ALL)));
+}
+
+async function main() {
+    const opts = parseArgs(process.argv.slice(2));
+    console.log(`${opts.days} days of history, state changes ${opts.changesPerHour}/hour/cat, ${opts.rotationsPerDay} rotations a day, ` +
+        `checkpoint saved ${opts.lag} s before the restart`);
+    console.log('\n  cats    lines/day   history    cold start              checkpoint   warm start (restore + compact + tail)');
+    for (const catCount of opts.cats) {
+        const nowMs = Date.now();
+        const firstMs = Math.floor(nowMs / DAY_MS) * DAY_MS - (opts.days - 1) * DAY_MS;
+        const cats = Array.from({ length: catCount }, () => ({ state: 0, since: firstMs, next: firstMs + Math.random() * HOUR_MS }));
+        const history = writeHistory(opts, path.join(opts.dir, String(catCount)), nowMs, cats);
+        const checkpointFile = path.join(path.dirname(history.livePath), 'checkpoint.bin');
+
+        // Before the restart: a server that was running until the checkpoint
+        const before = await start(history.livePath, null, history.savedMs);
+        const buf = encodeSnapshot({ leaderboard: before.leaderboard.snapshot(), watermarks: before.watermarks.snapshot() }, history.savedMs);
+        fs.writeFileSync(checkpointFile, buf);
+        // What it logged after, before the restart
+        fs.appendFileSync(history.livePath, history.after);
+
+        const cold = await start(history.livePath, null, nowMs);
+        const warm = await start(history.livePath, checkpointFile, nowMs);
+        // The server that never stopped reads the same lines live
+        before.feed(fs.readFileSync(history.livePath).subarray(before.offset), false);
+        const match = boards(warm.leaderboard) === boards(before.leaderboard) ? 'same boards' : 'BOARDS DIFFER';
+
+        const perDay = Math.round(history.lines / opts.days);
+        console.log(`  ${String(catCount).padStart(5)}  ${String(perDay).padStart(10)}  ${(history.bytes / 1048576).toFixed(0).padStart(5)} MiB  ` +
+            `${cold.totalMs.toFixed(0).padStart(6)} ms (${cold.counts.read} lines)  ` +
+            `${(buf.length / 1048576).toFixed(1).padStart(6)} MiB  ` +
+            `${warm.totalMs.toFixed(0).padStart(6)} ms = ${warm.restoredMs.toFixed(0)} + ${warm.compactMs.toFixed(0)} + ` +
+            `${(warm.totalMs - warm.restoredMs - warm.compactMs).toFixed(0)} (${warm.counts.applied} of ${warm.counts.read} lines applied), ${match}`);
+        fs.rmSync(path.join(opts.dir, String(catCount)), { recursive: true, force: true });
+    }
+}
+
+main().catch((err) => {
+    console.error(err);
+    process.exit(1);
+});
@@ -0,0 +1,161 @@
+#!/usr/bin/env node
+// bench_serial.js
+//
+// Throughput of the binary UART path end to end: N simulated collars stream over
+// pty loopbacks (catcollar_sim --uart) into one ingest process, the way a wired
+// gateway reads several collars at once.
+//
+// Usage:
+//   node tools/bench_serial.js [--collars 4] [--duration 10] [--baud 921600] [--decoder native|js]
+//                              [--bin sim/build/catcollar_sim] [--dir /tmp/bench_serial]
+//
+// For link saturation build the simulator with the SAMPLES flood:
+//   cmake -S sim -B sim/build -DSIM_UART_STREAM_BENCH=ON && cmake --build sim/build
+// Without it the collars send only their normal telemetry (a few hundred bytes/s).
+// The simulated line is paced at --baud (10 bits per byte), so that is the ceiling per collar.
+
+const fs = require('fs');
+const os = require('os');
+const path = require('path');
+const { spawn } = require('child_process');
+const frames = require('../lib/uart_frames');
+const { SerialIngest, flushAll } = require('../lib/serial_ingest');
+
+function parseArgs(argv) {
+    const opts = {
+        collars: 4,
+        duration: 10,
+        baud: 921600,
+        decoder: 'native',
+        bin: path.join(__dirname, '..', 'sim', 'build', 'catcollar_sim'),
+        dir: path.join(os.tmpdir(), 'bench_serial')
+    };
+    for (let i = 0; i < argv.length; i++) {
+        if (argv[i] === '--collars') {
+            opts.collars = parseInt(argv[++i], 10);
+        } else if (argv[i] === '--duration') {
+            opts.duration = parseInt(argv[++i], 10);
+        } else if (argv[i] === '--baud') {
+            opts.baud = parseInt(argv[++i], 10);
+        } else if (argv[i] === '--decoder') {
+            opts.decoder = argv[++i];
+        } else if (argv[i] === '--bin') {
+            opts.bin = argv[++i];
+        } else if (argv[i] === '--dir') {
+            opts.dir = argv[++i];
+        } else {
+            console.error(`Unknown argument: ${argv[i]}`);
+            process.exit(1);
+        }
+    }
+    return opts;
+}
+
+function waitForLink(link, timeoutMs) {
+    const deadline = Date.now() + timeoutMs;
+    return new Promise((resolve, reject) => {
+        const poll = () => {
+            if (fs.existsSync(link)) {
+                resolve();
+            } else if (Date.now() > deadline) {
+                reject(new Error(`${link} did not appear`));
+            } else {
+                setTimeout(poll, 20);
+            }
+        };
+        poll();
+    });
+}
+
+function startCollar(opts, id) {
+    const link = path.join(opts.dir, `collar-${id}.tty`);
+    const args = [
+        '--id', String(id),
+        '--port', String(3333 + (id - 1) % 3),
+        '--out', opts.dir,
+        '--uart', link,
+        '--uart-baud', String(opts.baud),
+        '--duration', String(opts.duration),
+        '--fresh'
+    ];
+    const child = spawn(opts.bin, args, { stdio: ['ignore', 'pipe', 'pipe'] });
+    let report = null;
+    let pending = '';
+    child.stdout.on('data', (chunk) => {
+        pending += chunk.toString();
+        const lines = pending.split('\n');
+        pending = lines.pop();
+        lines.filter(line => line.startsWith('SIMREPORT ')).forEach((line) => {
+            report = JSON.parse(line.slice('SIMREPORT '.length));
+        });
+    });
+    const exited = new Promise(resolve => child.on('exit', () => resolve(report)));
+    return { id, link, child, exited };
+}
+
+async function main() {
+    const opts = parseArgs(process.argv.slice(2));
+    if (!fs.existsSync(opts.bin)) {
+        console.error(`${opts.bin} not found; build it with: cmake -S sim -B sim/build && cmake --build sim/build`);
+        process.exit(1);
+    }
+    fs.rmSync(opts.dir, { recursive: true, force: true });
+    fs.mkdirSync(opts.dir, { recursive: true });
+    if (opts.decoder === 'js') {
+        frames.createFrameDecoder = () => new frames.JsFrameDecoder();
+    }
+
+    console.log(`${opts.collars} collars at ${opts.baud} baud for ${opts.duration} s, ${opts.decoder} decoder`);
+    const collars = [];
+    for (let id = 1; id <= opts.collars; id++) {
+        collars.push(startCollar(opts, id));
+    }
+    await Promise.all(collars.map(c => waitForLink(c.link, 5000)));
+
+    const ingests = collars.map(c => new SerialIngest(c.link, {
+        baudRate: opts.baud,
+        statusLog: path.join(opts.dir, 'cat_status_log.txt'),
+        dataLog: path.join(opts.dir, 'cat_data.csv'),
+        captureDir: path.join(opts.dir, 'captures')
+    }).open());
+
+    // Measure a steady window, after boot and before the collars exit
+    await new Promise(resolve => setTimeout(resolve, 1000));
+    const startCpu = process.cpuUsage();
+    const startNs = process.hrtime.bigint();
+    const before = ingests.map(i => i.stats());
+    await new Promise(resolve => setTimeout(resolve, (opts.duration - 2) * 1000));
+    const after = ingests.map(i => i.stats());
+    const seconds = Number(process.hrtime.bigint() - startNs) / 1e9;
+    const cpu = process.cpuUsage(startCpu);
+
+    // Stay attached until the collars exit so their line counters cover only time with a reader
+    const reports = await Promise.all(collars.map(c => c.exited));
+    ingests.forEach(ingest => ingest.close());
+    flushAll();
+
+    const lineRate = opts.baud / 10;
+    console.log(`\n  ${'collar'.padEnd(8)} ${'MB/s'.padStart(8)} ${'of line'.padStart(8)} ${'frames'.padStart(9)} ` +
+        `${'samples'.padStart(10)} ${'CRC err'.padStart(8)} ${'lost'.padStart(6)} ${'dropped'.padStart(8)}`);
+    let totalBytes = 0;
+    after.forEach((s, i) => {
+        const bytes = s.bytes - before[i].bytes;
+        totalBytes += bytes;
+        const dropped = s.collar ? s.collar.framesDropped : '-';
+        console.log(`  ${String(collars[i].id).padEnd(8)} ${(bytes / seconds / 1e6).toFixed(3).padStart(8)} ` +
+            `${(100 * bytes / seconds / lineRate).toFixed(1).padStart(7)}% ${String(s.frames - before[i].frames).padStart(9)} ` +
+            `${String(s.samples - before[i].samples).padStart(10)} ${String(s.crcErrors).padStart(8)} ` +
+            `${String(s.lost).padStart(6)} ${String(dropped).padStart(8)}`);
+    });
+    const cpuSeconds = (cpu.user + cpu.system) / 1e6;
+    console.log(`\n  Total ${(totalBytes / seconds / 1e6).toFixed(2)} MB/s into one ingest process, ` +
+        `${(100 * cpuSeconds / seconds).toFixed(1)}% of a core ` +
+        `(${(cpuSeconds * 1e9 / Math.max(totalBytes, 1)).toFixed(1)} ns/byte)`);
+    const discarded = reports.reduce((sum, r) => sum + (r && r.uart ? r.uart.tx_discarded : 0), 0);
+    console.log(`  Line bytes the ingest was too slow for: ${discarded}`);
+}
+
+main().catch((err) => {
+    console.error(err.message);
+    process.exit(1);
+});
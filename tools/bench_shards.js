@@ -0,0 +1,198 @@
+#!/usr/bin/env node
+// bench_shards.js
+//
+// Throughput of the sharded ingest (tools/shard_ingest.js) as shards are added, with
+// tools/load_gen.js as the fleet, all as processes on this machine. For each shard
+// count it starts the coordinator, runs --generators load generators for --duration
+// seconds and reads the shards' counters before and after:
+//
+//   offered     datagrams the generators sent per second
+//   ingested    records the shards logged and ranked per second; the rest were
+//               dropped at the collar ports while the shards were behind
+//   passed      share of records read by one shard and passed on to their owner
+//   CPU/record  all shards' CPU time per record
+//   busiest     CPU share of the busiest shard; ingested / busiest is the rate the
+//               shards would keep up with at one core each
+//
+// Then it checks a rebalance. With the most shards, one more is added halfway
+// through a run, and the merged leaderboards are compared with a single Leaderboard
+// fed the data log the shards wrote.
+//
+// Usage:
+//   node tools/bench_shards.js [--shards 1,2,4] [--collars 4000] [--period 500] [--duration 10]
+//                              [--generators 2] [--port 4333] [--http 3902] [--dir /tmp/bench_shards]
+
+const fs = require('fs');
+const os = require('os');
+const path = require('path');
+const { spawn } = require('child_process');
+const { HORIZONS, Leaderboard } = require('../lib/leaderboard');
+const { STATE_NAMES, parseDataLine } = require('../lib/telemetry');
+
+const PORTS = 3;
+
+function parseArgs(argv) {
+    const opts = {
+        shards: [1, 2, 4],
+        collars: 4000,
+        period: 500,
+        duration: 10,
+        generators: 2,
+        port: 4333,
+        http: 3902,
+        dir: path.join(os.tmpdir(), 'bench_shards')
+    };
+    for (let i = 0; i < argv.length; i++) {
+        if (argv[i] === '--shards') {
+            opts.shards = argv[++i].split(',').map(n => parseInt(n, 10));
+        } else if (argv[i] === '--collars') {
+            opts.collars = parseInt(argv[++i], 10);
+        } else if (argv[i] === '--period') {
+            opts.period = Number(argv[++i]);
+        } else if (argv[i] === '--duration') {
+            opts.duration = Number(argv[++i]);
+        } else if (argv[i] === '--generators') {
+            opts.generators = parseInt(argv[++i], 10);
+        } else if (argv[i] === '--port') {
+            opts.port = parseInt(argv[++i], 10);
+        } else if (argv[i] === '--http') {
+            opts.http = parseInt(argv[++i], 10);
+        } else if (argv[i] === '--dir') {
+            opts.dir = argv[++i];
+        } else {
+            console.error(`Unknown argument: ${argv[i]}`);
+            process.exit(1);
+        }
+    }
+    return opts;
+}
+
+function ports(opts) {
+    return Array.from({ length: PORTS }, (_, i) => ['--port', String(opts.port + i)]).flat();
+}
+
+function sleep(ms) {
+    return new Promise(resolve => setTimeout(resolve, ms));
+}
+
+// Start tools/shard_ingest.js; resolves with the child once its shards listen
+function startIngest(opts, shards) {
+    fs.rmSync(opts.dir, { recursive: true, force: true });
+    fs.mkdirSync(opts.dir, { recursive: true });
+    const child = spawn(process.execPath, [
+        path.join(__dirname, 'shard_ingest.js'), '--shards', String(shards), ...ports(opts), '--http', String(opts.http),
+        '--status-log', path.join(opts.dir, 'cat_status_log.txt'), '--data-log', path.join(opts.dir, 'cat_data.csv')
+    ], { stdio: ['ignore', 'pipe', 'inherit'] });
+    return new Promise((resolve, reject) => {
+        let out = '';
+        child.stdout.on('data', (chunk) => {
+            out += chunk;
+            if (out.includes('Shard coordinator on')) {
+                resolve(child);
+            }
+        });
+        child.on('exit', code => reject(new Error(`shard_ingest.js exited (${code})`)));
+    });
+}
+
+function stopIngest(child) {
+    return new Promise((resolve) => {
+        child.removeAllListeners('exit');
+        child.on('exit', resolve);
+        child.kill('SIGTERM');
+    });
+}
+
+// Run the generators to the end; resolves with { sent, seconds }
+function runLoad(opts) {
+    const each = Math.ceil(opts.collars / opts.generators);
+    return Promise.all(Array.from({ length: opts.generators }, (_, g) => new Promise((resolve, reject) => {
+        const child = spawn(process.execPath, [
+            path.join(__dirname, 'load_gen.js'), '--collars', String(Math.min(each, opts.collars - g * each)),
+            '--first', String(g * each), '--period', String(opts.period), '--duration', String(opts.duration),
+            ...ports(opts), '--json'
+        ], { stdio: ['ignore', 'pipe', 'inherit'] });
+        let out = '';
+        child.stdout.on('data', (chunk) => {
+            out += chunk;
+        });
+        child.on('exit', code => (code === 0 ? resolve(JSON.parse(out)) : reject(new Error(`load_gen.js exited (${code})`))));
+    }))).then(results => ({
+        sent: results.reduce((sum, r) => sum + r.sent, 0),
+        seconds: Math.max(...results.map(r => r.seconds))
+    }));
+}
+
+function request(opts, route, method = 'GET') {
+    return fetch(`http://127.0.0.1:${opts.http}${route}`, { method }).then(res => res.json());
+}
+
+async function measure(opts, shards) {
+    const ingest = await startIngest(opts, shards);
+    const before = await request(opts, '/shards');
+    const load = await runLoad(opts);
+    await sleep(1000);
+    const after = await request(opts, '/shards');
+    await stopIngest(ingest);
+
+    const records = after.totals.records - before.totals.records;
+    const forwarded = after.totals.forwarded - before.totals.forwarded;
+    const cpu = after.shards.map(shard => shard.cpuMs - before.shards.find(s => s.id === shard.id).cpuMs);
+    const busiest = Math.max(...cpu) / (load.seconds * 1000);
+    const perSecond = records / load.seconds;
+    console.log(`  ${String(shards).padStart(6)}  ${String(Math.round(load.sent / load.seconds)).padStart(8)}/s  ` +
+        `${String(Math.round(perSecond)).padStart(8)}/s (${(100 * (1 - records / load.sent)).toFixed(1).padStart(4)}% lost)  ` +
+        `${(100 * forwarded / records).toFixed(0).padStart(4)}%  ` +
+        `${(1000 * cpu.reduce((a, b) => a + b, 0) / records).toFixed(1).padStart(7)} µs  ` +
+        `${(100 * busiest).toFixed(0).padStart(5)}%  ${String(Math.round(perSecond / busiest)).padStart(9)}/s`);
+}
+
+// The merged boards against one Leaderboard fed every line of the data log in time order
+async function checkRebalance(opts, shards) {
+    const ingest = await startIngest(opts, shards);
+    const loaded = runLoad(opts);
+    await sleep(opts.duration * 500 + 1000);
+    const rebalance = await request(opts, '/shards', 'POST');
+    await loaded;
+    await sleep(1000);
+    const { boards } = await request(opts, '/leaderboard?k=10');
+    await stopIngest(ingest);
+
+    const records = fs.readFileSync(path.join(opts.dir, 'cat_data.csv'), 'utf8').split('\n')
+        .filter(line => line !== '')
+        .map(parseDataLine)
+        .sort((a, b) => Date.parse(a.time) - Date.parse(b.time));
+    const reference = new Leaderboard();
+    records.forEach((record) => {
+        reference.update(record.source, Date.parse(record.time), STATE_NAMES.indexOf(record.state), record.duration);
+    });
+    // The 1m and 10m windows moved on between the query and this check. Ties may rank
+    // in either order, so scores are compared place by place
+    const checked = HORIZONS.filter(horizon => horizon.ms >= 3600000).map(horizon => horizon.name);
+    const differ = checked.filter((horizon) => {
+        const expected = reference.top(horizon);
+        return expected.length !== boards[horizon].length ||
+            expected.some((entry, i) => Math.abs(entry.score - boards[horizon][i].score) > 0.01);
+    });
+    console.log(`\nRebalance from ${shards} to ${rebalance.shards} shards mid-run: shard ${rebalance.id} took over ` +
+        `${rebalance.collars} collars in ${rebalance.ms} ms (start included), holding ${rebalance.held} records meanwhile`);
+    console.log(`  ${records.length} records logged; ${checked.join(' and ')} boards ` +
+        (differ.length === 0 ? 'match a single board fed the data log' : `DIFFER for ${differ.join(', ')}`));
+}
+
+async function main() {
+    const opts = parseArgs(process.argv.slice(2));
+    console.log(`${opts.collars} collars reporting every ${opts.period} ms on average, from ${opts.generators} generators, ` +
+        `${opts.duration} s per run, ${os.cpus().length} CPUs`);
+    console.log('\n  shards   offered    ingested                passed  CPU/record  busiest  at a core each');
+    for (const shards of opts.shards) {
+        await measure(opts, shards);
+    }
+    await checkRebalance(opts, Math.max(...opts.shards));
+    fs.rmSync(opts.dir, { recursive: true, force: true });
+}
+
+main().catch((err) => {
+    console.error(err);
+    process.exit(1);
+});
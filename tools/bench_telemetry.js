@@ -0,0 +1,105 @@
+#!/usr/bin/env node
+// bench_telemetry.js
+//
+// Compare the JS and native telemetry paths on synthetic logs.
+//
+// Usage:
+//   node tools/bench_telemetry.js [--lines 10000000] [--runs 3]
+//
+// Build the addon first (npm run build:native), otherwise only the JS path is timed.
+
+const telemetry = require('../lib/telemetry');
+
+function parseArgs(argv) {
+    const opts = { lines: 10000000, runs: 3 };
+    for (let i = 0; i < argv.length; i++) {
+        if (argv[i] === '--lines') {
+            opts.lines = parseInt(argv[++i], 10);
+        } else if (argv[i] === '--runs') {
+            opts.runs = parseInt(argv[++i], 10);
+        } else {
+            console.error(`Unknown argument: ${argv[i]}`);
+            process.exit(1);
+        }
+    }
+    return opts;
+}
+
+function pad(n) {
+    return String(n).padStart(2, '0');
+}
+
+// Same shapes the collars and servers write, cycling through cats and states
+function statusLine(i) {
+    const port = 3333 + (i % 3);
+    const state = telemetry.STATE_NAMES[(i >> 2) % 3];
+    const seconds = i % 7200;
+    const duration = `${pad(Math.floor(seconds / 3600))}:${pad(Math.floor(seconds / 60) % 60)}:${pad(seconds % 60)}`;
+    const temperature = (i & 1) ? `, Temperature: ${(78 + (i % 500) / 100).toFixed(2)}°F` : '';
+    return `Port ${port} | ID ${1729875494654 + i} | Message: ${duration}${temperature}, Cat state: ${state}\n`;
+}
+
+function dataLine(i) {
+    const time = new Date(1729875494654 + i * 500).toISOString();
+    const source = `192.168.1.${10 + (i % 3)}:${3333 + (i % 3)}`;
+    const state = telemetry.STATE_NAMES[(i >> 2) % 3];
+    return `${time}, ${source}, 00:00:02, Temperature: ${(78 + (i % 500) / 100).toFixed(2)}°F, Cat state: ${state}\n`;
+}
+
+// Build the log in chunks so the intermediate strings stay small
+function generate(lines, lineFn) {
+    const chunks = [];
+    const chunkLines = 100000;
+    for (let start = 0; start < lines; start += chunkLines) {
+        let text = '';
+        for (let i = start; i < Math.min(lines, start + chunkLines); i++) {
+            text += lineFn(i);
+        }
+        chunks.push(Buffer.from(text, 'utf8'));
+    }
+    return Buffer.concat(chunks);
+}
+
+function time(label, runs, fn) {
+    let best = Infinity;
+    for (let r = 0; r < runs; r++) {
+        const start = process.hrtime.bigint();
+        fn();
+        const ms = Number(process.hrtime.bigint() - start) / 1e6;
+        best = Math.min(best, ms);
+    }
+    console.log(`  ${label.padEnd(10)} ${best.toFixed(1).padStart(10)} ms`);
+    return best;
+}
+
+function compare(name, buf, opts, jsFn, nativeFn) {
+    console.log(`${name} (${opts.lines} lines, ${(buf.length / 1048576).toFixed(1)} MiB, best of ${opts.runs})`);
+    const js = time('js', opts.runs, () => jsFn(buf));
+    if (!telemetry.native) {
+        return;
+    }
+    const nat = time('native', opts.runs, () => nativeFn(buf));
+    console.log(`  speedup    ${(js / nat).toFixed(1).padStart(10)}x`);
+}
+
+function main() {
+    const opts = parseArgs(process.argv.slice(2));
+    if (!telemetry.native) {
+        console.log('Native addon not built; timing the JS path only');
+    }
+
+    const statusLog = generate(opts.lines, statusLine);
+    compare('Status log aggregation (chart / leader)', statusLog, opts,
+        telemetry.aggregateStatusLogJs, telemetry.aggregateStatusLog);
+
+    const dataLog = generate(opts.lines, dataLine);
+    compare('Data log grouping (read_data)', dataLog, opts,
+        telemetry.groupDataLogJs, telemetry.groupDataLog);
+
+    if (telemetry.native) {
+        compare('Data log columns only (no JS objects)', dataLog, opts,
+            telemetry.groupDataLogJs, buf => telemetry.native.parseDataLog(buf));
+    }
+}
+
+main();
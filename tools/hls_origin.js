@@ -0,0 +1,144 @@
+#!/usr/bin/env node
+// hls_origin.js
+//
+// Stand-in for the Raspberry Pi camera server: writes a live HLS stream of
+// synthetic MPEG-TS segments to a directory (rolling playlist, old segments
+// deleted, as ffmpeg's hls muxer does) and serves the directory over HTTP.
+// Counts every request so tools/bench_hls.js can show what reaches the origin.
+//
+// Usage:
+//   node tools/hls_origin.js [--port 8000] [--dir /tmp/hls_origin] [--segment-ms 2000]
+//                            [--bitrate 2000000] [--window 6]
+//
+// Then point the relay at it: HLS_ORIGIN=http://127.0.0.1:8000/ node read_data.js
+
+const crypto = require('crypto');
+const fs = require('fs');
+const http = require('http');
+const os = require('os');
+const path = require('path');
+
+const TS_PACKET = 188;
+const PLAYLIST = 'stream.m3u8';
+
+function parseArgs(argv) {
+    const opts = { port: 8000, dir: path.join(os.tmpdir(), 'hls_origin'), segmentMs: 2000, bitrate: 2000000, window: 6 };
+    for (let i = 0; i < argv.length; i++) {
+        if (argv[i] === '--port') {
+            opts.port = parseInt(argv[++i], 10);
+        } else if (argv[i] === '--dir') {
+            opts.dir = argv[++i];
+        } else if (argv[i] === '--segment-ms') {
+            opts.segmentMs = parseInt(argv[++i], 10);
+        } else if (argv[i] === '--bitrate') {
+            opts.bitrate = parseInt(argv[++i], 10);
+        } else if (argv[i] === '--window') {
+            opts.window = parseInt(argv[++i], 10);
+        } else {
+            console.error(`Unknown argument: ${argv[i]}`);
+            process.exit(1);
+        }
+    }
+    return opts;
+}
+
+// One segment of null-payload TS packets on PID 0x100 with a running continuity counter
+function makeSegment(bytes) {
+    const packets = Math.max(1, Math.round(bytes / TS_PACKET));
+    const data = crypto.randomBytes(packets * TS_PACKET);
+    for (let i = 0; i < packets; i++) {
+        const at = i * TS_PACKET;
+        data[at] = 0x47;
+        data[at + 1] = 0x01;
+        data[at + 2] = 0x00;
+        data[at + 3] = 0x10 | (i & 0x0f);
+    }
+    return data;
+}
+
+function writeAtomic(file, data) {
+    fs.writeFileSync(`${file}.tmp`, data);
+    fs.renameSync(`${file}.tmp`, file);
+}
+
+// Start generating and serving; resolves with { port, stats(), stop() }
+function startOrigin(options) {
+    const opts = { ...parseArgs([]), ...options };
+    fs.rmSync(opts.dir, { recursive: true, force: true });
+    fs.mkdirSync(opts.dir, { recursive: true });
+
+    const targetS = Math.ceil(opts.segmentMs / 1000);
+    const segmentBytes = Math.round(opts.bitrate / 8 * opts.segmentMs / 1000);
+    const counters = { requests: 0, playlistRequests: 0, segmentRequests: 0, bytes: 0, segments: 0 };
+    let sequence = 0;
+
+    const publish = () => {
+        const name = `seg${sequence}.ts`;
+        writeAtomic(path.join(opts.dir, name), makeSegment(segmentBytes));
+        sequence++;
+        counters.segments++;
+        const first = Math.max(0, sequence - opts.window);
+        const lines = ['#EXTM3U', '#EXT-X-VERSION:3', `#EXT-X-TARGETDURATION:${targetS}`, `#EXT-X-MEDIA-SEQUENCE:${first}`];
+        for (let n = first; n < sequence; n++) {
+            lines.push(`#EXTINF:${(opts.segmentMs / 1000).toFixed(3)},`, `seg${n}.ts`);
+        }
+        writeAtomic(path.join(opts.dir, PLAYLIST), `${lines.join('\n')}\n`);
+
+        // Keep a couple past the window for players that are a little behind
+        const stale = path.join(opts.dir, `seg${first - 3}.ts`);
+        fs.rm(stale, { force: true }, () => {});
+    };
+    publish();
+    const timer = setInterval(publish, opts.segmentMs);
+
+    const server = http.createServer((req, res) => {
+        counters.requests++;
+        const name = path.basename(decodeURIComponent(new URL(req.url, 'http://origin').pathname));
+        if (name.endsWith('.m3u8')) {
+            counters.playlistRequests++;
+        } else {
+            counters.segmentRequests++;
+        }
+        fs.readFile(path.join(opts.dir, name), (err, data) => {
+            if (err) {
+                res.writeHead(404).end();
+                return;
+            }
+            counters.bytes += data.length;
+            res.writeHead(200, {
+                'Content-Type': name.endsWith('.m3u8') ? 'application/vnd.apple.mpegurl' : 'video/mp2t',
+                'Content-Length': data.length
+            });
+            res.end(data);
+        });
+    });
+
+    return new Promise((resolve) => {
+        server.listen(opts.port, () => {
+            resolve({
+                port: server.address().port,
+                dir: opts.dir,
+                segmentBytes,
+                stats: () => ({ ...counters }),
+                stop: () => {
+                    clearInterval(timer);
+                    server.closeAllConnections();
+                    server.close();
+                }
+            });
+        });
+    });
+}
+
+if (require.main === module) {
+    const opts = parseArgs(process.argv.slice(2));
+    startOrigin(opts).then((origin) => {
+        console.log(`HLS origin on http://127.0.0.1:${origin.port}/${PLAYLIST} from ${origin.dir}, ` +
+            `${origin.segmentBytes} bytes every ${opts.segmentMs} ms`);
+        setInterval(() => console.log(JSON.stringify(origin.stats())), 10000);
+    });
+}
+
+module.exports = {
+    startOrigin
+};
@@ -0,0 +1,102 @@
+#!/usr/bin/env node
+// latency_report.js
+//
+// Print the per-stage latency of status records (see lib/trace.js) as the servers
+// measured it: host_data.js from the collar to the leader on /buzz, read_data.js from
+// the collar to the dashboard.
+//
+// Usage:
+//   node tools/latency_report.js [--url http://127.0.0.1:3000/metrics ...] [--watch S]
+//
+// For a breakdown on one machine, run both servers and tools/udp_ingest.js, open the
+// dashboard (http://127.0.0.1:3001/), then run tools/sim_fleet.js against 127.0.0.1.
+
+const http = require('http');
+
+const DEFAULT_URLS = ['http://127.0.0.1:3000/metrics', 'http://127.0.0.1:3001/metrics'];
+
+function parseArgs(argv) {
+    const opts = { urls: [], watch: 0 };
+    for (let i = 0; i < argv.length; i++) {
+        if (argv[i] === '--url') {
+            opts.urls.push(argv[++i]);
+        } else if (argv[i] === '--watch') {
+            opts.watch = Number(argv[++i]);
+        } else {
+            console.error(`Unknown argument: ${argv[i]}`);
+            process.exit(1);
+        }
+    }
+    if (opts.urls.length === 0) {
+        opts.urls = DEFAULT_URLS;
+    }
+    return opts;
+}
+
+function getJson(url) {
+    return new Promise((resolve, reject) => {
+        http.get(url, (res) => {
+            let body = '';
+            res.setEncoding('utf8');
+            res.on('data', (chunk) => {
+                body += chunk;
+            });
+            res.on('end', () => {
+                try {
+                    resolve(JSON.parse(body));
+                } catch (err) {
+                    reject(new Error(`${url}: ${err.message}`));
+                }
+            });
+        }).on('error', reject);
+    });
+}
+
+function formatUs(us) {
+    if (us === null) {
+        return '-';
+    }
+    if (us < 1000) {
+        return `${us} us`;
+    }
+    if (us < 1000000) {
+        return `${(us / 1000).toFixed(1)} ms`;
+    }
+    return `${(us / 1000000).toFixed(2)} s`;
+}
+
+function printMetrics(url, metrics) {
+    console.log(`${url}: ${metrics.traced} records traced since ${metrics.since}` +
+        (metrics.unsynced ? `, ${metrics.unsynced} from unsynced collars` : ''));
+    console.log(`  ${'stage'.padEnd(8)} ${'n'.padStart(8)} ${'mean'.padStart(10)} ${'p50'.padStart(10)} ` +
+        `${'p90'.padStart(10)} ${'p99'.padStart(10)} ${'max'.padStart(10)}`);
+    for (const [stage, s] of Object.entries(metrics.stages)) {
+        console.log(`  ${stage.padEnd(8)} ${String(s.count).padStart(8)} ${formatUs(s.meanUs).padStart(10)} ` +
+            `${formatUs(s.p50Us).padStart(10)} ${formatUs(s.p90Us).padStart(10)} ${formatUs(s.p99Us).padStart(10)} ` +
+            `${formatUs(s.maxUs).padStart(10)}` + (s.negative ? `  (${s.negative} negative: clock skew)` : ''));
+    }
+}
+
+async function report(urls) {
+    for (const url of urls) {
+        try {
+            printMetrics(url, await getJson(url));
+        } catch (err) {
+            console.error(`${url}: ${err.message}`);
+        }
+    }
+}
+
+function main() {
+    const opts = parseArgs(process.argv.slice(2));
+    report(opts.urls).then(() => {
+        if (opts.watch > 0) {
+            setInterval(() => {
+                console.log('');
+                report(opts.urls);
+            }, opts.watch * 1000);
+        }
+    });
+}
+
+main();
@@ -0,0 +1,129 @@
+#!/usr/bin/env node
+// load_gen.js
+//
+// Fleet-sized load for the Wi-Fi ingest (tools/udp_ingest.js or tools/shard_ingest.js)
+// without running a simulator per collar. Each simulated collar sends the status
+// datagrams a real one does, from its own socket. Against a server on this machine
+// each socket is bound to its own loopback address (127.<n>.0.<m>, counting from
+// --first), so each collar shows up under its own "<address>:<port>" ID. Collars
+// are spread over the given ports in turn. Each one changes state now and then and
+// reports every --period ms on average.
+//
+// Usage:
+//   node tools/load_gen.js [--collars 1000] [--first 0] [--period 1000] [--duration 10]
+//                          [--server 127.0.0.1] [--port 3333 --port 3334 ...] [--json]
+//
+// Prints how many datagrams went out, as JSON with --json.
+
+const dgram = require('dgram');
+const { STATE_NAMES } = require('../lib/telemetry');
+const { DEFAULT_PORTS } = require('../lib/udp_ingest');
+
+const TICK_MS = 10;
+
+function parseArgs(argv) {
+    const opts = { collars: 1000, first: 0, period: 1000, duration: 10, server: '127.0.0.1', ports: [], json: false };
+    for (let i = 0; i < argv.length; i++) {
+        if (argv[i] === '--collars') {
+            opts.collars = parseInt(argv[++i], 10);
+        } else if (argv[i] === '--first') {
+            opts.first = parseInt(argv[++i], 10);
+        } else if (argv[i] === '--period') {
+            opts.period = Number(argv[++i]);
+        } else if (argv[i] === '--duration') {
+            opts.duration = Number(argv[++i]);
+        } else if (argv[i] === '--server') {
+            opts.server = argv[++i];
+        } else if (argv[i] === '--port') {
+            opts.ports.push(parseInt(argv[++i], 10));
+        } else if (argv[i] === '--json') {
+            opts.json = true;
+        } else {
+            console.error(`Unknown argument: ${argv[i]}`);
+            process.exit(1);
+        }
+    }
+    if (opts.ports.length === 0) {
+        opts.ports = DEFAULT_PORTS;
+    }
+    return opts;
+}
+
+function pad(n) {
+    return String(n).padStart(2, '0');
+}
+
+function bindCollar(address) {
+    return new Promise((resolve, reject) => {
+        const socket = dgram.createSocket('udp4');
+        socket.once('error', reject);
+        socket.bind(0, address, () => resolve(socket));
+    });
+}
+
+async function main() {
+    const opts = parseArgs(process.argv.slice(2));
+    const loopback = opts.server.startsWith('127.') || opts.server === 'localhost';
+    const collars = [];
+    for (let i = opts.first; i < opts.first + opts.collars; i++) {
+        const socket = await bindCollar(loopback ? `127.${(i >> 8) + 1}.0.${i & 255}` : undefined);
+        collars.push({
+            socket,
+            port: opts.ports[i % opts.ports.length],
+            state: i % STATE_NAMES.length,
+            sinceMs: Date.now(),
+            temperature: 79 + (i % 30) / 10,
+            nextMs: Date.now() + Math.random() * opts.period
+        });
+    }
+
+    let sent = 0;
+    let errors = 0;
+    const startMs = Date.now();
+    const endMs = startMs + opts.duration * 1000;
+    // Every collar whose report is due goes out each tick, so the rate holds however many there are
+    const timer = setInterval(() => {
+        const nowMs = Date.now();
+        if (nowMs >= endMs) {
+            clearInterval(timer);
+            finish();
+            return;
+        }
+        collars.forEach((collar) => {
+            if (collar.nextMs > nowMs) {
+                return;
+            }
+            collar.nextMs += opts.period * (0.5 + Math.random());
+            if (Math.random() < 0.1) {
+                collar.state = (collar.state + 1) % STATE_NAMES.length;
+                collar.sinceMs = nowMs;
+            }
+            collar.temperature += (Math.random() - 0.5) * 0.05;
+            const inState = Math.round((nowMs - collar.sinceMs) / 1000);
+            const text = `${pad(Math.floor(inState / 3600))}:${pad(Math.floor(inState / 60) % 60)}:${pad(inState % 60)}, ` +
+                `Temperature: ${collar.temperature.toFixed(2)}°F, Cat state: ${STATE_NAMES[collar.state]}, Time: ${nowMs * 1000}\n`;
+            sent++;
+            collar.socket.send(text, collar.port, opts.server, (err) => {
+                if (err) {
+                    errors++;
+                }
+            });
+        });
+    }, TICK_MS);
+
+    function finish() {
+        const seconds = (Date.now() - startMs) / 1000;
+        const result = { collars: opts.collars, sent, errors, seconds, perSecond: Math.round(sent / seconds) };
+        if (opts.json) {
+            console.log(JSON.stringify(result));
+        } else {
+            console.log(`${sent} datagrams from ${opts.collars} collars in ${seconds.toFixed(1)} s (${result.perSecond}/s), ${errors} send errors`);
+        }
+        setTimeout(() => collars.forEach(collar => collar.socket.close()), 100);
+    }
+}
+
+main().catch((err) => {
+    console.error(err);
+    process.exit(1);
+});
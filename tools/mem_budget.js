@@ -0,0 +1,126 @@
+#!/usr/bin/env node
+// mem_budget.js
+//
+// Static RAM report for a linked collar image: every .data/.bss symbol, grouped
+// by the source file that defines it, with the firmware's own (main/) total
+// checked against a budget. STATIC_ALLOC builds run it after every link (see
+// main/static_alloc.h), where it is the whole memory story: nothing in main/
+// allocates after boot, so this is all the RAM the collar's code uses apart
+// from what ESP-IDF's tasks take. The debug tasks' stacks (TASK_PLAN_DIAG_ARENA
+// in main/task_plan.h) are listed but left out of the budget, so the diagnostic
+// switches can be combined with STATIC_ALLOC.
+//
+// Usage:
+//   node tools/mem_budget.js <elf> [--nm nm] [--budget-kib 76] [--top 12]
+//
+// Needs an image built with debug info (the default for both builds), since
+// nm -l maps each symbol to its source line. Exits 1 over budget.
+
+const { execFileSync } = require('child_process');
+const path = require('path');
+
+const RAM_TYPES = new Set(['b', 'B', 'd', 'D', 's', 'S', 'g', 'G', 'v', 'V']);
+
+function parseArgs(argv) {
+    const opts = { elf: null, nm: 'nm', budgetKiB: 76, top: 12 };
+    for (let i = 0; i < argv.length; i++) {
+        if (argv[i] === '--nm') {
+            opts.nm = argv[++i];
+        } else if (argv[i] === '--budget-kib') {
+            opts.budgetKiB = Number(argv[++i]);
+        } else if (argv[i] === '--top') {
+            opts.top = parseInt(argv[++i], 10);
+        } else if (!argv[i].startsWith('--') && opts.elf === null) {
+            opts.elf = argv[i];
+        } else {
+            console.error(`Unknown argument: ${argv[i]}`);
+            process.exit(1);
+        }
+    }
+    if (opts.elf === null) {
+        console.error('Usage: node tools/mem_budget.js <elf> [--nm nm] [--budget-kib 76] [--top 12]');
+        process.exit(1);
+    }
+    return opts;
+}
+
+// [{ name, size, type, file }] for every RAM symbol with a size
+function ramSymbols(opts) {
+    const out = execFileSync(opts.nm, ['-S', '-l', '-t', 'd', '--size-sort', opts.elf], {
+        encoding: 'utf8',
+        maxBuffer: 256 * 1024 * 1024
+    });
+    const symbols = [];
+    out.split('\n').forEach((line) => {
+        const [fields, location] = line.split('\t');
+        const parts = (fields || '').trim().split(/\s+/);
+        if (parts.length < 4 || !RAM_TYPES.has(parts[2])) {
+            return;
+        }
+        const file = location ? location.replace(/:\d+$/, '') : null;
+        symbols.push({ name: parts[3], size: Number(parts[1]), type: parts[2], file });
+    });
+    return symbols;
+}
+
+// Only there in builds with a debug task switched on
+const DIAG_SYMBOLS = new Set(['s_diag_stack_arena']);
+
+function isFirmware(file) {
+    return file !== null && path.basename(path.dirname(file)) === 'main';
+}
+
+function kib(bytes) {
+    return `${(bytes / 1024).toFixed(1)} KiB`.padStart(10);
+}
+
+function main() {
+    const opts = parseArgs(process.argv.slice(2));
+    const symbols = ramSymbols(opts);
+
+    const byFile = new Map();
+    let total = 0;
+    let firmware = 0;
+    let bss = 0;
+    let diag = 0;
+    symbols.forEach((sym) => {
+        total += sym.size;
+        if ('bBsSvV'.includes(sym.type)) {
+            bss += sym.size;
+        }
+        if (isFirmware(sym.file) && DIAG_SYMBOLS.has(sym.name)) {
+            diag += sym.size;
+        } else if (isFirmware(sym.file)) {
+            firmware += sym.size;
+            const key = path.basename(sym.file);
+            byFile.set(key, (byFile.get(key) || 0) + sym.size);
+        }
+    });
+
+    console.log(`Static RAM of ${path.basename(opts.elf)}: ${kib(total).trim()} ` +
+        `(${kib(bss).trim()} zeroed, ${kib(total - bss).trim()} initialised), of which main/:`);
+    [...byFile.entries()].sort((a, b) => b[1] - a[1]).forEach(([file, bytes]) => {
+        console.log(`  ${file.padEnd(24)}${kib(bytes)}`);
+    });
+
+    console.log(`\nLargest in main/:`);
+    symbols.filter(sym => isFirmware(sym.file))
+        .sort((a, b) => b.size - a.size)
+        .slice(0, opts.top)
+        .forEach((sym) => {
+            console.log(`  ${sym.name.padEnd(32)}${String(sym.size).padStart(8)} B  ${path.basename(sym.file)}`);
+        });
+
+    if (diag > 0) {
+        console.log(`\nDebug task stacks, not in the budget: ${kib(diag).trim()}`);
+    }
+
+    const budget = opts.budgetKiB * 1024;
+    console.log(`\nmain/ uses ${kib(firmware).trim()} of its ${opts.budgetKiB} KiB budget (${(firmware / budget * 100).toFixed(0)}%)`);
+    if (firmware > budget) {
+        console.error(`Over budget by ${kib(firmware - budget).trim()}`);
+        process.exit(1);
+    }
+}
+
+main();
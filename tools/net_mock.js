@@ -0,0 +1,398 @@
+#!/usr/bin/env node
+// net_mock.js
+//
+// One simulated collar (sim/build/catcollar_sim) against mock servers, to check its
+// network task end to end. The mock stands in for both servers: a /buzz WebSocket
+// that answers time sync and HELLO, and a UDP port that takes the collar's status
+// records. It then drives the collar's downlink:
+//
+//   pushes   --pushes leader updates, --interval ms apart, each sent on the WebSocket
+//            and as a UDP datagram to the collar's port at once, as a server with both
+//            paths would. Leaders alternate between this collar and another, so every
+//            push should give exactly one buzz: on the change, or because this collar
+//            leads. Reported: buzzes per push and push-to-buzzer latency.
+//   flood    --flood more leader datagrams back to back on UDP only, all for the other
+//            cat, then --settle ms. Reported: how many the collar had read by the end.
+//   uplink   status datagrams and records the collar sent over the run, moving as
+//            --trace says (default sim/traces/sleep_wander_moonwalk.csv).
+//   accept   a second run of --handshake ms against a server that answers the upgrade
+//            with 101 but the wrong Sec-WebSocket-Accept, then sends a leader push as
+//            if connected. The collar must refuse the connection and never buzz.
+//   drop     a third run of --drop ms against a server that upgrades properly, pings the
+//            collar on its first connection and closes the socket before the pongs can
+//            go out. The collar must survive the failed send, reconnect after its
+//            back-off and buzz for the leader push it gets on the second connection.
+//
+// Collars that say "leader=seq" in their HELLO get "LEADER <seq> <id>", and the rest get
+// the bare ID. Buzzer edges come from <out>/collar-<id>.gpio, whose clock starts when
+// the simulator does; latencies are against the spawn, so they include its start-up
+// skew of a few ms.
+//
+// Usage:
+//   node tools/net_mock.js [--bin sim/build/catcollar_sim] [--id 1] [--trace FILE] [--port 3333]
+//                          [--http 3990] [--udp-bind-offset 10000] [--pushes 12] [--interval 2500]
+//                          [--flood 1000] [--settle 2000] [--handshake 3000] [--drop 14000]
+//                          [--out /tmp/net_mock] [--json]
+
+const crypto = require('crypto');
+const dgram = require('dgram');
+const fs = require('fs');
+const net = require('net');
+const os = require('os');
+const path = require('path');
+const { spawn } = require('child_process');
+const WebSocket = require('ws');
+const { LatencyHistogram } = require('../lib/trace');
+const { timesyncReply, epochUs } = require('../lib/timesync');
+
+const BUZZER_GPIO = 33; // As wired in CatCollar.c
+const OTHER_CAT = 'mock';
+const HELLO_TIMEOUT_MS = 30000;
+const WS_GUID = '258EAFA5-E914-47DA-95CA-C5AB0DC85B11'; // RFC 6455
+const DROP_PINGS = 4;
+
+function parseArgs(argv) {
+    const opts = {
+        bin: path.join(__dirname, '..', 'sim', 'build', 'catcollar_sim'),
+        id: '1',
+        trace: path.join(__dirname, '..', 'sim', 'traces', 'sleep_wander_moonwalk.csv'),
+        port: 3333,
+        http: 3990,
+        udpBindOffset: 10000,
+        pushes: 12,
+        interval: 2500,
+        flood: 1000,
+        settle: 2000,
+        handshake: 3000,
+        drop: 14000,
+        out: path.join(os.tmpdir(), 'net_mock'),
+        json: false
+    };
+    for (let i = 0; i < argv.length; i++) {
+        if (argv[i] === '--bin') {
+            opts.bin = argv[++i];
+        } else if (argv[i] === '--id') {
+            opts.id = argv[++i];
+        } else if (argv[i] === '--trace') {
+            opts.trace = argv[++i];
+        } else if (argv[i] === '--port') {
+            opts.port = parseInt(argv[++i], 10);
+        } else if (argv[i] === '--http') {
+            opts.http = parseInt(argv[++i], 10);
+        } else if (argv[i] === '--udp-bind-offset') {
+            opts.udpBindOffset = parseInt(argv[++i], 10);
+        } else if (argv[i] === '--pushes') {
+            opts.pushes = parseInt(argv[++i], 10);
+        } else if (argv[i] === '--interval') {
+            opts.interval = parseInt(argv[++i], 10);
+        } else if (argv[i] === '--flood') {
+            opts.flood = parseInt(argv[++i], 10);
+        } else if (argv[i] === '--settle') {
+            opts.settle = parseInt(argv[++i], 10);
+        } else if (argv[i] === '--handshake') {
+            opts.handshake = parseInt(argv[++i], 10);
+        } else if (argv[i] === '--drop') {
+            opts.drop = parseInt(argv[++i], 10);
+        } else if (argv[i] === '--out') {
+            opts.out = argv[++i];
+        } else if (argv[i] === '--json') {
+            opts.json = true;
+        } else {
+            console.error(`Unknown argument: ${argv[i]}`);
+            process.exit(1);
+        }
+    }
+    return opts;
+}
+
+function sleep(ms) {
+    return new Promise(resolve => setTimeout(resolve, ms));
+}
+
+// The mock servers ///////////////////////////////////////////////////////////
+
+function startServers(opts) {
+    const state = { collar: null, seqLeaders: false, hellos: 0, uplink: { datagrams: 0, records: 0 } };
+
+    const wss = new WebSocket.Server({ port: opts.http, path: '/buzz', perMessageDeflate: false });
+    const hello = new Promise((resolve) => {
+        wss.on('connection', (ws) => {
+            ws.on('message', (message) => {
+                const receivedUs = epochUs();
+                const text = message.toString();
+                const reply = timesyncReply(text, receivedUs);
+                if (reply) {
+                    ws.send(reply);
+                } else if (text.startsWith('HELLO ')) {
+                    state.collar = ws;
+                    state.seqLeaders = text.split(' ').includes('leader=seq');
+                    state.hellos++;
+                    resolve();
+                }
+            });
+        });
+    });
+
+    const uplink = dgram.createSocket('udp4');
+    uplink.on('message', (msg) => {
+        state.uplink.datagrams++;
+        state.uplink.records += msg.toString('utf8').split('\n').filter(line => line.trim() !== '').length;
+    });
+    return new Promise((resolve, reject) => {
+        uplink.once('error', reject);
+        uplink.bind(opts.port, '127.0.0.1', () => resolve({ state, wss, uplink, hello }));
+    });
+}
+
+// The collar /////////////////////////////////////////////////////////////////
+
+function startCollar(opts, http = opts.http) {
+    fs.rmSync(opts.out, { recursive: true, force: true });
+    fs.mkdirSync(opts.out, { recursive: true });
+    const child = spawn(opts.bin, [
+        '--id', opts.id, '--server', '127.0.0.1', '--port', String(opts.port),
+        '--ws-uri', `ws://127.0.0.1:${http}/buzz`, '--udp-bind-offset', String(opts.udpBindOffset),
+        '--trace', opts.trace, '--out', opts.out, '--fresh'
+    ], { stdio: ['ignore', 'pipe', 'pipe'] });
+    const log = fs.createWriteStream(path.join(opts.out, `collar-${opts.id}.log`));
+    const collar = { child, bootMs: Date.now(), report: null };
+    let pending = '';
+    child.stdout.on('data', (chunk) => {
+        log.write(chunk);
+        pending += chunk.toString();
+        const lines = pending.split('\n');
+        pending = lines.pop();
+        lines.filter(line => line.startsWith('SIMREPORT ')).forEach((line) => {
+            collar.report = JSON.parse(line.slice('SIMREPORT '.length));
+        });
+    });
+    child.stderr.pipe(log, { end: false });
+    collar.exited = new Promise(resolve => child.on('exit', resolve));
+    return collar;
+}
+
+// Rising edges of the buzzer, in ms since the collar booted
+function buzzes(opts) {
+    const file = path.join(opts.out, `collar-${opts.id}.gpio`);
+    if (!fs.existsSync(file)) {
+        return [];
+    }
+    return fs.readFileSync(file, 'utf8').split('\n')
+        .map(line => line.split(' ').map(Number))
+        .filter(([, gpio, level]) => gpio === BUZZER_GPIO && level === 1)
+        .map(([ms]) => ms);
+}
+
+// A server that switches protocols without having read the key: the upgrade gets a
+// well-formed 101 with someone else's accept value, then a leader push for this collar
+async function checkAccept(opts) {
+    const state = { upgrades: 0 };
+    const server = net.createServer((socket) => {
+        let request = '';
+        socket.on('data', (chunk) => {
+            request += chunk.toString('latin1');
+            if (!request.includes('\r\n\r\n')) {
+                return;
+            }
+            state.upgrades++;
+            request = '';
+            const push = Buffer.from(opts.id);
+            socket.write('HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n' +
+                'Sec-WebSocket-Accept: s3pPLMBiTxaQ9kYGzzhZRbK+xOo=\r\n\r\n');
+            socket.write(Buffer.concat([Buffer.from([0x81, push.length]), push]));
+        });
+        socket.on('error', () => {});
+    });
+    await new Promise(resolve => server.listen(opts.http + 1, '127.0.0.1', resolve));
+    const collarOpts = { ...opts, out: path.join(opts.out, 'accept') };
+    const collar = startCollar(collarOpts, opts.http + 1);
+    await sleep(opts.handshake);
+    collar.child.kill('SIGTERM');
+    await collar.exited;
+    server.close();
+    const ws = (collar.report || {}).ws || {};
+    return { upgrades: state.upgrades, connects: ws.connects === undefined ? null : ws.connects, buzzes: buzzes(collarOpts).length };
+}
+
+// A server that goes away mid-ping: the first connection gets its 101 and DROP_PINGS
+// pings in one write, then a close. The collar's HELLO is sent into the closed socket
+// and draws a reset, so a pong after it fails while later pings are still buffered.
+// Later connections are answered properly and get a leader push for this collar
+async function checkDrop(opts) {
+    const state = { upgrades: 0 };
+    const server = net.createServer((socket) => {
+        let request = '';
+        socket.on('data', (chunk) => {
+            request += chunk.toString('latin1');
+            if (!request.includes('\r\n\r\n')) {
+                return;
+            }
+            const key = (request.match(/Sec-WebSocket-Key: *(\S+)/i) || [])[1] || '';
+            request = '';
+            const accept = crypto.createHash('sha1').update(key + WS_GUID).digest('base64');
+            const upgrade = Buffer.from('HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n' +
+                `Sec-WebSocket-Accept: ${accept}\r\n\r\n`, 'latin1');
+            if (state.upgrades++ === 0) {
+                const ping = Buffer.from([0x89, 0x04, 0x70, 0x69, 0x6e, 0x67]);
+                socket.write(Buffer.concat([upgrade, ...Array(DROP_PINGS).fill(ping)]), () => socket.destroy());
+            } else {
+                const push = Buffer.from(opts.id);
+                socket.write(Buffer.concat([upgrade, Buffer.from([0x81, push.length]), push]));
+            }
+        });
+        socket.on('error', () => {});
+    });
+    await new Promise(resolve => server.listen(opts.http + 2, '127.0.0.1', resolve));
+    const collarOpts = { ...opts, out: path.join(opts.out, 'drop') };
+    const collar = startCollar(collarOpts, opts.http + 2);
+    let crashed = null;
+    collar.child.on('exit', (code, signal) => {
+        crashed = signal || code;
+    });
+    await sleep(opts.drop);
+    const alive = crashed === null;
+    collar.child.kill('SIGTERM');
+    await collar.exited;
+    server.close();
+    const ws = (collar.report || {}).ws || {};
+    return {
+        upgrades: state.upgrades,
+        alive,
+        exit: crashed,
+        connects: ws.connects === undefined ? null : ws.connects,
+        buzzes: buzzes(collarOpts).length
+    };
+}
+
+// Run ////////////////////////////////////////////////////////////////////////
+
+async function run(opts) {
+    const servers = await startServers(opts);
+    const collar = startCollar(opts);
+    let timer;
+    const timeout = new Promise((resolve, reject) => {
+        timer = setTimeout(() => {
+            collar.child.kill('SIGTERM');
+            reject(new Error('The collar never said HELLO'));
+        }, HELLO_TIMEOUT_MS);
+    });
+    await Promise.race([servers.hello, timeout]);
+    clearTimeout(timer);
+
+    const downlink = dgram.createSocket('udp4');
+    const collarPort = opts.port + opts.udpBindOffset;
+    let seq = Math.floor(Date.now() / 1000);
+    const leaderMessage = id => (servers.state.seqLeaders ? `LEADER ${++seq} ${id}` : id);
+    const sendBoth = (text) => {
+        servers.state.collar.send(text);
+        downlink.send(text, collarPort, '127.0.0.1');
+    };
+
+    // Pushes: every one a change, or this collar leading
+    const pushes = [];
+    for (let i = 0; i < opts.pushes; i++) {
+        const leader = i % 3 === 1 ? OTHER_CAT : opts.id;
+        pushes.push({ atMs: Date.now() - collar.bootMs, leader });
+        sendBoth(leaderMessage(leader));
+        await sleep(opts.interval);
+    }
+
+    // Flood: no change, so no buzz; the collar only has to keep up
+    const floodStart = Date.now();
+    for (let i = 0; i < opts.flood; i++) {
+        downlink.send(leaderMessage(OTHER_CAT), collarPort, '127.0.0.1');
+        if (i % 100 === 99) {
+            await sleep(1); // Let the sends drain rather than overrun the socket buffers
+        }
+    }
+    const floodSentMs = Date.now() - floodStart;
+    await sleep(opts.settle);
+
+    collar.child.kill('SIGTERM');
+    await collar.exited;
+    downlink.close();
+    servers.uplink.close();
+    servers.wss.close();
+
+    // Each push against the buzzes up to the next one
+    const edges = buzzes(opts);
+    const latency = new LatencyHistogram();
+    const perPush = pushes.map((push, i) => {
+        const endMs = i + 1 < pushes.length ? pushes[i + 1].atMs : push.atMs + opts.interval;
+        const inWindow = edges.filter(ms => ms >= push.atMs && ms < endMs);
+        if (inWindow.length > 0) {
+            latency.record((inWindow[0] - push.atMs) * 1000);
+        }
+        return inWindow.length;
+    });
+    const report = collar.report || {};
+    const udp = report.udp || {};
+    const accept = opts.handshake > 0 ? await checkAccept(opts) : null;
+    const drop = opts.drop > 0 ? await checkDrop(opts) : null;
+    return {
+        seqLeaders: servers.state.seqLeaders,
+        pushes: {
+            sent: pushes.length,
+            buzzes: perPush.reduce((sum, n) => sum + n, 0),
+            exactlyOnce: perPush.filter(n => n === 1).length,
+            latency: latency.summary()
+        },
+        flood: {
+            sent: opts.flood,
+            sentMs: floodSentMs,
+            read: udp.rx === undefined ? null : udp.rx - pushes.length
+        },
+        uplink: { collarSent: udp.tx === undefined ? null : udp.tx, ...servers.state.uplink },
+        ws: report.ws || null,
+        net: report.net || null,
+        accept,
+        drop
+    };
+}
+
+function ms(us) {
+    return us === null || us === undefined ? '-' : `${(us / 1000).toFixed(1)} ms`;
+}
+
+function print(opts, result) {
+    const { pushes, flood, uplink } = result;
+    console.log(`Collar ${opts.id} against mock servers (${result.seqLeaders ? 'LEADER <seq> <id>' : 'bare leader IDs'})`);
+    console.log(`  pushes   ${pushes.sent} on both paths: ${pushes.buzzes} buzzes, ${pushes.exactlyOnce} buzzed exactly once; ` +
+        `buzzer ${ms(pushes.latency.p50Us)} / ${ms(pushes.latency.maxUs)} after the push (p50 / max)`);
+    console.log(`  flood    ${flood.sent} datagrams in ${flood.sentMs} ms: ${flood.read === null ? '-' : flood.read} read ` +
+        `within ${opts.settle} ms`);
+    console.log(`  uplink   collar sent ${uplink.collarSent === null ? '-' : uplink.collarSent} datagrams; ` +
+        `mock got ${uplink.datagrams} datagrams, ${uplink.records} records`);
+    if (result.ws) {
+        console.log(`  ws       ${result.ws.connects} connects, ${result.ws.rx} frames in, ${result.ws.tx} out`);
+    }
+    if (result.net) {
+        console.log(`  net      ${JSON.stringify(result.net)}`);
+    }
+    if (result.accept) {
+        const { upgrades, connects, buzzes: buzzed } = result.accept;
+        console.log(`  accept   wrong Sec-WebSocket-Accept: ${upgrades} upgrades answered, ` +
+            `${connects === null ? '-' : connects} connects, ${buzzed} buzzes`);
+    }
+    if (result.drop) {
+        const { upgrades, alive, exit, connects, buzzes: buzzed } = result.drop;
+        console.log(`  drop     closed under ${DROP_PINGS} pings: ${alive ? 'collar survived' : `collar died (${exit})`}, ` +
+            `${upgrades} upgrades, ${connects === null ? '-' : connects} connects, ${buzzed} buzzes`);
+    }
+}
+
+async function main() {
+    const opts = parseArgs(process.argv.slice(2));
+    const result = await run(opts);
+    if (opts.json) {
+        console.log(JSON.stringify(result, null, 2));
+    } else {
+        print(opts, result);
+    }
+    process.exit(0);
+}
+
+main().catch((err) => {
+    console.error(err);
+    process.exit(1);
+});
@@ -0,0 +1,56 @@
+// ota_delta.js
+//
+// Build a firmware patch offline and report how much it saves; the rollout in
+// host_data.js builds and caches the same patches on demand.
+//
+// Usage:
+//   node tools/ota_delta.js old.bin new.bin [out.ccdp] [--window 11] [--lookahead 6]
+//   node tools/ota_delta.js --full new.bin [out.ccdp]
+//
+// The patch is decoded again before it is written, so a bad one never leaves this tool.
+
+const fs = require('fs');
+const { DEFAULTS, encodePatch, applyPatch } = require('../lib/ota_delta');
+
+function parseArgs(argv) {
+    const opts = { windowBits: DEFAULTS.windowBits, lookaheadBits: DEFAULTS.lookaheadBits, full: false, files: [] };
+    for (let i = 0; i < argv.length; i++) {
+        if (argv[i] === '--window') {
+            opts.windowBits = parseInt(argv[++i], 10);
+        } else if (argv[i] === '--lookahead') {
+            opts.lookaheadBits = parseInt(argv[++i], 10);
+        } else if (argv[i] === '--full') {
+            opts.full = true;
+        } else {
+            opts.files.push(argv[i]);
+        }
+    }
+    const needed = opts.full ? 1 : 2;
+    if (opts.files.length < needed || opts.files.length > needed + 1) {
+        console.error('Usage: node tools/ota_delta.js old.bin new.bin [out.ccdp] | --full new.bin [out.ccdp]');
+        process.exit(1);
+    }
+    return opts;
+}
+
+function main() {
+    const opts = parseArgs(process.argv.slice(2));
+    const old = opts.full ? Buffer.alloc(0) : fs.readFileSync(opts.files[0]);
+    const next = fs.readFileSync(opts.files[opts.full ? 0 : 1]);
+    const out = opts.files[opts.full ? 1 : 2];
+
+    const start = process.hrtime.bigint();
+    const { patch, opsLength, counts } = encodePatch(old, next, opts);
+    const encodeMs = Number(process.hrtime.bigint() - start) / 1e6;
+    applyPatch(old, patch);
+
+    console.log(`old ${old.length} B, new ${next.length} B`);
+    console.log(`ops ${opsLength} B: copy ${counts.copy} B, add ${counts.add} B, insert ${counts.insert} B, ${counts.seek} seeks`);
+    console.log(`patch ${patch.length} B (${(100 * patch.length / next.length).toFixed(2)}% of the image), ` +
+        `window 2^${opts.windowBits}, lookahead 2^${opts.lookaheadBits}, built in ${encodeMs.toFixed(0)} ms`);
+    if (out) {
+        fs.writeFileSync(out, patch);
+    }
+}
+
+main();
@@ -0,0 +1,130 @@
+// ota_rollout.js
+//
+// Roll a firmware version out to collars in waves through the /ota endpoint of
+// host_data.js, and follow it until every collar has updated, failed or been skipped.
+//
+// Usage:
+//   node tools/ota_rollout.js --version 1.1.0 [--server http://localhost:3000]
+//                             [--cats 1,2,3 | --group name] [--waves 1,4,16]
+//                             [--parallel 4] [--max-failures 0]
+//
+// The image must be in firmware/<version>.bin next to host_data.js, as must the
+// images the collars are running for them to get a delta instead of a full image.
+// --waves gives the size of each wave (the last size repeats); --parallel caps the
+// downloads in flight within a wave. The rollout stops after the wave in which the
+// failures exceed --max-failures.
+
+const fs = require('fs');
+const path = require('path');
+const http = require('http');
+
+const POLL_MS = 1000;
+
+function parseArgs(argv) {
+    const opts = { server: 'http://localhost:3000', version: null, cats: 'all', waves: [1, 4, 16], parallel: null, maxFailures: 0 };
+    for (let i = 0; i < argv.length; i++) {
+        const arg = argv[i];
+        if (arg === '--server') {
+            opts.server = argv[++i];
+        } else if (arg === '--version') {
+            opts.version = argv[++i];
+        } else if (arg === '--cats') {
+            const value = argv[++i];
+            opts.cats = value === 'all' ? 'all' : value.split(',');
+        } else if (arg === '--group') {
+            const groupsPath = path.join(__dirname, '..', 'collar_groups.json');
+            const groups = JSON.parse(fs.readFileSync(groupsPath, 'utf8'));
+            const name = argv[++i];
+            if (!groups[name]) {
+                throw new Error(`Unknown group ${name} in ${groupsPath}`);
+            }
+            opts.cats = groups[name].map(String);
+        } else if (arg === '--waves') {
+            opts.waves = argv[++i].split(',').map(Number);
+        } else if (arg === '--parallel') {
+            opts.parallel = parseInt(argv[++i], 10);
+        } else if (arg === '--max-failures') {
+            opts.maxFailures = parseInt(argv[++i], 10);
+        } else {
+            throw new Error(`Unexpected argument ${arg}`);
+        }
+    }
+    if (!opts.version) {
+        throw new Error('--version is required');
+    }
+    return opts;
+}
+
+function request(method, url, body) {
+    return new Promise((resolve, reject) => {
+        const payload = body ? JSON.stringify(body) : '';
+        const req = http.request(url, {
+            method,
+            headers: { 'Content-Type': 'application/json', 'Content-Length': Buffer.byteLength(payload) }
+        }, (res) => {
+            let data = '';
+            res.on('data', chunk => data += chunk);
+            res.on('end', () => {
+                try {
+                    resolve({ status: res.statusCode, body: JSON.parse(data) });
+                } catch (err) {
+                    reject(new Error(`Bad response (${res.statusCode}): ${data}`));
+                }
+            });
+        });
+        req.on('error', reject);
+        req.end(payload);
+    });
+}
+
+function describe(r) {
+    const size = r.bytes !== undefined ? ` ${r.delta ? 'delta' : 'full'} ${r.bytes} B` : '';
+    const radio = r.radioMs ? `, ${r.radioMs} ms download` : '';
+    return `  wave ${r.wave || '-'} cat ${r.catId}: ${r.ok ? 'ok  ' : 'FAIL'} ${r.result}` +
+        (r.from ? ` (from ${r.from}${size}${radio})` : '');
+}
+
+async function main() {
+    const opts = parseArgs(process.argv.slice(2));
+    const body = { version: opts.version, cats: opts.cats, waves: opts.waves, maxFailures: opts.maxFailures };
+    if (opts.parallel) {
+        body.parallel = opts.parallel;
+    }
+
+    const { status, body: started } = await request('POST', `${opts.server}/ota`, body);
+    if (status !== 202) {
+        console.error('Rollout rejected:', started.error);
+        process.exit(1);
+    }
+    console.log(`Rolling out ${opts.version} to ${started.targets.length} collar(s) in waves of ${opts.waves.join(', ')}`);
+
+    let printed = 0;
+    let wave = 0;
+    while (true) {
+        await new Promise(resolve => setTimeout(resolve, POLL_MS));
+        const { body: { rollout } } = await request('GET', `${opts.server}/ota`);
+        if (rollout.wave && rollout.wave !== wave) {
+            wave = rollout.wave;
+            console.log(`Wave ${wave}/${rollout.waves.length}: ${rollout.waves[wave - 1].join(', ')}`);
+        }
+        for (; printed < rollout.results.length; printed++) {
+            console.log(describe(rollout.results[printed]));
+        }
+        if (rollout.finished) {
+            if (rollout.error) {
+                console.error('Rollout failed:', rollout.error);
+                process.exit(1);
+            }
+            const s = rollout.summary;
+            const ratio = s.imageBytes ? ` (${(100 * s.patchBytes / s.imageBytes).toFixed(1)}% of ${s.imageBytes} B of full images)` : '';
+            console.log(`${s.updated} updated, ${s.current} already current, ${s.failed} failed${rollout.halted ? ', halted' : ''}`);
+            console.log(`Sent ${s.patchBytes} B${ratio}, ${s.radioMs} ms total download time`);
+            process.exit(s.failed === 0 ? 0 : 2);
+        }
+    }
+}
+
+main().catch(err => {
+    console.error(err.message);
+    process.exit(1);
+});
@@ -0,0 +1,102 @@
+// push_config.js
+//
+// Push runtime config to groups of collars through the /config endpoint of host_data.js.
+// Every collar in the group gets the change in parallel and acks or rejects it on its own.
+//
+// Usage:
+//   node tools/push_config.js [--server http://localhost:3000] [--cats 1,2,3 | --group name] key=value ...
+//   node tools/push_config.js --cats all sample_period_ms=250 samples_per_window=8
+//   node tools/push_config.js --group living_room --rollback
+//   node tools/push_config.js --cats 2 --get
+//
+// Groups are read from collar_groups.json next to host_data.js: { "living_room": ["1", "3"] }
+
+const fs = require('fs');
+const path = require('path');
+const http = require('http');
+
+function parseArgs(argv) {
+    const opts = { server: 'http://localhost:3000', cats: 'all', set: {}, rollback: false, get: false };
+    for (let i = 0; i < argv.length; i++) {
+        const arg = argv[i];
+        if (arg === '--server') {
+            opts.server = argv[++i];
+        } else if (arg === '--cats') {
+            const value = argv[++i];
+            opts.cats = value === 'all' ? 'all' : value.split(',');
+        } else if (arg === '--group') {
+            const groupsPath = path.join(__dirname, '..', 'collar_groups.json');
+            const groups = JSON.parse(fs.readFileSync(groupsPath, 'utf8'));
+            const name = argv[++i];
+            if (!groups[name]) {
+                throw new Error(`Unknown group ${name} in ${groupsPath}`);
+            }
+            opts.cats = groups[name].map(String);
+        } else if (arg === '--rollback') {
+            opts.rollback = true;
+        } else if (arg === '--get') {
+            opts.get = true;
+        } else if (arg.includes('=')) {
+            const [key, value] = arg.split('=');
+            opts.set[key] = value;
+        } else {
+            throw new Error(`Unexpected argument ${arg}`);
+        }
+    }
+    return opts;
+}
+
+function post(url, body) {
+    return new Promise((resolve, reject) => {
+        const payload = JSON.stringify(body);
+        const req = http.request(url, {
+            method: 'POST',
+            headers: { 'Content-Type': 'application/json', 'Content-Length': Buffer.byteLength(payload) }
+        }, (res) => {
+            let data = '';
+            res.on('data', chunk => data += chunk);
+            res.on('end', () => {
+                try {
+                    resolve({ status: res.statusCode, body: JSON.parse(data) });
+                } catch (err) {
+                    reject(new Error(`Bad response (${res.statusCode}): ${data}`));
+                }
+            });
+        });
+        req.on('error', reject);
+        req.end(payload);
+    });
+}
+
+async function main() {
+    const opts = parseArgs(process.argv.slice(2));
+    const body = { cats: opts.cats };
+    if (opts.rollback) {
+        body.rollback = true;
+    } else if (opts.get) {
+        body.get = true;
+    } else {
+        body.set = opts.set;
+    }
+
+    const { status, body: response } = await post(`${opts.server}/config`, body);
+    if (status !== 200) {
+        console.error('Push rejected:', response.error);
+        process.exit(1);
+    }
+
+    console.log(`Sent "${response.command}" to ${response.results.length} collar(s)`);
+    let failed = 0;
+    response.results.forEach(({ catId, ok, reply }) => {
+        console.log(`  cat ${catId}: ${ok ? 'ok  ' : 'FAIL'} ${reply}`);
+        if (!ok) {
+            failed++;
+        }
+    });
+    process.exit(failed === 0 ? 0 : 2);
+}
+
+main().catch(err => {
+    console.error(err.message);
+    process.exit(1);
+});
@@ -0,0 +1,63 @@
+#!/usr/bin/env node
+// relay_ingest.js
+//
+// Receive the uplinks of ESP-NOW gateway collars (see lib/relay_ingest.js) and log the
+// status of the leaves behind them into cat_status_log.txt and cat_data.csv.
+//
+// Usage:
+//   node tools/relay_ingest.js [--port 3340] [--quiet]
+//
+// Make collars relay with: node tools/push_config.js --cats 4,5 relay_mode=3 (applied on
+// reboot; 3 = gateway when the AP is in range, leaf otherwise).
+
+const { RelayIngest } = require('../lib/relay_ingest');
+const { flushAll } = require('../lib/log_append');
+
+const STATS_PERIOD_MS = 10000;
+
+function parseArgs(argv) {
+    const opts = { port: 3340, quiet: false };
+    for (let i = 0; i < argv.length; i++) {
+        if (argv[i] === '--port') {
+            opts.port = parseInt(argv[++i], 10);
+        } else if (argv[i] === '--quiet') {
+            opts.quiet = true;
+        } else {
+            console.error(`Unknown argument: ${argv[i]}`);
+            process.exit(1);
+        }
+    }
+    return opts;
+}
+
+function main() {
+    const opts = parseArgs(process.argv.slice(2));
+    const ingest = new RelayIngest({ port: opts.port });
+    ingest.on('error', (err) => {
+        console.error(`Relay ingest: ${err.message}`);
+        process.exit(1);
+    });
+    ingest.on('listening', port => console.log(`Listening for gateway uplinks on UDP ${port}`));
+    ingest.on('gateway', ({ gatewayId, address }) => console.log(`Gateway ${gatewayId} at ${address}`));
+    if (!opts.quiet) {
+        ingest.on('status', ({ gatewayId, catId, port, text }) =>
+            console.log(`${gatewayId} > ${catId}:${port}: ${text}`));
+    }
+    ingest.open();
+
+    setInterval(() => {
+        const s = ingest.stats();
+        const gateways = s.gateways.map(g => `${g.gatewayId} ${g.uplinks} uplinks ${g.lost} lost`).join(', ');
+        console.log(`${s.records} records from ${s.leaves} leaves, ${s.repeats} repeated batches, ` +
+            `${s.malformed} malformed; ${gateways || 'no gateways yet'}`);
+    }, STATS_PERIOD_MS);
+
+    const stop = () => {
+        flushAll();
+        process.exit(0);
+    };
+    process.on('SIGINT', stop);
+    process.on('SIGTERM', stop);
+}
+
+main();
@@ -0,0 +1,566 @@
+#!/usr/bin/env node
+// replay.js
+//
+// Recorded telemetry pushed back through the server stack, so a server change gets a
+// before and after number from the same traffic. It starts a scratch stack in --dir:
+// tools/shard_ingest.js on the collar ports and host_data.js following the status log
+// that writes (STATUS_LOG), with its HTTP on --http. Then it sends every recorded status
+// record again as a UDP datagram, at --speed times the recorded pace and with the
+// recorded gaps between records, and listens on /buzz as a collar does.
+//
+// Input is status log lines ("Port <port> | ID <ms> | Message: ..."), data log lines
+// ("<ISO time>, [<host>:<port>, ]..."), or both as LogStore keeps them under
+// logs/<name>/ (a directory, or one .part or .seg). A recorded collar is its source in
+// the data log, or its port. --scale N replays each one N times. Copy k sends from its
+// own loopback address to the port k places after the recorded one, so it is a cat of
+// its own to the ingest (and, on 3333-3335, to the leader). Copies after the first start
+// up to --jitter recorded ms later, drawn from --seed, so runs repeat exactly. Each record
+// goes out with Time: set to when it was sent and a Trace: field, so host_data.js times
+// its hops (lib/trace.js).
+//
+//   sent       records per second offered and sent, and how late the sender ran
+//   ingested   records the shards logged and lost, and the shards' CPU per record
+//   host_data  records its leaderboards applied, how long after the last send it caught
+//              up, and its CPU
+//   hops       host_data.js's store, leader and total latency (GET /metrics)
+//   leader     from the record that changes the leader the replay implies to the first
+//              /buzz push naming it. A change that another overtakes before a push is
+//              counted as superseded
+//   boards     the shards' and host_data.js's 1h and 24h boards against boards fed the
+//              replayed records, and the last leader pushed against the expected one
+//
+// Usage:
+//   node tools/replay.js [--log cat_data.csv ...] [--scale 1] [--speed 100] [--jitter 1000]
+//                        [--seed 1] [--shards 1] [--port 3333 --port 3334 ...] [--http 3903]
+//                        [--ingest-http 3902] [--dir /tmp/replay] [--json] [--save FILE]
+//                        [--compare FILE]
+//
+// --save writes the numbers as JSON, and --compare prints them next to a saved run.
+// Uses the collar ports 3333-3335 by default, so stop any ingest on them first.
+
+const dgram = require('dgram');
+const fs = require('fs');
+const os = require('os');
+const path = require('path');
+const zlib = require('zlib');
+const { performance } = require('perf_hooks');
+const { spawn } = require('child_process');
+const WebSocket = require('ws');
+const { HORIZONS, Leaderboard, parseWeights } = require('../lib/leaderboard');
+const { filesSince, readSegmentLines } = require('../lib/log_segments');
+const { LatencyHistogram } = require('../lib/trace');
+const { PORT_TO_CAT, STATE_NAMES, leaderOf, parseMessage } = require('../lib/telemetry');
+const { DEFAULT_PORTS } = require('../lib/udp_ingest');
+
+const ROOT = path.join(__dirname, '..');
+const TICK_MS = 10;
+const SETTLE_TIMEOUT_MS = 30000;
+const LEADER_PERIOD_MS = 5000; // host_data.js's push interval
+const SOURCE_RE = /^[\w.-]+:\d+$/;
+const CLOCK_TICK_MS = 10; // /proc times are in USER_HZ, 100 on Linux
+
+function parseArgs(argv) {
+    const opts = {
+        logs: [],
+        scale: 1,
+        speed: 100,
+        jitter: 1000,
+        seed: 1,
+        shards: 1,
+        ports: [],
+        http: 3903,
+        ingestHttp: 3902,
+        dir: path.join(os.tmpdir(), 'replay'),
+        json: false,
+        save: null,
+        compare: null
+    };
+    for (let i = 0; i < argv.length; i++) {
+        if (argv[i] === '--log') {
+            opts.logs.push(argv[++i]);
+        } else if (argv[i] === '--scale') {
+            opts.scale = parseInt(argv[++i], 10);
+        } else if (argv[i] === '--speed') {
+            opts.speed = Number(argv[++i]);
+        } else if (argv[i] === '--jitter') {
+            opts.jitter = Number(argv[++i]);
+        } else if (argv[i] === '--seed') {
+            opts.seed = parseInt(argv[++i], 10);
+        } else if (argv[i] === '--shards') {
+            opts.shards = parseInt(argv[++i], 10);
+        } else if (argv[i] === '--port') {
+            opts.ports.push(parseInt(argv[++i], 10));
+        } else if (argv[i] === '--http') {
+            opts.http = parseInt(argv[++i], 10);
+        } else if (argv[i] === '--ingest-http') {
+            opts.ingestHttp = parseInt(argv[++i], 10);
+        } else if (argv[i] === '--dir') {
+            opts.dir = argv[++i];
+        } else if (argv[i] === '--json') {
+            opts.json = true;
+        } else if (argv[i] === '--save') {
+            opts.save = argv[++i];
+        } else if (argv[i] === '--compare') {
+            opts.compare = argv[++i];
+        } else {
+            console.error(`Unknown argument: ${argv[i]}`);
+            process.exit(1);
+        }
+    }
+    if (opts.logs.length === 0) {
+        opts.logs = [path.join(ROOT, 'cat_data.csv')];
+    }
+    if (opts.ports.length === 0) {
+        opts.ports = DEFAULT_PORTS;
+    }
+    return opts;
+}
+
+function sleep(ms) {
+    return new Promise(resolve => setTimeout(resolve, ms));
+}
+
+// Small seeded generator (mulberry32), so the copies' offsets are the same every run
+function random(seed) {
+    let state = seed >>> 0;
+    return () => {
+        state = (state + 0x6D2B79F5) >>> 0;
+        let t = state;
+        t = Math.imul(t ^ (t >>> 15), t | 1);
+        t ^= t + Math.imul(t ^ (t >>> 7), t | 61);
+        return ((t ^ (t >>> 14)) >>> 0) / 4294967296;
+    };
+}
+
+// Input //////////////////////////////////////////////////////////////////////
+
+function readLog(file) {
+    if (fs.statSync(file).isDirectory()) {
+        return filesSince(file, 0).map(({ file: f, type }) => (type === 'rotated' ? fs.readFileSync(f) : readSegmentLines(f)));
+    }
+    if (file.endsWith('.seg') || file.endsWith('.part')) {
+        return [readSegmentLines(file)];
+    }
+    const data = fs.readFileSync(file);
+    return [file.endsWith('.gz') ? zlib.gunzipSync(data) : data];
+}
+
+// One log line into { ms, collar, port, message } or null
+function parseLine(line, defaultPort) {
+    if (line.startsWith('Port ')) {
+        const match = /^Port (\d+) \| ID (\d+) \| Message: (.*)$/.exec(line);
+        return match ? { ms: Number(match[2]), collar: `port ${match[1]}`, port: Number(match[1]), message: match[3] } : null;
+    }
+    const firstComma = line.indexOf(',');
+    const ms = firstComma > 0 ? Date.parse(line.substring(0, firstComma)) : NaN;
+    if (Number.isNaN(ms)) {
+        return null;
+    }
+    let message = line.substring(firstComma + 1).trim();
+    const secondComma = message.indexOf(',');
+    const source = secondComma > 0 ? message.substring(0, secondComma).trim() : '';
+    if (SOURCE_RE.test(source)) {
+        message = message.substring(secondComma + 1).trim();
+        return { ms, collar: source, port: Number(source.split(':').pop()), message };
+    }
+    return { ms, collar: `port ${defaultPort}`, port: defaultPort, message };
+}
+
+// Every record of every log in recorded order, and the collars in order of appearance
+function loadRecords(opts) {
+    const records = [];
+    opts.logs.forEach((file) => {
+        readLog(file).forEach((data) => {
+            data.toString('utf8').split('\n').forEach((line) => {
+                const record = line.trim() === '' ? null : parseLine(line.trim(), opts.ports[0]);
+                if (record) {
+                    records.push(record);
+                }
+            });
+        });
+    });
+    records.sort((a, b) => a.ms - b.ms);
+    const collars = new Map();
+    records.forEach((record) => {
+        if (!collars.has(record.collar)) {
+            collars.set(record.collar, { index: collars.size, port: record.port });
+        }
+        record.c = collars.get(record.collar).index;
+    });
+    return { records, collars: [...collars.values()] };
+}
+
+// Each copy of each collar as an identity: a loopback address and a port. Copy k of
+// collar c is identity k * collars + c. Returns the identities and every send in order,
+// at ms from the start of the replay.
+function plan(opts, records, collars) {
+    const rand = random(opts.seed);
+    const identities = [];
+    for (let k = 0; k < opts.scale; k++) {
+        collars.forEach((collar, c) => {
+            const i = k * collars.length + c;
+            const recorded = opts.ports.indexOf(collar.port);
+            identities.push({
+                address: `127.${(i >> 8) + 1}.0.${i & 255}`,
+                port: opts.ports[((recorded >= 0 ? recorded : c) + k) % opts.ports.length],
+                offsetMs: k === 0 ? 0 : rand() * opts.jitter
+            });
+        });
+    }
+    const t0 = records.length > 0 ? records[0].ms : 0;
+    const sends = [];
+    for (let k = 0; k < opts.scale; k++) {
+        records.forEach((record) => {
+            const identity = k * collars.length + record.c;
+            sends.push({ at: (record.ms - t0 + identities[identity].offsetMs) / opts.speed, identity, record });
+        });
+    }
+    sends.sort((a, b) => a.at - b.at);
+    return { identities, sends, recordedMs: records.length > 0 ? records[records.length - 1].ms - t0 : 0 };
+}
+
+// The recorded message with Time: and Trace: for this send
+function restamp(message, nowUs, traceId) {
+    const fields = message.split(',').map(field => field.trim())
+        .filter(field => field !== '' && !field.startsWith('Time:') && !field.startsWith('Trace:'));
+    return `${fields.join(', ')}, Time: ${nowUs}, Trace: ${(traceId >>> 0).toString(16).padStart(8, '0')} window=0 send=0\n`;
+}
+
+// The stack //////////////////////////////////////////////////////////////////
+
+// Resolves with the child once a line of its output contains ready
+function startChild(args, env, ready, name) {
+    const child = spawn(process.execPath, args, { cwd: ROOT, env: { ...process.env, ...env }, stdio: ['ignore', 'pipe', 'inherit'] });
+    return new Promise((resolve, reject) => {
+        let out = '';
+        const onData = (chunk) => {
+            out += chunk;
+            if (out.includes(ready)) {
+                out = '';
+                child.stdout.removeListener('data', onData);
+                child.stdout.resume(); // Keep reading so its logging never blocks
+                resolve(child);
+            }
+        };
+        child.stdout.on('data', onData);
+        child.on('exit', code => reject(new Error(`${name} exited (${code})`)));
+    });
+}
+
+function stopChild(child) {
+    return new Promise((resolve) => {
+        child.removeAllListeners('exit');
+        child.on('exit', resolve);
+        child.kill('SIGTERM');
+    });
+}
+
+async function startStack(opts) {
+    fs.rmSync(opts.dir, { recursive: true, force: true });
+    fs.mkdirSync(opts.dir, { recursive: true });
+    const statusLog = path.join(opts.dir, 'cat_status_log.txt');
+    const ingest = await startChild([
+        path.join(__dirname, 'shard_ingest.js'), '--shards', String(opts.shards),
+        ...opts.ports.flatMap(port => ['--port', String(port)]), '--http', String(opts.ingestHttp),
+        '--status-log', statusLog, '--data-log', path.join(opts.dir, 'cat_data.csv')
+    ], {}, 'Shard coordinator on', 'shard_ingest.js');
+    const host = await startChild([path.join(ROOT, 'host_data.js')], { PORT: String(opts.http), STATUS_LOG: statusLog },
+        'Leaderboards ready', 'host_data.js');
+    return { ingest, host };
+}
+
+function request(port, route) {
+    return fetch(`http://127.0.0.1:${port}${route}`).then(res => res.json());
+}
+
+// User and system CPU of a process in ms, or null off Linux
+function cpuMs(pid) {
+    try {
+        const fields = fs.readFileSync(`/proc/${pid}/stat`, 'utf8').split(') ').pop().split(' ');
+        return (Number(fields[11]) + Number(fields[12])) * CLOCK_TICK_MS;
+    } catch (err) {
+        return null;
+    }
+}
+
+function bindIdentity(identity) {
+    return new Promise((resolve, reject) => {
+        const socket = dgram.createSocket('udp4');
+        socket.once('error', reject);
+        socket.bind(0, identity.address, () => resolve(socket));
+    });
+}
+
+// Expected results ///////////////////////////////////////////////////////////
+
+// Follows what the replayed records imply: both servers' boards, the all-time leader
+// host_data.js computes from the status log, and when each leader change was sent
+class Reference {
+    constructor(weights) {
+        this.weights = weights;
+        this.shardBoard = new Leaderboard({ weights });
+        this.hostBoard = new Leaderboard({ weights });
+        this.catStates = {};
+        Object.values(PORT_TO_CAT).forEach((catId) => {
+            this.catStates[catId] = {};
+        });
+        this.leader = null;
+        this.changes = []; // { leader, sentMs }
+    }
+
+    add(source, port, nowMs, message) {
+        const record = parseMessage(message);
+        const state = STATE_NAMES.indexOf(record.state);
+        if (state < 0) {
+            return;
+        }
+        const catId = PORT_TO_CAT[port] || null;
+        this.shardBoard.update(source, nowMs, state, record.duration);
+        this.hostBoard.update(catId || String(port), nowMs, state, record.duration);
+        if (catId) {
+            const states = this.catStates[catId];
+            states[record.state] = (states[record.state] || 0) + record.duration;
+            const leader = leaderOf(this.catStates, this.weights);
+            if (leader !== this.leader) {
+                this.leader = leader;
+                this.changes.push({ leader, sentMs: nowMs });
+            }
+        }
+    }
+}
+
+// Leader changes against the pushes on /buzz: each change to the first push naming
+// it, unless another change came first
+function leaderLatency(changes, pushes) {
+    const histogram = new LatencyHistogram();
+    let superseded = 0;
+    let unseen = 0;
+    let p = 0;
+    changes.forEach((change, i) => {
+        const next = changes[i + 1];
+        while (p < pushes.length && pushes[p].ms < change.sentMs) {
+            p++;
+        }
+        const push = pushes.slice(p).find(entry => entry.leader === change.leader);
+        if (next && (!push || push.ms >= next.sentMs)) {
+            superseded++;
+        } else if (!push) {
+            unseen++;
+        } else {
+            histogram.record((push.ms - change.sentMs) * 1000);
+        }
+    });
+    return { changes: changes.length, superseded, unseen, ...histogram.summary() };
+}
+
+// Boards place by place: ties may rank in either order, so scores are compared
+function boardsMatch(expected, actual) {
+    return HORIZONS.filter(horizon => horizon.ms >= 3600000).map((horizon) => {
+        const want = expected.top(horizon.name);
+        const got = actual[horizon.name] || [];
+        return {
+            horizon: horizon.name,
+            match: want.length === got.length && want.every((entry, i) => Math.abs(entry.score - got[i].score) <= 0.01)
+        };
+    });
+}
+
+// Run ////////////////////////////////////////////////////////////////////////
+
+async function replay(opts) {
+    const { records, collars } = loadRecords(opts);
+    const { identities, sends, recordedMs } = plan(opts, records, collars);
+    const weights = parseWeights(process.env.LEADERBOARD_WEIGHTS || '');
+    const reference = new Reference(weights);
+    const stack = await startStack(opts);
+
+    const pushes = []; // { ms, leader }
+    const ws = new WebSocket(`ws://127.0.0.1:${opts.http}/buzz`);
+    ws.on('message', (data) => {
+        const text = data.toString();
+        if (Object.values(PORT_TO_CAT).includes(text)) {
+            pushes.push({ ms: Date.now(), leader: text });
+        }
+    });
+    await new Promise((resolve, reject) => {
+        ws.once('open', resolve);
+        ws.once('error', reject);
+    });
+    const sockets = await Promise.all(identities.map(bindIdentity));
+
+    const before = { shards: await request(opts.ingestHttp, '/shards'), hostCpuMs: cpuMs(stack.host.pid) };
+    const late = new LatencyHistogram();
+    let traceId = 0;
+    const startMs = performance.now();
+    await new Promise((resolve) => {
+        let next = 0;
+        const tick = () => {
+            const elapsed = performance.now() - startMs;
+            while (next < sends.length && sends[next].at <= elapsed) {
+                const { at, identity, record } = sends[next++];
+                const { address, port } = identities[identity];
+                const nowMs = Date.now();
+                const message = restamp(record.message, nowMs * 1000, traceId++);
+                sockets[identity].send(message, port, '127.0.0.1');
+                reference.add(`${address}:${port}`, port, nowMs, message);
+                late.record((elapsed - at) * 1000);
+            }
+            if (next === sends.length) {
+                resolve();
+            } else {
+                setTimeout(tick, Math.max(0, Math.min(TICK_MS, sends[next].at - (performance.now() - startMs))));
+            }
+        };
+        tick();
+    });
+    const sentMs = performance.now() - startMs;
+    const lastSendMs = Date.now();
+
+    // Wait for the shards to log what arrived and host_data.js to apply it
+    let ingested = 0;
+    let applied = 0;
+    let caughtUpMs = null;
+    for (let waited = 0, stable = 0; waited < SETTLE_TIMEOUT_MS && caughtUpMs === null; waited += 100) {
+        await sleep(100);
+        const { totals } = await request(opts.ingestHttp, '/shards');
+        const count = totals.records - before.shards.totals.records;
+        stable = count === ingested ? stable + 100 : 0;
+        ingested = count;
+        applied = (await request(opts.http, '/leaderboard/stats')).records;
+        if ((ingested === sends.length || stable >= 2000) && applied >= ingested) {
+            caughtUpMs = Date.now() - lastSendMs;
+        }
+    }
+    // The next push reads every line applied so far
+    const pushed = pushes.length;
+    for (let waited = 0; waited < LEADER_PERIOD_MS + 2000 && pushes.length === pushed; waited += 100) {
+        await sleep(100);
+    }
+
+    const after = { shards: await request(opts.ingestHttp, '/shards'), hostCpuMs: cpuMs(stack.host.pid) };
+    const shardBoards = (await request(opts.ingestHttp, '/leaderboard?k=10')).boards;
+    const hostBoards = (await request(opts.http, '/leaderboard?k=10')).boards;
+    const metrics = await request(opts.http, '/metrics');
+    ws.close();
+    sockets.forEach(socket => socket.close());
+    await Promise.all([stopChild(stack.ingest), stopChild(stack.host)]);
+    fs.rmSync(opts.dir, { recursive: true, force: true });
+
+    const seconds = sentMs / 1000;
+    const shardCpuMs = after.shards.totals.cpuMs - before.shards.totals.cpuMs;
+    const hostCpuMs = after.hostCpuMs === null ? null : after.hostCpuMs - before.hostCpuMs;
+    const lastPush = pushes.length > 0 ? pushes[pushes.length - 1].leader : null;
+    const hop = stage => ({ p50Us: metrics.stages[stage].p50Us, p99Us: metrics.stages[stage].p99Us });
+    return {
+        options: { logs: opts.logs, scale: opts.scale, speed: opts.speed, jitter: opts.jitter, seed: opts.seed, shards: opts.shards },
+        records: records.length,
+        collars: collars.length,
+        recordedMs,
+        cpus: os.cpus().length,
+        sent: {
+            records: sends.length,
+            seconds,
+            offeredPerSecond: sends.length / ((sends.length > 0 ? sends[sends.length - 1].at : 0) / 1000 || seconds || 1),
+            perSecond: sends.length / (seconds || 1),
+            lateP99Us: late.percentile(0.99)
+        },
+        ingested: {
+            records: ingested,
+            lost: sends.length - ingested,
+            perSecond: ingested / (seconds || 1),
+            cpuUsPerRecord: ingested > 0 ? (1000 * shardCpuMs) / ingested : null
+        },
+        host: {
+            applied,
+            caughtUpMs,
+            cpuUsPerRecord: hostCpuMs !== null && applied > 0 ? (1000 * hostCpuMs) / applied : null
+        },
+        hops: { store: hop('store'), leader: hop('leader'), total: hop('total') },
+        leader: leaderLatency(reference.changes, pushes),
+        boards: {
+            shards: boardsMatch(reference.shardBoard, shardBoards),
+            host: boardsMatch(reference.hostBoard, hostBoards),
+            leader: { expected: reference.leader, pushed: lastPush, match: reference.leader === lastPush }
+        }
+    };
+}
+
+// Report /////////////////////////////////////////////////////////////////////
+
+function ms(us) {
+    return us === null || us === undefined ? '-' : `${(us / 1000).toFixed(us < 10000 ? 1 : 0)} ms`;
+}
+
+function matches(checks) {
+    return checks.map(check => `${check.horizon} ${check.match ? 'match' : 'DIFFER'}`).join(', ');
+}
+
+function print(result) {
+    const { options, sent, ingested, host, hops, leader, boards } = result;
+    console.log(`${result.records} records from ${result.collars} collar${result.collars === 1 ? '' : 's'} (${(result.recordedMs / 60000).toFixed(1)} min recorded), ` +
+        `x${options.scale} at ${options.speed}x, ${options.shards} shards, ${result.cpus} CPUs`);
+    console.log(`  sent       ${sent.records} in ${sent.seconds.toFixed(2)} s: ${Math.round(sent.offeredPerSecond)}/s offered, ` +
+        `${Math.round(sent.perSecond)}/s sent, late ${ms(sent.lateP99Us)} at p99`);
+    console.log(`  ingested   ${ingested.records} (${ingested.lost} lost), ${Math.round(ingested.perSecond)}/s, ` +
+        `${ingested.cpuUsPerRecord === null ? '-' : ingested.cpuUsPerRecord.toFixed(1)} µs CPU/record`);
+    console.log(`  host_data  ${host.applied} applied, caught up ${host.caughtUpMs === null ? 'never' : `${host.caughtUpMs} ms`} ` +
+        `after the last send, ${host.cpuUsPerRecord === null ? '-' : host.cpuUsPerRecord.toFixed(1)} µs CPU/record`);
+    console.log(`  hops       store ${ms(hops.store.p50Us)} / ${ms(hops.store.p99Us)}, leader ${ms(hops.leader.p50Us)} / ` +
+        `${ms(hops.leader.p99Us)}, total ${ms(hops.total.p50Us)} / ${ms(hops.total.p99Us)} (p50 / p99)`);
+    console.log(`  leader     ${leader.changes} changes: ${leader.count} pushed, ${ms(leader.p50Us)} / ${ms(leader.p99Us)} / ` +
+        `${ms(leader.maxUs)} (p50 / p99 / max); ${leader.superseded} superseded, ${leader.unseen} never pushed`);
+    console.log(`  boards     shards ${matches(boards.shards)}; host_data ${matches(boards.host)}; last leader pushed ` +
+        `${boards.leader.pushed} (expected ${boards.leader.expected})`);
+}
+
+// The numbers worth comparing, as [label, value, lower is better]
+function headline(result) {
+    return [
+        ['sent/s', result.sent.perSecond, false],
+        ['lost', result.ingested.lost, true],
+        ['ingest µs CPU/record', result.ingested.cpuUsPerRecord, true],
+        ['host_data µs CPU/record', result.host.cpuUsPerRecord, true],
+        ['host_data caught up (ms)', result.host.caughtUpMs, true],
+        ['total hop p99 (ms)', result.hops.total.p99Us === null ? null : result.hops.total.p99Us / 1000, true],
+        ['leader p50 (ms)', result.leader.p50Us === null ? null : result.leader.p50Us / 1000, true],
+        ['leader p99 (ms)', result.leader.p99Us === null ? null : result.leader.p99Us / 1000, true]
+    ];
+}
+
+function compare(saved, result) {
+    const same = JSON.stringify(saved.options) === JSON.stringify(result.options);
+    console.log(`\n  ${'vs saved run'.padEnd(26)}${'before'.padStart(10)}${'after'.padStart(10)}${'change'.padStart(9)}` +
+        (same ? '' : '  (options differ)'));
+    const old = new Map(headline(saved).map(([label, value]) => [label, value]));
+    headline(result).forEach(([label, value, lowerBetter]) => {
+        const was = old.get(label);
+        const fmt = v => (v === null || v === undefined ? '-' : v.toFixed(v < 100 ? 1 : 0));
+        const percent = was && value !== null ? Math.round((100 * (value - was)) / was) : null;
+        const change = percent === null ? '' : `${percent >= 0 ? '+' : ''}${percent}%`;
+        const better = percent && (percent < 0) === lowerBetter ? ' better' : '';
+        console.log(`  ${label.padEnd(26)}${fmt(was).padStart(10)}${fmt(value).padStart(10)}${change.padStart(9)}${better}`);
+    });
+}
+
+async function main() {
+    const opts = parseArgs(process.argv.slice(2));
+    const result = await replay(opts);
+    if (opts.json) {
+        console.log(JSON.stringify(result, null, 2));
+    } else {
+        print(result);
+    }
+    if (opts.compare) {
+        compare(JSON.parse(fs.readFileSync(opts.compare, 'utf8')), result);
+    }
+    if (opts.save) {
+        fs.writeFileSync(opts.save, `${JSON.stringify(result, null, 2)}\n`);
+    }
+    const ok = result.boards.shards.concat(result.boards.host).every(check => check.match) && result.boards.leader.match;
+    process.exit(ok ? 0 : 1);
+}
+
+main().catch((err) => {
+    console.error(err);
+    process.exit(1);
+});
@@ -0,0 +1,75 @@
+#!/usr/bin/env node
+// serial_ingest.js
+//
+// Ingest the binary UART stream of one or more wired collars (see lib/serial_ingest.js)
+// into cat_status_log.txt, cat_data.csv and captures/.
+//
+// Usage:
+//   node tools/serial_ingest.js --port /dev/ttyUSB0 [--port /dev/ttyUSB1 ...] [--baud 921600]
+//                               [--send "CFG GET"] [--quiet]
+//
+// Switch a collar to the stream first with: node tools/push_config.js --cats 1 uart_baud=921600
+// Console output of each collar (LOG frames) is printed prefixed with its port unless --quiet.
+
+const { SerialIngest, flushAll } = require('../lib/serial_ingest');
+
+const STATS_PERIOD_MS = 10000;
+
+function parseArgs(argv) {
+    const opts = { ports: [], baud: 921600, send: [], quiet: false };
+    for (let i = 0; i < argv.length; i++) {
+        if (argv[i] === '--port') {
+            opts.ports.push(argv[++i]);
+        } else if (argv[i] === '--baud') {
+            opts.baud = parseInt(argv[++i], 10);
+        } else if (argv[i] === '--send') {
+            opts.send.push(argv[++i]);
+        } else if (argv[i] === '--quiet') {
+            opts.quiet = true;
+        } else {
+            console.error(`Unknown argument: ${argv[i]}`);
+            process.exit(1);
+        }
+    }
+    if (opts.ports.length === 0) {
+        console.error('At least one --port is required');
+        process.exit(1);
+    }
+    return opts;
+}
+
+function main() {
+    const opts = parseArgs(process.argv.slice(2));
+    const ingests = opts.ports.map((port) => {
+        const ingest = new SerialIngest(port, { baudRate: opts.baud });
+        ingest.on('error', (err) => console.error(`${port}: ${err.message}`));
+        ingest.on('hello', (hello) => {
+            console.log(`${port}: cat ${hello.catId}, port ${hello.port}, firmware ${hello.fw}`);
+            opts.send.forEach(text => ingest.send(text));
+        });
+        ingest.on('text', (text) => console.log(`${port}: ${text}`));
+        if (!opts.quiet) {
+            ingest.on('log', (text) => process.stdout.write(`${port}| ${text}`));
+            ingest.on('status', (text) => console.log(`${port}: ${text}`));
+        }
+        return ingest.open();
+    });
+
+    setInterval(() => {
+        ingests.forEach((ingest) => {
+            const s = ingest.stats();
+            const collar = s.collar ? `, collar sent ${s.collar.framesSent} dropped ${s.collar.framesDropped}` : '';
+            console.log(`${s.path}: ${s.frames} frames, ${s.samples} samples, ${s.crcErrors} CRC errors, ` +
+                `${s.lost} lost${collar}`);
+        });
+    }, STATS_PERIOD_MS);
+
+    const stop = () => {
+        flushAll();
+        process.exit(0);
+    };
+    process.on('SIGINT', stop);
+    process.on('SIGTERM', stop);
+}
+
+main();
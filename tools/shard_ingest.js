@@ -0,0 +1,146 @@
+#!/usr/bin/env node
+// shard_ingest.js
+//
+// The Wi-Fi ingest and the leaderboards as N shard processes (lib/shard.js), for
+// fleets one event loop cannot keep up with. Collars are spread over the shards by
+// consistent hashing of their "<address>:<port>" IDs (lib/shard_ring.js). Lines go
+// into cat_status_log.txt and cat_data.csv as from tools/udp_ingest.js, so
+// host_data.js and read_data.js work the same. The coordinator serves the merged
+// leaderboards over HTTP:
+//
+//   GET  /leaderboard?horizon=1h&group=living_room&k=5   as on host_data.js, across every shard
+//   GET  /shards                                         per-shard counts and rebalances
+//   POST /shards                                         add a shard; collars rebalance onto it
+//
+// Usage:
+//   node tools/shard_ingest.js [--shards 4] [--port 3333 --port 3334 ...] [--http 3002]
+//                              [--status-log cat_status_log.txt] [--data-log cat_data.csv]
+//
+// Listens on 3333-3335 by default. Weights come from LEADERBOARD_WEIGHTS and groups
+// from collar_groups.json, as on host_data.js; groups list collar IDs.
+
+const fs = require('fs');
+const path = require('path');
+const express = require('express');
+const { ALL, HORIZONS, parseWeights } = require('../lib/leaderboard');
+const { DEFAULT_PORTS } = require('../lib/udp_ingest');
+const { ShardCoordinator } = require('../lib/shard_coordinator');
+
+const ROOT = path.join(__dirname, '..');
+const STATS_PERIOD_MS = 10000;
+
+function parseArgs(argv) {
+    const opts = {
+        shards: 4,
+        ports: [],
+        http: 3002,
+        statusLog: path.join(ROOT, 'cat_status_log.txt'),
+        dataLog: path.join(ROOT, 'cat_data.csv')
+    };
+    for (let i = 0; i < argv.length; i++) {
+        if (argv[i] === '--shards') {
+            opts.shards = parseInt(argv[++i], 10);
+        } else if (argv[i] === '--port') {
+            opts.ports.push(parseInt(argv[++i], 10));
+        } else if (argv[i] === '--http') {
+            opts.http = parseInt(argv[++i], 10);
+        } else if (argv[i] === '--status-log') {
+            opts.statusLog = path.resolve(argv[++i]);
+        } else if (argv[i] === '--data-log') {
+            opts.dataLog = path.resolve(argv[++i]);
+        } else {
+            console.error(`Unknown argument: ${argv[i]}`);
+            process.exit(1);
+        }
+    }
+    if (opts.ports.length === 0) {
+        opts.ports = DEFAULT_PORTS;
+    }
+    return opts;
+}
+
+function loadGroups() {
+    try {
+        return JSON.parse(fs.readFileSync(path.join(ROOT, 'collar_groups.json'), 'utf8'));
+    } catch (err) {
+        if (err.code !== 'ENOENT') {
+            console.error('Error reading collar_groups.json:', err);
+        }
+        return {};
+    }
+}
+
+function serve(opts, coordinator, weights) {
+    const app = express();
+
+    app.get('/leaderboard', (req, res) => {
+        const group = req.query.group ? String(req.query.group) : ALL;
+        const k = req.query.k ? parseInt(req.query.k, 10) : undefined;
+        if (k !== undefined && !(k > 0)) {
+            res.status(400).json({ error: 'k must be a positive number' });
+            return;
+        }
+        const horizons = req.query.horizon ? [String(req.query.horizon)] : HORIZONS.map(horizon => horizon.name);
+        coordinator.top(horizons, group, k).then((boards) => {
+            if (!boards) {
+                res.status(400).json({ error: `Unknown horizon ${horizons.join(',')} or group ${group}` });
+                return;
+            }
+            res.json({ group, weights, asOf: new Date().toISOString(), boards });
+        });
+    });
+
+    app.get('/shards', (req, res) => {
+        coordinator.stats().then(stats => res.json(stats));
+    });
+
+    app.post('/shards', (req, res) => {
+        coordinator.add().then(
+            rebalance => res.json(rebalance),
+            err => res.status(500).json({ error: err.message })
+        );
+    });
+
+    app.listen(opts.http, () => console.log(`Shard coordinator on http://localhost:${opts.http}`));
+}
+
+async function main() {
+    const opts = parseArgs(process.argv.slice(2));
+    const weights = parseWeights(process.env.LEADERBOARD_WEIGHTS || '');
+    const coordinator = new ShardCoordinator({
+        ports: opts.ports,
+        statusLog: opts.statusLog,
+        dataLog: opts.dataLog,
+        weights,
+        groups: loadGroups()
+    });
+    coordinator.on('error', err => console.error(err.message));
+    coordinator.on('exit', ({ id, code, signal }) => {
+        console.error(`Shard ${id} exited (${signal || code}); its collars move to the other shards`);
+    });
+    coordinator.on('rebalanced', ({ id, shards, collars, ms }) => {
+        console.log(`Shard ${id} took over ${collars} collars in ${ms} ms; ${shards} shards`);
+    });
+
+    await coordinator.start(opts.shards);
+    console.log(`${opts.shards} shards listening for collar status on UDP ${opts.ports.join(', ')}`);
+    serve(opts, coordinator, weights);
+
+    setInterval(() => {
+        coordinator.stats().then(({ shards, totals }) => {
+            console.log(`${totals.records} records from ${totals.collars} collars, ${totals.forwarded} passed between ` +
+                `${shards.length} shards`);
+        });
+    }, STATS_PERIOD_MS);
+
+    const stop = () => {
+        coordinator.stop().then(() => process.exit(0));
+    };
+    process.on('SIGINT', stop);
+    process.on('SIGTERM', stop);
+}
+
+main().catch((err) => {
+    console.error(err);
+    process.exit(1);
+});
@@ -0,0 +1,196 @@
+#!/usr/bin/env node
+// sim_fleet.js
+//
+// Run a fleet of simulated collars (sim/build/catcollar_sim) against a server
+// and summarise their exit reports.
+//
+// Usage:
+//   node tools/sim_fleet.js [--collars 100] [--duration 60] [--server 127.0.0.1]
+//                           [--out sim_out] [--trace FILE] [--button-script FILE]
+//                           [--bin sim/build/catcollar_sim] [--fresh]
+//
+// Collars get cat IDs 1..N and UDP ports 3333-3335 in turn, like the real ones.
+// Each collar's console goes to <out>/collar-<id>.log.
+
+const fs = require('fs');
+const path = require('path');
+const { spawn } = require('child_process');
+
+function parseArgs(argv) {
+    const opts = {
+        collars: 100,
+        duration: 60,
+        server: '127.0.0.1',
+        out: 'sim_out',
+        trace: null,
+        buttonScript: null,
+        bin: path.join(__dirname, '..', 'sim', 'build', 'catcollar_sim'),
+        fresh: false,
+    };
+    for (let i = 0; i < argv.length; i++) {
+        if (argv[i] === '--collars') {
+            opts.collars = parseInt(argv[++i], 10);
+        } else if (argv[i] === '--duration') {
+            opts.duration = parseInt(argv[++i], 10);
+        } else if (argv[i] === '--server') {
+            opts.server = argv[++i];
+        } else if (argv[i] === '--out') {
+            opts.out = argv[++i];
+        } else if (argv[i] === '--trace') {
+            opts.trace = argv[++i];
+        } else if (argv[i] === '--button-script') {
+            opts.buttonScript = argv[++i];
+        } else if (argv[i] === '--bin') {
+            opts.bin = argv[++i];
+        } else if (argv[i] === '--fresh') {
+            opts.fresh = true;
+        } else {
+            console.error(`Unknown argument: ${argv[i]}`);
+            process.exit(1);
+        }
+    }
+    return opts;
+}
+
+function runCollar(opts, id) {
+    const args = [
+        '--id', String(id),
+        '--server', opts.server,
+        '--port', String(3333 + (id - 1) % 3),
+        '--out', opts.out,
+        '--duration', String(opts.duration),
+    ];
+    if (opts.trace) {
+        args.push('--trace', opts.trace);
+    }
+    if (opts.buttonScript) {
+        args.push('--button-script', opts.buttonScript);
+    }
+    if (opts.fresh) {
+        args.push('--fresh');
+    }
+
+    return new Promise(resolve => {
+        const log = fs.createWriteStream(path.join(opts.out, `collar-${id}.log`));
+        const child = spawn(opts.bin, args, { stdio: ['ignore', 'pipe', 'pipe'] });
+        const reports = [];
+        let pending = '';
+
+        child.stdout.on('data', chunk => {
+            log.write(chunk);
+            pending += chunk.toString();
+            const lines = pending.split('\n');
+            pending = lines.pop();
+            for (const line of lines) {
+                if (line.startsWith('SIMREPORT ')) {
+                    reports.push(JSON.parse(line.slice('SIMREPORT '.length)));
+                }
+            }
+        });
+        child.stderr.pipe(log, { end: false });
+        child.on('exit', code => {
+            log.end();
+            // A config-triggered restart or OTA update prints a report per boot; the last one covers the
+            // final run, but downloads happen in the boot before the update
+            const httpBytes = reports.reduce((sum, r) => sum + (r.http ? r.http.rx_bytes : 0), 0);
+            resolve({ id, code, report: reports[reports.length - 1] || null, boots: reports.length, httpBytes });
+        });
+    });
+}
+
+// Combine one task's latency histograms across collars (means weighted by count)
+function mergeLatency(samples) {
+    const n = samples.reduce((sum, s) => sum + s.n, 0);
+    const mean = n ? samples.reduce((sum, s) => sum + s.mean_us * s.n, 0) / n : 0;
+    const p99s = samples.filter(s => s.n > 0).map(s => s.p99_us).sort((a, b) => a - b);
+    return {
+        n,
+        mean,
+        worstP99: p99s.length ? p99s[p99s.length - 1] : 0,
+        medianP99: p99s.length ? p99s[Math.floor(p99s.length / 2)] : 0,
+        max: samples.reduce((max, s) => Math.max(max, s.max_us), 0),
+    };
+}
+
+function summarise(results) {
+    const reports = results.map(r => r.report).filter(Boolean);
+    const failed = results.filter(r => !r.report || r.code !== 0);
+    console.log(`${reports.length}/${results.length} collars reported` +
+        (failed.length ? `, ${failed.length} failed (ids ${failed.map(r => r.id).join(', ')})` : ''));
+    if (reports.length === 0) {
+        return;
+    }
+
+    const byTask = new Map();
+    for (const report of reports) {
+        for (const task of report.tasks) {
+            if (!byTask.has(task.name)) {
+                byTask.set(task.name, { delay: [], wake: [] });
+            }
+            byTask.get(task.name).delay.push(task.delay_late);
+            byTask.get(task.name).wake.push(task.wake_late);
+        }
+    }
+
+    console.log('\nLateness per task, all collars (us): timed delays | queue hand-offs');
+    console.log(`  ${'task'.padEnd(16)} ${'n'.padStart(8)} ${'mean'.padStart(8)} ${'p99 med'.padStart(8)} ` +
+        `${'p99 max'.padStart(8)} ${'max'.padStart(8)} | ${'n'.padStart(8)} ${'mean'.padStart(8)} ${'max'.padStart(8)}`);
+    for (const [name, lat] of byTask) {
+        const d = mergeLatency(lat.delay);
+        const w = mergeLatency(lat.wake);
+        if (d.n === 0 && w.n === 0) {
+            continue;
+        }
+        console.log(`  ${name.padEnd(16)} ${String(d.n).padStart(8)} ${d.mean.toFixed(0).padStart(8)} ` +
+            `${String(d.medianP99).padStart(8)} ${String(d.worstP99).padStart(8)} ${String(d.max).padStart(8)} | ` +
+            `${String(w.n).padStart(8)} ${w.mean.toFixed(0).padStart(8)} ${String(w.max).padStart(8)}`);
+    }
+
+    const total = key => reports.reduce((sum, r) => sum + key(r), 0);
+    const wsUp = reports.filter(r => r.ws.connected).length;
+    console.log('\nNetwork');
+    console.log(`  UDP sent      ${total(r => r.udp.tx)} datagrams, ${total(r => r.udp.tx_errors)} errors`);
+    console.log(`  UDP received  ${total(r => r.udp.rx)} datagrams`);
+    console.log(`  WebSocket     ${wsUp}/${reports.length} connected at exit, ` +
+        `${total(r => r.ws.connects)} connects, ${total(r => r.ws.rx)} frames in, ${total(r => r.ws.tx)} out`);
+    console.log(`  HTTP (OTA)    ${results.reduce((sum, r) => sum + r.httpBytes, 0)} bytes in`);
+
+    const versions = new Map();
+    for (const report of reports) {
+        const key = `${report.fw.version} (${report.fw.slot}, ${report.fw.state})`;
+        versions.set(key, (versions.get(key) || 0) + 1);
+    }
+    console.log('\nFirmware at exit');
+    for (const [version, count] of versions) {
+        console.log(`  ${String(count).padStart(5)} on ${version}`);
+    }
+
+    console.log('\nPeripherals');
+    console.log(`  I2C           ${total(r => r.i2c.transactions)} transactions, ${total(r => r.i2c.nacks)} NACKs, ` +
+        `bus busy ${(total(r => r.i2c.busy_us) / reports.length / 1e6).toFixed(2)} s per collar`);
+    console.log(`  Display       ${total(r => r.display_frames)} frames`);
+    console.log(`  Button        ${total(r => r.gpio_isr_calls)} interrupts`);
+    console.log(`  UART          ${total(r => r.uart ? r.uart.tx_bytes : 0)} bytes out, ` +
+        `${total(r => r.uart ? r.uart.rx_bytes : 0)} in`);
+}
+
+async function main() {
+    const opts = parseArgs(process.argv.slice(2));
+    if (!fs.existsSync(opts.bin)) {
+        console.error(`${opts.bin} not found; build it with: cmake -S sim -B sim/build && cmake --build sim/build`);
+        process.exit(1);
+    }
+    fs.mkdirSync(opts.out, { recursive: true });
+
+    console.log(`Starting ${opts.collars} collars for ${opts.duration} s against ${opts.server}`);
+    const runs = [];
+    for (let id = 1; id <= opts.collars; id++) {
+        runs.push(runCollar(opts, id));
+    }
+    // Ctrl-C stops the fleet early; every collar still prints its report
+    process.on('SIGINT', () => {});
+
+    summarise(await Promise.all(runs));
+}
+
+main();
@@ -0,0 +1,58 @@
+#!/usr/bin/env node
+// udp_ingest.js
+//
+// Receive the status datagrams of Wi-Fi collars (see lib/udp_ingest.js) and log them
+// into cat_status_log.txt and cat_data.csv.
+//
+// Usage:
+//   node tools/udp_ingest.js [--port 3333 --port 3334 ...] [--quiet]
+//
+// Listens on 3333-3335 by default, the ports the collars and the simulator send to.
+
+const { UdpIngest } = require('../lib/udp_ingest');
+const { flushAll } = require('../lib/log_append');
+
+const STATS_PERIOD_MS = 10000;
+
+function parseArgs(argv) {
+    const opts = { ports: [], quiet: false };
+    for (let i = 0; i < argv.length; i++) {
+        if (argv[i] === '--port') {
+            opts.ports.push(parseInt(argv[++i], 10));
+        } else if (argv[i] === '--quiet') {
+            opts.quiet = true;
+        } else {
+            console.error(`Unknown argument: ${argv[i]}`);
+            process.exit(1);
+        }
+    }
+    return opts;
+}
+
+function main() {
+    const opts = parseArgs(process.argv.slice(2));
+    const ingest = new UdpIngest({ ports: opts.ports });
+    ingest.on('error', (err) => {
+        console.error(`UDP ingest: ${err.message}`);
+        process.exit(1);
+    });
+    ingest.on('listening', port => console.log(`Listening for collar status on UDP ${port}`));
+    if (!opts.quiet) {
+        ingest.on('status', ({ source, text }) => console.log(`${source}: ${text}`));
+    }
+    ingest.open();
+
+    setInterval(() => {
+        const s = ingest.stats();
+        console.log(`${s.records} records in ${s.datagrams} datagrams from ${s.collars} collars`);
+    }, STATS_PERIOD_MS);
+
+    const stop = () => {
+        flushAll();
+        process.exit(0);
+    };
+    process.on('SIGINT', stop);
+    process.on('SIGTERM', stop);
+}
+
+main();